@@ -87,6 +87,27 @@ if(ENABLE_TIFF)
 	endif()
 endif(ENABLE_TIFF)
 
+# search for native HEIF/AVIF and JPEG XL decoders - Qt's image plugins are used otherwise
+unset(LIBHEIF_FOUND CACHE)
+if(ENABLE_HEIF OR ENABLE_AVIF)
+	pkg_check_modules(LIBHEIF libheif>=1.13.0)
+	if(LIBHEIF_FOUND)
+		add_definitions(-DWITH_LIBHEIF)
+	else()
+		message(STATUS "libheif not found - HEIF/AVIF files are decoded by Qt's image plugins")
+	endif()
+endif()
+
+unset(LIBJXL_FOUND CACHE)
+if(ENABLE_JXL)
+	pkg_check_modules(LIBJXL libjxl libjxl_threads)
+	if(LIBJXL_FOUND)
+		add_definitions(-DWITH_LIBJXL)
+	else()
+		message(STATUS "libjxl not found - JPEG XL files are decoded by Qt's image plugins")
+	endif()
+endif()
+
 #search for quazip
 unset(QUAZIP_SOURCE_DIRECTORY CACHE)
 unset(QUAZIP_INCLUDE_DIRECTORY CACHE)
@@ -13,7 +13,7 @@ set(BINARY_NAME ${PROJECT_NAME})
 set(DLL_CORE_NAME ${PROJECT_NAME}Core)
 
 #binary
-link_directories(${LIBRAW_LIBRARY_DIRS} ${OpenCV_LIBRARY_DIRS} ${EXIV2_LIBRARY_DIRS} ${CMAKE_BINARY_DIR})
+link_directories(${LIBRAW_LIBRARY_DIRS} ${OpenCV_LIBRARY_DIRS} ${EXIV2_LIBRARY_DIRS} ${LIBHEIF_LIBRARY_DIRS} ${LIBJXL_LIBRARY_DIRS} ${CMAKE_BINARY_DIR})
 add_executable(${BINARY_NAME} WIN32  MACOSX_BUNDLE ${NOMACS_EXE_SOURCES} ${NOMACS_EXE_HEADERS} ${NOMACS_QM} ${NOMACS_TRANSLATIONS} ${NOMACS_RC} ${QUAZIP_SOURCES})
 target_link_libraries(
 	${BINARY_NAME}
@@ -48,6 +48,8 @@ target_link_libraries(
 	${OpenCV_LIBS}
 	${TIFF_LIBRARIES}
 	${QUAZIP_LIBRARIES}
+	${LIBHEIF_LIBRARIES}
+	${LIBJXL_LIBRARIES}
 	)
 set_property(TARGET ${DLL_CORE_NAME} PROPERTY VERSION ${NOMACS_VERSION_MAJOR}.${NOMACS_VERSION_MINOR}.${NOMACS_VERSION_PATCH})
 set_property(TARGET ${DLL_CORE_NAME} PROPERTY SOVERSION ${NOMACS_VERSION_MAJOR})
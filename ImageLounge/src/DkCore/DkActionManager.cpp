@@ -425,6 +425,8 @@ QMenu *DkActionManager::createSortMenu(QWidget *parent)
     mSortMenu->addAction(mSortActions[menu_sort_file_size]);
     mSortMenu->addAction(mSortActions[menu_sort_date_created]);
     mSortMenu->addAction(mSortActions[menu_sort_date_modified]);
+    mSortMenu->addAction(mSortActions[menu_sort_date_taken]);
+    mSortMenu->addAction(mSortActions[menu_sort_rating]);
     mSortMenu->addAction(mSortActions[menu_sort_random]);
     mSortMenu->addSeparator();
     mSortMenu->addAction(mSortActions[menu_sort_ascending]);
@@ -946,43 +948,44 @@ void DkActionManager::init()
 
 void DkActionManager::createIcons()
 {
+    // most icons are in menus only - so rasterize them when they are shown first
     mFileIcons.resize(icon_file_end);
-    mFileIcons[icon_file_dir] = DkImage::loadIcon(":/nomacs/img/dir.svg");
-    mFileIcons[icon_file_open] = DkImage::loadIcon(":/nomacs/img/open.svg");
-    mFileIcons[icon_file_save] = DkImage::loadIcon(":/nomacs/img/save.svg");
-    mFileIcons[icon_file_print] = DkImage::loadIcon(":/nomacs/img/print.svg");
+    mFileIcons[icon_file_dir] = DkImage::loadIconDeferred(":/nomacs/img/dir.svg");
+    mFileIcons[icon_file_open] = DkImage::loadIconDeferred(":/nomacs/img/open.svg");
+    mFileIcons[icon_file_save] = DkImage::loadIconDeferred(":/nomacs/img/save.svg");
+    mFileIcons[icon_file_print] = DkImage::loadIconDeferred(":/nomacs/img/print.svg");
     mFileIcons[icon_file_open_large] = QIcon(":/nomacs/img/open.svg");
     mFileIcons[icon_file_dir_large] = QIcon(":/nomacs/img/dir.svg");
-    mFileIcons[icon_file_prev] = DkImage::loadIcon(":/nomacs/img/previous.svg");
-    mFileIcons[icon_file_next] = DkImage::loadIcon(":/nomacs/img/next.svg");
+    mFileIcons[icon_file_prev] = DkImage::loadIconDeferred(":/nomacs/img/previous.svg");
+    mFileIcons[icon_file_next] = DkImage::loadIconDeferred(":/nomacs/img/next.svg");
     mFileIcons[icon_file_filter] = DkImage::loadIcon();
     mFileIcons[icon_file_filter].addPixmap(DkImage::loadIcon(":/nomacs/img/filter.svg"), QIcon::Normal, QIcon::On);
     mFileIcons[icon_file_filter].addPixmap(DkImage::loadIcon(":/nomacs/img/filter-disabled.svg"), QIcon::Normal, QIcon::Off);
-    mFileIcons[icon_file_find] = DkImage::loadIcon(":/nomacs/img/find.svg");
+    mFileIcons[icon_file_find] = DkImage::loadIconDeferred(":/nomacs/img/find.svg");
 
     mEditIcons.resize(icon_edit_end);
-    mEditIcons[icon_edit_image] = DkImage::loadIcon(":/nomacs/img/sliders.svg");
-    mEditIcons[icon_edit_rotate_cw] = DkImage::loadIcon(":/nomacs/img/rotate-cw.svg");
-    mEditIcons[icon_edit_rotate_ccw] = DkImage::loadIcon(":/nomacs/img/rotate-cc.svg");
-    mEditIcons[icon_edit_crop] = DkImage::loadIcon(":/nomacs/img/crop.svg");
-    mEditIcons[icon_edit_resize] = DkImage::loadIcon(":/nomacs/img/resize.svg");
-    mEditIcons[icon_edit_copy] = DkImage::loadIcon(":/nomacs/img/copy.svg");
-    mEditIcons[icon_edit_paste] = DkImage::loadIcon(":/nomacs/img/paste.svg");
-    mEditIcons[icon_edit_delete] = DkImage::loadIcon(":/nomacs/img/trash.svg");
+    mEditIcons[icon_edit_image] = DkImage::loadIconDeferred(":/nomacs/img/sliders.svg");
+    mEditIcons[icon_edit_rotate_cw] = DkImage::loadIconDeferred(":/nomacs/img/rotate-cw.svg");
+    mEditIcons[icon_edit_rotate_ccw] = DkImage::loadIconDeferred(":/nomacs/img/rotate-cc.svg");
+    mEditIcons[icon_edit_crop] = DkImage::loadIconDeferred(":/nomacs/img/crop.svg");
+    mEditIcons[icon_edit_resize] = DkImage::loadIconDeferred(":/nomacs/img/resize.svg");
+    mEditIcons[icon_edit_copy] = DkImage::loadIconDeferred(":/nomacs/img/copy.svg");
+    mEditIcons[icon_edit_paste] = DkImage::loadIconDeferred(":/nomacs/img/paste.svg");
+    mEditIcons[icon_edit_delete] = DkImage::loadIconDeferred(":/nomacs/img/trash.svg");
 
     mViewIcons.resize(icon_view_end);
-    mViewIcons[icon_view_fullscreen] = DkImage::loadIcon(":/nomacs/img/fullscreen.svg");
-    mViewIcons[icon_view_reset] = DkImage::loadIcon(":/nomacs/img/zoom-reset.svg");
-    mViewIcons[icon_view_100] = DkImage::loadIcon(":/nomacs/img/zoom-100.svg");
-    mViewIcons[icon_view_gps] = DkImage::loadIcon(":/nomacs/img/location.svg");
-    mViewIcons[icon_view_zoom_in] = DkImage::loadIcon(":/nomacs/img/zoom-in.svg");
-    mViewIcons[icon_view_zoom_out] = DkImage::loadIcon(":/nomacs/img/zoom-out.svg");
+    mViewIcons[icon_view_fullscreen] = DkImage::loadIconDeferred(":/nomacs/img/fullscreen.svg");
+    mViewIcons[icon_view_reset] = DkImage::loadIconDeferred(":/nomacs/img/zoom-reset.svg");
+    mViewIcons[icon_view_100] = DkImage::loadIconDeferred(":/nomacs/img/zoom-100.svg");
+    mViewIcons[icon_view_gps] = DkImage::loadIconDeferred(":/nomacs/img/location.svg");
+    mViewIcons[icon_view_zoom_in] = DkImage::loadIconDeferred(":/nomacs/img/zoom-in.svg");
+    mViewIcons[icon_view_zoom_out] = DkImage::loadIconDeferred(":/nomacs/img/zoom-out.svg");
 
     mViewIcons[icon_view_movie_play] = DkImage::loadIcon(":/nomacs/img/play.svg");
     mViewIcons[icon_view_movie_play].addPixmap(DkImage::loadIcon(":/nomacs/img/play.svg"), QIcon::Normal, QIcon::On);
     mViewIcons[icon_view_movie_play].addPixmap(DkImage::loadIcon(":/nomacs/img/pause.svg"), QIcon::Normal, QIcon::Off);
-    mViewIcons[icon_view_movie_prev] = DkImage::loadIcon(":/nomacs/img/previous.svg");
-    mViewIcons[icon_view_movie_next] = DkImage::loadIcon(":/nomacs/img/next.svg");
+    mViewIcons[icon_view_movie_prev] = DkImage::loadIconDeferred(":/nomacs/img/previous.svg");
+    mViewIcons[icon_view_movie_next] = DkImage::loadIconDeferred(":/nomacs/img/next.svg");
 }
 
 void DkActionManager::createActions(QWidget *parent)
@@ -1116,6 +1119,18 @@ void DkActionManager::createActions(QWidget *parent)
     mSortActions[menu_sort_random]->setCheckable(true);
     mSortActions[menu_sort_random]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_random);
 
+    mSortActions[menu_sort_date_taken] = new QAction(QObject::tr("by Date &Taken"), parent);
+    mSortActions[menu_sort_date_taken]->setObjectName("menu_sort_date_taken");
+    mSortActions[menu_sort_date_taken]->setStatusTip(QObject::tr("Sort by the Date the Photo was Taken"));
+    mSortActions[menu_sort_date_taken]->setCheckable(true);
+    mSortActions[menu_sort_date_taken]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_date_taken);
+
+    mSortActions[menu_sort_rating] = new QAction(QObject::tr("by &Rating"), parent);
+    mSortActions[menu_sort_rating]->setObjectName("menu_sort_rating");
+    mSortActions[menu_sort_rating]->setStatusTip(QObject::tr("Sort by Rating"));
+    mSortActions[menu_sort_rating]->setCheckable(true);
+    mSortActions[menu_sort_rating]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_rating);
+
     mSortActions[menu_sort_ascending] = new QAction(QObject::tr("&Ascending"), parent);
     mSortActions[menu_sort_ascending]->setObjectName("menu_sort_ascending");
     mSortActions[menu_sort_ascending]->setStatusTip(QObject::tr("Sort in Ascending Order"));
@@ -1551,6 +1566,12 @@ void DkActionManager::createActions(QWidget *parent)
     mPreviewActions[preview_print]->setToolTip(QObject::tr("Prints selected files."));
     mPreviewActions[preview_print]->setShortcut(QKeySequence::Print);
 
+    mPreviewActions[preview_select_similar] = new QAction(QObject::tr("Select Si&milar"), parent);
+    mPreviewActions[preview_select_similar]->setToolTip(QObject::tr("Selects images that look like the selected images."));
+
+    mPreviewActions[preview_select_duplicates] = new QAction(QObject::tr("Select D&uplicates"), parent);
+    mPreviewActions[preview_select_duplicates]->setToolTip(QObject::tr("Selects all but the first image of each group of (near) duplicates."));
+
     // hidden actions
     mHiddenActions.resize(sc_end);
 
@@ -1654,7 +1675,7 @@ void DkActionManager::createActions(QWidget *parent)
 
     // trivial connects
     QObject::connect(action(menu_panel_toggle), &QAction::triggered, [](bool hide) {
-        DkSettingsManager::param().app().hideAllPanels = hide;
+        DkSettingsManager::edit().app().hideAllPanels = hide;
     });
 
     QObject::connect(action(menu_panel_statusbar), &QAction::triggered, [](bool show) {
@@ -1666,7 +1687,7 @@ void DkActionManager::createActions(QWidget *parent)
     });
 
     QObject::connect(action(menu_sync_all_actions), &QAction::triggered, [](bool sync) {
-        DkSettingsManager::param().sync().syncActions = sync;
+        DkSettingsManager::edit().sync().syncActions = sync;
     });
 }
 
@@ -1786,7 +1807,7 @@ void DkActionManager::enableImageActions(bool enable) const
 
 void DkActionManager::enableMovieActions(bool enable) const
 {
-    DkSettingsManager::param().app().showMovieToolBar = enable;
+    DkSettingsManager::edit().app().showMovieToolBar = enable;
 
     action(DkActionManager::menu_view_movie_pause)->setEnabled(enable);
     action(DkActionManager::menu_view_movie_prev)->setEnabled(enable);
@@ -148,6 +148,8 @@ public:
         menu_sort_date_created,
         menu_sort_date_modified,
         menu_sort_random,
+        menu_sort_date_taken,
+        menu_sort_rating,
         menu_sort_ascending,
         menu_sort_descending,
 
@@ -317,6 +319,8 @@ public:
         preview_filter,
         preview_batch,
         preview_print,
+        preview_select_similar,
+        preview_select_duplicates,
 
         actions_end
     };
@@ -27,6 +27,7 @@
 
 #include "DkBaseViewPort.h"
 #include "DkActionManager.h"
+#include "DkMovie.h"
 #include "DkSettings.h"
 #include "DkStatusBar.h"
 #include "DkUtils.h"
@@ -35,7 +36,6 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QMainWindow>
-#include <QMovie>
 #include <QScrollBar>
 #include <QShortcut>
 #include <QSvgRenderer>
@@ -132,7 +132,7 @@ void DkBaseViewPort::fullView()
 
 void DkBaseViewPort::togglePattern(bool show)
 {
-    DkSettingsManager::param().display().tpPattern = show;
+    DkSettingsManager::edit().display().tpPattern = show;
     update();
 }
 
@@ -530,26 +530,78 @@ void DkBaseViewPort::draw(QPainter &painter, double opacity)
     painter.setOpacity(opacity);
 
     if (mSvg && mSvg->isValid()) {
-        mSvg->render(&painter, mImgViewRect);
+        if (mSvgTiles)
+            mSvgTiles->draw(painter, mImgViewRect, viewport()->rect());
+        else
+            mSvg->render(&painter, mImgViewRect);
     } else if (mMovie && mMovie->isValid()) {
-        painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
+        painter.drawImage(mImgViewRect, mMovie->currentImage(), mMovie->frameRect());
     } else {
-        // if we have the exact level cached: render it directly
-        if (displayRect.width() == img.width() && displayRect.height() == img.height()) {
+        const bool colorManaged = DkColorManager::instance().needsTransform(img);
+
+        // if we have the exact level cached: render it directly (tiles are color managed)
+        if (displayRect.width() == img.width() && displayRect.height() == img.height() && !colorManaged) {
             painter.setWorldMatrixEnabled(false);
             painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
-            painter.drawImage(displayRect, img, img.rect());
+            painter.drawImage(displayRect, mImgStorage.displayImage(img), img.rect());
             painter.setWorldMatrixEnabled(true);
         } else {
             if (mImgMatrix.m11() * mWorldMatrix.m11() - std::numeric_limits<double>::epsilon() < 1.0)
                 painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
-            painter.drawImage(mImgViewRect, img, img.rect());
+
+            if (img.width() > DkImageStorage::tiled_image_size || img.height() > DkImageStorage::tiled_image_size || colorManaged)
+                drawTiles(painter, img);
+            else
+                painter.drawImage(mImgViewRect, mImgStorage.displayImage(img), img.rect());
         }
     }
 
     painter.setOpacity(oldOp);
 }
 
+/**
+ * Draws the tiles of img that intersect the viewport.
+ * Hence, the costs of panning & zooming scale with the screen size
+ * rather than the image size (e.g. for gigapixel panoramas).
+ * @param painter the painter with the world transform set
+ * @param img the image that is drawn to mImgViewRect
+ **/
+void DkBaseViewPort::drawTiles(QPainter &painter, const QImage &img)
+{
+    if (img.isNull())
+        return;
+
+    double sx = mImgViewRect.width() / img.width();
+    double sy = mImgViewRect.height() / img.height();
+
+    // maps image pixels to the viewport
+    QTransform imgToView = QTransform::fromScale(sx, sy) * QTransform::fromTranslate(mImgViewRect.left(), mImgViewRect.top());
+    QRect visible = (imgToView * painter.worldTransform()).inverted().mapRect(QRectF(viewport()->rect())).toAlignedRect() & img.rect();
+
+    if (visible.isEmpty())
+        return;
+
+    // antialiased edges would leave seams between the tiles
+    bool aa = painter.testRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+
+    int ts = DkImageStorage::tile_size;
+
+    for (int row = visible.top() / ts; row <= visible.bottom() / ts; row++) {
+        for (int col = visible.left() / ts; col <= visible.right() / ts; col++) {
+            QPixmap pm = mImgStorage.tile(img, col, row);
+
+            if (pm.isNull())
+                continue;
+
+            QRectF target(mImgViewRect.left() + col * ts * sx, mImgViewRect.top() + row * ts * sy, pm.width() * sx, pm.height() * sy);
+            painter.drawPixmap(target, pm, pm.rect());
+        }
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing, aa);
+}
+
 void DkBaseViewPort::drawPattern(QPainter &painter) const
 {
     QBrush pt = mPattern;
@@ -54,6 +54,8 @@ class QSettings;
 
 namespace nmc
 {
+class DkMovie;
+
 class DllCoreExport DkBaseViewPort : public QGraphicsView
 {
     Q_OBJECT
@@ -170,8 +172,9 @@ protected:
     Qt::KeyboardModifier mCtrlMod;
 
     DkImageStorage mImgStorage;
-    QSharedPointer<QMovie> mMovie;
+    QSharedPointer<DkMovie> mMovie;
     QSharedPointer<QSvgRenderer> mSvg;
+    QSharedPointer<DkSvgTiles> mSvgTiles;
     QBrush mPattern;
 
     QTransform mImgMatrix;
@@ -198,6 +201,7 @@ protected:
     // functions
     virtual void draw(QPainter &painter, double opacity = 1.0);
     virtual void drawPattern(QPainter &painter) const;
+    void drawTiles(QPainter &painter, const QImage &img);
     virtual void updateImageMatrix();
     virtual QTransform getScaledImageMatrix() const;
     virtual QTransform getScaledImageMatrix(const QSize &size) const;
@@ -27,17 +27,25 @@
 
 #include "DkBasicLoader.h"
 
+#include "DkCodecs.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
+#include "DkLog.h"
 #include "DkMath.h"
 #include "DkMetaData.h"
+#include "DkParallelEncoder.h"
+#include "DkReadAhead.h"
+#include "DkScratch.h"
 #include "DkSettings.h"
+#include "DkSharedImages.h"
 #include "DkTimer.h"
 #include "DkUtils.h" // just needed for qInfo() #ifdef
 
 #pragma warning(push, 0)
 #include <QBuffer>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QIcon>
 #include <QImage>
@@ -48,9 +56,13 @@
 #include <QObject>
 #include <QPixmap>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
+#include <algorithm>
 #include <assert.h>
+#include <mutex>
 #include <qmath.h>
 
 // quazip
@@ -89,7 +101,6 @@
 // #endif // defined(Q_OS_MAC) || defined(Q_OS_OPENBSD)
 
 #include <tiffio.h>
-#include <tiffio.hxx> // this is needed if you want to load tiffs from the buffer
 
 // #if defined(Q_OS_MAC) || defined(Q_OS_OPENBSD)
 #undef uint64
@@ -141,7 +152,7 @@ DkEditImage::DkEditImage(const QSharedPointer<DkMetaDataT> &metaData, const QIma
 bool DkEditImage::hasImage() const
 {
     // Every edit item has an image, but it may be the old/original one if only metadata has been edited
-    return !mImg.isNull();
+    return !mImg.isNull() || mIsDelta;
 }
 
 bool DkEditImage::hasMetaData() const
@@ -165,8 +176,17 @@ bool DkEditImage::hasNewMetaData() const
 void DkEditImage::setImage(const QImage &img)
 {
     mImg = img;
+
+    mIsDelta = false;
+    mDeltaTiles.clear();
+    mDeltaBytes = 0;
 }
 
+/**
+ * Returns the image of this history item.
+ * Delta items return a NULL image, use DkBasicLoader::historyImage() instead.
+ * @return QImage the image
+ **/
 QImage DkEditImage::image() const
 {
     return mImg;
@@ -182,9 +202,216 @@ QString DkEditImage::editName() const
     return mEditName;
 }
 
-int DkEditImage::size() const
+/**
+ * Returns the memory used by this history item in MB.
+ * @return float the memory in MB
+ **/
+float DkEditImage::size() const
+{
+    if (mIsDelta)
+        return mDeltaBytes / (1024.0f * 1024.0f);
+
+    return DkImage::getBufferSizeFloat(mImg.size(), mImg.depth());
+}
+
+bool DkEditImage::isDelta() const
+{
+    return mIsDelta;
+}
+
+QRect DkEditImage::deltaTile(int tileIdx, const QSize &size) const
+{
+    int numCols = (size.width() + delta_tile - 1) / delta_tile;
+    QRect r((tileIdx % numCols) * delta_tile, (tileIdx / numCols) * delta_tile, delta_tile, delta_tile);
+
+    return r.intersected(QRect(QPoint(), size));
+}
+
+/**
+ * Stores the image as difference to its successor in the history.
+ * Only tiles that differ from the successor are kept (zlib compressed).
+ * Edits that only change the metadata then cost (almost) no memory.
+ * @param successor the image of the next history item
+ * @return bool true if the item was converted, false if the images are not compatible or the delta would not save memory
+ **/
+bool DkEditImage::toDelta(const QImage &successor)
+{
+    // only images with identical memory layouts can be compared
+    if (mIsDelta || mImg.isNull() || successor.size() != mImg.size() || successor.format() != mImg.format() || mImg.depth() < 8
+        || !mImg.colorTable().isEmpty())
+        return false;
+
+    DkTimer dt;
+
+    const QImage &img = mImg;
+    const int bpp = img.depth() / 8;
+    const int numCols = (img.width() + delta_tile - 1) / delta_tile;
+    const int numRows = (img.height() + delta_tile - 1) / delta_tile;
+
+    QVector<int> tiles(numCols * numRows);
+    for (int idx = 0; idx < tiles.size(); idx++)
+        tiles[idx] = idx;
+
+    QVector<QByteArray> data(tiles.size());
+    QByteArray *dPtr = data.data();
+
+    QtConcurrent::blockingMap(tiles, [&](const int &tIdx) {
+        QRect r = deltaTile(tIdx, img.size());
+        int rowBytes = r.width() * bpp;
+        int xBytes = r.x() * bpp;
+
+        bool changed = false;
+        for (int y = r.top(); y <= r.bottom() && !changed; y++)
+            changed = memcmp(img.constScanLine(y) + xBytes, successor.constScanLine(y) + xBytes, rowBytes) != 0;
+
+        if (!changed)
+            return;
+
+        QByteArray raw(rowBytes * r.height(), Qt::Uninitialized);
+        for (int y = r.top(); y <= r.bottom(); y++)
+            memcpy(raw.data() + (size_t)(y - r.top()) * rowBytes, img.constScanLine(y) + xBytes, rowBytes);
+
+        dPtr[tIdx] = qCompress(raw, 1);
+    });
+
+    QVector<QPair<int, QByteArray>> deltaTiles;
+    qint64 deltaBytes = 0;
+
+    for (int idx = 0; idx < data.size(); idx++) {
+        if (!data[idx].isEmpty()) {
+            deltaTiles << qMakePair(idx, data[idx]);
+            deltaBytes += data[idx].size();
+        }
+    }
+
+    // not worth it (e.g. noisy images with global changes)
+    if (deltaBytes > img.sizeInBytes() * 0.75)
+        return false;
+
+    mDeltaTiles = deltaTiles;
+    mDeltaBytes = (int)deltaBytes;
+    mDeltaSize = img.size();
+    mDeltaDpmX = img.dotsPerMeterX();
+    mDeltaDpmY = img.dotsPerMeterY();
+    mIsDelta = true;
+    mImg = QImage();
+
+    qDebug() << "[DkEditImage]" << mEditName << "stored as" << mDeltaTiles.size() << "tiles (" << mDeltaBytes / 1024 << "KB) in" << dt;
+
+    return true;
+}
+
+/**
+ * Restores the image of a delta item.
+ * @param successor the image of the next history item
+ * @return QImage the restored image (or the item's image if it is not a delta)
+ **/
+QImage DkEditImage::fromDelta(const QImage &successor) const
+{
+    if (!mIsDelta)
+        return mImg;
+
+    if (successor.size() != mDeltaSize)
+        return QImage();
+
+    QImage img = successor.copy();
+    img.setDotsPerMeterX(mDeltaDpmX);
+    img.setDotsPerMeterY(mDeltaDpmY);
+
+    const int bpp = img.depth() / 8;
+    const int bpl = img.bytesPerLine();
+    uchar *bits = img.bits();
+
+    QVector<int> tiles(mDeltaTiles.size());
+    for (int idx = 0; idx < tiles.size(); idx++)
+        tiles[idx] = idx;
+
+    QtConcurrent::blockingMap(tiles, [&](const int &idx) {
+        const QPair<int, QByteArray> &tile = mDeltaTiles[idx];
+        QRect r = deltaTile(tile.first, mDeltaSize);
+        int rowBytes = r.width() * bpp;
+
+        QByteArray raw = qUncompress(tile.second);
+        if (raw.size() != rowBytes * r.height())
+            return;
+
+        for (int y = r.top(); y <= r.bottom(); y++)
+            memcpy(bits + (size_t)y * bpl + r.x() * bpp, raw.constData() + (size_t)(y - r.top()) * rowBytes, rowBytes);
+    });
+
+    return img;
+}
+
+/**
+ * Returns the formats the Qt decoders support.
+ * The plugins do not change at runtime.
+ * @return const QList<QByteArray>& the formats
+ **/
+static const QList<QByteArray> &qtImageFormats()
+{
+    static const QList<QByteArray> formats = []() {
+        QList<QByteArray> f = QImageReader::supportedImageFormats();
+        f << "jpe"; // fixes #435 - thumbnail gets loaded in the RAW loader
+        return f;
+    }();
+
+    return formats;
+}
+
+// DkDecoderRegistry --------------------------------------------------------------------
+DkDecoderRegistry::DkDecoderRegistry()
+{
+    DkBasicLoader::registerDecoders(*this);
+}
+
+DkDecoderRegistry &DkDecoderRegistry::instance()
+{
+    static DkDecoderRegistry inst;
+    return inst;
+}
+
+/**
+ * Adds a decoder.
+ * It is tried after all decoders that were added before.
+ * @param decoder the decoder
+ **/
+void DkDecoderRegistry::add(const DkDecoder &decoder)
+{
+    QMutexLocker locker(&mMutex);
+    mDecoders << decoder;
+}
+
+/**
+ * Returns the decoders that should be tried for a request in their order.
+ * Decoders that only answer preview requests are removed for full requests.
+ * For previews, decoders that skip the full resolution come first.
+ * Note that the decoders still need to accept the request (see DkDecoder::accepts)
+ * - some of them depend on what the decoders before have tried.
+ * @param request the request
+ * @return QVector<DkDecoder> the decoders
+ **/
+QVector<DkDecoder> DkDecoderRegistry::candidates(const DkDecodeRequest &request) const
 {
-    return qRound(DkImage::getBufferSizeFloat(mImg.size(), mImg.depth()));
+    QVector<DkDecoder> decoders;
+    {
+        QMutexLocker locker(&mMutex);
+        decoders = mDecoders;
+    }
+
+    if (!request.isPreview()) {
+        decoders.erase(std::remove_if(decoders.begin(),
+                                      decoders.end(),
+                                      [](const DkDecoder &d) {
+                                          return (d.capabilities & DkDecoder::cap_preview_only) != 0;
+                                      }),
+                       decoders.end());
+    } else {
+        std::stable_partition(decoders.begin(), decoders.end(), [](const DkDecoder &d) {
+            return (d.capabilities & (DkDecoder::cap_scaled | DkDecoder::cap_preview_only)) != 0;
+        });
+    }
+
+    return decoders;
 }
 
 // Basic loader and image edit class --------------------------------------------------------------------
@@ -211,17 +438,47 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, bool loadMetaData, bool
  **/
 bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArray> ba, bool loadMetaData, bool fast)
 {
-    DkTimer dt;
+    return loadGeneral(filePath, ba, loadMetaData, fast, QSharedPointer<DkMetaDataT>());
+}
+
+bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArray> ba, QSharedPointer<DkMetaDataT> metaData, bool fast)
+{
+    return loadGeneral(filePath, ba, true, fast, metaData);
+}
+
+bool DkBasicLoader::loadGeneral(const QString &filePath,
+                                QSharedPointer<QByteArray> ba,
+                                bool loadMetaData,
+                                bool fast,
+                                QSharedPointer<DkMetaDataT> parsedMetaData)
+{
+    DkTraceSpan dt("loader", "DkBasicLoader::loadGeneral", filePath);
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
     bool imgLoaded = false;
 
+    // checked between the decoders - a canceled load is not needed anymore
+    auto canceled = [&]() {
+        if (!isCanceled())
+            return false;
+
+        qCInfo(lcLoader) << "[Basic Loader]" << filePath << "canceled after" << dt;
+        return true;
+    };
+
     mFile = DkUtils::resolveSymLink(filePath);
     QFileInfo fInfo(mFile); // resolved lnk
     QString newSuffix = fInfo.suffix();
 
     release();
 
+    // the caller parsed the metadata already - don't do it twice
+    if (parsedMetaData)
+        mMetaData = parsedMetaData;
+
     if (mPageIdxDirty)
         imgLoaded = loadPage();
+    else
+        mPageOffsets.clear(); // new file - pages are indexed while decoding
 
     // identify raw images:
     // newSuffix.contains(QRegExp("(nef|crw|cr2|arw|rw2|mrw|dng)", Qt::CaseInsensitive)))
@@ -230,7 +487,7 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
     // Qt considers an orientation of 0 as wrong and fails to load these jpgs
     // however, the old nomacs wrote 0 if the orientation should be cleared
     // so we simply adopt the memory here
-    if (loadMetaData && mMetaData) {
+    if (loadMetaData && mMetaData && !parsedMetaData) {
         try {
             mMetaData->readMetaData(filePath, ba);
         } catch (...) {
@@ -239,120 +496,81 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
         qDebug() << "metaData is NULL!";
     }
 
-    QList<QByteArray> qtFormats = QImageReader::supportedImageFormats();
-    qtFormats << "jpe"; // fixes #435 - thumbnail gets loaded in the RAW loader
-    QString suf = fInfo.suffix().toLower();
-
-    QImage img;
+    if (canceled())
+        return false;
 
-    // load drif file
-    if (!imgLoaded && ("drif" == suf || "yuv" == suf || "raw" == suf))
-        imgLoaded = loadDrifFile(mFile, img, ba);
+    const QList<QByteArray> &qtFormats = qtImageFormats();
+    QString suf = fInfo.suffix().toLower();
 
-    if (!imgLoaded && !fInfo.exists() && ba && !ba->isEmpty()) {
-        imgLoaded = img.loadFromData(*ba.data());
+    // the magic bytes tell us which decoder to use - an empty format keeps the full cascade
+    QByteArray fmt = imgLoaded ? QByteArray() : sniffFormat(mFile, ba);
+    bool tiffMagic = fmt == "tif"; // RAW files are tiff containers too
+    bool jpgSuffix = suf == "jpg" || suf == "jpeg" || suf == "jpe" || suf == "jfif";
 
-        if (imgLoaded)
-            mLoader = qt_loader;
-    }
+    // Qt format used to decode - prefer the magic bytes if the file has a wrong extension
+    QByteArray qtFmt = suf.toLatin1();
+    if (!fmt.isEmpty() && !tiffMagic && fmt != qtFmt && !(fmt == "jpg" && jpgSuffix) && qtFormats.contains(fmt)
+        && (qtFormats.contains(qtFmt) || suf.isEmpty()))
+        qtFmt = fmt;
 
-    // load large icons
-    if (!imgLoaded && suf == "ico") {
-        QIcon icon(mFile);
+    bool isTiff = newSuffix.contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption))
+        || (tiffMagic && qtFormats.contains(suf.toLatin1()));
 
-        if (!icon.isNull()) {
-            img = icon.pixmap(QSize(256, 256)).toImage();
-            imgLoaded = true;
-        }
-    }
+    QImage img;
 
-    // default Qt loader
-    // here we just try those formats that are officially supported
-    if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str()) || suf.isEmpty()) {
-        // if image has Indexed8 + alpha channel -> we crash... sorry for that
-        if (!ba || ba->isEmpty())
-            imgLoaded = img.load(mFile, suf.toStdString().c_str());
-        else
-            imgLoaded = img.loadFromData(*ba.data(), suf.toStdString().c_str()); // toStdString() in order get 1 byte per char
+    // another tab or a synchronized instance might have decoded this file already
+    bool shareable = !imgLoaded && loadMetaData && !fast && !mTargetSize.isValid();
+    bool attached = false;
+    bool registered = false;
 
-        if (imgLoaded)
-            mLoader = qt_loader;
-    }
+    if (shareable) {
+        img = DkImageRegistry::instance().find(mFile, mPageIdx, &mLoader);
+        registered = !img.isNull();
 
-    // OpenCV Tiff loader - supports jpg compressed tiffs
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption))) {
-        imgLoaded = loadTIFFile(mFile, img, ba);
+        if (!registered && DkSharedImages::isEnabled())
+            img = DkSharedImages::instance().attach(mFile, mPageIdx, &mLoader);
 
-        if (imgLoaded)
-            mLoader = tif_loader;
+        imgLoaded = attached = !img.isNull();
     }
 
-    // PSD loader
+    DkDecodeRequest request;
+    request.filePath = mFile;
+    request.suffix = suf;
+    request.format = fmt;
+    request.qtFormat = qtFmt;
+    request.buffer = ba;
+    request.targetSize = mTargetSize;
+    request.fast = fast;
+    request.exists = fInfo.exists();
+    request.isTiff = isTiff;
+    request.tiffMagic = tiffMagic;
+
+    // try the decoders until one succeeds (see registerDecoders)
     if (!imgLoaded) {
-        imgLoaded = loadPSDFile(mFile, img, ba);
-        if (imgLoaded)
-            mLoader = psd_loader;
-    }
-
-    // RAW loader
-    if (!imgLoaded && !qtFormats.contains(suf.toStdString().c_str())) {
-        // TODO: sometimes (e.g. _DSC6289.tif) strange opencv errors are thrown - catch them!
-        // load raw files
-        imgLoaded = loadRawFile(mFile, img, ba, fast);
-        if (imgLoaded)
-            mLoader = raw_loader;
-    }
-
-    // TGA loader
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(tga)", QRegularExpression::CaseInsensitiveOption))) {
-        imgLoaded = loadTgaFile(mFile, img, ba);
-
-        if (imgLoaded)
-            mLoader = tga_loader; // TODO: add tga loader
-    }
+        for (const DkDecoder &d : DkDecoderRegistry::instance().candidates(request)) {
+            if (canceled())
+                return false;
 
-    QByteArray lba;
+            if (!d.accepts(request))
+                continue;
 
-    // default Qt loader
-    if (!imgLoaded && !newSuffix.contains(QRegularExpression("(roh)", QRegularExpression::CaseInsensitiveOption))) {
-        // if we first load files to buffers, we can additionally load images with wrong extensions (rainer bugfix : )
-        // TODO: add warning here
-        loadFileToBuffer(mFile, lba);
-        imgLoaded = img.loadFromData(lba);
-
-        if (imgLoaded)
-            qWarning() << "The image seems to have a wrong extension";
-
-        if (imgLoaded)
-            mLoader = qt_loader;
-    }
-
-    // add marker to fix broken panorama images from SAMSUNG
-    // see: https://github.com/nomacs/nomacs/issues/254
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(jpg|jpeg|jpe)", QRegularExpression::CaseInsensitiveOption))) {
-        // prefer external buffer
-        QByteArray baf = DkImage::fixSamsungPanorama(ba && !ba->isEmpty() ? *ba : lba);
+            request.loader = no_loader;
 
-        if (!baf.isEmpty())
-            imgLoaded = img.loadFromData(baf, suf.toStdString().c_str());
+            if (d.decode(*this, request)) {
+                img = request.img;
+                imgLoaded = true;
 
-        if (imgLoaded)
-            mLoader = qt_loader;
-    }
+                if (request.loader != no_loader)
+                    mLoader = request.loader;
 
-    // this loader is a bit buggy -> be carefull
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(roh)", QRegularExpression::CaseInsensitiveOption))) {
-        imgLoaded = loadRohFile(mFile, img, ba);
-        if (imgLoaded)
-            mLoader = roh_loader;
+                qCDebug(lcLoader) << "[Basic Loader]" << filePath << "decoded by" << d.name;
+                break;
+            }
+        }
     }
 
-    // this loader is for OpenCV cascade training files
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(vec)", QRegularExpression::CaseInsensitiveOption))) {
-        imgLoaded = loadOpenCVVecFile(mFile, img, ba);
-        if (imgLoaded)
-            mLoader = roh_loader;
-    }
+    if (canceled())
+        return false;
 
     // tiff things
     if (imgLoaded && !mPageIdxDirty)
@@ -364,8 +582,9 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
             mMetaData->setQtValues(img);
             int orientation = mMetaData->getOrientationDegree();
 
-            if (orientation != -1 && !mMetaData->isTiff() && !mMetaData->isAVIF() && !mMetaData->isHEIF() && !mMetaData->isJXL()
-                && !DkSettingsManager::param().metaData().ignoreExifOrientation) {
+            // shared images are rotated already - upright images (0) are not touched
+            if (!attached && orientation != -1 && orientation != 0 && !mMetaData->isTiff() && !mMetaData->isAVIF() && !mMetaData->isHEIF() && !mMetaData->isJXL()
+                && !settings->metaData().ignoreExifOrientation) {
                 img = DkImage::rotateImage(img, orientation);
             }
 
@@ -375,17 +594,487 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
         qDebug() << "metaData is NULL!";
     }
 
+    // memory-mapped images would be copied to the heap
+    bool mapped = imgLoaded && DkMappedImage::isMapped(img);
+
+    // opaque or gray images do not need 4 bytes per pixel - shared images are compact already
+    if (imgLoaded && !attached && !mapped)
+        img = DkImage::compactFormat(img);
+
+    // huge TIFFs (region loader) and RAW previews are not shared - peers need their loader state
+    if (imgLoaded && shareable && !mRegionLoader && !mIsRawPreview && !mapped) {
+        if (!attached && DkSharedImages::isEnabled())
+            img = DkSharedImages::instance().publish(mFile, mPageIdx, img, mLoader);
+        if (!registered)
+            DkImageRegistry::instance().add(mFile, mPageIdx, img, mLoader);
+    }
+
     if (imgLoaded)
         setEditImage(img, tr("Original Image"));
 
     if (imgLoaded)
-        qInfo() << "[Basic Loader]" << filePath << "loaded in" << dt;
+        qCInfo(lcLoader) << "[Basic Loader]" << filePath << "loaded in" << dt;
     else
         qWarning() << "[Basic Loader] could not load" << filePath;
 
     return imgLoaded;
 }
 
+/**
+ * Adds nomacs' decoders to the registry.
+ * The order is important: specialized decoders come first, guessing ones last.
+ * @param registry the registry
+ **/
+void DkBasicLoader::registerDecoders(DkDecoderRegistry &registry)
+{
+    auto decoder = [&registry](const QString &name,
+                               int capabilities,
+                               std::function<bool(const DkDecodeRequest &)> accepts,
+                               std::function<bool(DkBasicLoader &, DkDecodeRequest &)> decode) {
+        DkDecoder d;
+        d.name = name;
+        d.capabilities = capabilities;
+        d.accepts = accepts;
+        d.decode = decode;
+        registry.add(d);
+    };
+
+    // load drif file
+    decoder(
+        "drif",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return "drif" == r.suffix || "yuv" == r.suffix || "raw" == r.suffix;
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            return l.loadDrifFile(r.filePath, r.img, r.buffer);
+        });
+
+    // the file does not exist (e.g. zip archives)
+    decoder(
+        "buffer",
+        DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return !r.exists && r.buffer && !r.buffer->isEmpty();
+        },
+        [](DkBasicLoader &, DkDecodeRequest &r) {
+            r.loader = qt_loader;
+            return r.img.loadFromData(*r.buffer.data());
+        });
+
+    // load large icons
+    decoder(
+        "ico",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.suffix == "ico";
+        },
+        [](DkBasicLoader &, DkDecodeRequest &r) {
+            QIcon icon(r.filePath);
+
+            if (icon.isNull())
+                return false;
+
+            r.img = icon.pixmap(QSize(256, 256)).toImage();
+            return true;
+        });
+
+    // PSD - skip the layers (before the Qt loader since its plugin decodes them all)
+    decoder(
+        "psd-merged",
+        DkDecoder::cap_scaled | DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return r.format == "psd";
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = psd_loader;
+            return l.loadPSDFast(r.filePath, r.img, r.buffer);
+        });
+
+#ifdef WITH_LIBHEIF
+    // HEIF & AVIF - thumbnail items answer previews, grid tiles are decoded in parallel
+    decoder(
+        "heif",
+        DkDecoder::cap_scaled | DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return r.format == "heic" || r.format == "avif" || r.suffix == "heic" || r.suffix == "heif" || r.suffix == "hif" || r.suffix == "avif";
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = heif_loader;
+            return l.loadHeifFile(r.filePath, r.img, r.buffer);
+        });
+#endif
+
+#ifdef WITH_LIBJXL
+    // JPEG XL - the preview frame answers previews
+    decoder(
+        "jxl",
+        DkDecoder::cap_scaled | DkDecoder::cap_cancel | DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return r.format == "jxl" || (r.format.isEmpty() && r.suffix == "jxl");
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = jxl_loader;
+            return l.loadJxlFile(r.filePath, r.img, r.buffer);
+        });
+#endif
+
+    // decode a downscaled version directly if the caller does not need the full resolution
+    decoder(
+        "qt-scaled",
+        DkDecoder::cap_scaled | DkDecoder::cap_preview_only | DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return qtImageFormats().contains(r.qtFormat);
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = qt_loader;
+            return l.loadScaledFile(r.filePath, r.img, r.qtFormat, r.buffer);
+        });
+
+    // images that do not fit into the RAM are decoded to a memory-mapped file
+    // only large files are checked since the header is parsed twice
+    decoder(
+        "qt-mapped",
+        DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            if (r.isPreview() || !qtImageFormats().contains(r.qtFormat))
+                return false;
+
+            qint64 fileSize = r.buffer && !r.buffer->isEmpty() ? r.buffer->size() : QFileInfo(r.filePath).size();
+            return fileSize > (16 << 20);
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = qt_loader;
+            return l.loadMappedFile(r.filePath, r.img, r.qtFormat, r.buffer);
+        });
+
+    // default Qt loader
+    // here we just try those formats that are officially supported
+    decoder(
+        "qt",
+        DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return qtImageFormats().contains(r.qtFormat) || r.suffix.isEmpty();
+        },
+        [](DkBasicLoader &, DkDecodeRequest &r) {
+            bool loaded;
+
+            // if image has Indexed8 + alpha channel -> we crash... sorry for that
+            if (!r.buffer || r.buffer->isEmpty())
+                loaded = r.img.load(r.filePath, r.qtFormat.constData());
+            else
+                loaded = r.img.loadFromData(*r.buffer.data(), r.qtFormat.constData());
+
+            // the magic bytes were right but the decoder failed - guessing the format won't help
+            r.qtTried = !r.format.isEmpty() && r.qtFormat == r.format;
+            r.loader = qt_loader;
+
+            return loaded;
+        });
+
+    // huge TIFFs - only decode an overview, the viewport decodes the visible regions
+    decoder(
+        "tiff-overview",
+        DkDecoder::cap_scaled | DkDecoder::cap_region | DkDecoder::cap_cancel,
+        [](const DkDecodeRequest &r) {
+            return r.isTiff;
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = tif_loader;
+            return l.loadTIFFOverview(r.filePath, r.img);
+        });
+
+    // OpenCV Tiff loader - supports jpg compressed tiffs
+    decoder(
+        "tiff",
+        DkDecoder::cap_pages | DkDecoder::cap_cancel,
+        [](const DkDecodeRequest &r) {
+            return r.isTiff;
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = tif_loader;
+            return l.loadTIFFile(r.filePath, r.img, r.buffer);
+        });
+
+    // PSD loader
+    decoder(
+        "psd",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.format.isEmpty() || r.format == "psd";
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = psd_loader;
+            return l.loadPSDFile(r.filePath, r.img, r.buffer);
+        });
+
+    // RAW loader
+    decoder(
+        "raw",
+        DkDecoder::cap_cancel,
+        [](const DkDecodeRequest &r) {
+            return !qtImageFormats().contains(r.suffix.toLatin1()) && (r.format.isEmpty() || r.tiffMagic);
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            // TODO: sometimes (e.g. _DSC6289.tif) strange opencv errors are thrown - catch them!
+            r.loader = raw_loader;
+            return l.loadRawFile(r.filePath, r.img, r.buffer, r.fast);
+        });
+
+    // TGA loader
+    decoder(
+        "tga",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.suffix.contains("tga");
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = tga_loader;
+            return l.loadTgaFile(r.filePath, r.img, r.buffer);
+        });
+
+    // default Qt loader
+    decoder(
+        "qt-guess",
+        DkDecoder::cap_thread_safe,
+        [](const DkDecodeRequest &r) {
+            return !r.qtTried && !r.suffix.contains("roh");
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            // if we first load files to buffers, we can additionally load images with wrong extensions (rainer bugfix : )
+            l.loadFileToBuffer(r.filePath, r.fileBuffer);
+
+            if (!r.img.loadFromData(r.fileBuffer))
+                return false;
+
+            qWarning() << "The image seems to have a wrong extension";
+            r.loader = qt_loader;
+            return true;
+        });
+
+    // add marker to fix broken panorama images from SAMSUNG
+    // see: https://github.com/nomacs/nomacs/issues/254
+    decoder(
+        "samsung-panorama",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.suffix.contains(QRegularExpression("(jpg|jpeg|jpe)"));
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            if ((!r.buffer || r.buffer->isEmpty()) && r.fileBuffer.isEmpty())
+                l.loadFileToBuffer(r.filePath, r.fileBuffer);
+
+            // prefer external buffer
+            QByteArray baf = DkImage::fixSamsungPanorama(r.buffer && !r.buffer->isEmpty() ? *r.buffer : r.fileBuffer);
+
+            r.loader = qt_loader;
+            return !baf.isEmpty() && r.img.loadFromData(baf, r.suffix.toStdString().c_str());
+        });
+
+    // this loader is a bit buggy -> be carefull
+    decoder(
+        "roh",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.suffix.contains("roh");
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = roh_loader;
+            return l.loadRohFile(r.filePath, r.img, r.buffer);
+        });
+
+    // this loader is for OpenCV cascade training files
+    decoder(
+        "vec",
+        DkDecoder::cap_none,
+        [](const DkDecodeRequest &r) {
+            return r.suffix.contains("vec");
+        },
+        [](DkBasicLoader &l, DkDecodeRequest &r) {
+            r.loader = roh_loader;
+            return l.loadOpenCVVecFile(r.filePath, r.img, r.buffer);
+        });
+}
+
+/**
+ * Identifies the image format from the file's magic bytes.
+ * RAW files (and most camera formats) are reported as tif since they are tiff containers.
+ * @param header the first bytes of the file (a few KB are plenty)
+ * @return QByteArray the Qt format name (e.g. jpg, png, tif) or an empty array if unknown.
+ **/
+QByteArray DkBasicLoader::sniffFormat(const QByteArray &header)
+{
+    auto startsWith = [&header](const QByteArray &magic, int offset = 0) {
+        return header.mid(offset, magic.size()) == magic;
+    };
+
+    if (startsWith("\xFF\xD8\xFF"))
+        return "jpg";
+    if (startsWith("\x89PNG\r\n\x1A\n"))
+        return "png";
+    if (startsWith("GIF87a") || startsWith("GIF89a"))
+        return "gif";
+    if (startsWith("RIFF") && startsWith("WEBP", 8))
+        return "webp";
+    if (startsWith(QByteArrayLiteral("II*\0")) || startsWith(QByteArrayLiteral("MM\0*")) || startsWith(QByteArrayLiteral("II+\0"))
+        || startsWith(QByteArrayLiteral("MM\0+")))
+        return "tif";
+    if (startsWith("8BPS"))
+        return "psd";
+    if (startsWith("BM") && header.size() >= 14)
+        return "bmp";
+    if (header.size() >= 6 && header[0] == 0 && header[1] == 0 && header[2] == 1 && header[3] == 0)
+        return "ico";
+    if (startsWith("\xFF\x0A") || startsWith(QByteArrayLiteral("\0\0\0\x0CJXL \r\n\x87\n")))
+        return "jxl";
+    if (startsWith("ftyp", 4)) {
+        if (startsWith("avif", 8) || startsWith("avis", 8))
+            return "avif";
+        if (startsWith("heic", 8) || startsWith("heix", 8))
+            return "heic";
+        return QByteArray(); // e.g. CR3 or generic HEIF brands
+    }
+    if (header.size() >= 3 && header[0] == 'P' && QByteArray(" \t\r\n").contains(header[2])) {
+        switch (header[1]) {
+        case '1':
+        case '4':
+            return "pbm";
+        case '2':
+        case '5':
+            return "pgm";
+        case '3':
+        case '6':
+            return "ppm";
+        }
+    }
+
+    return QByteArray();
+}
+
+/**
+ * Identifies the image format of the file to be loaded.
+ * The result is cached so that reloads (e.g. page switches) do not read the file again.
+ * @param filePath the image file
+ * @param ba the file buffer (can be empty)
+ * @return QByteArray the format or an empty array if unknown.
+ **/
+QByteArray DkBasicLoader::sniffFormat(const QString &filePath, QSharedPointer<QByteArray> ba)
+{
+    if (ba && !ba->isEmpty())
+        return sniffFormat(QByteArray::fromRawData(ba->constData(), qMin(ba->size(), (int)sniff_size)));
+
+    QDateTime modified = QFileInfo(filePath).lastModified();
+
+    if (filePath == mSniffedFile && modified == mSniffedModified)
+        return mSniffedFormat;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    mSniffedFormat = sniffFormat(file.read(sniff_size));
+    mSniffedFile = filePath;
+    mSniffedModified = modified;
+
+    return mSniffedFormat;
+}
+
+/**
+ * Loads the image downscaled to (at least) the target size.
+ * This only works for decoders that support QImageIOHandler::ScaledSize.
+ * The JPEG decoder then uses libjpeg's DCT scaling (1/2, 1/4, 1/8) which is
+ * considerably faster and needs a fraction of the memory.
+ * @param filePath the image file
+ * @param img the loaded image
+ * @param format the image format (suffix)
+ * @param ba the file buffer (can be empty)
+ * @return bool true if a scaled image could be loaded.
+ **/
+bool DkBasicLoader::loadScaledFile(const QString &filePath, QImage &img, const QByteArray &format, QSharedPointer<QByteArray> ba) const
+{
+    QFile file(filePath);
+    QBuffer buffer;
+    QImageReader reader;
+
+    if (!ba || ba->isEmpty()) {
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        reader.setDevice(&file);
+    } else {
+        buffer.setData(*ba.data());
+        buffer.open(QIODevice::ReadOnly);
+        reader.setDevice(&buffer);
+    }
+    reader.setFormat(format);
+
+    if (!reader.supportsOption(QImageIOHandler::ScaledSize))
+        return false;
+
+    QSize s = reader.size();
+
+    // nothing to gain
+    if (!s.isValid() || (s.width() <= mTargetSize.width() && s.height() <= mTargetSize.height()))
+        return false;
+
+    // the image may be rotated (Exif) - so fill the target size in both directions
+    int ts = qMax(mTargetSize.width(), mTargetSize.height());
+    s.scale(QSize(ts, ts), Qt::KeepAspectRatioByExpanding);
+    s = s.boundedTo(reader.size());
+    reader.setScaledSize(s);
+
+    return reader.read(&img);
+}
+
+/**
+ * Decodes images that are larger than the RAM can hold to a memory-mapped file.
+ * Qt's handlers decode into the image passed if its size and format
+ * match - hence, the pixels never touch the heap.
+ * @param filePath the image file
+ * @param img the loaded image
+ * @param format the image format (suffix)
+ * @param ba the file buffer (can be empty)
+ * @return bool false if the image is small enough for the heap or could not be loaded.
+ **/
+bool DkBasicLoader::loadMappedFile(const QString &filePath, QImage &img, const QByteArray &format, QSharedPointer<QByteArray> ba) const
+{
+    QFile file(filePath);
+    QBuffer buffer;
+    QImageReader reader;
+
+    if (!ba || ba->isEmpty()) {
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        reader.setDevice(&file);
+    } else {
+        buffer.setData(*ba.data());
+        buffer.open(QIODevice::ReadOnly);
+        reader.setDevice(&buffer);
+    }
+    reader.setFormat(format);
+
+    QSize s = reader.size();
+    QImage::Format f = reader.imageFormat();
+
+    if (!DkMappedImage::shouldMap(s, f))
+        return false;
+
+    img = DkMappedImage::allocate(s, f);
+
+    // fall back to the heap
+    if (img.isNull())
+        return false;
+
+    if (!reader.read(&img)) {
+        img = QImage();
+        return false;
+    }
+
+    if (!DkMappedImage::isMapped(img))
+        qCWarning(lcLoader) << "[Basic Loader]" << filePath << "- the decoder did not use the mapped memory";
+
+    return true;
+}
+
 /**
  * Loads special RAW files that are generated by the Hamamatsu camera.
  * @param fileName the filename of the file to be loaded.
@@ -469,24 +1158,435 @@ bool nmc::DkBasicLoader::loadTgaFile(const QString &filePath, QImage &img, QShar
  * @param ba the file loaded into a bytearray.
  * @return bool true if the file could be loaded.
  **/
-bool DkBasicLoader::loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba, bool fast) const
+bool DkBasicLoader::loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba, bool fast)
 {
     DkRawLoader rawLoader(filePath, mMetaData);
     rawLoader.setLoadFast(fast);
+    rawLoader.setDevelop(mDevelopRaw);
+    rawLoader.setCancelToken(mCancelToken);
 
     bool success = rawLoader.load(ba);
 
-    if (success)
+    if (success) {
         img = rawLoader.image();
+        mIsRawPreview = rawLoader.isPreview();
+    }
 
     return success;
 }
 
-#ifdef Q_OS_WIN
-bool DkBasicLoader::loadPSDFile(const QString &, QImage &, QSharedPointer<QByteArray>) const
+/**
+ * Loads HEIF and AVIF files with libheif.
+ * Previews (target size) are answered with the thumbnail items. If the
+ * RAW previews are refined, large images show their thumbnail first
+ * and are decoded later - just like RAW files (see DkImageContainerT::refineImage()).
+ * @return bool true if the file could be loaded.
+ **/
+bool DkBasicLoader::loadHeifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba)
 {
-#else
-bool DkBasicLoader::loadPSDFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+    DkHeifLoader heifLoader(filePath);
+    heifLoader.setTargetSize(mTargetSize);
+    heifLoader.setLoadPreview(!mDevelopRaw && DkSettingsManager::snapshot()->resources().loadRawThumb == DkSettings::raw_thumb_refine);
+    heifLoader.setCancelToken(mCancelToken);
+
+    if (!heifLoader.load(ba))
+        return false;
+
+    img = heifLoader.image();
+    mIsRawPreview = heifLoader.isPreview() && !mTargetSize.isValid();
+
+    return true;
+}
+
+/**
+ * Loads JPEG XL files with libjxl.
+ * The preview frame is handled like HEIF thumbnails (see loadHeifFile()).
+ * @return bool true if the file could be loaded.
+ **/
+bool DkBasicLoader::loadJxlFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba)
+{
+    DkJxlLoader jxlLoader(filePath);
+    jxlLoader.setTargetSize(mTargetSize);
+    jxlLoader.setLoadPreview(!mDevelopRaw && DkSettingsManager::snapshot()->resources().loadRawThumb == DkSettings::raw_thumb_refine);
+    jxlLoader.setCancelToken(mCancelToken);
+
+    if (!jxlLoader.load(ba))
+        return false;
+
+    img = jxlLoader.image();
+    mIsRawPreview = jxlLoader.isPreview() && !mTargetSize.isValid();
+
+    return true;
+}
+
+/**
+ * Minimal big endian reader for Photoshop files.
+ * Reads past the end flag the stream as bad instead of failing.
+ **/
+class DkPsdStream
+{
+public:
+    DkPsdStream(const uchar *data, qint64 size)
+        : mData(data)
+        , mSize(size)
+    {
+    }
+
+    quint64 read(int bytes)
+    {
+        if (mPos + bytes > mSize) {
+            mOk = false;
+            mPos = mSize;
+            return 0;
+        }
+
+        quint64 val = 0;
+        for (int idx = 0; idx < bytes; idx++)
+            val = (val << 8) | mData[mPos++];
+
+        return val;
+    }
+
+    void seek(qint64 pos)
+    {
+        mOk = mOk && pos >= 0 && pos <= mSize;
+        mPos = mOk ? pos : mSize;
+    }
+
+    void skip(quint64 bytes)
+    {
+        seek(bytes > (quint64)mSize ? -1 : mPos + (qint64)bytes);
+    }
+
+    qint64 pos() const
+    {
+        return mPos;
+    }
+
+    qint64 size() const
+    {
+        return mSize;
+    }
+
+    const uchar *data(qint64 pos) const
+    {
+        return mData + pos;
+    }
+
+    bool ok() const
+    {
+        return mOk;
+    }
+
+private:
+    const uchar *mData = 0;
+    qint64 mSize = 0;
+    qint64 mPos = 0;
+    bool mOk = true;
+};
+
+/**
+ * Decodes one PackBits compressed channel of a PSD image.
+ * @param src the compressed data of the channel
+ * @param srcSize the compressed size in bytes
+ * @param dst the pre-allocated channel
+ * @param dstSize the channel size in bytes
+ * @return bool true if the channel was decoded completely.
+ **/
+static bool psdUnpackBits(const uchar *src, qint64 srcSize, uchar *dst, qint64 dstSize)
+{
+    const uchar *srcEnd = src + srcSize;
+    uchar *dstEnd = dst + dstSize;
+
+    while (src < srcEnd && dst < dstEnd) {
+        int n = *src++;
+
+        if (n < 128) {
+            n++;
+            if (src + n > srcEnd || dst + n > dstEnd)
+                return false;
+            memcpy(dst, src, n);
+            src += n;
+            dst += n;
+        } else if (n > 128) {
+            n = 257 - n;
+            if (src >= srcEnd || dst + n > dstEnd)
+                return false;
+            memset(dst, *src++, n);
+            dst += n;
+        } // 128 is a no-op
+    }
+
+    return dst == dstEnd;
+}
+
+/**
+ * Loads the embedded preview of Photoshop files.
+ * Photoshop stores a small JPG preview (~160 px) in the image resource 1036
+ * (1033 for Photoshop 4 which is BGR) - small thumbnails do not need more.
+ * @param s the stream positioned at the image resources section
+ * @param img the preview
+ * @param minSize the preview is not decoded if it is smaller
+ * @return bool true if a preview was found
+ **/
+static bool loadPSDPreview(DkPsdStream &s, QImage &img, const QSize &minSize)
+{
+    quint64 length = s.read(4);
+    qint64 end = s.pos() + (qint64)length;
+
+    while (s.ok() && s.pos() + 12 <= end) {
+        if (s.read(4) != 0x3842494D) // 8BIM
+            break;
+
+        int id = (int)s.read(2);
+        int nameLength = (int)s.read(1);
+        s.skip(nameLength + (nameLength % 2 ? 0 : 1)); // the pascal string is padded to an even size
+        quint64 size = s.read(4);
+        qint64 next = s.pos() + (qint64)size + (size % 2);
+
+        // 28 bytes header: format, width, height, width bytes, total size, compressed size, bpp, planes
+        if ((id == 1036 || id == 1033) && size > 28 && s.pos() + (qint64)size <= s.size()) {
+            bool jpg = s.read(4) == 1;
+            int pw = (int)s.read(4);
+            int ph = (int)s.read(4);
+            s.skip(16);
+
+            // too small - the merged image is decoded instead
+            if (pw < minSize.width() || ph < minSize.height())
+                return false;
+
+            if (jpg && img.loadFromData(s.data(s.pos()), (int)size - 28, "jpg")) {
+                if (id == 1033)
+                    img = img.rgbSwapped();
+                return true;
+            }
+        }
+
+        s.seek(next);
+    }
+
+    return false;
+}
+
+/**
+ * Loads Photoshop files fast.
+ * Thumbnails (a target size is set) are read from the embedded preview if it is large enough.
+ * Otherwise, the layer and mask section is skipped and only
+ * the merged image is decoded - one channel per thread.
+ * Only RGB and grayscale images with 8 or 16 bits are handled,
+ * all others are left to the libqpsd loader (see loadPSDFile).
+ * @param filePath the file path
+ * @param img the image
+ * @param ba the file buffer (can be empty)
+ * @return bool true if the image could be loaded.
+ **/
+bool DkBasicLoader::loadPSDFast(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+{
+    DkTimer dt;
+    QFile file(filePath);
+    const uchar *data = 0;
+    qint64 size = 0;
+
+    if (ba && !ba->isEmpty()) {
+        data = (const uchar *)ba->constData();
+        size = ba->size();
+    } else if (file.open(QIODevice::ReadOnly)) {
+        // mapping the file lets us skip the layers without reading them
+        size = file.size();
+        data = file.map(0, size);
+    }
+
+    if (!data)
+        return false;
+
+    DkPsdStream s(data, size);
+
+    if (s.read(4) != 0x38425053) // 8BPS
+        return false;
+
+    int version = (int)s.read(2);
+    if (version != 1 && version != 2)
+        return false;
+
+    s.skip(6); // reserved
+    int channels = (int)s.read(2);
+    int height = (int)s.read(4);
+    int width = (int)s.read(4);
+    int depth = (int)s.read(2);
+    int mode = (int)s.read(2);
+    s.skip(s.read(4)); // color mode data
+
+    if (!s.ok() || width <= 0 || height <= 0)
+        return false;
+
+    if (mTargetSize.isValid()) {
+        qint64 resPos = s.pos();
+
+        // the size of the image if it is scaled to the target size
+        QSize minSize(width, height);
+        if (width > mTargetSize.width() || height > mTargetSize.height())
+            minSize.scale(mTargetSize, Qt::KeepAspectRatio);
+
+        // allow for rounding errors
+        minSize -= QSize(1, 1);
+
+        if (loadPSDPreview(s, img, minSize)) {
+            qCDebug(lcLoader) << "[PSD] embedded preview loaded in" << dt;
+            return true;
+        }
+
+        s.seek(resPos);
+    }
+
+    // gray: 1 and rgb: 3 color channels - the next channel is the merged transparency
+    int nColors = mode == 1 ? 1 : mode == 3 ? 3 : 0;
+    if (!nColors || channels < nColors || (depth != 8 && depth != 16))
+        return false;
+
+    int nc = qMin(channels, nColors + 1);
+    bool alpha = nc > nColors;
+
+    s.skip(s.read(4)); // image resources
+    s.skip(s.read(version == 1 ? 4 : 8)); // layer and mask information
+    int compression = (int)s.read(2);
+
+    if (!s.ok() || compression > 1) // zip compressed merged images are very rare
+        return false;
+
+    int bpc = depth / 8;
+    qint64 planeSize = (qint64)width * height * bpc;
+    QVector<const uchar *> src(nc);
+    QVector<qint64> srcSize(nc, planeSize);
+
+    if (compression == 0) {
+        for (int c = 0; c < nc; c++)
+            src[c] = s.data(s.pos() + c * planeSize);
+
+        if (s.pos() + nc * planeSize > s.size())
+            return false;
+    } else {
+        // the compressed size of each row is stored in front of the data
+        int cntBytes = version == 1 ? 2 : 4;
+        qint64 pos = s.pos() + (qint64)channels * height * cntBytes;
+
+        for (int c = 0; c < nc; c++) {
+            qint64 cs = 0;
+            for (int r = 0; r < height; r++)
+                cs += s.read(cntBytes);
+
+            src[c] = s.data(qMin(pos, s.size()));
+            srcSize[c] = cs;
+            pos += cs;
+        }
+
+        if (!s.ok() || pos > s.size())
+            return false;
+    }
+
+    QVector<QByteArray> planes(nc);
+    QVector<int> cIdx;
+    for (int c = 0; c < nc; c++)
+        cIdx << c;
+
+    QtConcurrent::blockingMap(cIdx, [&](int c) {
+        if (compression == 0)
+            return;
+
+        planes[c].resize(planeSize);
+        if (!psdUnpackBits(src[c], srcSize[c], (uchar *)planes[c].data(), planeSize))
+            planes[c].clear();
+    });
+
+    for (int c = 0; c < nc; c++) {
+        if (compression == 1) {
+            if (planes[c].isEmpty())
+                return false;
+            src[c] = (const uchar *)planes[c].constData();
+        }
+    }
+
+    QImage::Format f;
+    if (depth == 8)
+        f = alpha ? QImage::Format_ARGB32 : nColors == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB32;
+    else
+        f = alpha ? QImage::Format_RGBA64 : nColors == 1 ? QImage::Format_Grayscale16 : QImage::Format_RGBX64;
+
+    QImage result(width, height, f);
+    if (result.isNull())
+        return false;
+
+    QVector<int> rows;
+    for (int r = 0; r < height; r++)
+        rows << r;
+
+    // interleave - the colors of the merged images are matted with white
+    QtConcurrent::blockingMap(rows, [&](int r) {
+        qint64 o = (qint64)r * width;
+
+        if (depth == 8) {
+            const uchar *cr = src[0] + o;
+            const uchar *cg = src[nColors == 3 ? 1 : 0] + o;
+            const uchar *cb = src[nColors == 3 ? 2 : 0] + o;
+            const uchar *ca = alpha ? src[nColors] + o : 0;
+
+            if (f == QImage::Format_Grayscale8) {
+                memcpy(result.scanLine(r), cr, width);
+                return;
+            }
+
+            QRgb *p = (QRgb *)result.scanLine(r);
+            for (int x = 0; x < width; x++) {
+                int a = ca ? ca[x] : 255;
+
+                if (a == 255 || a == 0)
+                    p[x] = qRgba(cr[x], cg[x], cb[x], a);
+                else
+                    p[x] = qRgba(qMax(0, (cr[x] + a - 255) * 255 / a),
+                                 qMax(0, (cg[x] + a - 255) * 255 / a),
+                                 qMax(0, (cb[x] + a - 255) * 255 / a),
+                                 a);
+            }
+        } else {
+            auto v = [&](int c, int x) -> int {
+                const uchar *b = src[c] + (o + x) * 2;
+                return (b[0] << 8) | b[1];
+            };
+            int gi = nColors == 3 ? 1 : 0;
+            int bi = nColors == 3 ? 2 : 0;
+
+            if (f == QImage::Format_Grayscale16) {
+                quint16 *p = (quint16 *)result.scanLine(r);
+                for (int x = 0; x < width; x++)
+                    p[x] = (quint16)v(0, x);
+                return;
+            }
+
+            QRgba64 *p = (QRgba64 *)result.scanLine(r);
+            for (int x = 0; x < width; x++) {
+                qint64 a = alpha ? v(nColors, x) : 65535;
+
+                if (a == 65535 || a == 0)
+                    p[x] = qRgba64(v(0, x), v(gi, x), v(bi, x), a);
+                else
+                    p[x] = qRgba64(qMax<qint64>(0, (v(0, x) + a - 65535) * 65535 / a),
+                                   qMax<qint64>(0, (v(gi, x) + a - 65535) * 65535 / a),
+                                   qMax<qint64>(0, (v(bi, x) + a - 65535) * 65535 / a),
+                                   a);
+            }
+        }
+    });
+
+    img = result;
+    qCDebug(lcLoader) << "[PSD] merged image decoded in" << dt;
+
+    return true;
+}
+
+#ifdef Q_OS_WIN
+bool DkBasicLoader::loadPSDFile(const QString &, QImage &, QSharedPointer<QByteArray>) const
+{
+#else
+bool DkBasicLoader::loadPSDFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
 {
     // load from file?
     if (!ba || ba->isEmpty()) {
@@ -524,46 +1624,73 @@ bool DkBasicLoader::loadPSDFile(const QString &filePath, QImage &img, QSharedPoi
     return false;
 }
 
-#ifndef WITH_LIBTIFF
-bool DkBasicLoader::loadTIFFile(const QString &, QImage &, QSharedPointer<QByteArray>) const
-{
-#else
-bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+#ifdef WITH_LIBTIFF
+/**
+ * Turns off libtiff's warning/error handlers (they show dialogs on Windows - we do the GUI : )
+ * The handlers are process-global and TIFFs are decoded concurrently, so they
+ * are turned off once and never restored.
+ **/
+static void silenceTiff()
 {
-    bool success = false;
+    static std::once_flag silenced;
+    std::call_once(silenced, []() {
+        TIFFSetWarningHandler(NULL);
+        TIFFSetErrorHandler(NULL);
+    });
+}
 
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
+/**
+ * Opens a TIFF file for reading.
+ * TIFFOpen expects the file name in the local 8 bit encoding, hence
+ * we use the wide char version on Windows.
+ * @param filePath the file path
+ * @return TIFF * the TIFF which must be closed using TIFFClose or NULL if it could not be opened
+ **/
+static TIFF *openTiffFile(const QString &filePath)
+{
+#ifdef Q_OS_WIN
+    return TIFFOpenW(reinterpret_cast<const wchar_t *>(filePath.utf16()), "r");
+#else
+    return TIFFOpen(QFile::encodeName(filePath), "r");
+#endif
+}
+#endif
 
-    DkTimer dt;
-    TIFF *tiff = 0;
+/**
+ * Loads an overview of huge TIFF files.
+ * Decoding a 2-4 GB TIFF at once takes minutes - so we load an overview
+ * and the viewport decodes the visible regions (see DkTiffRegionLoader).
+ * @param filePath the file path
+ * @param img the overview
+ * @return bool true if the file is huge and its overview could be loaded.
+ **/
+bool DkBasicLoader::loadTIFFOverview(const QString &filePath, QImage &img)
+{
+    QSharedPointer<DkTiffRegionLoader> rl(new DkTiffRegionLoader(filePath));
 
-// TODO: currently TIFFStreamOpen can only be linked on Windows?!
-#if defined(Q_OS_WIN)
+    int maxSide = mTargetSize.isValid() ? qMax(mTargetSize.width(), mTargetSize.height()) : DkTiffRegionLoader::overview_size;
+    img = rl->overview(maxSide, mCancelToken);
 
-    std::istringstream is(ba ? ba->toStdString() : "");
+    if (img.isNull())
+        return false;
 
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
+    mRegionLoader = rl;
 
-    // fallback to direct loading
-    if (!tiff)
-        tiff = TIFFOpen(filePath.toLatin1(), "r");
+    return true;
+}
 
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> bal;
-    if (!tiff)
-        bal = loadFileToBuffer(filePath);
+#ifndef WITH_LIBTIFF
+bool DkBasicLoader::loadTIFFile(const QString &, QImage &, QSharedPointer<QByteArray>)
+{
+#else
+bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba)
+{
+    bool success = false;
 
-    std::istringstream isl(bal ? bal->toStdString() : "");
+    silenceTiff();
 
-    if (bal)
-        tiff = TIFFStreamOpen("MemTIFF", &isl);
-#else
-    tiff = TIFFOpen(filePath.toLatin1(), "r");
-#endif
+    DkTimer dt;
+    TIFF *tiff = openTiff(filePath, ba);
 
     if (!tiff)
         return success;
@@ -576,20 +1703,16 @@ bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPoi
 
     // init the qImage
     img = QImage(width, height, QImage::Format_ARGB32);
+    success = readTiffImage(tiff, img, mCancelToken);
 
-    const int stopOnError = 1;
-    success = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
-
-    if (success) {
-        for (uint32_t y = 0; y < height; ++y)
-            convert32BitOrder(img.scanLine(y), width);
-    }
+    // the file is open anyway - index the remaining pages
+    if (success)
+        indexPages(tiff, ba);
+    else
+        img = QImage();
 
     TIFFClose(tiff);
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
-
     return success;
 
 #endif // !WITH_LIBTIFF
@@ -599,24 +1722,26 @@ bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPoi
 #define DRIF_IMAGE_IMPL
 #include "drif_image.h"
 
-bool isQtFmtCompatible(uint32_t f)
-{
-    switch (f) {
-    case DRIF_FMT_RGB888:
-    case DRIF_FMT_RGBA8888:
-    case DRIF_FMT_GRAY:
-        return true;
-    }
-
-    return false;
-}
-
-uint32_t drif2qtfmt(uint32_t f)
+/**
+ * Returns the Qt format a DRIF image is converted to.
+ * Planar and BGR layouts are reordered, YUV images are converted to RGB.
+ **/
+QImage::Format drif2qtfmt(uint32_t f)
 {
     switch (f) {
     case DRIF_FMT_RGB888:
+    case DRIF_FMT_BGR888:
+    case DRIF_FMT_RGB888P:
+    case DRIF_FMT_BGR888P:
+    case DRIF_FMT_YUV420P:
+    case DRIF_FMT_YVU420P:
+    case DRIF_FMT_NV12:
+    case DRIF_FMT_NV21:
         return QImage::Format_RGB888;
     case DRIF_FMT_RGBA8888:
+    case DRIF_FMT_BGRA8888:
+    case DRIF_FMT_RGBA8888P:
+    case DRIF_FMT_BGRA8888P:
         return QImage::Format_RGBA8888;
     case DRIF_FMT_GRAY:
         return QImage::Format_Grayscale8;
@@ -625,130 +1750,151 @@ uint32_t drif2qtfmt(uint32_t f)
     return QImage::Format_Invalid;
 }
 
-bool DkBasicLoader::loadDrifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+/**
+ * Converts one YUV pixel to RGB (BT.601, limited range - as OpenCV's YUV2RGB).
+ **/
+inline void drifYuv2Rgb(int y, int u, int v, uchar *rgb)
 {
-    bool success = false;
-
-    uint32_t w;
-    uint32_t h;
-    uint32_t f;
+    int c = 298 * (y - 16) + 128;
+    int d = u - 128;
+    int e = v - 128;
 
-    uint8_t *imgBytes = drifLoadImg(filePath.toLatin1(), &w, &h, &f);
-
-    if (!imgBytes)
-        return success;
-
-    if (isQtFmtCompatible(f)) {
-        img = QImage((int)w, (int)h, (QImage::Format)drif2qtfmt(f));
-        memcpy(reinterpret_cast<void *>(img.bits()), imgBytes, drifGetSize(w, h, f));
+    rgb[0] = (uchar)qBound(0, (c + 409 * e) >> 8, 255);
+    rgb[1] = (uchar)qBound(0, (c - 100 * d - 208 * e) >> 8, 255);
+    rgb[2] = (uchar)qBound(0, (c + 516 * d) >> 8, 255);
+}
 
-        success = true;
+/**
+ * Loads Developers RAW image files.
+ * The file is memory mapped (raw frame dumps can be several GB) and converted
+ * row-parallel into the image - there is no intermediate frame buffer.
+ * @param filePath the image file
+ * @param img the loaded image
+ * @param ba the file buffer (can be empty)
+ * @return bool true if the image could be loaded.
+ **/
+bool DkBasicLoader::loadDrifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+{
+    QFile file(filePath);
+    const uchar *data = 0;
+    qint64 size = 0;
+
+    if (ba && !ba->isEmpty()) {
+        data = reinterpret_cast<const uchar *>(ba->constData());
+        size = ba->size();
+    } else if (file.open(QIODevice::ReadOnly)) {
+        size = file.size();
+        data = size > 0 ? file.map(0, size) : 0; // unmapped when file is destroyed
     }
-#ifdef WITH_OPENCV
-    else {
-        img = QImage((int)w, (int)h, QImage::Format_RGB888);
 
-        switch (f) {
-        case DRIF_FMT_BGR888: {
-            cv::Mat imgMat = cv::Mat((int)h, (int)w, CV_8UC3, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_BGR2RGB);
+    if (!data || size < DRIF_FOOTER_SZ)
+        return false;
 
-            success = true;
-        } break;
+    drif_footer_t footer;
+    memcpy(&footer, data + size - DRIF_FOOTER_SZ, sizeof(footer));
 
-        case DRIF_FMT_RGB888P:
-        case DRIF_FMT_RGBA8888P: {
-            cv::Mat imgMatR = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes);
-            cv::Mat imgMatG = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes + w * h);
-            cv::Mat imgMatB = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes + 2 * w * h);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-
-            std::vector<cv::Mat> imgMat{imgMatR, imgMatG, imgMatB};
-            cv::merge(imgMat, rgbMat);
+    if (footer.magic != DRIF_MAGIC || !isDrifFmtValid(footer.f))
+        return false;
 
-            success = true;
-        } break;
+    if (footer.w < DRIF_MIN_W || footer.h < DRIF_MIN_H || footer.w > DRIF_MAX_W || footer.h > DRIF_MAX_H)
+        return false;
 
-        case DRIF_FMT_BGR888P:
-        case DRIF_FMT_BGRA8888P: {
-            cv::Mat imgMatB = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes);
-            cv::Mat imgMatG = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes + w * h);
-            cv::Mat imgMatR = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes + 2 * w * h);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
+    const uint32_t f = footer.f;
+    const int w = (int)footer.w;
+    const int h = (int)footer.h;
+    const quint64 planeSize = (quint64)w * h;
 
-            std::vector<cv::Mat> imgMat{imgMatR, imgMatG, imgMatB};
-            cv::merge(imgMat, rgbMat);
+    // drifGetSize overflows for large frames
+    if (planeSize * drifGetSize(2, 2, f) / 4 > (quint64)size)
+        return false;
 
-            success = true;
-        } break;
+    bool subsampled = f == DRIF_FMT_YUV420P || f == DRIF_FMT_YVU420P || f == DRIF_FMT_NV12 || f == DRIF_FMT_NV21;
+    if (subsampled && (w % 2 || h % 2))
+        return false;
 
-        case DRIF_FMT_BGRA8888: {
-            cv::Mat imgMat = cv::Mat((int)h, (int)w, CV_8UC4, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_BGR2RGB, 3);
+    QImage dImg(w, h, drif2qtfmt(f));
+    if (dImg.isNull())
+        return false;
 
-            success = true;
-        } break;
+    uchar *bits = dImg.bits();
+    const size_t bpl = (size_t)dImg.bytesPerLine();
 
-        case DRIF_FMT_RGBA8888: {
-            cv::Mat imgMat = cv::Mat((int)h, (int)w, CV_8UC4, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_RGBA2RGB, 3);
+    QVector<int> rows(h);
+    for (int y = 0; y < h; y++)
+        rows[y] = y;
 
-            success = true;
-        } break;
+    QtConcurrent::blockingMap(rows, [&](const int &y) {
+        uchar *dst = bits + (size_t)y * bpl;
+        const quint64 rowOffset = (quint64)y * w;
 
+        switch (f) {
+        case DRIF_FMT_RGB888:
+        case DRIF_FMT_RGBA8888:
         case DRIF_FMT_GRAY: {
-            cv::Mat imgMat = cv::Mat((int)h, (int)w, CV_8UC1, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_GRAY2RGB);
+            int c = drifGetSize(1, 1, f);
+            memcpy(dst, data + rowOffset * c, (size_t)w * c);
+        } break;
 
-            success = true;
+        case DRIF_FMT_BGR888:
+        case DRIF_FMT_BGRA8888: {
+            int c = drifGetSize(1, 1, f);
+            const uchar *src = data + rowOffset * c;
+
+            for (int x = 0; x < w * c; x += c) {
+                dst[x] = src[x + 2];
+                dst[x + 1] = src[x + 1];
+                dst[x + 2] = src[x];
+                if (c == 4)
+                    dst[x + 3] = src[x + 3];
+            }
         } break;
 
-        case DRIF_FMT_YUV420P: {
-            cv::Mat imgMat = cv::Mat((int)h + h / 2, (int)w, CV_8UC1, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_YUV2RGB_I420);
+        case DRIF_FMT_RGB888P:
+        case DRIF_FMT_BGR888P:
+        case DRIF_FMT_RGBA8888P:
+        case DRIF_FMT_BGRA8888P: {
+            int c = drifGetSize(1, 1, f);
+            bool bgr = f == DRIF_FMT_BGR888P || f == DRIF_FMT_BGRA8888P;
+
+            for (int ch = 0; ch < c; ch++) {
+                int plane = bgr && ch < 3 ? 2 - ch : ch;
+                const uchar *src = data + plane * planeSize + rowOffset;
 
-            success = true;
+                for (int x = 0; x < w; x++)
+                    dst[x * c + ch] = src[x];
+            }
         } break;
 
+        case DRIF_FMT_YUV420P:
         case DRIF_FMT_YVU420P: {
-            cv::Mat imgMat = cv::Mat((int)h + h / 2, (int)w, CV_8UC1, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_YUV2RGB_YV12);
+            const uchar *ySrc = data + rowOffset;
+            const uchar *uSrc = data + planeSize + (quint64)(y / 2) * (w / 2);
+            const uchar *vSrc = uSrc + planeSize / 4;
 
-            success = true;
-        } break;
+            if (f == DRIF_FMT_YVU420P)
+                std::swap(uSrc, vSrc);
 
-        case DRIF_FMT_NV12: {
-            cv::Mat imgMat = cv::Mat((int)h + h / 2, (int)w, CV_8UC1, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_YUV2RGB_NV12);
-
-            success = true;
+            for (int x = 0; x < w; x++)
+                drifYuv2Rgb(ySrc[x], uSrc[x / 2], vSrc[x / 2], dst + x * 3);
         } break;
 
+        case DRIF_FMT_NV12:
         case DRIF_FMT_NV21: {
-            cv::Mat imgMat = cv::Mat((int)h + h / 2, (int)w, CV_8UC1, imgBytes);
-            cv::Mat rgbMat = cv::Mat((int)h, (int)w, CV_8UC3, reinterpret_cast<uint8_t *>(img.bits()));
-            cv::cvtColor(imgMat, rgbMat, CV_YUV2RGB_NV21);
+            const uchar *ySrc = data + rowOffset;
+            const uchar *uvSrc = data + planeSize + (quint64)(y / 2) * w;
+            int uIdx = f == DRIF_FMT_NV12 ? 0 : 1;
 
-            success = true;
+            for (int x = 0; x < w; x++) {
+                int cx = x & ~1;
+                drifYuv2Rgb(ySrc[x], uvSrc[cx + uIdx], uvSrc[cx + 1 - uIdx], dst + x * 3);
+            }
         } break;
-
-        default:
-            success = false;
-            break;
         }
-    }
-#endif
+    });
 
-    drifFreeImg(imgBytes);
+    img = dImg;
 
-    return success;
+    return true;
 }
 
 void DkBasicLoader::setImage(const QImage &img, const QString &editName, const QString &file)
@@ -759,10 +1905,59 @@ void DkBasicLoader::setImage(const QImage &img, const QString &editName, const Q
 
 void DkBasicLoader::pruneEditHistory()
 {
+    // the new last item needs its full image since deltas refer to their successor
+    if (mImageIndex >= 0 && mImageIndex < mImages.size() - 1 && mImages[mImageIndex].isDelta())
+        mImages[mImageIndex].setImage(historyImage(mImageIndex));
+
     // delete all hidden edit states
     for (int idx = mImages.size() - 1; idx > mImageIndex; idx--) {
         mImages.pop_back();
     }
+
+    clearHistoryImage();
+}
+
+void DkBasicLoader::clearHistoryImage()
+{
+    QMutexLocker locker(&mHistoryMutex);
+    mHistoryImg = QImage();
+    mHistoryImgIdx = -1;
+}
+
+/**
+ * Returns the image of the history item idx.
+ * Older history items are stored as deltas to their successors,
+ * these are restored from the next item that holds a full image.
+ * @param idx the history index
+ * @return QImage the image of the history item
+ **/
+QImage DkBasicLoader::historyImage(int idx) const
+{
+    if (idx < 0 || idx >= mImages.size())
+        return QImage();
+
+    if (!mImages[idx].isDelta())
+        return mImages[idx].image();
+
+    QMutexLocker locker(&mHistoryMutex);
+
+    if (idx == mHistoryImgIdx)
+        return mHistoryImg;
+
+    // find the next full image (the last item is never a delta)
+    int fIdx = idx + 1;
+    while (fIdx < mImages.size() - 1 && mImages[fIdx].isDelta() && fIdx != mHistoryImgIdx)
+        fIdx++;
+
+    QImage img = fIdx == mHistoryImgIdx ? mHistoryImg : mImages[fIdx].image();
+
+    for (int cIdx = fIdx - 1; cIdx >= idx; cIdx--)
+        img = mImages[cIdx].fromDelta(img);
+
+    mHistoryImg = img;
+    mHistoryImgIdx = idx;
+
+    return img;
 }
 
 void DkBasicLoader::setEditImage(const QImage &img, const QString &editName)
@@ -774,24 +1969,36 @@ void DkBasicLoader::setEditImage(const QImage &img, const QString &editName)
     pruneEditHistory();
 
     // compute new history size
-    int historySize = 0;
+    float historySize = 0;
     for (const DkEditImage &e : mImages) {
         historySize += e.size();
     }
 
+    // the restored delta item is kept, too
+    {
+        QMutexLocker locker(&mHistoryMutex);
+        if (!mHistoryImg.isNull())
+            historySize += DkImage::getBufferSizeFloat(mHistoryImg.size(), mHistoryImg.depth());
+    }
+
     // reset exif orientation after image edit
     if (!mImages.isEmpty())
         mMetaData->clearOrientation();
     // new history item with new pixmap (and old or original metadata)
-    DkEditImage newImg(img, mMetaData->copy(), editName); // new image, old/unchanged metadata
+    DkEditImage newImg(img, metaDataSnapshot(), editName); // new image, old/unchanged metadata
 
-    if (historySize + newImg.size() > DkSettingsManager::param().resources().historyMemory && mImages.size() > mMinHistorySize) {
+    if (historySize + newImg.size() > DkMemoryGovernor::instance().historyMemory() && mImages.size() > mMinHistorySize) {
         mImages.removeAt(1);
+        clearHistoryImage();
         qWarning() << "removing history image because it's too large:" << historySize + newImg.size() << "MB";
     }
 
     mImages.append(newImg);
     mImageIndex = mImages.size() - 1; // set the index again to the last
+
+    // keep the previous item as difference to the new image (the original is always kept)
+    if (mImageIndex > 1)
+        mImages[mImageIndex - 1].toDelta(img);
 }
 
 void DkBasicLoader::setEditMetaData(const QSharedPointer<DkMetaDataT> &metaData, const QImage &img, const QString &editName)
@@ -802,10 +2009,32 @@ void DkBasicLoader::setEditMetaData(const QSharedPointer<DkMetaDataT> &metaData,
     // not removing second history item if oversized (see setEditImage())
 
     // new history item with new metadata (and image, but hasNewImage() will be false)
-    DkEditImage newImg(metaData->copy(), img, editName); // new metadata, old/unchanged image
+    DkEditImage newImg(metaData == mMetaData ? metaDataSnapshot() : metaData->copy(), img, editName); // new metadata, old/unchanged image
 
     mImages.append(newImg);
     mImageIndex = mImages.size() - 1; // set the index again to the last
+
+    // the image is unchanged - so the delta of the previous item is empty
+    if (mImageIndex > 1)
+        mImages[mImageIndex - 1].toDelta(img);
+}
+
+/**
+ * Returns an immutable copy of the current metadata.
+ * History items share this copy as long as the metadata is not modified.
+ * Most edits (crop, rotate, adjustments) do not touch the metadata and
+ * copying Exiv2 data (e.g. maker notes) for each of them is expensive.
+ * @return QSharedPointer<DkMetaDataT> the snapshot which must not be modified
+ **/
+QSharedPointer<DkMetaDataT> DkBasicLoader::metaDataSnapshot()
+{
+    if (!mMetaDataSnapshot || mSnapshotSource != mMetaData || mSnapshotRevision != mMetaData->revision()) {
+        mMetaDataSnapshot = mMetaData->copy();
+        mSnapshotSource = mMetaData;
+        mSnapshotRevision = mMetaData->revision();
+    }
+
+    return mMetaDataSnapshot;
 }
 
 void DkBasicLoader::setEditMetaData(const QSharedPointer<DkMetaDataT> &metaData, const QString &editName)
@@ -830,7 +2059,7 @@ QImage DkBasicLoader::lastImage() const
     // but this rotated pixmap is for the gui only, it should not be saved.
     for (int idx = mImageIndex; idx >= 0; idx--) {
         if (mImages[idx].hasNewImage()) {
-            return mImages[idx].image();
+            return historyImage(idx);
         }
     }
 
@@ -855,7 +2084,7 @@ QImage DkBasicLoader::pixmap() const
     }
     // Return current pixmap, which may contain modification from metadata changes like rotation
     // This should not be used to write the image to disk, use image() instead.
-    return mImages.at(mImageIndex).image();
+    return historyImage(mImageIndex);
 }
 
 /**
@@ -950,246 +2179,653 @@ void DkBasicLoader::redo()
     emit resetMetaDataSignal();
 }
 
-QVector<DkEditImage> *DkBasicLoader::history()
+QVector<DkEditImage> *DkBasicLoader::history()
+{
+    return &mImages;
+}
+
+DkEditImage DkBasicLoader::lastEdit() const
+{
+    assert(mImageIndex >= 0 && mImageIndex < mImages.size());
+    return mImages[mImageIndex];
+}
+
+int DkBasicLoader::historyIndex() const
+{
+    return mImageIndex;
+}
+
+void DkBasicLoader::setMinHistorySize(int size)
+{
+    mMinHistorySize = size;
+}
+
+void DkBasicLoader::setHistoryIndex(int idx)
+{
+    mImageIndex = idx;
+    // TODO update mMetaData, see undo()
+}
+
+void DkBasicLoader::loadFileToBuffer(const QString &filePath, QByteArray &ba) const
+{
+    QFileInfo fi(filePath);
+
+    if (!fi.exists())
+        return;
+
+#ifdef WITH_QUAZIP
+    if (fi.dir().path().contains(DkZipContainer::zipMarker()))
+        DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath), ba);
+#endif
+
+    QFile file(filePath);
+    file.open(QIODevice::ReadOnly);
+
+    ba = file.readAll();
+}
+
+QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString &filePath) const
+{
+    QFileInfo fi(filePath);
+
+#ifdef WITH_QUAZIP
+    if (fi.dir().path().contains(DkZipContainer::zipMarker()))
+        return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
+#endif
+
+    QSharedPointer<QByteArray> rba = DkReadAhead::instance().read(filePath);
+    if (rba)
+        return rba;
+
+    QSharedPointer<QByteArray> mba = mapFileToBuffer(filePath);
+    if (mba)
+        return mba;
+
+    QFile file(filePath);
+    file.open(QIODevice::ReadOnly);
+
+    QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
+    file.close();
+
+    return ba;
+}
+
+/**
+ * Maps large files read-only into memory.
+ * The buffer is a view (QByteArray::fromRawData) of the mapped file, so decoders,
+ * Exiv2 and the container share the page cache instead of holding copies.
+ * The file is unmapped with the last reference to the returned pointer - copies
+ * of the QByteArray itself must therefore not outlive it (writing to it detaches).
+ * Reading a mapping crashes (SIGBUS) if the file is truncated - so files are
+ * never rewritten in place (see writeBufferToFile()).
+ * @param filePath the file to be mapped
+ * @return QSharedPointer<QByteArray> the buffer or a null pointer if the file should be read instead
+ * (small files, network file systems where a stale mapping crashes, Windows where mapped files cannot be overwritten)
+ **/
+QSharedPointer<QByteArray> DkBasicLoader::mapFileToBuffer(const QString &filePath)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(filePath);
+    return QSharedPointer<QByteArray>();
+#else
+    QFileInfo fi(filePath);
+
+    // reading small files is as fast
+    if (fi.size() < 64 * 1024 * 1024 || fi.size() > std::numeric_limits<int>::max())
+        return QSharedPointer<QByteArray>();
+
+    if (DkUtils::isNetworkPath(fi.absolutePath())) {
+        qCDebug(lcLoader) << "[DkBasicLoader] not mapping" << fi.fileName() << "on a network share";
+        return QSharedPointer<QByteArray>();
+    }
+
+    QFile *file = new QFile(fi.absoluteFilePath());
+    uchar *ptr = file->open(QIODevice::ReadOnly) ? file->map(0, file->size()) : 0;
+
+    if (!ptr) {
+        delete file;
+        return QSharedPointer<QByteArray>();
+    }
+
+    // the QFile owns the mapping
+    return QSharedPointer<QByteArray>(new QByteArray(QByteArray::fromRawData(reinterpret_cast<const char *>(ptr), (int)file->size())), [file](QByteArray *ba) {
+        delete ba;
+        delete file;
+    });
+#endif
+}
+
+/**
+ * @brief writeBufferToFile() writes the passed in file buffer to the specified file.
+ *
+ * It's called by the save() routine, which saves the image to that file buffer
+ * and updates that file buffer to also contain exif data.
+ *
+ * @param fileInfo path to file to be written
+ * @param ba raw content to be written to file
+ */
+bool DkBasicLoader::writeBufferToFile(const QString &fileInfo, const QSharedPointer<QByteArray> ba) const
+{
+    if (!ba || ba->isEmpty())
+        return false;
+
+    // write a new file and replace the old one - buffers might map the old file (see mapFileToBuffer())
+    QSaveFile file(fileInfo);
+    file.open(QIODevice::WriteOnly);
+    qint64 bytesWritten = file.write(*ba.data(), ba->size());
+
+    if (!bytesWritten || bytesWritten == -1) {
+        file.cancelWriting();
+        file.commit();
+        return false;
+    }
+
+    bool saved = file.commit();
+    qCDebug(lcLoader) << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
+
+    return saved;
+}
+
+void DkBasicLoader::indexPages(const QString &filePath, const QSharedPointer<QByteArray> ba)
+{
+    // reset counters
+    mNumPages = 1;
+    mPageIdx = 1;
+
+#ifdef WITH_LIBTIFF
+
+    // the pages were indexed while decoding the first page
+    if (!mPageOffsets.isEmpty()) {
+        mNumPages = mPageOffsets.size();
+        return;
+    }
+
+    mPageBuffer.clear();
+
+    QFileInfo fInfo(filePath);
+
+    // for now we just support tiff's
+    if (!fInfo.suffix().contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption)))
+        return;
+
+    silenceTiff();
+
+    DkTimer dt;
+    TIFF *tiff = openTiff(filePath, ba);
+
+    if (!tiff)
+        return;
+
+    indexPages(tiff, ba);
+    mNumPages = mPageOffsets.size();
+
+    qDebug() << mNumPages << " TIFF directories... " << dt;
+    TIFFClose(tiff);
+#else
+    Q_UNUSED(filePath);
+    Q_UNUSED(ba);
+#endif
+}
+
+#ifdef WITH_LIBTIFF
+/**
+ * Caches the offsets of all directories (pages) of an opened TIFF.
+ * The TIFF must point to its first directory. Only the IFDs are parsed, no image data is read.
+ * Multi-page files keep a reference to the buffer so that loadPageAt() does not reopen the file.
+ * @param tiff the TIFF which is positioned at its first directory
+ * @param ba the buffer the TIFF was opened from (may be empty)
+ **/
+void DkBasicLoader::indexPages(TIFF *tiff, const QSharedPointer<QByteArray> ba)
+{
+    mPageOffsets.clear();
+
+    do {
+        mPageOffsets << (quint64)TIFFCurrentDirOffset(tiff);
+    } while (TIFFReadDirectory(tiff));
+
+    mPageBuffer = mPageOffsets.size() > 1 ? ba : QSharedPointer<QByteArray>();
+}
+
+/**
+ * Opens a TIFF for reading.
+ * If a buffer is given, libtiff reads (and memory-maps) it directly - the buffer is not copied.
+ * Files that cannot be opened by libtiff directly are loaded to a buffer.
+ * @param filePath the file path
+ * @param ba the file buffer (may be empty)
+ * @return TIFF * the TIFF which must be closed using TIFFClose or NULL if it could not be opened
+ **/
+TIFF *DkBasicLoader::openTiff(const QString &filePath, QSharedPointer<QByteArray> ba) const
+{
+    TIFF *tiff = 0;
+
+    if (!ba || ba->isEmpty())
+        tiff = openTiffFile(filePath);
+
+    if (tiff)
+        return tiff;
+
+    if (!ba || ba->isEmpty())
+        ba = loadFileToBuffer(filePath);
+
+    if (!ba || ba->isEmpty())
+        return tiff;
+
+    // the source keeps the buffer alive until libtiff closes it
+    struct DkTiffSource {
+        QSharedPointer<QByteArray> ba;
+        toff_t pos = 0;
+    };
+
+    DkTiffSource *src = new DkTiffSource();
+    src->ba = ba;
+
+    auto readProc = [](thandle_t h, tdata_t data, tsize_t size) -> tsize_t {
+        DkTiffSource *s = static_cast<DkTiffSource *>(h);
+        toff_t bs = (toff_t)s->ba->size();
+        toff_t n = s->pos < bs ? qMin((toff_t)size, bs - s->pos) : 0;
+
+        if (n > 0)
+            memcpy(data, s->ba->constData() + s->pos, (size_t)n);
+
+        s->pos += n;
+        return (tsize_t)n;
+    };
+
+    auto writeProc = [](thandle_t, tdata_t, tsize_t) -> tsize_t {
+        return 0;
+    };
+
+    auto seekProc = [](thandle_t h, toff_t offset, int whence) -> toff_t {
+        DkTiffSource *s = static_cast<DkTiffSource *>(h);
+
+        // negative offsets wrap around toff_t - which is what we want
+        switch (whence) {
+        case SEEK_SET:
+            s->pos = offset;
+            break;
+        case SEEK_CUR:
+            s->pos += offset;
+            break;
+        case SEEK_END:
+            s->pos = (toff_t)s->ba->size() + offset;
+            break;
+        }
+
+        return s->pos;
+    };
+
+    auto closeProc = [](thandle_t h) -> int {
+        delete static_cast<DkTiffSource *>(h);
+        return 0;
+    };
+
+    auto sizeProc = [](thandle_t h) -> toff_t {
+        return (toff_t) static_cast<DkTiffSource *>(h)->ba->size();
+    };
+
+    // libtiff reads uncompressed strips straight from the 'mapped' buffer
+    auto mapProc = [](thandle_t h, tdata_t *base, toff_t *size) -> int {
+        DkTiffSource *s = static_cast<DkTiffSource *>(h);
+        *base = (tdata_t)s->ba->constData();
+        *size = (toff_t)s->ba->size();
+        return 1;
+    };
+
+    auto unmapProc = [](thandle_t, tdata_t, toff_t) {
+    };
+
+    tiff = TIFFClientOpen("MemTIFF", "r", (thandle_t)src, readProc, writeProc, seekProc, closeProc, sizeProc, mapProc, unmapProc);
+
+    // libtiff does not call the closeProc if opening fails
+    if (!tiff)
+        delete src;
+
+    return tiff;
+}
+
+/**
+ * Decodes the current directory of tiff to img.
+ * Top-left oriented images are decoded in chunks of rows so that
+ * canceled loads stop early. Other orientations are flipped by libtiff
+ * and hence decoded at once.
+ * @param tiff the opened TIFF
+ * @param img an ARGB32 image of the directory's size
+ * @param token stops decoding between the chunks
+ * @return bool true if the image was decoded (and not canceled)
+ **/
+bool DkBasicLoader::readTiffImage(TIFF *tiff, QImage &img, const DkCancelToken &token) const
+{
+    const int stopOnError = 1;
+    uint32_t width = img.width();
+    uint32_t height = img.height();
+    uint16_t orientation = ORIENTATION_TOPLEFT;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+
+    bool success = false;
+    char emsg[1024];
+    TIFFRGBAImage rgba;
+
+    if (orientation != ORIENTATION_TOPLEFT || !TIFFRGBAImageOK(tiff, emsg) || !TIFFRGBAImageBegin(&rgba, tiff, stopOnError, emsg)) {
+        success = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+    } else {
+        rgba.req_orientation = ORIENTATION_TOPLEFT;
+        success = true;
+
+        // ~16 MB per chunk
+        uint32_t chunkRows = qMax(1u, (uint32_t)((16 << 20) / qMax(1u, width * 4)));
+
+        for (uint32_t y = 0; y < height && success; y += chunkRows) {
+            if (token.isCanceled()) {
+                success = false;
+                break;
+            }
+
+            rgba.row_offset = y;
+            rgba.col_offset = 0;
+            success = TIFFRGBAImageGet(&rgba, reinterpret_cast<uint32_t *>(img.scanLine(y)), width, qMin(chunkRows, height - y)) != 0;
+        }
+
+        TIFFRGBAImageEnd(&rgba);
+    }
+
+    if (success) {
+        for (uint32_t y = 0; y < height; ++y)
+            convert32BitOrder(img.scanLine(y), width);
+    }
+
+    return success;
+}
+#endif
+
+bool DkBasicLoader::loadPage(int skipIdx)
 {
-    return &mImages;
-}
+    bool imgLoaded = false;
 
-DkEditImage DkBasicLoader::lastEdit() const
-{
-    assert(mImageIndex >= 0 && mImageIndex < mImages.size());
-    return mImages[mImageIndex];
-}
+    mPageIdx += skipIdx;
 
-int DkBasicLoader::historyIndex() const
-{
-    return mImageIndex;
-}
+    // <= 1 since first page is loaded using qt
+    if (mPageIdx > mNumPages || mPageIdx <= 1)
+        return imgLoaded;
 
-void DkBasicLoader::setMinHistorySize(int size)
-{
-    mMinHistorySize = size;
+    return loadPageAt(mPageIdx);
 }
 
-void DkBasicLoader::setHistoryIndex(int idx)
+bool DkBasicLoader::loadPageAt(int pageIdx)
 {
-    mImageIndex = idx;
-    // TODO update mMetaData, see undo()
-}
+    bool imgLoaded = false;
 
-void DkBasicLoader::loadFileToBuffer(const QString &filePath, QByteArray &ba) const
-{
-    QFileInfo fi(filePath);
+#ifdef WITH_LIBTIFF
 
-    if (!fi.exists())
-        return;
+    // <= 1 since first page is loaded using qt
+    if (pageIdx > mNumPages || pageIdx < 1)
+        return imgLoaded;
 
-#ifdef WITH_QUAZIP
-    if (fi.dir().path().contains(DkZipContainer::zipMarker()))
-        DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath), ba);
-#endif
+    DkTimer dt;
+    collectPrefetchedPage();
 
-    QFile file(filePath);
-    file.open(QIODevice::ReadOnly);
+    QImage img;
+    if (QImage *cImg = mPageCache.object(pageIdx))
+        img = *cImg;
 
-    ba = file.readAll();
-}
+    // the page is currently prefetched - waiting is faster than decoding it again
+    if (img.isNull() && pageIdx == mPrefetchIdx) {
+        img = mPagePrefetch.result();
+        mPrefetchIdx = -1;
+    }
 
-QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString &filePath) const
-{
-    QFileInfo fi(filePath);
+    if (img.isNull()) {
+        quint64 offset = pageIdx <= mPageOffsets.size() ? mPageOffsets[pageIdx - 1] : 0;
+        img = loadTiffPage(mFile, mPageBuffer, pageIdx, offset);
+    } else
+        qCDebug(lcLoader) << "[DkBasicLoader] page" << pageIdx << "from cache";
 
-#ifdef WITH_QUAZIP
-    if (fi.dir().path().contains(DkZipContainer::zipMarker()))
-        return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
-#endif
+    imgLoaded = !img.isNull();
 
-    QFile file(filePath);
-    file.open(QIODevice::ReadOnly);
+    if (imgLoaded) {
+        cachePage(pageIdx, img);
+        setEditImage(img, tr("Original Image"));
 
-    QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-    file.close();
+        // prefetch the next page in browsing direction
+        prefetchPage(pageIdx < mLastPageIdx ? pageIdx - 1 : pageIdx + 1);
+        mLastPageIdx = pageIdx;
+    }
 
-    return ba;
+    qCDebug(lcLoader) << "[DkBasicLoader] page" << pageIdx << "loaded in" << dt;
+#else
+    Q_UNUSED(pageIdx);
+#endif
+
+    return imgLoaded;
 }
 
 /**
- * @brief writeBufferToFile() writes the passed in file buffer to the specified file.
- *
- * It's called by the save() routine, which saves the image to that file buffer
- * and updates that file buffer to also contain exif data.
- *
- * @param fileInfo path to file to be written
- * @param ba raw content to be written to file
- */
-bool DkBasicLoader::writeBufferToFile(const QString &fileInfo, const QSharedPointer<QByteArray> ba) const
+ * Decodes a page without changing the current page or the page cache.
+ * This function is thread-safe - each call opens its own TIFF handle.
+ * @param pageIdx the page index [1 numPages]
+ * @return QImage the decoded page or a NULL image if it could not be decoded
+ **/
+QImage DkBasicLoader::decodePageAt(int pageIdx) const
 {
-    if (!ba || ba->isEmpty())
-        return false;
-
-    QFile file(fileInfo);
-    file.open(QIODevice::WriteOnly);
-    qint64 bytesWritten = file.write(*ba.data(), ba->size());
-    file.close();
-    qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
+    if (pageIdx > mNumPages || pageIdx < 1)
+        return QImage();
 
-    if (!bytesWritten || bytesWritten == -1)
-        return false;
+    quint64 offset = pageIdx <= mPageOffsets.size() ? mPageOffsets[pageIdx - 1] : 0;
 
-    return true;
+    return loadTiffPage(mFile, mPageBuffer, pageIdx, offset);
 }
 
-void DkBasicLoader::indexPages(const QString &filePath, const QSharedPointer<QByteArray> ba)
+/**
+ * Decodes a single page of a multi-page TIFF.
+ * This function does not access any members (except for the const file loading), hence it is safe to be called from the prefetcher.
+ * @param filePath the TIFF's file path
+ * @param ba the file buffer (may be empty)
+ * @param pageIdx the page index [1 numPages]
+ * @param offset the page's IFD offset - if 0 the directories are traversed up to pageIdx
+ * @return QImage the decoded page or a NULL image if it could not be decoded
+ **/
+QImage DkBasicLoader::loadTiffPage(const QString &filePath, QSharedPointer<QByteArray> ba, int pageIdx, quint64 offset) const
 {
-    // reset counters
-    mNumPages = 1;
-    mPageIdx = 1;
+    QImage img;
 
 #ifdef WITH_LIBTIFF
 
-    QFileInfo fInfo(filePath);
+    silenceTiff();
 
-    // for now we just support tiff's
-    if (!fInfo.suffix().contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption)))
-        return;
+    TIFF *tiff = openTiff(filePath, ba);
 
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
+    if (!tiff)
+        return img;
 
-    DkTimer dt;
-    TIFF *tiff = 0;
+    // go to current directory
+    bool found = true;
+    if (offset) {
+        found = TIFFSetSubDirectory(tiff, offset) != 0;
+    } else {
+        for (int idx = 1; idx < pageIdx && found; idx++)
+            found = TIFFReadDirectory(tiff) != 0;
+    }
 
-#if defined(Q_OS_WIN)
-    std::istringstream is(ba ? ba->toStdString() : "");
+    if (found) {
+        uint32_t width = 0;
+        uint32_t height = 0;
 
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
 
-    // read from file
-    if (!tiff)
-        tiff = TIFFOpen(filePath.toLatin1(), "r"); // this->mFile was here before - not sure why
+        // init the qImage
+        img = QImage(width, height, QImage::Format_ARGB32);
 
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> bal;
-    if (!tiff)
-        bal = loadFileToBuffer(filePath);
-    ;
-    std::istringstream isl(bal ? bal->toStdString() : "");
+        // prefetched pages are dropped by collectPrefetchedPage - not canceled
+        if (img.isNull() || !readTiffImage(tiff, img, DkCancelToken()))
+            img = QImage();
+    }
 
-    if (bal)
-        tiff = TIFFStreamOpen("MemTIFF", &isl);
+    TIFFClose(tiff);
 #else
-    // read from file
-    tiff = TIFFOpen(filePath.toLatin1(), "r"); // this->mFile was here before - not sure why
+    Q_UNUSED(filePath);
+    Q_UNUSED(ba);
+    Q_UNUSED(pageIdx);
+    Q_UNUSED(offset);
 #endif
 
-    if (!tiff)
-        return;
+    return img;
+}
 
-    // libtiff example
-    int dircount = 0;
+/**
+ * Decodes the page pageIdx in the background.
+ * Only one page is prefetched at a time, the first page is never prefetched since Qt loads it.
+ * @param pageIdx the page index [2 numPages]
+ **/
+void DkBasicLoader::prefetchPage(int pageIdx)
+{
+    if (pageIdx <= 1 || pageIdx > mNumPages || pageIdx == mPrefetchIdx || mPageCache.contains(pageIdx))
+        return;
 
-    do {
-        dircount++;
+    // no caching - no prefetching
+    if (DkSettingsManager::param().resources().cacheMemory <= 0 || DkMemoryGovernor::instance().pressure() != DkMemoryGovernor::pressure_none)
+        return;
 
-    } while (TIFFReadDirectory(tiff));
+    // still busy (the destructor waits for the last prefetch only)
+    if (!mPagePrefetch.isFinished())
+        return;
 
-    mNumPages = dircount;
+    collectPrefetchedPage();
 
-    if (mNumPages > 1)
-        mPageIdx = 1;
+    // the container clears its buffer in place - so the prefetcher gets its own (shallow) copy
+    // which keeps the original (e.g. a memory mapped file) alive
+    QSharedPointer<QByteArray> ba;
+    if (mPageBuffer && !mPageBuffer->isEmpty()) {
+        QSharedPointer<QByteArray> src = mPageBuffer;
+        ba = QSharedPointer<QByteArray>(new QByteArray(*src), [src](QByteArray *b) {
+            delete b;
+        });
+    }
 
-    qDebug() << dircount << " TIFF directories... " << dt;
-    TIFFClose(tiff);
+    quint64 offset = pageIdx <= mPageOffsets.size() ? mPageOffsets[pageIdx - 1] : 0;
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
-#else
-    Q_UNUSED(filePath);
-#endif
+    mPrefetchIdx = pageIdx;
+    mPagePrefetch = QtConcurrent::run(this, &DkBasicLoader::loadTiffPage, mFile, ba, pageIdx, offset);
 }
 
-bool DkBasicLoader::loadPage(int skipIdx)
+/**
+ * Moves a finished prefetch to the page cache.
+ **/
+void DkBasicLoader::collectPrefetchedPage()
 {
-    bool imgLoaded = false;
+    if (mPrefetchIdx == -1 || !mPagePrefetch.isFinished())
+        return;
 
-    mPageIdx += skipIdx;
+    QImage img = mPagePrefetch.result();
 
-    // <= 1 since first page is loaded using qt
-    if (mPageIdx > mNumPages || mPageIdx <= 1)
-        return imgLoaded;
+    if (!img.isNull())
+        cachePage(mPrefetchIdx, img);
 
-    return loadPageAt(mPageIdx);
+    mPrefetchIdx = -1;
+    mPagePrefetch = QFuture<QImage>();
 }
 
-bool DkBasicLoader::loadPageAt(int pageIdx)
+void DkBasicLoader::cachePage(int pageIdx, const QImage &img)
 {
-    bool imgLoaded = false;
-
-#ifdef WITH_LIBTIFF
-
-    // <= 1 since first page is loaded using qt
-    if (pageIdx > mNumPages || pageIdx < 1)
-        return imgLoaded;
+    // pages may use up to a quarter of the image cache
+    int maxCost = qRound(DkMemoryGovernor::instance().cacheMemory() * 0.25 * 1024.0);
+    mPageCache.setMaxCost(qMax(maxCost, 0));
 
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
+    mPageCache.insert(pageIdx, new QImage(img), qMax(1, (int)(img.sizeInBytes() / 1024)));
+}
 
-    DkTimer dt;
-    TIFF *tiff = TIFFOpen(mFile.toLatin1(), "r");
+/**
+ * Releases all cached pages.
+ * Running prefetches are not waited for, their result is simply dropped.
+ **/
+void DkBasicLoader::clearPageCache()
+{
+    mPageCache.clear();
+    mPrefetchIdx = -1;
+    mLastPageIdx = 1;
+}
 
-#if defined(Q_OS_WIN)
+/**
+ * Returns the memory used by cached pages (in MB).
+ * The current page is not taken into account since it's shared with the image.
+ * @return float the memory in MB
+ **/
+float DkBasicLoader::getPageCacheMemory() const
+{
+    float mem = 0;
 
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> ba;
-    if (!tiff)
-        ba = loadFileToBuffer(mFile);
+    for (int key : mPageCache.keys()) {
+        if (key == mPageIdx)
+            continue;
 
-    std::istringstream is(ba ? ba->toStdString() : "");
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
-#endif
+        const QImage *img = mPageCache.object(key);
+        mem += DkImage::getBufferSizeFloat(img->size(), img->depth());
+    }
 
-    if (!tiff)
-        return imgLoaded;
+    return mem;
+}
 
-    uint32_t width = 0;
-    uint32_t height = 0;
+/**
+ * Returns the memory of the edit history.
+ * The image that is currently displayed is not counted.
+ * @return float the memory in MB
+ **/
+float DkBasicLoader::getHistoryMemory() const
+{
+    float mem = 0;
 
-    // go to current directory
-    for (int idx = 1; idx < pageIdx; idx++) {
-        if (!TIFFReadDirectory(tiff))
-            return false;
+    for (int idx = 0; idx < mImages.size(); idx++) {
+        if (idx != mImageIndex)
+            mem += mImages[idx].size();
     }
-    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
-    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
 
-    // init the qImage
-    QImage img = QImage(width, height, QImage::Format_ARGB32);
+    return mem;
+}
 
-    const int stopOnError = 1;
-    imgLoaded = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+void DkBasicLoader::setTargetSize(const QSize &size)
+{
+    mTargetSize = size;
+}
 
-    if (imgLoaded) {
-        for (uint32_t y = 0; y < height; ++y)
-            convert32BitOrder(img.scanLine(y), width);
-    }
+QSize DkBasicLoader::targetSize() const
+{
+    return mTargetSize;
+}
 
-    TIFFClose(tiff);
+/**
+ * If set, RAW files are always developed - embedded previews are ignored.
+ * @param develop if true, the RAW data is developed.
+ **/
+void DkBasicLoader::setDevelopRaw(bool develop)
+{
+    mDevelopRaw = develop;
+}
+
+/**
+ * Returns the region loader if only an overview of a huge TIFF is loaded.
+ * @return QSharedPointer<DkTiffRegionLoader> the region loader or NULL.
+ **/
+QSharedPointer<DkTiffRegionLoader> DkBasicLoader::regionLoader() const
+{
+    return mRegionLoader;
+}
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
+/**
+ * Returns true if the current image is the JPG preview embedded in a RAW file.
+ * @return bool true if only the preview was loaded.
+ **/
+bool DkBasicLoader::isRawPreview() const
+{
+    return mIsRawPreview;
+}
 
-    setEditImage(img, tr("Original Image"));
-#else
-    Q_UNUSED(pageIdx);
-#endif
+void DkBasicLoader::setCancelToken(const DkCancelToken &token)
+{
+    mCancelToken = token;
+}
 
-    return imgLoaded;
+bool DkBasicLoader::isCanceled() const
+{
+    return mCancelToken.isCanceled();
 }
 
 bool DkBasicLoader::setPageIdx(int skipIdx)
@@ -1244,6 +2880,12 @@ void DkBasicLoader::convert32BitOrder(void *buffer, int width) const
  */
 QString DkBasicLoader::save(const QString &filePath, const QImage &img, int compression)
 {
+    // we just have an overview - never replace the original with it
+    if (mRegionLoader && QFileInfo(filePath) == QFileInfo(mFile)) {
+        qWarning() << "[Basic Loader] I won't overwrite" << filePath << "with its overview";
+        return QString();
+    }
+
     QSharedPointer<QByteArray> ba;
 
     DkTimer dt;
@@ -1269,16 +2911,41 @@ QString DkBasicLoader::save(const QString &filePath, const QImage &img, int comp
  */
 bool DkBasicLoader::saveToBuffer(const QString &filePath, const QImage &img, QSharedPointer<QByteArray> &ba, int compression) const
 {
-    bool bufferCreated = false;
+    bool bufferCreated = !ba;
 
-    if (!ba) {
-        ba = QSharedPointer<QByteArray>(new QByteArray());
-        bufferCreated = true;
-    }
     // copy current metadata object: mMetaData pointer may be reset in the background in the process
     // and then it won't be saved because !isLoaded()... [2022-08, pse]
     QSharedPointer<DkMetaDataT> metaData = mMetaData;
 
+    bool saved = encodeToBuffer(filePath, img, ba, compression); // hint: release() might run now, resetting mMetaData [2022-08, pse]
+
+    // if we created the buffer here - force loading metadata from the file
+    if (saved && prepareMetaData(metaData, filePath, img, ba, bufferCreated))
+        injectMetaData(metaData, ba);
+
+    if (!saved)
+        emit errorDialogSignal(tr("Sorry, I could not save: %1").arg(QFileInfo(filePath).fileName()));
+
+    return saved;
+}
+
+/**
+ * @brief encodeToBuffer() encodes the image to the file buffer - no metadata is written.
+ *
+ * This is the first part of saveToBuffer(). The batch processing calls the
+ * parts separately so that encoding is not blocked by writing metadata.
+ *
+ * @param filePath path to file to which this image will later be written, the suffix is relevant
+ * @param img image to be written to file buffer
+ * @param ba in-memory file buffer containing the resulting file (it is created if NULL)
+ * @param compression compression flag for QImageWriter
+ * @return bool true if the image was encoded
+ */
+bool DkBasicLoader::encodeToBuffer(const QString &filePath, const QImage &img, QSharedPointer<QByteArray> &ba, int compression) const
+{
+    if (!ba)
+        ba = QSharedPointer<QByteArray>(new QByteArray());
+
     bool saved = false;
 
     QFileInfo fInfo(filePath);
@@ -1289,8 +2956,11 @@ bool DkBasicLoader::saveToBuffer(const QString &filePath, const QImage &img, QSh
         bool hasAlpha = DkImage::alphaChannelUsed(img);
         QImage sImg = img;
 
+        // TIFFs keep 16 bits per channel
+        bool keepDepth = DkImageHistogram::isHighBitDepth(img) && fInfo.suffix().contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption));
+
         // JPEG 2000 can only handle 32 or 8bit images
-        if (!hasAlpha && img.colorTable().empty() && !fInfo.suffix().contains(QRegularExpression("(avif|j2k|jp2|jpf|jpx|jxl|png)"))) {
+        if (!hasAlpha && !keepDepth && img.colorTable().empty() && !fInfo.suffix().contains(QRegularExpression("(avif|j2k|jp2|jpf|jpx|jxl|png)"))) {
             sImg = sImg.convertToFormat(QImage::Format_RGB888);
         } else if (fInfo.suffix().contains(QRegularExpression("(j2k|jp2|jpf|jpx)")) && sImg.depth() != 32 && sImg.depth() != 8) {
             if (sImg.hasAlphaChannel()) {
@@ -1303,57 +2973,104 @@ bool DkBasicLoader::saveToBuffer(const QString &filePath, const QImage &img, QSh
         if (fInfo.suffix().contains(QRegularExpression("(png)")))
             compression = -1;
 
-        QBuffer fileBuffer(ba.data());
-        // size_t s = fileBuffer.size();
-        fileBuffer.open(QIODevice::WriteOnly);
-        QImageWriter *imgWriter = new QImageWriter(&fileBuffer, fInfo.suffix().toStdString().c_str());
+        // huge PNGs and TIFFs are compressed by all threads
+        if (DkParallelEncoder::canEncode(sImg, fInfo.suffix(), compression))
+            saved = DkParallelEncoder::encode(sImg, fInfo.suffix(), *ba, compression);
 
-        if (compression >= 0) { // -1 -> use Qt's default
-            imgWriter->setCompression(compression);
-            imgWriter->setQuality(compression);
-        }
-        if (compression == -1 && imgWriter->format() == "jpg") {
-            imgWriter->setQuality(DkSettingsManager::instance().settings().app().defaultJpgQuality);
+        if (!saved) {
+            QBuffer fileBuffer(ba.data());
+            // size_t s = fileBuffer.size();
+            fileBuffer.open(QIODevice::WriteOnly);
+            QImageWriter *imgWriter = new QImageWriter(&fileBuffer, fInfo.suffix().toStdString().c_str());
+
+            if (compression >= 0) { // -1 -> use Qt's default
+                imgWriter->setCompression(compression);
+                imgWriter->setQuality(compression);
+            }
+            if (compression == -1 && imgWriter->format() == "jpg") {
+                imgWriter->setQuality(DkSettingsManager::instance().settings().app().defaultJpgQuality);
+            }
+
+            imgWriter->setOptimizedWrite(true); // this saves space TODO: user option here?
+            imgWriter->setProgressiveScanWrite(true);
+
+            saved = imgWriter->write(sImg);
+            delete imgWriter;
         }
+    }
+
+    return saved;
+}
+
+/**
+ * @brief prepareMetaData() updates the metadata for the encoded image.
+ *
+ * If the metadata was not loaded, it is read from the encoded buffer (or the file).
+ * The image dimensions and the thumbnail are updated - the exif orientation is kept.
+ *
+ * @param metaData the metadata to be saved with the image
+ * @param filePath path to file to which this image will later be written
+ * @param img the image that was encoded
+ * @param ba the encoded file buffer
+ * @param readFromFile if true, missing metadata is read from filePath instead of ba
+ * @return bool true if the metadata should be injected using injectMetaData()
+ */
+bool DkBasicLoader::prepareMetaData(QSharedPointer<DkMetaDataT> metaData, const QString &filePath, const QImage &img, QSharedPointer<QByteArray> ba, bool readFromFile)
+{
+    if (!metaData)
+        return false;
+
+    if (!metaData->isLoaded() || !metaData->hasMetaData()) {
+        if (!readFromFile)
+            metaData->readMetaData(filePath, ba);
+        else
+            metaData->readMetaData(filePath);
+    }
 
-        imgWriter->setOptimizedWrite(true); // this saves space TODO: user option here?
-        imgWriter->setProgressiveScanWrite(true);
+    // If we have metadata for the image, save it
+    // If your images are saved without metadata, check if the metadata object is discarded or reset
+    // causing isLoaded() to return false (glitch on reload) - pse
+    if (!metaData->isLoaded())
+        return false;
 
-        saved = imgWriter->write(sImg); // hint: release() might run now, resetting mMetaData which is used below [2022-08, pse]
-        delete imgWriter;
+    try {
+        metaData->updateImageMetaData(img, false); // set dimensions in exif (do not reset exif orientation)
+    } catch (...) {
+        qInfo() << "Sorry, I could not update the meta data...";
+        metaData->clearExifState();
+        return false;
     }
 
-    if (saved && metaData) {
-        if (!metaData->isLoaded() || !metaData->hasMetaData()) {
-            if (!bufferCreated)
-                metaData->readMetaData(filePath, ba);
-            else
-                // if we created the buffere here - force loading metadata from the file
-                metaData->readMetaData(filePath);
-        }
+    return true;
+}
 
-        // If we have metadata for the image, save it
-        // If your images are saved without metadata, check if the metadata object is discarded or reset
-        // causing isLoaded() to return false (glitch on reload) - pse
-        if (metaData->isLoaded()) {
-            try {
-                // be careful: here we actually lie about the constness
-                metaData->updateImageMetaData(img, false); // set dimensions in exif (do not reset exif orientation)
-                if (!metaData->saveMetaData(ba, true))
-                    metaData->clearExifState();
-            } catch (...) {
-                // is it still throwing anything?
-                qInfo() << "Sorry, I could not save the meta data...";
-                // clear exif state here -> the 'dirty' flag would otherwise edit the original image (see #514)
-                metaData->clearExifState();
-            }
-        }
+/**
+ * @brief injectMetaData() writes the metadata to the encoded file buffer.
+ *
+ * Exiv2 parses the buffer again, so this is the expensive part of saving metadata.
+ * It does not need the image and can run in a different thread than the encoder.
+ *
+ * @param metaData the metadata prepared with prepareMetaData()
+ * @param ba the encoded file buffer - it is replaced by the buffer including the metadata
+ * @return bool true if the metadata was written
+ */
+bool DkBasicLoader::injectMetaData(QSharedPointer<DkMetaDataT> metaData, QSharedPointer<QByteArray> &ba)
+{
+    if (!metaData || !ba)
+        return false;
+
+    try {
+        if (metaData->saveMetaData(ba, true))
+            return true;
+    } catch (...) {
+        // is it still throwing anything?
+        qInfo() << "Sorry, I could not save the meta data...";
     }
 
-    if (!saved)
-        emit errorDialogSignal(tr("Sorry, I could not save: %1").arg(fInfo.fileName()));
+    // clear exif state here -> the 'dirty' flag would otherwise edit the original image (see #514)
+    metaData->clearExifState();
 
-    return saved;
+    return false;
 }
 
 void DkBasicLoader::saveThumbToMetaData(const QString &filePath)
@@ -1433,8 +3150,8 @@ bool DkBasicLoader::isContainer(const QString &filePath)
     if (suffix.isEmpty())
         return false;
 
-    for (int idx = 0; idx < DkSettingsManager::param().app().containerFilters.size(); idx++) {
-        if (DkSettingsManager::param().app().containerFilters[idx].contains(suffix))
+    for (const QString &filter : DkSettingsManager::snapshot()->app().containerFilters) {
+        if (filter.contains(suffix))
             return true;
     }
 
@@ -1460,9 +3177,17 @@ void DkBasicLoader::release()
 
     mImages.clear(); // clear history
     mImageIndex = -1;
+    clearHistoryImage();
+    mIsRawPreview = false;
+    mRegionLoader.reset();
+
+    // keep the decoded pages if we are just switching pages
+    if (!mPageIdxDirty)
+        clearPageCache();
 
     // Unload metadata
     mMetaData = QSharedPointer<DkMetaDataT>(new DkMetaDataT());
+    mMetaDataSnapshot.reset();
 }
 
 #ifdef Q_OS_WIN
@@ -1804,6 +3529,7 @@ FileDownloader::FileDownloader(const QUrl &imageUrl, const QString &filePath, QO
     }
 
     connect(&mWebCtrl, SIGNAL(finished(QNetworkReply *)), SLOT(fileDownloaded(QNetworkReply *)));
+    connect(&mPartialWatcher, SIGNAL(finished()), this, SLOT(partialDecoded()));
 
     downloadFile(imageUrl);
 }
@@ -1815,8 +3541,82 @@ FileDownloader::~FileDownloader()
 void FileDownloader::downloadFile(const QUrl &url)
 {
     QNetworkRequest request(url);
-    mWebCtrl.get(request);
+    QNetworkReply *reply = mWebCtrl.get(request);
     mUrl = url;
+
+    // the data is streamed so that we can show it while downloading
+    mDownloadedData = QSharedPointer<QByteArray>(new QByteArray());
+    mDecodedSize = 0;
+    mFinished = false;
+    connect(reply, SIGNAL(readyRead()), this, SLOT(dataReceived()));
+}
+
+void FileDownloader::dataReceived()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+
+    if (!reply || reply->error() != QNetworkReply::NoError)
+        return;
+
+    mDownloadedData->append(reply->readAll());
+    decodePartial();
+}
+
+/**
+ * Decodes the data received so far.
+ * Decoding starts over with every pass, so it is done whenever the data
+ * doubled - this at most doubles the decoding time of the download.
+ **/
+void FileDownloader::decodePartial()
+{
+    qint64 size = mDownloadedData->size();
+
+    if (mFinished || mPartialWatcher.isRunning() || size < qMax<qint64>(partial_min_size, mDecodedSize * 2))
+        return;
+
+    QByteArray data = *mDownloadedData; // implicitly shared
+    mDecodedSize = size;
+
+    mPartialWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [data]() {
+        return decode(data);
+    }));
+}
+
+/**
+ * Decodes an incomplete image.
+ * Truncated JPGs decode to the lines (or progressive scans) received
+ * and interlaced PNGs to the passes received.
+ * @param data the data received
+ * @return QImage the partial image or a null image if nothing could be decoded yet.
+ **/
+QImage FileDownloader::decode(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    QImage img;
+
+    if (!reader.canRead() || !reader.read(&img))
+        return QImage();
+
+    return img;
+}
+
+void FileDownloader::partialDecoded()
+{
+    QImage img = mPartialWatcher.result();
+
+    // the full image is loaded already
+    if (mFinished)
+        return;
+
+    if (!img.isNull())
+        emit partialImageSignal(img);
+
+    // more data arrived while decoding
+    decodePartial();
 }
 
 void FileDownloader::saved()
@@ -1825,14 +3625,16 @@ void FileDownloader::saved()
         qInfo() << "downloaded image saved to" << mFilePath;
         emit downloaded(mFilePath);
     } else {
+        // the image is still shown from the downloaded data
         qWarning() << "could not download file to " << mFilePath;
+        emit downloaded();
     }
 }
 
-bool FileDownloader::save(const QString &filePath, const QSharedPointer<QByteArray> data)
+bool FileDownloader::save(const QString &filePath, const QByteArray data)
 {
-    if (!data) {
-        qWarning() << "cannot save file if data is NULL";
+    if (data.isEmpty()) {
+        qWarning() << "cannot save file if data is empty";
         return false;
     }
 
@@ -1841,10 +3643,15 @@ bool FileDownloader::save(const QString &filePath, const QSharedPointer<QByteArr
     if (!fi.absoluteDir().exists())
         QDir().mkpath(fi.absolutePath());
 
-    QFile f(filePath);
-    f.open(QIODevice::WriteOnly);
+    QSaveFile f(filePath);
+
+    if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size()) {
+        f.cancelWriting();
+        f.commit();
+        return false;
+    }
 
-    return f.write(*data);
+    return f.commit();
 }
 
 void FileDownloader::fileDownloaded(QNetworkReply *pReply)
@@ -1854,7 +3661,11 @@ void FileDownloader::fileDownloaded(QNetworkReply *pReply)
         qWarning() << pReply->errorString();
     }
 
-    mDownloadedData = QSharedPointer<QByteArray>(new QByteArray(pReply->readAll()));
+    if (!mDownloadedData)
+        mDownloadedData = QSharedPointer<QByteArray>(new QByteArray());
+
+    mDownloadedData->append(pReply->readAll());
+    mFinished = true;
     // emit a signal
     pReply->deleteLater();
 
@@ -1862,10 +3673,14 @@ void FileDownloader::fileDownloaded(QNetworkReply *pReply)
     if (mFilePath.isEmpty()) {
         emit downloaded();
     }
-    // ok save it
+    // ok save it - downloaded() is emitted once the file exists
     else {
+        // the saver gets its own copy - containers clear their buffer when they release the image
+        QByteArray data = *mDownloadedData;
+        data.detach();
+
         connect(&mSaveWatcher, SIGNAL(finished()), this, SLOT(saved()), Qt::UniqueConnection);
-        mSaveWatcher.setFuture(QtConcurrent::run(&nmc::FileDownloader::save, mFilePath, mDownloadedData));
+        mSaveWatcher.setFuture(QtConcurrent::run(&nmc::FileDownloader::save, mFilePath, data));
     }
 }
 
@@ -1882,6 +3697,10 @@ QUrl FileDownloader::getUrl() const
 #ifdef WITH_QUAZIP
 
 // DkZipContainer --------------------------------------------------------------------
+QMutex DkZipContainer::mArchiveMutex;
+QHash<QString, DkZipContainer::DkZipArchive> DkZipContainer::mArchives;
+QCache<QString, QByteArray> DkZipContainer::mExtracted(64 * 1024); // KB
+
 DkZipContainer::DkZipContainer(const QString &encodedFilePath)
 {
     if (!encodedFilePath.isEmpty() && encodedFilePath.contains(mZipMarker)) {
@@ -1926,68 +3745,515 @@ QString DkZipContainer::decodeImageFile(const QString &encodedFileInfo)
     return tmp;
 }
 
-QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString &zipFile, const QString &imageFile)
+QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString &zipFile, const QString &imageFile)
+{
+    QSharedPointer<QByteArray> ba(new QByteArray());
+    extractImage(zipFile, imageFile, *ba);
+
+    return ba;
+}
+
+/**
+ * Extracts imageFile from zipFile.
+ * Recently extracted files are cached, so thumbnails, metadata and the full
+ * image share one extraction. Archives are opened from a pool of handles
+ * with a parsed central directory.
+ * @param zipFile the archive
+ * @param imageFile the file name within the archive
+ * @param ba the extracted file (empty if it could not be extracted)
+ **/
+void DkZipContainer::extractImage(const QString &zipFile, const QString &imageFile, QByteArray &ba)
+{
+    QString key = zipFile + mZipMarker + imageFile;
+
+    {
+        QMutexLocker locker(&mArchiveMutex);
+        validateArchive(zipFile);
+
+        if (QByteArray *cached = mExtracted.object(key)) {
+            ba = *cached;
+            return;
+        }
+    }
+
+    DkZipHandle handle = openArchive(zipFile);
+    if (!handle.zip)
+        return;
+
+    if (seekEntry(handle.zip, zipFile, imageFile)) {
+        QuaZipFile extractedFile(handle.zip);
+
+        if (extractedFile.open(QIODevice::ReadOnly) && extractedFile.getZipError() == UNZ_OK) {
+            ba = extractedFile.readAll();
+            extractedFile.close();
+        }
+    }
+
+    closeArchive(zipFile, handle);
+
+    if (!ba.isEmpty()) {
+        QMutexLocker locker(&mArchiveMutex);
+        mExtracted.insert(key, new QByteArray(ba), qMax(ba.size() / 1024, 1));
+    }
+}
+
+/**
+ * Returns an open handle of zipFile.
+ * Idle handles are reused. The central directory is parsed
+ * when the archive is opened for the first time.
+ * Call closeArchive() to return the handle.
+ * @param zipFile the archive
+ * @return DkZipHandle an open handle - its zip is NULL if the archive cannot be opened
+ **/
+DkZipContainer::DkZipHandle DkZipContainer::openArchive(const QString &zipFile)
+{
+    bool known = false;
+
+    {
+        QMutexLocker locker(&mArchiveMutex);
+        validateArchive(zipFile);
+        closeIdleHandles();
+
+        auto it = mArchives.find(zipFile);
+        if (it != mArchives.end()) {
+            if (!it->handles.isEmpty())
+                return it->handles.takeLast();
+
+            known = true;
+        }
+    }
+
+    DkZipHandle handle;
+    QFileInfo fi(zipFile);
+    handle.modified = fi.lastModified();
+    handle.size = fi.size();
+    handle.zip = new QuaZip(zipFile);
+
+    if (!handle.zip->open(QuaZip::mdUnzip)) {
+        delete handle.zip;
+        return DkZipHandle();
+    }
+
+    if (!known) {
+        DkTimer dt;
+        QuaZip *zip = handle.zip;
+        QHash<QString, QPair<quint64, quint64>> entries;
+
+        for (bool more = zip->goToFirstFile(); more; more = zip->goToNextFile()) {
+            unz64_file_pos pos;
+
+            if (unzGetFilePos64(zip->getUnzFile(), &pos) == UNZ_OK)
+                entries.insert(zip->getCurrentFileName(), qMakePair((quint64)pos.pos_in_zip_directory, (quint64)pos.num_of_file));
+        }
+
+        QMutexLocker locker(&mArchiveMutex);
+
+        // keep the directories of a few archives only
+        if (mArchives.size() >= max_archives && !mArchives.contains(zipFile)) {
+            for (const DkZipArchive &a : mArchives) {
+                for (const DkZipHandle &h : a.handles)
+                    delete h.zip;
+            }
+            mArchives.clear();
+        }
+
+        DkZipArchive &a = mArchives[zipFile];
+        a.modified = handle.modified;
+        a.size = handle.size;
+        a.entries = entries;
+
+        qCDebug(lcArchive) << "[DkZipContainer]" << entries.size() << "entries of" << fi.fileName() << "indexed in" << dt;
+    }
+
+    return handle;
+}
+
+/**
+ * Returns a handle that was opened by openArchive().
+ * Handles are pooled for concurrent thumbnail loading unless
+ * the archive changed since the handle was opened.
+ * @param zipFile the archive
+ * @param handle the handle which must not be used afterwards
+ **/
+void DkZipContainer::closeArchive(const QString &zipFile, const DkZipHandle &handle)
+{
+    QMutexLocker locker(&mArchiveMutex);
+
+    auto it = mArchives.find(zipFile);
+
+    if (it != mArchives.end() && it->handles.size() < max_handles && it->modified == handle.modified && it->size == handle.size) {
+        DkZipHandle h = handle;
+        h.idleSince = QDateTime::currentMSecsSinceEpoch();
+        it->handles << h;
+        return;
+    }
+
+    delete handle.zip;
+}
+
+/**
+ * Closes the idle handles of zipFile (e.g. if the user leaves the archive).
+ * Open handles lock the file on Windows. The central directory is kept.
+ * @param zipFile the archive
+ **/
+void DkZipContainer::releaseArchive(const QString &zipFile)
+{
+    QMutexLocker locker(&mArchiveMutex);
+
+    auto it = mArchives.find(zipFile);
+
+    if (it == mArchives.end())
+        return;
+
+    for (const DkZipHandle &h : it->handles)
+        delete h.zip;
+    it->handles.clear();
+}
+
+/**
+ * Closes handles that were not used for max_idle_time.
+ * mArchiveMutex must be locked.
+ **/
+void DkZipContainer::closeIdleHandles()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    for (DkZipArchive &a : mArchives) {
+        for (int idx = a.handles.size() - 1; idx >= 0; idx--) {
+            if (now - a.handles[idx].idleSince > max_idle_time) {
+                delete a.handles[idx].zip;
+                a.handles.remove(idx);
+            }
+        }
+    }
+}
+
+/**
+ * Makes imageFile the current file of zip.
+ * The position is looked up in the cached central directory
+ * rather than by scanning the archive.
+ **/
+bool DkZipContainer::seekEntry(QuaZip *zip, const QString &zipFile, const QString &imageFile)
+{
+    QPair<quint64, quint64> p;
+    bool found = false;
+
+    {
+        QMutexLocker locker(&mArchiveMutex);
+        auto it = mArchives.find(zipFile);
+
+        if (it != mArchives.end() && it->entries.contains(imageFile)) {
+            p = it->entries.value(imageFile);
+            found = true;
+        }
+    }
+
+    // goToFirstFile() tells QuaZip that there is a current file
+    if (found && zip->goToFirstFile()) {
+        unz64_file_pos pos;
+        pos.pos_in_zip_directory = p.first;
+        pos.num_of_file = p.second;
+
+        if (unzGoToFilePos64(zip->getUnzFile(), &pos) == UNZ_OK)
+            return true;
+    }
+
+    // fallback: scan the archive (e.g. case insensitive names)
+    return zip->setCurrentFile(imageFile);
+}
+
+/**
+ * Drops the cached state of zipFile if it changed on disk.
+ * mArchiveMutex must be locked.
+ **/
+void DkZipContainer::validateArchive(const QString &zipFile)
+{
+    auto it = mArchives.find(zipFile);
+
+    if (it == mArchives.end())
+        return;
+
+    QFileInfo fi(zipFile);
+
+    if (fi.lastModified() != it->modified || fi.size() != it->size) {
+        for (const DkZipHandle &h : it->handles)
+            delete h.zip;
+        mArchives.erase(it);
+        mExtracted.clear();
+    }
+}
+
+bool DkZipContainer::isZip() const
+{
+    return mImageInZip;
+}
+
+QString DkZipContainer::getZipFilePath() const
+{
+    return mZipFilePath;
+}
+
+QString DkZipContainer::getImageFileName() const
+{
+    return mImageFileName;
+}
+
+QString DkZipContainer::getEncodedFilePath() const
+{
+    return mEncodedFilePath;
+}
+
+QString DkZipContainer::zipMarker()
+{
+    return mZipMarker;
+}
+
+// DkZipExtractor --------------------------------------------------------------------
+DkZipExtractor::DkZipExtractor(QObject *parent)
+    : QObject(parent)
+{
+}
+
+DkZipExtractor::~DkZipExtractor()
+{
+    cancel();
+
+    // the tasks use this object
+    QMutexLocker locker(&mMutex);
+    while (mNumTasks > 0 || mFinishing)
+        mChanged.wait(&mMutex);
+}
+
+/**
+ * Starts extracting entries of zipFile.
+ * progress() is emitted while the files are written, finished() if all
+ * are done (or the extraction was canceled).
+ * @param zipFile the archive
+ * @param entries the file names within the archive
+ * @param filePaths the target of each entry
+ * @return bool false if an extraction is running already
+ **/
+bool DkZipExtractor::extract(const QString &zipFile, const QStringList &entries, const QStringList &filePaths)
+{
+    if (isRunning() || entries.size() != filePaths.size())
+        return false;
+
+    mZipFile = zipFile;
+    mEntries = entries;
+    mFilePaths = filePaths;
+    mNext = 0;
+    mCanceled = 0;
+
+    QMutexLocker locker(&mMutex);
+    mNumDone = 0;
+    mBufferedBytes = 0;
+    mExtracted.clear();
+    mFailed.clear();
+
+    if (mEntries.isEmpty()) {
+        locker.unlock();
+        emit finished();
+        return true;
+    }
+
+    // each worker runs until all entries are taken - so we leave half of the lane for decoding
+    int numWorkers = qBound(1, DkScheduler::instance().pool(DkScheduler::lane_cpu)->maxThreadCount() / 2, mEntries.size());
+    mNumTasks = numWorkers;
+    locker.unlock();
+
+    for (int idx = 0; idx < numWorkers; idx++) {
+        DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_batch, [this]() {
+            work();
+            taskDone();
+        });
+    }
+
+    return true;
+}
+
+bool DkZipExtractor::isRunning() const
+{
+    QMutexLocker locker(&mMutex);
+    return mNumTasks > 0;
+}
+
+bool DkZipExtractor::wasCanceled() const
+{
+    return mCanceled.loadRelaxed() != 0;
+}
+
+QStringList DkZipExtractor::extractedFiles() const
+{
+    QMutexLocker locker(&mMutex);
+    return mExtracted;
+}
+
+QStringList DkZipExtractor::failedEntries() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFailed;
+}
+
+/**
+ * Stops the extraction - files that are inflated already are still written.
+ **/
+void DkZipExtractor::cancel()
+{
+    mCanceled = 1;
+
+    QMutexLocker locker(&mMutex);
+    mChanged.wakeAll();
+}
+
+/**
+ * Inflates entries until all are taken.
+ * Each worker has its own handle of the archive.
+ **/
+void DkZipExtractor::work()
+{
+    DkZipContainer::DkZipHandle handle = DkZipContainer::openArchive(mZipFile);
+    QuaZip *zip = handle.zip;
+
+    for (int idx = mNext.fetchAndAddRelaxed(1); idx < mEntries.size(); idx = mNext.fetchAndAddRelaxed(1)) {
+        if (mCanceled.loadRelaxed())
+            break;
+
+        QSharedPointer<QByteArray> ba;
+
+        if (!zip || !inflate(zip, idx, ba)) {
+            qCDebug(lcArchive) << "unable to extract:" << mEntries[idx];
+            entryDone(idx, false);
+        } else if (!ba)
+            entryDone(idx, true); // streamed
+        else
+            write(idx, ba);
+    }
+
+    if (zip)
+        DkZipContainer::closeArchive(mZipFile, handle);
+}
+
+/**
+ * Inflates an entry.
+ * Large entries are written to disk while they are inflated - ba is null then.
+ * @return bool false if the entry could not be extracted
+ **/
+bool DkZipExtractor::inflate(QuaZip *zip, int idx, QSharedPointer<QByteArray> &ba)
+{
+    if (!DkZipContainer::seekEntry(zip, mZipFile, mEntries[idx]))
+        return false;
+
+    QuaZipFile zf(zip);
+
+    if (!zf.open(QIODevice::ReadOnly) || zf.getZipError() != UNZ_OK)
+        return false;
+
+    if (zf.usize() <= stream_size) {
+        ba = QSharedPointer<QByteArray>(new QByteArray(zf.readAll()));
+        zf.close();
+        return zf.getZipError() == UNZ_OK;
+    }
+
+    const QString &filePath = mFilePaths[idx];
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray chunk(chunk_size, Qt::Uninitialized);
+    bool ok = true;
+
+    while (ok && !zf.atEnd() && !mCanceled.loadRelaxed()) {
+        qint64 n = zf.read(chunk.data(), chunk.size());
+        ok = n > 0 && file.write(chunk.constData(), n) == n;
+    }
+
+    zf.close();
+    ok = ok && !mCanceled.loadRelaxed() && zf.getZipError() == UNZ_OK;
+
+    // do not leave truncated files
+    if (!ok)
+        file.remove();
+
+    return ok;
+}
+
+/**
+ * Writes an inflated entry with the I/O lane.
+ * Blocks while too many inflated files wait for the disk.
+ **/
+void DkZipExtractor::write(int idx, QSharedPointer<QByteArray> ba)
 {
-    QuaZip zip(zipFile);
-    if (!zip.open(QuaZip::mdUnzip))
-        return QSharedPointer<QByteArray>(new QByteArray());
+    QMutexLocker locker(&mMutex);
 
-    qDebug() << "DkZip::extractImage filePath: " << zipFile;
-    qDebug() << "3.0 image file" << imageFile;
+    while (mBufferedBytes > 0 && mBufferedBytes + ba->size() > max_buffered_bytes)
+        mChanged.wait(&mMutex);
 
-    zip.setCurrentFile(imageFile);
-    QuaZipFile extractedFile(&zip);
-    if (!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK)
-        return QSharedPointer<QByteArray>(new QByteArray());
+    mBufferedBytes += ba->size();
+    mNumTasks++;
+    locker.unlock();
 
-    QSharedPointer<QByteArray> ba(new QByteArray(extractedFile.readAll()));
-    extractedFile.close();
+    // not canceled by a token: the task must run to release its bytes
+    DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_interactive, [this, idx, ba]() {
+        bool ok = writeFile(mFilePaths[idx], *ba);
 
-    zip.close();
+        QMutexLocker locker(&mMutex);
+        mBufferedBytes -= ba->size();
+        mChanged.wakeAll();
+        locker.unlock();
 
-    return ba;
+        entryDone(idx, ok);
+        taskDone();
+    });
 }
 
-void DkZipContainer::extractImage(const QString &zipFile, const QString &imageFile, QByteArray &ba)
+void DkZipExtractor::entryDone(int idx, bool extracted)
 {
-    QuaZip zip(zipFile);
-    if (!zip.open(QuaZip::mdUnzip))
-        return;
+    QMutexLocker locker(&mMutex);
 
-    zip.setCurrentFile(imageFile);
-    QuaZipFile extractedFile(&zip);
-    if (!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK)
-        return;
+    if (extracted)
+        mExtracted << mFilePaths[idx];
+    else
+        mFailed << mEntries[idx];
 
-    ba = QByteArray(extractedFile.readAll());
-    extractedFile.close();
+    int done = ++mNumDone;
+    locker.unlock();
 
-    zip.close();
+    // a few updates are enough for large archives
+    if (done == mEntries.size() || done % qMax(mEntries.size() / 200, 1) == 0)
+        emit progress(done, mEntries.size());
 }
 
-bool DkZipContainer::isZip() const
+void DkZipExtractor::taskDone()
 {
-    return mImageInZip;
+    QMutexLocker locker(&mMutex);
+    bool last = --mNumTasks == 0;
+    mFinishing = last;
+    mChanged.wakeAll();
+    locker.unlock();
+
+    if (last) {
+        emit finished();
+
+        locker.relock();
+        mFinishing = false;
+        mChanged.wakeAll();
+    }
 }
 
-QString DkZipContainer::getZipFilePath() const
+bool DkZipExtractor::writeFile(const QString &filePath, const QByteArray &ba)
 {
-    return mZipFilePath;
-}
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
 
-QString DkZipContainer::getImageFileName() const
-{
-    return mImageFileName;
-}
+    QFile file(filePath);
+    bool ok = file.open(QIODevice::WriteOnly) && file.write(ba) == ba.size();
+    file.close();
 
-QString DkZipContainer::getEncodedFilePath() const
-{
-    return mEncodedFilePath;
-}
+    if (!ok)
+        file.remove();
 
-QString DkZipContainer::zipMarker()
-{
-    return mZipMarker;
+    return ok;
 }
 
 #endif
@@ -1997,6 +4263,7 @@ DkRawLoader::DkRawLoader(const QString &filePath, const QSharedPointer<DkMetaDat
 {
     mFilePath = filePath;
     mMetaData = metaData;
+    mSettings = DkSettingsManager::snapshot();
 }
 
 bool DkRawLoader::isEmpty() const
@@ -2009,13 +4276,44 @@ void DkRawLoader::setLoadFast(bool fast)
     mLoadFast = fast;
 }
 
+void DkRawLoader::setDevelop(bool develop)
+{
+    mDevelop = develop;
+}
+
+void DkRawLoader::setCancelToken(const DkCancelToken &token)
+{
+    mCancelToken = token;
+}
+
+/**
+ * Returns true if the embedded preview was loaded instead of the RAW data.
+ * @return bool true if image() is the embedded preview.
+ **/
+bool DkRawLoader::isPreview() const
+{
+    return mIsPreview;
+}
+
+#ifdef WITH_LIBRAW
+/**
+ * LibRaw's progress callback - a non-zero return value stops dcraw_process.
+ **/
+static int rawProgress(void *data, enum LibRaw_progress, int, int)
+{
+    return static_cast<DkCancelToken *>(data)->isCanceled() ? 1 : 0;
+}
+#endif
+
 bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
 {
     DkTimer dt;
 
     // try fetching the preview
-    if (loadPreview(ba))
+    if (!mDevelop && loadPreview(ba)) {
+        mIsPreview = true;
         return true;
+    }
 
 #ifdef WITH_LIBRAW
 
@@ -2030,14 +4328,17 @@ bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
 
         // check camera models for specific hacks
         detectSpecialCamera(iProcessor);
+        iProcessor.set_progress_handler(rawProgress, &mCancelToken);
 
         // try loading RAW preview
-        if (mLoadFast) {
+        if (mLoadFast && !mDevelop) {
             mImg = loadPreviewRaw(iProcessor);
 
             // are we done already?
-            if (!mImg.isNull())
+            if (!mImg.isNull()) {
+                mIsPreview = true;
                 return true;
+            }
         }
 
         // unpack the data
@@ -2045,16 +4346,34 @@ bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
         if (std::strcmp(iProcessor.version(), "0.13.5") != 0) // fixes a bug specific to libraw 13 - version call is UNTESTED
             iProcessor.raw2image();
 
-        if (error != LIBRAW_SUCCESS)
+        if (error != LIBRAW_SUCCESS || mCancelToken.isCanceled())
             return false;
 
         // develop using libraw
         if (mCamType == camera_unknown) {
+            if (mSettings->resources().rawHighBitDepth)
+                iProcessor.imgdata.params.output_bps = 16;
+
             error = iProcessor.dcraw_process();
 
+            if (error == LIBRAW_CANCELLED_BY_CALLBACK) {
+                qCInfo(lcLoader) << "[RAW] canceled after" << dt;
+                return false;
+            }
+
             auto rimg = iProcessor.dcraw_make_mem_image();
 
-            if (rimg) {
+            if (rimg && rimg->bits == 16) {
+                // RGB48 -> RGBX64
+                cv::Mat rgba;
+                cv::cvtColor(cv::Mat(rimg->height, rimg->width, CV_16UC3, rimg->data), rgba, CV_RGB2RGBA);
+                LibRaw::dcraw_clear_mem(rimg);
+
+                mImg = QImage(rgba.data, rgba.cols, rgba.rows, (int)rgba.step, QImage::Format_RGBX64);
+                mImg = mImg.copy(); // make a deep copy...
+
+                return true;
+            } else if (rimg) {
                 mImg = QImage(rimg->data, rimg->width, rimg->height, rimg->width * 3, QImage::Format_RGB888);
                 mImg = mImg.copy(); // make a deep copy...
                 LibRaw::dcraw_clear_mem(rimg);
@@ -2071,30 +4390,32 @@ bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
         else
             rawMat = prepareImg(iProcessor);
 
-        // color correction + white balance
-        if (mIsChromatic) {
-            whiteBalance(iProcessor, rawMat);
-        }
+        if (mCancelToken.isCanceled())
+            return false;
+
+        // color correction + white balance + gamma correction
+        cv::Mat devMat = develop(iProcessor, rawMat);
+        rawMat.release();
 
-        // gamma correction
-        gammaCorrection(iProcessor, rawMat);
+        if (mCancelToken.isCanceled())
+            return false;
 
         // reduce color noise
-        if (DkSettingsManager::param().resources().filterRawImages && mIsChromatic)
-            reduceColorNoise(iProcessor, rawMat);
+        if (mSettings->resources().filterRawImages && mIsChromatic)
+            reduceColorNoise(iProcessor, devMat);
 
-        mImg = raw2Img(iProcessor, rawMat);
+        mImg = raw2Img(iProcessor, devMat);
 
         // qDebug() << "img size" << mImg.size();
-        // qDebug() << "raw mat size" << rawMat.rows << "x" << rawMat.cols;
+        // qDebug() << "raw mat size" << devMat.rows << "x" << devMat.cols;
         iProcessor.recycle();
-        rawMat.release();
+        devMat.release();
     } catch (...) {
-        qDebug() << "[RAW] error during processing...";
+        qCDebug(lcLoader) << "[RAW] error during processing...";
         return false;
     }
 
-    qInfo() << "[RAW] loaded in " << dt;
+    qCInfo(lcLoader) << "[RAW] loaded in " << dt;
 
 #endif
 
@@ -2111,20 +4432,21 @@ bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray> &ba)
     try {
         // try to get preview image from exiv2
         if (mMetaData) {
-            if (mLoadFast || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
-                || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
+            if (mLoadFast || mSettings->resources().loadRawThumb == DkSettings::raw_thumb_always
+                || mSettings->resources().loadRawThumb == DkSettings::raw_thumb_if_large
+                || mSettings->resources().loadRawThumb == DkSettings::raw_thumb_refine) {
                 mMetaData->readMetaData(mFilePath, ba);
 
                 int minWidth = 0;
 
 #ifdef WITH_LIBRAW // if nomacs has libraw - we can still hope for a fallback -> otherwise try whatever we have here
-                if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
+                if (mSettings->resources().loadRawThumb == DkSettings::raw_thumb_if_large)
                     minWidth = 1920;
 #endif
                 mImg = mMetaData->getPreviewImage(minWidth);
 
                 if (!mImg.isNull()) {
-                    qDebug() << "[RAW] loaded with exiv2";
+                    qCDebug(lcLoader) << "[RAW] loaded with exiv2";
                     return true;
                 }
             }
@@ -2155,8 +4477,9 @@ QImage DkRawLoader::loadPreviewRaw(LibRaw &iProcessor) const
 {
     int tW = iProcessor.imgdata.thumbnail.twidth;
 
-    if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
-        || (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tW >= 1920)) {
+    if (mSettings->resources().loadRawThumb == DkSettings::raw_thumb_always
+        || mSettings->resources().loadRawThumb == DkSettings::raw_thumb_refine
+        || (mSettings->resources().loadRawThumb == DkSettings::raw_thumb_if_large && tW >= 1920)) {
         // crashes here if image is broken
         int err = iProcessor.unpack_thumb();
         char *tPtr = iProcessor.imgdata.thumbnail.thumb;
@@ -2167,7 +4490,7 @@ QImage DkRawLoader::loadPreviewRaw(LibRaw &iProcessor) const
 
             // we're good to go
             if (!img.isNull()) {
-                qDebug() << "[RAW] I loaded the RAW's thumbnail";
+                qCDebug(lcLoader) << "[RAW] I loaded the RAW's thumbnail";
                 return img;
             } else
                 qDebug() << "RAW could not load the thumb";
@@ -2217,22 +4540,48 @@ void DkRawLoader::detectSpecialCamera(const LibRaw &iProcessor)
 
 cv::Mat DkRawLoader::demosaic(LibRaw &iProcessor) const
 {
+    DkTimer dt;
+
     cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC1);
-    double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+    int black = (int)iProcessor.imgdata.color.black;
+    qint64 scale = rawScale(iProcessor);
+
+    // the color filter repeats every 8 rows and 2 columns (see LibRaw's FC())
+    // so we look it up instead of calling COLOR() for every pixel
+    int colorLut[8][2];
+    for (int rIdx = 0; rIdx < 8; rIdx++) {
+        for (int cIdx = 0; cIdx < 2; cIdx++)
+            colorLut[rIdx][cIdx] = iProcessor.COLOR(rIdx, cIdx);
+    }
 
-    // normalize all image values
-    for (int rIdx = 0; rIdx < rawMat.rows; rIdx++) {
-        unsigned short *ptrRaw = rawMat.ptr<unsigned short>(rIdx);
+    // exotic sensors (e.g. X-Trans, Fuji's rotated layout) do not repeat like that
+    bool periodic = true;
+    for (int rIdx = 0; rIdx < 16 && periodic; rIdx++) {
+        for (int cIdx = 0; cIdx < 16 && periodic; cIdx++)
+            periodic = iProcessor.COLOR(rIdx, cIdx) == colorLut[rIdx & 7][cIdx & 1];
+    }
+
+    const ushort(*image)[4] = iProcessor.imgdata.image;
 
-        for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
-            int colIdx = iProcessor.COLOR(rIdx, cIdx);
-            double val = (double)(iProcessor.imgdata.image[(rawMat.cols * rIdx) + cIdx][colIdx]);
+    // normalize all image values w.r.t the black point defined
+    cv::parallel_for_(cv::Range(0, rawMat.rows), [&](const cv::Range &range) {
+        for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+            unsigned short *ptrRaw = rawMat.ptr<unsigned short>(rIdx);
+            const ushort(*ptrImg)[4] = image + (size_t)rawMat.cols * rIdx;
 
-            // normalize the value w.r.t the black point defined
-            val = (val - iProcessor.imgdata.color.black) / dynamicRange;
-            ptrRaw[cIdx] = clip<unsigned short>(val * USHRT_MAX); // for conversion to 16U
+            if (periodic) {
+                const int *lut = colorLut[rIdx & 7];
+
+                for (int cIdx = 0; cIdx < rawMat.cols; cIdx++)
+                    ptrRaw[cIdx] = normalizeRaw(ptrImg[cIdx][lut[cIdx & 1]], black, scale);
+            } else {
+                for (int cIdx = 0; cIdx < rawMat.cols; cIdx++)
+                    ptrRaw[cIdx] = normalizeRaw(ptrImg[cIdx][iProcessor.COLOR(rIdx, cIdx)], black, scale);
+            }
         }
-    }
+    });
+
+    qCDebug(lcLoader) << "[RAW] normalized in" << dt;
 
     // no demosaicing
     if (mIsChromatic) {
@@ -2266,30 +4615,38 @@ cv::Mat DkRawLoader::demosaic(LibRaw &iProcessor) const
 cv::Mat DkRawLoader::prepareImg(const LibRaw &iProcessor) const
 {
     cv::Mat rawMat = cv::Mat(iProcessor.imgdata.sizes.height, iProcessor.imgdata.sizes.width, CV_16UC3, cv::Scalar(0));
-    double dynamicRange = (double)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);
+    int black = (int)iProcessor.imgdata.color.black;
+    qint64 scale = rawScale(iProcessor);
 
-    // normalization function
-    auto normalize = [&](double val) {
-        val = (val - iProcessor.imgdata.color.black) / dynamicRange;
-        return clip<unsigned short>(val * USHRT_MAX);
-    };
+    const ushort(*image)[4] = iProcessor.imgdata.image;
 
-    for (int rIdx = 0; rIdx < rawMat.rows; rIdx++) {
-        unsigned short *ptrI = rawMat.ptr<unsigned short>(rIdx);
+    cv::parallel_for_(cv::Range(0, rawMat.rows), [&](const cv::Range &range) {
+        for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+            unsigned short *ptrI = rawMat.ptr<unsigned short>(rIdx);
+            const ushort(*ptrImg)[4] = image + (size_t)rawMat.cols * rIdx;
 
-        for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
-            *ptrI = normalize(iProcessor.imgdata.image[rawMat.cols * rIdx + cIdx][0]);
-            ptrI++;
-            *ptrI = normalize(iProcessor.imgdata.image[rawMat.cols * rIdx + cIdx][1]);
-            ptrI++;
-            *ptrI = normalize(iProcessor.imgdata.image[rawMat.cols * rIdx + cIdx][2]);
-            ptrI++;
+            for (int cIdx = 0; cIdx < rawMat.cols; cIdx++) {
+                ptrI[3 * cIdx] = normalizeRaw(ptrImg[cIdx][0], black, scale);
+                ptrI[3 * cIdx + 1] = normalizeRaw(ptrImg[cIdx][1], black, scale);
+                ptrI[3 * cIdx + 2] = normalizeRaw(ptrImg[cIdx][2], black, scale);
+            }
         }
-    }
+    });
 
     return rawMat;
 }
 
+/**
+ * Returns the factor that maps [black maximum] to [0 USHRT_MAX].
+ * @return qint64 the factor in 16.16 fixed-point.
+ **/
+qint64 DkRawLoader::rawScale(const LibRaw &iProcessor) const
+{
+    qint64 dynamicRange = qMax((qint64)iProcessor.imgdata.color.maximum - (qint64)iProcessor.imgdata.color.black, (qint64)1);
+
+    return ((qint64)USHRT_MAX * 65536 + dynamicRange / 2) / dynamicRange;
+}
+
 cv::Mat DkRawLoader::whiteMultipliers(const LibRaw &iProcessor) const
 {
     // get camera white balance multipliers
@@ -2323,7 +4680,7 @@ cv::Mat DkRawLoader::whiteMultipliers(const LibRaw &iProcessor) const
     return wm;
 }
 
-cv::Mat DkRawLoader::gammaTable(const LibRaw &iProcessor) const
+cv::Mat DkRawLoader::gammaTable(const LibRaw &iProcessor, double maxVal) const
 {
     // OK this is an instance of reverse engineering:
     // we found out that the values of (at least) the PhaseOne's achromatic back have to be doubled
@@ -2338,66 +4695,110 @@ cv::Mat DkRawLoader::gammaTable(const LibRaw &iProcessor) const
     unsigned short *gmtp = gmt.ptr<unsigned short>();
 
     for (int idx = 0; idx < gmt.cols; idx++) {
-        gmtp[idx] = clip<unsigned short>(qRound((1.099 * std::pow((double)idx / USHRT_MAX, gamma) - 0.099) * 255 * cameraHackMlp));
+        gmtp[idx] = clip<unsigned short>(qRound((1.099 * std::pow((double)idx / USHRT_MAX, gamma) - 0.099) * maxVal * cameraHackMlp));
     }
 
     // a 1 x 65535 U16 gamma table
     return gmt;
 }
 
-void DkRawLoader::whiteBalance(const LibRaw &iProcessor, cv::Mat &img) const
+/**
+ * Applies white balance, color correction and the gamma lookup to the rows of img.
+ * @param img a CV_16UC1 or CV_16UC3 image
+ * @param dst the developed image (8 or 16 bit) with the same number of channels
+ * @param lutp the gamma lookup (USHRT_MAX + 1 entries)
+ **/
+template <typename T>
+static void developRows(const cv::Mat &img, cv::Mat &dst, const T *lutp, const float *wbp, const float (*cm)[4], bool colorCorrect)
 {
-    // white balance must not be empty at this point
-    cv::Mat wb = whiteMultipliers(iProcessor);
-    const float *wbp = wb.ptr<float>();
-    assert(wb.cols == 4);
+    cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range &range) {
+        for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+            const unsigned short *ptr = img.ptr<unsigned short>(rIdx);
+            T *ptrD = dst.ptr<T>(rIdx);
+
+            if (!colorCorrect) {
+                for (int idx = 0; idx < img.cols * img.channels(); idx++)
+                    ptrD[idx] = lutp[ptr[idx]];
+
+                continue;
+            }
 
-    for (int rIdx = 0; rIdx < img.rows; rIdx++) {
-        unsigned short *ptr = img.ptr<unsigned short>(rIdx);
-
-        for (int cIdx = 0; cIdx < img.cols; cIdx++) {
-            // apply white balance correction
-            unsigned short r = clip<unsigned short>(*ptr * wbp[0]);
-            unsigned short g = clip<unsigned short>(*(ptr + 1) * wbp[1]);
-            unsigned short b = clip<unsigned short>(*(ptr + 2) * wbp[2]);
-
-            // apply color correction
-            int cr =
-                qRound(iProcessor.imgdata.color.rgb_cam[0][0] * r + iProcessor.imgdata.color.rgb_cam[0][1] * g + iProcessor.imgdata.color.rgb_cam[0][2] * b);
-            int cg =
-                qRound(iProcessor.imgdata.color.rgb_cam[1][0] * r + iProcessor.imgdata.color.rgb_cam[1][1] * g + iProcessor.imgdata.color.rgb_cam[1][2] * b);
-            int cb =
-                qRound(iProcessor.imgdata.color.rgb_cam[2][0] * r + iProcessor.imgdata.color.rgb_cam[2][1] * g + iProcessor.imgdata.color.rgb_cam[2][2] * b);
-
-            // clip & save color corrected values
-            *ptr = clip<unsigned short>(cr);
-            ptr++;
-            *ptr = clip<unsigned short>(cg);
-            ptr++;
-            *ptr = clip<unsigned short>(cb);
-            ptr++;
+            for (int cIdx = 0; cIdx < img.cols; cIdx++, ptr += 3, ptrD += 3) {
+                // apply white balance correction
+                unsigned short r = clip<unsigned short>(ptr[0] * wbp[0]);
+                unsigned short g = clip<unsigned short>(ptr[1] * wbp[1]);
+                unsigned short b = clip<unsigned short>(ptr[2] * wbp[2]);
+
+                // apply color correction
+                int cr = qRound(cm[0][0] * r + cm[0][1] * g + cm[0][2] * b);
+                int cg = qRound(cm[1][0] * r + cm[1][1] * g + cm[1][2] * b);
+                int cb = qRound(cm[2][0] * r + cm[2][1] * g + cm[2][2] * b);
+
+                // clip, gamma correct & save the values
+                ptrD[0] = lutp[clip<unsigned short>(cr)];
+                ptrD[1] = lutp[clip<unsigned short>(cg)];
+                ptrD[2] = lutp[clip<unsigned short>(cb)];
+            }
         }
-    }
+    });
 }
 
-void DkRawLoader::gammaCorrection(const LibRaw &iProcessor, cv::Mat &img) const
+/**
+ * Develops the normalized raw image in a single pass.
+ * White balance, color correction, gamma correction and the
+ * conversion to 8-bit (or 16-bit see Resources::rawHighBitDepth)
+ * are applied per pixel while a row is in the cache.
+ * @param iProcessor the LibRaw processor
+ * @param img a CV_16UC1 or CV_16UC3 image (see demosaic() and prepareImg())
+ * @return cv::Mat the developed CV_8U (CV_16U) image with the same number of channels
+ **/
+cv::Mat DkRawLoader::develop(const LibRaw &iProcessor, const cv::Mat &img) const
 {
-    // white balance must not be empty at this point
-    cv::Mat gt = gammaTable(iProcessor);
+    DkTimer dt;
+
+    const bool highBitDepth = mSettings->resources().rawHighBitDepth;
+    const double maxVal = highBitDepth ? USHRT_MAX : 255;
+
+    // fold the linear part and the clipping into one lookup table
+    cv::Mat gt = gammaTable(iProcessor, maxVal);
     const unsigned short *gammaLookup = gt.ptr<unsigned short>();
     assert(gt.cols == USHRT_MAX);
 
-    for (int rIdx = 0; rIdx < img.rows; rIdx++) {
-        unsigned short *ptr = img.ptr<unsigned short>(rIdx);
+    double linearMlp = (double)iProcessor.imgdata.params.gamm[1] / 255.0 * (maxVal / 255.0);
+    std::vector<unsigned short> lut(USHRT_MAX + 1);
 
-        for (int cIdx = 0; cIdx < img.cols * img.channels(); cIdx++) {
-            // values close to 0 are treated linear
-            if (ptr[cIdx] <= 5) // 0.018 * 255
-                ptr[cIdx] = (unsigned short)qRound(ptr[cIdx] * (double)iProcessor.imgdata.params.gamm[1] / 255.0);
-            else
-                ptr[cIdx] = gammaLookup[ptr[cIdx]];
-        }
+    for (int idx = 0; idx < (int)lut.size(); idx++) {
+        // values close to 0 are treated linear
+        if (idx <= 5) // 0.018 * 255
+            lut[idx] = clip<unsigned short>(qRound(idx * linearMlp));
+        else
+            lut[idx] = gammaLookup[qMin(idx, gt.cols - 1)];
+
+        lut[idx] = qMin(lut[idx], (unsigned short)maxVal);
+    }
+
+    // white balance must not be empty at this point
+    cv::Mat wb = whiteMultipliers(iProcessor);
+    const float *wbp = wb.ptr<float>();
+    assert(wb.cols == 4);
+
+    const float(*cm)[4] = iProcessor.imgdata.color.rgb_cam;
+    bool colorCorrect = mIsChromatic && img.channels() == 3;
+
+    cv::Mat dst;
+
+    if (highBitDepth) {
+        dst = cv::Mat(img.rows, img.cols, CV_16UC(img.channels()));
+        developRows<unsigned short>(img, dst, lut.data(), wbp, cm, colorCorrect);
+    } else {
+        std::vector<uchar> lut8(lut.begin(), lut.end());
+        dst = cv::Mat(img.rows, img.cols, CV_8UC(img.channels()));
+        developRows<uchar>(img, dst, lut8.data(), wbp, cm, colorCorrect);
     }
+
+    qCDebug(lcLoader) << "[RAW] developed in" << dt << (highBitDepth ? "(16 bit)" : "");
+
+    return dst;
 }
 
 void DkRawLoader::reduceColorNoise(const LibRaw &iProcessor, cv::Mat &img) const
@@ -2422,17 +4823,23 @@ void DkRawLoader::reduceColorNoise(const LibRaw &iProcessor, cv::Mat &img) const
 
         DkTimer dMed;
 
-        // revert back to 8-bit image
-        img.convertTo(img, CV_8U);
-
         cv::cvtColor(img, img, CV_RGB2YCrCb);
 
         std::vector<cv::Mat> imgCh;
         cv::split(img, imgCh);
         assert(imgCh.size() == 3);
 
-        cv::medianBlur(imgCh[1], imgCh[1], winSize);
-        cv::medianBlur(imgCh[2], imgCh[2], winSize);
+        // OpenCV's median filter supports large windows for 8-bit images only
+        // the chroma is smoothed anyway - so we can afford to filter it with 8-bit
+        for (int cIdx = 1; cIdx < 3; cIdx++) {
+            if (imgCh[cIdx].depth() == CV_16U) {
+                cv::Mat ch8;
+                imgCh[cIdx].convertTo(ch8, CV_8U, 1.0 / 257.0);
+                cv::medianBlur(ch8, ch8, winSize);
+                ch8.convertTo(imgCh[cIdx], CV_16U, 257.0);
+            } else
+                cv::medianBlur(imgCh[cIdx], imgCh[cIdx], winSize);
+        }
 
         cv::merge(imgCh, img);
         cv::cvtColor(img, img, CV_YCrCb2RGB);
@@ -2446,16 +4853,371 @@ QImage DkRawLoader::raw2Img(const LibRaw &iProcessor, cv::Mat &img) const
     if (iProcessor.imgdata.sizes.pixel_aspect != 1.0f)
         cv::resize(img, img, cv::Size(), (double)iProcessor.imgdata.sizes.pixel_aspect, 1.0f);
 
-    // revert back to 8-bit image
-    img.convertTo(img, CV_8U);
-
     // TODO: for now - fix this!
     if (img.channels() == 1)
         cv::cvtColor(img, img, CV_GRAY2RGB);
 
-    return DkImage::mat2QImage(img);
+    // 16 bit images are stored as RGBX64 (R, G, B, A as quint16) - the buffer is adopted, too
+    if (img.depth() == CV_16U) {
+        cv::cvtColor(img, img, CV_RGB2RGBA);
+
+        return QImage(
+            img.data,
+            img.cols,
+            img.rows,
+            (int)img.step,
+            QImage::Format_RGBX64,
+            [](void *mat) {
+                delete static_cast<cv::Mat *>(mat);
+            },
+            new cv::Mat(img));
+    }
+
+    // the developed image is not needed anymore - adopt its buffer
+    return DkImage::mat2QImageView(img);
+}
+
+#endif
+
+// -------------------------------------------------------------------- DkTiffRegionLoader
+DkTiffRegionLoader::DkTiffRegionLoader(const QString &filePath)
+{
+    mFilePath = filePath;
+}
+
+/**
+ * Reads the image size and the overview levels.
+ * @return bool true if the file is a TIFF that can be read.
+ **/
+bool DkTiffRegionLoader::open()
+{
+#ifdef WITH_LIBTIFF
+    silenceTiff();
+
+    TIFF *tiff = openTiffFile(mFilePath);
+
+    if (tiff) {
+        readLevels(tiff);
+        TIFFClose(tiff);
+    }
+#endif
+
+    return isValid();
+}
+
+/**
+ * Reads the image size and loads an overview if the image is huge.
+ * The file is opened once for both.
+ * @param maxSide the maximal side length of the overview
+ * @param token stops decoding - the overview is NULL then
+ * @return QImage the overview or a NULL image if the file is not a huge TIFF.
+ **/
+QImage DkTiffRegionLoader::overview(int maxSide, const DkCancelToken &token)
+{
+    QImage img;
+
+#ifdef WITH_LIBTIFF
+    silenceTiff();
+
+    TIFF *tiff = openTiffFile(mFilePath);
+
+    if (tiff) {
+        readLevels(tiff);
+
+        if ((qint64)mSize.width() * mSize.height() >= huge_image_pixels) {
+            double scale = qMin(1.0, (double)maxSide / qMax(mSize.width(), mSize.height()));
+            img = readRegion(tiff, QRect(QPoint(), mSize), scale, token);
+        }
+
+        TIFFClose(tiff);
+    }
+#else
+    Q_UNUSED(maxSide);
+    Q_UNUSED(token);
+#endif
+
+    return img;
+}
+
+bool DkTiffRegionLoader::isValid() const
+{
+    return !mSize.isEmpty();
+}
+
+QSize DkTiffRegionLoader::size() const
+{
+    return mSize;
+}
+
+int DkTiffRegionLoader::numLevels() const
+{
+    return mLevelSizes.size();
+}
+
+/**
+ * Decodes a region of the image.
+ * This method is thread-safe since it opens its own file handle.
+ * @param rect the region in full resolution coordinates
+ * @param scale the scale of the result (<= 1)
+ * @param token stops decoding - the region is NULL then
+ * @return QImage the region with approximately rect.size() * scale pixels.
+ **/
+QImage DkTiffRegionLoader::region(const QRect &rect, double scale, const DkCancelToken &token) const
+{
+    QImage img;
+
+#ifdef WITH_LIBTIFF
+    silenceTiff();
+
+    TIFF *tiff = openTiffFile(mFilePath);
+
+    if (tiff) {
+        img = readRegion(tiff, rect, scale, token);
+        TIFFClose(tiff);
+    }
+#else
+    Q_UNUSED(rect);
+    Q_UNUSED(scale);
+    Q_UNUSED(token);
+#endif
+
+    return img;
+}
+
+#ifdef WITH_LIBTIFF
+/**
+ * Reads the image size and the overview levels of an opened TIFF.
+ * @param tiff the TIFF which is positioned at its first directory
+ **/
+void DkTiffRegionLoader::readLevels(TIFF *tiff)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+
+    mSize = QSize(width, height);
+    mLevelSizes.clear();
+    mLevelOffsets.clear();
+    mLevelSizes << mSize;
+    mLevelOffsets << (quint64)TIFFCurrentDirOffset(tiff);
+
+    // overviews stored as SubIFDs (e.g. OME-TIFF)
+    QVector<quint64> subIfds;
+    uint16_t numSubIfds = 0;
+    toff_t *subIfdOffsets = 0;
+
+    if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &numSubIfds, &subIfdOffsets)) {
+        for (int idx = 0; idx < numSubIfds; idx++)
+            subIfds << (quint64)subIfdOffsets[idx];
+    }
+
+    for (quint64 offset : subIfds) {
+        if (!TIFFSetSubDirectory(tiff, offset))
+            continue;
+
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+        mLevelSizes << QSize(width, height);
+        mLevelOffsets << offset;
+    }
+
+    // overviews stored as reduced resolution pages (e.g. pyramidal TIFFs)
+    TIFFSetSubDirectory(tiff, mLevelOffsets.first());
+
+    while (TIFFReadDirectory(tiff)) {
+        uint32_t fileType = 0;
+
+        if (!TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &fileType) || !(fileType & FILETYPE_REDUCEDIMAGE))
+            continue;
+
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+        mLevelSizes << QSize(width, height);
+        mLevelOffsets << (quint64)TIFFCurrentDirOffset(tiff);
+    }
+
+    if (mLevelSizes.size() > 1)
+        qCDebug(lcLoader) << "[TIFF] overview levels:" << mLevelSizes;
 }
 
+/**
+ * Decodes a region of an opened TIFF.
+ * Only tiles or strips that contain sampled pixels are read. Huge
+ * strips (e.g. single-strip files) of 8 bit RGB or gray images are
+ * read line by line so that only the sampled rows are decoded.
+ * @param tiff the opened TIFF
+ * @param rect the region in full resolution coordinates
+ * @param scale the scale of the result (<= 1)
+ * @param token stops decoding - the region is NULL then
+ * @return QImage the region with approximately rect.size() * scale pixels.
+ **/
+QImage DkTiffRegionLoader::readRegion(TIFF *tiff, const QRect &rect, double scale, const DkCancelToken &token) const
+{
+    QImage img;
+    QRect r = rect & QRect(QPoint(), mSize);
+
+    if (r.isEmpty() || scale <= 0)
+        return img;
+
+    scale = qMin(scale, 1.0);
+
+    // choose the smallest level that is still large enough in both dimensions
+    int level = 0;
+    for (int idx = 1; idx < mLevelSizes.size(); idx++) {
+        const QSize &s = mLevelSizes[idx];
+        double ls = qMin((double)s.width() / mSize.width(), (double)s.height() / mSize.height());
+
+        if (ls >= scale && (qint64)s.width() * s.height() < (qint64)mLevelSizes[level].width() * mLevelSizes[level].height())
+            level = idx;
+    }
+
+    if (!TIFFSetSubDirectory(tiff, mLevelOffsets[level]))
+        return img;
+
+    DkTimer dt;
+
+    QSize ls = mLevelSizes[level];
+    double lx = (double)ls.width() / mSize.width();
+    double ly = (double)ls.height() / mSize.height();
+
+    // the region in level coordinates
+    QRect lr = QRect(qFloor(r.left() * lx), qFloor(r.top() * ly), qCeil(r.width() * lx), qCeil(r.height() * ly)) & QRect(QPoint(), ls);
+
+    // sampling step in level pixels
+    double step = qMax(lx / scale, 1.0);
+    int w = qMax(qFloor(lr.width() / step), 1);
+    int h = qMax(qFloor(lr.height() / step), 1);
+
+    QVector<int> srcX(w);
+    QVector<int> srcY(h);
+
+    for (int idx = 0; idx < w; idx++)
+        srcX[idx] = qMin(lr.left() + qFloor(idx * step), lr.right());
+    for (int idx = 0; idx < h; idx++)
+        srcY[idx] = qMin(lr.top() + qFloor(idx * step), lr.bottom());
+
+    img = QImage(w, h, QImage::Format_ARGB32);
+    img.fill(Qt::transparent);
+
+    // copies the sampled pixels of a decoded block
+    // libtiff's RGBA rasters have their origin in the lower left corner
+    auto copyBlock = [&](const std::vector<uint32_t> &raster, const QRect &block, int rasterWidth) {
+        int y0 = std::lower_bound(srcY.begin(), srcY.end(), block.top()) - srcY.begin();
+        int x0 = std::lower_bound(srcX.begin(), srcX.end(), block.left()) - srcX.begin();
+
+        for (int y = y0; y < h && srcY[y] <= block.bottom(); y++) {
+            QRgb *ptr = reinterpret_cast<QRgb *>(img.scanLine(y));
+            const uint32_t *row = &raster[(size_t)(block.height() - 1 - (srcY[y] - block.top())) * rasterWidth];
+
+            for (int x = x0; x < w && srcX[x] <= block.right(); x++) {
+                uint32_t p = row[srcX[x] - block.left()];
+                ptr[x] = qRgba(TIFFGetR(p), TIFFGetG(p), TIFFGetB(p), TIFFGetA(p));
+            }
+        }
+    };
+
+    // true if a sampled row/column falls into [first last]
+    auto isSampled = [](const QVector<int> &samples, int first, int last) {
+        auto it = std::lower_bound(samples.begin(), samples.end(), first);
+        return it != samples.end() && *it <= last;
+    };
+
+    int numBlocks = 0;
+
+    if (TIFFIsTiled(tiff)) {
+        uint32_t tw = 0, th = 0;
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &th);
+
+        std::vector<uint32_t> raster((size_t)tw * th);
+
+        for (int ty = lr.top() / (int)th * (int)th; ty <= lr.bottom(); ty += th) {
+            if (token.isCanceled())
+                break;
+
+            if (!isSampled(srcY, ty, ty + th - 1))
+                continue;
+
+            for (int tx = lr.left() / (int)tw * (int)tw; tx <= lr.right(); tx += tw) {
+                if (!isSampled(srcX, tx, tx + tw - 1))
+                    continue;
+
+                if (TIFFReadRGBATile(tiff, tx, ty, raster.data())) {
+                    copyBlock(raster, QRect(tx, ty, tw, th), tw);
+                    numBlocks++;
+                }
+            }
+        }
+    } else {
+        uint32_t rps = 0;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rps);
+        rps = qBound(1u, rps, (uint32_t)ls.height());
+
+        uint16_t bps = 0, spp = 0, planar = 0, photometric = 0, orientation = ORIENTATION_TOPLEFT;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bps);
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &spp);
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+        TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+
+        bool rgb = photometric == PHOTOMETRIC_RGB && spp >= 3;
+        bool gray = photometric == PHOTOMETRIC_MINISBLACK && spp >= 1;
+
+        if ((qint64)ls.width() * rps > max_strip_pixels && bps == 8 && planar == PLANARCONFIG_CONTIG && orientation == ORIENTATION_TOPLEFT
+            && (rgb || gray)) {
+            int numColors = rgb ? 3 : 1;
+            std::vector<uint8_t> line((size_t)TIFFScanlineSize(tiff));
+            int lastRow = -1;
+
+            for (int y = 0; y < h; y++) {
+                if (token.isCanceled())
+                    break;
+
+                // srcY is sorted - libtiff can skip forward in compressed strips
+                if (srcY[y] != lastRow) {
+                    if (TIFFReadScanline(tiff, line.data(), srcY[y]) < 0)
+                        break;
+
+                    lastRow = srcY[y];
+                    numBlocks++;
+                }
+
+                QRgb *ptr = reinterpret_cast<QRgb *>(img.scanLine(y));
+
+                for (int x = 0; x < w; x++) {
+                    const uint8_t *p = &line[(size_t)srcX[x] * spp];
+                    int a = spp > numColors ? p[numColors] : 255;
+                    ptr[x] = rgb ? qRgba(p[0], p[1], p[2], a) : qRgba(p[0], p[0], p[0], a);
+                }
+            }
+        } else {
+            std::vector<uint32_t> raster((size_t)ls.width() * rps);
+
+            for (int sy = lr.top() / (int)rps * (int)rps; sy <= lr.bottom(); sy += rps) {
+                if (token.isCanceled())
+                    break;
+
+                int rows = qMin((int)rps, ls.height() - sy);
+
+                if (!isSampled(srcY, sy, sy + rows - 1))
+                    continue;
+
+                if (TIFFReadRGBAStrip(tiff, sy, raster.data())) {
+                    copyBlock(raster, QRect(0, sy, ls.width(), rows), ls.width());
+                    numBlocks++;
+                }
+            }
+        }
+    }
+
+    if (token.isCanceled())
+        img = QImage();
+
+    qCDebug(lcLoader) << "[TIFF] region" << r << "decoded from level" << level << "(" << numBlocks << "blocks) in" << dt;
+
+    return img;
+}
 #endif
 
 // -------------------------------------------------------------------- DkTgaLoader
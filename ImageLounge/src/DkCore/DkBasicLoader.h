@@ -28,16 +28,27 @@
 #pragma once
 
 #pragma warning(push, 0)
+#include <QAtomicInt>
+#include <QCache>
+#include <QDateTime>
 #include <QFutureWatcher>
+#include <QHash>
 #include <QImage>
+#include <QMutex>
 #include <QNetworkAccessManager>
 #include <QSharedPointer>
 #include <QUrl>
+#include <QWaitCondition>
+
+#include <functional>
 #pragma warning(pop)
 
 #pragma warning(disable : 4251) // TODO: remove
 // #include "DkImageStorage.h"
 
+#include "DkScheduler.h"
+#include "DkSettings.h"
+
 #ifndef Q_OS_WIN
 #include "qpsdhandler.h"
 #endif
@@ -64,7 +75,12 @@
 
 // Qt defines
 class QNetworkReply;
+
+#ifdef WITH_LIBTIFF
+typedef struct tiff TIFF;
+#endif
 class LibRaw;
+class QuaZip;
 
 namespace nmc
 {
@@ -86,6 +102,7 @@ public:
     static QString decodeZipFile(const QString &encodedFileInfo);
     static QString decodeImageFile(const QString &encodedFileInfo);
     static QString encodeZipFile(const QString &zipFile, const QString &imageFile);
+    static void releaseArchive(const QString &zipFile);
 
 protected:
     QString mEncodedFilePath;
@@ -93,6 +110,102 @@ protected:
     QString mImageFileName;
     bool mImageInZip;
     static QString mZipMarker;
+
+    enum {
+        max_handles = 4, // idle handles per archive
+        max_archives = 8,
+        max_idle_time = 30000, // ms
+    };
+
+    // a handle & the state of the file it was opened on
+    struct DkZipHandle {
+        QuaZip *zip = 0;
+        QDateTime modified;
+        qint64 size = 0;
+        qint64 idleSince = 0; // ms since epoch
+    };
+
+    // parsed central directory & idle handles of an archive
+    struct DkZipArchive {
+        QDateTime modified;
+        qint64 size = 0;
+        QHash<QString, QPair<quint64, quint64>> entries; // file name -> position in the central directory
+        QVector<DkZipHandle> handles;
+    };
+
+    static QMutex mArchiveMutex;
+    static QHash<QString, DkZipArchive> mArchives;
+    static QCache<QString, QByteArray> mExtracted;
+
+    static DkZipHandle openArchive(const QString &zipFile);
+    static void closeArchive(const QString &zipFile, const DkZipHandle &handle);
+    static void closeIdleHandles();
+    static bool seekEntry(QuaZip *zip, const QString &zipFile, const QString &imageFile);
+    static void validateArchive(const QString &zipFile);
+
+    friend class DkZipExtractor;
+};
+
+/**
+ * Extracts files of an archive in the background.
+ * The central directory is parsed once (see DkZipContainer). The entries
+ * are then inflated by workers of the scheduler's CPU lane - each with its
+ * own read handle. Inflated files are written by the I/O lane while the
+ * workers inflate the next entries. Large entries are streamed to disk.
+ **/
+class DllCoreExport DkZipExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum {
+        max_buffered_bytes = 64 << 20, // inflated files that wait for the writers
+        stream_size = 16 << 20, // larger entries are written while they are inflated
+        chunk_size = 1 << 20,
+    };
+
+    DkZipExtractor(QObject *parent = 0);
+    ~DkZipExtractor();
+
+    bool extract(const QString &zipFile, const QStringList &entries, const QStringList &filePaths);
+    bool isRunning() const;
+    bool wasCanceled() const;
+
+    QStringList extractedFiles() const;
+    QStringList failedEntries() const;
+
+public slots:
+    void cancel();
+
+signals:
+    // NOTE: emitted from the scheduler's threads
+    void progress(int done, int total) const;
+    void finished() const; // also emitted if the extraction was canceled
+
+protected:
+    void work();
+    bool inflate(QuaZip *zip, int idx, QSharedPointer<QByteArray> &ba);
+    void write(int idx, QSharedPointer<QByteArray> ba);
+    void entryDone(int idx, bool extracted);
+    void taskDone();
+
+    static bool writeFile(const QString &filePath, const QByteArray &ba);
+
+    QString mZipFile;
+    QStringList mEntries;
+    QStringList mFilePaths;
+
+    QAtomicInt mNext; // the next entry that is inflated
+    QAtomicInt mCanceled;
+
+    mutable QMutex mMutex;
+    QWaitCondition mChanged;
+    int mNumTasks = 0; // workers & writes that are running
+    bool mFinishing = false; // finished() is emitted
+    int mNumDone = 0;
+    qint64 mBufferedBytes = 0;
+    QStringList mExtracted;
+    QStringList mFailed;
 };
 #endif
 
@@ -111,14 +224,30 @@ public:
     bool hasNewImage() const;
     bool hasNewMetaData() const;
     QSharedPointer<DkMetaDataT> metaData() const;
-    int size() const;
+    float size() const;
+
+    bool isDelta() const;
+    bool toDelta(const QImage &successor);
+    QImage fromDelta(const QImage &successor) const;
 
 protected:
+    enum { delta_tile = 128 };
+
+    QRect deltaTile(int tileIdx, const QSize &size) const;
+
     QString mEditName;
     QImage mImg;
     bool mNewImg;
     bool mNewMetaData;
     QSharedPointer<DkMetaDataT> mMetaData;
+
+    // delta items store the (compressed) tiles which differ from their successor
+    bool mIsDelta = false;
+    QVector<QPair<int, QByteArray>> mDeltaTiles;
+    QSize mDeltaSize;
+    int mDeltaBytes = 0;
+    int mDeltaDpmX = 0;
+    int mDeltaDpmY = 0;
 };
 
 class DllCoreExport DkRawLoader
@@ -128,6 +257,9 @@ public:
 
     bool isEmpty() const;
     void setLoadFast(bool fast);
+    void setDevelop(bool develop);
+    void setCancelToken(const DkCancelToken &token);
+    bool isPreview() const;
 
     bool load(const QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
 
@@ -148,8 +280,12 @@ protected:
     };
 
     bool mLoadFast = false;
+    bool mDevelop = false;
+    bool mIsPreview = false;
     bool mIsChromatic = true;
     Cam mCamType = camera_unknown;
+    DkCancelToken mCancelToken;
+    DkSettingsSnapshot mSettings; // captured once - the settings do not change while developing
 
     bool loadPreview(const QSharedPointer<QByteArray> &ba);
 
@@ -165,11 +301,9 @@ protected:
     cv::Mat prepareImg(const LibRaw &iProcessor) const;
 
     cv::Mat whiteMultipliers(const LibRaw &iProcessor) const;
-    cv::Mat gammaTable(const LibRaw &iProcessor) const;
-
-    void whiteBalance(const LibRaw &iProcessor, cv::Mat &img) const;
+    cv::Mat gammaTable(const LibRaw &iProcessor, double maxVal = 255) const;
 
-    void gammaCorrection(const LibRaw &iProcessor, cv::Mat &img) const;
+    cv::Mat develop(const LibRaw &iProcessor, const cv::Mat &img) const;
 
     void reduceColorNoise(const LibRaw &iProcessor, cv::Mat &img) const;
 
@@ -189,7 +323,143 @@ protected:
 
         return static_cast<num>(vr);
     }
+
+    qint64 rawScale(const LibRaw &iProcessor) const;
+
+    /**
+     * Integer version of clip<unsigned short>((val - black) / dynamicRange * USHRT_MAX).
+     * @param val the sensor value
+     * @param black the black point
+     * @param scale the 16.16 fixed-point scale (see rawScale())
+     * @return unsigned short the normalized value
+     **/
+    inline unsigned short normalizeRaw(int val, int black, qint64 scale) const
+    {
+        int d = val - black;
+
+        if (d <= 0)
+            return 0;
+
+        qint64 v = ((qint64)d * scale + (1 << 15)) >> 16;
+
+        // see clip()
+        return v > USHRT_MAX ? USHRT_MAX - 2 : static_cast<unsigned short>(v);
+    }
+#endif
+};
+
+/**
+ * Decodes regions of huge TIFF files.
+ * Only the tiles (or strips) that intersect a region are read. If the file
+ * has overviews (SubIFDs or reduced resolution pages), zoomed out regions are
+ * read from the smallest overview that is still large enough.
+ **/
+class DllCoreExport DkTiffRegionLoader
+{
+public:
+    DkTiffRegionLoader(const QString &filePath);
+
+    enum {
+        huge_image_pixels = 1 << 28, // 256 MP ~ 1 GB as ARGB32
+        overview_size = 4096,
+        max_strip_pixels = 1 << 24, // larger strips are read line by line
+    };
+
+    bool open();
+    bool isValid() const;
+    QSize size() const;
+    int numLevels() const;
+
+    QImage overview(int maxSide, const DkCancelToken &token = DkCancelToken());
+    QImage region(const QRect &rect, double scale, const DkCancelToken &token = DkCancelToken()) const;
+
+protected:
+#ifdef WITH_LIBTIFF
+    void readLevels(TIFF *tiff);
+    QImage readRegion(TIFF *tiff, const QRect &rect, double scale, const DkCancelToken &token) const;
 #endif
+
+    QString mFilePath;
+    QSize mSize;
+
+    // level 0 is the full resolution
+    QVector<QSize> mLevelSizes;
+    QVector<quint64> mLevelOffsets;
+};
+
+class DkBasicLoader;
+
+/**
+ * The state of one decode request.
+ * It is passed to all decoders that are tried for a file.
+ **/
+class DllCoreExport DkDecodeRequest
+{
+public:
+    QString filePath;
+    QString suffix; // lower case
+    QByteArray format; // sniffed from the magic bytes - empty if unknown
+    QByteArray qtFormat; // the format passed to the Qt decoders
+    QSharedPointer<QByteArray> buffer; // the caller's file buffer (can be empty)
+    QByteArray fileBuffer; // the file, if a decoder had to read it
+    QSize targetSize; // valid if a preview that covers the target size suffices
+    bool fast = false;
+    bool exists = true;
+    bool isTiff = false;
+    bool tiffMagic = false;
+    bool qtTried = false; // the Qt decoder failed for the sniffed format
+
+    // results
+    QImage img;
+    int loader = 0;
+
+    bool isPreview() const
+    {
+        return targetSize.isValid();
+    };
+};
+
+/**
+ * An image decoder of the DkDecoderRegistry.
+ **/
+class DllCoreExport DkDecoder
+{
+public:
+    enum Capability {
+        cap_none = 0x00,
+        cap_scaled = 0x01, // decodes downscaled images directly
+        cap_preview_only = 0x02, // answers preview requests only (e.g. embedded thumbnails)
+        cap_region = 0x04, // decodes regions (see DkTiffRegionLoader)
+        cap_pages = 0x08, // multi-page files
+        cap_cancel = 0x10, // checks the cancel token while decoding
+        cap_thread_safe = 0x20, // decodes several files concurrently
+    };
+
+    QString name;
+    int capabilities = cap_none;
+    std::function<bool(const DkDecodeRequest &)> accepts;
+    std::function<bool(DkBasicLoader &, DkDecodeRequest &)> decode;
+};
+
+/**
+ * Knows all image decoders and their capabilities.
+ * Decoders are tried in the order they were added. For previews,
+ * decoders that can skip the full resolution are tried first.
+ **/
+class DllCoreExport DkDecoderRegistry
+{
+public:
+    static DkDecoderRegistry &instance();
+
+    void add(const DkDecoder &decoder);
+    QVector<DkDecoder> candidates(const DkDecodeRequest &request) const;
+
+private:
+    DkDecoderRegistry();
+    DkDecoderRegistry(const DkDecoderRegistry &);
+
+    mutable QMutex mMutex;
+    QVector<DkDecoder> mDecoders;
 };
 
 /**
@@ -213,12 +483,18 @@ public:
         hdr_loader,
         tif_loader,
         tga_loader,
+        heif_loader,
+        jxl_loader,
     };
 
     DkBasicLoader(int mode = mode_default);
 
+    static void registerDecoders(DkDecoderRegistry &registry);
+
     ~DkBasicLoader()
     {
+        // the prefetcher decodes with this loader
+        mPagePrefetch.waitForFinished();
         release();
     };
 
@@ -235,6 +511,17 @@ public:
      **/
     bool loadGeneral(const QString &filePath, const QSharedPointer<QByteArray> ba, bool loadMetaData = false, bool fast = true);
 
+    /**
+     * Loads the image for the given file using metadata that was already parsed.
+     * The metadata is not read again - use this if the caller needed the metadata anyway (e.g. thumbnails).
+     * @param filePath an image file
+     * @param ba the file buffer (can be empty)
+     * @param metaData the metadata of filePath (if NULL, the metadata is read)
+     * @param fast if true, RAW files are loaded in fast mode
+     * @return bool true if the image was loaded
+     **/
+    bool loadGeneral(const QString &filePath, const QSharedPointer<QByteArray> ba, QSharedPointer<DkMetaDataT> metaData, bool fast = true);
+
     /**
      * Loads the page requested (with respect to the current page)
      * @param skipIdx number of pages to skip
@@ -242,6 +529,7 @@ public:
      **/
     bool loadPage(int skipIdx = 0);
     bool loadPageAt(int pageIdx = 0);
+    QImage decodePageAt(int pageIdx) const;
 
     int getNumPages() const
     {
@@ -255,15 +543,43 @@ public:
 
     bool setPageIdx(int skipIdx);
     void resetPageIdx();
+    float getPageCacheMemory() const;
+    float getHistoryMemory() const;
+
+    /**
+     * Sets a size hint for the next images loaded.
+     * Decoders that can downscale while decoding (e.g. JPEG's DCT scaling)
+     * then never allocate the full resolution buffer. The resulting image
+     * is at least as large as the hint (within its aspect ratio).
+     * @param size the target size - an invalid size loads the full resolution
+     **/
+    void setTargetSize(const QSize &size);
+    QSize targetSize() const;
+    void setDevelopRaw(bool develop);
+    bool isRawPreview() const;
+    QSharedPointer<DkTiffRegionLoader> regionLoader() const;
+
+    /**
+     * Stops decodes of this loader if token is canceled.
+     * The decoders check it between stages, strips and tiles. A canceled
+     * load fails (and frees its buffers) as soon as the current block is done.
+     * @param token the token of the current load
+     **/
+    void setCancelToken(const DkCancelToken &token);
+    bool isCanceled() const;
 
     QString save(const QString &filePath, const QImage &img, int compression = -1);
     bool saveToBuffer(const QString &filePath, const QImage &img, QSharedPointer<QByteArray> &ba, int compression = -1) const;
+    bool encodeToBuffer(const QString &filePath, const QImage &img, QSharedPointer<QByteArray> &ba, int compression = -1) const;
+    static bool prepareMetaData(QSharedPointer<DkMetaDataT> metaData, const QString &filePath, const QImage &img, QSharedPointer<QByteArray> ba, bool readFromFile = false);
+    static bool injectMetaData(QSharedPointer<DkMetaDataT> metaData, QSharedPointer<QByteArray> &ba);
     void saveThumbToMetaData(const QString &filePath, QSharedPointer<QByteArray> &ba);
     void saveMetaData(const QString &filePath, QSharedPointer<QByteArray> &ba);
     void saveThumbToMetaData(const QString &filePath);
     void saveMetaData(const QString &filePath);
 
     static bool isContainer(const QString &filePath);
+    static QByteArray sniffFormat(const QByteArray &header);
 
     /**
      * Sets a new image (if edited outside the basicLoader class)
@@ -338,6 +654,7 @@ public:
     void undo();
     void redo();
     QVector<DkEditImage> *history();
+    QImage historyImage(int idx) const;
     DkEditImage lastEdit() const;
 
     void setMinHistorySize(int size);
@@ -346,6 +663,7 @@ public:
 
     void loadFileToBuffer(const QString &filePath, QByteArray &ba) const;
     QSharedPointer<QByteArray> loadFileToBuffer(const QString &filePath) const;
+    static QSharedPointer<QByteArray> mapFileToBuffer(const QString &filePath);
     bool writeBufferToFile(const QString &fileInfo, const QSharedPointer<QByteArray> ba) const;
 
     void release();
@@ -375,7 +693,7 @@ public:
 #endif
 
     bool loadPSDFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
-    bool loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    bool loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
     bool loadDrifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
 
 #ifdef Q_OS_WIN
@@ -400,12 +718,40 @@ signals:
     void resetMetaDataSignal();
 
 protected:
+    void clearHistoryImage();
+    bool loadGeneral(const QString &filePath,
+                     const QSharedPointer<QByteArray> ba,
+                     bool loadMetaData,
+                     bool fast,
+                     QSharedPointer<DkMetaDataT> parsedMetaData);
+    bool loadScaledFile(const QString &filePath, QImage &img, const QByteArray &format, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    bool loadMappedFile(const QString &filePath, QImage &img, const QByteArray &format, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
     bool loadRohFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
     bool loadTgaFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
-    bool loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false) const;
+    bool loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false);
+    bool loadTIFFOverview(const QString &filePath, QImage &img);
+    bool loadPSDFast(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    bool loadHeifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+    bool loadJxlFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
     void indexPages(const QString &filePath, const QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+#ifdef WITH_LIBTIFF
+    void indexPages(TIFF *tiff, const QSharedPointer<QByteArray> ba);
+    TIFF *openTiff(const QString &filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    bool readTiffImage(TIFF *tiff, QImage &img, const DkCancelToken &token) const;
+#endif
+    QImage loadTiffPage(const QString &filePath, QSharedPointer<QByteArray> ba, int pageIdx, quint64 offset) const;
+    void prefetchPage(int pageIdx);
+    void collectPrefetchedPage();
+    void cachePage(int pageIdx, const QImage &img);
+    void clearPageCache();
+    QSharedPointer<DkMetaDataT> metaDataSnapshot();
+    QByteArray sniffFormat(const QString &filePath, QSharedPointer<QByteArray> ba);
     void convert32BitOrder(void *buffer, int width) const;
 
+    enum {
+        sniff_size = 4096,
+    };
+
     int mLoader;
     bool mTraining;
     int mMode;
@@ -414,8 +760,28 @@ protected:
     int mNumPages;
     int mPageIdx;
     bool mPageIdxDirty;
+    QVector<quint64> mPageOffsets;
+    QSharedPointer<QByteArray> mPageBuffer;
+    QCache<int, QImage> mPageCache; // cost in KB
+    QFuture<QImage> mPagePrefetch;
+    int mPrefetchIdx = -1;
+    int mLastPageIdx = 1;
+    QByteArray mSniffedFormat; // magic bytes of mSniffedFile
+    QString mSniffedFile;
+    QDateTime mSniffedModified;
+    QSize mTargetSize;
+    bool mDevelopRaw = false;
+    bool mIsRawPreview = false;
+    DkCancelToken mCancelToken;
+    QSharedPointer<DkTiffRegionLoader> mRegionLoader;
     QSharedPointer<DkMetaDataT> mMetaData;
+    QSharedPointer<DkMetaDataT> mMetaDataSnapshot; // shared by history items
+    QWeakPointer<DkMetaDataT> mSnapshotSource;
+    quint64 mSnapshotRevision = 0;
     QVector<DkEditImage> mImages;
+    mutable QMutex mHistoryMutex; // image() is const & called from the loading threads
+    mutable QImage mHistoryImg; // the last delta item restored - counted in the history memory
+    mutable int mHistoryImgIdx = -1;
     int mMinHistorySize = 2;
     int mImageIndex = 0;
 };
@@ -474,20 +840,33 @@ public:
 
 signals:
     void downloaded(const QString &filePath = "");
+    void partialImageSignal(const QImage &img);
 
 private slots:
     void fileDownloaded(QNetworkReply *pReply);
+    void dataReceived();
+    void partialDecoded();
     void saved();
 
 private:
+    enum {
+        partial_min_size = 1 << 16, // start decoding after 64 KB
+    };
+
+    void decodePartial();
+
     QNetworkAccessManager mWebCtrl;
     QSharedPointer<QByteArray> mDownloadedData;
     QUrl mUrl;
     QString mFilePath;
+    qint64 mDecodedSize = 0; // size of the data that was decoded last
+    bool mFinished = false;
 
     QFutureWatcher<bool> mSaveWatcher;
+    QFutureWatcher<QImage> mPartialWatcher;
 
-    static bool save(const QString &filePath, const QSharedPointer<QByteArray> data);
+    static bool save(const QString &filePath, const QByteArray data);
+    static QImage decode(const QByteArray &data);
 };
 
 }
@@ -0,0 +1,766 @@
+/*******************************************************************************************************
+ DkBenchmark.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkBenchmark.h"
+
+#include "DkBasicLoader.h"
+#include "DkBatchInfo.h"
+#include "DkImageContainer.h"
+#include "DkImageStorage.h"
+#include "DkManipulators.h"
+#include "DkMetaData.h"
+#include "DkProcess.h"
+#include "DkSettings.h"
+#include "DkTelemetry.h"
+#include "DkThumbs.h"
+#include "DkTimer.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkMemoryProbe --------------------------------------------------------------------
+DkMemoryProbe::DkMemoryProbe()
+{
+    reset();
+
+    mThread = QThread::create([this]() {
+        while (!mStop.loadRelaxed()) {
+            sample();
+            QThread::msleep(1);
+        }
+    });
+    mThread->start();
+}
+
+DkMemoryProbe::~DkMemoryProbe()
+{
+    mStop.storeRelaxed(1);
+    mThread->wait();
+    delete mThread;
+}
+
+/**
+ * Starts a new measurement - the peak is set to the current memory.
+ **/
+void DkMemoryProbe::reset()
+{
+    mPeak.storeRelaxed(DkMemory::getProcessMemory());
+}
+
+/**
+ * Returns the memory (in bytes) that is currently used.
+ * @return qint64 the memory or -1 if it cannot be measured on this platform
+ **/
+qint64 DkMemoryProbe::current()
+{
+    sample();
+    return DkMemory::getProcessMemory();
+}
+
+/**
+ * Returns the peak memory (in bytes) since the last reset.
+ **/
+qint64 DkMemoryProbe::peak() const
+{
+    return mPeak.loadRelaxed();
+}
+
+void DkMemoryProbe::sample()
+{
+    qint64 mem = DkMemory::getProcessMemory();
+    qint64 p = mPeak.loadRelaxed();
+
+    while (mem > p && !mPeak.testAndSetRelaxed(p, mem, p)) {
+    }
+}
+
+// DkBenchmark --------------------------------------------------------------------
+DkBenchmark::DkBenchmark(const QString &corpusPath)
+    : mCorpusPath(corpusPath)
+{
+    mTempPath = QDir(QDir::tempPath()).absoluteFilePath("nomacs-bench");
+}
+
+/**
+ * Runs the corpus benchmark and writes the results.
+ * @param corpusPath the corpus descriptor (JSON)
+ * @param resultsPath the results file - results are printed to stdout if empty
+ * @return int the exit code
+ **/
+int DkBenchmark::runBenchmark(const QString &corpusPath, const QString &resultsPath)
+{
+    // do not read or write persistent caches (e.g. thumbnails)
+    DkSettingsManager::edit().app().privateMode = true;
+
+    DkBenchmark bench(corpusPath);
+
+    if (!bench.run())
+        return 1;
+
+    if (!bench.saveResults(resultsPath))
+        return 1;
+
+    return bench.memoryFailures() > 0 ? 1 : 0;
+}
+
+int DkBenchmark::memoryFailures() const
+{
+    return mMemoryFailures;
+}
+
+/**
+ * Returns the size class of an image: small (< 4 MP), medium (< 20 MP) or large.
+ **/
+QString DkBenchmark::sizeClass(const QSize &size)
+{
+    qint64 px = (qint64)size.width() * size.height();
+
+    if (px < 4000000)
+        return "small";
+    else if (px < 20000000)
+        return "medium";
+
+    return "large";
+}
+
+bool DkBenchmark::run()
+{
+    DkTimer dt;
+
+    if (!loadCorpus())
+        return false;
+
+    for (Item &item : mItems)
+        benchmarkItem(item);
+
+    benchmarkBatch();
+
+    if (mMeasureMemory) {
+        for (const Item &item : mItems)
+            benchmarkMemory(item);
+    }
+
+    // the synthetic images are recreated by the next run
+    QDir(mTempPath).removeRecursively();
+
+    qInfo() << "[Benchmark]" << mResults.size() << "benchmarks of" << mItems.size() << "images computed in" << dt;
+
+    return true;
+}
+
+bool DkBenchmark::loadCorpus()
+{
+    QFile file(mCorpusPath);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "[Benchmark] cannot open corpus" << mCorpusPath;
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonObject corpus = QJsonDocument::fromJson(file.readAll(), &error).object();
+
+    if (error.error != QJsonParseError::NoError) {
+        qCritical() << "[Benchmark] illegal corpus" << mCorpusPath << error.errorString();
+        return false;
+    }
+
+    mIterations = qMax(corpus.value("iterations").toInt(mIterations), 1);
+    mMeasureMemory = corpus.contains("memory");
+    mMemoryConfig = corpus.value("memory").toObject();
+    QDir corpusDir = QFileInfo(mCorpusPath).absoluteDir();
+
+    for (const QJsonValue &v : corpus.value("images").toArray()) {
+        QJsonObject o = v.toObject();
+        Item item;
+
+        if (o.contains("synthetic")) {
+            QJsonObject s = o.value("synthetic").toObject();
+            item.filePath = createSynthetic(s.value("format").toString("jpg"), QSize(s.value("width").toInt(1024), s.value("height").toInt(768)));
+        } else
+            item.filePath = corpusDir.absoluteFilePath(o.value("path").toString());
+
+        QFile f(item.filePath);
+
+        if (item.filePath.isEmpty() || !f.open(QIODevice::ReadOnly)) {
+            qCritical() << "[Benchmark] cannot read" << item.filePath;
+            return false;
+        }
+
+        item.md5 = QCryptographicHash::hash(f.readAll(), QCryptographicHash::Md5).toHex();
+
+        // a different file would render the results incomparable
+        QString md5 = o.value("md5").toString();
+        if (!md5.isEmpty() && md5.compare(item.md5, Qt::CaseInsensitive) != 0) {
+            qCritical() << "[Benchmark]" << item.filePath << "does not match its md5 - expected:" << md5 << "got:" << item.md5;
+            return false;
+        }
+
+        item.bytes = f.size();
+        item.format = QFileInfo(item.filePath).suffix().toLower();
+        mItems << item;
+    }
+
+    if (mItems.isEmpty()) {
+        qCritical() << "[Benchmark] no images in" << mCorpusPath;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Writes img as flat, uncompressed 8 bit RGB Photoshop file.
+ * Qt cannot write PSDs - but flat files are simple: a header followed by the planes.
+ * @param img the RGB32 image
+ * @param filePath the file path
+ * @return bool true on success
+ **/
+static bool writeSyntheticPsd(const QImage &img, const QString &filePath)
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream ds(&file);
+    ds.setByteOrder(QDataStream::BigEndian);
+
+    ds.writeRawData("8BPS", 4);
+    ds << (quint16)1; // version
+    ds.writeRawData("\0\0\0\0\0\0", 6); // reserved
+    ds << (quint16)3 << (quint32)img.height() << (quint32)img.width() << (quint16)8 << (quint16)3; // channels, size, depth, RGB
+    ds << (quint32)0 << (quint32)0 << (quint32)0; // no color mode data, image resources, layers
+    ds << (quint16)0; // raw image data
+
+    QByteArray line(img.width(), 0);
+
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < img.height(); y++) {
+            const QRgb *ptr = reinterpret_cast<const QRgb *>(img.constScanLine(y));
+
+            for (int x = 0; x < img.width(); x++)
+                line[x] = (char)(c == 0 ? qRed(ptr[x]) : c == 1 ? qGreen(ptr[x]) : qBlue(ptr[x]));
+
+            ds.writeRawData(line.constData(), line.size());
+        }
+    }
+
+    return ds.status() == QDataStream::Ok;
+}
+
+/**
+ * Writes img as linear (demosaiced) 16 bit DNG.
+ * Real RAWs cannot be rendered - but linear DNGs run through LibRaw like camera files.
+ * @param img the RGB32 image
+ * @param filePath the file path
+ * @return bool true on success
+ **/
+static bool writeSyntheticDng(const QImage &img, const QString &filePath)
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream ds(&file);
+    ds.setByteOrder(QDataStream::LittleEndian);
+
+    enum { t_byte = 1, t_ascii = 2, t_short = 3, t_long = 4, t_rational = 5, t_srational = 10 };
+
+    const QByteArray model("nomacs synthetic\0", 18); // even size
+    const quint16 numTags = 15;
+    const quint32 bpsOffset = 8 + 2 + numTags * 12 + 4;
+    const quint32 modelOffset = bpsOffset + 3 * 2;
+    const quint32 matrixOffset = modelOffset + model.size();
+    const quint32 neutralOffset = matrixOffset + 9 * 8;
+    const quint32 dataOffset = neutralOffset + 3 * 8;
+    const quint32 dataSize = (quint32)img.width() * img.height() * 3 * 2;
+
+    auto tag = [&ds](quint16 id, quint16 type, quint32 count, quint32 value) {
+        ds << id << type << count << value;
+    };
+
+    ds.writeRawData("II", 2);
+    ds << (quint16)42 << (quint32)8;
+
+    // tags must be sorted
+    ds << numTags;
+    tag(254, t_long, 1, 0); // NewSubFileType: main image
+    tag(256, t_long, 1, img.width());
+    tag(257, t_long, 1, img.height());
+    tag(258, t_short, 3, bpsOffset);
+    tag(259, t_short, 1, 1); // uncompressed
+    tag(262, t_short, 1, 34892); // LinearRaw
+    tag(273, t_long, 1, dataOffset);
+    tag(277, t_short, 1, 3);
+    tag(278, t_long, 1, img.height());
+    tag(279, t_long, 1, dataSize);
+    tag(284, t_short, 1, 1); // chunky
+    tag(50706, t_byte, 4, 0x00000401); // DNGVersion 1.4.0.0
+    tag(50708, t_ascii, model.size(), modelOffset); // UniqueCameraModel
+    tag(50721, t_srational, 9, matrixOffset); // ColorMatrix1
+    tag(50728, t_rational, 3, neutralOffset); // AsShotNeutral
+    ds << (quint32)0; // no further IFDs
+
+    ds << (quint16)16 << (quint16)16 << (quint16)16;
+    ds.writeRawData(model.constData(), model.size());
+
+    for (int idx = 0; idx < 9; idx++)
+        ds << (qint32)(idx % 4 == 0 ? 1 : 0) << (qint32)1;
+
+    for (int idx = 0; idx < 3; idx++)
+        ds << (quint32)1 << (quint32)1;
+
+    for (int y = 0; y < img.height(); y++) {
+        const QRgb *ptr = reinterpret_cast<const QRgb *>(img.constScanLine(y));
+
+        for (int x = 0; x < img.width(); x++)
+            ds << (quint16)(qRed(ptr[x]) * 257) << (quint16)(qGreen(ptr[x]) * 257) << (quint16)(qBlue(ptr[x]) * 257);
+    }
+
+    return ds.status() == QDataStream::Ok;
+}
+
+/**
+ * Renders a deterministic test image with gradients, edges and text.
+ * @param format the file format (e.g. jpg, png, tif, psd, dng)
+ * @param size the image size
+ * @return QString the file path of the image, empty on failure
+ **/
+QString DkBenchmark::createSynthetic(const QString &format, const QSize &size) const
+{
+    QImage img(size, QImage::Format_RGB32);
+
+    for (int y = 0; y < img.height(); y++) {
+        QRgb *ptr = reinterpret_cast<QRgb *>(img.scanLine(y));
+
+        for (int x = 0; x < img.width(); x++) {
+            int r = x * 255 / qMax(img.width() - 1, 1);
+            int g = y * 255 / qMax(img.height() - 1, 1);
+            int b = ((x / 16 + y / 16) % 2) ? 200 : 40;
+            ptr[x] = qRgb(r, g, (b + (x * y) % 32) & 0xff);
+        }
+    }
+
+    QPainter p(&img);
+    p.setPen(QPen(Qt::white, qMax(size.width() / 500, 1)));
+
+    for (int idx = 0; idx < 32; idx++)
+        p.drawEllipse(QPoint(size.width() / 2, size.height() / 2), idx * size.width() / 64, idx * size.height() / 64);
+
+    p.end();
+
+    QDir().mkpath(mTempPath);
+    QString filePath = QDir(mTempPath).absoluteFilePath(QString("synthetic-%1x%2.%3").arg(size.width()).arg(size.height()).arg(format));
+
+    if (format == "psd" || format == "dng") {
+        if (!(format == "psd" ? writeSyntheticPsd(img, filePath) : writeSyntheticDng(img, filePath))) {
+            qCritical() << "[Benchmark] cannot write" << filePath;
+            return QString();
+        }
+
+        return filePath;
+    }
+
+    QImageWriter writer(filePath);
+    writer.setQuality(90);
+
+    if (!writer.write(img)) {
+        qCritical() << "[Benchmark] cannot write" << filePath << writer.errorString();
+        return QString();
+    }
+
+    return filePath;
+}
+
+/**
+ * Calls fnc (once for warm up) and records the timings of all iterations.
+ * @param name the benchmark name
+ * @param item the image benchmarked
+ * @param fnc the function to be measured
+ **/
+void DkBenchmark::measure(const QString &name, const Item &item, const std::function<void()> &fnc)
+{
+    fnc();
+
+    QVector<double> times;
+    QElapsedTimer t;
+
+    for (int idx = 0; idx < mIterations; idx++) {
+        t.start();
+        fnc();
+        times << t.nsecsElapsed() / 1e6;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    double mean = 0.0;
+    for (double ct : times)
+        mean += ct;
+    mean /= times.size();
+
+    QJsonObject r;
+    r["benchmark"] = name;
+    r["image"] = QFileInfo(item.filePath).fileName();
+    r["md5"] = item.md5;
+    r["format"] = item.format;
+    r["width"] = item.size.width();
+    r["height"] = item.size.height();
+    r["bytes"] = item.bytes;
+    r["iterations"] = mIterations;
+    r["min_ms"] = times.first();
+    r["median_ms"] = times[times.size() / 2];
+    r["mean_ms"] = mean;
+    mResults << r;
+
+    qInfo() << "[Benchmark]" << name << r["image"].toString() << "median:" << times[times.size() / 2] << "ms";
+}
+
+void DkBenchmark::benchmarkItem(Item &item)
+{
+    QFile file(item.filePath);
+    file.open(QIODevice::ReadOnly);
+    QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
+
+    QImage img;
+    bool rawPreview = false;
+    {
+        DkBasicLoader loader;
+        loader.loadGeneral(item.filePath, ba, false, false);
+        img = loader.image();
+        rawPreview = loader.isRawPreview();
+    }
+
+    if (img.isNull()) {
+        qWarning() << "[Benchmark] could not decode" << item.filePath;
+        return;
+    }
+
+    item.size = img.size();
+
+    // decode from memory - so we do not measure the disk
+    measure("decode", item, [&]() {
+        DkBasicLoader loader;
+        loader.loadGeneral(item.filePath, ba, false, false);
+    });
+
+    // RAW files are decoded from their embedded previews - so we develop them, too
+    if (rawPreview) {
+        measure("develop_raw", item, [&]() {
+            DkBasicLoader loader;
+            loader.setDevelopRaw(true);
+            loader.loadGeneral(item.filePath, ba, false, false);
+        });
+    }
+
+    measure("metadata", item, [&]() {
+        DkMetaDataT metaData;
+        metaData.readMetaData(item.filePath, ba);
+    });
+
+    measure("thumbnail", item, [&]() {
+        DkThumbNail thumb(item.filePath);
+        thumb.compute();
+    });
+
+    measure("thumbnail_full", item, [&]() {
+        DkThumbNail thumb(item.filePath);
+        thumb.compute(DkThumbNail::force_full_thumb);
+    });
+
+    measure("resize", item, [&]() {
+        DkImage::resizeImage(img, QSize(), 0.25, DkImage::ipl_area, false);
+    });
+
+    measure("resize_gamma", item, [&]() {
+        DkImage::resizeImage(img, QSize(), 0.25, DkImage::ipl_area, true);
+    });
+
+    // all manipulators with their default parameters
+    DkManipulatorManager manager;
+    manager.createManipulators(nullptr);
+
+    QVector<QSharedPointer<DkBaseManipulator>> mpls;
+    for (int idx = 0; idx < DkManipulatorManager::m_end; idx++)
+        mpls << manager.manipulator((DkManipulatorManager::ManipulatorId)idx);
+    for (int idx = DkManipulatorManager::m_end; idx < DkManipulatorManager::m_ext_end; idx++)
+        mpls << manager.manipulatorExt((DkManipulatorManager::ManipulatorExtId)idx);
+
+    for (const QSharedPointer<DkBaseManipulator> &mpl : mpls) {
+        if (!mpl)
+            continue;
+
+        measure("manipulator_" + mpl->name().remove('&').toLower().replace(' ', '_'), item, [&]() {
+            mpl->apply(img);
+        });
+    }
+}
+
+/**
+ * Converts the whole corpus to downscaled JPGs with the batch pipeline.
+ **/
+void DkBenchmark::benchmarkBatch()
+{
+    QStringList files;
+    qint64 bytes = 0;
+
+    for (const Item &item : mItems) {
+        files << item.filePath;
+        bytes += item.bytes;
+    }
+
+    QString outDir = QDir(mTempPath).absoluteFilePath("batch");
+
+    QSharedPointer<DkBatchTransform> transform(new DkBatchTransform());
+    transform->setProperties(0, false, QRect(), 0.5f);
+
+    DkSaveInfo si;
+    si.setMode(DkSaveInfo::mode_overwrite);
+
+    DkBatchConfig config(files, outDir, "bench-<d:4>.jpg");
+    config.setSaveInfo(si);
+    config.setProcessFunctions(QVector<QSharedPointer<DkAbstractBatch>>() << transform);
+
+    Item corpus;
+    corpus.filePath = QFileInfo(mCorpusPath).fileName();
+    corpus.format = "corpus";
+    corpus.bytes = bytes;
+
+    int numFailures = 0;
+    measure("batch", corpus, [&]() {
+        DkBatchProcessing process(config);
+        process.compute();
+        process.waitForFinished();
+        numFailures = process.getNumFailures();
+    });
+
+    // throughput of the median run
+    QJsonObject r = mResults.last().toObject();
+    double sec = r["median_ms"].toDouble() / 1000.0;
+    r["images"] = files.size();
+    r["failures"] = numFailures;
+    r["images_per_sec"] = sec > 0 ? files.size() / sec : 0.0;
+    r["mb_per_sec"] = sec > 0 ? bytes / (1024.0 * 1024.0) / sec : 0.0;
+    mResults[mResults.size() - 1] = r;
+}
+
+/**
+ * Returns the maximal number of frames a step may allocate.
+ * @param step the scenario step
+ * @param sizeClass the size class of the image (see sizeClass())
+ **/
+double DkBenchmark::memoryThreshold(const QString &step, const QString &sizeClass) const
+{
+    // peak (release: retained) bytes in decoded frames
+    QJsonObject defaults;
+    defaults["load"] = 2.5;
+    defaults["display"] = 1.0;
+    defaults["navigate"] = 2.5;
+    defaults["edit"] = 3.0;
+    defaults["save"] = 2.0;
+    defaults["release"] = 0.25;
+
+    QJsonObject cls = mMemoryConfig.value("classes").toObject().value(sizeClass).toObject();
+
+    if (cls.contains(step))
+        return cls.value(step).toDouble();
+
+    return mMemoryConfig.value("thresholds").toObject().value(step).toDouble(defaults.value(step).toDouble());
+}
+
+/**
+ * Measures the memory of load -> display -> navigate -> edit -> save -> release.
+ * The scenario runs twice - the first run initializes codecs and caches.
+ **/
+void DkBenchmark::benchmarkMemory(const Item &item)
+{
+    if (item.size.isEmpty())
+        return;
+
+    DkMemoryProbe probe;
+
+    if (probe.current() < 0) {
+        qWarning() << "[Benchmark] cannot measure the memory on this platform";
+        return;
+    }
+
+    qint64 frame = (qint64)item.size.width() * item.size.height() * 4;
+    QString sc = sizeClass(item.size);
+    QString outPath = QDir(mTempPath).absoluteFilePath("memory." + item.format);
+    QSize screen(1920, 1080);
+
+    QDir().mkpath(mTempPath);
+
+    DkManipulatorManager manager;
+    manager.createManipulators(nullptr);
+    QVector<QSharedPointer<DkBaseManipulator>> edits;
+    edits << manager.manipulator(DkManipulatorManager::m_invert) << manager.manipulator(DkManipulatorManager::m_flip_h);
+
+    for (int run = 0; run < 2; run++) {
+        QSharedPointer<DkImageContainer> current(new DkImageContainer(item.filePath));
+        QScopedPointer<DkImageStorage> storage(new DkImageStorage());
+        qint64 base = probe.current();
+
+        auto step = [&](const QString &name, const std::function<void()> &fnc) {
+            qint64 before = probe.current();
+            probe.reset();
+            fnc();
+            qint64 after = probe.current();
+            qint64 peak = qMax(probe.peak(), after) - before;
+
+            if (run == 0)
+                return;
+
+            // released memory is not a peak
+            double frames = name == "release" ? (double)(after - base) / frame : (double)peak / frame;
+            double threshold = memoryThreshold(name, sc);
+            bool passed = frames <= threshold;
+
+            QJsonObject r;
+            r["benchmark"] = "memory_" + name;
+            r["image"] = QFileInfo(item.filePath).fileName();
+            r["md5"] = item.md5;
+            r["format"] = item.format;
+            r["width"] = item.size.width();
+            r["height"] = item.size.height();
+            r["size_class"] = sc;
+            r["frame_bytes"] = frame;
+            r["peak_bytes"] = peak;
+            r["steady_bytes"] = after - base;
+            r["owned_bytes"] = DkTelemetry::instance().stats().totalMemory();
+            r["frames"] = frames;
+            r["threshold"] = threshold;
+            r["passed"] = passed;
+            mResults << r;
+
+            if (!passed) {
+                mMemoryFailures++;
+                qWarning().noquote() << "[Benchmark]" << name << r["image"].toString() << "needs" << QString::number(frames, 'f', 2)
+                                     << "frames - the threshold is" << threshold;
+            } else
+                qInfo().noquote() << "[Benchmark] memory" << name << r["image"].toString() << QString::number(frames, 'f', 2) << "frames";
+        };
+
+        step("load", [&]() {
+            current->loadImage();
+        });
+
+        step("display", [&]() {
+            QImage img = current->image();
+            storage->setImage(img, DkImageStorage::pyramid(img, screen));
+        });
+
+        // the next image is loaded while the current one is still displayed
+        step("navigate", [&]() {
+            QSharedPointer<DkImageContainer> next(new DkImageContainer(item.filePath));
+            next->loadImage();
+
+            QImage img = next->image();
+            storage->setImage(img, DkImageStorage::pyramid(img, screen));
+            current = next;
+        });
+
+        step("edit", [&]() {
+            for (const QSharedPointer<DkBaseManipulator> &mpl : edits) {
+                if (mpl)
+                    current->setImage(mpl->apply(current->image()), mpl->name());
+            }
+
+            QImage img = current->image();
+            storage->setImage(img, DkImageStorage::pyramid(img, screen));
+        });
+
+        step("save", [&]() {
+            current->saveImage(outPath);
+        });
+
+        step("release", [&]() {
+            current.clear();
+            storage.reset();
+        });
+    }
+
+    QFile::remove(outPath);
+}
+
+bool DkBenchmark::saveResults(const QString &filePath) const
+{
+    QJsonObject env;
+    env["nomacs"] = QApplication::applicationVersion();
+    env["qt"] = qVersion();
+    env["os"] = QSysInfo::prettyProductName();
+    env["cpu"] = QSysInfo::currentCpuArchitecture();
+    env["threads"] = QThread::idealThreadCount();
+
+    QJsonObject results;
+    results["corpus"] = QFileInfo(mCorpusPath).fileName();
+    results["environment"] = env;
+    results["results"] = mResults;
+
+    QByteArray json = QJsonDocument(results).toJson();
+
+    if (filePath.isEmpty()) {
+        QTextStream(stdout) << json;
+        return true;
+    }
+
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "[Benchmark] cannot write results to" << filePath;
+        return false;
+    }
+
+    file.write(json);
+    qInfo() << "[Benchmark] results written to" << filePath;
+
+    return true;
+}
+
+}
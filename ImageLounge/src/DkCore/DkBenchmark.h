@@ -0,0 +1,153 @@
+/*******************************************************************************************************
+ DkBenchmark.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInteger>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+class QByteArray;
+class QThread;
+
+namespace nmc
+{
+
+/**
+ * Tracks the peak memory of the process (see DkMemory::getProcessMemory).
+ * A thread samples the memory every millisecond. Full-frame copies
+ * live much longer than that - so they are not missed.
+ **/
+class DllCoreExport DkMemoryProbe
+{
+public:
+    DkMemoryProbe();
+    ~DkMemoryProbe();
+
+    void reset();
+    qint64 current();
+    qint64 peak() const;
+
+protected:
+    void sample();
+
+    QThread *mThread = 0;
+    QAtomicInt mStop;
+    QAtomicInteger<qint64> mPeak;
+};
+
+/**
+ * Measures the core image pipeline on a corpus of images.
+ * The corpus is described by a JSON file:
+ * {
+ *   "iterations": 5,
+ *   "images": [
+ *     { "path": "raw/canon-24mp.cr2", "md5": "..." },
+ *     { "synthetic": { "format": "jpg", "width": 6000, "height": 4000 } }
+ *   ]
+ * }
+ * Paths are relative to the descriptor. If a md5 is given, the file
+ * must match it - so results of different machines are comparable.
+ * Synthetic images are rendered deterministically into a temporary folder
+ * (jpg, png, tif and everything Qt writes, psd and linear dng are written by the benchmark).
+ * benchmark/default-corpus.json covers all formats at several sizes with synthetic images only.
+ * Results are written as JSON (one record per benchmark and image).
+ *
+ * If the corpus has a "memory" object, each image also runs through
+ * load -> display -> navigate -> edit -> save -> release and the peak
+ * and steady-state bytes of each step are recorded. Thresholds are
+ * given in decoded frames (width * height * 4 bytes) - they can be set
+ * for all images and overridden per size class (small, medium, large):
+ *   "memory": {
+ *     "thresholds": { "load": 2.5, "edit": 3 },
+ *     "classes": { "large": { "edit": 2.5 } }
+ *   }
+ * Steps that exceed their threshold fail the benchmark - so changes
+ * that add full-frame copies are caught.
+ **/
+class DllCoreExport DkBenchmark
+{
+public:
+    DkBenchmark(const QString &corpusPath);
+
+    bool run();
+    bool saveResults(const QString &filePath) const;
+
+    int memoryFailures() const;
+
+    static int runBenchmark(const QString &corpusPath, const QString &resultsPath);
+    static QString sizeClass(const QSize &size);
+
+protected:
+    struct Item {
+        QString filePath;
+        QString format;
+        QSize size;
+        qint64 bytes = 0;
+        QString md5;
+    };
+
+    bool loadCorpus();
+    QString createSynthetic(const QString &format, const QSize &size) const;
+
+    void measure(const QString &name, const Item &item, const std::function<void()> &fnc);
+    void benchmarkItem(Item &item);
+    void benchmarkBatch();
+    void benchmarkMemory(const Item &item);
+    double memoryThreshold(const QString &step, const QString &sizeClass) const;
+
+    QString mCorpusPath;
+    QString mTempPath;
+    int mIterations = 5;
+
+    QVector<Item> mItems;
+    QJsonArray mResults;
+
+    bool mMeasureMemory = false;
+    QJsonObject mMemoryConfig;
+    int mMemoryFailures = 0;
+};
+
+}
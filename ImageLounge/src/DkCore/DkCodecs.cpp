@@ -0,0 +1,515 @@
+/*******************************************************************************************************
+ DkCodecs.cpp
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkCodecs.h"
+
+#include "DkBasicLoader.h"
+#include "DkLog.h"
+#include "DkScratch.h"
+#include "DkTimer.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QFile>
+#include <QThreadPool>
+#include <QVector>
+
+#ifdef WITH_LIBHEIF
+#include <libheif/heif.h>
+#endif
+
+#ifdef WITH_LIBJXL
+#include <jxl/decode.h>
+#include <jxl/thread_parallel_runner.h>
+#endif
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+namespace
+{
+
+#if defined(WITH_LIBHEIF) || defined(WITH_LIBJXL)
+// the full decode of smaller images is fast enough - no need to show the preview first
+const qint64 preview_first_pixels = 8000000;
+
+int decoderThreads()
+{
+    return qMax(1, DkScheduler::instance().pool(DkScheduler::lane_cpu)->maxThreadCount());
+}
+#endif
+
+#ifdef WITH_LIBHEIF
+
+/**
+ * The primary image of a HEIF file.
+ **/
+class DkHeifFile
+{
+public:
+    DkHeifFile(const QString &filePath, const QSharedPointer<QByteArray> &ba)
+        : mBuffer(ba)
+    {
+        mCtx = heif_context_alloc();
+
+        // grid tiles are decoded in parallel
+        heif_context_set_max_decoding_threads(mCtx, decoderThreads());
+
+        // libheif reads the items it needs only - reading thumbnails is cheap
+        heif_error err;
+        if (mBuffer && !mBuffer->isEmpty())
+            err = heif_context_read_from_memory_without_copy(mCtx, mBuffer->constData(), mBuffer->size(), 0);
+        else
+            err = heif_context_read_from_file(mCtx, QFile::encodeName(filePath).constData(), 0);
+
+        if (err.code == heif_error_Ok)
+            heif_context_get_primary_image_handle(mCtx, &mHandle);
+        else
+            qCDebug(lcLoader) << "[HEIF] could not read" << filePath << err.message;
+    }
+
+    ~DkHeifFile()
+    {
+        if (mHandle)
+            heif_image_handle_release(mHandle);
+
+        heif_context_free(mCtx);
+    }
+
+    const heif_image_handle *primary() const
+    {
+        return mHandle;
+    }
+
+    /**
+     * Returns the smallest thumbnail whose longer side is at least minSide.
+     * If minSide is 0, the largest thumbnail is returned.
+     * The caller releases the handle.
+     **/
+    heif_image_handle *thumbnail(int minSide) const
+    {
+        int n = mHandle ? heif_image_handle_get_number_of_thumbnails(mHandle) : 0;
+
+        if (n <= 0)
+            return 0;
+
+        QVector<heif_item_id> ids(n);
+        n = heif_image_handle_get_list_of_thumbnail_IDs(mHandle, ids.data(), n);
+
+        heif_image_handle *best = 0;
+        int bestSide = 0;
+
+        for (int idx = 0; idx < n; idx++) {
+            heif_image_handle *th = 0;
+
+            if (heif_image_handle_get_thumbnail(mHandle, ids[idx], &th).code != heif_error_Ok || !th)
+                continue;
+
+            int side = qMax(heif_image_handle_get_width(th), heif_image_handle_get_height(th));
+            bool better = !best || (minSide > 0 ? side >= minSide && (bestSide < minSide || side < bestSide) : side > bestSide);
+
+            if (better) {
+                if (best)
+                    heif_image_handle_release(best);
+                best = th;
+                bestSide = side;
+            } else
+                heif_image_handle_release(th);
+        }
+
+        if (best && bestSide < minSide) {
+            heif_image_handle_release(best);
+            best = 0;
+        }
+
+        return best;
+    }
+
+private:
+    DkHeifFile(const DkHeifFile &) = delete;
+
+    QSharedPointer<QByteArray> mBuffer; // must outlive the context
+    heif_context *mCtx = 0;
+    heif_image_handle *mHandle = 0;
+};
+
+// releases the decoded pixels together with the last QImage copy
+void releaseHeifImage(void *img)
+{
+    heif_image_release(static_cast<heif_image *>(img));
+}
+
+/**
+ * Decodes an image (or thumbnail) item to 8 bit RGB(A).
+ * The transformations of the item (rotation, mirroring) are applied.
+ **/
+QImage decodeHeif(const heif_image_handle *handle, const DkCancelToken &token)
+{
+    if (token.isCanceled())
+        return QImage();
+
+    bool alpha = heif_image_handle_has_alpha_channel(handle) != 0;
+
+    heif_decoding_options *options = heif_decoding_options_alloc();
+    options->convert_hdr_to_8bit = 1;
+
+    heif_image *img = 0;
+    heif_error err = heif_decode_image(handle, &img, heif_colorspace_RGB, alpha ? heif_chroma_interleaved_RGBA : heif_chroma_interleaved_RGB, options);
+    heif_decoding_options_free(options);
+
+    if (err.code != heif_error_Ok || !img) {
+        qCDebug(lcLoader) << "[HEIF] could not decode:" << err.message;
+        return QImage();
+    }
+
+    int stride = 0;
+    uint8_t *data = heif_image_get_plane(img, heif_channel_interleaved, &stride);
+    int w = heif_image_get_width(img, heif_channel_interleaved);
+    int h = heif_image_get_height(img, heif_channel_interleaved);
+
+    if (!data || w <= 0 || h <= 0) {
+        heif_image_release(img);
+        return QImage();
+    }
+
+    return QImage(data, w, h, stride, alpha ? QImage::Format_RGBA8888 : QImage::Format_RGB888, &releaseHeifImage, img);
+}
+
+#endif
+
+#ifdef WITH_LIBJXL
+
+QSharedPointer<QByteArray> readFile(const QString &filePath, const QSharedPointer<QByteArray> &ba)
+{
+    if (ba && !ba->isEmpty())
+        return ba;
+
+    QSharedPointer<QByteArray> mapped = DkBasicLoader::mapFileToBuffer(filePath);
+
+    if (mapped)
+        return mapped;
+
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QSharedPointer<QByteArray>();
+
+    return QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+}
+
+/**
+ * A libjxl decoder with a parallel runner.
+ **/
+class DkJxlDecoder
+{
+public:
+    DkJxlDecoder()
+    {
+        mDec = JxlDecoderCreate(0);
+        mRunner = JxlThreadParallelRunnerCreate(0, decoderThreads());
+
+        if (mDec && mRunner && JxlDecoderSetParallelRunner(mDec, JxlThreadParallelRunner, mRunner) != JXL_DEC_SUCCESS) {
+            JxlDecoderDestroy(mDec);
+            mDec = 0;
+        }
+    }
+
+    ~DkJxlDecoder()
+    {
+        if (mDec)
+            JxlDecoderDestroy(mDec);
+        if (mRunner)
+            JxlThreadParallelRunnerDestroy(mRunner);
+    }
+
+    JxlDecoder *decoder() const
+    {
+        return mRunner ? mDec : 0;
+    }
+
+private:
+    DkJxlDecoder(const DkJxlDecoder &) = delete;
+
+    JxlDecoder *mDec = 0;
+    void *mRunner = 0;
+};
+
+// the size of the decoded pixels (xsize & ysize are given before the orientation is applied)
+QSize jxlSize(const JxlBasicInfo &info, uint32_t w, uint32_t h)
+{
+    if (info.orientation >= JXL_ORIENT_TRANSPOSE)
+        return QSize((int)h, (int)w);
+
+    return QSize((int)w, (int)h);
+}
+
+#endif
+
+}
+
+// DkHeifLoader --------------------------------------------------------------------
+DkHeifLoader::DkHeifLoader(const QString &filePath)
+{
+    mFilePath = filePath;
+}
+
+/**
+ * Requests a preview: a thumbnail that covers size is decoded instead of the image.
+ **/
+void DkHeifLoader::setTargetSize(const QSize &size)
+{
+    mTargetSize = size;
+}
+
+/**
+ * If true, the largest thumbnail of large images is decoded instead of the image.
+ * The image is then decoded later (see DkImageContainerT::refineImage()).
+ **/
+void DkHeifLoader::setLoadPreview(bool preview)
+{
+    mLoadPreview = preview;
+}
+
+void DkHeifLoader::setCancelToken(const DkCancelToken &token)
+{
+    mCancelToken = token;
+}
+
+bool DkHeifLoader::isPreview() const
+{
+    return mIsPreview;
+}
+
+QImage DkHeifLoader::image() const
+{
+    return mImg;
+}
+
+bool DkHeifLoader::load(const QSharedPointer<QByteArray> &ba)
+{
+#ifdef WITH_LIBHEIF
+    DkTimer dt;
+
+    DkHeifFile file(mFilePath, ba);
+    const heif_image_handle *handle = file.primary();
+
+    if (!handle)
+        return false;
+
+    qint64 numPixels = (qint64)heif_image_handle_get_width(handle) * heif_image_handle_get_height(handle);
+    heif_image_handle *th = 0;
+
+    if (mTargetSize.isValid())
+        th = file.thumbnail(qMax(mTargetSize.width(), mTargetSize.height()));
+    else if (mLoadPreview && numPixels >= preview_first_pixels)
+        th = file.thumbnail(0);
+
+    if (th) {
+        mImg = decodeHeif(th, mCancelToken);
+        mIsPreview = !mImg.isNull();
+        heif_image_handle_release(th);
+    }
+
+    if (mImg.isNull())
+        mImg = decodeHeif(handle, mCancelToken);
+
+    if (!mImg.isNull())
+        qCInfo(lcLoader) << "[HEIF]" << (mIsPreview ? "thumbnail" : "image") << mImg.size() << "loaded in" << dt;
+
+    return !mImg.isNull();
+#else
+    Q_UNUSED(ba);
+    return false;
+#endif
+}
+
+/**
+ * Returns the largest thumbnail of a HEIF file.
+ * Exiv2 does not read these thumbnail items.
+ * @return QImage the thumbnail (rotated already) or a null image
+ **/
+QImage DkHeifLoader::thumbnail(const QString &filePath, const QSharedPointer<QByteArray> &ba)
+{
+#ifdef WITH_LIBHEIF
+    DkHeifFile file(filePath, ba);
+    heif_image_handle *th = file.thumbnail(0);
+
+    if (!th)
+        return QImage();
+
+    QImage img = decodeHeif(th, DkCancelToken());
+    heif_image_handle_release(th);
+
+    return img;
+#else
+    Q_UNUSED(filePath);
+    Q_UNUSED(ba);
+    return QImage();
+#endif
+}
+
+// DkJxlLoader --------------------------------------------------------------------
+DkJxlLoader::DkJxlLoader(const QString &filePath)
+{
+    mFilePath = filePath;
+}
+
+/**
+ * Requests a preview: the preview frame is decoded if it covers size.
+ **/
+void DkJxlLoader::setTargetSize(const QSize &size)
+{
+    mTargetSize = size;
+}
+
+/**
+ * If true, only the preview frame of large images is decoded.
+ * The image is then decoded later (see DkImageContainerT::refineImage()).
+ **/
+void DkJxlLoader::setLoadPreview(bool preview)
+{
+    mLoadPreview = preview;
+}
+
+void DkJxlLoader::setCancelToken(const DkCancelToken &token)
+{
+    mCancelToken = token;
+}
+
+bool DkJxlLoader::isPreview() const
+{
+    return mIsPreview;
+}
+
+QImage DkJxlLoader::image() const
+{
+    return mImg;
+}
+
+bool DkJxlLoader::load(const QSharedPointer<QByteArray> &ba)
+{
+#ifdef WITH_LIBJXL
+    DkTimer dt;
+
+    QSharedPointer<QByteArray> buffer = readFile(mFilePath, ba);
+
+    if (!buffer || buffer->isEmpty())
+        return false;
+
+    DkJxlDecoder d;
+    JxlDecoder *dec = d.decoder();
+
+    if (!dec)
+        return false;
+
+    int events = JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE;
+    if (mTargetSize.isValid() || mLoadPreview)
+        events |= JXL_DEC_PREVIEW_IMAGE;
+
+    if (JxlDecoderSubscribeEvents(dec, events) != JXL_DEC_SUCCESS)
+        return false;
+
+    JxlDecoderSetInput(dec, reinterpret_cast<const uint8_t *>(buffer->constData()), buffer->size());
+    JxlDecoderCloseInput(dec);
+
+    JxlBasicInfo info;
+    JxlPixelFormat format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+    QImage::Format qFormat = QImage::Format_RGBX8888;
+    bool usePreview = false;
+    QImage img;
+
+    for (;;) {
+        if (mCancelToken.isCanceled())
+            return false;
+
+        JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+
+        if (status == JXL_DEC_BASIC_INFO) {
+            if (JxlDecoderGetBasicInfo(dec, &info) != JXL_DEC_SUCCESS)
+                return false;
+
+            if (info.alpha_bits > 0)
+                qFormat = QImage::Format_RGBA8888;
+
+            if (info.have_preview) {
+                int side = qMax(info.preview.xsize, info.preview.ysize);
+
+                if (mTargetSize.isValid())
+                    usePreview = side >= qMax(mTargetSize.width(), mTargetSize.height());
+                else
+                    usePreview = mLoadPreview && (qint64)info.xsize * info.ysize >= preview_first_pixels;
+            }
+        } else if (status == JXL_DEC_NEED_PREVIEW_OUT_BUFFER) {
+            // the preview is small - decode it even if we do not need it
+            size_t bytes = 0;
+            img = QImage(jxlSize(info, info.preview.xsize, info.preview.ysize), qFormat);
+
+            if (img.isNull() || JxlDecoderPreviewOutBufferSize(dec, &format, &bytes) != JXL_DEC_SUCCESS || bytes > (size_t)img.sizeInBytes()
+                || JxlDecoderSetPreviewOutBuffer(dec, &format, img.bits(), bytes) != JXL_DEC_SUCCESS)
+                return false;
+        } else if (status == JXL_DEC_PREVIEW_IMAGE) {
+            if (usePreview) {
+                mImg = img;
+                mIsPreview = true;
+                break;
+            }
+        } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+            size_t bytes = 0;
+            QSize s = jxlSize(info, info.xsize, info.ysize);
+
+            // images larger than the RAM are decoded to a mapped file
+            img = DkMappedImage::shouldMap(s, qFormat) ? DkMappedImage::allocate(s, qFormat) : QImage();
+            if (img.isNull())
+                img = QImage(s, qFormat);
+
+            if (img.isNull() || JxlDecoderImageOutBufferSize(dec, &format, &bytes) != JXL_DEC_SUCCESS || bytes > (size_t)img.sizeInBytes()
+                || JxlDecoderSetImageOutBuffer(dec, &format, img.bits(), bytes) != JXL_DEC_SUCCESS)
+                return false;
+        } else if (status == JXL_DEC_FULL_IMAGE) {
+            // the first frame of animations
+            mImg = img;
+            break;
+        } else if (status == JXL_DEC_SUCCESS) {
+            break;
+        } else {
+            qCDebug(lcLoader) << "[JXL] could not decode" << mFilePath;
+            return false;
+        }
+    }
+
+    if (!mImg.isNull())
+        qCInfo(lcLoader) << "[JXL]" << (mIsPreview ? "preview" : "image") << mImg.size() << "loaded in" << dt;
+
+    return !mImg.isNull();
+#else
+    Q_UNUSED(ba);
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,117 @@
+/*******************************************************************************************************
+ DkCodecs.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QImage>
+#include <QSharedPointer>
+#include <QString>
+#pragma warning(pop) // no warnings from includes - end
+
+#include "DkScheduler.h"
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Decodes HEIF (HEIC) and AVIF files with libheif.
+ * Unlike Qt's image plugins, it uses the thumbnail items of the
+ * container: if a preview is requested (target size), the smallest
+ * thumbnail that covers it is decoded instead of the image.
+ * The tiles of grid images (e.g. phone HEICs) are decoded in parallel
+ * by as many threads as the scheduler's CPU lane has.
+ * Needs nomacs to be compiled with libheif (WITH_LIBHEIF).
+ **/
+class DllCoreExport DkHeifLoader
+{
+public:
+    DkHeifLoader(const QString &filePath);
+
+    void setTargetSize(const QSize &size);
+    void setLoadPreview(bool preview);
+    void setCancelToken(const DkCancelToken &token);
+    bool isPreview() const;
+
+    bool load(const QSharedPointer<QByteArray> &ba = QSharedPointer<QByteArray>());
+
+    QImage image() const;
+
+    static QImage thumbnail(const QString &filePath, const QSharedPointer<QByteArray> &ba = QSharedPointer<QByteArray>());
+
+protected:
+    QString mFilePath;
+    QSize mTargetSize;
+    bool mLoadPreview = false;
+    bool mIsPreview = false;
+    DkCancelToken mCancelToken;
+
+    QImage mImg;
+};
+
+/**
+ * Decodes JPEG XL files with libjxl.
+ * libjxl's parallel runner gets as many threads as the scheduler's CPU
+ * lane has. Previews are answered with the preview frame of the file if
+ * it covers the target size.
+ * Needs nomacs to be compiled with libjxl (WITH_LIBJXL).
+ **/
+class DllCoreExport DkJxlLoader
+{
+public:
+    DkJxlLoader(const QString &filePath);
+
+    void setTargetSize(const QSize &size);
+    void setLoadPreview(bool preview);
+    void setCancelToken(const DkCancelToken &token);
+    bool isPreview() const;
+
+    bool load(const QSharedPointer<QByteArray> &ba = QSharedPointer<QByteArray>());
+
+    QImage image() const;
+
+protected:
+    QString mFilePath;
+    QSize mTargetSize;
+    bool mLoadPreview = false;
+    bool mIsPreview = false;
+    DkCancelToken mCancelToken;
+
+    QImage mImg;
+};
+
+}
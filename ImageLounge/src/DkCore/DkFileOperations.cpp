@@ -0,0 +1,269 @@
+/*******************************************************************************************************
+ DkFileOperations.cpp
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkFileOperations.h"
+
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// file states
+enum {
+    file_pending = 0,
+    file_done,
+    file_failed,
+    file_skipped, // e.g. the target is the source
+};
+
+// DkFileOperations --------------------------------------------------------------------
+DkFileOperations::DkFileOperations(Operation op, const QStringList &srcPaths, const QStringList &dstPaths, QObject *parent)
+    : QObject(parent)
+    , mOp(op)
+    , mSrcPaths(srcPaths)
+    , mDstPaths(dstPaths)
+{
+    Q_ASSERT(op == op_trash || srcPaths.size() == dstPaths.size());
+
+    mDone.resize(mSrcPaths.size());
+    mDone.fill(file_pending);
+
+    mProgressTimer.setInterval(100);
+    connect(&mProgressTimer, SIGNAL(timeout()), this, SLOT(reportProgress()));
+}
+
+DkFileOperations::~DkFileOperations()
+{
+    // workers reference this object
+    cancel();
+
+    for (QFutureWatcher<void> *w : mWorkers)
+        w->waitForFinished();
+}
+
+/**
+ * Starts the workers.
+ * Each worker takes the next file until all files are processed.
+ **/
+void DkFileOperations::start()
+{
+    if (mSrcPaths.empty()) {
+        emit finished();
+        deleteLater();
+        return;
+    }
+
+    QString path = mOp == op_trash || mOp == op_rename ? mSrcPaths.first() : mDstPaths.first();
+    int numWorkers = qMin(maxWorkers(path), mSrcPaths.size());
+
+    for (int idx = 0; idx < numWorkers; idx++) {
+        QFutureWatcher<void> *w = new QFutureWatcher<void>(this);
+        connect(w, SIGNAL(finished()), this, SLOT(workerFinished()));
+        w->setFuture(DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_interactive, [this]() {
+            work();
+        }, mToken));
+
+        mWorkers << w;
+        mNumRunning++;
+    }
+
+    mProgressTimer.start();
+    qInfo() << "[DkFileOperations] processing" << mSrcPaths.size() << "files with" << numWorkers << "workers";
+}
+
+bool DkFileOperations::isRunning() const
+{
+    return mNumRunning > 0;
+}
+
+DkFileOperations::Operation DkFileOperations::operation() const
+{
+    return mOp;
+}
+
+int DkFileOperations::size() const
+{
+    return mSrcPaths.size();
+}
+
+void DkFileOperations::cancel()
+{
+    mToken.cancel();
+}
+
+bool DkFileOperations::isCanceled() const
+{
+    return mToken.isCanceled();
+}
+
+/**
+ * The number of files that are processed in parallel.
+ * The workers run until all files are processed - so they take at most half
+ * of the I/O lane (images & thumbnails are loaded meanwhile).
+ * Network shares serialize most requests anyway and
+ * are slowed down by too many concurrent requests.
+ * @param path a file path of the target folder
+ **/
+int DkFileOperations::maxWorkers(const QString &path)
+{
+    int numWorkers = qBound(1, DkScheduler::instance().pool(DkScheduler::lane_io)->maxThreadCount() / 2, 8);
+
+    if (DkUtils::isNetworkPath(path))
+        return qMin(numWorkers, 2);
+
+    return numWorkers;
+}
+
+/**
+ * Returns the files that do not exist anymore (i.e. moved, renamed or trashed files).
+ **/
+QStringList DkFileOperations::removedFiles() const
+{
+    QStringList files;
+
+    if (mOp == op_copy || mOp == op_link)
+        return files;
+
+    for (int idx = 0; idx < mDone.size(); idx++) {
+        if (mDone[idx] == file_done)
+            files << mSrcPaths[idx];
+    }
+
+    return files;
+}
+
+/**
+ * Returns the files that were created.
+ **/
+QStringList DkFileOperations::addedFiles() const
+{
+    QStringList files;
+
+    if (mOp == op_trash)
+        return files;
+
+    for (int idx = 0; idx < mDone.size(); idx++) {
+        if (mDone[idx] == file_done)
+            files << mDstPaths[idx];
+    }
+
+    return files;
+}
+
+/**
+ * Returns the names of all files that could not be processed.
+ **/
+QStringList DkFileOperations::errors() const
+{
+    QStringList files;
+
+    for (int idx = 0; idx < mDone.size(); idx++) {
+        if (mDone[idx] == file_failed)
+            files << QFileInfo(mSrcPaths[idx]).fileName();
+    }
+
+    return files;
+}
+
+void DkFileOperations::work()
+{
+    for (int idx = mNextIdx.fetchAndAddRelaxed(1); idx < mSrcPaths.size(); idx = mNextIdx.fetchAndAddRelaxed(1)) {
+        if (mToken.isCanceled())
+            break;
+
+        // each worker writes its own entries only (data() does not detach)
+        mDone.data()[idx] = (char)process(idx);
+        mNumProcessed.fetchAndAddRelaxed(1);
+    }
+}
+
+int DkFileOperations::process(int idx) const
+{
+    const QString &src = mSrcPaths[idx];
+
+    if (mOp == op_trash)
+        return DkUtils::moveToTrash(src) ? file_done : file_failed;
+
+    const QString &dst = mDstPaths[idx];
+
+    // e.g. files that are pasted to their own folder
+    if (QFileInfo(src) == QFileInfo(dst))
+        return file_skipped;
+
+    // we never overwrite files
+    if (QFileInfo::exists(dst))
+        return file_failed;
+
+    QFile file(src);
+    bool ok = false;
+
+    switch (mOp) {
+    // a move is actually a rename
+    case op_move:
+    case op_rename:
+        ok = file.rename(dst);
+        break;
+    case op_link:
+        ok = file.link(dst);
+        break;
+    default:
+        ok = file.copy(dst);
+        break;
+    }
+
+    return ok ? file_done : file_failed;
+}
+
+void DkFileOperations::workerFinished()
+{
+    mNumRunning--;
+
+    if (mNumRunning > 0)
+        return;
+
+    mProgressTimer.stop();
+    reportProgress();
+
+    qInfo() << "[DkFileOperations]" << removedFiles().size() << "removed," << addedFiles().size() << "added," << errors().size() << "failed";
+
+    emit finished();
+    deleteLater();
+}
+
+void DkFileOperations::reportProgress() const
+{
+    emit progress(mNumProcessed.loadAcquire(), mSrcPaths.size());
+}
+
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************************************
+ DkFileOperations.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#pragma warning(pop) // no warnings from includes - end
+
+#include "DkScheduler.h"
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Copies, moves, links, renames or trashes files in the background.
+ * The files are processed by a few workers of the scheduler's I/O lane
+ * (at most half of it). Their number is bounded on network shares where
+ * parallel requests do not pay off. Existing files are never overwritten. Call start() and wait for finished() - then
+ * removedFiles() and addedFiles() describe what changed on disk.
+ * The operation deletes itself after finished() was emitted.
+ **/
+class DllCoreExport DkFileOperations : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Operation {
+        op_copy = 0,
+        op_move,
+        op_link,
+        op_rename,
+        op_trash,
+
+        op_end
+    };
+
+    /**
+     * @param op the operation
+     * @param srcPaths the files to be processed
+     * @param dstPaths the new file paths (empty for op_trash)
+     * @param parent the parent
+     **/
+    DkFileOperations(Operation op, const QStringList &srcPaths, const QStringList &dstPaths = QStringList(), QObject *parent = 0);
+    ~DkFileOperations();
+
+    void start();
+    bool isRunning() const;
+
+    Operation operation() const;
+    int size() const;
+
+    QStringList removedFiles() const;
+    QStringList addedFiles() const;
+    QStringList errors() const;
+    bool isCanceled() const;
+
+    static int maxWorkers(const QString &path);
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int done, int total) const;
+    void finished() const;
+
+private slots:
+    void workerFinished();
+    void reportProgress() const;
+
+private:
+    int process(int idx) const;
+    void work();
+
+    Operation mOp;
+    QStringList mSrcPaths;
+    QStringList mDstPaths;
+
+    // written by the workers (one entry per file)
+    QVector<char> mDone;
+    QAtomicInt mNextIdx = 0;
+    QAtomicInt mNumProcessed = 0;
+
+    DkCancelToken mToken;
+    QVector<QFutureWatcher<void> *> mWorkers;
+    int mNumRunning = 0;
+    QTimer mProgressTimer;
+};
+
+}
@@ -0,0 +1,154 @@
+/*******************************************************************************************************
+ DkFileWatcher.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkFileWatcher.h"
+
+#include "DkImageContainer.h"
+#include "DkScheduler.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QFileInfo>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkFileWatcher --------------------------------------------------------------------
+DkFileWatcher::DkFileWatcher()
+{
+    mTimer.setInterval(500);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(check()));
+    connect(&mStatWatcher, SIGNAL(finished()), this, SLOT(checked()));
+}
+
+DkFileWatcher &DkFileWatcher::instance()
+{
+    static DkFileWatcher inst;
+    return inst;
+}
+
+/**
+ * Starts watching the container's file.
+ * The current state of the file is the reference - later changes are reported.
+ * @param imgC the container (it must call unwatch() before it is deleted)
+ **/
+void DkFileWatcher::watch(DkImageContainerT *imgC)
+{
+    if (!imgC || mFiles.contains(imgC))
+        return;
+
+    QString filePath = imgC->watchedFilePath();
+    QFileInfo fi = filePath == imgC->filePath() ? imgC->fileInfo() : QFileInfo(filePath); // cached by the container
+
+    FileState state;
+    state.modified = fi.lastModified();
+    state.exists = fi.exists();
+
+    mFiles.insert(imgC, qMakePair(filePath, state));
+
+    if (!mTimer.isActive())
+        mTimer.start();
+}
+
+void DkFileWatcher::unwatch(DkImageContainerT *imgC)
+{
+    mFiles.remove(imgC);
+
+    if (mFiles.isEmpty())
+        mTimer.stop();
+}
+
+bool DkFileWatcher::isWatching(DkImageContainerT *imgC) const
+{
+    return mFiles.contains(imgC);
+}
+
+void DkFileWatcher::check()
+{
+    // slow shares - don't queue up checks
+    if (mStatWatcher.isRunning() || mFiles.isEmpty())
+        return;
+
+    QStringList filePaths;
+    for (auto f : mFiles)
+        filePaths << f.first;
+    filePaths.removeDuplicates();
+
+    mStatWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_prefetch, [filePaths]() {
+        return stat(filePaths);
+    }));
+}
+
+void DkFileWatcher::checked()
+{
+    FileStates states = mStatWatcher.result();
+    QVector<DkImageContainerT *> notify;
+
+    for (auto it = mFiles.begin(); it != mFiles.end(); ++it) {
+        auto s = states.find(it.value().first);
+
+        if (s == states.end())
+            continue;
+
+        if (s.value() != it.value().second) {
+            it.value().second = s.value();
+            notify << it.key();
+        } else if (it.key()->isUpdatePending()) {
+            notify << it.key(); // the file was not readable before
+        }
+    }
+
+    // containers might unwatch while being notified
+    for (DkImageContainerT *imgC : notify) {
+        if (mFiles.contains(imgC))
+            imgC->checkForFileUpdates();
+    }
+}
+
+/**
+ * Stats the files - this function is thread-safe.
+ * @param filePaths the files
+ * @return DkFileWatcher::FileStates the states of all files
+ **/
+DkFileWatcher::FileStates DkFileWatcher::stat(const QStringList &filePaths)
+{
+    FileStates states;
+
+    for (const QString &fp : filePaths) {
+        QFileInfo fi(fp);
+
+        FileState state;
+        state.exists = fi.exists();
+        state.modified = fi.lastModified();
+        states.insert(fp, state);
+    }
+
+    return states;
+}
+
+}
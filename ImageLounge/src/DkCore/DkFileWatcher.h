@@ -0,0 +1,100 @@
+/*******************************************************************************************************
+ DkFileWatcher.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+class DkImageContainerT;
+
+/**
+ * Watches the files of all displayed images.
+ * A single timer stats all watched files in one batch on the I/O lane.
+ * Containers are only notified (checkForFileUpdates) if their file changed
+ * or if they wait for a pending update. We do not use QFileSystemWatcher
+ * since it locks the files (the user could not delete them on Windows).
+ **/
+class DllCoreExport DkFileWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DkFileWatcher &instance();
+
+    void watch(DkImageContainerT *imgC);
+    void unwatch(DkImageContainerT *imgC);
+    bool isWatching(DkImageContainerT *imgC) const;
+
+protected slots:
+    void check();
+    void checked();
+
+protected:
+    DkFileWatcher();
+    DkFileWatcher(const DkFileWatcher &) = delete;
+
+    struct FileState {
+        QDateTime modified;
+        bool exists = false;
+
+        bool operator!=(const FileState &o) const
+        {
+            return modified != o.modified || exists != o.exists;
+        }
+    };
+
+    typedef QHash<QString, FileState> FileStates;
+
+    static FileStates stat(const QStringList &filePaths);
+
+    QTimer mTimer;
+    QFutureWatcher<FileStates> mStatWatcher;
+
+    // file path (zip archive for zip members) & last known state of the watched containers
+    QHash<DkImageContainerT *, QPair<QString, FileState>> mFiles;
+};
+
+}
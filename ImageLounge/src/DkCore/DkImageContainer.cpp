@@ -27,17 +27,25 @@
 
 #include "DkImageContainer.h"
 #include "DkBasicLoader.h"
+#include "DkFileWatcher.h"
 #include "DkImageStorage.h"
 #include "DkMetaData.h"
+#include "DkReadAhead.h"
+#include "DkScheduler.h"
 #include "DkSettings.h"
+#include "DkSharedImages.h"
 #include "DkThumbs.h"
 #include "DkTimer.h"
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QObject>
 #include <QRegularExpression>
+#include <QThread>
+#include <QThreadPool>
 #include <QtConcurrentRun>
 
 // quazip
@@ -58,6 +66,9 @@ namespace nmc
 QString DkZipContainer::mZipMarker = "dIrChAr";
 #endif
 
+// smoothed decode time (ms) - written by the loading threads
+static QAtomicInt sDecodeTime;
+
 // DkImageContainer --------------------------------------------------------------------
 /**
  * Creates a DkImageContainer.
@@ -122,6 +133,9 @@ void DkImageContainer::clear()
     if (mFileBuffer)
         mFileBuffer->clear();
     init();
+
+    // release pixels that no other tab uses
+    DkImageRegistry::instance().prune();
 }
 
 void DkImageContainer::undo()
@@ -268,15 +282,65 @@ QSharedPointer<QByteArray> DkImageContainer::getFileBuffer()
     return mFileBuffer;
 }
 
+void DkImageContainer::setFileBuffer(QSharedPointer<QByteArray> ba)
+{
+    mFileBuffer = ba;
+}
+
+/**
+ * Returns the histogram cached by the histogram widget.
+ * Check its imageKey - it might belong to a previous version of the image.
+ * @return QSharedPointer<DkImageHistogram> the histogram or NULL.
+ **/
+QSharedPointer<DkImageHistogram> DkImageContainer::histogram() const
+{
+    return mHistogram;
+}
+
+void DkImageContainer::setHistogram(QSharedPointer<DkImageHistogram> histogram)
+{
+    mHistogram = histogram;
+}
+
+/**
+ * Returns the memory that counts towards the cache budget.
+ * @return float the memory of the file buffer, the decoded image & cached pages in MB
+ **/
 float DkImageContainer::getMemoryUsage() const
 {
+    DkTelemetry::Stats s;
+    memoryUsage(s);
+
+    qint64 bytes = s.memory[DkTelemetry::mem_file_buffers] + s.memory[DkTelemetry::mem_images] + s.memory[DkTelemetry::mem_pages];
+
+    return bytes / (1024.0f * 1024.0f);
+}
+
+/**
+ * Adds the memory of this container to stats.
+ * @param stats the stats of all containers
+ **/
+void DkImageContainer::memoryUsage(DkTelemetry::Stats &stats) const
+{
+    if (mFileBuffer)
+        stats.memory[DkTelemetry::mem_file_buffers] += mFileBuffer->size();
+
+    for (const QImage &img : scaledImages)
+        stats.memory[DkTelemetry::mem_scaled_images] += img.sizeInBytes();
+
+    if (mThumb)
+        stats.memory[DkTelemetry::mem_thumbnails] += mThumb->getImage().sizeInBytes();
+
     if (!mLoader)
-        return 0;
+        return;
 
-    float memSize = mFileBuffer ? mFileBuffer->size() / (1024.0f * 1024.0f) : 0;
-    memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+    // the metadata keeps the file buffer for Exiv2 (even if we released ours)
+    if (QSharedPointer<DkMetaDataT> metaData = mLoader->getMetaData())
+        stats.memory[DkTelemetry::mem_file_buffers] += metaData->sourceMemory(mFileBuffer);
 
-    return memSize;
+    stats.memory[DkTelemetry::mem_images] += mLoader->image().sizeInBytes();
+    stats.memory[DkTelemetry::mem_pages] += qRound64(mLoader->getPageCacheMemory() * 1024.0 * 1024.0);
+    stats.memory[DkTelemetry::mem_history] += qRound64(mLoader->getHistoryMemory() * 1024.0 * 1024.0);
 }
 
 float DkImageContainer::getFileSize() const
@@ -284,6 +348,86 @@ float DkImageContainer::getFileSize() const
     return QFileInfo(mFilePath).size() / (1024.0f * 1024.0f);
 }
 
+/**
+ * Returns the natural order key of the file name.
+ * @return QString the sort key (see DkUtils::naturalSortKey)
+ **/
+QString DkImageContainer::sortName() const
+{
+    return mSortName;
+}
+
+/**
+ * Returns the (cached) sort value for a sort mode.
+ * The file is only queried once, subsequent calls (e.g. if
+ * the sort mode is changed) just return the cached value.
+ * This method is thread-safe.
+ * @param sortMode the sort mode (DkSettings::sortMode)
+ * @return qint64 the sort value - 0 if sorted by filename
+ **/
+qint64 DkImageContainer::sortValue(int sortMode) const
+{
+    QMutexLocker locker(&mSortMutex);
+
+    switch (sortMode) {
+    case DkSettings::sort_file_size:
+        cacheFileStats();
+        return mSortFileSize;
+    case DkSettings::sort_date_created:
+        cacheFileStats();
+        return mSortCreated;
+    case DkSettings::sort_date_modified:
+        cacheFileStats();
+        return mSortModified;
+    case DkSettings::sort_date_taken:
+        cacheMetaDataStats();
+        return mSortDateTaken;
+    case DkSettings::sort_rating:
+        cacheMetaDataStats();
+        return mSortRating;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Caches the file stats sort keys - mSortMutex must be locked.
+ **/
+void DkImageContainer::cacheFileStats() const
+{
+    if (mFileStatsCached)
+        return;
+
+    // one stat for all keys
+    QFileInfo fi(mFilePath);
+    QDateTime created = fi.birthTime();
+    QDateTime modified = fi.lastModified();
+
+    mSortFileSize = fi.size();
+    mSortCreated = created.isValid() ? created.toMSecsSinceEpoch() : 0;
+    mSortModified = modified.isValid() ? modified.toMSecsSinceEpoch() : 0;
+    mFileStatsCached = true;
+}
+
+/**
+ * Caches the metadata sort keys - mSortMutex must be locked.
+ **/
+void DkImageContainer::cacheMetaDataStats() const
+{
+    if (mMetaDataStatsCached)
+        return;
+
+    cacheFileStats();
+
+    // the index only reads metadata of files that are new or changed
+    DkMetaDataIndex::Entry e = DkMetaDataIndex::instance().entry(mFilePath, mSortModified, mSortFileSize);
+
+    // images without capture date (e.g. screenshots) are sorted by their creation date
+    mSortDateTaken = e.dateTaken != 0 ? e.dateTaken : mSortCreated;
+    mSortRating = e.rating;
+    mMetaDataStatsCached = true;
+}
+
 DkRotatingRect DkImageContainer::cropRect()
 {
     QSharedPointer<DkMetaDataT> metaData = getMetaData();
@@ -392,6 +536,10 @@ void DkImageContainer::setFilePath(const QString &filePath)
 {
     mFilePath = filePath;
     mFileInfo = QFileInfo(filePath);
+    mSortName = DkUtils::naturalSortKey(mFileInfo.fileName());
+
+    QMutexLocker locker(&mSortMutex);
+    mFileStatsCached = false;
 
 #ifdef Q_OS_WIN
     mFileNameStr = DkUtils::qStringToStdWString(fileName());
@@ -464,9 +612,25 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString &fil
 #endif
 
     if (fInfo.suffix().contains("psd")) { // for now just psd's are not cached because their file might be way larger than the part we need to read
+        // mapping only pages in what is read
+        QSharedPointer<QByteArray> mba = DkBasicLoader::mapFileToBuffer(fInfo.absoluteFilePath());
+        return mba ? mba : QSharedPointer<QByteArray>(new QByteArray());
+    }
+
+    // huge TIFFs are decoded region by region from the file (see DkTiffRegionLoader)
+    if (fInfo.suffix().contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption)) && fInfo.size() > 512 * 1024 * 1024) {
         return QSharedPointer<QByteArray>(new QByteArray());
     }
 
+    // network shares: reads are ordered and bounded per share
+    QSharedPointer<QByteArray> rba = DkReadAhead::instance().read(fInfo.absoluteFilePath());
+    if (rba)
+        return rba;
+
+    QSharedPointer<QByteArray> mba = DkBasicLoader::mapFileToBuffer(fInfo.absoluteFilePath());
+    if (mba)
+        return mba;
+
     QFile file(fInfo.absoluteFilePath());
     file.open(QIODevice::ReadOnly);
 
@@ -479,15 +643,35 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString &fil
 QSharedPointer<DkBasicLoader>
 DkImageContainer::loadImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer)
 {
+    QElapsedTimer timer;
+    timer.start();
+
     try {
         loader->loadGeneral(filePath, fileBuffer, true, false);
     } catch (...) {
         qWarning() << "Unknown error in DkImageContainer::lfoadImageIntern";
     }
 
+    // canceled & failed loads say nothing about the decode speed
+    if (loader->hasImage() && !loader->isCanceled()) {
+        int ms = (int)qMin(timer.elapsed(), (qint64)10000);
+        int old = sDecodeTime.loadRelaxed();
+        sDecodeTime.storeRelaxed(old > 0 ? (old + ms) / 2 : qMax(ms, 1));
+    }
+
     return loader;
 }
 
+/**
+ * Returns the (smoothed) time needed to decode an image of the folders browsed so far.
+ * The cacher uses it to decide how far it has to look ahead.
+ * @return int the decode time in ms or 0 if no image was decoded yet
+ **/
+int DkImageContainer::decodeTime()
+{
+    return sDecodeTime.loadRelaxed();
+}
+
 QString DkImageContainer::saveImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression)
 {
     return loader->save(filePath, saveImg, compression);
@@ -559,74 +743,62 @@ bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const Q
 
 bool imageContainerLessThan(const DkImageContainer &l, const DkImageContainer &r)
 {
-    switch (DkSettingsManager::param().global().sortMode) {
-    case DkSettings::sort_filename:
-#ifdef Q_OS_WIN
-        // not beautiful if you take a look at the code, but:
-        // time on Win8 with compFilename:
-        //		WinAPI, indexed ( 73872 ) files in:  " 92 ms"
-        //		[DkImageLoader]  73872  containers created in  " 1.825 sec"
-        //		[DkImageLoader] after sorting:  " 52.246 sec"
-        // time on Win8 with direct wCompLogic:
-        //		WinAPI, indexed ( 73872 ) files in:  " 63 ms"
-        //		[DkImageLoader]  73872  containers created in  " 1.203 sec"
-        //		[DkImageLoader] after sorting:  " 14.407 sec"
-        if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-            return DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-        else
-            return !DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-#else
-        if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-            return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
-        else
-            return DkUtils::compFilenameInv(l.fileInfo(), r.fileInfo());
-#endif
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
 
-    case DkSettings::sort_date_created:
-        if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-            return DkUtils::compDateCreated(l.fileInfo(), r.fileInfo());
-        else
-            return DkUtils::compDateCreatedInv(l.fileInfo(), r.fileInfo());
+    return imageContainerLessThan(l, r, settings->global().sortMode, settings->global().sortDir);
+}
 
-    case DkSettings::sort_file_size:
-        if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-            return DkUtils::compFileSize(l.fileInfo(), r.fileInfo());
-        else
-            return DkUtils::compFileSizeInv(l.fileInfo(), r.fileInfo());
+/**
+ * Compares two images with a given sort mode.
+ * Callers that compare many images (e.g. merging sorted lists) read
+ * the sort mode once instead of reading the settings for every comparison.
+ **/
+bool imageContainerLessThan(const DkImageContainer &l, const DkImageContainer &r, int sortMode, int sortDir)
+{
+    if (sortMode == DkSettings::sort_random)
+        return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
 
-    case DkSettings::sort_date_modified:
-        if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
-            return DkUtils::compDateModified(l.fileInfo(), r.fileInfo());
-        else
-            return DkUtils::compDateModifiedInv(l.fileInfo(), r.fileInfo());
+    // the keys are cached - so we don't stat the files for every comparison
+    // note: we used to use StrCmpLogicalW on windows which took ~14 sec for 73872 files
+    if (sortDir == DkSettings::sort_ascending)
+        return sortKeyLessThan(l.sortValue(sortMode), l.sortName(), r.sortValue(sortMode), r.sortName());
+    else
+        return sortKeyLessThan(r.sortValue(sortMode), r.sortName(), l.sortValue(sortMode), l.sortName());
+}
 
-    case DkSettings::sort_random:
-        return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
+/**
+ * Compares two precomputed sort keys.
+ * The sort value (date, size) is compared first, the natural
+ * order key of the file name is used if the values are equal.
+ **/
+bool sortKeyLessThan(qint64 lValue, const QString &lName, qint64 rValue, const QString &rName)
+{
+    if (lValue != rValue)
+        return lValue < rValue;
 
-    default:
-        // filename
-        return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
-    }
+    return lName < rName;
 }
 
 // DkImageContainerT --------------------------------------------------------------------
 DkImageContainerT::DkImageContainerT(const QString &filePath)
     : DkImageContainer(filePath)
 {
-    // our file watcher
-    mFileUpdateTimer.setSingleShot(false);
-    mFileUpdateTimer.setInterval(500);
-
-    connect(&mFileUpdateTimer, SIGNAL(timeout()), this, SLOT(checkForFileUpdates()), Qt::UniqueConnection);
     // connect(&metaDataWatcher, SIGNAL(finished()), this, SLOT(metaDataLoaded()));
 }
 
 DkImageContainerT::~DkImageContainerT()
 {
+    DkFileWatcher::instance().unwatch(this);
+
     mBufferWatcher.blockSignals(true);
     mBufferWatcher.cancel();
     mImageWatcher.blockSignals(true);
     mImageWatcher.cancel();
+    mRefineWatcher.blockSignals(true);
+    mRefineWatcher.cancel();
+    mScaledWatcher.blockSignals(true);
+    mStatsWatcher.blockSignals(true);
+    mStatsToken.cancel();
 
     // This dtor is where saveMetaData() used to be called, which called the "dangerous" overload of saveMetaData(),
     // which is dangerous because it updates the file. We consider this to be a bug.
@@ -642,6 +814,8 @@ DkImageContainerT::~DkImageContainerT()
 void DkImageContainerT::clear()
 {
     cancel();
+    cancelRefine();
+    mStatsToken.cancel();
 
     if (mFetchingImage || mFetchingBuffer)
         return;
@@ -649,6 +823,25 @@ void DkImageContainerT::clear()
     DkImageContainer::clear();
 }
 
+/**
+ * Returns the file that is watched for updates (see DkFileWatcher).
+ * @return QString the file path or the path of the zip archive for zip members
+ **/
+QString DkImageContainerT::watchedFilePath()
+{
+#ifdef WITH_QUAZIP
+    if (isFromZip())
+        return getZipData()->getZipFilePath();
+#endif
+
+    return filePath();
+}
+
+bool DkImageContainerT::isUpdatePending() const
+{
+    return mWaitForUpdate == update_pending;
+}
+
 void DkImageContainerT::checkForFileUpdates()
 {
 #ifdef WITH_QUAZIP
@@ -659,6 +852,16 @@ void DkImageContainerT::checkForFileUpdates()
     QDateTime modifiedBefore = fileInfo().lastModified();
     mFileInfo.refresh();
 
+    if (mFileInfo.lastModified() != modifiedBefore) {
+        {
+            QMutexLocker locker(&mSortMutex);
+            mFileStatsCached = false;
+        }
+
+        // the buffer is outdated - and a mapped buffer crashes if the file was rewritten in place
+        mFileBuffer.reset();
+    }
+
     bool changed = false;
 
     // if image exists_not don't do this
@@ -675,7 +878,7 @@ void DkImageContainerT::checkForFileUpdates()
 #endif
 
     if (changed) {
-        mFileUpdateTimer.stop();
+        DkFileWatcher::instance().unwatch(this);
         if (DkSettingsManager::param().global().askToSaveDeletedFiles) {
             mEdited = changed;
             emit fileLoadedSignal(true);
@@ -763,15 +966,38 @@ void DkImageContainerT::fetchFile()
     mFetchingBuffer = true; // saves the threaded call
     connect(&mBufferWatcher, SIGNAL(finished()), this, SLOT(bufferLoaded()), Qt::UniqueConnection);
 
-    mBufferWatcher.setFuture(QtConcurrent::run(this, &nmc::DkImageContainerT::loadFileToBuffer, filePath()));
+    QString fp = filePath();
+    mFetchToken = DkCancelToken();
+    mBufferWatcher.setFuture(DkScheduler::instance().run(
+        DkScheduler::lane_io,
+        fetchPriority(),
+        [this, fp]() {
+            return loadFileToBuffer(fp);
+        },
+        mFetchToken));
+}
+
+DkScheduler::Priority DkImageContainerT::fetchPriority() const
+{
+    return mSelected ? DkScheduler::priority_interactive : DkScheduler::priority_prefetch;
 }
 
 void DkImageContainerT::bufferLoaded()
 {
     mFetchingBuffer = false;
 
-    if (!mBufferWatcher.isCanceled())
-        mFileBuffer = mBufferWatcher.result();
+    if (mBufferWatcher.isCanceled()) {
+        // the request was dropped before it started - but loading was resumed since
+        if (getLoadState() == loading)
+            fetchFile();
+        else if (getLoadState() == loading_canceled) {
+            mLoadState = not_loaded;
+            clear();
+        }
+        return;
+    }
+
+    mFileBuffer = mBufferWatcher.result();
 
     if (getLoadState() == loading)
         fetchImage();
@@ -802,19 +1028,43 @@ void DkImageContainerT::fetchImage()
 
     connect(&mImageWatcher, SIGNAL(finished()), this, SLOT(imageLoaded()), Qt::UniqueConnection);
 
-    mImageWatcher.setFuture(QtConcurrent::run(this, &nmc::DkImageContainerT::loadImageIntern, filePath(), mLoader, mFileBuffer));
+    QString fp = filePath();
+    QSharedPointer<DkBasicLoader> loader = getLoader();
+    QSharedPointer<QByteArray> ba = mFileBuffer;
+
+    // cancel() stops the decode at its next checkpoint
+    mFetchToken = DkCancelToken();
+    loader->setCancelToken(mFetchToken);
+    mImageWatcher.setFuture(DkScheduler::instance().run(
+        DkScheduler::lane_cpu,
+        fetchPriority(),
+        [this, fp, loader, ba]() {
+            return loadImageIntern(fp, loader, ba);
+        },
+        mFetchToken));
 }
 
 void DkImageContainerT::imageLoaded()
 {
     mFetchingImage = false;
 
+    // the loader is reused - it must not keep a canceled token
+    bool stopped = mImageWatcher.isCanceled() || mImageWatcher.result()->isCanceled();
+    if (!mImageWatcher.isCanceled())
+        mImageWatcher.result()->setCancelToken(DkCancelToken());
+
     if (getLoadState() == loading_canceled) {
         mLoadState = not_loaded;
         clear();
         return;
     }
 
+    // dropped or stopped - but loading was resumed since
+    if (stopped) {
+        fetchImage();
+        return;
+    }
+
     // deliver image
     mLoader = mImageWatcher.result();
 
@@ -823,7 +1073,7 @@ void DkImageContainerT::imageLoaded()
 
 void DkImageContainerT::loadingFinished()
 {
-    DkTimer dt;
+    DkTraceSpan dt("container", "DkImageContainerT::loadingFinished", filePath());
 
     if (getLoadState() == loading_canceled) {
         mLoadState = not_loaded;
@@ -845,7 +1095,7 @@ void DkImageContainerT::loadingFinished()
     }
 
     if (!getLoader()->hasImage()) {
-        mFileUpdateTimer.stop();
+        DkFileWatcher::instance().unwatch(this);
         mEdited = false;
         QString msg = tr("Sorry, I could not load: %1").arg(fileName());
         emit showInfoSignal(msg);
@@ -861,12 +1111,208 @@ void DkImageContainerT::loadingFinished()
         double bs = mFileBuffer->size() / (1024.0f * 1024.0f);
 
         // if the file buffer is more than 5MB - we check if we need to delete it
-        if (bs > 5 && bs > DkSettingsManager::param().resources().cacheMemory * 0.5f)
+        if (bs > 5 && bs > DkMemoryGovernor::instance().cacheMemory() * 0.5)
             mFileBuffer->clear();
     }
 
     mLoadState = loaded;
     emit fileLoadedSignal(true);
+
+    // only the current image is developed - prefetched neighbours keep their preview
+    if (mSelected) {
+        refineImage();
+        computeStatistics();
+    }
+}
+
+/**
+ * Develops the RAW data in the background if only the embedded preview is shown.
+ * The developed image replaces the preview once it is ready (see imageRefined()).
+ **/
+void DkImageContainerT::refineImage()
+{
+    if (mRefining || mEdited || getLoadState() != loaded || !getLoader()->isRawPreview())
+        return;
+
+    if (DkSettingsManager::param().resources().loadRawThumb != DkSettings::raw_thumb_refine)
+        return;
+
+    // copy the buffer (implicitly shared) - clear() must not pull it away from the worker
+    // the copy keeps the original alive since it may be a view of a mapped file
+    QSharedPointer<QByteArray> src = getFileBuffer();
+    QSharedPointer<QByteArray> ba(new QByteArray(*src), [src](QByteArray *b) {
+        delete b;
+    });
+
+    mRefining = true;
+    connect(&mRefineWatcher, SIGNAL(finished()), this, SLOT(imageRefined()), Qt::UniqueConnection);
+
+    mRefineToken = DkCancelToken();
+    mRefineWatcher.setFuture(QtConcurrent::run(refinePool(), this, &nmc::DkImageContainerT::refineImageIntern, filePath(), ba, mRefineToken));
+}
+
+/**
+ * Stops a pending RAW develop.
+ * A develop that is not running yet is skipped entirely. A running develop
+ * stops at its next stage and its result is dropped.
+ **/
+void DkImageContainerT::cancelRefine()
+{
+    if (mRefining) {
+        mRefineWatcher.cancel();
+        mRefineToken.cancel();
+    }
+}
+
+void DkImageContainerT::imageRefined()
+{
+    mRefining = false;
+
+    if (mRefineWatcher.isCanceled()) {
+        // we were selected again while the canceled develop was running
+        if (mSelected)
+            refineImage();
+        return;
+    }
+
+    QSharedPointer<DkBasicLoader> loader = mRefineWatcher.result();
+
+    // keep the preview if the user edited it meanwhile
+    if (!loader || !loader->hasImage() || mEdited || getLoadState() != loaded || getLoader()->history()->size() > 1)
+        return;
+
+    mLoader = loader;
+    qInfoClean() << "[RAW] developed " << filePath();
+
+    emit imageUpdatedSignal();
+    computeStatistics();
+}
+
+/**
+ * Computes the statistics (histogram) of the current image version in the background.
+ * They are shown by the histogram panel and reused by auto adjust & normalize,
+ * which then only remap the pixels.
+ **/
+void DkImageContainerT::computeStatistics()
+{
+    QImage img = image();
+
+    if (img.isNull() || mStatsWatcher.isRunning())
+        return;
+
+    if (mHistogram && mHistogram->exact && mHistogram->imageKey == img.cacheKey())
+        return;
+
+    // another tab or an adjustment computed them already
+    DkImageHistogram h = DkImageHistogram::cached(img);
+    if (!h.isEmpty()) {
+        setHistogram(QSharedPointer<DkImageHistogram>(new DkImageHistogram(h)));
+        return;
+    }
+
+    connect(&mStatsWatcher, SIGNAL(finished()), this, SLOT(statisticsComputed()), Qt::UniqueConnection);
+
+    mStatsToken = DkCancelToken();
+    mStatsWatcher.setFuture(DkScheduler::instance().run(
+        DkScheduler::lane_cpu,
+        DkScheduler::priority_batch,
+        [img]() {
+            return QSharedPointer<DkImageHistogram>(new DkImageHistogram(DkImageHistogram::statistics(img)));
+        },
+        mStatsToken));
+}
+
+void DkImageContainerT::statisticsComputed()
+{
+    if (mStatsWatcher.isCanceled() || getLoadState() != loaded)
+        return;
+
+    QSharedPointer<DkImageHistogram> h = mStatsWatcher.result();
+
+    // the image was edited meanwhile
+    if (h && !h->isEmpty() && h->imageKey == image().cacheKey())
+        setHistogram(h);
+}
+
+/**
+ * Returns the image scaled to height if it is cached.
+ * Otherwise, it is scaled in the background and a null image is returned.
+ * thumbLoadedSignal() is emitted as soon as the scaled image is ready.
+ * @param height the height of the scaled image
+ * @return QImage the scaled image or a null image if it is not computed yet
+ **/
+QImage DkImageContainerT::imageScaledToHeightThreaded(int height)
+{
+    QImage img = image();
+
+    if (img.isNull())
+        return QImage();
+
+    // the image was edited
+    if (img.cacheKey() != mScaledSourceKey) {
+        scaledImages.clear();
+        mScaledSourceKey = img.cacheKey();
+    }
+
+    for (const QImage &sImg : scaledImages) {
+        if (sImg.height() == height)
+            return sImg;
+    }
+
+    if (!mScaledWatcher.isRunning()) {
+        mScaledPendingKey = img.cacheKey();
+        connect(&mScaledWatcher, SIGNAL(finished()), this, SLOT(scaledImageComputed()), Qt::UniqueConnection);
+        mScaledWatcher.setFuture(QtConcurrent::run([img, height]() {
+            return img.scaledToHeight(height, Qt::SmoothTransformation);
+        }));
+    }
+
+    return QImage();
+}
+
+void DkImageContainerT::scaledImageComputed()
+{
+    // the image changed meanwhile - the next request computes it again
+    if (mScaledPendingKey == mScaledSourceKey) {
+        scaledImages << mScaledWatcher.result();
+
+        if (scaledImages.size() > 10)
+            scaledImages.pop_front();
+    }
+
+    emit thumbLoadedSignal();
+}
+
+/**
+ * A single low priority thread for RAW development.
+ * The develop itself is parallel - so running several at once would only
+ * compete with the loading of the images the user is browsing.
+ * @return QThreadPool* the pool
+ **/
+QThreadPool *DkImageContainerT::refinePool()
+{
+    static QThreadPool pool;
+    pool.setMaxThreadCount(1);
+
+    return &pool;
+}
+
+QSharedPointer<DkBasicLoader>
+DkImageContainerT::refineImageIntern(const QString &filePath, const QSharedPointer<QByteArray> fileBuffer, const DkCancelToken &token)
+{
+    QThread::currentThread()->setPriority(QThread::LowPriority);
+
+    QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+    loader->setDevelopRaw(true);
+    loader->setCancelToken(token);
+
+    try {
+        loader->loadGeneral(filePath, fileBuffer, true, false);
+    } catch (...) {
+        qWarning() << "Unknown error in DkImageContainerT::refineImageIntern";
+    }
+
+    return loader;
 }
 
 void DkImageContainerT::downloadFile(const QUrl &url)
@@ -881,6 +1327,7 @@ void DkImageContainerT::downloadFile(const QUrl &url)
 
         mFileDownloader = QSharedPointer<FileDownloader>(new FileDownloader(url, saveFile.absoluteFilePath(), this));
         connect(mFileDownloader.data(), SIGNAL(downloaded(const QString &)), this, SLOT(fileDownloaded(const QString &)), Qt::UniqueConnection);
+        connect(mFileDownloader.data(), SIGNAL(partialImageSignal(const QImage &)), this, SIGNAL(partialImageSignal(const QImage &)), Qt::UniqueConnection);
         qDebug() << "trying to download: " << url;
     } else
         mFileDownloader->downloadFile(url);
@@ -921,6 +1368,7 @@ void DkImageContainerT::cancel()
         return;
 
     mLoadState = loading_canceled;
+    mFetchToken.cancel();
 }
 
 void DkImageContainerT::receiveUpdates(QObject *obj, bool connectSignals /* = true */)
@@ -932,17 +1380,27 @@ void DkImageContainerT::receiveUpdates(QObject *obj, bool connectSignals /* = tr
         connect(this, SIGNAL(showInfoSignal(const QString &, int, int)), obj, SIGNAL(showInfoSignal(const QString &, int, int)), Qt::UniqueConnection);
         connect(this, SIGNAL(fileSavedSignal(const QString &, bool, bool)), obj, SLOT(imageSaved(const QString &, bool, bool)), Qt::UniqueConnection);
         connect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()), Qt::UniqueConnection);
-        mFileUpdateTimer.start();
+        connect(this, SIGNAL(partialImageSignal(const QImage &)), obj, SIGNAL(partialImageSignal(const QImage &)), Qt::UniqueConnection);
+        DkFileWatcher::instance().watch(this);
     } else if (!connectSignals) {
         disconnect(this, SIGNAL(errorDialogSignal(const QString &)), obj, SLOT(errorDialog(const QString &)));
         disconnect(this, SIGNAL(fileLoadedSignal(bool)), obj, SLOT(imageLoaded(bool)));
         disconnect(this, SIGNAL(showInfoSignal(const QString &, int, int)), obj, SIGNAL(showInfoSignal(const QString &, int, int)));
         disconnect(this, SIGNAL(fileSavedSignal(const QString &, bool, bool)), obj, SLOT(imageSaved(const QString &, bool, bool)));
         disconnect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()));
-        mFileUpdateTimer.stop();
+        disconnect(this, SIGNAL(partialImageSignal(const QImage &)), obj, SIGNAL(partialImageSignal(const QImage &)));
+        DkFileWatcher::instance().unwatch(this);
+
+        // the user moved on - the preview is enough
+        cancelRefine();
     }
 
+    bool selected = !mSelected && connectSignals;
     mSelected = connectSignals;
+
+    // a cached preview becomes the current image
+    if (selected)
+        refineImage();
 }
 
 void DkImageContainerT::saveMetaDataThreaded(const QString &filePath)
@@ -950,8 +1408,13 @@ void DkImageContainerT::saveMetaDataThreaded(const QString &filePath)
     if (!exists() || (getLoader()->getMetaData() && !getLoader()->getMetaData()->isDirty()))
         return;
 
-    mFileUpdateTimer.stop();
-    QFuture<void> future = QtConcurrent::run(this, &nmc::DkImageContainerT::saveMetaDataIntern, filePath, getLoader(), getFileBuffer());
+    DkFileWatcher::instance().unwatch(this);
+    QSharedPointer<DkBasicLoader> loader = getLoader();
+    QSharedPointer<QByteArray> ba = getFileBuffer();
+
+    DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_interactive, [this, filePath, loader, ba]() {
+        saveMetaDataIntern(filePath, loader, ba);
+    });
 }
 
 void DkImageContainerT::saveMetaDataThreaded()
@@ -988,10 +1451,16 @@ bool DkImageContainerT::saveImageThreaded(const QString &filePath, const QImage
 
     qDebug() << "attempting to save: " << filePath;
 
-    mFileUpdateTimer.stop();
+    DkFileWatcher::instance().unwatch(this);
     connect(&mSaveImageWatcher, SIGNAL(finished()), this, SLOT(savingFinished()), Qt::UniqueConnection);
 
-    mSaveImageWatcher.setFuture(QtConcurrent::run(this, &nmc::DkImageContainerT::saveImageIntern, filePath, mLoader, saveImg, compression));
+    QSharedPointer<DkBasicLoader> loader = mLoader;
+
+    // encoding dominates - so it runs in the CPU lane
+    mSaveImageWatcher.setFuture(
+        DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [this, filePath, loader, saveImg, compression]() {
+            return saveImageIntern(filePath, loader, saveImg, compression);
+        }));
 
     return true;
 }
@@ -1025,7 +1494,7 @@ void DkImageContainerT::savingFinished()
         mDownloaded = false;
         if (mSelected) {
             loadImageThreaded(true); // force a reload
-            mFileUpdateTimer.start();
+            DkFileWatcher::instance().watch(this);
         }
     }
 }
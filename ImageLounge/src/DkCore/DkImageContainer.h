@@ -29,7 +29,9 @@
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QFutureWatcher>
+#include <QMutex>
 #include <QSharedPointer>
+#include <QThreadPool>
 #include <QTimer>
 #pragma warning(pop) // no warnings from includes - end
 
@@ -45,12 +47,15 @@
 #endif
 #endif
 
+#include "DkScheduler.h"
+#include "DkTelemetry.h"
 #include "DkThumbs.h"
 
 namespace nmc
 {
 // nomacs defines
 class DkBasicLoader;
+class DkImageHistogram;
 class DkMetaDataT;
 class DkZipContainer;
 class FileDownloader;
@@ -95,12 +100,19 @@ public:
     void setEdited(bool edited = true);
     QString getTitleAttribute() const;
     float getMemoryUsage() const;
+    void memoryUsage(DkTelemetry::Stats &stats) const;
     float getFileSize() const;
+    QString sortName() const;
+    qint64 sortValue(int sortMode) const;
+    static int decodeTime();
 
     virtual QSharedPointer<DkBasicLoader> getLoader();
     virtual QSharedPointer<DkMetaDataT> getMetaData();
     virtual QSharedPointer<DkThumbNailT> getThumb();
     virtual QSharedPointer<QByteArray> getFileBuffer();
+    void setFileBuffer(QSharedPointer<QByteArray> ba);
+    QSharedPointer<DkImageHistogram> histogram() const;
+    void setHistogram(QSharedPointer<DkImageHistogram> histogram);
 #ifdef WITH_QUAZIP
     QSharedPointer<DkZipContainer> getZipData();
 #endif
@@ -135,10 +147,13 @@ protected:
     QString saveImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
     void setFilePath(const QString &filePath);
     void init();
+    void cacheFileStats() const;
+    void cacheMetaDataStats() const;
 
     QSharedPointer<QByteArray> mFileBuffer;
     QSharedPointer<DkBasicLoader> mLoader;
     QSharedPointer<DkThumbNailT> mThumb;
+    QSharedPointer<DkImageHistogram> mHistogram;
 
     int mLoadState = not_loaded;
     bool mEdited = false;
@@ -147,6 +162,18 @@ protected:
     QFileInfo mFileInfo;
     QVector<QImage> scaledImages;
 
+    // sort keys - the file stats are cached so that sorting does not touch the file system
+    // they are computed lazily by sorting threads - mSortMutex guards them
+    QString mSortName;
+    mutable QMutex mSortMutex;
+    mutable bool mFileStatsCached = false;
+    mutable qint64 mSortFileSize = 0;
+    mutable qint64 mSortCreated = 0;
+    mutable qint64 mSortModified = 0;
+    mutable bool mMetaDataStatsCached = false;
+    mutable qint64 mSortDateTaken = 0;
+    mutable qint64 mSortRating = 0;
+
 #ifdef WITH_QUAZIP
     QSharedPointer<DkZipContainer> mZipData;
 #endif
@@ -159,6 +186,8 @@ private:
 };
 
 bool imageContainerLessThan(const DkImageContainer &l, const DkImageContainer &r);
+bool imageContainerLessThan(const DkImageContainer &l, const DkImageContainer &r, int sortMode, int sortDir);
+bool sortKeyLessThan(qint64 lValue, const QString &lName, qint64 rValue, const QString &rName);
 bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const QSharedPointer<DkImageContainer> r);
 
 class DllCoreExport DkImageContainerT : public QObject, public DkImageContainer
@@ -180,7 +209,10 @@ public:
     bool saveImageThreaded(const QString &filePath, int compression = -1);
     void saveMetaDataThreaded(const QString &filePath);
     void saveMetaDataThreaded();
+    QImage imageScaledToHeightThreaded(int height);
     bool isFileDownloaded() const;
+    QString watchedFilePath();
+    bool isUpdatePending() const;
 
     virtual QSharedPointer<DkBasicLoader> getLoader() override;
     virtual QSharedPointer<DkThumbNailT> getThumb() override;
@@ -197,6 +229,7 @@ signals:
     void errorDialogSignal(const QString &msg) const;
     void thumbLoadedSignal(bool loaded = true) const;
     void imageUpdatedSignal() const;
+    void partialImageSignal(const QImage &img) const;
 
 public slots:
     void checkForFileUpdates();
@@ -206,20 +239,32 @@ protected slots:
     void imageLoaded();
     void savingFinished();
     void loadingFinished();
+    void imageRefined();
+    void scaledImageComputed();
+    void statisticsComputed();
     void fileDownloaded(const QString &filePath);
 
 protected:
     void fetchImage();
+    void refineImage();
+    void cancelRefine();
+    void computeStatistics();
+    static QThreadPool *refinePool();
+    DkScheduler::Priority fetchPriority() const;
 
     QSharedPointer<QByteArray> loadFileToBuffer(const QString &filePath);
     QSharedPointer<DkBasicLoader> loadImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
     QString saveImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
     void saveMetaDataIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
+    QSharedPointer<DkBasicLoader> refineImageIntern(const QString &filePath, const QSharedPointer<QByteArray> fileBuffer, const DkCancelToken &token);
 
     QFutureWatcher<QSharedPointer<QByteArray>> mBufferWatcher;
     QFutureWatcher<QSharedPointer<DkBasicLoader>> mImageWatcher;
+    QFutureWatcher<QSharedPointer<DkBasicLoader>> mRefineWatcher;
     QFutureWatcher<QString> mSaveImageWatcher;
     QFutureWatcher<bool> mSaveMetaDataWatcher;
+    QFutureWatcher<QImage> mScaledWatcher;
+    QFutureWatcher<QSharedPointer<DkImageHistogram>> mStatsWatcher;
 
     QSharedPointer<FileDownloader> mFileDownloader;
 
@@ -235,9 +280,13 @@ protected:
 
     bool mFetchingImage = false;
     bool mFetchingBuffer = false;
+    DkCancelToken mFetchToken; // stops loads if the image is canceled
+    DkCancelToken mRefineToken;
+    DkCancelToken mStatsToken; // skips the statistics of released images
+    bool mRefining = false;
     bool mDownloaded = false;
-
-    QTimer mFileUpdateTimer;
+    qint64 mScaledSourceKey = 0; // cacheKey of the image scaledImages were computed from
+    qint64 mScaledPendingKey = 0;
 };
 
 }
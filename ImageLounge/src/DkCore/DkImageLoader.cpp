@@ -32,11 +32,17 @@
 #include "DkDialog.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
+#include "DkLog.h"
 #include "DkMessageBox.h"
 #include "DkMetaData.h"
+#include "DkReadAhead.h"
 #include "DkSaveDialog.h"
+#include "DkScheduler.h"
+#include "DkScratch.h"
 #include "DkSettings.h"
+#include "DkSharedImages.h"
 #include "DkStatusBar.h"
+#include "DkTelemetry.h"
 #include "DkThumbs.h"
 #include "DkTimer.h"
 #include "DkUtils.h"
@@ -63,9 +69,11 @@
 #include <QPainter>
 #include <QPluginLoader>
 #include <QProgressDialog>
+#include <QRandomGenerator>
 #include <QReadLocker>
 #include <QReadWriteLock>
 #include <QRegularExpression>
+#include <QScreen>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QStringBuilder>
@@ -74,9 +82,12 @@
 #include <QTimer>
 #include <QWidget>
 #include <QWriteLocker>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 #include <qmath.h>
 
+#include <algorithm>
+
 // quazip
 #ifdef WITH_QUAZIP
 #ifdef WITH_QUAZIP1
@@ -105,6 +116,765 @@
 namespace nmc
 {
 
+// DkFileFilter --------------------------------------------------------------------
+DkFileFilter::DkFileFilter(const QStringList &ignoreKeywords, const QStringList &keywords)
+{
+    // simple filters (*.jpg) are looked up in a hash - all others are matched as wildcards
+    // both ignore the case - as QDir's name filters (without QDir::CaseSensitive) & the WinAPI indexing did before
+    for (const QString &f : DkSettingsManager::param().app().browseFilters) {
+        QString suffix = f;
+        suffix.remove(0, suffix.startsWith("*.") ? 2 : 0);
+
+        if (!suffix.contains(QRegularExpression("[\\*\\?\\[\\.]")) && f.startsWith("*."))
+            mSuffixes.insert(suffix.toLower());
+        else
+            mWildcards << QRegularExpression(QRegularExpression::wildcardToRegularExpression(f), QRegularExpression::CaseInsensitiveOption);
+    }
+
+    for (const QString &kw : ignoreKeywords)
+        mIgnoreExps << QRegularExpression(kw, QRegularExpression::CaseInsensitiveOption);
+
+    mKeywords = keywords;
+
+    mFilterDuplicates = DkSettingsManager::param().resources().filterDuplicats;
+    mPreferredExtension = DkSettingsManager::param().resources().preferredExtension;
+    mPreferredExtension = mPreferredExtension.replace("*.", "");
+}
+
+/**
+ * Returns true if a file should be indexed.
+ * Files without suffix are checked by content.
+ * @param dirPath the file's directory.
+ * @param fileName the file name.
+ * @return bool true if the file is accepted.
+ **/
+bool DkFileFilter::accept(const QString &dirPath, const QString &fileName) const
+{
+    int dotIdx = fileName.lastIndexOf('.');
+    bool valid = false;
+
+    if (dotIdx == -1) {
+        valid = DkUtils::isValid(QFileInfo(dirPath, fileName));
+    } else {
+        valid = mSuffixes.contains(fileName.mid(dotIdx + 1).toLower());
+
+        for (int idx = 0; !valid && idx < mWildcards.size(); idx++)
+            valid = mWildcards[idx].match(fileName).hasMatch();
+    }
+
+    if (!valid)
+        return false;
+
+    // remove files that contain ignore keywords
+    for (const QRegularExpression &re : mIgnoreExps) {
+        if (re.match(fileName).hasMatch())
+            return false;
+    }
+
+    for (const QString &kw : mKeywords) {
+        if (!fileName.contains(kw, Qt::CaseInsensitive))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Removes files that have a twin with the preferred extension.
+ * e.g. img.nef is removed if img.jpg exists and jpg is preferred.
+ * @param fileNames all file names
+ * @return QStringList the files without duplicates
+ **/
+QStringList DkFileFilter::removeDuplicates(const QStringList &fileNames) const
+{
+    if (!mFilterDuplicates)
+        return fileNames;
+
+    auto baseName = [](const QString &fileName) {
+        int dotIdx = fileName.indexOf('.');
+        return (dotIdx == -1) ? fileName : fileName.left(dotIdx);
+    };
+
+    // number of preferred files per base name
+    QHash<QString, int> preferred;
+    for (const QString &fn : fileNames) {
+        if (fn.contains(mPreferredExtension, Qt::CaseInsensitive))
+            preferred[baseName(fn)]++;
+    }
+
+    QStringList files;
+    files.reserve(fileNames.size());
+
+    for (const QString &fn : fileNames) {
+        int dotIdx = fn.lastIndexOf('.');
+        QString suffix = (dotIdx == -1) ? QString() : fn.mid(dotIdx + 1);
+
+        if (mPreferredExtension.compare(suffix, Qt::CaseInsensitive) == 0) {
+            files << fn;
+            continue;
+        }
+
+        // do not count ourselves
+        int numPreferred = preferred.value(baseName(fn), 0);
+        if (fn.contains(mPreferredExtension, Qt::CaseInsensitive))
+            numPreferred--;
+
+        if (numPreferred <= 0)
+            files << fn;
+    }
+
+    return files;
+}
+
+// DkImageCacher --------------------------------------------------------------------
+DkImageCacher::DkImageCacher()
+{
+    cachers() << this;
+}
+
+DkImageCacher::~DkImageCacher()
+{
+    cachers().removeAll(this);
+}
+
+/**
+ * Updates the cache window around the current image.
+ * Images within the window are (pre)fetched in browsing direction,
+ * all other images that were cached before are released.
+ * @param images the images of the current folder.
+ * @param cIdx the index of the current image.
+ **/
+void DkImageCacher::update(const QVector<QSharedPointer<DkImageContainerT>> &images, int cIdx)
+{
+    if (cIdx < 0 || cIdx >= images.size())
+        return;
+
+    DkTraceSpan dt("cacher", "DkImageCacher::update", images[cIdx]->filePath());
+
+    // read once - distance() & wrapIdx() are called for every entry
+    mLoop = DkSettingsManager::snapshot()->global().loop;
+
+    // images that are cached by other tabs count, too
+    DkMemoryGovernor::Pressure pressure = DkMemoryGovernor::instance().pressure();
+    const double budget = qMax(DkMemoryGovernor::instance().cacheMemory() - othersMemoryUsage(), 0.0);
+    const int maxCached = DkMemoryGovernor::instance().maxImagesCached();
+    const int numImages = images.size();
+
+    // shed the cold tiers first
+    if (pressure > mPressure) {
+        if (pressure >= DkMemoryGovernor::pressure_moderate)
+            DkColdImageCache::instance().clear();
+
+        // thumbnails are reloaded from the thumbnail cache if they are needed again
+        if (pressure >= DkMemoryGovernor::pressure_critical) {
+            for (int idx = 0; idx < numImages; idx++) {
+                if (qAbs(idx - cIdx) > maxCached)
+                    images[idx]->getThumb()->release();
+            }
+        }
+
+        qCInfo(lcCacher) << "[Cacher] shedding cold tiers - memory pressure:" << pressure;
+    }
+    mPressure = pressure;
+
+    updateDirection(cIdx, numImages);
+    touch(images[cIdx], cIdx);
+
+    // images the user passes while one image is decoded (velocity [images/s] * decode time [s])
+    const double decodeSec = qMax(DkImageContainer::decodeTime(), 1) / 1000.0;
+    const double passed = mVelocity * decodeSec;
+
+    // look ahead as far as the user gets while decoding - but not beyond what fits into the budget
+    const double imgMem = qMax((double)images[cIdx]->getMemoryUsage(), 1.0);
+    const int fits = qMax((int)(budget / imgMem), 1);
+    const int ahead = qBound(1, qMax(maxCached, qCeil(passed) + 1), fits);
+
+    // fast browsing in one direction: nothing behind is needed
+    // slow browsing or turning around: keep what was prefetched in the other direction
+    int behind = (passed >= 1.0) ? 1 : qMax(maxCached / 2, 1);
+    if (mTurned)
+        behind = qMax(behind, mLastAhead);
+    mLastAhead = ahead;
+
+    // release everything that left the window
+    QVector<Entry> entries;
+    double mem = 0;
+
+    for (Entry e : mEntries) {
+        QSharedPointer<DkImageContainerT> cImg = e.image.toStrongRef();
+
+        if (!cImg)
+            continue;
+
+        // the folder was sorted or changed - find the image again
+        if (e.idx < 0 || e.idx >= numImages || images[e.idx] != cImg)
+            e.idx = images.indexOf(cImg);
+
+        // never release the image that is shown (it might be edited)
+        if (cImg == images[cIdx]) {
+            mem += cImg->getMemoryUsage();
+            entries << e;
+            continue;
+        }
+
+        // the image is not in the folder anymore
+        bool stale = e.idx == -1;
+        int d = stale ? 0 : distance(e.idx, cIdx, numImages);
+
+        // clear images if they are edited
+        if (stale || cImg->isEdited() || d < -behind || d > ahead) {
+            if (e.prefetched)
+                DkTelemetry::instance().count(DkTelemetry::prefetch_wasted);
+
+            // stepping back shows the screen resolution version right away
+            DkColdImageCache::instance().insert(cImg);
+            cImg->clear();
+            qCDebug(lcCacher) << "[Cacher]" << cImg->filePath() << "freed";
+            continue;
+        }
+
+        mem += cImg->getMemoryUsage();
+        entries << e;
+    }
+
+    // prefetch in browsing direction
+    for (int k = 1; k <= ahead && mem < budget; k++) {
+        int idx = wrapIdx(cIdx + k * mDirection, numImages);
+
+        if (idx == -1 || idx == cIdx)
+            break;
+
+        QSharedPointer<DkImageContainerT> cImg = images[idx];
+
+        Entry e;
+        e.image = cImg;
+        e.idx = idx;
+
+        for (int i = 0; i < entries.size(); i++) {
+            if (entries[i].image == cImg) {
+                e.prefetched = entries[i].prefetched;
+                entries.remove(i);
+                break;
+            }
+        }
+
+        if (cImg->getLoadState() == DkImageContainerT::not_loaded) {
+            if (!e.prefetched)
+                DkTelemetry::instance().count(DkTelemetry::prefetch_issued);
+            e.prefetched = true;
+
+            // fully load the next image if it is decoded before the user gets there
+            if (k == 1 && passed < 1.0) {
+                cImg->loadImageThreaded();
+                qCDebug(lcCacher) << "[Cacher]" << cImg->filePath() << "fully cached...";
+            } else {
+                cImg->fetchFile();
+                qCDebug(lcCacher) << "[Cacher]" << cImg->filePath() << "file fetched...";
+            }
+        }
+
+        mem += cImg->getMemoryUsage();
+        entries << e;
+    }
+
+    // network shares: read the files beyond the window in browsing direction
+    QStringList readAhead;
+    for (int k = 1; k <= ahead + DkReadAhead::num_files && readAhead.size() < DkReadAhead::num_files; k++) {
+        int idx = wrapIdx(cIdx + k * mDirection, numImages);
+
+        if (idx == -1 || idx == cIdx)
+            break;
+
+        if (images[idx]->getLoadState() == DkImageContainerT::not_loaded)
+            readAhead << images[idx]->filePath();
+    }
+    DkReadAhead::instance().prefetch(readAhead);
+
+    // evict the farthest (and then the least recently used) images if we exceed the budget
+    while (mem > budget && entries.size() > 2) {
+        int rIdx = -1;
+        int rDist = -1;
+
+        for (int i = 0; i < entries.size(); i++) {
+            int d = qAbs(distance(entries[i].idx, cIdx, numImages));
+
+            // keep the current & its neighbors
+            if (d <= 1)
+                continue;
+
+            // entries are in LRU order: > prefers older entries for equal distances
+            if (d > rDist) {
+                rDist = d;
+                rIdx = i;
+            }
+        }
+
+        if (rIdx == -1)
+            break;
+
+        QSharedPointer<DkImageContainerT> cImg = entries[rIdx].image.toStrongRef();
+        if (cImg) {
+            if (entries[rIdx].prefetched)
+                DkTelemetry::instance().count(DkTelemetry::prefetch_wasted);
+
+            mem -= cImg->getMemoryUsage();
+            DkColdImageCache::instance().insert(cImg);
+            cImg->clear();
+            qCDebug(lcCacher) << "[Cacher]" << cImg->filePath() << "evicted";
+        }
+        entries.remove(rIdx);
+    }
+
+    mEntries = entries;
+
+    // drop the pixels of released images that are not shown in another tab
+    DkImageRegistry::instance().prune();
+
+    qCDebug(lcCacher) << "[Cacher] updated in" << dt << "(" << mem << "MB," << mEntries.size() << "images, direction:" << mDirection << ")";
+}
+
+/**
+ * Forgets all cached images.
+ * The images themselves are not released since
+ * they are owned by the loader.
+ **/
+void DkImageCacher::clear()
+{
+    mEntries.clear();
+    mLastIdx = -1;
+    mDirection = 1;
+    mVelocity = 0.0;
+    mTurned = false;
+    mLastAhead = 0;
+    mLastUpdate.invalidate();
+}
+
+int DkImageCacher::direction() const
+{
+    return mDirection;
+}
+
+double DkImageCacher::velocity() const
+{
+    return mVelocity;
+}
+
+/**
+ * Memory of the images cached by all other cachers (tabs).
+ * Pixels shared between tabs are counted per tab, so the estimate errs on the safe side.
+ * @return double the memory in MB
+ **/
+double DkImageCacher::othersMemoryUsage() const
+{
+    double mem = 0;
+
+    for (const DkImageCacher *c : cachers()) {
+        if (c != this)
+            mem += c->memoryUsage();
+    }
+
+    return mem;
+}
+
+/**
+ * All cachers of this process - they are created & used in the GUI thread only.
+ **/
+QVector<DkImageCacher *> &DkImageCacher::cachers()
+{
+    static QVector<DkImageCacher *> c;
+    return c;
+}
+
+double DkImageCacher::memoryUsage() const
+{
+    double mem = 0;
+
+    for (const Entry &e : mEntries) {
+        QSharedPointer<DkImageContainerT> cImg = e.image.toStrongRef();
+
+        if (cImg)
+            mem += cImg->getMemoryUsage();
+    }
+
+    return mem;
+}
+
+void DkImageCacher::updateDirection(int cIdx, int numImages)
+{
+    if (mLastIdx != -1 && cIdx != mLastIdx) {
+        int step = cIdx - mLastIdx;
+
+        // wrapping around the folder is a small step if we loop
+        if (mLoop && qAbs(step) > numImages / 2)
+            step += (step > 0) ? -numImages : numImages;
+
+        int direction = (step > 0) ? 1 : -1;
+        mTurned = direction != mDirection;
+        mDirection = direction;
+
+        if (mLastUpdate.isValid()) {
+            double sec = qMax(mLastUpdate.elapsed(), qint64(1)) / 1000.0;
+            double v = qAbs(step) / sec;
+
+            // browsing pauses should not count as slow browsing
+            mVelocity = (sec > 2.0) ? 0.0 : 0.5 * mVelocity + 0.5 * v;
+        }
+    }
+
+    mLastIdx = cIdx;
+    mLastUpdate.restart();
+}
+
+void DkImageCacher::touch(QSharedPointer<DkImageContainerT> imgC, int idx)
+{
+    for (int i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].image == imgC) {
+            if (mEntries[i].prefetched)
+                DkTelemetry::instance().count(DkTelemetry::prefetch_used);
+
+            mEntries.remove(i);
+            break;
+        }
+    }
+
+    Entry e;
+    e.image = imgC;
+    e.idx = idx;
+    mEntries << e;
+}
+
+/**
+ * Returns the signed distance of idx to the current image.
+ * Positive values are in browsing direction.
+ **/
+int DkImageCacher::distance(int idx, int cIdx, int numImages) const
+{
+    int d = idx - cIdx;
+
+    if (mLoop && numImages > 0) {
+        if (d > numImages / 2)
+            d -= numImages;
+        else if (d < -numImages / 2)
+            d += numImages;
+    }
+
+    return d * mDirection;
+}
+
+int DkImageCacher::wrapIdx(int idx, int numImages) const
+{
+    if (idx >= 0 && idx < numImages)
+        return idx;
+
+    if (!mLoop || numImages <= 0)
+        return -1;
+
+    idx %= numImages;
+    return (idx < 0) ? idx + numImages : idx;
+}
+
+// DkColdImageCache --------------------------------------------------------------------
+DkColdImageCache::DkColdImageCache()
+{
+}
+
+DkColdImageCache &DkColdImageCache::instance()
+{
+    static DkColdImageCache inst;
+    return inst;
+}
+
+/**
+ * Keeps a screen resolution version of imgC.
+ * The image is downscaled in the background - call this before the image is released.
+ * Images that wait to be downscaled count against the budget - if too many are queued, imgC is not cached.
+ * Edited images are not cached since their file would not match.
+ * @param imgC a loaded image.
+ **/
+void DkColdImageCache::insert(QSharedPointer<DkImageContainerT> imgC)
+{
+    if (!imgC || imgC->getLoadState() != DkImageContainerT::loaded || imgC->isEdited())
+        return;
+
+    // the cold tier is shed first under memory pressure
+    if (DkMemoryGovernor::instance().pressure() != DkMemoryGovernor::pressure_none)
+        return;
+
+    Entry e;
+    e.filePath = imgC->filePath();
+    e.modified = imgC->fileInfo().lastModified();
+    e.img = imgC->image(); // shallow copy - keeps the pixels alive until they are downscaled
+
+    if (e.img.isNull())
+        return;
+
+    // the queued images are kept alive in full resolution until they are downscaled
+    // cached images are evicted by add() - so only the queue is throttled here
+    double mem = DkImage::getBufferSizeFloat(e.img.size(), e.img.depth());
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (mPendingMemory + mem > DkMemoryGovernor::instance().cacheMemory() * 0.25)
+            return;
+
+        mPendingMemory += mem;
+    }
+
+    // screens are queried in the GUI thread
+    QSize ss;
+    for (const QScreen *s : QGuiApplication::screens())
+        ss = ss.expandedTo(s->size() * s->devicePixelRatio());
+
+    DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_batch, [this, e, ss, mem]() {
+        Entry ce = e;
+        ce.img = downscale(e.img, ss);
+
+        {
+            QMutexLocker locker(&mMutex);
+            mPendingMemory -= mem;
+        }
+
+        add(ce);
+        return true;
+    });
+}
+
+/**
+ * Returns the cached (screen resolution) image.
+ * @param filePath the image's file path.
+ * @param modified the modification date of the file - outdated entries are dropped.
+ * @return QImage the cached image or a null image.
+ **/
+QImage DkColdImageCache::image(const QString &filePath, const QDateTime &modified)
+{
+    QMutexLocker locker(&mMutex);
+
+    int idx = find(filePath);
+    if (idx == -1)
+        return QImage();
+
+    Entry e = mEntries[idx];
+    mEntries.remove(idx);
+
+    if (e.modified != modified) {
+        mMemory -= DkImage::getBufferSizeFloat(e.img.size(), e.img.depth());
+        return QImage();
+    }
+
+    mEntries << e;
+
+    return e.img;
+}
+
+void DkColdImageCache::remove(const QString &filePath)
+{
+    QMutexLocker locker(&mMutex);
+
+    int idx = find(filePath);
+    if (idx != -1) {
+        mMemory -= DkImage::getBufferSizeFloat(mEntries[idx].img.size(), mEntries[idx].img.depth());
+        mEntries.remove(idx);
+    }
+}
+
+void DkColdImageCache::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.clear();
+    mMemory = 0.0;
+}
+
+/**
+ * Memory of the cold tier (including the images that wait to be downscaled).
+ * @return double the memory in MB
+ **/
+double DkColdImageCache::memoryUsage() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMemory + mPendingMemory;
+}
+
+void DkColdImageCache::add(const Entry &e)
+{
+    const double budget = DkMemoryGovernor::instance().cacheMemory() * 0.25;
+    double mem = DkImage::getBufferSizeFloat(e.img.size(), e.img.depth());
+
+    if (e.img.isNull() || mem > budget)
+        return;
+
+    QMutexLocker locker(&mMutex);
+
+    int idx = find(e.filePath);
+    if (idx != -1) {
+        mMemory -= DkImage::getBufferSizeFloat(mEntries[idx].img.size(), mEntries[idx].img.depth());
+        mEntries.remove(idx);
+    }
+
+    mEntries << e;
+    mMemory += mem;
+
+    // evict the least recently used images
+    while (mMemory > budget && !mEntries.isEmpty()) {
+        mMemory -= DkImage::getBufferSizeFloat(mEntries.first().img.size(), mEntries.first().img.depth());
+        mEntries.removeFirst();
+    }
+
+    qCDebug(lcCacher) << "[Cacher]" << e.filePath << "moved to the cold tier (" << mMemory << "MB," << mEntries.size() << "images)";
+}
+
+int DkColdImageCache::find(const QString &filePath) const
+{
+    for (int idx = 0; idx < mEntries.size(); idx++) {
+        if (mEntries[idx].filePath == filePath)
+            return idx;
+    }
+
+    return -1;
+}
+
+/**
+ * Downscales img to fit the screen size ss.
+ **/
+QImage DkColdImageCache::downscale(const QImage &img, const QSize &ss)
+{
+    if (ss.isEmpty() || (img.width() <= ss.width() && img.height() <= ss.height()))
+        return img;
+
+    return img.scaled(ss, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+// DkFolderIndex --------------------------------------------------------------------
+DkFolderIndex::DkFolderIndex()
+{
+}
+
+DkFolderIndex &DkFolderIndex::instance()
+{
+    static DkFolderIndex inst;
+    return inst;
+}
+
+/**
+ * Returns the folders of a tree.
+ * The tree is walked level by level - the folders of a level are listed in parallel
+ * in the I/O lane. This blocks until the whole tree is walked (see DkImageLoader::updateSubFolders).
+ * @param rootDirPath the root folder
+ * @return QStringList the root and its sub folders (sorted)
+ **/
+QStringList DkFolderIndex::folders(const QString &rootDirPath)
+{
+    DkTimer dt;
+
+    QStringList folders;
+    QStringList level;
+    level << rootDirPath;
+
+    while (!level.empty()) {
+        QVector<QFuture<Entry>> futures;
+
+        // the user waits for it
+        for (const QString &dirPath : level) {
+            futures << DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_interactive, [this, dirPath]() {
+                return entry(dirPath);
+            });
+        }
+
+        folders << level;
+        level.clear();
+
+        for (QFuture<Entry> &f : futures) {
+            f.waitForFinished();
+
+            if (f.resultCount() > 0)
+                level << f.result().subFolders;
+        }
+    }
+
+    std::sort(folders.begin(), folders.end(), DkUtils::compLogicQString);
+
+    qInfo() << "[DkFolderIndex]" << folders.size() << "folders of" << rootDirPath << "indexed in" << dt;
+
+    return folders;
+}
+
+/**
+ * Returns the number of images of a folder.
+ * The folder is only listed if it changed since it was indexed.
+ * Keywords are not applied (see DkImageLoader::hasImages).
+ * @param dirPath the folder
+ * @return int the number of files that pass the browse filters
+ **/
+int DkFolderIndex::numImages(const QString &dirPath)
+{
+    return entry(dirPath).numImages;
+}
+
+/**
+ * Returns the number of images of a folder without accessing the disk.
+ * @param dirPath the folder
+ * @return int the number of images when the folder was indexed or -1 if it was not indexed yet
+ **/
+int DkFolderIndex::cachedNumImages(const QString &dirPath) const
+{
+    QMutexLocker locker(&mMutex);
+    auto it = mEntries.constFind(dirPath);
+
+    return it != mEntries.constEnd() ? it->numImages : -1;
+}
+
+void DkFolderIndex::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.clear();
+}
+
+DkFolderIndex::Entry DkFolderIndex::entry(const QString &dirPath)
+{
+    // adding, removing or renaming files changes the folder's modification date
+    qint64 modified = QFileInfo(dirPath).lastModified().toMSecsSinceEpoch();
+
+    {
+        QMutexLocker locker(&mMutex);
+        auto it = mEntries.constFind(dirPath);
+
+        if (it != mEntries.constEnd() && it->modified == modified)
+            return it.value();
+    }
+
+    Entry e = list(dirPath, modified);
+
+    QMutexLocker locker(&mMutex);
+    mEntries.insert(dirPath, e);
+
+    return e;
+}
+
+/**
+ * Lists a folder once for its sub folders and images.
+ * Linked folders are not followed (they might create loops).
+ **/
+DkFolderIndex::Entry DkFolderIndex::list(const QString &dirPath, qint64 modified)
+{
+    Entry e;
+    e.modified = modified;
+
+    DkFileFilter filter;
+    QDirIterator it(dirPath, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo fi = it.fileInfo();
+
+        if (fi.isDir()) {
+            if (!fi.isSymLink())
+                e.subFolders << it.filePath();
+        } else if (filter.accept(dirPath, it.fileName()))
+            e.numImages++;
+    }
+
+    return e;
+}
+
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
  * Default constructor.
@@ -114,6 +884,7 @@ namespace nmc
 DkImageLoader::DkImageLoader(const QString &filePath)
 {
     qRegisterMetaType<QFileInfo>("QFileInfo");
+    qRegisterMetaType<QFileInfoList>("QFileInfoList");
 
     mDirWatcher = new QFileSystemWatcher(this);
     connect(mDirWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
@@ -122,6 +893,9 @@ DkImageLoader::DkImageLoader(const QString &filePath)
     mSortingImages = false;
 
     connect(&mCreateImageWatcher, SIGNAL(finished()), this, SLOT(imagesSorted()));
+    connect(&mIndexWatcher, SIGNAL(finished()), this, SLOT(dirIndexed()));
+    connect(&mSubFolderWatcher, SIGNAL(finished()), this, SLOT(subFoldersIndexed()));
+    connect(this, SIGNAL(filesIndexedSignal(const QFileInfoList &, int)), this, SLOT(filesIndexed(const QFileInfoList &, int)), Qt::QueuedConnection);
 
     mDelayedUpdateTimer.setSingleShot(true);
     connect(&mDelayedUpdateTimer, SIGNAL(timeout()), this, SLOT(directoryChanged()));
@@ -134,6 +908,19 @@ DkImageLoader::DkImageLoader(const QString &filePath)
 
     // saveDir = DkSettingsManager::param().global().lastSaveDir;	// loading save dir is obsolete ?!
 
+    DkTelemetry::instance().addProvider(this, [this](DkTelemetry::Stats &stats) {
+        for (const QSharedPointer<DkImageContainerT> &imgC : mImages) {
+            // the loader is written by the loading thread
+            if (imgC->getLoadState() == DkImageContainerT::loading)
+                stats.queues[DkTelemetry::queue_image_loads]++;
+            else
+                imgC->memoryUsage(stats);
+        }
+
+        if (mCurrentImage && !mImages.contains(mCurrentImage) && mCurrentImage->getLoadState() != DkImageContainerT::loading)
+            mCurrentImage->memoryUsage(stats);
+    });
+
     QFileInfo fInfo(filePath);
 
     if (fInfo.exists())
@@ -147,8 +934,22 @@ DkImageLoader::DkImageLoader(const QString &filePath)
  **/
 DkImageLoader::~DkImageLoader()
 {
+    DkTelemetry::instance().removeProvider(this);
+
     if (mCreateImageWatcher.isRunning())
         mCreateImageWatcher.blockSignals(true);
+
+    // the walk does not access the loader
+    mSubFolderWatcher.blockSignals(true);
+
+    if (mIndexWatcher.isRunning()) {
+        cancelIndexing();
+        mIndexWatcher.blockSignals(true);
+        mIndexWatcher.waitForFinished();
+    }
+
+    // e.g. entries of thumbnails that were computed after sorting
+    DkMetaDataIndex::instance().save();
 }
 
 /**
@@ -164,6 +965,8 @@ void DkImageLoader::clearPath()
         mCurrentImage->receiveUpdates(this, false);
         mLastImageLoaded = mCurrentImage;
         mImages.clear();
+        mImageIndex.clear();
+        mCacher.clear();
 
         // only clear the current image if it exists
         mCurrentImage.clear();
@@ -231,6 +1034,14 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
 
     DkTimer dt;
 
+    // the folder is indexed in the background - work with what we have so far
+    if (isIndexing()) {
+        if (newDirPath == mIndexingDir)
+            return true;
+
+        cancelIndexing();
+    }
+
     // folder changed signal was emitted
     if (mFolderUpdated && newDirPath == mCurrentDir) {
         mFolderUpdated = false;
@@ -243,19 +1054,16 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
         if (files.empty()) {
             emit showInfoSignal(tr("%1 \n does not contain any image").arg(newDirPath), 4000); // stop showing
             mImages.clear();
+            mImageIndex.clear();
             emit updateDirSignal(mImages);
             return false;
         }
 
-        // disabled threaded sorting - people didn't like it (#484 and #460)
-        // if (files.size() > 2000) {
-        //	createImages(files, false);
-        //	sortImagesThreaded(images);
-        //}
-        // else
-        createImages(files, true);
+        // just apply the changes - existing containers keep their caches & thumbnails
+        if (updateImages(files))
+            emit updateDirSignal(mImages);
 
-        qDebug() << "getting file list.....";
+        qInfoClean() << newDirPath << " [" << mImages.size() << "] updated in " << dt;
     }
     // new folder is loaded
     else if ((newDirPath != mCurrentDir || mImages.empty()) && !newDirPath.isEmpty() && QDir(newDirPath).exists()) {
@@ -271,12 +1079,20 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
         mFolderFilterString.clear(); // delete key words -> otherwise user may be confused
 
         if (scanRecursive && DkSettingsManager::param().global().scanSubFolders)
-            files = updateSubFolders(mCurrentDir);
-        else
-            files = getFilteredFileInfoList(mCurrentDir,
-                                            mIgnoreKeywords,
-                                            mKeywords,
-                                            mFolderFilterString); // this line takes seconds if you have lots of files and slow loading (e.g. network)
+            updateSubFolders(mCurrentDir);
+
+        files = getFilteredFileInfoList(mCurrentDir,
+                                        mIgnoreKeywords,
+                                        mKeywords,
+                                        mFolderFilterString); // this line takes seconds if you have lots of files and slow loading (e.g. network)
+
+        // the first sub folder with images is loaded once the sub folders are indexed
+        if (files.empty() && mSubFolderWatcher.isRunning()) {
+            mImages.clear();
+            mImageIndex.clear();
+            emit updateDirSignal(mImages);
+            return true;
+        }
 
         if (files.empty()) {
             emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000); // stop showing
@@ -306,6 +1122,138 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
     return true;
 }
 
+/**
+ * Indexes a new directory in the background.
+ * The images are created in batches while the directory is
+ * indexed. Hence, the current image can be displayed before
+ * large (or network) folders are fully indexed.
+ * Refreshing the current folder and recursive scans fall back to loadDir.
+ * @param newDirPath the directory to be loaded.
+ * @return bool false if the directory does not exist.
+ **/
+bool DkImageLoader::loadDirThreaded(const QString &newDirPath)
+{
+    if (isIndexing() && newDirPath == mIndexingDir)
+        return true;
+
+    bool newFolder = (newDirPath != mCurrentDir || mImages.empty()) && !newDirPath.isEmpty();
+
+    if (!newFolder || DkSettingsManager::param().global().scanSubFolders || !QDir(newDirPath).exists())
+        return loadDir(newDirPath);
+
+    cancelIndexing();
+
+    mCurrentDir = newDirPath;
+    mFolderUpdated = false;
+    mFolderFilterString.clear(); // delete key words -> otherwise user may be confused
+
+    mImages.clear();
+    mImageIndex.clear();
+    mCacher.clear();
+    mIndexedImages.clear();
+
+    mIndexingDir = newDirPath;
+    mIndexTimer.start();
+
+    int generation = mIndexGeneration.loadAcquire();
+    DkFileFilter filter(mIgnoreKeywords, mKeywords);
+
+    mIndexWatcher.setFuture(QtConcurrent::run([this, newDirPath, filter, generation]() {
+        return indexDir(newDirPath, filter, QString(), [this, generation](const QFileInfoList &files) {
+            // the indexing was canceled
+            if (mIndexGeneration.loadAcquire() != generation)
+                return false;
+
+            emit filesIndexedSignal(files, generation);
+            return true;
+        });
+    }));
+
+    return true;
+}
+
+bool DkImageLoader::isIndexing() const
+{
+    return mIndexWatcher.isRunning();
+}
+
+void DkImageLoader::cancelIndexing()
+{
+    // running indexers stop with their next batch & their results are ignored
+    mIndexGeneration.fetchAndAddOrdered(1);
+    mIndexingDir.clear();
+    mIndexedImages.clear();
+}
+
+/**
+ * Adds a batch of new files while the folder is indexed.
+ * Batches are collected until they double the images that are already sorted,
+ * then they are merged - so merging & updating the views costs O(N) for the whole folder.
+ * @param files the files that were indexed since the last batch.
+ * @param generation the indexer's generation - outdated batches are ignored.
+ **/
+void DkImageLoader::filesIndexed(const QFileInfoList &files, int generation)
+{
+    if (generation != mIndexGeneration.loadAcquire() || files.empty())
+        return;
+
+    mIndexedImages.reserve(mIndexedImages.size() + files.size());
+
+    for (const QFileInfo &f : files) {
+        const QString &fp = f.absoluteFilePath();
+
+        if (findFileIdx(fp, mImages, mImageIndex) != -1)
+            continue;
+        else if (mCurrentImage && mCurrentImage->filePath() == fp)
+            mIndexedImages << mCurrentImage; // the current image was loaded before its folder was indexed
+        else
+            mIndexedImages << QSharedPointer<DkImageContainerT>(new DkImageContainerT(fp));
+    }
+
+    if (mIndexedImages.size() < mImages.size())
+        return;
+
+    mImages = mergeImages(mImages, mIndexedImages);
+    mIndexedImages.clear();
+    updateImageIndex();
+
+    emit updateDirSignal(mImages);
+    qDebug() << "[DkImageLoader]" << mImages.size() << "images indexed so far...";
+}
+
+void DkImageLoader::dirIndexed()
+{
+    // a new folder was requested in the meantime
+    if (mIndexingDir.isEmpty())
+        return;
+
+    QString dirPath = mIndexingDir;
+    mIndexingDir.clear();
+    mIndexedImages.clear();
+
+    QFileInfoList files = mIndexWatcher.result();
+
+    if (files.empty()) {
+        emit showInfoSignal(tr("%1 \n does not contain any image").arg(dirPath), 4000); // stop showing
+        mImages.clear();
+        mImageIndex.clear();
+        emit updateDirSignal(mImages);
+        return;
+    }
+
+    createImages(files, true);
+
+    qInfoClean() << dirPath << " [" << mImages.size() << "] indexed in " << mIndexTimer;
+
+    if (mCurrentImage) {
+        // this signal is needed by the folder scrollbar
+        emit imageUpdatedSignal(findFileIdx(mCurrentImage->filePath(), mImages));
+
+        if (mCurrentImage->hasImage())
+            updateCacher(mCurrentImage);
+    }
+}
+
 void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>> images)
 {
     if (mSortingImages) {
@@ -315,7 +1263,13 @@ void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>
 
     mSortingIsDirty = false;
     mSortingImages = true;
-    mCreateImageWatcher.setFuture(QtConcurrent::run(this, &nmc::DkImageLoader::sortImages, images));
+
+    // the sort mode might change while we are sorting
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
+
+    mCreateImageWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [this, images, settings]() {
+        return sortImages(images, settings);
+    }));
 
     qDebug() << "sorting images threaded...";
 }
@@ -323,62 +1277,233 @@ void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>
 void DkImageLoader::imagesSorted()
 {
     mSortingImages = false;
-    mImages = mCreateImageWatcher.result();
+    QVector<QSharedPointer<DkImageContainerT>> sorted = mCreateImageWatcher.result();
+
+    // the images changed while they were sorted (e.g. the folder was updated)
+    bool changed = sorted.size() != mImages.size();
 
-    if (mSortingIsDirty) {
+    for (int idx = 0; idx < sorted.size() && !changed; idx++) {
+        int cIdx = findFileIdx(sorted[idx]->filePath(), mImages, mImageIndex);
+        changed = cIdx == -1 || mImages[cIdx] != sorted[idx];
+    }
+
+    if (mSortingIsDirty || changed) {
         qDebug() << "re-sorting because it's dirty...";
-        sortImagesThreaded(mImages);
+
+        if (!mImages.empty())
+            sortImagesThreaded(mImages);
         return;
     }
 
-    emit updateDirSignal(mImages);
+    mImages = sorted;
+    updateImageIndex();
+
+    emit updateDirSignal(mImages);
+
+    if (mCurrentImage) {
+        // the folder scrollbar & the cacher need the new index
+        emit imageUpdatedSignal(findFileIdx(mCurrentImage->filePath(), mImages));
+
+        if (mCurrentImage->hasImage())
+            updateCacher(mCurrentImage);
+    }
+
+    if (mDirWatcher) {
+        if (!mDirWatcher->directories().isEmpty())
+            mDirWatcher->removePaths(mDirWatcher->directories());
+        mDirWatcher->addPath(mCurrentDir);
+    }
+
+    qDebug() << "images sorted...";
+}
+
+void DkImageLoader::createImages(const QFileInfoList &files, bool sort)
+{
+    // TODO: change files to QStringList
+    DkTimer dt;
+    QVector<QSharedPointer<DkImageContainerT>> oldImages = mImages;
+    QHash<QString, int> oldIndex = mImageIndex;
+    mImages.clear();
+    mImages.reserve(files.size());
+
+    for (const QFileInfo &f : files) {
+        const QString &fp = f.absoluteFilePath();
+        int oIdx = findFileIdx(fp, oldImages, oldIndex);
+
+        // NOTE: we had this here: oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == f.lastModified())
+        // however, that did not detect file changes & slowed down the process - so I removed it...
+        if (oIdx != -1)
+            mImages << oldImages.at(oIdx);
+        else if (mCurrentImage && mCurrentImage->filePath() == fp)
+            mImages << mCurrentImage; // the current image was loaded before its folder was indexed
+        else
+            mImages << QSharedPointer<DkImageContainerT>(new DkImageContainerT(fp));
+    }
+    qInfo() << "[DkImageLoader]" << mImages.size() << "containers created in" << dt;
+
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
+
+    // the metadata is read in the background - the images are shown in their current order until then
+    if (sort && sortReadsMetaData(settings->global().sortMode)) {
+        sortImagesThreaded(mImages);
+    } else if (sort) {
+        mImages = sortImages(mImages, settings);
+        qInfo() << "[DkImageLoader] after sorting: " << dt;
+    }
+
+    updateImageIndex();
+
+    if (sort) {
+        emit updateDirSignal(mImages);
+
+        if (mDirWatcher) {
+            if (!mDirWatcher->directories().isEmpty())
+                mDirWatcher->removePaths(mDirWatcher->directories());
+            mDirWatcher->addPath(mCurrentDir);
+        }
+    }
+}
+
+/**
+ * Applies the changes of a folder update to the current images.
+ * Containers of files that still exist are kept, removed files are
+ * dropped and new files are merged at their sorted position. Hence,
+ * only new files are stat'ed and sorted (e.g. tethered shooting into
+ * large folders).
+ * @param files the (filtered) files of the current folder.
+ * @return bool true if files were added or removed.
+ **/
+bool DkImageLoader::updateImages(const QFileInfoList &files)
+{
+    DkTimer dt;
+
+    QVector<bool> kept(mImages.size(), false);
+    QVector<QSharedPointer<DkImageContainerT>> added;
+
+    for (const QFileInfo &f : files) {
+        const QString &fp = f.absoluteFilePath();
+        int idx = findFileIdx(fp, mImages, mImageIndex);
+
+        if (idx != -1)
+            kept[idx] = true;
+        else if (mCurrentImage && mCurrentImage->filePath() == fp)
+            added << mCurrentImage;
+        else
+            added << QSharedPointer<DkImageContainerT>(new DkImageContainerT(fp));
+    }
+
+    QVector<QSharedPointer<DkImageContainerT>> images;
+    images.reserve(files.size());
+
+    for (int idx = 0; idx < mImages.size(); idx++) {
+        if (kept[idx])
+            images << mImages[idx];
+    }
+
+    int numRemoved = mImages.size() - images.size();
+
+    if (added.empty() && numRemoved == 0)
+        return false;
+
+    mImages = mergeImages(images, added);
+    updateImageIndex();
+
+    qInfo() << "[DkImageLoader]" << added.size() << "images added and" << numRemoved << "removed in" << dt;
 
-    if (mDirWatcher) {
-        if (!mDirWatcher->directories().isEmpty())
-            mDirWatcher->removePaths(mDirWatcher->directories());
-        mDirWatcher->addPath(mCurrentDir);
+    return true;
+}
+
+/**
+ * Merges new images into sorted images.
+ * Only the new images are sorted - hence, adding a few images to a large folder is linear.
+ * New images are appended in a random order (random sort mode) or
+ * if they are sorted by metadata (they are moved once their metadata is read).
+ * @param images the sorted images.
+ * @param added the new images (not sorted).
+ * @return QVector<QSharedPointer<DkImageContainerT>> all images.
+ **/
+QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::mergeImages(QVector<QSharedPointer<DkImageContainerT>> images, QVector<QSharedPointer<DkImageContainerT>> added)
+{
+    if (added.empty())
+        return images;
+
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
+    const int sortMode = settings->global().sortMode;
+    const int sortDir = settings->global().sortDir;
+
+    // a random order cannot be merged
+    if (sortMode == DkSettings::sort_random) {
+        images += sortImages(added, settings);
+    } else if (sortReadsMetaData(sortMode)) {
+        // new files are moved to their position once their metadata is read
+        images += added;
+        sortImagesThreaded(images);
+    } else {
+        added = sortImages(added, settings);
+
+        QVector<QSharedPointer<DkImageContainerT>> merged(images.size() + added.size());
+        std::merge(images.begin(), images.end(), added.begin(), added.end(), merged.begin(), [sortMode, sortDir](const QSharedPointer<DkImageContainerT> &l, const QSharedPointer<DkImageContainerT> &r) {
+            return imageContainerLessThan(*l, *r, sortMode, sortDir);
+        });
+        images = merged;
     }
 
-    qDebug() << "images sorted...";
+    return images;
 }
 
-void DkImageLoader::createImages(const QFileInfoList &files, bool sort)
+/**
+ * Sorts the images according to the sort settings.
+ * One key is computed per image (the file name's natural sort key
+ * and cached file stats) and an index array is sorted by these keys.
+ * Hence, the settings are read once and the file system is not queried
+ * for every comparison.
+ * @param images the images to be sorted.
+ * @param settings the settings snapshot that was captured when sorting was requested.
+ * @return QVector<QSharedPointer<DkImageContainerT>> the sorted images.
+ **/
+QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT>> images, const DkSettingsSnapshot &settings) const
 {
-    // TODO: change files to QStringList
-    DkTimer dt;
-    QVector<QSharedPointer<DkImageContainerT>> oldImages = mImages;
-    mImages.clear();
 
-    QDate today = QDate::currentDate();
+    struct SortKey {
+        qint64 value;
+        QString name;
+        int idx;
+    };
 
-    for (const QFileInfo &f : files) {
-        const QString &fp = f.absoluteFilePath();
-        int oIdx = findFileIdx(fp, oldImages);
+    const int sortMode = settings->global().sortMode;
+    const bool ascending = settings->global().sortDir == DkSettings::sort_ascending;
 
-        // NOTE: we had this here: oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == f.lastModified())
-        // however, that did not detect file changes & slowed down the process - so I removed it...
-        mImages << ((oIdx != -1) ? oldImages.at(oIdx) : QSharedPointer<DkImageContainerT>(new DkImageContainerT(fp)));
+    // files that are not indexed yet need their metadata - read it in parallel
+    // this blocks until all files are read (see sortImagesThreaded())
+    if (sortReadsMetaData(sortMode)) {
+        QtConcurrent::blockingMap(images, [sortMode](const QSharedPointer<DkImageContainerT> &img) {
+            img->sortValue(sortMode);
+        });
+        DkMetaDataIndex::instance().save();
     }
-    qInfo() << "[DkImageLoader]" << mImages.size() << "containers created in" << dt;
-
-    if (sort) {
-        std::sort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
-        qInfo() << "[DkImageLoader] after sorting: " << dt;
 
-        emit updateDirSignal(mImages);
+    QVector<SortKey> keys;
+    keys.reserve(images.size());
 
-        if (mDirWatcher) {
-            if (!mDirWatcher->directories().isEmpty())
-                mDirWatcher->removePaths(mDirWatcher->directories());
-            mDirWatcher->addPath(mCurrentDir);
-        }
+    for (int idx = 0; idx < images.size(); idx++) {
+        SortKey k;
+        k.value = (sortMode == DkSettings::sort_random) ? (qint64)QRandomGenerator::global()->generate64() : images[idx]->sortValue(sortMode);
+        k.name = images[idx]->sortName();
+        k.idx = idx;
+        keys << k;
     }
-}
 
-QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT>> images) const
-{
-    std::sort(images.begin(), images.end(), imageContainerLessThanPtr);
-    return images;
+    std::sort(keys.begin(), keys.end(), [ascending](const SortKey &l, const SortKey &r) {
+        return ascending ? sortKeyLessThan(l.value, l.name, r.value, r.name) : sortKeyLessThan(r.value, r.name, l.value, l.name);
+    });
+
+    QVector<QSharedPointer<DkImageContainerT>> sorted;
+    sorted.reserve(images.size());
+
+    for (const SortKey &k : keys)
+        sorted << images[k.idx];
+
+    return sorted;
 }
 
 /**
@@ -408,6 +1533,41 @@ void DkImageLoader::changeFile(int skipIdx)
     load(imgC);
 }
 
+/**
+ * Returns the image skipIdx images away from the current one.
+ * In contrast to getSkippedImage() neither the folder nor the current image are touched.
+ * @param skipIdx the number of files to be skipped from the current file.
+ * @return QSharedPointer<DkImageContainerT> the image or NULL if it's beyond the folder's end
+ **/
+QSharedPointer<DkImageContainerT> DkImageLoader::peekImage(int skipIdx) const
+{
+    if (!mCurrentImage)
+        return QSharedPointer<DkImageContainerT>();
+
+    // multi-page documents skip pages first
+    if (mCurrentImage->getLoader()->getNumPages() > 1)
+        return mCurrentImage;
+
+    int numImages = mImages.size();
+    int idx = findFileIdx(mCurrentImage->filePath(), mImages);
+
+    if (idx == -1)
+        return QSharedPointer<DkImageContainerT>();
+
+    idx += skipIdx;
+
+    if (DkSettingsManager::param().global().loop && numImages > 0) {
+        idx %= numImages;
+        if (idx < 0)
+            idx += numImages;
+    }
+
+    if (idx < 0 || idx >= numImages)
+        return QSharedPointer<DkImageContainerT>();
+
+    return mImages[idx];
+}
+
 /**
  * Returns the file info of the ancesting/subsequent file + skipIdx.
  * @param skipIdx the number of files to be skipped from the current file.
@@ -645,41 +1805,100 @@ QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString
 
 QSharedPointer<DkImageContainerT> DkImageLoader::findFile(const QString &filePath) const
 {
-    // if one image is from zip than all should be
-    // for images in zip the "images[idx]->file() == file" comparison somahow does not work
-    if (mImages.size() > 0) {
-        if (mImages[0]->isFromZip()) {
-            int idx = findFileIdx(filePath, mImages);
-            if (idx < 0)
-                return QSharedPointer<DkImageContainerT>();
-            else
-                return mImages[idx];
-        }
-    }
+    int idx = findFileIdx(filePath, mImages);
 
-    for (int idx = 0; idx < mImages.size(); idx++) {
-        if (mImages[idx]->filePath() == filePath)
-            return mImages[idx];
-    }
+    if (idx < 0)
+        return QSharedPointer<DkImageContainerT>();
 
-    return QSharedPointer<DkImageContainerT>();
+    return mImages[idx];
 }
 
 int DkImageLoader::findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images) const
+{
+    // the index is only valid for our own images
+    if (&images == &mImages)
+        return findFileIdx(filePath, images, mImageIndex);
+
+    return findFileIdx(filePath, images, QHash<QString, int>());
+}
+
+int DkImageLoader::findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images, const QHash<QString, int> &index)
 {
     // this seems a bit bizare...
     // however, in converting the string from a fileInfo - we quarantee that the separators are the same (/ vs \)
     QString lFilePath = filePath;
-    lFilePath.replace("\\", QDir::separator());
+    if (QDir::separator() != '\\' && lFilePath.contains('\\'))
+        lFilePath.replace("\\", QDir::separator());
 
-    for (int idx = 0; idx < images.size(); idx++) {
-        if (images[idx]->filePath() == lFilePath)
+    int idx = index.value(lFilePath, -1);
+
+    // the hash might be outdated (e.g. zip containers change their file path) - check the hit
+    if (idx >= 0 && idx < images.size() && matchesPath(images[idx], lFilePath))
+        return idx;
+
+    // the index is complete - so we can trust a miss
+    if (!index.isEmpty() && index.size() >= images.size() && idx == -1)
+        return -1;
+
+    for (idx = 0; idx < images.size(); idx++) {
+        if (matchesPath(images[idx], lFilePath))
             return idx;
     }
 
     return -1;
 }
 
+bool DkImageLoader::matchesPath(QSharedPointer<DkImageContainerT> imgC, const QString &filePath)
+{
+    if (!imgC)
+        return false;
+
+    if (imgC->filePath() == filePath)
+        return true;
+
+#ifdef WITH_QUAZIP
+    // for images in zip the file path is replaced by the image name - so we need the encoded path
+    if (imgC->isFromZip() && imgC->getZipData()->getEncodedFilePath() == filePath)
+        return true;
+#endif
+
+    return false;
+}
+
+/**
+ * Creates a hash that maps the file paths to the image indexes.
+ * Images in zip archives are indexed with their current file path
+ * and their encoded path (see DkZipContainer::encodeZipFile).
+ * @param images the images to be indexed.
+ * @return QHash<QString, int> file path -> image index.
+ **/
+QHash<QString, int> DkImageLoader::createImageIndex(const QVector<QSharedPointer<DkImageContainerT>> &images)
+{
+    QHash<QString, int> index;
+    index.reserve(images.size());
+
+    // if one image is from zip than all should be
+    bool fromZip = !images.empty() && images[0]->isFromZip();
+
+    for (int idx = 0; idx < images.size(); idx++) {
+        index.insert(images[idx]->filePath(), idx);
+
+#ifdef WITH_QUAZIP
+        if (fromZip)
+            index.insert(images[idx]->getZipData()->getEncodedFilePath(), idx);
+#else
+        Q_UNUSED(fromZip);
+#endif
+    }
+
+    return index;
+}
+
+void DkImageLoader::updateImageIndex()
+{
+    mImageIndex = createImageIndex(mImages);
+}
+
 QStringList DkImageLoader::getFileNames() const
 {
     QStringList fileNames;
@@ -699,6 +1918,7 @@ QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::getImages()
 void DkImageLoader::setImages(QVector<QSharedPointer<DkImageContainerT>> images)
 {
     mImages = images;
+    updateImageIndex();
     emit updateDirSignal(images);
 }
 
@@ -793,13 +2013,23 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg)
     if (mCurrentImage && newImg && mCurrentImage->isFromZip() && !newImg->isFromZip())
         mFolderUpdated = true;
 
+#ifdef WITH_QUAZIP
+    // idle handles lock the archive (e.g. on Windows) - close them if we leave it
+    if (mCurrentImage && mCurrentImage->isFromZip()) {
+        QString zipFile = mCurrentImage->getZipData()->getZipFilePath();
+
+        if (!newImg || !newImg->isFromZip() || newImg->getZipData()->getZipFilePath() != zipFile)
+            DkZipContainer::releaseArchive(zipFile);
+    }
+#endif
+
     if (signalsBlocked()) {
         mCurrentImage = newImg;
         return;
     }
 
     if (newImg)
-        loadDir(newImg->dirPath());
+        loadDirThreaded(newImg->dirPath());
     // else
     //	qDebug() << "empty image assigned"; // TODO
 
@@ -830,6 +2060,9 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg)
                 mCurrentImage->clear();
 
             mCurrentImage->getLoader()->resetPageIdx();
+
+            // scratch buffers of the last image (e.g. adjustment previews) are not needed anymore
+            DkScratchPool::instance().trim();
         }
         mCurrentImage->receiveUpdates(this, false); // reset updates
     }
@@ -854,6 +2087,7 @@ void DkImageLoader::reloadImage()
 
     mCurrentDir = "";
     mImages.clear();
+    mImageIndex.clear();
     mCurrentImage->clear();
     setCurrentImage(mCurrentImage);
     loadDir(mCurrentImage->dirPath());
@@ -906,6 +2140,14 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
     }
 #endif
 
+    // was it cached?
+    if (image->getLoadState() == DkImageContainerT::loaded)
+        DkTelemetry::instance().count(DkTelemetry::cache_hit);
+    else if (image->getLoadState() == DkImageContainerT::loading || !image->getFileBuffer()->isEmpty())
+        DkTelemetry::instance().count(DkTelemetry::cache_partial_hit);
+    else
+        DkTelemetry::instance().count(DkTelemetry::cache_miss);
+
     setCurrentImage(image);
 
     if (mCurrentImage && mCurrentImage->getLoadState() == DkImageContainerT::loading)
@@ -1446,9 +2688,9 @@ void DkImageLoader::updateHistory()
     settings.endGroup();
 
     // update
-    DkSettingsManager::param().global().lastDir = file.absolutePath();
-    DkSettingsManager::param().global().recentFiles = rFiles;
-    DkSettingsManager::param().global().recentFolders = rFolders;
+    DkSettingsManager::edit().global().lastDir = file.absolutePath();
+    DkSettingsManager::edit().global().recentFiles = rFiles;
+    DkSettingsManager::edit().global().recentFolders = rFolders;
 
     // DkSettings s = DkSettings();
     // s.save();
@@ -1594,6 +2836,10 @@ bool DkImageLoader::restoreFile(const QString &filePath)
  **/
 void DkImageLoader::directoryChanged(const QString &path)
 {
+    // we are editing the folder ourselves (see applyFileChanges)
+    if (mDirUpdatesBlocked > 0 && !path.isEmpty())
+        return;
+
     if (path.isEmpty() || path == mCurrentDir) {
         mFolderUpdated = true;
 
@@ -1612,6 +2858,66 @@ void DkImageLoader::directoryChanged(const QString &path)
     }
 }
 
+/**
+ * Ignores notifications of the directory watcher while nomacs
+ * edits the current folder itself. The watcher notifies late -
+ * so the block is released with a delay.
+ * @param block if true, folder updates are blocked
+ **/
+void DkImageLoader::blockDirectoryUpdates(bool block)
+{
+    if (block)
+        mDirUpdatesBlocked++;
+    else
+        QTimer::singleShot(1000, this, [this]() {
+            mDirUpdatesBlocked = qMax(mDirUpdatesBlocked - 1, 0);
+        });
+}
+
+/**
+ * Applies file changes that nomacs made to the current folder.
+ * The folder is not indexed again - removed files are dropped
+ * and added files are merged (see updateImages).
+ * @param removedFiles files that were moved, renamed or deleted
+ * @param addedFiles files that were copied, moved or renamed
+ **/
+void DkImageLoader::applyFileChanges(const QStringList &removedFiles, const QStringList &addedFiles)
+{
+    if (removedFiles.empty() && addedFiles.empty())
+        return;
+
+    // we cannot tell if new files pass the keyword filters
+    if (!addedFiles.empty() && (!mKeywords.empty() || !mIgnoreKeywords.empty() || !mFolderFilterString.isEmpty())) {
+        mFolderUpdated = true;
+        loadDir(mCurrentDir, false);
+        return;
+    }
+
+    QSet<QString> removed(removedFiles.begin(), removedFiles.end());
+
+    QFileInfoList files;
+    files.reserve(mImages.size() + addedFiles.size());
+
+    for (const QSharedPointer<DkImageContainerT> &imgC : mImages) {
+        if (!removed.contains(imgC->filePath()))
+            files << QFileInfo(imgC->filePath());
+    }
+
+    for (const QString &fp : addedFiles) {
+        QFileInfo fi(fp);
+
+        if (fi.absolutePath() == mCurrentDir && DkUtils::hasValidSuffix(fi.fileName()))
+            files << fi;
+    }
+
+    if (files.empty()) {
+        mImages.clear();
+        mImageIndex.clear();
+        emit updateDirSignal(mImages);
+    } else if (updateImages(files))
+        emit updateDirSignal(mImages);
+}
+
 /**
  * Returns true if a file was specified.
  * @return bool true if a file name/path was specified
@@ -1670,54 +2976,58 @@ QString DkImageLoader::getDirPath() const
 
 QStringList DkImageLoader::getFoldersRecursive(const QString &dirPath)
 {
-    // DkTimer dt;
-    QStringList subFolders;
-    // qDebug() << "scanning recursively: " << dir.absolutePath();
-
-    if (DkSettingsManager::param().global().scanSubFolders) {
-        QDirIterator dirs(dirPath, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    if (!DkSettingsManager::param().global().scanSubFolders)
+        return QStringList() << dirPath;
 
-        int nFolders = 0;
-        while (dirs.hasNext()) {
-            dirs.next();
-            subFolders << dirs.filePath();
-            nFolders++;
+    return DkFolderIndex::instance().folders(dirPath);
+}
 
-            if (nFolders > 100)
-                break;
+/**
+ * Indexes the sub folders of rootDirPath in the background.
+ * Until the walk is finished, only the current folder is browsed.
+ * subFoldersUpdatedSignal is emitted with the folders once they are indexed.
+ * @param rootDirPath the root folder
+ **/
+void DkImageLoader::updateSubFolders(const QString &rootDirPath)
+{
+    mSubFolders = QStringList() << rootDirPath;
 
-            // getFoldersRecursive(dirs.filePath(), subFolders);
-            // qDebug() << "loop: " << dirs.filePath();
-        }
+    if (!DkSettingsManager::param().global().scanSubFolders) {
+        mSubFolderWatcher.setFuture(QFuture<QStringList>());
+        return;
     }
 
-    subFolders << dirPath;
+    // the walk waits for its listings in the I/O lane - so it must not run there itself
+    mSubFolderWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_probe, DkScheduler::priority_interactive, [rootDirPath]() {
+        return getFoldersRecursive(rootDirPath);
+    }));
+}
 
-    std::sort(subFolders.begin(), subFolders.end(), DkUtils::compLogicQString);
+void DkImageLoader::subFoldersIndexed()
+{
+    if (mSubFolderWatcher.future().resultCount() == 0)
+        return;
 
-    qDebug() << dirPath << "loaded recursively...";
+    mSubFolders = mSubFolderWatcher.result();
+    emit subFoldersUpdatedSignal(mSubFolders);
 
-    // qDebug() << "scanning folders recursively took me: " << QString::fromStdString(dt.getTotal());
-    return subFolders;
-}
+    qDebug() << "[DkImageLoader]" << mSubFolders.size() << "sub folders indexed";
 
-QFileInfoList DkImageLoader::updateSubFolders(const QString &rootDirPath)
-{
-    mSubFolders = getFoldersRecursive(rootDirPath);
-    QFileInfoList files;
-    qDebug() << mSubFolders;
+    // the root folder has no images - load the first sub folder that has some
+    if (!mImages.empty())
+        return;
 
-    // find the first subfolder that has images
-    for (int idx = 0; idx < mSubFolders.size(); idx++) {
-        mCurrentDir = mSubFolders[idx];
-        files = getFilteredFileInfoList(mCurrentDir,
-                                        mIgnoreKeywords,
-                                        mKeywords); // this line takes seconds if you have lots of files and slow loading (e.g. network)
-        if (!files.empty())
-            break;
+    for (const QString &dirPath : mSubFolders) {
+        if (DkFolderIndex::instance().cachedNumImages(dirPath) <= 0)
+            continue;
+
+        if (loadDir(dirPath, false)) {
+            firstFile();
+            return;
+        }
     }
 
-    return files;
+    emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000); // stop showing
 }
 
 int DkImageLoader::getNextFolderIdx(int folderIdx)
@@ -1727,7 +3037,7 @@ int DkImageLoader::getNextFolderIdx(int folderIdx)
     if (mSubFolders.empty())
         return nextIdx;
 
-    // find the first sub folder that has images
+    // find the first sub folder that has images (the index answers without accessing the disk)
     for (int idx = 1; idx < mSubFolders.size(); idx++) {
         int tmpNextIdx = folderIdx + idx;
 
@@ -1736,11 +3046,7 @@ int DkImageLoader::getNextFolderIdx(int folderIdx)
         else if (tmpNextIdx >= mSubFolders.size())
             return -1;
 
-        QDir cDir = mSubFolders[tmpNextIdx];
-        QFileInfoList cFiles = getFilteredFileInfoList(cDir.absolutePath(),
-                                                       mIgnoreKeywords,
-                                                       mKeywords); // this line takes seconds if you have lots of files and slow loading (e.g. network)
-        if (!cFiles.empty()) {
+        if (DkFolderIndex::instance().cachedNumImages(mSubFolders[tmpNextIdx]) > 0) {
             nextIdx = tmpNextIdx;
             break;
         }
@@ -1756,7 +3062,7 @@ int DkImageLoader::getPrevFolderIdx(int folderIdx)
     if (mSubFolders.empty())
         return prevIdx;
 
-    // find the first sub folder that has images
+    // find the first sub folder that has images (the index answers without accessing the disk)
     for (int idx = 1; idx < mSubFolders.size(); idx++) {
         int tmpPrevIdx = folderIdx - idx;
 
@@ -1765,11 +3071,7 @@ int DkImageLoader::getPrevFolderIdx(int folderIdx)
         else if (tmpPrevIdx < 0)
             return -1;
 
-        QDir cDir = mSubFolders[tmpPrevIdx];
-        QFileInfoList cFiles = getFilteredFileInfoList(cDir.absolutePath(),
-                                                       mIgnoreKeywords,
-                                                       mKeywords); // this line takes seconds if you have lots of files and slow loading (e.g. network)
-        if (!cFiles.empty()) {
+        if (DkFolderIndex::instance().cachedNumImages(mSubFolders[tmpPrevIdx]) > 0) {
             prevIdx = tmpPrevIdx;
             break;
         }
@@ -1794,71 +3096,24 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC)
     if (!imgC || !DkSettingsManager::param().resources().cacheMemory)
         return;
 
-    DkTimer dt;
-
-    //// no caching? delete all
-    // if (!DkSettingsManager::param().resources().cacheMemory) {
-    //	for (int idx = 0; idx < images.size(); idx++) {
-    //		images.at(idx)->clear();
-    //	}
-    //	return;
-    // }
-
     int cIdx = findFileIdx(imgC->filePath(), mImages);
-    double mem = 0;
-    double totalMem = 0;
 
     if (cIdx == -1) {
-        qWarning() << "WARNING: image not found for caching!";
+        // the folder is still indexed - we'll update the cache once it's done
+        if (!isIndexing())
+            qWarning() << "WARNING: image not found for caching!";
         return;
     }
 
-    for (int idx = 0; idx < mImages.size(); idx++) {
-        auto cImg = mImages.at(idx);
-
-        // clear images if they are edited
-        if (idx != cIdx && cImg->isEdited()) {
-            cImg->clear();
-            continue;
-        }
-
-        // do not count the last & the current image
-        if (idx > cIdx && idx <= cIdx + DkSettingsManager::param().resources().maxImagesCached)
-            mem += cImg->getMemoryUsage();
-        else if (abs(cIdx - idx) > 1) {
-            cImg->clear();
-            if (cImg->hasImage())
-                qDebug() << "[Cacher]" << cImg->filePath() << "freed";
-
-            continue;
-        } else
-            totalMem += cImg->getMemoryUsage();
-
-        // ignore the last and current one
-        if (idx == cIdx - 1 || idx == cIdx) {
-            continue;
-        }
-        // fully load the next image
-        else if (idx == cIdx + 1 && mem < DkSettingsManager::param().resources().cacheMemory
-                 && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-            cImg->loadImageThreaded();
-            qDebug() << "[Cacher] " << cImg->filePath() << " fully cached...";
-        } else if (idx > cIdx && idx < cIdx + DkSettingsManager::param().resources().maxImagesCached - 2
-                   && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-            // dt.getIvl();
-            mImages.at(idx)->fetchFile(); // TODO: crash detected here
-            qDebug() << "[Cacher] " << cImg->filePath() << " file fetched...";
-        }
-    }
-
-    qDebug() << "[Cacher] created in" << dt << "(" << mem + totalMem << "MB)";
+    mCacher.update(mImages, cIdx);
 }
 
 /**
  * Returns the file list of the directory dir.
  * Note: this function might get slow if lots of files (> 10000) are in the
- * directory or if the directory is in the net.
- * Currently the file list is sorted according to the system specification.
+ * directory or if the directory is in the net. Use loadDirThreaded to index
+ * such directories in the background.
+ * The file list is not sorted.
  * @param dir the directory to load the file list from.
  * @param ignoreKeywords if one of these keywords is in the file name, the file will be ignored.
  * @param keywords if one of these keywords is not in the file name, the file will be ignored.
@@ -1866,139 +3121,118 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC)
  **/
 QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QStringList ignoreKeywords, QStringList keywords, QString folderKeywords)
 {
-    DkTimer dt;
-
     if (dirPath.isEmpty())
         return QFileInfoList();
 
-#ifdef Q_OS_WIN
-
-    QString winPath = QDir::toNativeSeparators(dirPath) + "\\*.*";
-
-    const wchar_t *fname = reinterpret_cast<const wchar_t *>(winPath.utf16());
-
-    WIN32_FIND_DATAW findFileData;
-    HANDLE MyHandle = FindFirstFileW(fname, &findFileData);
-
-    std::vector<std::wstring> fileNameList;
-    std::wstring fileName;
-
-    if (MyHandle != INVALID_HANDLE_VALUE) {
-        do {
-            fileName = findFileData.cFileName;
-            fileNameList.push_back(fileName); // TODO: sort correct according to numbers
-        } while (FindNextFileW(MyHandle, &findFileData) != 0);
-    }
-
-    FindClose(MyHandle);
-
-    // remove the * in fileFilters
-    QStringList fileFiltersClean = DkSettingsManager::param().app().browseFilters;
-    for (QString &filter : fileFiltersClean)
-        filter.replace("*", "");
+    return indexDir(dirPath, DkFileFilter(ignoreKeywords, keywords), folderKeywords);
+}
 
-    // qDebug() << "browse filters: " << DkSettingsManager::param().app().browseFilters;
+/**
+ * Indexes all files of a directory in a single pass.
+ * This function is thread-safe. If batchIndexed is set, it is called
+ * with the files found since the last batch (~ every 250 ms). Indexing is stopped if
+ * batchIndexed returns false. Batches are not reported if folder keywords
+ * are set since they need the full file list. Duplicates are removed from
+ * the full list only (i.e. batches might contain files that are removed later).
+ * @param dirPath the directory to be indexed.
+ * @param filter the file filter.
+ * @param folderKeywords filters the file list (see DkUtils::filterStringList).
+ * @param batchIndexed callback for partial results.
+ * @return QFileInfoList all filtered files of the directory (not sorted).
+ **/
+QFileInfoList DkImageLoader::indexDir(const QString &dirPath,
+                                      const DkFileFilter &filter,
+                                      const QString &folderKeywords,
+                                      std::function<bool(const QFileInfoList &)> batchIndexed)
+{
+    DkTimer dt;
 
     QStringList fileList;
-    std::vector<std::wstring>::iterator lIter = fileNameList.begin();
-
-    // convert to QStringList
-    for (unsigned int idx = 0; idx < fileNameList.size(); idx++, lIter++) {
-        QString qFilename = DkUtils::stdWStringToQString(*lIter);
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+    int numReported = 0;
+    bool canceled = false;
 
-        // believe it or not, but this is 10 times faster than QRegExp
-        // drawback: we also get files that contain *.jpg*
-        for (int i = 0; i < fileFiltersClean.size(); i++) {
-            if (qFilename.contains(fileFiltersClean[i], Qt::CaseInsensitive)) {
-                fileList.append(qFilename);
-                break;
-            }
-        }
-    }
+    auto toFileInfos = [&dirPath](const QStringList &fileNames) {
+        QFileInfoList fileInfoList;
+        fileInfoList.reserve(fileNames.size());
 
-    qInfoClean() << "WinAPI, indexed (" << fileList.size() << ") files in: " << dt;
-#else
+        for (const QString &fn : fileNames)
+            fileInfoList.append(QFileInfo(dirPath, fn));
 
-    // true file list
-    QDir tmpDir(dirPath);
-    tmpDir.setSorting(QDir::LocaleAware);
-    QStringList fileList = tmpDir.entryList(DkSettingsManager::param().app().browseFilters);
+        return fileInfoList;
+    };
 
-#endif
+    auto addFile = [&](const QString &fileName) {
+        if (!filter.accept(dirPath, fileName))
+            return;
 
-    // append files with no suffix
-    QDir cDir(dirPath);
-    QStringList allFiles = cDir.entryList();
-    QStringList noSuffixFiles;
+        fileList << fileName;
 
-    for (const QString &name : allFiles) {
-        if (!name.contains(".") && DkUtils::isValid(QFileInfo(dirPath, name))) {
-            fileList << name;
+        if (batchIndexed && folderKeywords.isEmpty() && batchTimer.elapsed() > 250) {
+            canceled = !batchIndexed(toFileInfos(fileList.mid(numReported)));
+            numReported = fileList.size();
+            batchTimer.restart();
         }
-    }
-
-    // remove files that contain ignore keywords
-    for (int idx = 0; idx < ignoreKeywords.size(); idx++) {
-        QRegularExpression exp = QRegularExpression("^((?!" + ignoreKeywords[idx] + ").)*$", QRegularExpression::CaseInsensitiveOption);
-        fileList = fileList.filter(exp);
-    }
-
-    for (int idx = 0; idx < keywords.size(); idx++) {
-        fileList = fileList.filter(keywords[idx], Qt::CaseInsensitive);
-    }
+    };
 
-    if (folderKeywords != "") {
-        QStringList filterList = fileList;
-        fileList = DkUtils::filterStringList(folderKeywords, filterList);
-    }
+#ifdef Q_OS_WIN
 
-    if (DkSettingsManager::param().resources().filterDuplicats) {
-        QString preferredExtension = DkSettingsManager::param().resources().preferredExtension;
-        preferredExtension = preferredExtension.replace("*.", "");
-        qDebug() << "preferred extension: " << preferredExtension;
+    QString winPath = QDir::toNativeSeparators(dirPath) + "\\*.*";
 
-        QStringList resultList = fileList;
-        fileList.clear();
+    const wchar_t *fname = reinterpret_cast<const wchar_t *>(winPath.utf16());
 
-        for (int idx = 0; idx < resultList.size(); idx++) {
-            QFileInfo cFName = QFileInfo(resultList.at(idx));
+    WIN32_FIND_DATAW findFileData;
+    HANDLE MyHandle = FindFirstFileW(fname, &findFileData);
 
-            if (preferredExtension.compare(cFName.suffix(), Qt::CaseInsensitive) == 0) {
-                fileList.append(resultList.at(idx));
+    if (MyHandle != INVALID_HANDLE_VALUE) {
+        do {
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                 continue;
-            }
 
-            QString cFBase = cFName.baseName();
-            bool remove = false;
+            addFile(DkUtils::stdWStringToQString(findFileData.cFileName));
+        } while (!canceled && FindNextFileW(MyHandle, &findFileData) != 0);
+    }
 
-            for (int cIdx = 0; cIdx < resultList.size(); cIdx++) {
-                QString ccBase = QFileInfo(resultList.at(cIdx)).baseName();
+    FindClose(MyHandle);
 
-                if (cIdx != idx && ccBase == cFBase && resultList.at(cIdx).contains(preferredExtension, Qt::CaseInsensitive)) {
-                    remove = true;
-                    break;
-                }
-            }
+    qInfoClean() << "WinAPI, indexed (" << fileList.size() << ") files in: " << dt;
+#else
 
-            if (!remove)
-                fileList.append(resultList.at(idx));
-        }
+    QDirIterator dirIt(dirPath, QDir::Files | QDir::NoDotAndDotDot);
+
+    while (!canceled && dirIt.hasNext()) {
+        dirIt.next();
+        addFile(dirIt.fileName());
     }
 
-    // fileList = sort(fileList, dir);
+#endif
 
-    QFileInfoList fileInfoList;
+    if (canceled)
+        return QFileInfoList();
 
-    for (int idx = 0; idx < fileList.size(); idx++)
-        fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
+    if (!folderKeywords.isEmpty())
+        fileList = DkUtils::filterStringList(folderKeywords, fileList);
 
-    return fileInfoList;
+    return toFileInfos(filter.removeDuplicates(fileList));
 }
 
+/**
+ * Sorts the images in the background.
+ * updateDirSignal() is emitted once they are sorted.
+ **/
 void DkImageLoader::sort()
 {
-    std::sort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
-    emit updateDirSignal(mImages);
+    sortImagesThreaded(mImages);
+}
+
+/**
+ * True if sorting needs the metadata of all files (e.g. the date taken).
+ * Reading it takes long - so these modes are always sorted in the background.
+ **/
+bool DkImageLoader::sortReadsMetaData(int sortMode)
+{
+    return sortMode == DkSettings::sort_date_taken || sortMode == DkSettings::sort_rating;
 }
 
 void DkImageLoader::currentImageUpdated() const
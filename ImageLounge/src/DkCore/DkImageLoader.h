@@ -28,8 +28,18 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
 #include <QImage>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QSet>
 #include <QTimer>
+
+#include <functional>
 #pragma warning(pop) // no warnings from includes - end
 
 #ifndef DllCoreExport
@@ -44,6 +54,8 @@
 
 // my classes
 #include "DkImageContainer.h"
+#include "DkSettings.h"
+#include "DkTimer.h"
 
 #ifdef Q_OS_LINUX
 typedef unsigned char byte;
@@ -56,6 +68,151 @@ class QUrl;
 namespace nmc
 {
 
+/**
+ * Single pass file filter for indexing folders.
+ * Suffixes are looked up in a hash, keywords are compiled once
+ * and duplicates are found with a hash on the files' base names.
+ **/
+class DllCoreExport DkFileFilter
+{
+public:
+    DkFileFilter(const QStringList &ignoreKeywords = QStringList(), const QStringList &keywords = QStringList());
+
+    bool accept(const QString &dirPath, const QString &fileName) const;
+    QStringList removeDuplicates(const QStringList &fileNames) const;
+
+protected:
+    QSet<QString> mSuffixes;
+    QVector<QRegularExpression> mWildcards;
+    QVector<QRegularExpression> mIgnoreExps;
+    QStringList mKeywords;
+
+    bool mFilterDuplicates = false;
+    QString mPreferredExtension;
+};
+
+/**
+ * Prefetch cache for the images of the current folder.
+ * The cacher keeps a sliding window around the current image
+ * that follows the browsing direction. Images that leave the window
+ * are released in distance/LRU order so that the total memory stays
+ * below the cache budget (see DkMemoryGovernor). An update costs O(window) and not O(folder size).
+ * The budget is global: the images cached by other loaders (tabs) are charged to it.
+ **/
+class DllCoreExport DkImageCacher
+{
+public:
+    DkImageCacher();
+    ~DkImageCacher();
+
+    void update(const QVector<QSharedPointer<DkImageContainerT>> &images, int cIdx);
+    void clear();
+
+    int direction() const;
+    double velocity() const;
+    double memoryUsage() const;
+
+protected:
+    struct Entry {
+        QWeakPointer<DkImageContainerT> image;
+        int idx = -1; // index in the folder - it is looked up again if the folder is sorted
+        bool prefetched = false; // true until the image is displayed
+    };
+
+    void updateDirection(int cIdx, int numImages);
+    void touch(QSharedPointer<DkImageContainerT> imgC, int idx);
+    int distance(int idx, int cIdx, int numImages) const;
+    int wrapIdx(int idx, int numImages) const;
+    double othersMemoryUsage() const;
+
+    static QVector<DkImageCacher *> &cachers();
+
+    QVector<Entry> mEntries; // LRU order - the most recent entry is at the back
+    QElapsedTimer mLastUpdate;
+    int mLastIdx = -1;
+    int mDirection = 1; // 1 forward, -1 backward
+    double mVelocity = 0.0; // images per second (smoothed)
+    bool mTurned = false; // true if the last step changed the direction
+    int mLastAhead = 0; // images prefetched in the last update
+    int mPressure = 0; // DkMemoryGovernor::Pressure of the last update
+    bool mLoop = false; // Global::loop of the last update
+};
+
+/**
+ * Cold tier of the image cache.
+ * Images that leave the cacher window are kept at screen resolution
+ * so that stepping back shows them right away while the full image is decoded.
+ * The cold tier has its own budget (a quarter of the cache budget)
+ * and evicts the least recently used images. Entries are validated with the
+ * file's modification date. The cache is thread-safe.
+ **/
+class DllCoreExport DkColdImageCache
+{
+public:
+    static DkColdImageCache &instance();
+
+    void insert(QSharedPointer<DkImageContainerT> imgC);
+    QImage image(const QString &filePath, const QDateTime &modified);
+    void remove(const QString &filePath);
+    void clear();
+
+    double memoryUsage() const;
+
+private:
+    DkColdImageCache();
+    DkColdImageCache(const DkColdImageCache &);
+
+    struct Entry {
+        QString filePath;
+        QDateTime modified;
+        QImage img;
+    };
+
+    void add(const Entry &e);
+    int find(const QString &filePath) const;
+    static QImage downscale(const QImage &img, const QSize &ss);
+
+    QVector<Entry> mEntries; // LRU order - the most recent entry is at the back
+    double mMemory = 0.0; // MB
+    double mPendingMemory = 0.0; // MB of full resolution images that wait to be downscaled
+    mutable QMutex mMutex;
+};
+
+/**
+ * Cached folder tree for browsing sub folders (see GlobalSettings::scanSubFolders).
+ * Sub trees are walked in parallel (one listing per folder in the I/O lane)
+ * and the number of images is counted while listing. Entries are validated
+ * with their folder's modification date, so folders that did not change
+ * are neither listed nor counted again.
+ * The index is thread-safe. The walk blocks, so it must not be called from the GUI thread.
+ **/
+class DllCoreExport DkFolderIndex
+{
+public:
+    static DkFolderIndex &instance();
+
+    QStringList folders(const QString &rootDirPath);
+    int numImages(const QString &dirPath);
+    int cachedNumImages(const QString &dirPath) const;
+    void clear();
+
+private:
+    DkFolderIndex();
+    DkFolderIndex(const DkFolderIndex &);
+
+    struct Entry {
+        qint64 modified = 0;
+        int numImages = 0; // files that pass the browse filters (without keywords)
+        QStringList subFolders;
+    };
+
+    Entry entry(const QString &dirPath);
+    static Entry list(const QString &dirPath, qint64 modified);
+
+    QHash<QString, Entry> mEntries;
+    mutable QMutex mMutex;
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -72,11 +229,16 @@ public:
     virtual ~DkImageLoader();
 
     static QStringList getFoldersRecursive(const QString &dirPath);
-    QFileInfoList updateSubFolders(const QString &rootDirPath);
+    void updateSubFolders(const QString &rootDirPath);
     QFileInfoList getFilteredFileInfoList(const QString &dirPath,
                                           QStringList ignoreKeywords = QStringList(),
                                           QStringList keywords = QStringList(),
                                           QString folderKeywords = QString());
+    static QFileInfoList indexDir(const QString &dirPath,
+                                  const DkFileFilter &filter,
+                                  const QString &folderKeywords = QString(),
+                                  std::function<bool(const QFileInfoList &)> batchIndexed = std::function<bool(const QFileInfoList &)>());
+    bool isIndexing() const;
 
     void rotateImage(double angle);
     QSharedPointer<DkImageContainerT> getCurrentImage() const;
@@ -98,6 +260,7 @@ public:
     void clearPath();
     void loadLastDir();
     QSharedPointer<DkImageContainerT> getSkippedImage(int skipIdx, bool searchFile = true, bool recursive = false);
+    QSharedPointer<DkImageContainerT> peekImage(int skipIdx) const;
 
     QString getDirPath() const;
     QString getSavePath() const;
@@ -108,6 +271,7 @@ public:
     QSharedPointer<DkImageContainerT> findOrCreateFile(const QString &filePath) const;
     QSharedPointer<DkImageContainerT> findFile(const QString &filePath) const;
     int findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images) const;
+    static QHash<QString, int> createImageIndex(const QVector<QSharedPointer<DkImageContainerT>> &images);
 
     bool hasFile() const;
     bool hasMovie() const;
@@ -116,6 +280,8 @@ public:
 
     void deactivate();
     void activate(bool isActive = true);
+    void blockDirectoryUpdates(bool block);
+    void applyFileChanges(const QStringList &removedFiles, const QStringList &addedFiles);
     bool hasImage() const;
     bool isEdited() const;
     int numFiles() const;
@@ -149,6 +315,9 @@ signals:
     void updateDirSignal(QVector<QSharedPointer<DkImageContainerT>> images) const;
     void imageHasGPSSignal(bool hasGPS) const;
     void loadImageToTab(const QString &filePath) const;
+    void filesIndexedSignal(const QFileInfoList &files, int generation) const;
+    void subFoldersUpdatedSignal(const QStringList &folders) const;
+    void partialImageSignal(const QImage &img) const; // the current image is being downloaded
 
 public slots:
     void undo();
@@ -169,6 +338,7 @@ public slots:
     QString getFolderFilter();
     QStringList getFolderFilters();
     bool loadDir(const QString &newDirPath, bool scanRecursive = true);
+    bool loadDirThreaded(const QString &newDirPath);
     void errorDialog(const QString &msg) const;
     void loadFileAt(int idx);
 
@@ -177,6 +347,9 @@ public slots:
     void imageLoaded(bool loaded = false);
     void imageSaved(const QString &file, bool saved = true, bool loadToTab = true);
     void imagesSorted();
+    void filesIndexed(const QFileInfoList &files, int generation);
+    void dirIndexed();
+    void subFoldersIndexed();
     bool unloadFile();
     void reloadImage();
     void showOnMap();
@@ -189,7 +362,14 @@ protected:
     void updateHistory();
     void sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>> images);
     void createImages(const QFileInfoList &files, bool sort = true);
-    QVector<QSharedPointer<DkImageContainerT>> sortImages(QVector<QSharedPointer<DkImageContainerT>> images) const;
+    bool updateImages(const QFileInfoList &files);
+    QVector<QSharedPointer<DkImageContainerT>> mergeImages(QVector<QSharedPointer<DkImageContainerT>> images, QVector<QSharedPointer<DkImageContainerT>> added);
+    void cancelIndexing();
+    QVector<QSharedPointer<DkImageContainerT>> sortImages(QVector<QSharedPointer<DkImageContainerT>> images, const DkSettingsSnapshot &settings) const;
+    static bool sortReadsMetaData(int sortMode);
+    void updateImageIndex();
+    static int findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images, const QHash<QString, int> &index);
+    static bool matchesPath(QSharedPointer<DkImageContainerT> imgC, const QString &filePath);
 
     QStringList mIgnoreKeywords;
     QStringList mKeywords;
@@ -197,12 +377,14 @@ protected:
 
     QTimer mDelayedUpdateTimer;
     bool mTimerBlockedUpdate = false;
+    int mDirUpdatesBlocked = 0;
     QString mCurrentDir;
     QString mSaveDir;
     QString mCopyDir;
     QFileSystemWatcher *mDirWatcher = 0;
     QStringList mSubFolders;
     QVector<QSharedPointer<DkImageContainerT>> mImages;
+    QHash<QString, int> mImageIndex; // file path -> index in mImages
     QSharedPointer<DkImageContainerT> mCurrentImage;
     QSharedPointer<DkImageContainerT> mLastImageLoaded;
     bool mFolderUpdated = false;
@@ -210,6 +392,15 @@ protected:
     bool mSortingImages = false;
     bool mSortingIsDirty = false;
     QFutureWatcher<QVector<QSharedPointer<DkImageContainerT>>> mCreateImageWatcher;
+    DkImageCacher mCacher;
+
+    // threaded folder indexing
+    QFutureWatcher<QFileInfoList> mIndexWatcher;
+    QFutureWatcher<QStringList> mSubFolderWatcher;
+    QString mIndexingDir;
+    QVector<QSharedPointer<DkImageContainerT>> mIndexedImages; // indexed but not merged yet
+    QAtomicInt mIndexGeneration = 0;
+    DkTimer mIndexTimer;
 };
 
 }
\ No newline at end of file
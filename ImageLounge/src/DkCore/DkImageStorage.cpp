@@ -27,20 +27,35 @@
 
 #include "DkImageStorage.h"
 #include "DkActionManager.h"
+#include "DkLog.h"
 #include "DkMath.h"
+#include "DkPixelFormats.h"
+#include "DkScheduler.h"
+#include "DkScratch.h"
 #include "DkSettings.h"
+#include "DkTelemetry.h"
 #include "DkThumbs.h"
 #include "DkTimer.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QBitmap>
 #include <QDebug>
+#include <QFile>
+#include <QFuture>
+#include <QIconEngine>
+#include <QMutex>
 #include <QPainter>
 #include <QPixmap>
+#include <QScopedPointer>
 #include <QSvgRenderer>
+#include <QThread>
 #include <QTimer>
 #include <QtConcurrentRun>
 #include <qmath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #pragma warning(pop) // no warnings from includes - end
 
 #if defined(Q_OS_WIN) && !defined(SOCK_STREAM)
@@ -121,6 +136,14 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
         return QImage();
     }
 
+    // nearest neighbor does not mix pixels - so there is nothing to correct
+    if (interpolation == ipl_nearest)
+        correctGamma = false;
+
+    // resample in linear light directly on the 8 (16) bit data
+    if (correctGamma)
+        return resizeLinear(img, nSize, interpolation);
+
     Qt::TransformationMode iplQt = Qt::FastTransformation;
     switch (interpolation) {
     case ipl_nearest:
@@ -133,6 +156,11 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
         iplQt = Qt::SmoothTransformation;
         break;
     }
+
+    // Qt keeps the bit depth - the OpenCV path converts to 8 bit
+    if (DkImageHistogram::isHighBitDepth(img))
+        return img.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
+
 #ifdef WITH_OPENCV
 
     int ipl = CV_INTER_CUBIC;
@@ -156,27 +184,33 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
 
     try {
         QImage qImg;
-        cv::Mat resizeImage = DkImage::qImage2Mat(img);
-
-        if (correctGamma) {
-            resizeImage.convertTo(resizeImage, CV_16U, USHRT_MAX / 255.0f);
-            DkImage::gammaToLinear(resizeImage);
+        DkScratch scratch;
+        cv::Mat resizeImage = DkImage::qImage2MatView(img); // just read
+
+        if (correctGamma && !resizeImage.empty()) {
+            cv::Mat linearImage = scratch.mat(resizeImage.rows, resizeImage.cols, CV_MAKETYPE(CV_16U, resizeImage.channels()));
+            resizeImage.convertTo(linearImage, CV_16U, USHRT_MAX / 255.0f);
+            DkImage::gammaToLinear(linearImage);
+            resizeImage = linearImage;
         }
 
         // is the image convertible?
         if (resizeImage.empty()) {
             qImg = img.scaled(newSize, Qt::IgnoreAspectRatio, iplQt);
         } else {
-            cv::Mat tmp;
+            // the result is adopted by the QImage - so only the intermediate is leased
+            cv::Mat tmp = correctGamma ? scratch.mat(nSize.height(), nSize.width(), resizeImage.type()) : cv::Mat();
             cv::resize(resizeImage, tmp, cv::Size(nSize.width(), nSize.height()), 0, 0, ipl);
-            resizeImage = tmp;
 
             if (correctGamma) {
-                DkImage::linearToGamma(resizeImage);
-                resizeImage.convertTo(resizeImage, CV_8U, 255.0f / USHRT_MAX);
+                DkImage::linearToGamma(tmp);
+
+                cv::Mat gammaImage;
+                tmp.convertTo(gammaImage, CV_8U, 255.0f / USHRT_MAX);
+                tmp = gammaImage;
             }
 
-            qImg = DkImage::mat2QImage(resizeImage);
+            qImg = DkImage::mat2QImageView(tmp);
         }
 
         if (!img.colorTable().isEmpty())
@@ -194,7 +228,7 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
 
     if (correctGamma)
         DkImage::gammaToLinear(qImg);
-    qImg.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
+    qImg = qImg.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
 
     if (correctGamma)
         DkImage::linearToGamma(qImg);
@@ -202,26 +236,226 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
 #endif
 }
 
+// pixel kernels --------------------------------------------------------------------
+// written once and instantiated per pixel layout (see DkPixelFormat::dispatch)
+
+struct DkAlphaUsedKernel {
+    DkAlphaUsedKernel(const QImage &img)
+        : img(img)
+    {
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        if (L::alpha < 0)
+            return;
+
+        const int a = qMax((int)L::alpha, 0);
+        const int width = img.width();
+
+        DkImage::parallelRows(img.height(), [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow && !used.loadRelaxed(); rIdx++) {
+                const C *ptr = reinterpret_cast<const C *>(img.constScanLine(rIdx)) + a;
+
+                // no branches within a row
+                quint32 opaque = L::maxValue;
+                for (int cIdx = 0; cIdx < width; cIdx++)
+                    opaque &= ptr[cIdx * L::channels];
+
+                if (opaque != (quint32)L::maxValue)
+                    used.storeRelaxed(1);
+            }
+        });
+    }
+
+    const QImage &img;
+    QAtomicInt used;
+};
+
+// thresholds the color channels (alpha is kept)
+struct DkThresholdKernel {
+    DkThresholdKernel(QImage &img, double thr)
+        : img(img)
+        , thr(thr)
+    {
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        // thr is given for 8 bit channels
+        const int t = qBound(-1, (int)std::floor(thr * (L::maxValue / 255)), (int)L::maxValue);
+        const int width = img.width();
+        uchar *bits = img.bits();
+        const int bpl = img.bytesPerLine();
+
+        DkImage::parallelRows(img.height(), [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+                C *ptr = reinterpret_cast<C *>(bits + (size_t)rIdx * bpl);
+
+                for (int cIdx = 0; cIdx < width; cIdx++, ptr += L::channels) {
+                    for (int ch = 0; ch < L::channels; ch++) {
+                        if (ch != L::alpha)
+                            ptr[ch] = (int)ptr[ch] > t ? (C)L::maxValue : (C)0;
+                    }
+                }
+            }
+        });
+    }
+
+    QImage &img;
+    double thr;
+};
+
+struct DkLightnessLuts {
+    quint16 linear[256]; // sRGB -> linear (16 bit)
+    uchar lightness[4096]; // linear luminance (12 bit) -> L* (scaled to [0 255])
+};
+
+static DkLightnessLuts createLightnessLuts()
+{
+    DkLightnessLuts luts;
+
+    for (int idx = 0; idx < 256; idx++) {
+        double i = idx / 255.0;
+        double l = i <= 0.04045 ? i / 12.92 : std::pow((i + 0.055) / 1.055, 2.4);
+        luts.linear[idx] = (quint16)qRound(l * 65535);
+    }
+
+    for (int idx = 0; idx < 4096; idx++) {
+        double y = idx / 4095.0;
+        double l = y > 0.008856 ? 116.0 * std::cbrt(y) - 16.0 : 903.3 * y;
+        luts.lightness[idx] = (uchar)qBound(0, qRound(l * 2.55), 255);
+    }
+
+    return luts;
+}
+
+static const DkLightnessLuts &lightnessLuts()
+{
+    static const DkLightnessLuts luts = createLightnessLuts();
+    return luts;
+}
+
+// writes the lightness (L* of CIELAB) of src to a Grayscale8 image (mapped by map)
+struct DkLightnessKernel {
+    DkLightnessKernel(const QImage &src, QImage &dst, const uchar *map)
+        : src(src)
+        , dst(dst)
+        , map(map)
+    {
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        const int shift = 8 * (sizeof(C) - 1);
+        const DkLightnessLuts &luts = lightnessLuts();
+        const int width = src.width();
+        uchar *dBits = dst.bits();
+        const int dBpl = dst.bytesPerLine();
+
+        DkImage::parallelRows(src.height(), [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+                const C *sPtr = reinterpret_cast<const C *>(src.constScanLine(rIdx));
+                uchar *dPtr = dBits + (size_t)rIdx * dBpl;
+
+                for (int cIdx = 0; cIdx < width; cIdx++, sPtr += L::channels) {
+                    // Rec. 709 luminance weights (they sum up to 65536)
+                    quint32 y = 13933u * luts.linear[sPtr[L::red] >> shift] + 46871u * luts.linear[sPtr[L::green] >> shift]
+                        + 4732u * luts.linear[sPtr[L::blue] >> shift];
+                    dPtr[cIdx] = map[luts.lightness[y >> 20]];
+                }
+            }
+        });
+    }
+
+    const QImage &src;
+    QImage &dst;
+    const uchar *map;
+};
+
+static QImage lightnessImage(const QImage &img, const uchar *map)
+{
+    QImage src = img;
+
+    // e.g. indexed images
+    if (!DkPixelFormat::hasLayout(src.format()))
+        src = src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+    QImage dst(src.size(), QImage::Format_Grayscale8);
+
+    if (dst.isNull())
+        return dst;
+
+    DkLightnessKernel k(src, dst, map);
+    DkPixelFormat::dispatch(src.format(), k);
+
+    dst.setDotsPerMeterX(img.dotsPerMeterX());
+    dst.setDotsPerMeterY(img.dotsPerMeterY());
+
+    return dst;
+}
+
+/**
+ * True if any pixel of img is not opaque.
+ * @param img the image
+ * @return bool false if img has no alpha channel or all pixels are opaque
+ **/
 bool DkImage::alphaChannelUsed(const QImage &img)
 {
-    if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_ARGB32)
+    // formats without alpha channel do not instantiate the kernel
+    DkAlphaUsedKernel k(img);
+
+    if (!img.hasAlphaChannel() || !DkPixelFormat::dispatch(img.format(), k))
         return false;
 
-    // number of used bytes per line
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
-    const uchar *ptr = img.bits();
+    return k.used.loadRelaxed() != 0;
+}
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, ptr++) {
-            if (cIdx % 4 == 3 && *ptr != 255)
-                return true;
-        }
+/**
+ * Converts img to the most compact format that keeps all its information.
+ * Grayscale images are stored with 8 (16) bits, opaque images drop their alpha channel
+ * and 8 bit color images are stored with 3 bytes per pixel.
+ * Small images are kept since drawing 32 bit images is faster.
+ * @param img a decoded image.
+ * @return QImage the compact image (or img if it is compact already).
+ **/
+QImage DkImage::compactFormat(const QImage &img)
+{
+    // ~4 MP: compacting smaller images saves less than it costs
+    if (img.isNull() || (qint64)img.width() * img.height() < 4 * 1024 * 1024 || img.depth() <= 8)
+        return img;
 
-        ptr += pad;
+    const QImage::Format f = img.format();
+
+    // 16 bit grayscale
+    if (f == QImage::Format_RGBX64 || f == QImage::Format_RGBA64 || f == QImage::Format_RGBA64_Premultiplied) {
+        if (!img.hasAlphaChannel() && img.isGrayscale())
+            return img.convertToFormat(QImage::Format_Grayscale16);
+        return img;
     }
 
-    return false;
+    bool opaque = f == QImage::Format_RGB32 || f == QImage::Format_RGBX8888;
+
+    if (!opaque && (f == QImage::Format_ARGB32 || f == QImage::Format_ARGB32_Premultiplied || f == QImage::Format_RGBA8888
+                    || f == QImage::Format_RGBA8888_Premultiplied))
+        opaque = !alphaChannelUsed(img);
+
+    if (!opaque)
+        return img;
+
+    if (img.isGrayscale())
+        return img.convertToFormat(QImage::Format_Grayscale8);
+
+    return img.convertToFormat(QImage::Format_RGB888);
 }
 
 QImage DkImage::thresholdImage(const QImage &img, double thr, bool color)
@@ -231,19 +465,20 @@ QImage DkImage::thresholdImage(const QImage &img, double thr, bool color)
 
     DkTimer dt;
 
-    QImage tImg = color ? img.copy() : grayscaleImage(img);
+    QImage tImg;
 
-    // number of bytes per line used
-    int bpl = (tImg.width() * tImg.depth() + 7) / 8;
-    int pad = tImg.bytesPerLine() - bpl;
+    if (color) {
+        tImg = DkPixelFormat::hasLayout(img.format()) ? img.copy() : img.convertToFormat(QImage::Format_ARGB32);
 
-    uchar *mPtr = tImg.bits();
+        DkThresholdKernel k(tImg, thr);
+        DkPixelFormat::dispatch(tImg.format(), k);
+    } else {
+        // threshold the lightness in the same pass
+        uchar map[256];
+        for (int idx = 0; idx < 256; idx++)
+            map[idx] = idx > thr ? 255 : 0;
 
-    for (int rIdx = 0; rIdx < tImg.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            *mPtr = *mPtr > thr ? 255 : 0;
-        }
-        mPtr += pad;
+        tImg = lightnessImage(img, map);
     }
 
     qDebug() << "thresholding takes: " << dt;
@@ -251,8 +486,19 @@ QImage DkImage::thresholdImage(const QImage &img, double thr, bool color)
     return tImg;
 }
 
+/**
+ * Rotates the image around its center.
+ * Quarter turns are exact pixel remaps that keep the image's format,
+ * other angles are rendered (smoothly) into a transparent RGBA image.
+ * @param img the image
+ * @param angle the angle in degrees
+ * @return QImage the rotated image (img itself if angle is a multiple of 360)
+ **/
 QImage DkImage::rotateImage(const QImage &img, double angle)
 {
+    if (angle == qRound(angle) && qRound(angle) % 90 == 0)
+        return rotateQuarterTurns(img, qRound(angle) / 90);
+
     // compute new image size
     DkVector nSl((float)img.width(), (float)img.height());
     DkVector nSr = nSl;
@@ -290,36 +536,42 @@ QImage DkImage::rotateImage(const QImage &img, double angle)
     return imgR;
 }
 
-QImage DkImage::grayscaleImage(const QImage &img)
+/**
+ * Rotates the image by quarter turns without resampling.
+ * Qt transposes quarter turns in cache friendly tiles (no painter, no interpolation).
+ * @param img the image
+ * @param turns the number of clockwise quarter turns (negative turns rotate counter-clockwise)
+ * @return QImage the rotated image (img itself if there is nothing to rotate)
+ **/
+QImage DkImage::rotateQuarterTurns(const QImage &img, int turns)
 {
-    QImage imgR;
-
-#ifdef WITH_OPENCV
-
-    cv::Mat cvImg = DkImage::qImage2Mat(img);
-    cv::cvtColor(cvImg, cvImg, CV_RGB2Lab);
+    turns = ((turns % 4) + 4) % 4;
 
-    std::vector<cv::Mat> imgs;
-    cv::split(cvImg, imgs);
-
-    // get the luminance channel
-    if (!imgs.empty())
-        cvImg = imgs[0];
+    if (img.isNull() || turns == 0)
+        return img;
 
-    // convert it back for the painter
-    cv::cvtColor(cvImg, cvImg, CV_GRAY2RGB);
+    if (turns == 2)
+        return img.mirrored(true, true);
 
-    imgR = DkImage::mat2QImage(cvImg);
-#else
+    // exact matrices (QTransform::rotate() special-cases quarter turns) take Qt's transpose path
+    QTransform t;
+    t.rotate(turns * 90);
 
-    QVector<QRgb> table(256);
-    for (int i = 0; i < 256; ++i)
-        table[i] = qRgb(i, i, i);
+    return img.transformed(t);
+}
 
-    imgR = img.convertToFormat(QImage::Format_Indexed8, table);
-#endif
+/**
+ * Converts img to its lightness (L* of CIELAB).
+ * @param img the image
+ * @return QImage a Grayscale8 image
+ **/
+QImage DkImage::grayscaleImage(const QImage &img)
+{
+    uchar map[256];
+    for (int idx = 0; idx < 256; idx++)
+        map[idx] = (uchar)idx;
 
-    return imgR;
+    return lightnessImage(img, map);
 }
 
 template<typename numFmt>
@@ -374,595 +626,1606 @@ void DkImage::linearToGamma(QImage &img)
     mapGammaTable(img, gt);
 }
 
-void DkImage::mapGammaTable(QImage &img, const QVector<uchar> &gammaTable)
-{
-    DkTimer dt;
+// resampling --------------------------------------------------------------------
+struct DkResampleLuts {
+    QVector<float> toLinear; // 8 bit -> [0 1]
+    QVector<float> toLinear16; // 16 bit -> [0 1]
+    QVector<uchar> toGamma; // [0 USHRT_MAX] -> 8 bit
+    QVector<unsigned short> toGamma16; // [0 USHRT_MAX] -> 16 bit
+};
 
-    // number of bytes per line used
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
+static DkResampleLuts createResampleLuts(bool linear)
+{
+    QVector<unsigned short> g2l = DkImage::getGamma2LinearTable<unsigned short>();
+    QVector<unsigned short> l2g = DkImage::getLinear2GammaTable<unsigned short>();
 
-    // int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
+    DkResampleLuts luts;
+    luts.toLinear.resize(256);
+    luts.toLinear16.resize(g2l.size());
+    luts.toGamma.resize(l2g.size());
+    luts.toGamma16.resize(l2g.size());
 
-    uchar *mPtr = img.bits();
+    for (int idx = 0; idx < luts.toLinear.size(); idx++)
+        luts.toLinear[idx] = (linear ? g2l[idx * 257] : idx * 257) / (float)USHRT_MAX;
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            if (*mPtr < 0 || *mPtr > gammaTable.size()) {
-                qDebug() << "WRONG VALUE: " << *mPtr;
-                continue;
-            }
-            if ((int)gammaTable[*mPtr] < 0 || (int)gammaTable[*mPtr] > USHRT_MAX) {
-                qDebug() << "WRONG VALUE: " << *mPtr;
-                continue;
-            }
+    for (int idx = 0; idx < luts.toLinear16.size(); idx++)
+        luts.toLinear16[idx] = (linear ? g2l[idx] : idx) / (float)USHRT_MAX;
 
-            *mPtr = gammaTable[*mPtr];
-        }
-        mPtr += pad;
+    for (int idx = 0; idx < luts.toGamma.size(); idx++) {
+        unsigned short g = linear ? l2g[idx] : (unsigned short)idx;
+        luts.toGamma[idx] = (uchar)((g + 128) / 257);
+        luts.toGamma16[idx] = g;
     }
 
-    qDebug() << "gamma computation takes: " << dt;
+    return luts;
 }
 
-QImage DkImage::normImage(const QImage &img)
+/// LUTs that decode to [0 1] floats and encode back - either in linear light or directly on the gamma encoded values
+static const DkResampleLuts &resampleLuts(bool linear)
 {
-    QImage imgN = img.copy();
-    normImage(imgN);
+    static const DkResampleLuts linearLuts = createResampleLuts(true);
+    static const DkResampleLuts gammaLuts = createResampleLuts(false);
 
-    return imgN;
+    return linear ? linearLuts : gammaLuts;
 }
 
-bool DkImage::normImage(QImage &img)
+/// support of the filter kernels in source pixels
+static double resampleSupport(int interpolation)
 {
-    uchar maxVal = 0;
-    uchar minVal = 255;
-
-    // number of used bytes per line
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
-    uchar *mPtr = img.bits();
-    bool hasAlpha = img.hasAlphaChannel() || img.format() == QImage::Format_RGB32;
-
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            if (hasAlpha && cIdx % 4 == 3)
-                continue;
-
-            if (*mPtr > maxVal)
-                maxVal = *mPtr;
-            if (*mPtr < minVal)
-                minVal = *mPtr;
-        }
-
-        mPtr += pad;
-    }
-
-    if ((minVal == 0 && maxVal == 255) || maxVal - minVal == 0)
-        return false;
-
-    uchar *ptr = img.bits();
-
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, ptr++) {
-            if (hasAlpha && cIdx % 4 == 3)
-                continue;
+    if (interpolation == DkImage::ipl_cubic)
+        return 2.0;
+    else if (interpolation == DkImage::ipl_lanczos)
+        return 4.0;
 
-            *ptr = (uchar)qRound(255.0f * (*ptr - minVal) / (maxVal - minVal));
-        }
+    return 1.0;
+}
 
-        ptr += pad;
+static double resampleKernel(int interpolation, double t)
+{
+    t = std::abs(t);
+
+    if (interpolation == DkImage::ipl_cubic) {
+        // Keys (a = -0.5)
+        if (t < 1.0)
+            return (1.5 * t - 2.5) * t * t + 1.0;
+        if (t < 2.0)
+            return ((-0.5 * t + 2.5) * t - 4.0) * t + 2.0;
+        return 0.0;
+    } else if (interpolation == DkImage::ipl_lanczos) {
+        if (t < 1e-8)
+            return 1.0;
+        if (t >= 4.0)
+            return 0.0;
+        double x = t * CV_PI;
+        return 4.0 * std::sin(x) * std::sin(x / 4.0) / (x * x);
     }
 
-    return true;
+    return t < 1.0 ? 1.0 - t : 0.0;
 }
 
-QImage DkImage::autoAdjustImage(const QImage &img)
+/**
+ * Resizes img in linear light.
+ * Pixels are decoded with an 8 bit -> float LUT, filtered separably
+ * (kernels are widened when downsampling) and encoded with a 16 bit LUT.
+ * 16 bit images are decoded with a 16 bit LUT and keep their bit depth.
+ * Output rows are processed in chunks so that only a few
+ * horizontally filtered rows are kept per thread.
+ * @param img the image to resize (converted to (A)RGB32 or RGBA64)
+ * @param size the new size
+ * @param interpolation the interpolation method (area, linear, cubic or lanczos)
+ * @return QImage the resized image
+ **/
+QImage DkImage::resizeLinear(const QImage &img, const QSize &size, int interpolation)
 {
-    QImage imgA = img.copy();
-    autoAdjustImage(imgA);
+    QImage src = img;
 
-    return imgA;
-}
+    const bool deep = DkImageHistogram::isHighBitDepth(img);
 
-bool DkImage::autoAdjustImage(QImage &img)
-{
-    // return DkImage::unsharpMask(img, 30.0f, 1.5f);
+    if (deep && src.format() != QImage::Format_RGBX64 && src.format() != QImage::Format_RGBA64)
+        src = src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_RGBA64 : QImage::Format_RGBX64);
+    else if (!deep)
+        toRgb32(src);
+
+    if (src.isNull() || size.isEmpty())
+        return QImage();
 
     DkTimer dt;
-    qDebug() << "[Auto Adjust] image format: " << img.format();
 
-    // for grayscale image - normalize is the same
-    if (img.format() <= QImage::Format_Indexed8) {
-        qDebug() << "[Auto Adjust] Grayscale - switching to Normalize: " << img.format();
-        return normImage(img);
-    } else if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32
-               && img.format() != QImage::Format_RGB888) {
-        qDebug() << "[Auto Adjust] Format not supported: " << img.format();
-        return false;
-    }
+    const DkResampleLuts &luts = resampleLuts(true);
+    const QVector<float> &toLinear = luts.toLinear;
+    const QVector<uchar> &toGamma = luts.toGamma;
+    const QVector<float> &toLinear16 = luts.toLinear16;
+    const QVector<unsigned short> &toGamma16 = luts.toGamma16;
+
+    // filter kernels with their support (in source pixels)
+    const double support = resampleSupport(interpolation);
+
+    auto kernel = [interpolation](double t) -> double {
+        return resampleKernel(interpolation, t);
+    };
+
+    // taps & weights for each output pixel of one dimension
+    struct DkFilterTaps {
+        int taps = 0;
+        QVector<int> idx;
+        QVector<float> w;
+    };
+
+    auto computeTaps = [&](int srcSize, int dstSize) -> DkFilterTaps {
+        double scale = (double)dstSize / srcSize;
+        double fs = scale < 1.0 ? 1.0 / scale : 1.0;
+        bool area = interpolation == ipl_area && scale < 1.0;
+
+        DkFilterTaps ft;
+        ft.taps = area ? qCeil(fs) + 1 : qCeil(2.0 * support * fs) + 1;
+        ft.idx.resize(dstSize * ft.taps);
+        ft.w.resize(dstSize * ft.taps);
+
+        for (int dIdx = 0; dIdx < dstSize; dIdx++) {
+            double center = (dIdx + 0.5) / scale - 0.5;
+            double x0 = dIdx / scale;
+            double x1 = (dIdx + 1) / scale;
+            int first = area ? qFloor(x0) : qFloor(center - support * fs) + 1;
+            double sum = 0.0;
+
+            for (int tIdx = 0; tIdx < ft.taps; tIdx++) {
+                int sIdx = first + tIdx;
+
+                // area: overlap of the source pixel with the footprint of the target pixel
+                double w = area ? qMax(0.0, qMin(sIdx + 1.0, x1) - qMax((double)sIdx, x0)) : kernel((sIdx - center) / fs);
+
+                ft.idx[dIdx * ft.taps + tIdx] = qBound(0, sIdx, srcSize - 1);
+                ft.w[dIdx * ft.taps + tIdx] = (float)w;
+                sum += w;
+            }
 
-    int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
+            for (int tIdx = 0; sum != 0.0 && tIdx < ft.taps; tIdx++)
+                ft.w[dIdx * ft.taps + tIdx] = (float)(ft.w[dIdx * ft.taps + tIdx] / sum);
+        }
 
-    uchar maxR = 0, maxG = 0, maxB = 0;
-    uchar minR = 255, minG = 255, minB = 255;
+        return ft;
+    };
 
-    // number of bytes per line used
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
+    const DkFilterTaps hTaps = computeTaps(src.width(), size.width());
+    const DkFilterTaps vTaps = computeTaps(src.height(), size.height());
 
-    uchar *mPtr = img.bits();
-    uchar r, g, b;
+    const bool alpha = src.hasAlphaChannel();
+    QImage dst;
 
-    int histR[256] = {0};
-    int histG[256] = {0};
-    int histB[256] = {0};
+    if (deep)
+        dst = QImage(size, alpha ? QImage::Format_RGBA64 : QImage::Format_RGBX64);
+    else
+        dst = QImage(size, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl;) {
-            r = *mPtr;
-            mPtr++;
-            g = *mPtr;
-            mPtr++;
-            b = *mPtr;
-            mPtr++;
-            cIdx += 3;
-
-            if (r > maxR)
-                maxR = r;
-            if (r < minR)
-                minR = r;
-
-            if (g > maxG)
-                maxG = g;
-            if (g < minG)
-                minG = g;
-
-            if (b > maxB)
-                maxB = b;
-            if (b < minB)
-                minB = b;
-
-            histR[r]++;
-            histG[g]++;
-            histB[b]++;
-
-            // ?? strange but I would expect the alpha channel to be the first (big endian?)
-            if (channels == 4) {
-                mPtr++;
-                cIdx++;
+    if (dst.isNull())
+        return QImage();
+
+    const int sw = src.width();
+    const int dw = dst.width();
+    const int chunkSize = 64; // output rows
+
+    uchar *dBits = dst.bits();
+    const int dBpl = dst.bytesPerLine();
+
+    parallelRows(dst.height(), [&](int firstRow, int lastRow) {
+        // the temporaries are reused by subsequent calls of this thread
+        DkScratch scratch;
+        float *line = scratch.alloc<float>((size_t)sw * 4);
+        float *acc = scratch.alloc<float>((size_t)dw * 4);
+        float *rows = 0;
+        size_t rowsSize = 0;
+
+        if (!line || !acc)
+            return;
+
+        for (int cIdx = firstRow; cIdx < lastRow; cIdx += chunkSize) {
+            int cEnd = qMin(cIdx + chunkSize, lastRow);
+
+            // source rows needed for this chunk
+            int r0 = src.height();
+            int r1 = -1;
+            for (int tIdx = cIdx * vTaps.taps; tIdx < cEnd * vTaps.taps; tIdx++) {
+                r0 = qMin(r0, vTaps.idx[tIdx]);
+                r1 = qMax(r1, vTaps.idx[tIdx]);
             }
-        }
-        mPtr += pad;
-    }
 
-    QColor ignoreChannel;
-    bool ignoreR = maxR - minR == 0 || maxR - minR == 255;
-    bool ignoreG = maxR - minR == 0 || maxG - minG == 255;
-    bool ignoreB = maxR - minR == 0 || maxB - minB == 255;
+            // every row is filled by the horizontal pass below
+            size_t numRows = (size_t)(r1 - r0 + 1) * dw * 4;
 
-    uchar *ptr = img.bits();
+            if (numRows > rowsSize) {
+                rows = scratch.alloc<float>(numRows);
+                rowsSize = numRows;
+            }
 
-    if (ignoreR) {
-        maxR = findHistPeak(histR);
-        ignoreR = maxR - minR == 0 || maxR - minR == 255;
-    }
-    if (ignoreG) {
-        maxG = findHistPeak(histG);
-        ignoreG = maxG - minG == 0 || maxG - minG == 255;
-    }
-    if (ignoreB) {
-        maxB = findHistPeak(histB);
-        ignoreB = maxB - minB == 0 || maxB - minB == 255;
-    }
+            if (!rows)
+                return;
 
-    // qDebug() << "red max: " << maxR << " min: " << minR << " ignored: " << ignoreR;
-    // qDebug() << "green max: " << maxG << " min: " << minG << " ignored: " << ignoreG;
-    // qDebug() << "blue max: " << maxB << " min: " << minB << " ignored: " << ignoreB;
-    // qDebug() << "computed in: " << dt;
+            // decode & filter horizontally
+            for (int rIdx = r0; rIdx <= r1; rIdx++) {
+                const QRgb *sPtr = reinterpret_cast<const QRgb *>(src.constScanLine(rIdx));
+                const QRgba64 *sPtr16 = reinterpret_cast<const QRgba64 *>(src.constScanLine(rIdx));
 
-    if (ignoreR && ignoreG && ignoreB) {
-        qDebug() << "[Auto Adjust] There is no need to adjust the image";
-        return false;
-    }
+                for (int x = 0; deep && x < sw; x++) {
+                    QRgba64 px = sPtr16[x];
+                    float a = alpha ? px.alpha() / 65535.0f : 1.0f;
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl;) {
-            // don't check values - speed (but you see under-/overflows anyway)
-            if (!ignoreR && *ptr < maxR)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minR) / (maxR - minR));
-            else if (!ignoreR)
-                *ptr = 255;
+                    line[x * 4] = toLinear16[px.red()] * a;
+                    line[x * 4 + 1] = toLinear16[px.green()] * a;
+                    line[x * 4 + 2] = toLinear16[px.blue()] * a;
+                    line[x * 4 + 3] = a;
+                }
 
-            ptr++;
-            cIdx++;
+                for (int x = 0; !deep && x < sw; x++) {
+                    QRgb px = sPtr[x];
+                    float a = alpha ? qAlpha(px) / 255.0f : 1.0f;
 
-            if (!ignoreG && *ptr < maxG)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minG) / (maxG - minG));
-            else if (!ignoreG)
-                *ptr = 255;
+                    // premultiply - otherwise transparent pixels bleed their color
+                    line[x * 4] = toLinear[qRed(px)] * a;
+                    line[x * 4 + 1] = toLinear[qGreen(px)] * a;
+                    line[x * 4 + 2] = toLinear[qBlue(px)] * a;
+                    line[x * 4 + 3] = a;
+                }
 
-            ptr++;
-            cIdx++;
+                float *rPtr = &rows[(size_t)(rIdx - r0) * dw * 4];
 
-            if (!ignoreB && *ptr < maxB)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minB) / (maxB - minB));
-            else if (!ignoreB)
-                *ptr = 255;
-            ptr++;
-            cIdx++;
+                for (int x = 0; x < dw; x++) {
+                    float v[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
-            if (channels == 4) {
-                ptr++;
-                cIdx++;
+                    for (int tIdx = x * hTaps.taps; tIdx < (x + 1) * hTaps.taps; tIdx++) {
+                        const float *lPtr = &line[hTaps.idx[tIdx] * 4];
+                        float w = hTaps.w[tIdx];
+                        v[0] += w * lPtr[0];
+                        v[1] += w * lPtr[1];
+                        v[2] += w * lPtr[2];
+                        v[3] += w * lPtr[3];
+                    }
+
+                    rPtr[x * 4] = v[0];
+                    rPtr[x * 4 + 1] = v[1];
+                    rPtr[x * 4 + 2] = v[2];
+                    rPtr[x * 4 + 3] = v[3];
+                }
             }
-        }
-        ptr += pad;
-    }
 
-    qDebug() << "[Auto Adjust] image adjusted in: " << dt;
+            // filter vertically & encode
+            for (int y = cIdx; y < cEnd; y++) {
+                std::fill(acc, acc + (size_t)dw * 4, 0.0f);
 
-    return true;
-}
+                for (int tIdx = y * vTaps.taps; tIdx < (y + 1) * vTaps.taps; tIdx++) {
+                    float w = vTaps.w[tIdx];
 
-uchar DkImage::findHistPeak(const int *hist, float quantile)
-{
-    int histArea = 0;
+                    if (w == 0.0f)
+                        continue;
 
-    for (int idx = 0; idx < 256; idx++)
-        histArea += hist[idx];
+                    const float *rPtr = &rows[(size_t)(vTaps.idx[tIdx] - r0) * dw * 4];
 
-    int sumBins = 0;
+                    for (int x = 0; x < dw * 4; x++)
+                        acc[x] += w * rPtr[x];
+                }
 
-    for (int idx = 255; idx >= 0; idx--) {
-        sumBins += hist[idx];
+                if (deep) {
+                    QRgba64 *dPtr = reinterpret_cast<QRgba64 *>(dBits + (size_t)y * dBpl);
 
-        if (sumBins / (float)histArea > quantile) {
-            qDebug() << "max bin: " << idx;
-            return (uchar)idx;
-        }
-    }
+                    for (int x = 0; x < dw; x++) {
+                        float a = qBound(0.0f, acc[x * 4 + 3], 1.0f);
+                        float na = alpha && a > 0.0f ? 1.0f / a : 1.0f;
 
-    qDebug() << "no max bin found... sum: " << sumBins;
+                        quint16 r = toGamma16[(int)(qBound(0.0f, acc[x * 4] * na, 1.0f) * USHRT_MAX + 0.5f)];
+                        quint16 g = toGamma16[(int)(qBound(0.0f, acc[x * 4 + 1] * na, 1.0f) * USHRT_MAX + 0.5f)];
+                        quint16 b = toGamma16[(int)(qBound(0.0f, acc[x * 4 + 2] * na, 1.0f) * USHRT_MAX + 0.5f)];
 
-    return 255;
-}
+                        dPtr[x] = qRgba64(r, g, b, alpha ? (quint16)qRound(a * 65535.0f) : 65535);
+                    }
 
-QPixmap DkImage::makeSquare(const QPixmap &pm)
-{
-    QRect r(QPoint(), pm.size());
+                    continue;
+                }
 
-    if (r.width() > r.height()) {
-        r.setX(qFloor((r.width() - r.height()) * 0.5f));
-        r.setWidth(r.height());
-    } else {
-        r.setY(qFloor((r.height() - r.width()) * 0.5f));
-        r.setHeight(r.width());
-    }
+                QRgb *dPtr = reinterpret_cast<QRgb *>(dBits + (size_t)y * dBpl);
 
-    return pm.copy(r);
+                for (int x = 0; x < dw; x++) {
+                    float a = qBound(0.0f, acc[x * 4 + 3], 1.0f);
+                    float na = alpha && a > 0.0f ? 1.0f / a : 1.0f;
+
+                    int r = toGamma[(int)(qBound(0.0f, acc[x * 4] * na, 1.0f) * USHRT_MAX + 0.5f)];
+                    int g = toGamma[(int)(qBound(0.0f, acc[x * 4 + 1] * na, 1.0f) * USHRT_MAX + 0.5f)];
+                    int b = toGamma[(int)(qBound(0.0f, acc[x * 4 + 2] * na, 1.0f) * USHRT_MAX + 0.5f)];
+
+                    dPtr[x] = qRgba(r, g, b, alpha ? qRound(a * 255.0f) : 255);
+                }
+            }
+        }
+    });
+
+    qDebug() << "[DkImage] linear light resize" << src.size() << "->" << size << "in" << dt;
+
+    if (img.format() == QImage::Format_Grayscale16)
+        return dst.convertToFormat(QImage::Format_Grayscale16);
+
+    return dst;
 }
 
-QPixmap DkImage::merge(const QVector<QImage> &imgs)
+/**
+ * Maps img with the affine transformation t to a new image.
+ * Each target pixel is resampled once - so cropping, resizing and rotating
+ * can be combined without accumulating the blur of several passes.
+ * If t only scales, translates and turns by multiples of 90°, the covered
+ * source rectangle is resized separably and turned losslessly.
+ * Otherwise, the target pixels are mapped back and filtered in the source (see warpImage).
+ * @param img the source image
+ * @param t the transformation from source to target coordinates
+ * @param size the size of the target image
+ * @param interpolation the interpolation method
+ * @param correctGamma if true, pixels are mixed in linear light
+ * @return QImage the transformed image - pixels that are not covered by img are transparent
+ **/
+QImage DkImage::transformImage(const QImage &img, const QTransform &t, const QSize &size, int interpolation, bool correctGamma)
 {
-    if (imgs.size() > 10) {
-        qWarning() << "DkImage::merge is built for a small amount of images, you gave me: " << imgs.size();
+    if (img.isNull() || size.isEmpty() || !t.isAffine() || !t.isInvertible())
+        return QImage();
+
+    if (t.isIdentity() && img.size() == size)
+        return img;
+
+    // quarter turns of t (-1 if it rotates by other angles or mirrors)
+    const double eps = 1e-9 * qMax(qAbs(t.m11()) + qAbs(t.m12()), qAbs(t.m21()) + qAbs(t.m22()));
+    int turns = -1;
+
+    if (qAbs(t.m12()) <= eps && qAbs(t.m21()) <= eps) {
+        if (t.m11() > 0 && t.m22() > 0)
+            turns = 0;
+        else if (t.m11() < 0 && t.m22() < 0)
+            turns = 2;
+    } else if (qAbs(t.m11()) <= eps && qAbs(t.m22()) <= eps) {
+        if (t.m12() > 0 && t.m21() < 0)
+            turns = 1;
+        else if (t.m12() < 0 && t.m21() > 0)
+            turns = 3;
     }
 
-    QPixmap pm;
-    int margin = 10;
-    int x = 0;
-    QPainter p;
+    if (turns < 0)
+        return warpImage(img, t, size, interpolation, correctGamma);
 
-    for (const QImage &img : imgs) {
-        // init on first
-        if (pm.isNull()) {
-            pm = QPixmap(img.height() * imgs.size() + margin * (imgs.size() - 1), img.height());
-            pm.fill(QColor(0, 0, 0, 0));
+    // source rectangle covered by the target
+    QRectF sr = t.inverted().mapRect(QRectF(QPointF(), QSizeF(size)));
+    QRect r(QPoint(qRound(sr.left()), qRound(sr.top())), QPoint(qRound(sr.right()) - 1, qRound(sr.bottom()) - 1));
 
-            p.begin(&pm);
-        }
+    if (r.isEmpty())
+        return QImage();
 
-        QPixmap cpm = DkImage::makeSquare(QPixmap::fromImage(img));
-        QRect r(QPoint(x, 0), QSize(pm.height(), pm.height()));
-        p.drawPixmap(r, cpm);
-        x += r.width() + margin;
-    }
+    QImage cImg = r == img.rect() ? img : img.copy(r);
+    QImage rImg = resizeImage(cImg, turns % 2 ? size.transposed() : size, 1.0, interpolation, correctGamma);
 
-    return pm;
+    return rotateQuarterTurns(rImg, turns);
 }
 
-QImage DkImage::cropToImage(const QImage &src, const DkRotatingRect &rect, const QColor &fillColor)
+/**
+ * Maps img with an arbitrary affine transformation.
+ * Every target pixel center is mapped back to the source where the
+ * kernel (widened by the footprint of the target pixel) is evaluated.
+ * Area interpolation is approximated by the widened linear kernel.
+ * @param img the image to transform (converted to (A)RGB32 or RGBA64)
+ * @param t the transformation from source to target coordinates
+ * @param size the size of the target image
+ * @param interpolation the interpolation method
+ * @param correctGamma if true, pixels are mixed in linear light
+ * @return QImage the warped image
+ **/
+QImage DkImage::warpImage(const QImage &img, const QTransform &t, const QSize &size, int interpolation, bool correctGamma)
 {
-    QTransform tForm;
-    QPointF cImgSize;
-    rect.getTransform(tForm, cImgSize);
+    QImage src = img;
 
-    // illegal?
-    if (cImgSize.x() < 0.5f || cImgSize.y() < 0.5f)
-        return src;
+    const bool deep = DkImageHistogram::isHighBitDepth(img);
 
-    double angle = DkMath::normAngleRad(rect.getAngle(), 0, CV_PI * 0.5);
-    double minD = qMin(std::abs(angle), std::abs(angle - CV_PI * 0.5));
+    if (deep && src.format() != QImage::Format_RGBX64 && src.format() != QImage::Format_RGBA64)
+        src = src.convertToFormat(src.hasAlphaChannel() ? QImage::Format_RGBA64 : QImage::Format_RGBX64);
+    else if (!deep)
+        toRgb32(src);
 
-    QImage img = QImage(qRound(cImgSize.x()), qRound(cImgSize.y()), QImage::Format_ARGB32);
-    img.fill(fillColor.rgba());
+    bool invertible = false;
+    const QTransform ti = t.inverted(&invertible);
 
-    // render the image into the new coordinate system
-    QPainter painter(&img);
-    painter.setWorldTransform(tForm);
+    if (src.isNull() || size.isEmpty() || !invertible)
+        return QImage();
 
-    // for rotated rects we want perfect anti-aliasing
-    if (minD > FLT_EPSILON)
-        painter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
+    DkTimer dt;
 
-    painter.drawImage(QRect(QPoint(), src.size()), src, QRect(QPoint(), src.size()));
-    painter.end();
+    const bool nearest = interpolation == ipl_nearest;
+    const DkResampleLuts &luts = resampleLuts(correctGamma && !nearest);
 
-    return img;
-}
+    // the footprint of a target pixel in the source
+    const double fx = qMax(1.0, std::hypot(ti.m11(), ti.m21()));
+    const double fy = qMax(1.0, std::hypot(ti.m12(), ti.m22()));
+    const double rx = resampleSupport(interpolation) * fx;
+    const double ry = resampleSupport(interpolation) * fy;
+    const int tx = qCeil(2.0 * rx) + 1;
+    const int ty = qCeil(2.0 * ry) + 1;
 
-QImage DkImage::hueSaturation(const QImage &src, int hue, int sat, int brightness)
-{
-    // nothing to do?
-    if (hue == 0 && sat == 0 && brightness == 0)
-        return src;
+    const int sw = src.width();
+    const int sh = src.height();
 
-    QImage imgR;
+    // border pixels are extended if the target lies within the source
+    const bool covered = QRectF(src.rect()).contains(ti.mapRect(QRectF(QPointF(), QSizeF(size))));
+    const bool srcAlpha = src.hasAlphaChannel();
+    const bool alpha = srcAlpha || !covered;
 
-#ifdef WITH_OPENCV
+    QImage dst;
 
-    // normalize brightness/saturation
-    int brightnessN = qRound(brightness / 100.0 * 255.0);
-    double satN = sat / 100.0 + 1.0;
-
-    cv::Mat hsvImg = DkImage::qImage2Mat(src);
-
-    if (hsvImg.channels() > 3)
-        cv::cvtColor(hsvImg, hsvImg, CV_RGBA2BGR);
-
-    cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
-
-    // apply hue/saturation changes
-    for (int rIdx = 0; rIdx < hsvImg.rows; rIdx++) {
-        unsigned char *iPtr = hsvImg.ptr<unsigned char>(rIdx);
-
-        for (int cIdx = 0; cIdx < hsvImg.cols * 3; cIdx += 3) {
-            // adopt hue
-            int h = iPtr[cIdx] + hue;
-            if (h < 0)
-                h += 180;
-            if (h >= 180)
-                h -= 180;
-
-            iPtr[cIdx] = (unsigned char)h;
-
-            // adopt value
-            int v = iPtr[cIdx + 2] + brightnessN;
-            if (v < 0)
-                v = 0;
-            if (v > 255)
-                v = 255;
-            iPtr[cIdx + 2] = (unsigned char)v;
-
-            // adopt saturation
-            int s = qRound(iPtr[cIdx + 1] * satN);
-            if (s < 0)
-                s = 0;
-            if (s > 255)
-                s = 255;
-            iPtr[cIdx + 1] = (unsigned char)s;
-        }
-    }
+    if (deep)
+        dst = QImage(size, alpha ? QImage::Format_RGBA64 : QImage::Format_RGBX64);
+    else
+        dst = QImage(size, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
 
-    cv::cvtColor(hsvImg, hsvImg, CV_HSV2BGR);
-    imgR = DkImage::mat2QImage(hsvImg);
+    if (dst.isNull())
+        return QImage();
 
-#endif // WITH_OPENCV
+    uchar *dBits = dst.bits();
+    const int dBpl = dst.bytesPerLine();
 
-    return imgR;
-}
+    parallelRows(dst.height(), [&](int firstRow, int lastRow) {
+        DkScratch scratch;
+        float *wx = scratch.alloc<float>(tx);
+        float *wy = scratch.alloc<float>(ty);
 
-QImage DkImage::exposure(const QImage &src, double exposure, double offset, double gamma)
-{
-    if (exposure == 0.0 && offset == 0.0 && gamma == 1.0)
-        return src;
+        if (!wx || !wy)
+            return;
 
-    QImage imgR;
-#ifdef WITH_OPENCV
+        for (int y = firstRow; y < lastRow; y++) {
+            QRgb *dPtr = reinterpret_cast<QRgb *>(dBits + (size_t)y * dBpl);
+            QRgba64 *dPtr16 = reinterpret_cast<QRgba64 *>(dBits + (size_t)y * dBpl);
 
-    cv::Mat rgbImg = DkImage::qImage2Mat(src);
-    rgbImg.convertTo(rgbImg, CV_16U, 256, offset * std::numeric_limits<unsigned short>::max());
+            for (int x = 0; x < dst.width(); x++) {
+                // target pixel center in source pixel coordinates
+                QPointF p = ti.map(QPointF(x + 0.5, y + 0.5));
 
-    if (rgbImg.channels() > 3)
-        cv::cvtColor(rgbImg, rgbImg, CV_RGBA2BGR);
+                if (nearest) {
+                    int sx = qFloor(p.x());
+                    int sy = qFloor(p.y());
 
-    if (exposure != 0.0)
-        rgbImg = exposureMat(rgbImg, exposure);
+                    if (!covered && (sx < 0 || sy < 0 || sx >= sw || sy >= sh)) {
+                        if (deep)
+                            dPtr16[x] = qRgba64(0, 0, 0, 0);
+                        else
+                            dPtr[x] = 0;
+                        continue;
+                    }
 
-    if (gamma != 1.0)
-        rgbImg = gammaMat(rgbImg, gamma);
+                    sx = qBound(0, sx, sw - 1);
+                    sy = qBound(0, sy, sh - 1);
 
-    rgbImg.convertTo(rgbImg, CV_8U, 1.0 / 256.0);
-    imgR = DkImage::mat2QImage(rgbImg);
+                    if (deep)
+                        dPtr16[x] = reinterpret_cast<const QRgba64 *>(src.constScanLine(sy))[sx];
+                    else
+                        dPtr[x] = reinterpret_cast<const QRgb *>(src.constScanLine(sy))[sx];
+                    continue;
+                }
 
-#endif // WITH_OPENCV
+                double u = p.x() - 0.5;
+                double v = p.y() - 0.5;
 
-    return imgR;
-}
+                if (!covered && (u < -rx - 1 || v < -ry - 1 || u > sw + rx || v > sh + ry)) {
+                    if (deep)
+                        dPtr16[x] = qRgba64(0, 0, 0, 0);
+                    else
+                        dPtr[x] = 0;
+                    continue;
+                }
 
-QImage DkImage::bgColor(const QImage &src, const QColor &col)
-{
-    QImage dst(src.size(), QImage::Format_RGB32);
-    dst.fill(col);
+                int x0 = qFloor(u - rx) + 1;
+                int y0 = qFloor(v - ry) + 1;
+                float sumX = 0.0f;
+                float sumY = 0.0f;
 
-    QPainter p(&dst);
-    p.drawImage(QPoint(0, 0), src);
+                for (int tIdx = 0; tIdx < tx; tIdx++) {
+                    wx[tIdx] = (float)resampleKernel(interpolation, (x0 + tIdx - u) / fx);
+                    sumX += wx[tIdx];
+                }
 
-    return dst;
-}
+                for (int tIdx = 0; tIdx < ty; tIdx++) {
+                    wy[tIdx] = (float)resampleKernel(interpolation, (y0 + tIdx - v) / fy);
+                    sumY += wy[tIdx];
+                }
 
-QByteArray DkImage::extractImageFromDataStream(const QByteArray &ba, const QByteArray &beginSignature, const QByteArray &endSignature, bool debugOutput)
-{
-    int bIdx = ba.indexOf(beginSignature);
+                // samples outside the source count as transparent
+                float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+                for (int yIdx = 0; yIdx < ty; yIdx++) {
+                    int sy = y0 + yIdx;
+
+                    if (wy[yIdx] == 0.0f || (!covered && (sy < 0 || sy >= sh)))
+                        continue;
+
+                    sy = qBound(0, sy, sh - 1);
+                    const QRgb *sPtr = reinterpret_cast<const QRgb *>(src.constScanLine(sy));
+                    const QRgba64 *sPtr16 = reinterpret_cast<const QRgba64 *>(src.constScanLine(sy));
+
+                    for (int xIdx = 0; xIdx < tx; xIdx++) {
+                        int sx = x0 + xIdx;
+
+                        if (!covered && (sx < 0 || sx >= sw))
+                            continue;
+
+                        sx = qBound(0, sx, sw - 1);
+                        float w = wy[yIdx] * wx[xIdx];
+
+                        // premultiply - otherwise transparent pixels bleed their color
+                        if (deep) {
+                            QRgba64 px = sPtr16[sx];
+                            float a = srcAlpha ? px.alpha() / 65535.0f : 1.0f;
+                            acc[0] += w * luts.toLinear16[px.red()] * a;
+                            acc[1] += w * luts.toLinear16[px.green()] * a;
+                            acc[2] += w * luts.toLinear16[px.blue()] * a;
+                            acc[3] += w * a;
+                        } else {
+                            QRgb px = sPtr[sx];
+                            float a = qAlpha(px) / 255.0f;
+                            acc[0] += w * luts.toLinear[qRed(px)] * a;
+                            acc[1] += w * luts.toLinear[qGreen(px)] * a;
+                            acc[2] += w * luts.toLinear[qBlue(px)] * a;
+                            acc[3] += w * a;
+                        }
+                    }
+                }
 
-    if (bIdx == -1) {
-        qDebug() << "[ExtractImage] could not locate" << beginSignature;
-        return QByteArray();
-    }
+                float sum = sumX * sumY;
+                float a = sum != 0.0f ? qBound(0.0f, acc[3] / sum, 1.0f) : 0.0f;
+                float na = a > 0.0f ? 1.0f / (a * sum) : 0.0f;
 
-    int eIdx = ba.indexOf(endSignature, bIdx);
+                int r = (int)(qBound(0.0f, acc[0] * na, 1.0f) * USHRT_MAX + 0.5f);
+                int g = (int)(qBound(0.0f, acc[1] * na, 1.0f) * USHRT_MAX + 0.5f);
+                int b = (int)(qBound(0.0f, acc[2] * na, 1.0f) * USHRT_MAX + 0.5f);
 
-    if (eIdx == -1) {
-        qDebug() << "[ExtractImage] could not locate" << endSignature;
-        return QByteArray();
-    }
+                if (deep)
+                    dPtr16[x] = qRgba64(luts.toGamma16[r], luts.toGamma16[g], luts.toGamma16[b], alpha ? (quint16)qRound(a * 65535.0f) : 65535);
+                else
+                    dPtr[x] = qRgba(luts.toGamma[r], luts.toGamma[g], luts.toGamma[b], alpha ? qRound(a * 255.0f) : 255);
+            }
+        }
+    });
 
-    QByteArray bac = ba.mid(bIdx, eIdx + endSignature.size() - bIdx);
+    qDebug() << "[DkImage] warped" << src.size() << "->" << size << "in" << dt;
 
-    if (debugOutput) {
-        qDebug() << "extracting image from stream...";
-        qDebug() << "cropping: [" << bIdx << eIdx << "]";
-        qDebug() << "original size: " << ba.size() / 1024.0 << "KB"
-                 << "new size: " << bac.size() / 1024.0 << "KB"
-                 << "difference:" << (ba.size() - bac.size()) / 1024 << "KB";
-    }
+    if (img.format() == QImage::Format_Grayscale16 && !alpha)
+        return dst.convertToFormat(QImage::Format_Grayscale16);
 
-    return bac;
+    return dst;
 }
 
-QByteArray DkImage::fixSamsungPanorama(QByteArray &ba)
-{
-    // this code is based on python code from bcyrill
-    // see: https://gist.github.com/bcyrill/e59fda6c7ffe23c7c4b08a990804b269
-    // it fixes SAMSUNG panorama images that are not standard conformant by adding an EOI marker to the QByteArray
-    // see also: https://github.com/nomacs/nomacs/issues/254
-
-    if (ba.size() < 8)
-        return QByteArray();
+// maps the color channels (alpha is kept)
+struct DkGammaKernel {
+    DkGammaKernel(QImage &img, const uchar *table)
+        : img(img)
+        , table(table)
+    {
+    }
 
-    QByteArray trailer = ba.right(4);
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
 
-    // is it a samsung panorama jpg?
-    if (trailer != QByteArray("SEFT"))
-        return QByteArray();
+        const int width = img.width();
+        uchar *bits = img.bits();
+        const int bpl = img.bytesPerLine();
 
-    // TODO saveify:
-    int sefhPos = intFromByteArray(ba, ba.size() - 8) + 8;
-    trailer = ba.right(sefhPos);
+        DkImage::parallelRows(img.height(), [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+                C *ptr = reinterpret_cast<C *>(bits + (size_t)rIdx * bpl);
 
-    // trailer starts with "SEFH"?
-    if (trailer.left(4) != QByteArray("SEFH"))
-        return QByteArray();
+                for (int cIdx = 0; cIdx < width; cIdx++, ptr += L::channels) {
+                    for (int ch = 0; ch < L::channels; ch++) {
+                        if (ch != L::alpha)
+                            ptr[ch] = map(ptr[ch]);
+                    }
+                }
+            }
+        });
+    }
 
-    int endPos = ba.size();
-    int dirPos = endPos - sefhPos;
+    inline uchar map(uchar v) const
+    {
+        return table[v];
+    }
 
-    int count = intFromByteArray(trailer, 8);
+    // interpolates the 8 bit table
+    inline quint16 map(quint16 v) const
+    {
+        int idx = v >> 8;
+        int lo = table[idx];
+        int hi = table[qMin(idx + 1, 255)];
+        int v256 = lo * 256 + (hi - lo) * (v & 0xff);
 
-    int firstBlock = 0;
-    bool isPano = false;
+        return (quint16)(v256 + (v256 >> 8));
+    }
 
-    for (int idx = 0; idx < count; idx++) {
-        int e = 12 + 12 * idx;
+    QImage &img;
+    const uchar *table;
+};
 
-        int noff = intFromByteArray(trailer, e + 4);
-        int size = intFromByteArray(trailer, e + 8);
+void DkImage::mapGammaTable(QImage &img, const QVector<uchar> &gammaTable)
+{
+    if (gammaTable.size() < 256) {
+        qWarning() << "[DkImage] gamma table with" << gammaTable.size() << "entries ignored";
+        return;
+    }
 
-        if (firstBlock < noff)
-            firstBlock = noff;
+    DkTimer dt;
 
-        QByteArray cdata = ba.mid(dirPos - noff, size);
+    // map the palette
+    if (img.format() == QImage::Format_Indexed8) {
+        QVector<QRgb> ct = img.colorTable();
 
-        int eoff = intFromByteArray(cdata, 4);
-        QString pi = cdata.mid(8, eoff);
+        for (QRgb &c : ct)
+            c = qRgba(gammaTable[qRed(c)], gammaTable[qGreen(c)], gammaTable[qBlue(c)], qAlpha(c));
 
-        if (pi == "Panorama_Shot_Info")
-            isPano = true;
+        img.setColorTable(ct);
+        return;
     }
 
-    if (!isPano)
-        return QByteArray();
-
-    int dataPos = dirPos - firstBlock;
+    if (!DkPixelFormat::hasLayout(img.format()))
+        img = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
 
-    // ok, append the missing marker
-    QByteArray nb;
-    nb.append(ba.left(dataPos));
-    nb.append(QByteArray("\xff\xd9"));
-    nb.append(ba.right(dataPos));
-    qDebug() << "SAMSUNG panorma fix: EOI marker injected";
+    DkGammaKernel k(img, gammaTable.constData());
+    DkPixelFormat::dispatch(img.format(), k);
 
-    return nb;
+    qDebug() << "gamma computation takes: " << dt;
 }
 
-int DkImage::intFromByteArray(const QByteArray &ba, int pos)
+QImage DkImage::normImage(const QImage &img)
 {
-    // TODO saveify:
-    QByteArray tmp = ba.mid(pos, 4);
-    const int *val = (const int *)(tmp.constData());
+    QImage imgN = img.copy();
+    normImage(imgN);
 
-    return *val;
+    return imgN;
 }
 
-#ifdef WITH_OPENCV
-cv::Mat DkImage::exposureMat(const cv::Mat &src, double exposure)
+bool DkImage::normImage(QImage &img)
 {
-    int maxVal = std::numeric_limits<unsigned short>::max();
-    cv::Mat lut(1, maxVal + 1, CV_16UC1);
+    uchar maxVal = 0;
+    uchar minVal = 255;
 
-    double smooth = 0.5;
-    double cStops = std::log(exposure) / std::log(2.0);
-    double range = cStops * 2.0;
-    double linRange = std::pow(2.0, range);
-    double x1 = (maxVal + 1.0) / linRange - 1.0;
-    double y1 = x1 * exposure;
-    double y2 = maxVal * (1.0 + (1.0 - smooth) * (exposure - 1.0));
-    double sq3x = std::pow(x1 * x1 * maxVal, 1.0 / 3.0);
-    double B = (y2 - y1 + exposure * (3.0 * x1 - 3.0 * sq3x)) / (maxVal + 2.0 * x1 - 3.0 * sq3x);
-    double A = (exposure - B) * 3.0 * std::pow(x1 * x1, 1.0 / 3.0);
-    double CC = y2 - A * std::pow(maxVal, 1.0 / 3.0) - B * maxVal;
+    // number of used bytes per line
+    int bpl = (img.width() * img.depth() + 7) / 8;
+    int pad = img.bytesPerLine() - bpl;
+    bool hasAlpha = img.hasAlphaChannel() || img.format() == QImage::Format_RGB32;
 
-    for (int rIdx = 0; rIdx < lut.rows; rIdx++) {
-        unsigned short *ptrLut = lut.ptr<unsigned short>(rIdx);
+    // the statistics of common formats are computed once per image version
+    DkImageHistogram stats;
+    if (img.format() == QImage::Format_Grayscale8 || img.format() == QImage::Format_RGB888 || img.format() == QImage::Format_RGB32
+        || img.format() == QImage::Format_ARGB32)
+        stats = DkImageHistogram::statistics(img);
 
-        for (int cIdx = 0; cIdx < lut.cols; cIdx++) {
-            double val = cIdx;
-            double valE = 0.0;
+    if (!stats.isEmpty()) {
+        for (int cIdx = 0; cIdx < 3; cIdx++) {
+            minVal = (uchar)qMin((int)minVal, stats.firstBin(cIdx));
+            maxVal = (uchar)qMax((int)maxVal, stats.lastBin(cIdx));
+        }
+    } else {
+        const uchar *mPtr = img.constBits();
 
-            if (exposure < 1.0) {
-                valE = val * std::exp(exposure / 10.0); // /10 - make it slower -> we go down till -20
-            } else if (cIdx < x1) {
-                valE = val * exposure;
-            } else {
-                valE = A * std::pow(val, 1.0 / 3.0) + B * val + CC;
+        for (int rIdx = 0; rIdx < img.height(); rIdx++) {
+            for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
+                if (hasAlpha && cIdx % 4 == 3)
+                    continue;
+
+                if (*mPtr > maxVal)
+                    maxVal = *mPtr;
+                if (*mPtr < minVal)
+                    minVal = *mPtr;
             }
 
-            if (valE < 0)
-                ptrLut[cIdx] = 0;
-            else if (valE > maxVal)
-                ptrLut[cIdx] = (unsigned short)maxVal;
-            else
-                ptrLut[cIdx] = (unsigned short)qRound(valE);
+            mPtr += pad;
         }
     }
 
-    return applyLUT(src, lut);
-}
+    if ((minVal == 0 && maxVal == 255) || maxVal - minVal == 0)
+        return false;
 
-cv::Mat DkImage::gammaMat(const cv::Mat &src, double gamma)
-{
-    int maxVal = std::numeric_limits<unsigned short>::max();
-    cv::Mat lut(1, maxVal + 1, CV_16UC1);
+    uchar *ptr = img.bits();
 
-    for (int rIdx = 0; rIdx < lut.rows; rIdx++) {
-        unsigned short *ptrLut = lut.ptr<unsigned short>(rIdx);
+    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
+        for (int cIdx = 0; cIdx < bpl; cIdx++, ptr++) {
+            if (hasAlpha && cIdx % 4 == 3)
+                continue;
 
-        for (int cIdx = 0; cIdx < lut.cols; cIdx++) {
-            double val = std::pow((double)cIdx / maxVal, 1.0 / gamma) * maxVal;
-            ptrLut[cIdx] = (unsigned short)qRound(val);
+            *ptr = (uchar)qRound(255.0f * (*ptr - minVal) / (maxVal - minVal));
         }
-    }
+
+        ptr += pad;
+    }
+
+    return true;
+}
+
+QImage DkImage::autoAdjustImage(const QImage &img)
+{
+    QImage imgA = img.copy();
+    autoAdjustImage(imgA);
+
+    return imgA;
+}
+
+bool DkImage::autoAdjustImage(QImage &img)
+{
+    // return DkImage::unsharpMask(img, 30.0f, 1.5f);
+
+    DkTimer dt;
+    qDebug() << "[Auto Adjust] image format: " << img.format();
+
+    // for grayscale image - normalize is the same
+    if (img.format() <= QImage::Format_Indexed8) {
+        qDebug() << "[Auto Adjust] Grayscale - switching to Normalize: " << img.format();
+        return normImage(img);
+    } else if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32
+               && img.format() != QImage::Format_RGB888) {
+        qDebug() << "[Auto Adjust] Format not supported: " << img.format();
+        return false;
+    }
+
+    int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
+
+    // number of bytes per line used
+    int bpl = (img.width() * img.depth() + 7) / 8;
+    int pad = img.bytesPerLine() - bpl;
+
+    // the statistics are computed once per image version - we just remap the pixels
+    DkImageHistogram stats = DkImageHistogram::statistics(img);
+
+    if (stats.isEmpty())
+        return false;
+
+    // R, G, B below refer to the byte order: RGB888 is stored as R, G, B - (A)RGB32 as B, G, R, (A) (little endian)
+    int chR = channels == 4 ? 2 : 0;
+    int chG = 1;
+    int chB = channels == 4 ? 0 : 2;
+
+    const int *histR = stats.hist[chR];
+    const int *histG = stats.hist[chG];
+    const int *histB = stats.hist[chB];
+
+    uchar minR = (uchar)stats.firstBin(chR), maxR = (uchar)stats.lastBin(chR);
+    uchar minG = (uchar)stats.firstBin(chG), maxG = (uchar)stats.lastBin(chG);
+    uchar minB = (uchar)stats.firstBin(chB), maxB = (uchar)stats.lastBin(chB);
+
+    QColor ignoreChannel;
+    bool ignoreR = maxR - minR == 0 || maxR - minR == 255;
+    bool ignoreG = maxR - minR == 0 || maxG - minG == 255;
+    bool ignoreB = maxR - minR == 0 || maxB - minB == 255;
+
+    uchar *ptr = img.bits();
+
+    if (ignoreR) {
+        maxR = findHistPeak(histR);
+        ignoreR = maxR - minR == 0 || maxR - minR == 255;
+    }
+    if (ignoreG) {
+        maxG = findHistPeak(histG);
+        ignoreG = maxG - minG == 0 || maxG - minG == 255;
+    }
+    if (ignoreB) {
+        maxB = findHistPeak(histB);
+        ignoreB = maxB - minB == 0 || maxB - minB == 255;
+    }
+
+    // qDebug() << "red max: " << maxR << " min: " << minR << " ignored: " << ignoreR;
+    // qDebug() << "green max: " << maxG << " min: " << minG << " ignored: " << ignoreG;
+    // qDebug() << "blue max: " << maxB << " min: " << minB << " ignored: " << ignoreB;
+    // qDebug() << "computed in: " << dt;
+
+    if (ignoreR && ignoreG && ignoreB) {
+        qDebug() << "[Auto Adjust] There is no need to adjust the image";
+        return false;
+    }
+
+    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
+        for (int cIdx = 0; cIdx < bpl;) {
+            // don't check values - speed (but you see under-/overflows anyway)
+            if (!ignoreR && *ptr < maxR)
+                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minR) / (maxR - minR));
+            else if (!ignoreR)
+                *ptr = 255;
+
+            ptr++;
+            cIdx++;
+
+            if (!ignoreG && *ptr < maxG)
+                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minG) / (maxG - minG));
+            else if (!ignoreG)
+                *ptr = 255;
+
+            ptr++;
+            cIdx++;
+
+            if (!ignoreB && *ptr < maxB)
+                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minB) / (maxB - minB));
+            else if (!ignoreB)
+                *ptr = 255;
+            ptr++;
+            cIdx++;
+
+            if (channels == 4) {
+                ptr++;
+                cIdx++;
+            }
+        }
+        ptr += pad;
+    }
+
+    qDebug() << "[Auto Adjust] image adjusted in: " << dt;
+
+    return true;
+}
+
+uchar DkImage::findHistPeak(const int *hist, float quantile)
+{
+    int histArea = 0;
+
+    for (int idx = 0; idx < 256; idx++)
+        histArea += hist[idx];
+
+    int sumBins = 0;
+
+    for (int idx = 255; idx >= 0; idx--) {
+        sumBins += hist[idx];
+
+        if (sumBins / (float)histArea > quantile) {
+            qDebug() << "max bin: " << idx;
+            return (uchar)idx;
+        }
+    }
+
+    qDebug() << "no max bin found... sum: " << sumBins;
+
+    return 255;
+}
+
+QPixmap DkImage::makeSquare(const QPixmap &pm)
+{
+    QRect r(QPoint(), pm.size());
+
+    if (r.width() > r.height()) {
+        r.setX(qFloor((r.width() - r.height()) * 0.5f));
+        r.setWidth(r.height());
+    } else {
+        r.setY(qFloor((r.height() - r.width()) * 0.5f));
+        r.setHeight(r.width());
+    }
+
+    return pm.copy(r);
+}
+
+QImage DkImage::makeSquare(const QImage &img)
+{
+    QRect r(QPoint(), img.size());
+
+    if (r.width() > r.height()) {
+        r.setX(qFloor((r.width() - r.height()) * 0.5f));
+        r.setWidth(r.height());
+    } else {
+        r.setY(qFloor((r.height() - r.width()) * 0.5f));
+        r.setHeight(r.width());
+    }
+
+    return img.copy(r);
+}
+
+QPixmap DkImage::merge(const QVector<QImage> &imgs)
+{
+    if (imgs.size() > 10) {
+        qWarning() << "DkImage::merge is built for a small amount of images, you gave me: " << imgs.size();
+    }
+
+    QPixmap pm;
+    int margin = 10;
+    int x = 0;
+    QPainter p;
+
+    for (const QImage &img : imgs) {
+        // init on first
+        if (pm.isNull()) {
+            pm = QPixmap(img.height() * imgs.size() + margin * (imgs.size() - 1), img.height());
+            pm.fill(QColor(0, 0, 0, 0));
+
+            p.begin(&pm);
+        }
+
+        QPixmap cpm = DkImage::makeSquare(QPixmap::fromImage(img));
+        QRect r(QPoint(x, 0), QSize(pm.height(), pm.height()));
+        p.drawPixmap(r, cpm);
+        x += r.width() + margin;
+    }
+
+    return pm;
+}
+
+// blends two 32 bit pixels channel-wise (a + b = 256)
+static inline quint32 interpolate256(quint32 x, int a, quint32 y, int b)
+{
+    quint32 t = (x & 0xff00ff) * a + (y & 0xff00ff) * b;
+    t = (t >> 8) & 0xff00ff;
+
+    x = ((x >> 8) & 0xff00ff) * a + ((y >> 8) & 0xff00ff) * b;
+    x &= 0xff00ff00;
+
+    return x | t;
+}
+
+/**
+ * Maps the destination rows [firstRow lastRow) back into src and copies the nearest pixels.
+ * Pixels outside src are filled.
+ **/
+template <typename T>
+static void warpRowsNearest(const QImage &src, uchar *dBits, int dBpl, int dWidth, const QTransform &inv, T fill, int firstRow, int lastRow)
+{
+    const uchar *sBits = src.constBits();
+    const int sBpl = src.bytesPerLine();
+    const int sw = src.width();
+    const int sh = src.height();
+
+    for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+        T *dst = reinterpret_cast<T *>(dBits + (size_t)rIdx * dBpl);
+        QPointF p = inv.map(QPointF(0.5, rIdx + 0.5));
+        double px = p.x();
+        double py = p.y();
+
+        for (int cIdx = 0; cIdx < dWidth; cIdx++, px += inv.m11(), py += inv.m12()) {
+            int x = qFloor(px);
+            int y = qFloor(py);
+
+            dst[cIdx] = x >= 0 && y >= 0 && x < sw && y < sh ? reinterpret_cast<const T *>(sBits + (size_t)y * sBpl)[x] : fill;
+        }
+    }
+}
+
+/**
+ * Maps the destination rows [firstRow lastRow) back into src and samples it bilinearly.
+ * Pixels are blended premultiplied - samples outside src are the (premultiplied) fill color.
+ **/
+template <bool premultiplySrc, bool unpremultiplyDst>
+static void warpRows32(const QImage &src, uchar *dBits, int dBpl, int dWidth, const QTransform &inv, quint32 fill, int firstRow, int lastRow)
+{
+    const uchar *sBits = src.constBits();
+    const int sBpl = src.bytesPerLine();
+    const int sw = src.width();
+    const int sh = src.height();
+
+    auto pixel = [&](int x, int y) -> quint32 {
+        if (x < 0 || y < 0 || x >= sw || y >= sh)
+            return fill;
+
+        quint32 c = reinterpret_cast<const quint32 *>(sBits + (size_t)y * sBpl)[x];
+        return premultiplySrc ? qPremultiply(c) : c;
+    };
+
+    for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+        quint32 *dst = reinterpret_cast<quint32 *>(dBits + (size_t)rIdx * dBpl);
+
+        // pixel centers are at .5
+        QPointF p = inv.map(QPointF(0.5, rIdx + 0.5)) - QPointF(0.5, 0.5);
+        double px = p.x();
+        double py = p.y();
+
+        for (int cIdx = 0; cIdx < dWidth; cIdx++, px += inv.m11(), py += inv.m12()) {
+            int x = qFloor(px);
+            int y = qFloor(py);
+
+            if (x < -1 || y < -1 || x >= sw || y >= sh) {
+                dst[cIdx] = unpremultiplyDst ? qUnpremultiply(fill) : fill;
+                continue;
+            }
+
+            int wx = qRound((px - x) * 256);
+            int wy = qRound((py - y) * 256);
+
+            quint32 top = interpolate256(pixel(x, y), 256 - wx, pixel(x + 1, y), wx);
+            quint32 bottom = interpolate256(pixel(x, y + 1), 256 - wx, pixel(x + 1, y + 1), wx);
+            quint32 c = interpolate256(top, 256 - wy, bottom, wy);
+
+            dst[cIdx] = unpremultiplyDst ? qUnpremultiply(c) : c;
+        }
+    }
+}
+
+/**
+ * Bilinear version of warpRows32 for grayscale images.
+ **/
+static void warpRowsGray(const QImage &src, uchar *dBits, int dBpl, int dWidth, const QTransform &inv, uchar fill, int firstRow, int lastRow)
+{
+    const uchar *sBits = src.constBits();
+    const int sBpl = src.bytesPerLine();
+    const int sw = src.width();
+    const int sh = src.height();
+
+    auto pixel = [&](int x, int y) -> int {
+        return x >= 0 && y >= 0 && x < sw && y < sh ? sBits[(size_t)y * sBpl + x] : fill;
+    };
+
+    for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+        uchar *dst = dBits + (size_t)rIdx * dBpl;
+
+        QPointF p = inv.map(QPointF(0.5, rIdx + 0.5)) - QPointF(0.5, 0.5);
+        double px = p.x();
+        double py = p.y();
+
+        for (int cIdx = 0; cIdx < dWidth; cIdx++, px += inv.m11(), py += inv.m12()) {
+            int x = qFloor(px);
+            int y = qFloor(py);
+
+            if (x < -1 || y < -1 || x >= sw || y >= sh) {
+                dst[cIdx] = fill;
+                continue;
+            }
+
+            int wx = qRound((px - x) * 256);
+            int wy = qRound((py - y) * 256);
+
+            int top = pixel(x, y) * (256 - wx) + pixel(x + 1, y) * wx;
+            int bottom = pixel(x, y + 1) * (256 - wx) + pixel(x + 1, y + 1) * wx;
+
+            dst[cIdx] = (uchar)((top * (256 - wy) + bottom * wy + (1 << 15)) >> 16);
+        }
+    }
+}
+
+/**
+ * Crops a (rotated) rectangle from src.
+ * Only the destination pixels are computed: they are mapped back into src
+ * and sampled bilinearly (nearest for axis aligned crops) - in parallel.
+ * 8 bit grayscale and RGB32 images keep their format if the fill color allows it.
+ * @param src the source image
+ * @param rect the crop rectangle
+ * @param fillColor the color of pixels that are outside src
+ * @return QImage the cropped image
+ **/
+QImage DkImage::cropToImage(const QImage &src, const DkRotatingRect &rect, const QColor &fillColor)
+{
+    QTransform tForm;
+    QPointF cImgSize;
+    rect.getTransform(tForm, cImgSize);
+
+    // illegal?
+    if (cImgSize.x() < 0.5f || cImgSize.y() < 0.5f)
+        return src;
+
+    double angle = DkMath::normAngleRad(rect.getAngle(), 0, CV_PI * 0.5);
+    double minD = qMin(std::abs(angle), std::abs(angle - CV_PI * 0.5));
+
+    // for rotated rects we want perfect anti-aliasing
+    bool smooth = minD > FLT_EPSILON;
+
+    bool invertible = false;
+    QTransform inv = tForm.inverted(&invertible);
+
+    if (!invertible)
+        return src;
+
+    DkTimer dt;
+
+    QRgb fill = fillColor.rgba();
+    bool opaqueFill = qAlpha(fill) == 255;
+    bool grayFill = opaqueFill && qRed(fill) == qGreen(fill) && qGreen(fill) == qBlue(fill);
+
+    QImage s = src;
+    QImage::Format dstFormat = s.format();
+
+    if (s.format() == QImage::Format_Grayscale8 && grayFill)
+        dstFormat = QImage::Format_Grayscale8;
+    else if (s.format() == QImage::Format_RGB32)
+        dstFormat = opaqueFill ? QImage::Format_RGB32 : QImage::Format_ARGB32; // RGB32 pixels are opaque ARGB32 pixels
+    else if (s.format() != QImage::Format_ARGB32 && s.format() != QImage::Format_ARGB32_Premultiplied) {
+        s = s.convertToFormat(QImage::Format_ARGB32);
+        dstFormat = QImage::Format_ARGB32;
+    }
+
+    QImage img(qRound(cImgSize.x()), qRound(cImgSize.y()), dstFormat);
+
+    if (img.isNull())
+        return QImage();
+
+    uchar *dBits = img.bits();
+    const int dBpl = img.bytesPerLine();
+    const int dWidth = img.width();
+    const QImage::Format sFormat = s.format();
+
+    parallelRows(img.height(), [&](int firstRow, int lastRow) {
+        if (dstFormat == QImage::Format_Grayscale8) {
+            if (smooth)
+                warpRowsGray(s, dBits, dBpl, dWidth, inv, (uchar)qRed(fill), firstRow, lastRow);
+            else
+                warpRowsNearest<uchar>(s, dBits, dBpl, dWidth, inv, (uchar)qRed(fill), firstRow, lastRow);
+        } else if (!smooth) {
+            quint32 f = dstFormat == QImage::Format_ARGB32_Premultiplied ? qPremultiply(fill) : fill;
+            warpRowsNearest<quint32>(s, dBits, dBpl, dWidth, inv, f, firstRow, lastRow);
+        } else if (sFormat == QImage::Format_ARGB32)
+            warpRows32<true, true>(s, dBits, dBpl, dWidth, inv, qPremultiply(fill), firstRow, lastRow);
+        else if (dstFormat == QImage::Format_ARGB32)
+            warpRows32<false, true>(s, dBits, dBpl, dWidth, inv, qPremultiply(fill), firstRow, lastRow);
+        else
+            warpRows32<false, false>(s, dBits, dBpl, dWidth, inv, qPremultiply(fill), firstRow, lastRow);
+    });
+
+    img.setDotsPerMeterX(src.dotsPerMeterX());
+    img.setDotsPerMeterY(src.dotsPerMeterY());
+
+    qDebug() << "[DkImage] cropped" << img.size() << "in" << dt;
+
+    return img;
+}
+
+QImage DkImage::hueSaturation(const QImage &src, int hue, int sat, int brightness)
+{
+    // nothing to do?
+    if (hue == 0 && sat == 0 && brightness == 0)
+        return src;
+
+    QImage imgR = src;
+
+    if (!hueSaturation(imgR, hue, sat, brightness))
+        return QImage();
+
+    return imgR;
+}
+
+/**
+ * Adjusts hue, saturation and brightness in place.
+ * The image is converted to (A)RGB32 if needed. Like OpenCV's 8 bit HSV,
+ * a hue of 180 is a full turn.
+ * @param img the image to be modified
+ * @param hue the hue offset [-180 180]
+ * @param sat the saturation change in percent
+ * @param brightness the brightness change in percent
+ * @return bool false if the image could not be converted
+ **/
+bool DkImage::hueSaturation(QImage &img, int hue, int sat, int brightness)
+{
+    if (hue == 0 && sat == 0 && brightness == 0)
+        return true;
+
+    if (!toRgb32(img))
+        return false;
+
+    DkTimer dt;
+
+    uchar *bits = img.bits();
+    const int bpl = img.bytesPerLine();
+    const int width = img.width();
+
+    parallelRows(img.height(), [&](int firstRow, int lastRow) {
+        for (int rIdx = firstRow; rIdx < lastRow; rIdx++)
+            hueSaturationRow(reinterpret_cast<QRgb *>(bits + (size_t)rIdx * bpl), width, hue, sat, brightness);
+    });
+
+    qDebug() << "[DkImage] hue/saturation computed in" << dt;
+
+    return true;
+}
+
+/**
+ * Changes hue, saturation and brightness of one row of (A)RGB32 pixels.
+ * @param ptr the pixels
+ * @param width the number of pixels
+ * @param hue the hue offset [-180 180]
+ * @param sat the saturation change in percent
+ * @param brightness the brightness change in percent
+ **/
+void DkImage::hueSaturationRow(QRgb *ptr, int width, int hue, int sat, int brightness)
+{
+    // normalize hue (to [0 6[), brightness & saturation
+    const float hueN = (hue < 0 ? hue + 180 : hue) / 30.0f;
+    const float brightnessN = qRound(brightness / 100.0 * 255.0);
+    const float satN = sat / 100.0f + 1.0f;
+
+    // the pixel loop is branch-free (selects only) so that compilers can vectorize it
+    for (int cIdx = 0; cIdx < width; cIdx++) {
+        const QRgb px = ptr[cIdx];
+        const float r = (float)((px >> 16) & 0xff);
+        const float g = (float)((px >> 8) & 0xff);
+        const float b = (float)(px & 0xff);
+
+        // RGB -> HSV (h in [0 6[)
+        const float v = qMax(r, qMax(g, b));
+        const float diff = v - qMin(r, qMin(g, b));
+        const float dn = 1.0f / qMax(diff, 1.0f);
+
+        float h = v == r ? (g - b) * dn : (v == g ? (b - r) * dn + 2.0f : (r - g) * dn + 4.0f);
+        h += h < 0.0f ? 6.0f : 0.0f;
+
+        // adopt hue/saturation/value
+        h += hueN;
+        h -= h >= 6.0f ? 6.0f : 0.0f;
+        const float s = qMin(diff / qMax(v, 1.0f) * satN, 1.0f);
+        const float vn = qBound(0.0f, v + brightnessN, 255.0f);
+
+        // HSV -> RGB: c = v - v*s*clamp(min(k, 4-k), 0, 1) with k = (n + h) mod 6
+        const float vs = vn * s;
+        float kr = h + 5.0f;
+        kr -= kr >= 6.0f ? 6.0f : 0.0f;
+        float kg = h + 3.0f;
+        kg -= kg >= 6.0f ? 6.0f : 0.0f;
+        float kb = h + 1.0f;
+        kb -= kb >= 6.0f ? 6.0f : 0.0f;
+
+        const uint nr = (uint)(vn - vs * qBound(0.0f, qMin(kr, 4.0f - kr), 1.0f) + 0.5f);
+        const uint ng = (uint)(vn - vs * qBound(0.0f, qMin(kg, 4.0f - kg), 1.0f) + 0.5f);
+        const uint nb = (uint)(vn - vs * qBound(0.0f, qMin(kb, 4.0f - kb), 1.0f) + 0.5f);
+
+        ptr[cIdx] = (px & 0xff000000) | (nr << 16) | (ng << 8) | nb;
+    }
+}
+
+QImage DkImage::exposure(const QImage &src, double exposure, double offset, double gamma)
+{
+    if (exposure == 0.0 && offset == 0.0 && gamma == 1.0)
+        return src;
+
+    QImage imgR = src;
+
+    if (!DkImage::exposure(imgR, exposure, offset, gamma))
+        return QImage();
+
+    return imgR;
+}
+
+/**
+ * Applies exposure, offset and gamma in place.
+ * All three operate on single channels. Hence, they are
+ * composed into one 8 bit LUT which is then applied to RGB.
+ * @param img the image to be modified (converted to (A)RGB32 if needed)
+ * @param exposure the exposure (0 = no change)
+ * @param offset the offset [-1 1]
+ * @param gamma the gamma (1 = no change)
+ * @return bool false if the image could not be converted
+ **/
+bool DkImage::exposure(QImage &img, double exposure, double offset, double gamma)
+{
+    if (exposure == 0.0 && offset == 0.0 && gamma == 1.0)
+        return true;
+
+    if (!toRgb32(img))
+        return false;
+
+    DkTimer dt;
+
+    const QVector<uchar> lut = exposureLut(exposure, offset, gamma);
+
+    uchar *bits = img.bits();
+    const int bpl = img.bytesPerLine();
+    const int width = img.width();
+
+    parallelRows(img.height(), [&](int firstRow, int lastRow) {
+        for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+            QRgb *ptr = reinterpret_cast<QRgb *>(bits + (size_t)rIdx * bpl);
+
+            for (int cIdx = 0; cIdx < width; cIdx++) {
+                const QRgb px = ptr[cIdx];
+                ptr[cIdx] = (px & 0xff000000) | (lut[(px >> 16) & 0xff] << 16) | (lut[(px >> 8) & 0xff] << 8) | lut[px & 0xff];
+            }
+        }
+    });
+
+    qDebug() << "[DkImage] exposure computed in" << dt;
+
+    return true;
+}
+
+/**
+ * Composes the 16 bit pipeline (offset -> exposure -> gamma) for all 8 bit values.
+ * @param exposure the exposure (0 = no change)
+ * @param offset the offset [-1 1]
+ * @param gamma the gamma (1 = no change)
+ * @return QVector<uchar> a LUT with 256 entries
+ **/
+QVector<uchar> DkImage::exposureLut(double exposure, double offset, double gamma)
+{
+    const int maxVal = std::numeric_limits<unsigned short>::max();
+    const QVector<unsigned short> expLut = exposure != 0.0 ? exposureLut(exposure) : QVector<unsigned short>();
+
+    QVector<uchar> lut(256);
+
+    for (int idx = 0; idx < lut.size(); idx++) {
+        int val = qBound(0, qRound(idx * 256 + offset * maxVal), maxVal);
+
+        if (!expLut.isEmpty())
+            val = expLut[val];
+
+        if (gamma != 1.0)
+            val = qRound(std::pow((double)val / maxVal, 1.0 / gamma) * maxVal);
+
+        lut[idx] = (uchar)qBound(0, qRound(val / 256.0), 255);
+    }
+
+    return lut;
+}
+
+/**
+ * Computes the 16 bit exposure curve.
+ * Values are scaled linearly and compressed smoothly towards
+ * the maximum if the exposure is increased.
+ * @param exposure the exposure (> 0)
+ * @return QVector<unsigned short> a LUT with USHRT_MAX+1 entries
+ **/
+QVector<unsigned short> DkImage::exposureLut(double exposure)
+{
+    int maxVal = std::numeric_limits<unsigned short>::max();
+    QVector<unsigned short> lut(maxVal + 1);
+
+    double smooth = 0.5;
+    double cStops = std::log(exposure) / std::log(2.0);
+    double range = cStops * 2.0;
+    double linRange = std::pow(2.0, range);
+    double x1 = (maxVal + 1.0) / linRange - 1.0;
+    double y1 = x1 * exposure;
+    double y2 = maxVal * (1.0 + (1.0 - smooth) * (exposure - 1.0));
+    double sq3x = std::pow(x1 * x1 * maxVal, 1.0 / 3.0);
+    double B = (y2 - y1 + exposure * (3.0 * x1 - 3.0 * sq3x)) / (maxVal + 2.0 * x1 - 3.0 * sq3x);
+    double A = (exposure - B) * 3.0 * std::pow(x1 * x1, 1.0 / 3.0);
+    double CC = y2 - A * std::pow(maxVal, 1.0 / 3.0) - B * maxVal;
+
+    for (int cIdx = 0; cIdx < lut.size(); cIdx++) {
+        double val = cIdx;
+        double valE = 0.0;
+
+        if (exposure < 1.0) {
+            valE = val * std::exp(exposure / 10.0); // /10 - make it slower -> we go down till -20
+        } else if (cIdx < x1) {
+            valE = val * exposure;
+        } else {
+            valE = A * std::pow(val, 1.0 / 3.0) + B * val + CC;
+        }
+
+        if (valE < 0)
+            lut[cIdx] = 0;
+        else if (valE > maxVal)
+            lut[cIdx] = (unsigned short)maxVal;
+        else
+            lut[cIdx] = (unsigned short)qRound(valE);
+    }
+
+    return lut;
+}
+
+/**
+ * Converts img to RGB32 or ARGB32 (if it has an alpha channel).
+ * Images that are already in one of these formats are not changed.
+ * @param img the image to be converted
+ * @return bool false if img is empty
+ **/
+bool DkImage::toRgb32(QImage &img)
+{
+    if (img.isNull())
+        return false;
+
+    if (img.format() != QImage::Format_RGB32 && img.format() != QImage::Format_ARGB32)
+        img = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+    return !img.isNull();
+}
+
+/**
+ * Splits numRows into blocks and processes them concurrently.
+ * The calling thread processes the first block and returns once all blocks are finished.
+ * @param numRows the number of rows
+ * @param fnc is called with the first and last (exclusive) row of each block
+ **/
+void DkImage::parallelRows(int numRows, const std::function<void(int, int)> &fnc)
+{
+    // at least 64 rows per thread
+    int numBlocks = qBound(1, numRows / 64, QThread::idealThreadCount());
+    int blockSize = (numRows + numBlocks - 1) / numBlocks;
+
+    QVector<QFuture<void>> blocks;
+
+    for (int rIdx = blockSize; rIdx < numRows; rIdx += blockSize) {
+        int lastRow = qMin(rIdx + blockSize, numRows);
+        blocks << QtConcurrent::run([&fnc, rIdx, lastRow]() {
+            fnc(rIdx, lastRow);
+        });
+    }
+
+    fnc(0, qMin(blockSize, numRows));
+
+    for (QFuture<void> &b : blocks)
+        b.waitForFinished();
+}
+
+// blends src over a background color (RGB32)
+struct DkBgColorKernel {
+    DkBgColorKernel(const QImage &src, QImage &dst, QRgb col)
+        : src(src)
+        , dst(dst)
+        , col(col)
+    {
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        const int shift = 8 * (sizeof(C) - 1);
+        const int a = qMax((int)L::alpha, 0);
+        const quint32 m = L::maxValue;
+        const quint32 bg[3] = {qRed(col) * (m / 255), qGreen(col) * (m / 255), qBlue(col) * (m / 255)};
+
+        const int width = src.width();
+        uchar *dBits = dst.bits();
+        const int dBpl = dst.bytesPerLine();
+
+        DkImage::parallelRows(src.height(), [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+                const C *sPtr = reinterpret_cast<const C *>(src.constScanLine(rIdx));
+                QRgb *dPtr = reinterpret_cast<QRgb *>(dBits + (size_t)rIdx * dBpl);
+
+                for (int cIdx = 0; cIdx < width; cIdx++, sPtr += L::channels) {
+                    quint32 rgb[3] = {sPtr[L::red], sPtr[L::green], sPtr[L::blue]};
+
+                    if (L::alpha >= 0) {
+                        quint32 ia = m - sPtr[a];
+
+                        for (int ch = 0; ch < 3; ch++) {
+                            if (L::premultiplied)
+                                rgb[ch] = qMin(rgb[ch] + (bg[ch] * ia + m / 2) / m, m);
+                            else
+                                rgb[ch] = (rgb[ch] * sPtr[a] + bg[ch] * ia + m / 2) / m;
+                        }
+                    }
+
+                    dPtr[cIdx] = qRgb(rgb[0] >> shift, rgb[1] >> shift, rgb[2] >> shift);
+                }
+            }
+        });
+    }
+
+    const QImage &src;
+    QImage &dst;
+    QRgb col;
+};
+
+QImage DkImage::bgColor(const QImage &src, const QColor &col)
+{
+    QImage dst(src.size(), QImage::Format_RGB32);
+
+    if (dst.isNull())
+        return dst;
+
+    DkBgColorKernel k(src, dst, col.rgb());
+
+    if (DkPixelFormat::dispatch(src.format(), k))
+        return dst;
+
+    // e.g. indexed images
+    dst.fill(col);
+
+    QPainter p(&dst);
+    p.drawImage(QPoint(0, 0), src);
+
+    return dst;
+}
+
+QByteArray DkImage::extractImageFromDataStream(const QByteArray &ba, const QByteArray &beginSignature, const QByteArray &endSignature, bool debugOutput)
+{
+    int bIdx = ba.indexOf(beginSignature);
+
+    if (bIdx == -1) {
+        qDebug() << "[ExtractImage] could not locate" << beginSignature;
+        return QByteArray();
+    }
+
+    int eIdx = ba.indexOf(endSignature, bIdx);
+
+    if (eIdx == -1) {
+        qDebug() << "[ExtractImage] could not locate" << endSignature;
+        return QByteArray();
+    }
+
+    QByteArray bac = ba.mid(bIdx, eIdx + endSignature.size() - bIdx);
+
+    if (debugOutput) {
+        qDebug() << "extracting image from stream...";
+        qDebug() << "cropping: [" << bIdx << eIdx << "]";
+        qDebug() << "original size: " << ba.size() / 1024.0 << "KB"
+                 << "new size: " << bac.size() / 1024.0 << "KB"
+                 << "difference:" << (ba.size() - bac.size()) / 1024 << "KB";
+    }
+
+    return bac;
+}
+
+QByteArray DkImage::fixSamsungPanorama(QByteArray &ba)
+{
+    // this code is based on python code from bcyrill
+    // see: https://gist.github.com/bcyrill/e59fda6c7ffe23c7c4b08a990804b269
+    // it fixes SAMSUNG panorama images that are not standard conformant by adding an EOI marker to the QByteArray
+    // see also: https://github.com/nomacs/nomacs/issues/254
+
+    if (ba.size() < 8)
+        return QByteArray();
+
+    QByteArray trailer = ba.right(4);
+
+    // is it a samsung panorama jpg?
+    if (trailer != QByteArray("SEFT"))
+        return QByteArray();
+
+    // TODO saveify:
+    int sefhPos = intFromByteArray(ba, ba.size() - 8) + 8;
+    trailer = ba.right(sefhPos);
+
+    // trailer starts with "SEFH"?
+    if (trailer.left(4) != QByteArray("SEFH"))
+        return QByteArray();
+
+    int endPos = ba.size();
+    int dirPos = endPos - sefhPos;
+
+    int count = intFromByteArray(trailer, 8);
+
+    int firstBlock = 0;
+    bool isPano = false;
+
+    for (int idx = 0; idx < count; idx++) {
+        int e = 12 + 12 * idx;
+
+        int noff = intFromByteArray(trailer, e + 4);
+        int size = intFromByteArray(trailer, e + 8);
+
+        if (firstBlock < noff)
+            firstBlock = noff;
+
+        QByteArray cdata = ba.mid(dirPos - noff, size);
+
+        int eoff = intFromByteArray(cdata, 4);
+        QString pi = cdata.mid(8, eoff);
+
+        if (pi == "Panorama_Shot_Info")
+            isPano = true;
+    }
+
+    if (!isPano)
+        return QByteArray();
+
+    int dataPos = dirPos - firstBlock;
+
+    // ok, append the missing marker
+    QByteArray nb;
+    nb.append(ba.left(dataPos));
+    nb.append(QByteArray("\xff\xd9"));
+    nb.append(ba.right(dataPos));
+    qDebug() << "SAMSUNG panorma fix: EOI marker injected";
+
+    return nb;
+}
+
+int DkImage::intFromByteArray(const QByteArray &ba, int pos)
+{
+    // TODO saveify:
+    QByteArray tmp = ba.mid(pos, 4);
+    const int *val = (const int *)(tmp.constData());
+
+    return *val;
+}
+
+#ifdef WITH_OPENCV
+cv::Mat DkImage::exposureMat(const cv::Mat &src, double exposure)
+{
+    QVector<unsigned short> expLut = exposureLut(exposure);
+    cv::Mat lut(1, expLut.size(), CV_16UC1, expLut.data());
+
+    return applyLUT(src, lut);
+}
+
+cv::Mat DkImage::gammaMat(const cv::Mat &src, double gamma)
+{
+    int maxVal = std::numeric_limits<unsigned short>::max();
+    cv::Mat lut(1, maxVal + 1, CV_16UC1);
+
+    for (int rIdx = 0; rIdx < lut.rows; rIdx++) {
+        unsigned short *ptrLut = lut.ptr<unsigned short>(rIdx);
+
+        for (int cIdx = 0; cIdx < lut.cols; cIdx++) {
+            double val = std::pow((double)cIdx / maxVal, 1.0 / gamma) * maxVal;
+            ptrLut[cIdx] = (unsigned short)qRound(val);
+        }
+    }
 
     return applyLUT(src, lut);
 }
@@ -1057,6 +2320,80 @@ QPixmap DkImage::loadFromSvg(const QString &filePath, const QSize &size)
     return pm;
 }
 
+// DkDeferredIconEngine --------------------------------------------------------------------
+// rasterizes the icon the first time it is painted (see DkImage::loadIconDeferred)
+class DkDeferredIconEngine : public QIconEngine
+{
+public:
+    DkDeferredIconEngine(const QString &filePath, const QSize &size, const QColor &col)
+        : mFilePath(filePath)
+        , mSize(size)
+        , mColor(col)
+    {
+    }
+
+    QIconEngine *clone() const override
+    {
+        return new DkDeferredIconEngine(*this);
+    }
+
+    void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state) override
+    {
+        icon().paint(painter, rect, Qt::AlignCenter, mode, state);
+    }
+
+    QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) override
+    {
+        return icon().pixmap(size, mode, state);
+    }
+
+    QSize actualSize(const QSize &size, QIcon::Mode, QIcon::State) override
+    {
+        // layouts ask for the size before anything is painted - don't rasterize here
+        QSize s = mSize * DkSettingsManager::param().dpiScaleFactor();
+        if (mSize.isEmpty()) {
+            int eis = DkSettingsManager::param().effectiveIconSize();
+            s = QSize(eis, eis);
+        }
+
+        if (s.width() > size.width() || s.height() > size.height())
+            s.scale(size, Qt::KeepAspectRatio);
+
+        return s;
+    }
+
+protected:
+    QIcon &icon()
+    {
+        if (mIcon.isNull())
+            mIcon = QIcon(DkImage::loadIcon(mFilePath, mSize, mColor));
+
+        return mIcon;
+    }
+
+    QString mFilePath;
+    QSize mSize;
+    QColor mColor;
+    QIcon mIcon;
+};
+
+/**
+ * Returns an icon that is only rasterized (and colorized) when it is painted first.
+ * Use it for icons that are created at startup but might never be shown (e.g. menu icons).
+ * NOTE: pixmaps cannot be added to the returned icon.
+ * @param filePath the SVG's path
+ * @param size the icon size - the effective icon size is used if it is empty
+ * @param col the icon color - the theme's icon color is used if it is invalid
+ * @return QIcon the deferred icon
+ **/
+QIcon DkImage::loadIconDeferred(const QString &filePath, const QSize &size, const QColor &col)
+{
+    if (filePath.isEmpty())
+        return QIcon();
+
+    return QIcon(new DkDeferredIconEngine(filePath, size, col));
+}
+
 #ifdef WITH_OPENCV
 
 /**
@@ -1102,6 +2439,34 @@ cv::Mat DkImage::qImage2Mat(const QImage &img)
     return mat2;
 }
 
+/**
+ * Converts a QImage to a Mat on scratch memory.
+ * Kernels that need the Mat only temporarily use this version
+ * so that the copy reuses the thread's scratch buffers.
+ * @param img formats supported: ARGB32 | RGB32 | RGB888 (others are converted to ARGB32)
+ * @param scratch the scratch the Mat is leased from
+ * @return cv::Mat the corresponding Mat - valid as long as scratch lives
+ **/
+cv::Mat DkImage::qImage2Mat(const QImage &img, DkScratch &scratch)
+{
+    QImage cImg = img;
+
+    if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32 && img.format() != QImage::Format_RGB888)
+        cImg = img.convertToFormat(QImage::Format_ARGB32);
+
+    int type = cImg.format() == QImage::Format_RGB888 ? CV_8UC3 : CV_8UC4;
+    cv::Mat src(cImg.height(), cImg.width(), type, (uchar *)cImg.constBits(), cImg.bytesPerLine());
+    cv::Mat mat = scratch.mat(cImg.height(), cImg.width(), type);
+
+    // fall back to the heap if the scratch is exhausted
+    if (mat.empty())
+        return src.clone();
+
+    src.copyTo(mat);
+
+    return mat;
+}
+
 /**
  * Converts a cv::Mat to a QImage.
  * @param img supported formats CV8UC1 | CV_8UC3 | CV_8UC4
@@ -1134,6 +2499,62 @@ QImage DkImage::mat2QImage(cv::Mat img)
     return qImg;
 }
 
+/**
+ * Returns a Mat that points to the pixels of img (no copy).
+ * The Mat must only be read and is valid as long as img lives unchanged.
+ * Formats other than ARGB32 | RGB32 | RGB888 are converted (i.e. copied).
+ * @param img the image
+ * @return cv::Mat a view of img
+ **/
+cv::Mat DkImage::qImage2MatView(const QImage &img)
+{
+    if (img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB32)
+        return cv::Mat(img.height(), img.width(), CV_8UC4, (uchar *)img.constBits(), img.bytesPerLine());
+    else if (img.format() == QImage::Format_RGB888)
+        return cv::Mat(img.height(), img.width(), CV_8UC3, (uchar *)img.constBits(), img.bytesPerLine());
+
+    return qImage2Mat(img);
+}
+
+static void releaseMat(void *mat)
+{
+    delete static_cast<cv::Mat *>(mat);
+}
+
+/**
+ * Converts a cv::Mat to a QImage that adopts the Mat's buffer (no copy).
+ * The QImage keeps a reference to the buffer - so img must own its data
+ * (no views, no scratch memory) and must not be changed afterwards.
+ * @param img supported formats CV8UC1 | CV_8UC3 | CV_8UC4 (CV_32F is converted)
+ * @return QImage the corresponding QImage
+ **/
+QImage DkImage::mat2QImageView(const cv::Mat &img)
+{
+    cv::Mat mat = img;
+
+    if (mat.depth() == CV_32F)
+        img.convertTo(mat, CV_8U, 255);
+
+    QImage::Format format;
+
+    switch (mat.type()) {
+    case CV_8UC1:
+        format = QImage::Format_Indexed8;
+        break;
+    case CV_8UC3:
+        format = QImage::Format_RGB888;
+        break;
+    case CV_8UC4:
+        format = QImage::Format_ARGB32;
+        break;
+    default:
+        return QImage();
+    }
+
+    // opencv uses size_t for scaling in x64 applications
+    return QImage(mat.data, (int)mat.cols, (int)mat.rows, (int)mat.step, format, &releaseMat, new cv::Mat(mat));
+}
+
 cv::Mat DkImage::get1DGauss(double sigma)
 {
     // correct -> checked with matlab reference
@@ -1196,139 +2617,372 @@ void DkImage::mapGammaTable(cv::Mat &img, const QVector<unsigned short> &gammaTa
     qDebug() << "gamma computation takes: " << dt;
 }
 
-void DkImage::logPolar(const cv::Mat &src, cv::Mat &dst, cv::Point2d center, double scaleLog, double angle, double scale)
+// caches the polar coordinates of a destination grid and the remap tables derived from them
+// the radius table only depends on the scale, the angle table only depends on the rotation
+class DkPolarGrid
 {
-    cv::Mat mapx, mapy;
+public:
+    DkPolarGrid(const cv::Size &size, const cv::Point2d &center)
+        : mSize(size)
+        , mCenter(center)
+    {
+        mRadius = cv::Mat(size, CV_32F);
+        mAngle = cv::Mat(size, CV_32F);
+
+        DkImage::parallelRows(size.height, [&](int firstRow, int lastRow) {
+            cv::Mat bufx(1, mSize.width, CV_32F);
+            cv::Mat bufy(1, mSize.width, CV_32F);
+
+            for (int x = 0; x < mSize.width; x++)
+                bufx.ptr<float>()[x] = (float)(x - mCenter.x);
+
+            for (int y = firstRow; y < lastRow; y++) {
+                bufy.setTo((float)(y - mCenter.y));
+                cv::cartToPolar(bufx, bufy, mRadius.row(y), mAngle.row(y));
+            }
+        });
+    }
+
+    static QSharedPointer<DkPolarGrid> grid(const cv::Size &size, const cv::Point2d &center)
+    {
+        static QMutex mutex;
+        static QVector<QSharedPointer<DkPolarGrid>> grids;
+
+        QMutexLocker locker(&mutex);
+
+        for (int idx = 0; idx < grids.size(); idx++) {
+            if (grids[idx]->mSize == size && grids[idx]->mCenter == center) {
+                grids.move(idx, 0);
+                return grids.first();
+            }
+        }
+
+        // keep the preview & the full resolution grid
+        grids.prepend(QSharedPointer<DkPolarGrid>(new DkPolarGrid(size, center)));
+        grids.resize(qMin(grids.size(), 2));
+
+        return grids.first();
+    }
+
+    void maps(double scaleLog, double rhoScale, double angle, double phiScale, cv::Mat &mapx, cv::Mat &mapy)
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (mMapX.empty() || mScaleLog != scaleLog || mRhoScale != rhoScale) {
+            // new buffers - previous maps might still be in use
+            cv::Mat mx(mSize, CV_32F);
+
+            DkImage::parallelRows(mSize.height, [&](int firstRow, int lastRow) {
+                for (int y = firstRow; y < lastRow; y++) {
+                    const float *r = mRadius.ptr<float>(y);
+                    float *m = mx.ptr<float>(y);
+
+                    for (int x = 0; x < mSize.width; x++)
+                        m[x] = (float)(std::log(r[x] / scaleLog + 1.0) * rhoScale);
+                }
+            });
+
+            mMapX = mx;
+            mScaleLog = scaleLog;
+            mRhoScale = rhoScale;
+        }
+
+        if (mMapY.empty() || mPhiOffset != angle || mPhiScale != phiScale) {
+            cv::Mat my(mSize, CV_32F);
+
+            DkImage::parallelRows(mSize.height, [&](int firstRow, int lastRow) {
+                for (int y = firstRow; y < lastRow; y++) {
+                    const float *a = mAngle.ptr<float>(y);
+                    float *m = my.ptr<float>(y);
+
+                    for (int x = 0; x < mSize.width; x++) {
+                        double phi = a[x] + angle;
+
+                        if (phi < 0)
+                            phi += 2 * CV_PI;
+                        else if (phi > 2 * CV_PI)
+                            phi -= 2 * CV_PI;
+
+                        m[x] = (float)(phi * phiScale);
+                    }
+                }
+            });
+
+            mMapY = my;
+            mPhiOffset = angle;
+            mPhiScale = phiScale;
+        }
+
+        mapx = mMapX;
+        mapy = mMapY;
+    }
+
+protected:
+    cv::Size mSize;
+    cv::Point2d mCenter;
 
-    cv::Size ssize, dsize;
-    ssize = src.size();
-    dsize = dst.size();
+    cv::Mat mRadius;
+    cv::Mat mAngle;
+
+    QMutex mMutex;
+    cv::Mat mMapX;
+    cv::Mat mMapY;
+    double mScaleLog = 0.0;
+    double mRhoScale = 0.0;
+    double mPhiOffset = 0.0;
+    double mPhiScale = 0.0;
+};
+
+void DkImage::logPolar(const cv::Mat &src, cv::Mat &dst, cv::Point2d center, double scaleLog, double angle, double scale)
+{
+    DkTimer dt;
 
-    mapx = cv::Mat(dsize.height, dsize.width, CV_32F);
-    mapy = cv::Mat(dsize.height, dsize.width, CV_32F);
+    cv::Size dsize = dst.empty() ? src.size() : dst.size();
 
-    double xDist = dst.cols - center.x;
-    double yDist = dst.rows - center.y;
+    double xDist = dsize.width - center.x;
+    double yDist = dsize.height - center.y;
 
     double radius = std::sqrt(xDist * xDist + yDist * yDist);
 
     scale *= src.cols / std::log(radius / scaleLog + 1.0);
+    double ascale = src.rows / (2 * CV_PI);
+
+    cv::Mat mapx, mapy;
+    DkPolarGrid::grid(dsize, center)->maps(scaleLog, scale, angle, ascale, mapx, mapy);
+
+    // src and dst might share their buffer
+    cv::Mat out(dsize, src.type());
+
+    parallelRows(dsize.height, [&](int firstRow, int lastRow) {
+        cv::Mat outStrip = out.rowRange(firstRow, lastRow);
+        cv::remap(src, outStrip, mapx.rowRange(firstRow, lastRow), mapy.rowRange(firstRow, lastRow), CV_INTER_AREA, IPL_BORDER_REPLICATE);
+    });
+
+    dst = out;
+
+    qDebug() << "log polar computed in" << dt;
+}
+
+void DkImage::tinyPlanet(QImage &img, double scaleLog, double angle, QSize s, bool invert /* = false */)
+{
+    QTransform rotationMatrix;
+    rotationMatrix.rotate((invert) ? (double)-90 : (double)90);
+    img = img.transformed(rotationMatrix);
+
+    // make square
+    img = img.scaled(s, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    cv::Mat mImg = DkImage::qImage2MatView(img);
+    cv::Mat polarImg;
+
+    qDebug() << "scale log: " << scaleLog << " inverted: " << invert;
+    logPolar(mImg, polarImg, cv::Point2d(mImg.cols * 0.5, mImg.rows * 0.5), scaleLog, angle);
+
+    img = DkImage::mat2QImageView(polarImg);
+}
+
+#endif
+
+/**
+ * Blurs the image with a gaussian.
+ * Small kernels are convolved directly, larger sigmas are approximated
+ * with box blurs whose cost does not depend on sigma (see boxBlur()).
+ * @param img the image - it is blurred in place
+ * @param sigma the gaussian's standard deviation
+ * @return bool true
+ **/
+bool DkImage::gaussianBlur(QImage &img, float sigma)
+{
+    DkTimer dt;
+
+#ifdef WITH_OPENCV
+    // a few taps are cheaper (and more accurate) than the boxes
+    if (sigma < 3.0f) {
+        cv::Mat imgCv = DkImage::qImage2MatView(img);
+
+        cv::Mat imgG;
+        cv::Mat gx = cv::getGaussianKernel(qRound(4 * sigma + 1), sigma);
+        cv::Mat gy = gx.t();
+        cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
+        img = DkImage::mat2QImageView(imgG);
+
+        qDebug() << "gaussian blur takes: " << dt;
+        return true;
+    }
+#endif
+
+    boxBlur(img, sigma);
+    qDebug() << "gaussian blur takes: " << dt;
+
+    return true;
+}
+
+/**
+ * Sharpens the image: img * weight + blurred * (1 - weight).
+ * @param img the image - it is sharpened in place
+ * @param sigma the standard deviation of the blur (see gaussianBlur())
+ * @param weight the weight of the image (> 1 sharpens)
+ * @return bool true
+ **/
+bool DkImage::unsharpMask(QImage &img, float sigma, float weight)
+{
+    DkTimer dt;
+
+    QImage blurred = img;
+    gaussianBlur(blurred, sigma);
 
-    int x, y;
-    cv::Mat bufx, bufy, bufp, bufa;
-    double ascale = ssize.height / (2 * CV_PI);
-    cv::AutoBuffer<float> _buf(4 * dsize.width);
-    float *buf = _buf;
+    // the blur might have converted the format
+    if (blurred.format() != img.format())
+        img = img.convertToFormat(blurred.format());
 
-    bufx = cv::Mat(1, dsize.width, CV_32F, buf);
-    bufy = cv::Mat(1, dsize.width, CV_32F, buf + dsize.width);
-    bufp = cv::Mat(1, dsize.width, CV_32F, buf + dsize.width * 2);
-    bufa = cv::Mat(1, dsize.width, CV_32F, buf + dsize.width * 3);
+    const int bpl = (img.width() * img.depth() + 7) / 8;
+    const float bw = 1.0f - weight;
 
-    for (x = 0; x < dsize.width; x++)
-        bufx.ptr<float>()[x] = (float)(x - center.x);
+    // detach once - scanLine() must not detach in the worker threads
+    uchar *data = img.bits();
+    const int stride = img.bytesPerLine();
 
-    for (y = 0; y < dsize.height; y++) {
-        float *mx = mapx.ptr<float>(y);
-        float *my = mapy.ptr<float>(y);
+    parallelRows(img.height(), [&](int firstRow, int lastRow) {
+        for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+            uchar *ptr = data + rIdx * stride;
+            const uchar *bPtr = blurred.constScanLine(rIdx);
 
-        for (x = 0; x < dsize.width; x++)
-            bufy.ptr<float>()[x] = (float)(y - center.y);
+            for (int cIdx = 0; cIdx < bpl; cIdx++)
+                ptr[cIdx] = (uchar)qBound(0, qRound(ptr[cIdx] * weight + bPtr[cIdx] * bw), 255);
+        }
+    });
 
-        cv::cartToPolar(bufx, bufy, bufp, bufa);
+    qDebug() << "unsharp mask takes: " << dt;
 
-        for (x = 0; x < dsize.width; x++) {
-            bufp.ptr<float>()[x] /= (float)scaleLog;
-            bufp.ptr<float>()[x] += 1.0f;
-        }
+    return true;
+}
 
-        cv::log(bufp, bufp);
+/**
+ * The radii of numBoxes box blurs that approximate a gaussian.
+ * See Kovesi, "Fast Almost-Gaussian Filtering", 2010.
+ * @param sigma the gaussian's standard deviation
+ * @param numBoxes the number of consecutive box blurs
+ * @return QVector<int> the radius of each box
+ **/
+QVector<int> DkImage::boxBlurRadii(float sigma, int numBoxes)
+{
+    double s2 = 12.0 * sigma * sigma;
 
-        for (x = 0; x < dsize.width; x++) {
-            double rho = bufp.ptr<float>()[x] * scale;
-            double phi = bufa.ptr<float>()[x] + angle;
+    int wl = qFloor(qSqrt(s2 / numBoxes + 1.0));
+    if (wl % 2 == 0)
+        wl--;
+    int wu = wl + 2;
 
-            if (phi < 0)
-                phi += 2 * CV_PI;
-            else if (phi > 2 * CV_PI)
-                phi -= 2 * CV_PI;
+    // the number of boxes with the smaller width
+    int m = qRound((s2 - numBoxes * wl * wl - 4.0 * numBoxes * wl - 3.0 * numBoxes) / (-4.0 * wl - 4.0));
 
-            phi *= ascale;
+    QVector<int> radii;
+    for (int idx = 0; idx < numBoxes; idx++)
+        radii << ((idx < m ? wl : wu) - 1) / 2;
 
-            // qDebug() << "phi: " << bufa.data.fl[x];
+    return radii;
+}
 
-            mx[x] = (float)rho;
-            my[x] = (float)phi;
+/**
+ * Box blurs all channels of a row (edges are replicated).
+ * The window is a running sum - so each pixel costs two additions.
+ **/
+static void boxBlurRow(const uchar *src, uchar *dst, int width, int cn, int r)
+{
+    const float norm = 1.0f / (2 * r + 1);
+    const int last = width - 1;
+
+    for (int c = 0; c < cn; c++) {
+        const uchar *s = src + c;
+        uchar *d = dst + c;
+
+        // the window of the first pixel is [-r r]
+        int sum = r * s[0];
+        for (int x = 0; x < r; x++)
+            sum += s[qMin(x, last) * cn];
+
+        for (int x = 0; x < width; x++) {
+            sum += s[qMin(x + r, last) * cn];
+            d[x * cn] = (uchar)(sum * norm + 0.5f);
+            sum -= s[qMax(x - r, 0) * cn];
         }
     }
-
-    cv::remap(src, dst, mapx, mapy, CV_INTER_AREA, IPL_BORDER_REPLICATE);
 }
 
-void DkImage::tinyPlanet(QImage &img, double scaleLog, double angle, QSize s, bool invert /* = false */)
+/**
+ * Box blurs the byte columns [firstCol lastCol) (edges are replicated).
+ * Rows are traversed top to bottom so that memory is accessed sequentially.
+ **/
+static void boxBlurColumns(const uchar *src, int srcStride, uchar *dst, int dstStride, int height, int firstCol, int lastCol, int r)
 {
-    QTransform rotationMatrix;
-    rotationMatrix.rotate((invert) ? (double)-90 : (double)90);
-    img = img.transformed(rotationMatrix);
+    const float norm = 1.0f / (2 * r + 1);
+    const int last = height - 1;
 
-    // make square
-    img = img.scaled(s, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    QVector<int> sums(lastCol - firstCol);
+    int *sum = sums.data() - firstCol;
 
-    cv::Mat mImg = DkImage::qImage2Mat(img);
+    for (int cIdx = firstCol; cIdx < lastCol; cIdx++)
+        sum[cIdx] = r * src[cIdx];
 
-    qDebug() << "scale log: " << scaleLog << " inverted: " << invert;
-    logPolar(mImg, mImg, cv::Point2d(mImg.cols * 0.5, mImg.rows * 0.5), scaleLog, angle);
+    for (int y = 0; y < r; y++) {
+        const uchar *row = src + qMin(y, last) * srcStride;
 
-    img = DkImage::mat2QImage(mImg);
-}
+        for (int cIdx = firstCol; cIdx < lastCol; cIdx++)
+            sum[cIdx] += row[cIdx];
+    }
 
-#endif
+    for (int y = 0; y < height; y++) {
+        const uchar *add = src + qMin(y + r, last) * srcStride;
+        const uchar *sub = src + qMax(y - r, 0) * srcStride;
+        uchar *d = dst + y * dstStride;
 
-bool DkImage::gaussianBlur(QImage &img, float sigma)
-{
-#ifdef WITH_OPENCV
-    DkTimer dt;
-    cv::Mat imgCv = DkImage::qImage2Mat(img);
+        for (int cIdx = firstCol; cIdx < lastCol; cIdx++) {
+            sum[cIdx] += add[cIdx];
+            d[cIdx] = (uchar)(sum[cIdx] * norm + 0.5f);
+            sum[cIdx] -= sub[cIdx];
+        }
+    }
+}
 
-    cv::Mat imgG;
-    cv::Mat gx = cv::getGaussianKernel(qRound(4 * sigma + 1), sigma);
-    cv::Mat gy = gx.t();
-    cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
-    img = DkImage::mat2QImage(imgG);
+/**
+ * Approximates a gaussian blur with three consecutive box blurs.
+ * Each box is a running sum, so the cost does not depend on sigma.
+ * Rows (and byte columns) are processed in parallel blocks.
+ * @param img the image - it is blurred in place (formats other than 8, 24 and 32 bit are converted)
+ * @param sigma the gaussian's standard deviation
+ **/
+void DkImage::boxBlur(QImage &img, float sigma)
+{
+    if (img.isNull())
+        return;
 
-    qDebug() << "gaussian blur takes: " << dt;
-#else
-    Q_UNUSED(img);
-    Q_UNUSED(sigma);
-#endif
+    if (img.format() == QImage::Format_Indexed8 || (img.depth() != 8 && img.depth() != 24 && img.depth() != 32))
+        img = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
 
-    return true;
-}
+    const int width = img.width();
+    const int height = img.height();
+    const int cn = img.depth() / 8;
+    const int bpl = width * cn;
+    const int stride = img.bytesPerLine();
 
-bool DkImage::unsharpMask(QImage &img, float sigma, float weight)
-{
-#ifdef WITH_OPENCV
-    DkTimer dt;
-    // DkImage::gammaToLinear(img);
-    cv::Mat imgCv = DkImage::qImage2Mat(img);
+    // rows are blurred from the image to the buffer and columns back
+    QVector<uchar> buffer(bpl * height);
+    uchar *tmp = buffer.data();
+    uchar *data = img.bits();
 
-    cv::Mat imgG;
-    cv::Mat gx = cv::getGaussianKernel(qRound(4 * sigma + 1), sigma);
-    cv::Mat gy = gx.t();
-    cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
-    // cv::GaussianBlur(imgCv, imgG, cv::Size(4*sigma+1, 4*sigma+1), sigma);		// this is awesomely slow
-    cv::addWeighted(imgCv, weight, imgG, 1 - weight, 0, imgCv);
-    img = DkImage::mat2QImage(imgCv);
+    for (int r : boxBlurRadii(sigma, 3)) {
+        if (r < 1)
+            continue;
 
-    qDebug() << "unsharp mask takes: " << dt;
-    // DkImage::linearToGamma(img);
-#else
-    Q_UNUSED(img);
-    Q_UNUSED(sigma);
-    Q_UNUSED(weight);
-#endif
+        parallelRows(height, [&](int firstRow, int lastRow) {
+            for (int rIdx = firstRow; rIdx < lastRow; rIdx++)
+                boxBlurRow(data + rIdx * stride, tmp + rIdx * bpl, width, cn, r);
+        });
 
-    return true;
+        parallelRows(bpl, [&](int firstCol, int lastCol) {
+            boxBlurColumns(tmp, bpl, data, stride, height, firstCol, lastCol, r);
+        });
+    }
 }
 
 QImage DkImage::createThumb(const QImage &image, int maxSize)
@@ -1396,58 +3050,586 @@ bool DkImage::addToImage(QImage &img, unsigned char val)
     return done;
 }
 
-QColor DkImage::getMeanColor(const QImage &img)
+// finds the most frequent (quantized) color of a sampled image
+struct DkMeanColorKernel {
+    DkMeanColorKernel(const QImage &img, int numCols)
+        : img(img)
+        , numCols(numCols)
+        , counts((numCols + 1) * (numCols + 1) * (numCols + 1), 0)
+    {
+        // some speed-up params
+        rStep = qRound(img.height() / 100.0f) + 1;
+        cStep = qRound(img.width() / 100.0f) + 1;
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        for (int rIdx = 0; rIdx < img.height(); rIdx += rStep) {
+            const C *ptr = reinterpret_cast<const C *>(img.constScanLine(rIdx));
+
+            for (int cIdx = 0; cIdx < img.width(); cIdx += cStep) {
+                const C *px = ptr + cIdx * L::channels;
+                add(quantize(px[L::red], L::maxValue), quantize(px[L::green], L::maxValue), quantize(px[L::blue], L::maxValue));
+            }
+        }
+    }
+
+    // e.g. indexed images
+    void runGeneric()
+    {
+        for (int rIdx = 0; rIdx < img.height(); rIdx += rStep) {
+            for (int cIdx = 0; cIdx < img.width(); cIdx += cStep) {
+                QRgb c = img.pixel(cIdx, rIdx);
+                add(quantize(qRed(c), 255), quantize(qGreen(c), 255), quantize(qBlue(c), 255));
+            }
+        }
+    }
+
+    inline int quantize(quint32 v, quint32 maxValue) const
+    {
+        return (int)((2 * v * numCols + maxValue) / (2 * maxValue));
+    }
+
+    void add(int r, int g, int b)
+    {
+        // skip black and white
+        if (r < 3 && g < 3 && b < 3)
+            return;
+        if (r > numCols - 3 && g > numCols - 3 && b > numCols - 3)
+            return;
+
+        int &c = counts[(r * (numCols + 1) + g) * (numCols + 1) + b];
+
+        if (++c > maxCount) {
+            maxCount = c;
+            maxCol = qRgb(r, g, b);
+        }
+    }
+
+    const QImage &img;
+    int numCols;
+    int rStep = 1;
+    int cStep = 1;
+
+    std::vector<int> counts;
+    int maxCount = 0;
+    QRgb maxCol = 0;
+};
+
+QColor DkImage::getMeanColor(const QImage &img)
+{
+    const int numCols = 42;
+
+    DkMeanColorKernel k(img, numCols);
+
+    if (!DkPixelFormat::dispatch(img.format(), k))
+        k.runGeneric();
+
+    if (k.maxCount > 0)
+        return QColor(qRound((float)qRed(k.maxCol) / numCols * 255),
+                      qRound((float)qGreen(k.maxCol) / numCols * 255),
+                      qRound((float)qBlue(k.maxCol) / numCols * 255));
+    else
+        return DkSettingsManager::param().display().hudBgColor;
+}
+
+// DkImageHistogram --------------------------------------------------------------------
+/**
+ * Computes the histogram of img.
+ * @param img an 8, 24 or 32 bit image or a 16 bit per channel image (Grayscale16, RGBA64)
+ * @param step only every step-th row and column is counted if > 1
+ * @return DkImageHistogram the histogram (empty if the format is not supported)
+ **/
+DkImageHistogram DkImageHistogram::fromImage(const QImage &img, int step)
+{
+    DkImageHistogram h;
+
+    bool highBitDepth = isHighBitDepth(img);
+
+    if (img.isNull() || (img.depth() != 8 && img.depth() != 24 && img.depth() != 32 && !highBitDepth))
+        return h;
+
+    DkTimer dt;
+
+    step = qMax(step, 1);
+
+    // at least 64 rows per thread
+    int numBlocks = qBound(1, img.height() / (64 * step), QThread::idealThreadCount());
+    int blockSize = (img.height() + numBlocks - 1) / numBlocks;
+    blockSize = (blockSize + step - 1) / step * step; // blocks start at sampled rows
+
+    QVector<QFuture<DkImageHistogram>> parts;
+
+    for (int rIdx = blockSize; rIdx < img.height(); rIdx += blockSize) {
+        int lastRow = qMin(rIdx + blockSize, img.height());
+
+        parts << QtConcurrent::run([img, rIdx, lastRow, step, highBitDepth]() {
+            DkImageHistogram ph;
+            if (highBitDepth)
+                ph.countHighBitDepth(img, rIdx, lastRow, step);
+            else
+                ph.count(img, rIdx, lastRow, step);
+            return ph;
+        });
+    }
+
+    // the first block is ours
+    if (highBitDepth)
+        h.countHighBitDepth(img, 0, qMin(blockSize, img.height()), step);
+    else
+        h.count(img, 0, qMin(blockSize, img.height()), step);
+
+    for (QFuture<DkImageHistogram> &p : parts)
+        h.add(p.result());
+
+    h.imageKey = img.cacheKey();
+    h.exact = step == 1;
+
+    qCDebug(lcHistogram) << "[DkImageHistogram] computed in" << dt << "with" << numBlocks << "threads";
+
+    return h;
+}
+
+/**
+ * Merges a partial histogram.
+ * @param other the histogram of other pixels
+ **/
+void DkImageHistogram::add(const DkImageHistogram &other)
+{
+    for (int cIdx = 0; cIdx < 3; cIdx++) {
+        for (int idx = 0; idx < 256; idx++)
+            hist[cIdx][idx] += other.hist[cIdx][idx];
+    }
+
+    // empty partial histograms have no valid extrema
+    if (other.minValue != -1)
+        minValue = (minValue == -1) ? other.minValue : qMin(minValue, other.minValue);
+    maxValue = qMax(maxValue, other.maxValue);
+
+    bitDepth = qMax(bitDepth, other.bitDepth);
+    numPixels += other.numPixels;
+    numZeroPixels += other.numZeroPixels;
+    numSaturatedPixels += other.numSaturatedPixels;
+    minBinValue = qMin(minBinValue, other.minBinValue);
+    maxBinValue = qMax(maxBinValue, other.maxBinValue);
+}
+
+/**
+ * True for images with 16 bits per channel.
+ * @param img the image
+ * @return bool true if img is Grayscale16 or RGBA64 (RGBX64, premultiplied)
+ **/
+bool DkImageHistogram::isHighBitDepth(const QImage &img)
+{
+    switch (img.format()) {
+    case QImage::Format_Grayscale16:
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool DkImageHistogram::isEmpty() const
+{
+    return numPixels == 0;
+}
+
+/**
+ * Index of the first (8 bit) bin that is not empty.
+ * @param channel the channel (0 red, 1 green, 2 blue)
+ * @return int the bin's index or -1 if the histogram is empty
+ **/
+int DkImageHistogram::firstBin(int channel) const
+{
+    for (int idx = 0; idx < 256; idx++) {
+        if (hist[channel][idx])
+            return idx;
+    }
+
+    return -1;
+}
+
+/**
+ * Index of the last (8 bit) bin that is not empty.
+ * @param channel the channel (0 red, 1 green, 2 blue)
+ * @return int the bin's index or -1 if the histogram is empty
+ **/
+int DkImageHistogram::lastBin(int channel) const
+{
+    for (int idx = 255; idx >= 0; idx--) {
+        if (hist[channel][idx])
+            return idx;
+    }
+
+    return -1;
+}
+
+// exact histograms of recently used image versions (keyed by QImage::cacheKey())
+static QMutex histCacheMutex;
+static QCache<qint64, DkImageHistogram> histCache(16);
+
+/**
+ * Returns the exact histogram of img.
+ * It is computed (and cached) if it was not computed for this version of the image before.
+ * @param img the image
+ * @return DkImageHistogram the histogram (empty if the format is not supported)
+ **/
+DkImageHistogram DkImageHistogram::statistics(const QImage &img)
+{
+    DkImageHistogram h = cached(img);
+
+    if (h.isEmpty()) {
+        h = fromImage(img);
+        cache(h);
+    }
+
+    return h;
+}
+
+/**
+ * Returns the cached histogram of img.
+ * @param img the image
+ * @return DkImageHistogram the exact histogram or an empty histogram if it is not cached
+ **/
+DkImageHistogram DkImageHistogram::cached(const QImage &img)
+{
+    if (img.isNull())
+        return DkImageHistogram();
+
+    QMutexLocker lock(&histCacheMutex);
+    DkImageHistogram *h = histCache.object(img.cacheKey());
+
+    return h ? *h : DkImageHistogram();
+}
+
+/**
+ * Caches an exact histogram - sampled histograms are ignored.
+ * @param hist the histogram (its imageKey must be set)
+ **/
+void DkImageHistogram::cache(const DkImageHistogram &hist)
+{
+    if (hist.isEmpty() || !hist.exact || !hist.imageKey)
+        return;
+
+    QMutexLocker lock(&histCacheMutex);
+    histCache.insert(hist.imageKey, new DkImageHistogram(hist));
+}
+
+// counts 8 bit histograms (the high byte of 16 bit channels)
+struct DkHistogramKernel {
+    DkHistogramKernel(const QImage &img, int firstRow, int lastRow, int step)
+        : img(img)
+        , firstRow(firstRow)
+        , lastRow(lastRow)
+        , step(step)
+    {
+    }
+
+    template<typename L>
+    void run()
+    {
+        typedef typename L::Channel C;
+
+        const int shift = 8 * (sizeof(C) - 1);
+        const int width = img.width();
+
+        gray = L::channels == 1;
+
+        for (int rIdx = firstRow; rIdx < lastRow; rIdx += step) {
+            const C *pixel = reinterpret_cast<const C *>(img.constScanLine(rIdx));
+
+            for (int cIdx = 0, k = 0; cIdx < width; cIdx += step, k ^= 1, pixel += L::channels * step) {
+                int(*hc)[256] = h2[k];
+
+                if (L::channels == 1) {
+                    hc[0][pixel[0] >> shift]++;
+                    continue;
+                }
+
+                int r = pixel[L::red] >> shift;
+                int g = pixel[L::green] >> shift;
+                int b = pixel[L::blue] >> shift;
+                hc[0][r]++;
+                hc[1][g]++;
+                hc[2][b]++;
+
+                int rgb = r | (g << 8) | (b << 16);
+                numZeroPixels += rgb == 0;
+                numSaturatedPixels += rgb == 0xffffff;
+            }
+        }
+    }
+
+    const QImage &img;
+    int firstRow;
+    int lastRow;
+    int step;
+
+    // consecutive pixels are counted into two separate histograms
+    int h2[2][3][256] = {};
+    bool gray = false;
+    int numZeroPixels = 0;
+    int numSaturatedPixels = 0;
+};
+
+/**
+ * Counts the pixels of rows [firstRow lastRow) - every step-th pixel if step > 1.
+ * Consecutive pixels are counted into two separate histograms so that
+ * increments of equal values do not stall on each other.
+ **/
+void DkImageHistogram::count(const QImage &img, int firstRow, int lastRow, int step)
+{
+    DkHistogramKernel k(img, firstRow, lastRow, step);
+
+    numPixels = ((img.width() + step - 1) / step) * ((lastRow - firstRow + step - 1) / step);
+
+    // other formats are counted by their bytes (e.g. indexed images)
+    if (!DkPixelFormat::dispatch(img.format(), k)) {
+        if (img.depth() == 8)
+            k.run<DkGray8>();
+        else if (img.depth() == 24)
+            k.run<DkRgb888>();
+        else
+            k.run<DkRgb32>();
+    }
+
+    if (k.gray) {
+        for (int idx = 0; idx < 256; idx++) {
+            int v = k.h2[0][0][idx] + k.h2[1][0][idx];
+
+            hist[0][idx] = v;
+            hist[1][idx] = v;
+            hist[2][idx] = v;
+
+            if (v && idx < minBinValue)
+                minBinValue = idx;
+            if (v && idx > maxBinValue)
+                maxBinValue = idx;
+        }
+
+        numSaturatedPixels = hist[0][255];
+        return;
+    }
+
+    for (int cIdx = 0; cIdx < 3; cIdx++) {
+        for (int idx = 0; idx < 256; idx++)
+            hist[cIdx][idx] = k.h2[0][cIdx][idx] + k.h2[1][cIdx][idx];
+    }
+
+    numZeroPixels = k.numZeroPixels;
+    numSaturatedPixels = k.numSaturatedPixels;
+}
+
+/**
+ * Counts the pixels of 16 bit images - rows [firstRow lastRow), every step-th pixel if step > 1.
+ * Values are counted into the 256 display bins (the high byte) - the extrema keep the full range.
+ **/
+void DkImageHistogram::countHighBitDepth(const QImage &img, int firstRow, int lastRow, int step)
+{
+    const int width = img.width();
+    const bool gray = img.format() == QImage::Format_Grayscale16;
+    const int numChannels = gray ? 1 : 3;
+    const int pixelStride = gray ? step : 4 * step; // RGBA64 is stored as 4 quint16 (R, G, B, A)
+
+    bitDepth = 16;
+    numPixels = ((width + step - 1) / step) * ((lastRow - firstRow + step - 1) / step);
+
+    for (int rIdx = firstRow; rIdx < lastRow; rIdx += step) {
+        const quint16 *pixel = reinterpret_cast<const quint16 *>(img.constScanLine(rIdx));
+
+        for (int cIdx = 0; cIdx < width; cIdx += step, pixel += pixelStride) {
+            for (int ch = 0; ch < numChannels; ch++) {
+                hist[ch][pixel[ch] >> 8]++;
+            }
+
+            if (gray) {
+                if (minValue == -1 || pixel[0] < minValue)
+                    minValue = pixel[0];
+                maxValue = qMax(maxValue, (int)pixel[0]);
+                numZeroPixels += pixel[0] == 0;
+                numSaturatedPixels += pixel[0] == 0xffff;
+            } else {
+                numZeroPixels += (pixel[0] | pixel[1] | pixel[2]) == 0;
+                numSaturatedPixels += (pixel[0] & pixel[1] & pixel[2]) == 0xffff;
+            }
+        }
+    }
+
+    if (!gray)
+        return;
+
+    // gray: duplicate the channels
+    for (int idx = 0; idx < 256; idx++) {
+        hist[1][idx] = hist[0][idx];
+        hist[2][idx] = hist[0][idx];
+
+        if (hist[0][idx] && idx < minBinValue)
+            minBinValue = idx;
+        if (hist[0][idx] && idx > maxBinValue)
+            maxBinValue = idx;
+    }
+}
+
+// DkColorManager --------------------------------------------------------------------
+DkColorManager::DkColorManager()
+{
+}
+
+DkColorManager &DkColorManager::instance()
+{
+    static DkColorManager inst;
+    return inst;
+}
+
+/**
+ * True if img has to be converted before it is drawn.
+ * Images without a color space are considered sRGB.
+ * @param img the image to draw
+ **/
+bool DkColorManager::needsTransform(const QImage &img)
+{
+    if (!DkSettingsManager::snapshot()->display().colorManagement || img.isNull() || !img.colorSpace().isValid())
+        return false;
+
+    return img.colorSpace() != displayColorSpace();
+}
+
+/**
+ * Converts img to the display's color space.
+ * @param img an image with a color space (e.g. from an embedded ICC profile)
+ * @return QImage the converted image (or img if no conversion is needed)
+ **/
+QImage DkColorManager::toDisplay(const QImage &img)
+{
+    if (!needsTransform(img))
+        return img;
+
+    QColorTransform t;
+    QColorSpace display;
+    {
+        QMutexLocker locker(&mMutex);
+        display = displayColorSpaceIntern();
+
+        int idx = -1;
+        for (int tIdx = 0; tIdx < mTransforms.size(); tIdx++) {
+            if (mTransforms[tIdx].first == img.colorSpace()) {
+                idx = tIdx;
+                break;
+            }
+        }
+
+        if (idx != -1) {
+            mTransforms.append(mTransforms.takeAt(idx));
+        } else {
+            mTransforms.append(qMakePair(img.colorSpace(), img.colorSpace().transformationToColorSpace(display)));
+
+            if (mTransforms.size() > max_transforms)
+                mTransforms.removeFirst();
+        }
+
+        t = mTransforms.last().second;
+    }
+
+    // the transform interpolates the profile's curves with LUTs (SIMD)
+    QImage dst = img;
+    dst.applyColorTransform(t);
+    dst.setColorSpace(display);
+
+    return dst;
+}
+
+QColorSpace DkColorManager::displayColorSpace()
+{
+    QMutexLocker locker(&mMutex);
+    return displayColorSpaceIntern();
+}
+
+/**
+ * Forgets the display profile and all transforms (e.g. if the profile was changed).
+ * Images that were converted before are dropped by their owners (see revision()).
+ **/
+void DkColorManager::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mDisplayLoaded = false;
+    mTransforms.clear();
+    mRevision.fetchAndAddOrdered(1);
+}
+
+/**
+ * The revision changes whenever the color management changes.
+ * Caches of converted images compare it to the revision they were converted with.
+ **/
+int DkColorManager::revision() const
+{
+    return mRevision.loadAcquire();
+}
+
+QColorSpace DkColorManager::displayColorSpaceIntern()
 {
-    // some speed-up params
-    int nC = qRound(img.depth() / 8.0f);
-    int rStep = qRound(img.height() / 100.0f) + 1;
-    int cStep = qRound(img.width() / 100.0f) + 1;
-    int numCols = 42;
-
-    int offset = (nC > 1) ? 1 : 0; // no offset for grayscale images
-    QMap<QRgb, int> colLookup;
-    int maxColCount = 0;
-    QRgb maxCol = 0;
+    if (mDisplayLoaded)
+        return mDisplay;
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx += rStep) {
-        const unsigned char *pixel = img.constScanLine(rIdx);
+    mDisplayLoaded = true;
+    mDisplay = QColorSpace(QColorSpace::SRgb);
 
-        for (int cIdx = 0; cIdx < img.width() * nC; cIdx += cStep * nC) {
-            QColor cColC(qRound(pixel[cIdx + 2 * offset] / 255.0f * numCols),
-                         qRound(pixel[cIdx + offset] / 255.0f * numCols),
-                         qRound(pixel[cIdx] / 255.0f * numCols));
-            QRgb cCol = cColC.rgb();
+    QString path = DkSettingsManager::snapshot()->display().displayProfile;
 
-            //// skip black
-            // if (cColC.saturation() < 10)
-            //	continue;
-            if (qRed(cCol) < 3 && qGreen(cCol) < 3 && qBlue(cCol) < 3)
-                continue;
-            if (qRed(cCol) > numCols - 3 && qGreen(cCol) > numCols - 3 && qBlue(cCol) > numCols - 3)
-                continue;
+    if (!path.isEmpty()) {
+        QFile file(path);
+        QColorSpace cs;
 
-            if (colLookup.contains(cCol)) {
-                colLookup[cCol]++;
-            } else
-                colLookup[cCol] = 1;
+        if (file.open(QIODevice::ReadOnly))
+            cs = QColorSpace::fromIccProfile(file.readAll());
 
-            if (colLookup[cCol] > maxColCount) {
-                maxCol = cCol;
-                maxColCount = colLookup[cCol];
-            }
-        }
+        if (cs.isValid()) {
+            mDisplay = cs;
+            qInfo() << "[Color] display profile:" << cs.description();
+        } else
+            qWarning() << "[Color] could not read the display profile:" << path;
     }
 
-    if (maxColCount > 0)
-        return QColor(qRound((float)qRed(maxCol) / numCols * 255), qRound((float)qGreen(maxCol) / numCols * 255), qRound((float)qBlue(maxCol) / numCols * 255));
-    else
-        return DkSettingsManager::param().display().hudBgColor;
+    return mDisplay;
 }
 
 // DkImageStorage --------------------------------------------------------------------
+// converted tiles of the images drawn (key: image cache key, tile index)
+struct DkTileCache {
+    QCache<QPair<qint64, int>, QPixmap> tiles; // KB
+    int colorRevision = 0;
+};
+
+/**
+ * Returns the tiles of all image storages.
+ * They share one budget - otherwise each viewport (e.g. in the compare mode) could keep 128 MB.
+ * Tiles are only converted and drawn in the GUI thread.
+ **/
+static DkTileCache &tileCache()
+{
+    static DkTileCache *cache = 0;
+
+    if (!cache) {
+        cache = new DkTileCache();
+        cache->tiles.setMaxCost(128 * 1024); // KB
+
+        DkTelemetry::instance().addProvider(cache, [](DkTelemetry::Stats &stats) {
+            stats.memory[DkTelemetry::mem_image_storage] += (qint64)tileCache().tiles.totalCost() * 1024;
+        });
+    }
+
+    return *cache;
+}
+
 DkImageStorage::DkImageStorage(const QImage &img)
 {
     mImg = img;
+    setPyramid(img);
 
     mWaitTimer = new QTimer(this);
     mWaitTimer->setSingleShot(true);
@@ -1462,6 +3644,37 @@ DkImageStorage::DkImageStorage(const QImage &img)
             this,
             SLOT(antiAliasingChanged(bool)),
             Qt::UniqueConnection);
+
+    DkTelemetry::instance().addProvider(this, [this](DkTelemetry::Stats &stats) {
+        stats.memory[DkTelemetry::mem_image_storage] += memoryUsage();
+    });
+}
+
+DkImageStorage::~DkImageStorage()
+{
+    DkTelemetry::instance().removeProvider(this);
+}
+
+/**
+ * Returns the memory of all copies (scaled image & pyramid).
+ * The image itself is not counted since it is shared with its container.
+ * The tiles are shared by all storages and reported separately.
+ * @return qint64 the memory in bytes
+ **/
+qint64 DkImageStorage::memoryUsage() const
+{
+    qint64 bytes = (mScaledImg.cacheKey() != mImg.cacheKey()) ? mScaledImg.sizeInBytes() : 0;
+
+    {
+        QMutexLocker locker(&mPyramidMutex);
+
+        for (int idx = 1; idx < mPyramid.size(); idx++)
+            bytes += mPyramid[idx].sizeInBytes();
+    }
+
+    bytes += mDisplayImg.sizeInBytes();
+
+    return bytes;
 }
 
 void DkImageStorage::init()
@@ -1476,21 +3689,107 @@ void DkImageStorage::setImage(const QImage &img)
 {
     init();
     mImg = img;
+    setPyramid(img);
+    mDisplayImg = QImage();
+    mDisplaySrcKey = 0;
 
     mComputeState = l_cancelled;
 }
 
+/**
+ * Sets the image together with pyramid levels that were built in advance (see pyramid()).
+ * Hence, the image can be drawn filtered right away (e.g. for slideshow transitions).
+ * @param img the full resolution image
+ * @param pyramid the pyramid of img
+ **/
+void DkImageStorage::setImage(const QImage &img, const QVector<QImage> &pyramid)
+{
+    setImage(img);
+
+    if (!pyramid.isEmpty() && pyramid.first().cacheKey() == img.cacheKey()) {
+        QMutexLocker locker(&mPyramidMutex);
+        mPyramid = pyramid;
+    }
+}
+
+/**
+ * Builds the pyramid levels of img that are needed to draw it with size.
+ * This function is thread-safe.
+ * @param img the full resolution image
+ * @param size the size the image will be drawn with
+ * @return QVector<QImage> the pyramid (the first level is img)
+ **/
+QVector<QImage> DkImageStorage::pyramid(const QImage &img, const QSize &size)
+{
+    QVector<QImage> levels;
+
+    if (img.isNull())
+        return levels;
+
+    levels << img;
+
+    if (!size.isEmpty())
+        extendPyramid(levels, size);
+
+    return levels;
+}
+
+/**
+ * Adds levels until the next one would be smaller than size.
+ * @param levels the pyramid (at least the base level)
+ * @param size the requested size
+ **/
+void DkImageStorage::extendPyramid(QVector<QImage> &levels, const QSize &size)
+{
+    for (QImage l = levels.last(); (l.width() + 1) / 2 >= size.width() && (l.height() + 1) / 2 >= size.height();) {
+        l = halfSize(l);
+
+        // 1px levels do not get any smaller
+        if (l.isNull() || l.size() == levels.last().size())
+            break;
+
+        // OpenCV does not know color spaces
+        l.setColorSpace(levels.first().colorSpace());
+
+        levels << l;
+    }
+}
+
+/**
+ * Resets the pyramid to its base level.
+ * @param img the full resolution image
+ **/
+void DkImageStorage::setPyramid(const QImage &img)
+{
+    QMutexLocker locker(&mPyramidMutex);
+    mPyramid.clear();
+
+    if (!img.isNull())
+        mPyramid << img;
+}
+
 void DkImageStorage::antiAliasingChanged(bool antiAliasing)
 {
-    DkSettingsManager::param().display().antiAliasing = antiAliasing;
+    DkSettingsManager::edit().display().antiAliasing = antiAliasing;
 
-    if (!antiAliasing)
+    if (!antiAliasing) {
         init();
+        setPyramid(mImg); // free the levels
+    }
 
     emit infoSignal((antiAliasing) ? tr("Anti Aliasing Enabled") : tr("Anti Aliasing Disabled"));
     emit imageUpdated();
 }
 
+/**
+ * True if the anti-aliased image is computed or scheduled.
+ * Until then, image() returns a pyramid level.
+ **/
+bool DkImageStorage::isComputing() const
+{
+    return mComputeState == l_computing || (mWaitTimer && mWaitTimer->isActive());
+}
+
 QImage DkImageStorage::imageConst() const
 {
     return mImg;
@@ -1498,6 +3797,8 @@ QImage DkImageStorage::imageConst() const
 
 QImage DkImageStorage::image(const QSize &size)
 {
+    checkColorRevision();
+
     if (size.isEmpty() || mImg.isNull() || !DkSettingsManager::param().display().antiAliasing || // user disabled?
         mImg.size().width() < size.width() // scale factor > 1?
     )
@@ -1513,10 +3814,136 @@ QImage DkImageStorage::image(const QSize &size)
         mWaitTimer->start();
     }
 
-    // currently no alternative is available
+    // the nearest larger level is already filtered - so it's a good fit until we have the exact size
+    return pyramidLevel(size);
+}
+
+/**
+ * Returns the smallest pyramid level that has at least minPixels.
+ * Only levels that are built already are considered.
+ * @param minPixels the minimal number of pixels
+ * @return QImage the pyramid level (or the original)
+ **/
+QImage DkImageStorage::sampleImage(int minPixels) const
+{
+    QMutexLocker locker(&mPyramidMutex);
+
+    for (int idx = mPyramid.size() - 1; idx > 0; idx--) {
+        const QImage &l = mPyramid[idx];
+
+        if ((qint64)l.width() * l.height() >= minPixels)
+            return l;
+    }
+
+    return mImg;
+}
+
+/**
+ * Returns the smallest pyramid level that is at least as large as size.
+ * Levels are built lazily in computeIntern() - so this falls back to the original.
+ * @param size the requested size
+ * @return QImage the pyramid level
+ **/
+QImage DkImageStorage::pyramidLevel(const QSize &size) const
+{
+    QMutexLocker locker(&mPyramidMutex);
+
+    for (int idx = mPyramid.size() - 1; idx > 0; idx--) {
+        const QImage &l = mPyramid[idx];
+
+        if (l.width() >= size.width() && l.height() >= size.height())
+            return l;
+    }
+
     return mImg;
 }
 
+/**
+ * Returns a tile of img converted for drawing.
+ * Tiles are converted (and color managed) when they are first drawn and cached - so
+ * panning a huge image only converts what becomes visible.
+ * @param img the image (the original or a scaled version)
+ * @param col the tile's column
+ * @param row the tile's row
+ * @return QPixmap the tile (at most tile_size x tile_size)
+ **/
+QPixmap DkImageStorage::tile(const QImage &img, int col, int row)
+{
+    checkColorRevision();
+
+    // tiles that were converted with another display profile are dropped
+    DkTileCache &tc = tileCache();
+
+    if (tc.colorRevision != mColorRevision) {
+        tc.colorRevision = mColorRevision;
+        tc.tiles.clear();
+    }
+
+    int numCols = (img.width() + tile_size - 1) / tile_size;
+    QPair<qint64, int> key(img.cacheKey(), row * numCols + col);
+
+    if (QPixmap *pm = tc.tiles.object(key))
+        return *pm;
+
+    QRect r = QRect(col * tile_size, row * tile_size, tile_size, tile_size) & img.rect();
+
+    if (r.isEmpty())
+        return QPixmap();
+
+    QPixmap *pm = new QPixmap(QPixmap::fromImage(DkColorManager::instance().toDisplay(img.copy(r))));
+    QPixmap tilePm = *pm;
+
+    tc.tiles.insert(key, pm, qMax(r.width() * r.height() * 4 / 1024, 1));
+
+    return tilePm;
+}
+
+/**
+ * Returns img in a format that is drawn without conversion.
+ * Compact images (e.g. RGB888, see DkImage::compactFormat()) would be converted
+ * whenever they are painted - so they are converted once and the last one is cached.
+ * @param img the image (the original or a scaled version)
+ * @return QImage img as (A)RGB32
+ **/
+QImage DkImageStorage::displayImage(const QImage &img)
+{
+    switch (img.format()) {
+    case QImage::Format_Invalid:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return img;
+    default:
+        break;
+    }
+
+    if (img.cacheKey() != mDisplaySrcKey) {
+        mDisplayImg = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        mDisplaySrcKey = img.cacheKey();
+    }
+
+    return mDisplayImg;
+}
+
+/**
+ * Drops the scaled image if the color management changed
+ * (e.g. it was turned off or the display profile changed).
+ **/
+void DkImageStorage::checkColorRevision()
+{
+    int revision = DkColorManager::instance().revision();
+
+    if (revision == mColorRevision)
+        return;
+
+    mColorRevision = revision;
+    mScaledImg = QImage();
+
+    // the running computation converts with the old profile - image() starts a new one
+    if (mComputeState == l_computing)
+        mComputeState = l_cancelled;
+}
+
 void DkImageStorage::cancel()
 {
     mComputeState = l_cancelled;
@@ -1535,47 +3962,84 @@ void DkImageStorage::compute()
 
     mComputeState = l_computing;
 
-    mFutureWatcher.setFuture(QtConcurrent::run(this, &nmc::DkImageStorage::computeIntern, mImg, mSize));
+    QImage img = mImg;
+    QSize size = mSize;
+    bool highQuality = DkSettingsManager::snapshot()->display().highQualityAntiAliasing;
+
+    mFutureWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [this, img, size, highQuality]() {
+        QImage scaled = computeIntern(img, size, highQuality);
+
+        // OpenCV does not know color spaces
+        if (scaled.colorSpace() != img.colorSpace())
+            scaled.setColorSpace(img.colorSpace());
+
+        return DkColorManager::instance().toDisplay(scaled);
+    }));
 }
 
-QImage DkImageStorage::computeIntern(const QImage &src, const QSize &size)
+QImage DkImageStorage::computeIntern(const QImage &src, const QSize &size, bool highQuality)
 {
     // should not happen
-    if (size.width() >= mImg.width()) {
+    if (size.width() >= src.width()) {
         qWarning() << "DkImageStorage::computeIntern was called without a need...";
         return src;
     }
 
     DkTimer dt;
-    QImage resizedImg = src;
 
-    if (!DkSettingsManager::param().display().highQualityAntiAliasing) {
-        QSize cs = src.size();
+    QSize s = size;
 
-        // fast down sampling until the image is twice times full HD
-        while (qMin(cs.width(), cs.height()) > 2 * 4000) {
-            cs *= 0.5;
-        }
+    if (s.height() == 0)
+        s.setHeight(1);
+    if (s.width() == 0)
+        s.setWidth(1);
+
+    QVector<QImage> levels;
+    {
+        QMutexLocker locker(&mPyramidMutex);
+
+        // is the pyramid still built for src?
+        if (!mPyramid.isEmpty() && mPyramid.first().cacheKey() == src.cacheKey())
+            levels = mPyramid;
+    }
+
+    if (levels.isEmpty())
+        levels << src;
+
+    // add levels until the next one would be smaller than the requested size
+    int numLevels = levels.size();
+    extendPyramid(levels, s);
+
+    if (levels.size() > numLevels) {
+        QMutexLocker locker(&mPyramidMutex);
 
-        // for extreme panorama images the Qt scaling crashes (if we have a width > 30000) so we simply
-        if (cs != mImg.size()) {
-            resizedImg = resizedImg.scaled(cs, Qt::KeepAspectRatio, Qt::FastTransformation);
+        if (!mPyramid.isEmpty() && mPyramid.first().cacheKey() == src.cacheKey() && levels.size() > mPyramid.size())
+            mPyramid = levels;
+    }
+
+    // resample from the nearest larger level (less than 2x)
+    QImage resizedImg = src;
+
+    for (int idx = levels.size() - 1; idx > 0; idx--) {
+        if (levels[idx].width() >= s.width() && levels[idx].height() >= s.height()) {
+            resizedImg = levels[idx];
+            break;
         }
     }
 
-    QSize s = mSize;
+    if (resizedImg.size() == s)
+        return resizedImg;
 
-    if (s.height() == 0)
-        s.setHeight(1);
-    if (s.width() == 0)
-        s.setWidth(1);
+    if (!highQuality) {
+        resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        return resizedImg;
+    }
 
 #ifdef WITH_OPENCV
     try {
-        cv::Mat rImgCv = DkImage::qImage2Mat(resizedImg);
         cv::Mat tmp;
-        cv::resize(rImgCv, tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
-        resizedImg = DkImage::mat2QImage(tmp);
+        cv::resize(DkImage::qImage2MatView(resizedImg), tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
+        resizedImg = DkImage::mat2QImageView(tmp);
     } catch (...) {
         qWarning() << "DkImageStorage: OpenCV exception caught while resizing...";
     }
@@ -1586,6 +4050,54 @@ QImage DkImageStorage::computeIntern(const QImage &src, const QSize &size)
     return resizedImg;
 }
 
+/**
+ * Downsamples an image by a factor of 2 (box filter).
+ * @param img the source image
+ * @return QImage the next pyramid level
+ **/
+QImage DkImageStorage::halfSize(const QImage &img)
+{
+    QSize hs((img.width() + 1) / 2, (img.height() + 1) / 2);
+
+#ifdef WITH_OPENCV
+    try {
+        // OpenCV's area interpolation has a fast path for integer factors
+        // and - unlike Qt - does not crash for extreme panoramas (> 30000 px)
+        cv::Mat tmp;
+
+        // the first levels of out-of-core images are mapped too
+        if (DkMappedImage::isMapped(img) && DkMappedImage::shouldMap(hs, img.format())
+            && (img.format() == QImage::Format_Grayscale8 || img.format() == QImage::Format_RGB32 || img.format() == QImage::Format_ARGB32
+                || img.format() == QImage::Format_ARGB32_Premultiplied)) {
+            QImage dst = DkMappedImage::allocate(hs, img.format());
+
+            if (!dst.isNull()) {
+                int type = img.format() == QImage::Format_Grayscale8 ? CV_8UC1 : CV_8UC4;
+                cv::Mat src(img.height(), img.width(), type, (uchar *)img.constBits(), img.bytesPerLine());
+                cv::Mat dstMat(dst.height(), dst.width(), type, dst.bits(), dst.bytesPerLine());
+                cv::resize(src, dstMat, dstMat.size(), 0, 0, CV_INTER_AREA);
+                return dst;
+            }
+        }
+
+        // keep compact grayscale levels (qImage2MatView would expand them to 4 channels)
+        if (img.format() == QImage::Format_Grayscale8) {
+            cv::Mat src(img.height(), img.width(), CV_8UC1, (uchar *)img.constBits(), img.bytesPerLine());
+            cv::resize(src, tmp, cv::Size(hs.width(), hs.height()), 0, 0, CV_INTER_AREA);
+            return QImage(tmp.data, tmp.cols, tmp.rows, (int)tmp.step, QImage::Format_Grayscale8, &releaseMat, new cv::Mat(tmp));
+        }
+
+        cv::resize(DkImage::qImage2MatView(img), tmp, cv::Size(hs.width(), hs.height()), 0, 0, CV_INTER_AREA);
+        return DkImage::mat2QImageView(tmp);
+    } catch (...) {
+        qWarning() << "DkImageStorage: OpenCV exception caught while building the pyramid...";
+        return QImage();
+    }
+#else
+    return img.scaled(hs, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+#endif
+}
+
 void DkImageStorage::imageComputed()
 {
     if (mComputeState == l_cancelled) {
@@ -1602,4 +4114,217 @@ void DkImageStorage::imageComputed()
     else
         qWarning() << "could not compute interpolated image...";
 }
+
+// DkSvgTiles --------------------------------------------------------------------
+// owns the renderer of the worker thread - it is only used by one render task at a time
+class DkSvgRasterizer
+{
+public:
+    DkSvgRasterizer(const QByteArray &svgData)
+        : mSvgData(svgData)
+    {
+    }
+
+    QSvgRenderer *renderer()
+    {
+        if (!mRenderer)
+            mRenderer.reset(new QSvgRenderer(mSvgData));
+
+        return mRenderer.data();
+    }
+
+protected:
+    QByteArray mSvgData;
+    QScopedPointer<QSvgRenderer> mRenderer;
+};
+
+DkSvgTiles::DkSvgTiles(const QByteArray &svgData, const QSize &defaultSize, QObject *parent)
+    : QObject(parent)
+{
+    mRasterizer = QSharedPointer<DkSvgRasterizer>(new DkSvgRasterizer(svgData));
+    mDefaultSize = defaultSize;
+    mTiles.setMaxCost(128 * 1024); // KB
+
+    connect(&mRenderWatcher, SIGNAL(finished()), this, SLOT(tilesRendered()));
+}
+
+DkSvgTiles::~DkSvgTiles()
+{
+    // the render task only holds the (shared) rasterizer - no need to wait for it
+    mRenderWatcher.blockSignals(true);
+}
+
+/**
+ * Draws the cached tiles that intersect the viewport and requests the missing ones.
+ * @param painter the painter with the world transform set
+ * @param imgViewRect the rect the SVG is drawn to
+ * @param viewportRect the viewport in device coordinates
+ **/
+void DkSvgTiles::draw(QPainter &painter, const QRectF &imgViewRect, const QRect &viewportRect)
+{
+    if (mDefaultSize.isEmpty() || imgViewRect.isEmpty())
+        return;
+
+    // find the zoom bucket
+    double scale = painter.worldTransform().mapRect(imgViewRect).width() / mDefaultSize.width();
+    int level = qBound<int>(-max_level, qCeil(std::log2(scale)), max_level);
+    double ls = levelScale(level);
+
+    QRect canvas(0, 0, qCeil(mDefaultSize.width() * ls), qCeil(mDefaultSize.height() * ls));
+    double sx = imgViewRect.width() / canvas.width();
+    double sy = imgViewRect.height() / canvas.height();
+
+    // maps canvas pixels to the viewport
+    QTransform canvasToView = QTransform::fromScale(sx, sy) * QTransform::fromTranslate(imgViewRect.left(), imgViewRect.top());
+    QRect visible = (canvasToView * painter.worldTransform()).inverted().mapRect(QRectF(viewportRect)).toAlignedRect() & canvas;
+
+    if (visible.isEmpty())
+        return;
+
+    // antialiased edges would leave seams between the tiles
+    bool aa = painter.testRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+
+    int ts = DkImageStorage::tile_size;
+    QRect missing;
+
+    for (int row = visible.top() / ts; row <= visible.bottom() / ts; row++) {
+        for (int col = visible.left() / ts; col <= visible.right() / ts; col++) {
+            QRectF target(imgViewRect.left() + col * ts * sx, imgViewRect.top() + row * ts * sy, ts * sx, ts * sy);
+
+            if (QImage *tile = mTiles.object(tileKey(level, col, row))) {
+                painter.drawImage(QRectF(target.topLeft(), QSizeF(tile->width() * sx, tile->height() * sy)), *tile, tile->rect());
+                continue;
+            }
+
+            missing |= QRect(col, row, 1, 1);
+
+            // show the coarse overview until the tile is rendered
+            if (!mOverview.isNull()) {
+                target &= imgViewRect;
+                double ox = mOverview.width() / imgViewRect.width();
+                double oy = mOverview.height() / imgViewRect.height();
+                QRectF src((target.left() - imgViewRect.left()) * ox, (target.top() - imgViewRect.top()) * oy, target.width() * ox, target.height() * oy);
+                painter.drawImage(target, mOverview, src);
+            }
+        }
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing, aa);
+
+    if (mOverview.isNull())
+        render(0, QRect());
+    else if (!missing.isNull())
+        render(level, missing);
+}
+
+void DkSvgTiles::render(int level, const QRect &tiles)
+{
+    // tilesUpdated() triggers a repaint which requests the tiles still missing
+    if (mRenderWatcher.isRunning())
+        return;
+
+    mRenderWatcher.setFuture(QtConcurrent::run(&DkSvgTiles::renderTiles, mRasterizer, level, tiles));
+}
+
+void DkSvgTiles::tilesRendered()
+{
+    QVector<DkSvgTile> tiles = mRenderWatcher.result();
+
+    if (tiles.isEmpty())
+        return;
+
+    for (const DkSvgTile &t : tiles) {
+        if (t.col == -1)
+            mOverview = t.img;
+        else
+            mTiles.insert(tileKey(t.level, t.col, t.row), new QImage(t.img), qMax(int(t.img.sizeInBytes() / 1024), 1));
+    }
+
+    emit tilesUpdated();
+}
+
+/**
+ * Renders the tiles of a zoom level (runs on a worker thread).
+ * All tiles are rendered in one pass, so the SVG is traversed only once per request.
+ * @param rasterizer the SVG renderer
+ * @param level the zoom bucket (the scale is 2^level)
+ * @param tiles the tile indexes to render, the overview is rendered if it is null
+ **/
+QVector<DkSvgTiles::DkSvgTile> DkSvgTiles::renderTiles(QSharedPointer<DkSvgRasterizer> rasterizer, int level, const QRect &tiles)
+{
+    QVector<DkSvgTile> rendered;
+
+    QSvgRenderer *renderer = rasterizer->renderer();
+    if (!renderer->isValid())
+        return rendered;
+
+    QSizeF ds = renderer->defaultSize();
+
+    if (tiles.isNull()) {
+        DkSvgTile t;
+        t.col = -1;
+        t.row = -1;
+        t.img = QImage(ds.toSize().scaled(overview_size, overview_size, Qt::KeepAspectRatio), QImage::Format_ARGB32_Premultiplied);
+
+        if (t.img.isNull())
+            return rendered;
+
+        t.img.fill(Qt::transparent);
+        QPainter p(&t.img);
+        p.setRenderHint(QPainter::Antialiasing);
+        renderer->render(&p, QRectF(QPointF(), t.img.size()));
+
+        rendered << t;
+        return rendered;
+    }
+
+    double ls = levelScale(level);
+    int ts = DkImageStorage::tile_size;
+
+    QRect canvas(0, 0, qCeil(ds.width() * ls), qCeil(ds.height() * ls));
+    QRect region = QRect(tiles.left() * ts, tiles.top() * ts, tiles.width() * ts, tiles.height() * ts) & canvas;
+
+    if (region.isEmpty())
+        return rendered;
+
+    QImage img(region.size(), QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::transparent);
+
+    QPainter p(&img);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.translate(-region.topLeft());
+    renderer->render(&p, QRectF(QPointF(), ds * ls));
+    p.end();
+
+    for (int row = tiles.top(); row <= tiles.bottom(); row++) {
+        for (int col = tiles.left(); col <= tiles.right(); col++) {
+            QRect r = QRect(col * ts, row * ts, ts, ts) & region;
+
+            if (r.isEmpty())
+                continue;
+
+            DkSvgTile t;
+            t.level = level;
+            t.col = col;
+            t.row = row;
+            t.img = img.copy(r.translated(-region.topLeft()));
+            rendered << t;
+        }
+    }
+
+    return rendered;
+}
+
+quint64 DkSvgTiles::tileKey(int level, int col, int row)
+{
+    return ((quint64)(level + max_level) << 48) | ((quint64)(row & 0xffffff) << 24) | (quint64)(col & 0xffffff);
+}
+
+double DkSvgTiles::levelScale(int level)
+{
+    return std::ldexp(1.0, level);
+}
+
 }
@@ -28,12 +28,22 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QCache>
 #include <QColor>
+#include <QColorSpace>
+#include <QColorTransform>
 #include <QFutureWatcher>
+#include <QIcon>
 #include <QImage>
+#include <QMutex>
 #include <QObject>
+#include <QPixmap>
+#include <QSharedPointer>
 #include <QVector>
 
+#include <functional>
+
 // opencv
 #ifdef WITH_OPENCV
 #include "opencv2/core/core.hpp"
@@ -63,6 +73,7 @@
 
 // Qt defines
 class QPixmap;
+class QPainter;
 class QString;
 class QSize;
 class QColor;
@@ -71,6 +82,52 @@ class QTimer;
 namespace nmc
 {
 class DkRotatingRect;
+class DkScratch;
+
+/**
+ * Pixel statistics of an image.
+ * The histogram is computed in parallel: each thread counts a block of
+ * rows into its own histogram and the partial histograms are merged.
+ * 16 bit sources (Grayscale16, RGBA64) are binned at their native
+ * resolution (see bins) in addition to the 8 bit display histogram.
+ * Exact histograms of recently used images are cached (see statistics()),
+ * so that adjustments of the same image version do not count the pixels again.
+ **/
+class DllCoreExport DkImageHistogram
+{
+public:
+    enum {
+        sample_pixels = 4000000, // pixels counted if histograms are sampled
+    };
+
+    static DkImageHistogram fromImage(const QImage &img, int step = 1);
+    static bool isHighBitDepth(const QImage &img);
+    static DkImageHistogram statistics(const QImage &img);
+    static DkImageHistogram cached(const QImage &img);
+    static void cache(const DkImageHistogram &hist);
+
+    void add(const DkImageHistogram &other);
+    bool isEmpty() const;
+    int firstBin(int channel) const;
+    int lastBin(int channel) const;
+
+    int hist[3][256] = {}; /// 3 channels 256 bin. channels duplicated when gray
+    int numPixels = 0; /// pixels counted
+    int numZeroPixels = 0; /// pixels with zero value
+    int numSaturatedPixels = 0; /// pixels saturating RGB 8bit
+    int minBinValue = 256; /// (gray-only) minimum intensity value
+    int maxBinValue = -1; /// (gray-only) maximum intensity value
+    qint64 imageKey = 0; /// QImage::cacheKey() of the image
+    bool exact = true; /// false if not all pixels were counted (sampled histograms)
+
+    int bitDepth = 8; /// bits per channel of the source
+    int minValue = -1; /// (gray-only) minimum value in the source's range
+    int maxValue = -1; /// (gray-only) maximum value in the source's range
+
+protected:
+    void count(const QImage &img, int firstRow, int lastRow, int step);
+    void countHighBitDepth(const QImage &img, int firstRow, int lastRow, int step);
+};
 
 /**
  * DkImage holds some basic image processing
@@ -84,7 +141,10 @@ public:
 
 #ifdef WITH_OPENCV
     static cv::Mat qImage2Mat(const QImage &img);
+    static cv::Mat qImage2Mat(const QImage &img, DkScratch &scratch);
     static QImage mat2QImage(cv::Mat img);
+    static cv::Mat qImage2MatView(const QImage &img);
+    static QImage mat2QImageView(const cv::Mat &img);
     static cv::Mat get1DGauss(double sigma);
     static void mapGammaTable(cv::Mat &img, const QVector<unsigned short> &gammaTable);
     static void gammaToLinear(cv::Mat &img);
@@ -112,23 +172,34 @@ public:
     static bool gaussianBlur(QImage &img, float sigma = 20.0f);
     static bool unsharpMask(QImage &img, float sigma = 20.0f, float weight = 1.5f);
     static bool alphaChannelUsed(const QImage &img);
+    static QImage compactFormat(const QImage &img);
     static QImage thresholdImage(const QImage &img, double thr, bool color = false);
     static QImage rotateImage(const QImage &img, double angle);
+    static QImage rotateQuarterTurns(const QImage &img, int turns);
+    static QImage transformImage(const QImage &img, const QTransform &t, const QSize &size, int interpolation = ipl_cubic, bool correctGamma = true);
     static QImage grayscaleImage(const QImage &img);
     static QPixmap colorizePixmap(const QPixmap &icon, const QColor &col, float opacity = 1.0f);
     static QPixmap loadIcon(const QString &filePath = QString(), const QSize &size = QSize(), const QColor &col = QColor());
     static QPixmap loadIcon(const QString &filePath, const QColor &col, const QSize &size = QSize());
     static QPixmap loadFromSvg(const QString &filePath, const QSize &size);
+    static QIcon loadIconDeferred(const QString &filePath, const QSize &size = QSize(), const QColor &col = QColor());
     static QImage createThumb(const QImage &img, const int maxSize = -1);
     static bool addToImage(QImage &img, unsigned char val = 1);
     static QColor getMeanColor(const QImage &img);
     static uchar findHistPeak(const int *hist, float quantile = 0.005f);
     static QPixmap makeSquare(const QPixmap &pm);
+    static QImage makeSquare(const QImage &img);
     static QPixmap merge(const QVector<QImage> &imgs);
     static QImage cropToImage(const QImage &src, const DkRotatingRect &rect, const QColor &fillColor = QColor());
     static QImage hueSaturation(const QImage &src, int hue, int sat, int brightness);
+    static bool hueSaturation(QImage &img, int hue, int sat, int brightness);
+    static void hueSaturationRow(QRgb *ptr, int width, int hue, int sat, int brightness);
     static QImage exposure(const QImage &src, double exposure, double offset, double gamma);
+    static bool exposure(QImage &img, double exposure, double offset, double gamma);
+    static QVector<unsigned short> exposureLut(double exposure);
+    static QVector<uchar> exposureLut(double exposure, double offset, double gamma);
     static QImage bgColor(const QImage &src, const QColor &col);
+    static void parallelRows(int numRows, const std::function<void(int, int)> &fnc);
     static QByteArray extractImageFromDataStream(const QByteArray &ba,
                                                  const QByteArray &beginSignature = "‰PNG",
                                                  const QByteArray &endSignature = "END®B`‚",
@@ -141,6 +212,13 @@ public:
     static cv::Mat gammaMat(const cv::Mat &src, double gmma);
     static cv::Mat applyLUT(const cv::Mat &src, const cv::Mat &lut);
 #endif // WITH_OPENCV
+
+protected:
+    static bool toRgb32(QImage &img);
+    static QImage resizeLinear(const QImage &img, const QSize &size, int interpolation);
+    static QImage warpImage(const QImage &img, const QTransform &t, const QSize &size, int interpolation, bool correctGamma);
+    static void boxBlur(QImage &img, float sigma);
+    static QVector<int> boxBlurRadii(float sigma, int numBoxes);
 };
 
 class DllCoreExport DkImageStorage : public QObject
@@ -149,6 +227,7 @@ class DllCoreExport DkImageStorage : public QObject
 
 public:
     DkImageStorage(const QImage &img = QImage());
+    virtual ~DkImageStorage();
 
     enum ComputeState {
         l_not_computed,
@@ -160,6 +239,11 @@ public:
         l_end
     };
 
+    enum {
+        tile_size = 512,
+        tiled_image_size = 4096, // images with a larger side are drawn as tiles
+    };
+
     bool isEmpty() const
     {
         return mImg.isNull();
@@ -171,9 +255,17 @@ public:
     };
 
     void setImage(const QImage &img);
+    void setImage(const QImage &img, const QVector<QImage> &pyramid);
     QImage imageConst() const;
     QImage image(const QSize &size = QSize());
+    QImage sampleImage(int minPixels) const;
+    qint64 memoryUsage() const;
+    QPixmap tile(const QImage &img, int col, int row);
+    QImage displayImage(const QImage &img);
     void cancel();
+    bool isComputing() const;
+
+    static QVector<QImage> pyramid(const QImage &img, const QSize &size);
 
 public slots:
     void antiAliasingChanged(bool antiAliasing);
@@ -189,14 +281,118 @@ protected:
     QImage mScaledImg;
     QSize mSize;
 
+    // compact images converted for drawing (see displayImage())
+    QImage mDisplayImg;
+    qint64 mDisplaySrcKey = 0;
+
+    // mPyramid[0] is mImg, each level halves the previous one
+    QVector<QImage> mPyramid;
+    mutable QMutex mPyramidMutex;
+
     QTimer *mWaitTimer = 0;
     QFutureWatcher<QImage> mFutureWatcher;
 
     ComputeState mComputeState = l_not_computed;
+    int mColorRevision = 0; // DkColorManager revision of the converted tiles & the scaled image
 
-    QImage computeIntern(const QImage &src, const QSize &size);
+    QImage computeIntern(const QImage &src, const QSize &size, bool highQuality);
+    QImage pyramidLevel(const QSize &size) const;
+    static void extendPyramid(QVector<QImage> &levels, const QSize &size);
+    static QImage halfSize(const QImage &img);
+    void setPyramid(const QImage &img);
     void init();
+    void checkColorRevision();
+};
+
+/**
+ * Display color management.
+ * Images with an embedded ICC profile are converted to the display profile
+ * (Display::displayProfile, sRGB if empty) right before they are drawn:
+ * once per scaled image or tile, which are cached - so panning and zooming
+ * do not transform pixels again. The transforms are built once per
+ * (source, display) profile pair and cached. Converted images carry the
+ * display color space, hence they are never converted twice.
+ * The manager is thread-safe.
+ **/
+class DllCoreExport DkColorManager
+{
+public:
+    static DkColorManager &instance();
+
+    bool needsTransform(const QImage &img);
+    QImage toDisplay(const QImage &img);
+    QColorSpace displayColorSpace();
+    void clear();
+    int revision() const;
+
+private:
+    DkColorManager();
+    DkColorManager(const DkColorManager &);
+
+    QColorSpace displayColorSpaceIntern();
+
+    enum {
+        max_transforms = 16,
+    };
+
+    QColorSpace mDisplay;
+    bool mDisplayLoaded = false;
+    QVector<QPair<QColorSpace, QColorTransform>> mTransforms; // most recent at the back
+    QMutex mMutex;
+    QAtomicInt mRevision = 0; // incremented by clear()
+};
+
+class DkSvgRasterizer;
+
+/**
+ * Raster cache of a (static) SVG.
+ * The SVG is rendered on a worker thread into tiles of the current zoom bucket
+ * (zoom levels are bucketed to powers of two). Hence, panning only blits cached
+ * tiles and the SVG is rendered again only if the zoom bucket changes.
+ * Tiles that are not rendered yet are drawn from a coarse overview.
+ **/
+class DllCoreExport DkSvgTiles : public QObject
+{
+    Q_OBJECT
+
+public:
+    DkSvgTiles(const QByteArray &svgData, const QSize &defaultSize, QObject *parent = 0);
+    virtual ~DkSvgTiles();
+
+    void draw(QPainter &painter, const QRectF &imgViewRect, const QRect &viewportRect);
+
+signals:
+    void tilesUpdated() const;
+
+protected slots:
+    void tilesRendered();
+
+protected:
+    enum {
+        overview_size = 1024,
+        max_level = 8,
+    };
+
+    struct DkSvgTile {
+        int level = 0;
+        int col = 0;
+        int row = 0;
+        QImage img;
+    };
+
+    void render(int level, const QRect &tiles);
+    static QVector<DkSvgTile> renderTiles(QSharedPointer<DkSvgRasterizer> rasterizer, int level, const QRect &tiles);
+    static quint64 tileKey(int level, int col, int row);
+    static double levelScale(int level);
+
+    QSharedPointer<DkSvgRasterizer> mRasterizer;
+    QFutureWatcher<QVector<DkSvgTile>> mRenderWatcher;
+    QSize mDefaultSize;
+
+    QImage mOverview;
+    QCache<quint64, QImage> mTiles; // KB
 };
+
 //
 // class DllCoreExport DkImageStorage : public QObject {
 //	Q_OBJECT
@@ -0,0 +1,276 @@
+/*******************************************************************************************************
+ DkLog.cpp
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkLog.h"
+
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QFile>
+#include <QTextStream>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+Q_LOGGING_CATEGORY(lcCacher, "nomacs.cacher", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcLoader, "nomacs.loader", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcHistogram, "nomacs.histogram", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcMosaic, "nomacs.mosaic", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcArchive, "nomacs.archive", QtInfoMsg)
+
+// DkLogSink --------------------------------------------------------------------
+DkLogSink::DkLogSink()
+    : mHead(&mStub)
+{
+    mTail = &mStub;
+    qRegisterMetaType<QtMsgType>("QtMsgType");
+}
+
+DkLogSink::~DkLogSink()
+{
+    // the thread must not outlive the sink if nomacs exits early
+    uninstall();
+}
+
+DkLogSink &DkLogSink::instance()
+{
+    static DkLogSink inst;
+    return inst;
+}
+
+/**
+ * Starts the sink thread and installs its message handler.
+ * Call setLogFile() before.
+ **/
+void DkLogSink::install()
+{
+    if (mInstalled)
+        return;
+
+    mInstalled = true;
+    mStop.storeRelease(0);
+    start(QThread::LowPriority);
+
+    qInstallMessageHandler(messageHandler);
+}
+
+/**
+ * Restores the default message handler and writes
+ * all pending messages before the sink thread stops.
+ **/
+void DkLogSink::uninstall()
+{
+    if (!mInstalled)
+        return;
+
+    qInstallMessageHandler(0);
+
+    mStop.storeRelease(1);
+    mWake.release();
+    wait();
+
+    mInstalled = false;
+}
+
+/**
+ * Messages (except for debug messages) are appended to filePath.
+ * @param filePath the log file or an empty string to disable the log file
+ **/
+void DkLogSink::setLogFile(const QString &filePath)
+{
+    Q_ASSERT(!isRunning());
+    mFilePath = filePath;
+}
+
+/**
+ * Enables debug messages of the nomacs logging categories.
+ * They are disabled by the categories - so the messages
+ * are not even formatted if nobody reads them.
+ **/
+void DkLogSink::setDebugEnabled(bool enabled)
+{
+    QLoggingCategory::setFilterRules(enabled ? "nomacs.*.debug=true" : "");
+}
+
+bool DkLogSink::isDebugEnabled() const
+{
+    return lcCacher().isDebugEnabled();
+}
+
+/**
+ * Queues a message - this never waits for the sink thread.
+ * @param type the message type
+ * @param msg the message
+ **/
+void DkLogSink::post(QtMsgType type, const QString &msg)
+{
+    if (mPending.fetchAndAddRelaxed(1) >= maxPending) {
+        mPending.fetchAndAddRelaxed(-1);
+        mDropped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    Entry *e = new Entry();
+    e->type = type;
+    e->msg = msg;
+    push(e);
+
+    // only the first message after the sink fell asleep touches the semaphore
+    if (mSleeping.testAndSetOrdered(1, 0))
+        mWake.release();
+}
+
+void DkLogSink::messageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg)
+{
+    // we are about to abort - the sink thread will not get to it
+    if (type == QtFatalMsg) {
+        if (!instance().mFilePath.isEmpty())
+            DkUtils::logToFile(type, msg);
+        fprintf(stderr, "%s\n", qPrintable(msg));
+        return;
+    }
+
+    instance().post(type, msg);
+}
+
+void DkLogSink::run()
+{
+    if (!mFilePath.isEmpty()) {
+        mFile = new QFile(mFilePath);
+
+        if (!mFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
+            printf("cannot open %s for logging\n", mFilePath.toStdString().c_str());
+            delete mFile;
+            mFile = nullptr;
+        }
+    }
+
+    while (!mStop.loadAcquire()) {
+        if (drain() > 0)
+            continue;
+
+        mSleeping.storeRelease(1);
+
+        // a message might have been pushed before we set the flag
+        if (drain() == 0)
+            mWake.tryAcquire(1, 100);
+
+        mSleeping.storeRelease(0);
+    }
+
+    drain();
+
+    delete mFile;
+    mFile = nullptr;
+}
+
+void DkLogSink::push(Entry *e)
+{
+    e->next.store(nullptr, std::memory_order_relaxed);
+    Entry *prev = mHead.exchange(e, std::memory_order_acq_rel);
+    prev->next.store(e, std::memory_order_release);
+}
+
+/**
+ * Takes the oldest message (sink thread only).
+ * Returns a nullptr if the queue is empty or a producer
+ * has not yet linked its message.
+ **/
+DkLogSink::Entry *DkLogSink::pop()
+{
+    Entry *tail = mTail;
+    Entry *next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &mStub) {
+        if (!next)
+            return nullptr;
+
+        mTail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        mTail = next;
+        return tail;
+    }
+
+    if (tail != mHead.load(std::memory_order_acquire))
+        return nullptr;
+
+    push(&mStub);
+    next = tail->next.load(std::memory_order_acquire);
+
+    if (next) {
+        mTail = next;
+        return tail;
+    }
+
+    return nullptr;
+}
+
+int DkLogSink::drain()
+{
+    int numWritten = 0;
+
+    while (Entry *e = pop()) {
+        write(e);
+        delete e;
+        mPending.fetchAndAddRelaxed(-1);
+        numWritten++;
+    }
+
+    int numDropped = mDropped.fetchAndStoreRelaxed(0);
+    if (numDropped > 0) {
+        Entry e;
+        e.type = QtWarningMsg;
+        e.msg = QString("[DkLogSink] %1 messages dropped").arg(numDropped);
+        write(&e);
+    }
+
+    if (mFile && numWritten > 0)
+        mFile->flush();
+
+    return numWritten;
+}
+
+void DkLogSink::write(const Entry *e)
+{
+    if (mFile) {
+        QString txt = DkUtils::logMessage(e->type, e->msg);
+
+        if (!txt.isEmpty()) {
+            QTextStream ts(mFile);
+            ts << txt << "\n";
+        }
+    }
+
+    emit message(e->type, e->msg);
+}
+
+}
@@ -0,0 +1,131 @@
+/*******************************************************************************************************
+ DkLog.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QLoggingCategory>
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+
+#include <atomic>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+// Qt defines
+class QFile;
+
+namespace nmc
+{
+
+// Logging categories of the hot paths.
+// Their debug messages are disabled by default - use qCDebug(lcCacher) so that
+// nothing is formatted unless they are enabled (e.g. QT_LOGGING_RULES="nomacs.cacher.debug=true").
+DllCoreExport const QLoggingCategory &lcCacher();
+DllCoreExport const QLoggingCategory &lcLoader();
+DllCoreExport const QLoggingCategory &lcHistogram();
+DllCoreExport const QLoggingCategory &lcMosaic();
+DllCoreExport const QLoggingCategory &lcArchive();
+
+/**
+ * Background sink of all log messages.
+ * Its message handler appends messages to a lock-free queue and
+ * returns - the sink thread writes them to the log file and
+ * emits message() for the log widget. Threads that log therefore
+ * never wait for the file or the GUI.
+ * If the queue is full, messages are dropped (and counted).
+ **/
+class DllCoreExport DkLogSink : public QThread
+{
+    Q_OBJECT
+
+public:
+    static DkLogSink &instance();
+
+    void install();
+    void uninstall();
+
+    void setLogFile(const QString &filePath);
+    void setDebugEnabled(bool enabled);
+    bool isDebugEnabled() const;
+
+    void post(QtMsgType type, const QString &msg);
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+
+signals:
+    void message(QtMsgType type, const QString &msg) const;
+
+protected:
+    void run() override;
+
+private:
+    DkLogSink();
+    DkLogSink(const DkLogSink &) = delete;
+    ~DkLogSink();
+
+    struct Entry {
+        std::atomic<Entry *> next{nullptr};
+        QtMsgType type = QtDebugMsg;
+        QString msg;
+    };
+
+    void push(Entry *e);
+    Entry *pop();
+    int drain();
+    void write(const Entry *e);
+
+    // producers exchange the head, the sink thread owns the tail (multi-producer single-consumer)
+    std::atomic<Entry *> mHead;
+    Entry *mTail = nullptr;
+    Entry mStub;
+
+    QAtomicInt mPending = 0;
+    QAtomicInt mDropped = 0;
+    QAtomicInt mSleeping = 0;
+    QAtomicInt mStop = 0;
+    QSemaphore mWake;
+
+    bool mInstalled = false;
+    QString mFilePath;
+    QFile *mFile = nullptr;
+
+    static const int maxPending = 10000;
+};
+
+}
@@ -32,8 +32,10 @@
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 
 #pragma warning(push, 0) // no warnings from includes
+#include <QApplication>
 #include <QSharedPointer>
 #include <QWidget>
 #pragma warning(pop)
@@ -49,7 +51,7 @@ DkBaseManipulator::DkBaseManipulator(QAction *action)
     // add default icon
     if (mAction->icon().isNull()) {
         QSize size(22, 22);
-        mAction->setIcon(DkImage::loadIcon(":/nomacs/img/sliders.svg", size));
+        mAction->setIcon(DkImage::loadIconDeferred(":/nomacs/img/sliders.svg", size));
     }
 }
 
@@ -69,6 +71,92 @@ QIcon DkBaseManipulator::icon() const
     return mAction->icon();
 }
 
+// DkPointOperation --------------------------------------------------------------------
+DkPointOperation::DkPointOperation()
+{
+}
+
+/// <summary>
+/// Creates a point operation that maps R, G, B (and alpha) with the same LUT.
+/// </summary>
+/// <param name="lut">The LUT (256 entries).</param>
+/// <param name="alpha">If true, the alpha channel is mapped too.</param>
+DkPointOperation::DkPointOperation(const QVector<uchar> &lut, bool alpha)
+{
+    if (lut.size() != 256)
+        return;
+
+    mLut.resize(4 * 256);
+
+    for (int cIdx = 0; cIdx < 4; cIdx++) {
+        for (int idx = 0; idx < 256; idx++)
+            mLut[cIdx * 256 + idx] = cIdx < 3 || alpha ? lut[idx] : (uchar)idx;
+    }
+}
+
+/// <summary>
+/// Creates a point operation that maps whole rows (e.g. for operations that mix channels).
+/// </summary>
+/// <param name="rowFnc">Maps width pixels in place.</param>
+/// <param name="opaque">If true, the resulting pixels are opaque.</param>
+DkPointOperation::DkPointOperation(const std::function<void(QRgb *, int)> &rowFnc, bool opaque)
+    : mRowFnc(rowFnc)
+    , mOpaque(opaque)
+{
+}
+
+bool DkPointOperation::isValid() const
+{
+    return isLut() || mRowFnc;
+}
+
+bool DkPointOperation::isLut() const
+{
+    return !mLut.isEmpty();
+}
+
+bool DkPointOperation::isOpaque() const
+{
+    return mOpaque;
+}
+
+/// <summary>
+/// Composes the LUT of op with this LUT (op is applied after this operation).
+/// </summary>
+/// <returns>false if either of the operations is not a LUT.</returns>
+bool DkPointOperation::compose(const DkPointOperation &op)
+{
+    if (!isLut() || !op.isLut())
+        return false;
+
+    // (idx & ~0xff) is the offset of the channel
+    for (int idx = 0; idx < mLut.size(); idx++)
+        mLut[idx] = op.mLut[(idx & ~0xff) | mLut[idx]];
+
+    return true;
+}
+
+void DkPointOperation::apply(QRgb *ptr, int width) const
+{
+    if (mRowFnc) {
+        mRowFnc(ptr, width);
+        return;
+    }
+
+    if (mLut.isEmpty())
+        return;
+
+    const uchar *lb = mLut.constData();
+    const uchar *lg = lb + 256;
+    const uchar *lr = lb + 512;
+    const uchar *la = lb + 768;
+
+    for (int cIdx = 0; cIdx < width; cIdx++) {
+        const QRgb px = ptr[cIdx];
+        ptr[cIdx] = ((QRgb)la[px >> 24] << 24) | ((QRgb)lr[(px >> 16) & 0xff] << 16) | ((QRgb)lg[(px >> 8) & 0xff] << 8) | lb[px & 0xff];
+    }
+}
+
 // DkManipulatorManager --------------------------------------------------------------------
 DkManipulatorManager::DkManipulatorManager()
 {
@@ -84,82 +172,87 @@ void DkManipulatorManager::createManipulators(QWidget *parent)
 
     QSize size(22, 22);
 
+    // icons are rasterized when shown & shortcuts need the GUI application - there is none in headless batch mode
+    bool hasGui = qobject_cast<QApplication *>(QCoreApplication::instance()) != 0;
+
     // grayscale
     QAction *action;
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/grayscale.svg", size), QObject::tr("&Grayscale"), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/grayscale.svg", size), QObject::tr("&Grayscale"), parent);
     action->setStatusTip(QObject::tr("Convert to Grayscale"));
     mpls[m_grayscale] = QSharedPointer<DkGrayScaleManipulator>::create(action);
 
     // auto adjust
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/auto-adjust.svg", size), QObject::tr("&Auto Adjust"), parent);
-    action->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_L);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/auto-adjust.svg", size), QObject::tr("&Auto Adjust"), parent);
+    if (hasGui)
+        action->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_L);
     action->setStatusTip(QObject::tr("Auto Adjust Image Contrast and Color Balance"));
     mpls[m_auto_adjust] = QSharedPointer<DkAutoAdjustManipulator>::create(action);
 
     // normalize
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/normalize.svg", size), QObject::tr("Nor&malize Image"), parent);
-    action->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_N);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/normalize.svg", size), QObject::tr("Nor&malize Image"), parent);
+    if (hasGui)
+        action->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_N);
     action->setStatusTip(QObject::tr("Normalize the Image"));
     mpls[m_normalize] = QSharedPointer<DkNormalizeManipulator>::create(action);
 
     // flip horizontal
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/flip-horizontal.svg", size), QObject::tr("Flip &Horizontal"), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/flip-horizontal.svg", size), QObject::tr("Flip &Horizontal"), parent);
     action->setStatusTip(QObject::tr("Flip Image Horizontally"));
     mpls[m_flip_h] = QSharedPointer<DkFlipHManipulator>::create(action);
 
     // flip vertical
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/flip-vertical.svg", size), QObject::tr("Flip &Vertical"), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/flip-vertical.svg", size), QObject::tr("Flip &Vertical"), parent);
     action->setStatusTip(QObject::tr("Flip Image Vertically"));
     mpls[m_flip_v] = QSharedPointer<DkFlipVManipulator>::create(action);
 
     // invert image
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/invert.svg", size), QObject::tr("&Invert Image"), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/invert.svg", size), QObject::tr("&Invert Image"), parent);
     action->setStatusTip(QObject::tr("Invert the Image"));
     mpls[m_invert] = QSharedPointer<DkInvertManipulator>::create(action);
 
     // extended --------------------------------------------------------------------
     // tiny planet
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/tiny-planet.svg", size), QObject::tr("&Tiny Planet..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/tiny-planet.svg", size), QObject::tr("&Tiny Planet..."), parent);
     action->setStatusTip(QObject::tr("Create a Tiny Planet"));
     mpls[m_tiny_planet] = QSharedPointer<DkTinyPlanetManipulator>::create(action);
 
     // tiny planet
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/bucket.svg", size), QObject::tr("&Background Color..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/bucket.svg", size), QObject::tr("&Background Color..."), parent);
     action->setStatusTip(QObject::tr("Add a background color"));
     mpls[m_color] = QSharedPointer<DkColorManipulator>::create(action);
 
     // blur
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/blur.svg", size), QObject::tr("&Blur..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/blur.svg", size), QObject::tr("&Blur..."), parent);
     action->setStatusTip(QObject::tr("Blur the image"));
     mpls[m_blur] = QSharedPointer<DkBlurManipulator>::create(action);
 
     // unsharp mask
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/sharpen.svg", size), QObject::tr("&Sharpen..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/sharpen.svg", size), QObject::tr("&Sharpen..."), parent);
     action->setStatusTip(QObject::tr("Sharpens the image by applying an unsharp mask"));
     mpls[m_unsharp_mask] = QSharedPointer<DkUnsharpMaskManipulator>::create(action);
 
     // rotate
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/rotate-cc.svg", size), QObject::tr("&Rotate..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/rotate-cc.svg", size), QObject::tr("&Rotate..."), parent);
     action->setStatusTip(QObject::tr("Rotate the image"));
     mpls[m_rotate] = QSharedPointer<DkRotateManipulator>::create(action);
 
     // resize
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/resize.svg", size), QObject::tr("&Resize..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/resize.svg", size), QObject::tr("&Resize..."), parent);
     action->setStatusTip(QObject::tr("Resize the image"));
     mpls[m_resize] = QSharedPointer<DkResizeManipulator>::create(action);
 
     // threshold
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/threshold.svg", size), QObject::tr("&Threshold..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/threshold.svg", size), QObject::tr("&Threshold..."), parent);
     action->setStatusTip(QObject::tr("Threshold the image"));
     mpls[m_threshold] = QSharedPointer<DkThresholdManipulator>::create(action);
 
     // hue/saturation
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/sliders.svg", size), QObject::tr("&Hue/Saturation..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/sliders.svg", size), QObject::tr("&Hue/Saturation..."), parent);
     action->setStatusTip(QObject::tr("Change Hue and Saturation"));
     mpls[m_hue] = QSharedPointer<DkHueManipulator>::create(action);
 
     // exposure
-    action = new QAction(DkImage::loadIcon(":/nomacs/img/exposure.svg", size), QObject::tr("&Exposure..."), parent);
+    action = new QAction(DkImage::loadIconDeferred(":/nomacs/img/exposure.svg", size), QObject::tr("&Exposure..."), parent);
     action->setStatusTip(QObject::tr("Change the Exposure and Gamma"));
     mpls[m_exposure] = QSharedPointer<DkExposureManipulator>::create(action);
 
@@ -236,6 +329,75 @@ int DkManipulatorManager::numSelected() const
     return nSel;
 }
 
+/// <summary>
+/// Applies a chain of point operations in a single pass over the image.
+/// Consecutive LUTs are composed and each row is mapped by
+/// all operations before the next row is processed.
+/// 16 bit images are not fused since the fused pass works on 8 bit pixels.
+/// Their manipulators are applied one after another instead.
+/// </summary>
+/// <param name="img">The source image.</param>
+/// <param name="mpls">Manipulators that provide a point operation.</param>
+/// <returns>The manipulated image or a null image if a manipulator is no point operation.</returns>
+QImage DkManipulatorManager::applyPointOperations(const QImage &img, const QVector<QSharedPointer<DkBaseManipulator>> &mpls)
+{
+    QVector<DkPointOperation> ops;
+    bool opaque = !img.hasAlphaChannel();
+
+    for (const QSharedPointer<DkBaseManipulator> &mpl : mpls) {
+        DkPointOperation op = mpl->pointOperation();
+
+        if (!op.isValid())
+            return QImage();
+
+        opaque |= op.isOpaque();
+
+        if (ops.isEmpty() || !ops.last().compose(op))
+            ops << op;
+    }
+
+    if (img.isNull() || ops.isEmpty())
+        return img;
+
+    // keep the depth of 16 bit images
+    if (DkImageHistogram::isHighBitDepth(img)) {
+        QImage imgR = img;
+
+        for (const QSharedPointer<DkBaseManipulator> &mpl : mpls) {
+            imgR = mpl->apply(imgR);
+
+            if (imgR.isNull())
+                break;
+        }
+
+        return imgR;
+    }
+
+    DkTimer dt;
+
+    QImage imgR = img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+    uchar *bits = imgR.bits();
+    const int bpl = imgR.bytesPerLine();
+    const int width = imgR.width();
+
+    DkImage::parallelRows(imgR.height(), [&](int firstRow, int lastRow) {
+        for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+            QRgb *ptr = reinterpret_cast<QRgb *>(bits + (size_t)rIdx * bpl);
+
+            for (const DkPointOperation &op : ops)
+                op.apply(ptr, width);
+        }
+    });
+
+    if (opaque && imgR.format() == QImage::Format_ARGB32)
+        imgR.reinterpretAsFormat(QImage::Format_RGB32);
+
+    qDebug() << "[DkManipulatorManager]" << mpls.size() << "point operations fused to" << ops.size() << "in" << dt;
+
+    return imgR;
+}
+
 void DkManipulatorManager::loadSettings(QSettings &settings)
 {
     settings.beginGroup("Manipulators");
@@ -273,6 +435,32 @@ QString DkBaseManipulator::errorMessage() const
     return "";
 }
 
+/// <summary>
+/// Applies the manipulator to a downscaled preview.
+/// Manipulators with parameters in pixels (e.g. kernel sizes)
+/// should override this and scale them.
+/// </summary>
+/// <param name="img">The downscaled image.</param>
+/// <param name="scale">The size of img relative to the original image.</param>
+/// <returns>The manipulated preview.</returns>
+QImage DkBaseManipulator::applyPreview(const QImage &img, double scale) const
+{
+    Q_UNUSED(scale);
+    return apply(img);
+}
+
+/// <summary>
+/// Returns the per pixel map of this manipulator.
+/// Manipulators that map pixels independently of their
+/// neighbors and the image statistics should override this
+/// so that they can be fused with other point operations.
+/// </summary>
+/// <returns>The point operation or an invalid operation (default).</returns>
+DkPointOperation DkBaseManipulator::pointOperation() const
+{
+    return DkPointOperation();
+}
+
 void DkBaseManipulator::saveSettings(QSettings &settings)
 {
     settings.beginGroup(name());
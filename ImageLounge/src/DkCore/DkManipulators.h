@@ -30,9 +30,12 @@
 
 #pragma warning(push, 0) // no warnings from includes
 #include <QAction>
+#include <QImage>
 #include <QSettings>
 #pragma warning(pop)
 
+#include <functional>
+
 #pragma warning(disable : 4251) // TODO: remove
 
 #ifndef DllCoreExport
@@ -53,6 +56,33 @@ namespace nmc
 // nomacs defines
 class DkImageContainer;
 
+/// <summary>
+/// A point operation maps each (A)RGB32 pixel
+/// independently of its neighbors. It is either
+/// a LUT per channel or a function that maps rows.
+/// Consecutive point operations of a manipulator chain
+/// are fused (see DkManipulatorManager::applyPointOperations).
+/// </summary>
+class DllCoreExport DkPointOperation
+{
+public:
+    DkPointOperation();
+    DkPointOperation(const QVector<uchar> &lut, bool alpha = false);
+    DkPointOperation(const std::function<void(QRgb *, int)> &rowFnc, bool opaque = false);
+
+    bool isValid() const;
+    bool isLut() const;
+    bool isOpaque() const;
+
+    bool compose(const DkPointOperation &op);
+    void apply(QRgb *ptr, int width) const;
+
+private:
+    QVector<uchar> mLut; // b, g, r, a (256 entries each)
+    std::function<void(QRgb *, int)> mRowFnc;
+    bool mOpaque = false;
+};
+
 /// <summary>
 /// Base class of simple image manipulators.
 /// Manipulators are functions that map
@@ -74,6 +104,8 @@ public:
 
     virtual QString errorMessage() const = 0;
     virtual QImage apply(const QImage &img) const = 0;
+    virtual QImage applyPreview(const QImage &img, double scale) const;
+    virtual DkPointOperation pointOperation() const;
 
     virtual void saveSettings(QSettings &settings);
     virtual void loadSettings(QSettings &settings);
@@ -151,6 +183,8 @@ public:
 
     int numSelected() const;
 
+    static QImage applyPointOperations(const QImage &img, const QVector<QSharedPointer<DkBaseManipulator>> &mpls);
+
     void loadSettings(QSettings &settings);
     void saveSettings(QSettings &settings) const;
 
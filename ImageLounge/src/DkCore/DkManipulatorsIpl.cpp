@@ -112,6 +112,15 @@ QImage DkInvertManipulator::apply(const QImage &img) const
     return imgR;
 }
 
+DkPointOperation DkInvertManipulator::pointOperation() const
+{
+    QVector<uchar> lut(256);
+    for (int idx = 0; idx < lut.size(); idx++)
+        lut[idx] = (uchar)(255 - idx);
+
+    return DkPointOperation(lut);
+}
+
 QString DkInvertManipulator::errorMessage() const
 {
     return QObject::tr("Cannot invert image");
@@ -170,6 +179,23 @@ QImage DkTinyPlanetManipulator::apply(const QImage &img) const
 #endif
 }
 
+QImage DkTinyPlanetManipulator::applyPreview(const QImage &img, double scale) const
+{
+#ifdef WITH_OPENCV
+    int ms = qMax(img.width(), img.height());
+    QSize s(ms, ms);
+
+    // the planet size is measured in pixels of the original
+    QImage imgR = img.copy();
+    DkImage::tinyPlanet(imgR, qMax(size() * scale, 1.0), angle() * DK_DEG2RAD, s, inverted());
+    return imgR;
+#else
+    Q_UNUSED(img);
+    Q_UNUSED(scale);
+    return QImage(); // trigger warning
+#endif
+}
+
 QString DkTinyPlanetManipulator::errorMessage() const
 {
     return QObject::tr("Sorry, I could not create a tiny planet");
@@ -230,6 +256,13 @@ QImage DkBlurManipulator::apply(const QImage &img) const
     return imgC;
 }
 
+QImage DkBlurManipulator::applyPreview(const QImage &img, double scale) const
+{
+    QImage imgC = img.copy();
+    DkImage::gaussianBlur(imgC, qMax((float)(sigma() * scale), 0.5f));
+    return imgC;
+}
+
 QString DkBlurManipulator::errorMessage() const
 {
     // so give me coffee & TV
@@ -263,6 +296,13 @@ QImage DkUnsharpMaskManipulator::apply(const QImage &img) const
     return imgC;
 }
 
+QImage DkUnsharpMaskManipulator::applyPreview(const QImage &img, double scale) const
+{
+    QImage imgC = img.copy();
+    DkImage::unsharpMask(imgC, qMax((float)(sigma() * scale), 0.5f), 1.0f + amount() / 100.0f);
+    return imgC;
+}
+
 QString DkUnsharpMaskManipulator::errorMessage() const
 {
     return QObject::tr("Cannot sharpen image");
@@ -389,6 +429,20 @@ QImage DkThresholdManipulator::apply(const QImage &img) const
     return DkImage::thresholdImage(img, threshold(), color());
 }
 
+DkPointOperation DkThresholdManipulator::pointOperation() const
+{
+    // the gray value is no point operation (see DkImage::grayscaleImage)
+    if (!color())
+        return DkPointOperation();
+
+    // DkImage::thresholdImage maps the color channels
+    QVector<uchar> lut(256);
+    for (int idx = 0; idx < lut.size(); idx++)
+        lut[idx] = idx > threshold() ? 255 : 0;
+
+    return DkPointOperation(lut);
+}
+
 QString DkThresholdManipulator::errorMessage() const
 {
     return QObject::tr("Cannot threshold image");
@@ -433,6 +487,17 @@ QImage DkHueManipulator::apply(const QImage &img) const
     return DkImage::hueSaturation(img, hue(), saturation(), value());
 }
 
+DkPointOperation DkHueManipulator::pointOperation() const
+{
+    int h = hue();
+    int s = saturation();
+    int v = value();
+
+    return DkPointOperation([h, s, v](QRgb *ptr, int width) {
+        DkImage::hueSaturationRow(ptr, width, h, s, v);
+    });
+}
+
 QString DkHueManipulator::errorMessage() const
 {
     return QObject::tr("Cannot change Hue/Saturation");
@@ -490,6 +555,11 @@ QImage DkExposureManipulator::apply(const QImage &img) const
     return DkImage::exposure(img, exposure(), offset(), gamma());
 }
 
+DkPointOperation DkExposureManipulator::pointOperation() const
+{
+    return DkPointOperation(DkImage::exposureLut(exposure(), offset(), gamma()));
+}
+
 QString DkExposureManipulator::errorMessage() const
 {
     return QObject::tr("Cannot apply exposure");
@@ -548,6 +618,26 @@ QImage DkColorManipulator::apply(const QImage &img) const
     return DkImage::bgColor(img, color());
 }
 
+DkPointOperation DkColorManipulator::pointOperation() const
+{
+    const int r = color().red();
+    const int g = color().green();
+    const int b = color().blue();
+
+    // blend with the background color (see DkImage::bgColor)
+    return DkPointOperation(
+        [r, g, b](QRgb *ptr, int width) {
+            for (int cIdx = 0; cIdx < width; cIdx++) {
+                const QRgb px = ptr[cIdx];
+                const int a = qAlpha(px);
+                const int ia = 255 - a;
+
+                ptr[cIdx] = qRgb((qRed(px) * a + r * ia + 127) / 255, (qGreen(px) * a + g * ia + 127) / 255, (qBlue(px) * a + b * ia + 127) / 255);
+            }
+        },
+        true);
+}
+
 QString DkColorManipulator::errorMessage() const
 {
     return QObject::tr("Cannot draw background color");
@@ -86,6 +86,7 @@ public:
     DkInvertManipulator(QAction *action = 0);
 
     QImage apply(const QImage &img) const override;
+    DkPointOperation pointOperation() const override;
     QString errorMessage() const override;
 };
 
@@ -114,6 +115,7 @@ public:
     DkTinyPlanetManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    QImage applyPreview(const QImage &img, double scale) const override;
     QString errorMessage() const override;
 
     void setSize(int size);
@@ -137,6 +139,7 @@ public:
     DkColorManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    DkPointOperation pointOperation() const override;
     QString errorMessage() const override;
 
     void setColor(const QColor &col);
@@ -152,6 +155,7 @@ public:
     DkBlurManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    QImage applyPreview(const QImage &img, double scale) const override;
     QString errorMessage() const override;
 
     void setSigma(int sigma);
@@ -167,6 +171,7 @@ public:
     DkUnsharpMaskManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    QImage applyPreview(const QImage &img, double scale) const override;
     QString errorMessage() const override;
 
     void setSigma(int sigma);
@@ -224,6 +229,7 @@ public:
     DkThresholdManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    DkPointOperation pointOperation() const override;
     QString errorMessage() const override;
 
     void setThreshold(int thr);
@@ -243,6 +249,7 @@ public:
     DkHueManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    DkPointOperation pointOperation() const override;
     QString errorMessage() const override;
 
     void setHue(int hue);
@@ -266,6 +273,7 @@ public:
     DkExposureManipulator(QAction *action);
 
     QImage apply(const QImage &img) const override;
+    DkPointOperation pointOperation() const override;
     QString errorMessage() const override;
 
     void setExposure(double exposure);
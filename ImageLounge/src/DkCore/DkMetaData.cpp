@@ -35,14 +35,23 @@
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QApplication>
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QImage>
 #include <QObject>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QTranslator>
 #include <QVector2D>
 #pragma warning(pop) // no warnings from includes - end
 
+#include <functional>
 #include <iostream>
 
 namespace nmc
@@ -55,7 +64,7 @@ DkMetaDataT::DkMetaDataT()
 
 bool DkMetaDataT::isNull()
 {
-    return !mExifImg.get();
+    return !mExifImg.get() && !mHeaderOnly;
 }
 
 QSharedPointer<DkMetaDataT> DkMetaDataT::copy() const
@@ -64,15 +73,28 @@ QSharedPointer<DkMetaDataT> DkMetaDataT::copy() const
     QSharedPointer<DkMetaDataT> metaDataN(new DkMetaDataT());
     metaDataN->mFilePath = mFilePath;
     metaDataN->mExifState = mExifState;
+    metaDataN->mQtKeys = mQtKeys;
+    metaDataN->mQtValues = mQtValues;
+
+    // nothing was parsed yet - the copy shares the source and opens it on demand (see readFullMetaData())
+    if (mHeaderOnly) {
+        metaDataN->mSource = mSource;
+        metaDataN->mHeader = mHeader;
+        metaDataN->mHeaderOnly = true;
+        metaDataN->mExifState = dirty;
+
+        return metaDataN;
+    }
 
     if (mExifImg.get() != 0) {
         // ImageFactory::create(type) may crash even if old Image object has that type
         try {
             // Load new Exiv2::Image object
             metaDataN->mExifImg = Exiv2::ImageFactory::create(mExifImg->imageType());
-            // Copy exif data from old object into new object
-            Exiv2::ExifData data = mExifImg->exifData();
-            metaDataN->mExifImg->setExifData(data); // explicit copy of list<Exifdatum>
+            // explicit copies of the Exif, IPTC & XMP lists
+            metaDataN->mExifImg->setExifData(mExifImg->exifData());
+            metaDataN->mExifImg->setIptcData(mExifImg->iptcData());
+            metaDataN->mExifImg->setXmpData(mExifImg->xmpData());
             metaDataN->mExifState = dirty;
         } catch (...) {
             metaDataN->mExifState = no_data;
@@ -93,30 +115,39 @@ void DkMetaDataT::update(const QSharedPointer<DkMetaDataT> &other)
     // Copy exif data (to this instance), reading from src
     if (src->isNull())
         return;
+    src->readFullMetaData();
+    readFullMetaData();
     mExifImg->setExifData(src->mExifImg->exifData()); // explicit copy of list<Exifdatum>
+    mRevision++;
 }
 
 void DkMetaDataT::readMetaData(const QString &filePath, QSharedPointer<QByteArray> ba)
 {
+    mRevision++;
+
     if (mUseSidecar) {
         loadSidecar(filePath);
         return;
     }
 
+    DkTraceSpan span("metadata", "DkMetaDataT::readMetaData", filePath);
+
     mFilePath = filePath;
-    QFileInfo fileInfo(filePath);
+    mHeaderOnly = false;
+    mHeader = DkHeaderInfo();
+    mSource.reset();
+
+    // Exiv2 reads from the buffer without copying it - callers clear their buffers in place
+    // so we keep a shallow copy which also holds the original (e.g. a memory mapped file)
+    if (ba && !ba->isEmpty()) {
+        QSharedPointer<QByteArray> src = ba;
+        mSource = QSharedPointer<QByteArray>(new QByteArray(*ba), [src](QByteArray *b) {
+            delete b;
+        });
+    }
 
     try {
-        if (!ba || ba->isEmpty()) {
-            // we used to have a few ugly lines here, just to get unicode files loaded
-            // since we load 99% through the buffer & we cannot use /Zc:wchar_t- (as of Qt5.10)
-            // I removed these lines - so if we don't have the buffer, we can only load the metadata
-            // of files that use std::string literals in their path
-            std::string strFilePath = (fileInfo.isSymLink()) ? fileInfo.symLinkTarget().toStdString() : filePath.toStdString();
-            mExifImg = Exiv2::ImageFactory::open(strFilePath);
-        } else {
-            mExifImg = Exiv2::ImageFactory::open(reinterpret_cast<const byte *>(ba->constData()), ba->size());
-        }
+        mExifImg = openSource();
     } catch (...) {
         // TODO: check crashes here
         mExifState = no_data;
@@ -131,6 +162,17 @@ void DkMetaDataT::readMetaData(const QString &filePath, QSharedPointer<QByteArra
         return;
     }
 
+    // browsing needs the orientation, rating and thumbnail only - all other tags are read on demand
+    if (mExifImg->imageType() == Exiv2::ImageType::jpeg) {
+        QByteArray header = mSource ? QByteArray::fromRawData(mSource->constData(), mSource->size()) : readSource(0, max_header_size);
+
+        if (readHeader(header)) {
+            mHeaderOnly = true;
+            mExifState = loaded;
+            return;
+        }
+    }
+
     try {
         mExifImg->readMetadata();
 
@@ -152,6 +194,291 @@ void DkMetaDataT::readMetaData(const QString &filePath, QSharedPointer<QByteArra
     // printMetaData();
 }
 
+/**
+ * Opens the Exiv2 image of the buffer (if available) or the file.
+ * No metadata is read.
+ * @return std::unique_ptr<Exiv2::Image> the Exiv2 image
+ **/
+std::unique_ptr<Exiv2::Image> DkMetaDataT::openSource() const
+{
+    if (mSource)
+        return Exiv2::ImageFactory::open(reinterpret_cast<const byte *>(mSource->constData()), mSource->size());
+
+    // we used to have a few ugly lines here, just to get unicode files loaded
+    // since we load 99% through the buffer & we cannot use /Zc:wchar_t- (as of Qt5.10)
+    // I removed these lines - so if we don't have the buffer, we can only load the metadata
+    // of files that use std::string literals in their path
+    QFileInfo fileInfo(mFilePath);
+    std::string strFilePath = (fileInfo.isSymLink()) ? fileInfo.symLinkTarget().toStdString() : mFilePath.toStdString();
+
+    return Exiv2::ImageFactory::open(strFilePath);
+}
+
+QByteArray DkMetaDataT::readSource(qint64 offset, qint64 length) const
+{
+    if (mSource)
+        return mSource->mid((int)offset, (int)length);
+
+    QFile file(mFilePath);
+
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+        return QByteArray();
+
+    return file.read(length);
+}
+
+/**
+ * Parses the JPEG header without Exiv2.
+ * Only the orientation, rating, image size and the thumbnail's position
+ * are read from IFD0, the Exif IFD, IFD1 and the XMP packet. Maker notes
+ * and all other tags are not touched.
+ * @param data the beginning of the JPEG file
+ * @return bool false if the header could not be parsed - then Exiv2 has to read everything
+ **/
+bool DkMetaDataT::readHeader(const QByteArray &data)
+{
+    const uchar *d = reinterpret_cast<const uchar *>(data.constData());
+    const int numBytes = data.size();
+
+    if (numBytes < 4 || d[0] != 0xFF || d[1] != 0xD8)
+        return false;
+
+    DkHeaderInfo header;
+    int tiffPos = -1;
+    int tiffLen = 0;
+    bool scanFound = false;
+
+    // find the Exif & XMP segments
+    for (int pos = 2; pos + 4 <= numBytes;) {
+        if (d[pos] != 0xFF)
+            return false;
+
+        uchar marker = d[pos + 1];
+
+        // fill bytes
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        // start of scan - all metadata segments are read
+        if (marker == 0xDA || marker == 0xD9) {
+            scanFound = true;
+            break;
+        }
+
+        int len = (d[pos + 2] << 8) | d[pos + 3];
+        if (len < 2 || pos + 2 + len > numBytes)
+            return false;
+
+        const char *seg = reinterpret_cast<const char *>(d + pos + 4);
+        int segLen = len - 2;
+
+        static const char exifId[] = "Exif\0";
+        static const char xmpId[] = "http://ns.adobe.com/xap/1.0/";
+
+        if (marker == 0xE1 && tiffPos == -1 && segLen > 6 && !memcmp(seg, exifId, 6)) {
+            tiffPos = pos + 10;
+            tiffLen = segLen - 6;
+        } else if (marker == 0xE1 && segLen > (int)sizeof(xmpId) && !memcmp(seg, xmpId, sizeof(xmpId))) {
+            QByteArray xmp = QByteArray::fromRawData(seg + sizeof(xmpId), segLen - (int)sizeof(xmpId));
+
+            // <xmp:Rating>3</xmp:Rating> or xmp:Rating="3"
+            auto xmpValue = [&xmp](const QByteArray &key) -> float {
+                int idx = xmp.indexOf(key);
+                if (idx == -1)
+                    return -1;
+
+                idx += key.size();
+                while (idx < xmp.size() && (xmp[idx] == '=' || xmp[idx] == '"' || xmp[idx] == '>' || xmp[idx] == ' '))
+                    idx++;
+
+                int end = idx;
+                while (end < xmp.size() && (isdigit((uchar)xmp[end]) || xmp[end] == '-' || xmp[end] == '.'))
+                    end++;
+
+                bool ok = false;
+                float val = xmp.mid(idx, end - idx).toFloat(&ok);
+
+                return ok ? val : -1;
+            };
+
+            header.xmpRating = xmpValue("xmp:Rating");
+
+            if (header.xmpRating == -1)
+                header.xmpRating = xmpValue("MicrosoftPhoto:Rating");
+        }
+
+        pos += 2 + len;
+    }
+
+    // the header is larger than the data we have
+    if (!scanFound)
+        return false;
+
+    if (tiffPos != -1) {
+        const uchar *t = d + tiffPos;
+        bool le = tiffLen >= 8 && t[0] == 'I' && t[1] == 'I';
+
+        if (tiffLen < 8 || !(le || (t[0] == 'M' && t[1] == 'M')))
+            return false;
+
+        auto u16 = [&](quint32 o) -> quint32 {
+            return le ? t[o] | (t[o + 1] << 8) : (t[o] << 8) | t[o + 1];
+        };
+
+        auto u32 = [&](quint32 o) -> quint32 {
+            return le ? u16(o) | (u16(o + 2) << 16) : (u16(o) << 16) | u16(o + 2);
+        };
+
+        // SHORT (3) or LONG (4) values that fit into the entry
+        auto value = [&](quint32 entry) -> quint32 {
+            return u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8);
+        };
+
+        // calls fnc(tag, entry) for all entries of an IFD, returns the next IFD's offset
+        auto readIfd = [&](quint32 ifd, const std::function<void(quint32, quint32)> &fnc, bool &ok) -> quint32 {
+            ok = ifd >= 8 && ifd + 2 <= (quint32)tiffLen;
+            if (!ok)
+                return 0;
+
+            quint32 numEntries = u16(ifd);
+            ok = ifd + 2 + numEntries * 12 + 4 <= (quint32)tiffLen;
+            if (!ok)
+                return 0;
+
+            for (quint32 idx = 0; idx < numEntries; idx++) {
+                quint32 entry = ifd + 2 + idx * 12;
+                fnc(u16(entry), entry);
+            }
+
+            return u32(ifd + 2 + numEntries * 12);
+        };
+
+        quint32 exifIfd = 0;
+        bool ok = false;
+
+        quint32 ifd1 = readIfd(
+            u32(4),
+            [&](quint32 tag, quint32 entry) {
+                if (tag == 0x0112) // Exif.Image.Orientation
+                    header.orientation = (int)value(entry);
+                else if (tag == 0x4746) // Exif.Image.Rating
+                    header.exifRating = (float)value(entry);
+                else if (tag == 0x8769) // Exif.Photo IFD
+                    exifIfd = u32(entry + 8);
+            },
+            ok);
+
+        if (!ok)
+            return false;
+
+        if (exifIfd) {
+            int width = -1;
+            int height = -1;
+
+            readIfd(
+                exifIfd,
+                [&](quint32 tag, quint32 entry) {
+                    if (tag == 0xA002) // Exif.Photo.PixelXDimension
+                        width = (int)value(entry);
+                    else if (tag == 0xA003) // Exif.Photo.PixelYDimension
+                        height = (int)value(entry);
+                },
+                ok);
+
+            if (!ok)
+                return false;
+
+            if (width >= 0 && height >= 0)
+                header.size = QSize(width, height);
+        }
+
+        if (ifd1) {
+            quint32 thumbOffset = 0;
+            quint32 thumbLength = 0;
+
+            readIfd(
+                ifd1,
+                [&](quint32 tag, quint32 entry) {
+                    if (tag == 0x0201) // Exif.Thumbnail.JPEGInterchangeFormat
+                        thumbOffset = u32(entry + 8);
+                    else if (tag == 0x0202) // Exif.Thumbnail.JPEGInterchangeFormatLength
+                        thumbLength = u32(entry + 8);
+                },
+                ok);
+
+            if (ok && thumbOffset && thumbLength && (qint64)thumbOffset + thumbLength <= tiffLen) {
+                header.thumbOffset = tiffPos + thumbOffset;
+                header.thumbLength = thumbLength;
+            }
+        }
+    }
+
+    mHeader = header;
+
+    return true;
+}
+
+/**
+ * Reads all metadata if only the header was parsed so far.
+ **/
+void DkMetaDataT::readFullMetaData() const
+{
+    if (!mHeaderOnly.loadAcquire())
+        return;
+
+    QMutexLocker locker(&mFullMetaDataMutex);
+
+    // another thread read it meanwhile
+    if (!mHeaderOnly.loadAcquire())
+        return;
+
+    try {
+        DkTraceSpan dt("metadata", "DkMetaDataT::readFullMetaData", mFilePath);
+
+        // copies open the source when it is needed
+        if (!mExifImg)
+            mExifImg = openSource();
+
+        if (mExifImg) {
+            mExifImg->readMetadata();
+
+            if (!mExifImg->good())
+                qDebug() << "[Exiv2] metadata could not be read";
+
+            qDebug() << "[Exiv2] all metadata read in" << dt;
+        }
+    } catch (...) {
+        qDebug() << "[Exiv2] could not read metadata (exception)";
+    }
+
+    // the source could not be opened - callers get empty metadata
+    if (!mExifImg) {
+        try {
+            mExifImg = Exiv2::ImageFactory::create(Exiv2::ImageType::jpeg);
+        } catch (...) {
+            qDebug() << "[Exiv2] could not create empty metadata";
+        }
+    }
+
+    // publishes mExifImg
+    mHeaderOnly.storeRelease(0);
+}
+
+/**
+ * The memory of the file buffer that is kept for Exiv2.
+ * @param fileBuffer the owner's file buffer - it is not counted twice if the data is shared.
+ * @return qint64 the source size in bytes
+ **/
+qint64 DkMetaDataT::sourceMemory(QSharedPointer<QByteArray> fileBuffer) const
+{
+    if (!mSource || (fileBuffer && fileBuffer->constData() == mSource->constData()))
+        return 0;
+
+    return mSource->size();
+}
+
 /**
  * @brief saveMetaData() reloads the specified file and updates that file with the modified exif data.
  *
@@ -182,10 +509,15 @@ bool DkMetaDataT::saveMetaData(const QString &filePath, bool force)
         return false;
     }
 
-    // Open image file for WRITING, save it with modified metadata
-    file.open(QFile::WriteOnly);
-    file.write(ba->data(), ba->size());
-    file.close();
+    // replace the file - it might be mapped by the loader (see DkBasicLoader::mapFileToBuffer())
+    QSaveFile sFile(filePath);
+    sFile.open(QFile::WriteOnly);
+    sFile.write(ba->data(), ba->size());
+
+    if (!sFile.commit()) {
+        qDebug() << "[DkMetaDataT] could not write: " << QFileInfo(filePath).fileName();
+        return false;
+    }
 
     qInfo() << "[DkMetaDataT] I saved: " << ba->size() << " bytes";
 
@@ -213,6 +545,7 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray> &ba, bool force)
         return false;
 
     // Get exif sections from currently loaded image (old exif object)
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
     Exiv2::XmpData &xmpData = mExifImg->xmpData();
     Exiv2::IptcData &iptcData = mExifImg->iptcData();
@@ -261,6 +594,7 @@ bool DkMetaDataT::saveMetaData(QSharedPointer<QByteArray> &ba, bool force)
     // Replace old exif object with new one and clear "dirty" flag
     mExifImg.swap(exifImgN);
     mExifState = loaded;
+    mRevision++;
 
     return true;
 }
@@ -273,6 +607,7 @@ QString DkMetaDataT::getDescription() const
         return description;
 
     try {
+        readFullMetaData();
         Exiv2::ExifData &exifData = mExifImg->exifData();
 
         if (!exifData.empty()) {
@@ -296,6 +631,9 @@ int DkMetaDataT::getOrientationDegree() const
     if (mExifState != loaded && mExifState != dirty)
         return 0;
 
+    if (mHeaderOnly)
+        return mHeader.orientation == -1 ? 0 : orientationToDegree(mHeader.orientation);
+
     int orientation = 0;
 
     try {
@@ -305,37 +643,8 @@ int DkMetaDataT::getOrientationDegree() const
             Exiv2::ExifKey key = Exiv2::ExifKey("Exif.Image.Orientation");
             Exiv2::ExifData::iterator pos = exifData.findKey(key);
 
-            if (pos != exifData.end() && pos->count() != 0) {
-                auto v = pos->getValue();
-                orientation = (int)pos->toFloat();
-
-                switch (orientation) {
-                case 6:
-                    orientation = 90;
-                    break;
-                case 7:
-                    orientation = 90;
-                    break;
-                case 3:
-                    orientation = 180;
-                    break;
-                case 4:
-                    orientation = 180;
-                    break;
-                case 8:
-                    orientation = -90;
-                    break;
-                case 5:
-                    orientation = -90;
-                    break;
-                case 1:
-                    orientation = 0;
-                    break;
-                default:
-                    orientation = -1;
-                    break;
-                }
-            }
+            if (pos != exifData.end() && pos->count() != 0)
+                orientation = orientationToDegree((int)pos->toFloat());
         }
     } catch (...) {
         return 0;
@@ -344,11 +653,45 @@ int DkMetaDataT::getOrientationDegree() const
     return orientation;
 }
 
+/**
+ * Converts the Exif orientation to degrees.
+ * @param orientation the Exif orientation [1 8]
+ * @return int the rotation in degrees or -1 if the orientation is illegal
+ **/
+int DkMetaDataT::orientationToDegree(int orientation)
+{
+    switch (orientation) {
+    case 6:
+        return 90;
+    case 7:
+        return 90;
+    case 3:
+        return 180;
+    case 4:
+        return 180;
+    case 8:
+        return -90;
+    case 5:
+        return -90;
+    case 1:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
 DkMetaDataT::ExifOrientationState DkMetaDataT::checkExifOrientation() const
 {
     if (mExifState != loaded && mExifState != dirty)
         return or_not_set;
 
+    if (mHeaderOnly) {
+        if (mHeader.orientation == -1)
+            return or_not_set;
+
+        return mHeader.orientation > 0 && mHeader.orientation <= 8 ? or_valid : or_illegal;
+    }
+
     QString orStr = getNativeExifValue("Exif.Image.Orientation", false);
 
     if (orStr.isEmpty())
@@ -377,6 +720,25 @@ int DkMetaDataT::getRating() const
     float xmpRating = -1;
     float fRating = 0;
 
+    if (mHeaderOnly) {
+        exifRating = mHeader.exifRating;
+        xmpRating = mHeader.xmpRating;
+    } else {
+        readRating(exifRating, xmpRating);
+    }
+
+    if (xmpRating == -1.0f && exifRating != -1.0f)
+        fRating = exifRating;
+    else if (xmpRating != -1.0f && exifRating == -1.0f)
+        fRating = xmpRating;
+    else
+        fRating = exifRating;
+
+    return qRound(fRating);
+}
+
+void DkMetaDataT::readRating(float &exifRating, float &xmpRating) const
+{
     Exiv2::ExifData &exifData = mExifImg->exifData(); // Exif.Image.Rating  - short
     Exiv2::XmpData &xmpData = mExifImg->xmpData(); // Xmp.xmp.Rating - text
 
@@ -412,15 +774,6 @@ int DkMetaDataT::getRating() const
             }
         }
     }
-
-    if (xmpRating == -1.0f && exifRating != -1.0f)
-        fRating = exifRating;
-    else if (xmpRating != -1.0f && exifRating == -1.0f)
-        fRating = xmpRating;
-    else
-        fRating = exifRating;
-
-    return qRound(fRating);
 }
 
 QSize DkMetaDataT::getImageSize() const
@@ -430,6 +783,9 @@ QSize DkMetaDataT::getImageSize() const
     if (mExifState != loaded && mExifState != dirty)
         return size;
 
+    if (mHeaderOnly)
+        return mHeader.size;
+
     bool ok = false;
     int width = getNativeExifValue("Exif.Photo.PixelXDimension", false).toInt(&ok);
 
@@ -451,6 +807,7 @@ QString DkMetaDataT::getNativeExifValue(const QString &key, bool humanReadable)
     if (mExifState != loaded && mExifState != dirty)
         return info;
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
 
     if (!exifData.empty()) {
@@ -493,6 +850,7 @@ QString DkMetaDataT::getXmpValue(const QString &key) const
     if (mExifState != loaded && mExifState != dirty)
         return info;
 
+    readFullMetaData();
     Exiv2::XmpData &xmpData = mExifImg->xmpData();
 
     if (!xmpData.empty()) {
@@ -522,6 +880,7 @@ QString DkMetaDataT::getExifValue(const QString &key) const
     if (mExifState != loaded && mExifState != dirty)
         return info;
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
     std::string sKey = key.toStdString();
 
@@ -562,6 +921,7 @@ QString DkMetaDataT::getIptcValue(const QString &key) const
     if (mExifState != loaded && mExifState != dirty)
         return info;
 
+    readFullMetaData();
     Exiv2::IptcData &iptcData = mExifImg->iptcData();
 
     if (!iptcData.empty()) {
@@ -708,6 +1068,13 @@ QImage DkMetaDataT::getThumbnail() const
     if (mExifState != loaded && mExifState != dirty)
         return qThumb;
 
+    if (mHeaderOnly) {
+        if (mHeader.thumbLength > 0)
+            qThumb.loadFromData(readSource(mHeader.thumbOffset, mHeader.thumbLength));
+
+        return qThumb;
+    }
+
     Exiv2::ExifData &exifData = mExifImg->exifData();
 
     if (exifData.empty())
@@ -737,6 +1104,7 @@ QImage DkMetaDataT::getPreviewImage(int minPreviewWidth) const
     if (mExifState != loaded && mExifState != dirty)
         return qImg;
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
 
     if (exifData.empty())
@@ -775,6 +1143,7 @@ QImage DkMetaDataT::getPreviewImage(int minPreviewWidth) const
 
 void DkMetaDataT::setUseSidecar(bool useSidecar)
 {
+    mRevision++;
     mUseSidecar = useSidecar;
 }
 
@@ -829,6 +1198,17 @@ bool DkMetaDataT::isJXL() const
     return newSuffix.contains(QRegularExpression("(jxl)", QRegularExpression::CaseInsensitiveOption)) != 0;
 }
 
+/**
+ * Returns the revision of the metadata.
+ * The revision changes whenever the metadata is modified. Hence,
+ * copies of the metadata can be shared if the revision did not change.
+ * @return quint64 the current revision
+ **/
+quint64 DkMetaDataT::revision() const
+{
+    return mRevision;
+}
+
 bool DkMetaDataT::isDirty() const
 {
     return mExifState == dirty;
@@ -841,6 +1221,7 @@ QStringList DkMetaDataT::getExifKeys() const
     if (mExifState != loaded && mExifState != dirty)
         return exifKeys;
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
 
     if (exifData.empty()) {
@@ -864,6 +1245,7 @@ QStringList DkMetaDataT::getXmpKeys() const
     if (mExifState != loaded && mExifState != dirty)
         return xmpKeys;
 
+    readFullMetaData();
     Exiv2::XmpData &xmpData = mExifImg->xmpData();
     Exiv2::XmpData::const_iterator end = xmpData.end();
 
@@ -887,6 +1269,7 @@ QStringList DkMetaDataT::getIptcKeys() const
     if (mExifState != loaded && mExifState != dirty)
         return iptcKeys;
 
+    readFullMetaData();
     Exiv2::IptcData &iptcData = mExifImg->iptcData();
     Exiv2::IptcData::iterator endI = iptcData.end();
 
@@ -908,6 +1291,7 @@ QStringList DkMetaDataT::getExifValues() const
     if (mExifState != loaded && mExifState != dirty)
         return QStringList();
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
     Exiv2::ExifData::const_iterator end = exifData.end();
 
@@ -930,6 +1314,7 @@ QStringList DkMetaDataT::getIptcValues() const
     if (mExifState != loaded && mExifState != dirty)
         return iptcValues;
 
+    readFullMetaData();
     Exiv2::IptcData &iptcData = mExifImg->iptcData();
     Exiv2::IptcData::iterator endI = iptcData.end();
 
@@ -954,6 +1339,7 @@ void DkMetaDataT::setQtValues(const QImage &cImg)
             if (!val.isEmpty()) {
                 mQtValues.append(val);
                 mQtKeys.append(cKey);
+                mRevision++;
             }
         }
     }
@@ -985,6 +1371,7 @@ void DkMetaDataT::setThumbnail(QImage thumb)
         return;
 
     try {
+        readFullMetaData();
         Exiv2::ExifData exifData = mExifImg->exifData();
 
         if (exifData.empty())
@@ -1013,6 +1400,7 @@ void DkMetaDataT::setThumbnail(QImage thumb)
 
         mExifImg->setExifData(exifData);
         mExifState = dirty;
+        mRevision++;
 
     } catch (...) {
         qDebug() << "I could not save the thumbnail...";
@@ -1073,13 +1461,29 @@ void DkMetaDataT::clearOrientation()
     if (mExifState == not_loaded || mExifState == no_data)
         return;
 
+    // already cleared - don't touch the data (this is called for every edit)
+    if (mHeaderOnly && mHeader.orientation == 1)
+        return;
+
+    try {
+        readFullMetaData();
+        Exiv2::ExifData &exifData = mExifImg->exifData();
+        Exiv2::ExifData::iterator pos = exifData.findKey(Exiv2::ExifKey("Exif.Image.Orientation"));
+
+        if (pos != exifData.end() && pos->count() != 0 && (int)pos->toFloat() == 1)
+            return;
+    } catch (...) {
+    }
+
     setExifValue("Exif.Image.Orientation", "1"); // we wrote "0" here - that was against the standard!
 }
 
 void DkMetaDataT::clearExifState()
 {
-    if (mExifState == dirty)
+    if (mExifState == dirty) {
         mExifState = loaded;
+        mRevision++;
+    }
 }
 
 void DkMetaDataT::setOrientation(int o)
@@ -1095,8 +1499,10 @@ void DkMetaDataT::setOrientation(int o)
     if (o == 270)
         o = -90;
 
+    mRevision++;
     int orientation = 1;
 
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData();
     Exiv2::ExifKey key = Exiv2::ExifKey("Exif.Image.Orientation");
 
@@ -1200,6 +1606,9 @@ void DkMetaDataT::setRating(int r)
         r = 0;
     }
 
+    mRevision++;
+
+    readFullMetaData();
     Exiv2::ExifData &exifData = mExifImg->exifData(); // Exif.Image.Rating  - short
     Exiv2::XmpData &xmpData = mExifImg->xmpData(); // Xmp.xmp.Rating - text
 
@@ -1271,7 +1680,11 @@ bool DkMetaDataT::setExifValue(QString key, QString taginfo)
     if (mExifState == not_loaded || mExifState == no_data)
         return false;
 
+    // the tag might be added even if setting its value fails
+    mRevision++;
+
     try {
+        readFullMetaData();
         if (mExifImg->checkMode(Exiv2::mdExif) != Exiv2::amReadWrite && mExifImg->checkMode(Exiv2::mdExif) != Exiv2::amWrite)
             return false;
 
@@ -1342,6 +1755,7 @@ void DkMetaDataT::printMetaData() const
     if (mExifState != loaded && mExifState != dirty)
         return;
 
+    readFullMetaData();
     Exiv2::XmpData &xmpData = mExifImg->xmpData();
 
     qDebug() << "Exif------------------------------------------------------------------";
@@ -1380,6 +1794,7 @@ bool DkMetaDataT::saveRectToXMP(const DkRotatingRect &rect, const QSize &size)
     if (mExifState != loaded && mExifState != dirty)
         return false;
 
+    readFullMetaData();
     Exiv2::XmpData xmpData = mExifImg->xmpData();
 
     QRectF r = rect.toExifRect(size);
@@ -1404,6 +1819,7 @@ bool DkMetaDataT::saveRectToXMP(const DkRotatingRect &rect, const QSize &size)
     try {
         mExifImg->setXmpData(xmpData);
         mExifState = dirty;
+        mRevision++;
 
         qInfo() << r << "written to XMP";
 
@@ -1419,10 +1835,12 @@ bool DkMetaDataT::clearXMPRect()
     if (mExifState != loaded && mExifState != dirty)
         return false;
 
+    readFullMetaData();
     Exiv2::XmpData xmpData = mExifImg->xmpData();
     setXMPValue(xmpData, "Xmp.crs.HasCrop", "False");
     mExifImg->setXmpData(xmpData);
     mExifState = dirty;
+    mRevision++;
 
     return true;
 }
@@ -1439,6 +1857,7 @@ DkRotatingRect DkMetaDataT::getXMPRect(const QSize &size) const
         hasCrop.compare("true", Qt::CaseInsensitive) != 0)
         return DkRotatingRect();
 
+    readFullMetaData();
     Exiv2::XmpData xmpData = mExifImg->xmpData();
     double top = getXmpValue("Xmp.crs.CropTop").toDouble();
     double bottom = getXmpValue("Xmp.crs.CropBottom").toDouble();
@@ -1483,6 +1902,7 @@ std::unique_ptr<Exiv2::Image> DkMetaDataT::loadSidecar(const QString &filePath)
         // Create a new XMP sidecar, unfortunately this one has fewer attributes than the adobe version:
         xmpImg = Exiv2::ImageFactory::create(Exiv2::ImageType::xmp, xmpFilePath.toStdString());
 
+        readFullMetaData();
         xmpImg->setMetadata(*mExifImg);
         xmpImg->writeMetadata(); // we need that to add xmp afterwards - but why?
     }
@@ -1982,4 +2402,247 @@ void DkMetaDataHelper::initialize()
 #endif
 }
 
+// DkMetaDataIndex --------------------------------------------------------------------
+DkMetaDataIndex::DkMetaDataIndex()
+{
+    mCacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/nomacs/metadata";
+}
+
+DkMetaDataIndex &DkMetaDataIndex::instance()
+{
+    static DkMetaDataIndex inst;
+    return inst;
+}
+
+QString DkMetaDataIndex::cacheDir() const
+{
+    return mCacheDir;
+}
+
+/**
+ * Returns the indexed metadata of a file.
+ * @param filePath the file
+ * @param modified the file's modification date (ms since epoch)
+ * @param size the file's size
+ * @param entry the indexed metadata
+ * @return bool false if the file is not indexed or changed since
+ **/
+bool DkMetaDataIndex::find(const QString &filePath, qint64 modified, qint64 size, Entry &entry)
+{
+    QFileInfo fi(filePath);
+
+    QMutexLocker locker(&mMutex);
+    const Folder &f = folder(fi.absolutePath());
+
+    auto it = f.entries.constFind(fi.fileName());
+
+    if (it == f.entries.constEnd() || it->modified != modified || it->size != size)
+        return false;
+
+    entry = it.value();
+    return true;
+}
+
+/**
+ * Returns the metadata of a file - it is read and indexed if needed.
+ * @param filePath the file
+ * @param modified the file's modification date (ms since epoch)
+ * @param size the file's size
+ * @return DkMetaDataIndex::Entry the metadata
+ **/
+DkMetaDataIndex::Entry DkMetaDataIndex::entry(const QString &filePath, qint64 modified, qint64 size)
+{
+    Entry e;
+
+    if (find(filePath, modified, size, e))
+        return e;
+
+    DkMetaDataT metaData;
+
+    try {
+        metaData.readMetaData(filePath);
+    } catch (...) {
+        // index it anyway - so that we do not try again
+    }
+
+    e = fromMetaData(metaData, modified, size);
+    insertIntern(filePath, e);
+
+    return e;
+}
+
+/**
+ * Indexes metadata that was read anyway (e.g. for a thumbnail).
+ * @param filePath the file
+ * @param metaData its metadata
+ **/
+void DkMetaDataIndex::insert(const QString &filePath, const DkMetaDataT &metaData)
+{
+    QFileInfo fi(filePath);
+
+    // e.g. images in zip files
+    if (!fi.isFile() || !metaData.isLoaded())
+        return;
+
+    qint64 modified = fi.lastModified().toMSecsSinceEpoch();
+    Entry e;
+
+    if (find(filePath, modified, fi.size(), e))
+        return;
+
+    insertIntern(filePath, fromMetaData(metaData, modified, fi.size()));
+}
+
+/**
+ * Writes all folders that have unsaved entries.
+ **/
+void DkMetaDataIndex::save()
+{
+    QMutexLocker locker(&mMutex);
+
+    for (auto it = mFolders.begin(); it != mFolders.end(); it++) {
+        if (it->numDirty > 0)
+            saveFolder(it.key(), it.value());
+    }
+}
+
+/**
+ * Removes the index from memory and disk.
+ **/
+void DkMetaDataIndex::clear()
+{
+    QMutexLocker locker(&mMutex);
+
+    mFolders.clear();
+    QDir(mCacheDir).removeRecursively();
+}
+
+DkMetaDataIndex::Entry DkMetaDataIndex::fromMetaData(const DkMetaDataT &metaData, qint64 modified, qint64 size)
+{
+    Entry e;
+    e.modified = modified;
+    e.size = size;
+
+    if (!metaData.isLoaded())
+        return e;
+
+    try {
+        QDateTime dateTaken = DkUtils::convertDate(metaData.getExifValue("DateTimeOriginal"));
+
+        if (dateTaken.isValid())
+            e.dateTaken = dateTaken.toMSecsSinceEpoch();
+
+        e.rating = metaData.getRating();
+        e.imageSize = metaData.getImageSize();
+        e.model = metaData.getExifValue("Model").trimmed();
+    } catch (...) {
+        qWarning() << "[DkMetaDataIndex] could not read the metadata";
+    }
+
+    return e;
+}
+
+void DkMetaDataIndex::insertIntern(const QString &filePath, const Entry &entry)
+{
+    QFileInfo fi(filePath);
+
+    QMutexLocker locker(&mMutex);
+    Folder &f = folder(fi.absolutePath());
+
+    f.entries.insert(fi.fileName(), entry);
+
+    // large folders are saved while they are indexed
+    if (++f.numDirty >= save_interval)
+        saveFolder(fi.absolutePath(), f);
+}
+
+/**
+ * Returns the index of a folder - it is loaded from disk if needed.
+ * The mutex must be locked.
+ **/
+DkMetaDataIndex::Folder &DkMetaDataIndex::folder(const QString &dirPath)
+{
+    auto it = mFolders.find(dirPath);
+
+    if (it != mFolders.end())
+        return it.value();
+
+    Folder &f = mFolders[dirPath];
+
+    if (!isPersistent())
+        return f;
+
+    QFile file(folderFilePath(dirPath));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return f;
+
+    QDataStream ds(&file);
+    ds.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    qint32 version = 0;
+    QString path;
+    qint32 numEntries = 0;
+
+    ds >> magic >> version >> path >> numEntries;
+
+    // an old version or a hash collision
+    if (magic != 0x4e4d4d49 || version != 1 || path != dirPath)
+        return f;
+
+    for (int idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+        QString name;
+        Entry e;
+        ds >> name >> e.modified >> e.size >> e.dateTaken >> e.rating >> e.imageSize >> e.model;
+
+        if (ds.status() == QDataStream::Ok)
+            f.entries.insert(name, e);
+    }
+
+    return f;
+}
+
+/**
+ * Writes a folder's index.
+ * The mutex must be locked.
+ **/
+void DkMetaDataIndex::saveFolder(const QString &dirPath, Folder &folder)
+{
+    folder.numDirty = 0;
+
+    if (!isPersistent() || !QDir().mkpath(mCacheDir))
+        return;
+
+    // the old index is replaced when we commit
+    QSaveFile file(folderFilePath(dirPath));
+
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream ds(&file);
+    ds.setVersion(QDataStream::Qt_5_6);
+
+    ds << (quint32)0x4e4d4d49 << (qint32)1 << dirPath << (qint32)folder.entries.size();
+
+    for (auto it = folder.entries.constBegin(); it != folder.entries.constEnd(); it++) {
+        const Entry &e = it.value();
+        ds << it.key() << e.modified << e.size << e.dateTaken << e.rating << e.imageSize << e.model;
+    }
+
+    if (!file.commit())
+        qWarning() << "[DkMetaDataIndex] could not save the index of" << dirPath;
+}
+
+QString DkMetaDataIndex::folderFilePath(const QString &dirPath) const
+{
+    QString hash = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return mCacheDir + "/" + hash + ".idx";
+}
+
+bool DkMetaDataIndex::isPersistent() const
+{
+    return !DkSettingsManager::param().app().privateMode;
+}
+
 }
@@ -28,8 +28,12 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
 #include <QSharedPointer>
+#include <QSize>
 #include <QStringList>
 
 // code for metadata crop:
@@ -146,6 +150,8 @@ public:
     bool isJXL() const;
     bool isDirty() const;
     bool useSidecar() const;
+    qint64 sourceMemory(QSharedPointer<QByteArray> fileBuffer = QSharedPointer<QByteArray>()) const;
+    quint64 revision() const;
     void printMetaData() const; // only for debug
 
     // code for metadata crop:
@@ -156,6 +162,12 @@ public:
 
 protected:
     std::unique_ptr<Exiv2::Image> loadSidecar(const QString &filePath) const;
+    std::unique_ptr<Exiv2::Image> openSource() const;
+    QByteArray readSource(qint64 offset, qint64 length) const;
+    bool readHeader(const QByteArray &data);
+    void readFullMetaData() const;
+    void readRating(float &exifRating, float &xmpRating) const;
+    static int orientationToDegree(int orientation);
 
     enum {
         not_loaded,
@@ -164,13 +176,33 @@ protected:
         dirty,
     };
 
-    std::unique_ptr<Exiv2::Image> mExifImg;
+    enum {
+        max_header_size = 256 * 1024,
+    };
+
+    // values parsed from the JPEG header - valid until all metadata is read
+    struct DkHeaderInfo {
+        int orientation = -1;
+        float exifRating = -1;
+        float xmpRating = -1;
+        QSize size;
+        qint64 thumbOffset = 0;
+        qint64 thumbLength = 0;
+    };
+
+    mutable std::unique_ptr<Exiv2::Image> mExifImg; // opened by readFullMetaData() for copies of header-only metadata
     QString mFilePath;
     QStringList mQtKeys;
     QStringList mQtValues;
 
     int mExifState = not_loaded;
     bool mUseSidecar = false;
+    quint64 mRevision = 0;
+
+    QSharedPointer<QByteArray> mSource;
+    DkHeaderInfo mHeader;
+    mutable QAtomicInt mHeaderOnly = 0; // const getters of all threads might read the full metadata
+    mutable QMutex mFullMetaDataMutex;
 };
 
 class DllCoreExport DkMetaDataHelper
@@ -242,4 +274,59 @@ protected:
     QMap<int, QString> mCompressionModes;
 };
 
+/**
+ * Persistent index of the metadata that images are sorted by.
+ * Reading the metadata of every file of a folder is too slow for sorting,
+ * so the fields are indexed when thumbnails are computed (or when the folder
+ * is sorted by them for the first time) and stored per folder in the user's
+ * cache directory. Entries are keyed by file name, modification date and size.
+ * The index is thread-safe and not persistent in private mode.
+ **/
+class DllCoreExport DkMetaDataIndex
+{
+public:
+    struct Entry {
+        qint64 modified = 0;
+        qint64 size = -1;
+        qint64 dateTaken = 0; // ms since epoch - 0 if unknown
+        int rating = -1;
+        QSize imageSize;
+        QString model;
+    };
+
+    static DkMetaDataIndex &instance();
+
+    bool find(const QString &filePath, qint64 modified, qint64 size, Entry &entry);
+    Entry entry(const QString &filePath, qint64 modified, qint64 size);
+    void insert(const QString &filePath, const DkMetaDataT &metaData);
+    void save();
+    void clear();
+
+    QString cacheDir() const;
+
+private:
+    DkMetaDataIndex();
+    DkMetaDataIndex(const DkMetaDataIndex &);
+
+    enum {
+        save_interval = 500, // unsaved entries of a folder
+    };
+
+    struct Folder {
+        QHash<QString, Entry> entries; // file name -> entry
+        int numDirty = 0;
+    };
+
+    static Entry fromMetaData(const DkMetaDataT &metaData, qint64 modified, qint64 size);
+    Folder &folder(const QString &dirPath);
+    void insertIntern(const QString &filePath, const Entry &entry);
+    void saveFolder(const QString &dirPath, Folder &folder);
+    QString folderFilePath(const QString &dirPath) const;
+    bool isPersistent() const;
+
+    QString mCacheDir;
+    QHash<QString, Folder> mFolders;
+    QMutex mMutex;
+};
+
 }
@@ -0,0 +1,318 @@
+/*******************************************************************************************************
+ DkMosaicDatabase.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMosaicDatabase.h"
+
+#include "DkLog.h"
+#include "DkSettings.h"
+#include "DkThumbs.h"
+#include "DkTimer.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkMosaicDatabase --------------------------------------------------------------------
+DkMosaicDatabase::DkMosaicDatabase(const QString &dirPath, const QString &ignore, const QString &suffix)
+{
+    mDirPath = QDir(dirPath).absolutePath();
+    mIgnore = ignore;
+    mSuffix = suffix;
+}
+
+/**
+ * Computes the descriptors of all database images in parallel.
+ * Descriptors of unchanged files are read from the database file.
+ * @param progress is called with the number of images indexed and the total number - return false to cancel
+ * @return bool false if indexing was canceled
+ **/
+bool DkMosaicDatabase::build(const std::function<bool(int, int)> &progress)
+{
+    DkTimer dt;
+
+    QStringList files = listFiles();
+    QHash<QString, Entry> cached = load();
+
+    QVector<Entry> entries(files.size());
+    Entry *dst = entries.data();
+
+    QVector<int> indexes(files.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    QAtomicInt numIndexed = 0;
+    QAtomicInt numComputed = 0;
+    QAtomicInt canceled = 0;
+
+    QtConcurrent::blockingMap(indexes, [&](int idx) {
+        if (canceled.loadAcquire())
+            return;
+
+        QFileInfo fi(files[idx]);
+        Entry e = cached.value(fi.absoluteFilePath());
+
+        qint64 modified = fi.lastModified().toMSecsSinceEpoch();
+
+        if (e.descriptor.size() != descriptor_length || e.modified != modified || e.fileSize != fi.size()) {
+            DkThumbNail thumb(fi.absoluteFilePath());
+            thumb.compute();
+
+            e.filePath = fi.absoluteFilePath();
+            e.modified = modified;
+            e.fileSize = fi.size();
+            e.descriptor = descriptor(thumb.getImage());
+            numComputed.fetchAndAddOrdered(1);
+        }
+
+        dst[idx] = e;
+
+        int n = numIndexed.fetchAndAddOrdered(1) + 1;
+        if (progress && !progress(n, files.size()))
+            canceled.storeRelease(1);
+    });
+
+    if (canceled.loadAcquire())
+        return false;
+
+    mEntries.clear();
+
+    for (const Entry &e : entries) {
+        // images that cannot be loaded are not part of the database
+        if (e.descriptor.size() != descriptor_length)
+            continue;
+
+        mEntries << e;
+        cached.insert(e.filePath, e);
+    }
+
+    if (numComputed.loadAcquire() > 0)
+        save(cached);
+
+    qCInfo(lcMosaic) << "[DkMosaicDatabase]" << mEntries.size() << "images indexed (" << numComputed.loadAcquire() << "new) in" << dt;
+
+    return true;
+}
+
+int DkMosaicDatabase::size() const
+{
+    return mEntries.size();
+}
+
+const DkMosaicDatabase::Entry &DkMosaicDatabase::entry(int idx) const
+{
+    return mEntries[idx];
+}
+
+/**
+ * Returns the k nearest database images of a descriptor.
+ * This function is thread-safe.
+ * @param descriptor the query descriptor
+ * @param k the number of neighbours
+ * @param excluded flags images (by index) that should not be returned
+ * @return QVector<QPair<float, int> > the distances and indexes of the neighbours (nearest first)
+ **/
+QVector<QPair<float, int>> DkMosaicDatabase::nearest(const QVector<float> &descriptor, int k, const QVector<bool> &excluded) const
+{
+    QVector<QPair<float, int>> best;
+
+    if (descriptor.size() != descriptor_length || k <= 0)
+        return best;
+
+    for (int idx = 0; idx < mEntries.size(); idx++) {
+        if (excluded.value(idx, false))
+            continue;
+
+        float d = distance(descriptor, mEntries[idx].descriptor);
+
+        if (best.size() == k && d >= best.last().first)
+            continue;
+
+        QPair<float, int> n(d, idx);
+        best.insert(std::upper_bound(best.begin(), best.end(), n), n);
+
+        if (best.size() > k)
+            best.removeLast();
+    }
+
+    return best;
+}
+
+/**
+ * Computes the descriptor of an image.
+ * @param img the image (e.g. a thumbnail or a mosaic patch)
+ * @return QVector<float> the lightness of the central square or an empty vector if img is NULL
+ **/
+QVector<float> DkMosaicDatabase::descriptor(const QImage &img)
+{
+    QVector<float> desc;
+
+    if (img.isNull())
+        return desc;
+
+    // sRGB -> linear
+    static const QVector<float> linear = []() {
+        QVector<float> lut(256);
+        for (int idx = 0; idx < lut.size(); idx++) {
+            float c = idx / 255.0f;
+            lut[idx] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return lut;
+    }();
+
+    int s = qMin(img.width(), img.height());
+    QImage patch = img.copy((img.width() - s) / 2, (img.height() - s) / 2, s, s);
+    patch = patch.scaled(descriptor_size, descriptor_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_RGB32);
+
+    desc.reserve(descriptor_length);
+
+    for (int rIdx = 0; rIdx < patch.height(); rIdx++) {
+        const QRgb *ptr = reinterpret_cast<const QRgb *>(patch.constScanLine(rIdx));
+
+        for (int cIdx = 0; cIdx < patch.width(); cIdx++) {
+            float y = 0.2126f * linear[qRed(ptr[cIdx])] + 0.7152f * linear[qGreen(ptr[cIdx])] + 0.0722f * linear[qBlue(ptr[cIdx])];
+            float f = y > 0.008856f ? std::cbrt(y) : 7.787f * y + 16.0f / 116.0f;
+            desc << 116.0f * f - 16.0f;
+        }
+    }
+
+    return desc;
+}
+
+/**
+ * Returns the L1 distance of two descriptors.
+ **/
+float DkMosaicDatabase::distance(const QVector<float> &d1, const QVector<float> &d2)
+{
+    if (d1.size() != d2.size())
+        return std::numeric_limits<float>::max();
+
+    float d = 0.0f;
+    for (int idx = 0; idx < d1.size(); idx++)
+        d += std::abs(d1[idx] - d2[idx]);
+
+    return d;
+}
+
+QString DkMosaicDatabase::databaseFilePath() const
+{
+    QString name = QCryptographicHash::hash(mDirPath.toUtf8(), QCryptographicHash::Md5).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/nomacs/mosaic/" + name + ".db";
+}
+
+QStringList DkMosaicDatabase::listFiles() const
+{
+    QStringList fileFilters = mSuffix.isEmpty() ? DkSettingsManager::param().app().fileFilters : QStringList(mSuffix);
+    QStringList ignoreList = mIgnore.split(";", Qt::SkipEmptyParts);
+
+    QStringList files;
+    QDirIterator it(mDirPath, fileFilters, QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        QString filePath = it.next();
+        bool ignore = false;
+
+        for (const QString &i : ignoreList) {
+            if (filePath.contains(i)) {
+                ignore = true;
+                break;
+            }
+        }
+
+        if (!ignore)
+            files << filePath;
+    }
+
+    return files;
+}
+
+QHash<QString, DkMosaicDatabase::Entry> DkMosaicDatabase::load() const
+{
+    QHash<QString, Entry> entries;
+
+    QFile file(databaseFilePath());
+    if (!file.open(QIODevice::ReadOnly))
+        return entries;
+
+    QDataStream ds(&file);
+
+    quint32 magic = 0;
+    qint32 version = 0;
+    qint32 numEntries = 0;
+    ds >> magic >> version >> numEntries;
+
+    if (magic != db_magic || version != db_version)
+        return entries;
+
+    for (int idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+        Entry e;
+        ds >> e.filePath >> e.modified >> e.fileSize >> e.descriptor;
+
+        if (ds.status() == QDataStream::Ok)
+            entries.insert(e.filePath, e);
+    }
+
+    return entries;
+}
+
+bool DkMosaicDatabase::save(const QHash<QString, Entry> &entries) const
+{
+    QFileInfo fi(databaseFilePath());
+
+    if (!QDir().mkpath(fi.absolutePath()))
+        return false;
+
+    QFile file(fi.absoluteFilePath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[DkMosaicDatabase] cannot write" << fi.absoluteFilePath();
+        return false;
+    }
+
+    QDataStream ds(&file);
+    ds << (quint32)db_magic << (qint32)db_version << (qint32)entries.size();
+
+    for (const Entry &e : entries)
+        ds << e.filePath << e.modified << e.fileSize << e.descriptor;
+
+    return ds.status() == QDataStream::Ok;
+}
+
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************************************
+ DkMosaicDatabase.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QHash>
+#include <QImage>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Patch descriptors of all images of a (mosaic) database folder.
+ * A descriptor is the CIE L* of the image's central square sampled
+ * to descriptor_size x descriptor_size. Descriptors are stored in the
+ * cache folder, so only new or modified images are decoded again.
+ **/
+class DllCoreExport DkMosaicDatabase
+{
+public:
+    enum {
+        descriptor_size = 8,
+        descriptor_length = descriptor_size * descriptor_size,
+    };
+
+    enum {
+        db_magic = 0x4d4f5341, // MOSA
+        db_version = 1,
+    };
+
+    struct Entry {
+        QString filePath;
+        qint64 modified = 0; // ms since epoch
+        qint64 fileSize = 0;
+        QVector<float> descriptor;
+    };
+
+    DkMosaicDatabase(const QString &dirPath, const QString &ignore = QString(), const QString &suffix = QString());
+
+    bool build(const std::function<bool(int, int)> &progress = std::function<bool(int, int)>());
+
+    int size() const;
+    const Entry &entry(int idx) const;
+
+    QVector<QPair<float, int>> nearest(const QVector<float> &descriptor, int k, const QVector<bool> &excluded = QVector<bool>()) const;
+
+    static QVector<float> descriptor(const QImage &img);
+    static float distance(const QVector<float> &d1, const QVector<float> &d2);
+
+    QString databaseFilePath() const;
+
+protected:
+    QStringList listFiles() const;
+    QHash<QString, Entry> load() const;
+    bool save(const QHash<QString, Entry> &entries) const;
+
+    QString mDirPath;
+    QString mIgnore;
+    QString mSuffix;
+
+    QVector<Entry> mEntries;
+};
+
+}
@@ -0,0 +1,400 @@
+/*******************************************************************************************************
+ DkMovie.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMovie.h"
+
+#include "DkSettings.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QScopedPointer>
+#include <QtConcurrentRun>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkMovieDecoder --------------------------------------------------------------------
+// holds the reader state - it is only accessed by one decoding task at a time
+class DkMovieDecoder
+{
+public:
+    DkMovieDecoder(const QString &filePath)
+        : mFilePath(filePath)
+    {
+        restart();
+    }
+
+    void restart()
+    {
+        mReader.reset(new QImageReader(mFilePath));
+        mNextIdx = 0;
+    }
+
+    // moves the reader to frameIdx - returns false if it is behind the reader
+    bool seek(int frameIdx)
+    {
+        if (frameIdx == mNextIdx)
+            return true;
+
+        // some plugins (e.g. tiff, ico) support random access
+        if (mReader->jumpToImage(frameIdx)) {
+            mNextIdx = frameIdx;
+            return true;
+        }
+
+        // sequential formats (gif, webp) need to compose frames from the start
+        if (frameIdx < mNextIdx)
+            restart();
+
+        return false;
+    }
+
+    QString mFilePath;
+    QScopedPointer<QImageReader> mReader;
+    int mNextIdx = 0;
+};
+
+// DkMovie --------------------------------------------------------------------
+DkMovie::DkMovie(const QString &filePath, QObject *parent)
+    : QObject(parent)
+{
+    QImageReader reader(filePath);
+    mNumFrames = qMax(reader.imageCount(), 0);
+    mDecodeTimes = QVector<int>(mNumFrames, -1);
+    mDecoder = QSharedPointer<DkMovieDecoder>(new DkMovieDecoder(filePath));
+
+    // the animation may use a quarter of the image cache
+    mMaxCacheBytes = qRound64(cacheMemory() * 1024.0 * 1024.0);
+
+    QSize s = reader.size();
+    qint64 frameBytes = qMax(s.width(), 1) * (qint64)qMax(s.height(), 1) * 4;
+    mMaxFrames = (int)qBound<qint64>(3, mMaxCacheBytes / frameBytes, qMax(mNumFrames, 3));
+
+    mTimer.setSingleShot(true);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(nextFrame()));
+    connect(&mDecodeWatcher, SIGNAL(finished()), this, SLOT(framesDecoded()));
+}
+
+DkMovie::~DkMovie()
+{
+    // the decoding task only holds the (shared) decoder - no need to wait for it
+    mDecodeWatcher.blockSignals(true);
+    mTimer.stop();
+}
+
+bool DkMovie::isValid() const
+{
+    return !mCurrent.img.isNull();
+}
+
+int DkMovie::frameCount() const
+{
+    return mNumFrames;
+}
+
+int DkMovie::currentFrameNumber() const
+{
+    return mCurrent.idx;
+}
+
+QImage DkMovie::currentImage() const
+{
+    return mCurrent.img;
+}
+
+QRect DkMovie::frameRect() const
+{
+    return mCurrent.img.rect();
+}
+
+/// <summary>
+/// Returns the memory (in MB) the frame cache may use.
+/// </summary>
+float DkMovie::cacheMemory() const
+{
+    return (float)DkMemoryGovernor::instance().cacheMemory() * 0.25f;
+}
+
+/// <summary>
+/// Returns the time (in ms) it took to decode a frame or -1 if it was not decoded yet.
+/// </summary>
+int DkMovie::decodeTime(int frameIdx) const
+{
+    return mDecodeTimes.value(frameIdx, -1);
+}
+
+void DkMovie::start()
+{
+    mPlaying = true;
+    mPaused = false;
+    mForward = true;
+    showFrame(0);
+}
+
+void DkMovie::stop()
+{
+    mPlaying = false;
+    mPendingIdx = -1;
+    mTimer.stop();
+}
+
+void DkMovie::setPaused(bool paused)
+{
+    mPaused = paused;
+
+    if (paused)
+        mTimer.stop();
+    else if (mPlaying && isValid())
+        mTimer.start(mCurrent.delay);
+}
+
+void DkMovie::jumpToNextFrame()
+{
+    if (mNumFrames > 0) {
+        mForward = true;
+        jumpToFrame((qMax(mCurrent.idx, 0) + 1) % mNumFrames);
+    }
+}
+
+void DkMovie::jumpToPreviousFrame()
+{
+    if (mNumFrames > 0) {
+        mForward = false;
+        jumpToFrame((qMax(mCurrent.idx, 0) - 1 + mNumFrames) % mNumFrames);
+    }
+}
+
+void DkMovie::jumpToFrame(int frameIdx)
+{
+    if (frameIdx < 0 || frameIdx >= mNumFrames)
+        return;
+
+    mTimer.stop();
+    showFrame(frameIdx);
+}
+
+void DkMovie::nextFrame()
+{
+    if (mNumFrames > 0) {
+        mForward = true;
+        showFrame((mCurrent.idx + 1) % mNumFrames);
+    }
+}
+
+void DkMovie::showFrame(int frameIdx)
+{
+    if (!mFrames.contains(frameIdx)) {
+        // playback stalls until the frame is decoded
+        requestFrame(frameIdx);
+        return;
+    }
+
+    mPendingIdx = -1;
+    mCurrent = mFrames.value(frameIdx);
+    emit frameChanged(frameIdx);
+
+    if (mPlaying && !mPaused)
+        mTimer.start(mCurrent.delay);
+
+    evict();
+    decodeAhead();
+}
+
+void DkMovie::requestFrame(int frameIdx)
+{
+    mPendingIdx = frameIdx;
+
+    // framesDecoded() picks up the pending frame
+    if (mDecodeWatcher.isRunning())
+        return;
+
+    if (mForward) {
+        decode(frameIdx, decode_batch);
+    } else {
+        // decode a window that ends at the requested frame so that
+        // stepping back further is served from the cache
+        int from = qMax(frameIdx - mMaxFrames / 2, 0);
+        decode(from, frameIdx - from + 1);
+    }
+}
+
+void DkMovie::decodeAhead()
+{
+    if (mDecodeWatcher.isRunning() || mNumFrames <= 1)
+        return;
+
+    int ahead = qMin(mMaxFrames - 1, mNumFrames - 1);
+
+    for (int k = 1; k <= ahead; k++) {
+        int idx = mForward ? (mCurrent.idx + k) % mNumFrames : (mCurrent.idx - k + mNumFrames) % mNumFrames;
+
+        if (!mFrames.contains(idx)) {
+            if (mForward) {
+                decode(idx, qMin<int>(decode_batch, ahead - k + 1));
+            } else {
+                int from = qMax(idx - (ahead - k), 0);
+                decode(from, idx - from + 1);
+            }
+            return;
+        }
+    }
+}
+
+void DkMovie::decode(int from, int count)
+{
+    mDecodeWatcher.setFuture(QtConcurrent::run(&DkMovie::decodeFrames, mDecoder, from, count, mNumFrames));
+}
+
+void DkMovie::framesDecoded()
+{
+    const QVector<DkFrame> frames = mDecodeWatcher.result();
+
+    // stop decoding if the file is broken
+    if (frames.isEmpty()) {
+        if (mPendingIdx != -1)
+            qWarning() << "[DkMovie] could not decode frame" << mPendingIdx;
+        mPendingIdx = -1;
+        return;
+    }
+
+    for (const DkFrame &f : frames) {
+        if (mDecodeTimes[f.idx] == -1 && f.decodeTime > f.delay)
+            qInfo() << "[DkMovie] frame" << f.idx << "took" << f.decodeTime << "ms to decode, its delay is" << f.delay << "ms";
+
+        mDecodeTimes[f.idx] = f.decodeTime;
+
+        if (!mFrames.contains(f.idx)) {
+            mFrames.insert(f.idx, f);
+            mCacheBytes += f.img.sizeInBytes();
+        }
+    }
+
+    // the frames might be larger than expected
+    if (!mFrames.isEmpty()) {
+        qint64 frameBytes = qMax<qint64>(mCacheBytes / mFrames.size(), 1);
+        mMaxFrames = (int)qBound<qint64>(3, mMaxCacheBytes / frameBytes, qMax(mNumFrames, 3));
+    }
+
+    if (mPendingIdx != -1)
+        showFrame(mPendingIdx);
+    else {
+        evict();
+        decodeAhead();
+    }
+}
+
+/// <summary>
+/// Returns how far a frame is from the playhead in playback direction.
+/// </summary>
+int DkMovie::distance(int frameIdx) const
+{
+    int cIdx = qMax(mCurrent.idx, 0);
+    int d = mForward ? frameIdx - cIdx : cIdx - frameIdx;
+    return (d + mNumFrames) % qMax(mNumFrames, 1);
+}
+
+void DkMovie::evict()
+{
+    // drop the frames that are played last
+    while (mFrames.size() > mMaxFrames) {
+        int farIdx = -1;
+        int farDist = -1;
+
+        for (auto it = mFrames.constBegin(); it != mFrames.constEnd(); it++) {
+            int d = distance(it.key());
+            if (it.key() != mCurrent.idx && d > farDist) {
+                farDist = d;
+                farIdx = it.key();
+            }
+        }
+
+        if (farIdx == -1)
+            break;
+
+        mCacheBytes -= mFrames.take(farIdx).img.sizeInBytes();
+    }
+}
+
+/// <summary>
+/// Decodes count frames starting with from (runs on a worker thread).
+/// Frames preceding from are composed but not returned if the reader cannot seek.
+/// </summary>
+QVector<DkMovie::DkFrame> DkMovie::decodeFrames(QSharedPointer<DkMovieDecoder> decoder, int from, int count, int numFrames)
+{
+    QVector<DkFrame> frames;
+
+    if (numFrames <= 0 || from < 0 || from >= numFrames)
+        return frames;
+
+    count = qMin(count, numFrames);
+    decoder->seek(from);
+
+    bool wrapped = false;
+
+    while (frames.size() < count) {
+        int idx = decoder->mNextIdx;
+
+        if (idx >= numFrames) {
+            // loop the animation
+            if (wrapped)
+                break;
+            decoder->restart();
+            wrapped = true;
+            continue;
+        }
+
+        QElapsedTimer dt;
+        dt.start();
+
+        DkFrame f;
+        f.idx = idx;
+        f.img = decoder->mReader->read();
+        f.decodeTime = (int)dt.elapsed();
+
+        int delay = decoder->mReader->nextImageDelay();
+        f.delay = delay > 0 ? delay : 100;
+
+        if (f.img.isNull()) {
+            qWarning() << "[DkMovie] could not read frame" << idx << decoder->mReader->errorString();
+            decoder->restart();
+            break;
+        }
+
+        decoder->mNextIdx++;
+
+        if (idx >= from || !frames.isEmpty())
+            frames << f;
+    }
+
+    return frames;
+}
+
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************************************
+ DkMovie.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QFutureWatcher>
+#include <QImage>
+#include <QMap>
+#include <QSharedPointer>
+#include <QSize>
+#include <QTimer>
+#include <QVector>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+class DkMovieDecoder;
+
+/**
+ * Plays animated images (GIF, WebP...).
+ * Frames are decoded ahead on a worker thread into a cache whose size is
+ * bounded by the cache memory setting. The GUI thread only displays frames.
+ * Stepping backwards decodes a window of frames preceding the requested
+ * frame, so that going back further is served from the cache.
+ **/
+class DllCoreExport DkMovie : public QObject
+{
+    Q_OBJECT
+
+public:
+    DkMovie(const QString &filePath, QObject *parent = 0);
+    virtual ~DkMovie();
+
+    bool isValid() const;
+    int frameCount() const;
+    int currentFrameNumber() const;
+    QImage currentImage() const;
+    QRect frameRect() const;
+
+    float cacheMemory() const;
+    int decodeTime(int frameIdx) const;
+
+public slots:
+    void start();
+    void stop();
+    void setPaused(bool paused);
+    void jumpToNextFrame();
+    void jumpToPreviousFrame();
+    void jumpToFrame(int frameIdx);
+
+signals:
+    void frameChanged(int frameIdx);
+
+protected slots:
+    void framesDecoded();
+    void nextFrame();
+
+protected:
+    struct DkFrame {
+        int idx = -1;
+        QImage img;
+        int delay = 100; // ms
+        int decodeTime = 0; // ms
+    };
+
+    enum {
+        decode_batch = 4,
+    };
+
+    void showFrame(int frameIdx);
+    void requestFrame(int frameIdx);
+    void decodeAhead();
+    void decode(int from, int count);
+    void evict();
+    int distance(int frameIdx) const;
+
+    static QVector<DkFrame> decodeFrames(QSharedPointer<DkMovieDecoder> decoder, int from, int count, int numFrames);
+
+    QSharedPointer<DkMovieDecoder> mDecoder;
+    QFutureWatcher<QVector<DkFrame>> mDecodeWatcher;
+    QTimer mTimer;
+
+    QMap<int, DkFrame> mFrames; // decoded frames
+    qint64 mCacheBytes = 0;
+    qint64 mMaxCacheBytes = 0;
+    int mMaxFrames = 3;
+    QVector<int> mDecodeTimes; // ms per frame, -1 if not decoded yet
+
+    DkFrame mCurrent;
+    int mNumFrames = 0;
+    int mPendingIdx = -1; // the frame to be shown as soon as it's decoded
+    bool mForward = true;
+    bool mPlaying = false;
+    bool mPaused = false;
+};
+
+}
@@ -0,0 +1,599 @@
+/*******************************************************************************************************
+ DkParallelEncoder.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkParallelEncoder.h"
+
+#include "DkImageStorage.h"
+#include "DkSettings.h"
+#include "DkTimer.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QColorSpace>
+#include <QDebug>
+#include <QVector>
+#include <QtConcurrentMap>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// zlib comes with quazip
+#ifdef WITH_QUAZIP
+#include <zlib.h>
+#endif
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+#ifdef WITH_QUAZIP
+
+static void appendU16(QByteArray &ba, quint16 val, bool bigEndian)
+{
+    uchar b[2];
+    bigEndian ? qToBigEndian(val, b) : qToLittleEndian(val, b);
+    ba.append((const char *)b, 2);
+}
+
+static void appendU32(QByteArray &ba, quint32 val, bool bigEndian)
+{
+    uchar b[4];
+    bigEndian ? qToBigEndian(val, b) : qToLittleEndian(val, b);
+    ba.append((const char *)b, 4);
+}
+
+static inline int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = qAbs(p - a);
+    int pb = qAbs(p - b);
+    int pc = qAbs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+
+    return pb <= pc ? b : c;
+}
+
+/**
+ * Filters a PNG row with the filter that minimizes the sum of absolute differences.
+ * @param cur the row
+ * @param prev the previous row (zeros for the first row)
+ * @param n the number of bytes per row
+ * @param bpp the number of bytes per pixel
+ * @param dst the filter type followed by the filtered row
+ **/
+static void pngFilterRow(const uchar *cur, const uchar *prev, qint64 n, int bpp, uchar *dst)
+{
+    auto predict = [&](int type, qint64 x) -> int {
+        int a = x >= bpp ? cur[x - bpp] : 0;
+        int b = prev[x];
+        int c = x >= bpp ? prev[x - bpp] : 0;
+
+        switch (type) {
+        case 1:
+            return a;
+        case 2:
+            return b;
+        case 3:
+            return (a + b) >> 1;
+        case 4:
+            return paeth(a, b, c);
+        }
+
+        return 0;
+    };
+
+    quint64 sums[5] = {0, 0, 0, 0, 0};
+
+    for (qint64 x = 0; x < n; x++) {
+        for (int t = 0; t < 5; t++)
+            sums[t] += qAbs((int)(qint8)(uchar)(cur[x] - predict(t, x)));
+    }
+
+    int best = (int)(std::min_element(sums, sums + 5) - sums);
+
+    dst[0] = (uchar)best;
+    for (qint64 x = 0; x < n; x++)
+        dst[x + 1] = (uchar)(cur[x] - predict(best, x));
+}
+
+static void pngChunk(QByteArray &ba, const char *type, const QByteArray &data)
+{
+    appendU32(ba, data.size(), true);
+    ba.append(type, 4);
+    ba.append(data);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)type, 4);
+    crc = crc32(crc, (const Bytef *)data.constData(), data.size());
+    appendU32(ba, (quint32)crc, true);
+}
+
+class DkTiffTag
+{
+public:
+    enum Type {
+        type_short = 3,
+        type_long = 4,
+        type_rational = 5,
+        type_undefined = 7,
+    };
+
+    DkTiffTag(quint16 tag, Type type, quint32 count, const QByteArray &value)
+        : tag(tag)
+        , type(type)
+        , count(count)
+        , value(value)
+    {
+    }
+
+    static DkTiffTag shorts(quint16 tag, const QVector<quint16> &vals)
+    {
+        QByteArray v;
+        for (quint16 val : vals)
+            appendU16(v, val, false);
+        return DkTiffTag(tag, type_short, vals.size(), v);
+    }
+
+    static DkTiffTag longs(quint16 tag, const QVector<quint32> &vals)
+    {
+        QByteArray v;
+        for (quint32 val : vals)
+            appendU32(v, val, false);
+        return DkTiffTag(tag, type_long, vals.size(), v);
+    }
+
+    static DkTiffTag rational(quint16 tag, quint32 num, quint32 den)
+    {
+        QByteArray v;
+        appendU32(v, num, false);
+        appendU32(v, den, false);
+        return DkTiffTag(tag, type_rational, 1, v);
+    }
+
+    quint16 tag;
+    Type type;
+    quint32 count;
+    QByteArray value;
+};
+
+#endif // WITH_QUAZIP
+
+// DkParallelEncoder --------------------------------------------------------------------
+/**
+ * Returns true if img should be encoded by the parallel encoder.
+ * @param img the image
+ * @param suffix the suffix of the file
+ * @param compression the compression requested - TIFFs are only handled if they should be compressed
+ * @return bool true if encode() should be used
+ **/
+bool DkParallelEncoder::canEncode(const QImage &img, const QString &suffix, int compression)
+{
+#ifdef WITH_QUAZIP
+    if (!DkSettingsManager::snapshot()->resources().parallelEncoding || (qint64)img.width() * img.height() < min_pixels)
+        return false;
+
+    QString s = suffix.toLower();
+    return s == "png" || ((s == "tif" || s == "tiff") && compression > 0);
+#else
+    Q_UNUSED(img);
+    Q_UNUSED(suffix);
+    Q_UNUSED(compression);
+    return false;
+#endif
+}
+
+/**
+ * Encodes img using all threads.
+ * @param img the image
+ * @param suffix the suffix of the file (png, tif or tiff)
+ * @param ba the encoded file
+ * @param compression the compression requested - PNGs map it to a zlib level as Qt does, the only compressed TIFFs we write are deflated
+ * @return bool true if img was encoded - false if Qt should encode it.
+ **/
+bool DkParallelEncoder::encode(const QImage &img, const QString &suffix, QByteArray &ba, int compression)
+{
+    DkTimer dt;
+    bool encoded = false;
+
+    if (suffix.toLower() == "png") {
+#ifdef WITH_QUAZIP
+        // Qt's PNG writer maps the quality [0 100] to the zlib levels [9 0]
+        int level = compression < 0 ? Z_DEFAULT_COMPRESSION : (100 - qMin(compression, 100)) * 9 / 91;
+#else
+        Q_UNUSED(compression);
+        int level = -1;
+#endif
+        encoded = encodePng(img, ba, level);
+    } else
+        encoded = encodeTiff(img, ba);
+
+    if (encoded)
+        qInfo() << "[DkParallelEncoder]" << img.size() << "encoded to" << ba.size() / (1024 * 1024) << "MB in" << dt;
+    else
+        ba.clear();
+
+    return encoded;
+}
+
+/**
+ * Converts img to a format whose rows can be packed directly.
+ * @param img the image
+ * @param channels the number of channels written (1: gray, 3: RGB, 4: RGBA)
+ * @param bitDepth the bits per channel (8 or 16)
+ * @return QImage Grayscale8/16, RGB888, RGBA8888 or RGBA64
+ **/
+QImage DkParallelEncoder::toPacked(const QImage &img, int &channels, int &bitDepth)
+{
+    if (img.format() == QImage::Format_Grayscale8 || img.format() == QImage::Format_Grayscale16) {
+        channels = 1;
+        bitDepth = img.depth();
+        return img;
+    }
+
+    bool alpha = DkImage::alphaChannelUsed(img);
+    channels = alpha ? 4 : 3;
+
+    if (img.depth() == 64) {
+        bitDepth = 16;
+        return img.convertToFormat(QImage::Format_RGBA64);
+    }
+
+    bitDepth = 8;
+    return img.convertToFormat(alpha ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+}
+
+/**
+ * Copies a row of the packed image (see toPacked()).
+ * 16 bit images store 4 channels - the alpha is dropped for RGB.
+ **/
+void DkParallelEncoder::packRow(const QImage &img, int row, int channels, int bitDepth, bool bigEndian, uchar *dst)
+{
+    const uchar *src = img.constScanLine(row);
+    int w = img.width();
+
+    if (bitDepth == 8) {
+        memcpy(dst, src, (size_t)w * channels);
+        return;
+    }
+
+    const quint16 *s = (const quint16 *)src;
+    int sc = img.format() == QImage::Format_Grayscale16 ? 1 : 4;
+
+    for (int x = 0; x < w; x++) {
+        for (int c = 0; c < channels; c++) {
+            quint16 v = s[x * sc + c];
+
+            if (bigEndian)
+                qToBigEndian(v, dst);
+            else
+                qToLittleEndian(v, dst);
+            dst += 2;
+        }
+    }
+}
+
+/**
+ * Encodes a PNG. The rows are filtered concurrently, then the filtered
+ * data is deflated in chunks primed with the 32 KB before them.
+ * All but the last chunk end with a sync flush so that they can be joined
+ * to a single zlib stream, the checksum is combined from the chunks'.
+ * @param level the zlib compression level of all chunks (Z_DEFAULT_COMPRESSION or [0 9])
+ **/
+bool DkParallelEncoder::encodePng(const QImage &src, QByteArray &ba, int level)
+{
+#ifdef WITH_QUAZIP
+    int channels = 0, bitDepth = 0;
+    QImage img = toPacked(src, channels, bitDepth);
+
+    if (img.isNull())
+        return false;
+
+    int h = img.height();
+    int bpp = channels * bitDepth / 8;
+    qint64 rowBytes = (qint64)img.width() * bpp;
+    qint64 stride = rowBytes + 1; // each row starts with its filter type
+
+    std::vector<uchar> filtered;
+    try {
+        filtered.resize((size_t)(stride * h));
+    } catch (...) {
+        return false;
+    }
+
+    DkImage::parallelRows(h, [&](int firstRow, int lastRow) {
+        std::vector<uchar> prev((size_t)rowBytes, 0);
+        std::vector<uchar> cur((size_t)rowBytes);
+
+        if (firstRow > 0)
+            packRow(img, firstRow - 1, channels, bitDepth, true, prev.data());
+
+        for (int r = firstRow; r < lastRow; r++) {
+            packRow(img, r, channels, bitDepth, true, cur.data());
+            pngFilterRow(cur.data(), prev.data(), rowBytes, bpp, filtered.data() + r * stride);
+            std::swap(prev, cur);
+        }
+    });
+
+    qint64 total = (qint64)filtered.size();
+    int numChunks = (int)((total + chunk_size - 1) / chunk_size);
+
+    QVector<QByteArray> chunks(numChunks);
+    QVector<uLong> adlers(numChunks);
+    QVector<int> chunkIdx;
+    for (int idx = 0; idx < numChunks; idx++)
+        chunkIdx << idx;
+
+    QtConcurrent::blockingMap(chunkIdx, [&](int idx) {
+        qint64 offset = (qint64)idx * chunk_size;
+        uInt length = (uInt)qMin<qint64>(chunk_size, total - offset);
+        const Bytef *in = filtered.data() + offset;
+        bool last = idx == numChunks - 1;
+
+        adlers[idx] = adler32(adler32(0L, Z_NULL, 0), in, length);
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+
+        // raw deflate - the zlib header and checksum are written once for all chunks
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+
+        if (offset > 0) {
+            uInt dl = (uInt)qMin<qint64>(32768, offset);
+            deflateSetDictionary(&zs, in - dl, dl);
+        }
+
+        QByteArray &out = chunks[idx];
+        out.resize((int)deflateBound(&zs, length) + 16);
+
+        zs.next_in = (Bytef *)in;
+        zs.avail_in = length;
+        zs.next_out = (Bytef *)out.data();
+        zs.avail_out = out.size();
+
+        int rc = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool ok = last ? rc == Z_STREAM_END : (rc == Z_OK && zs.avail_in == 0 && zs.avail_out > 0);
+
+        out.resize(ok ? (int)zs.total_out : 0);
+        deflateEnd(&zs);
+    });
+
+    qint64 size = 0;
+    uLong adler = adlers[0];
+
+    for (int idx = 0; idx < numChunks; idx++) {
+        if (chunks[idx].isEmpty())
+            return false;
+
+        size += chunks[idx].size();
+
+        if (idx > 0)
+            adler = adler32_combine(adler, adlers[idx], (z_off_t)qMin<qint64>(chunk_size, total - (qint64)idx * chunk_size));
+    }
+
+    // QByteArray cannot hold more
+    if (size > std::numeric_limits<int>::max() - (1 << 24))
+        return false;
+
+    ba.clear();
+    ba.reserve((int)size + (1 << 16));
+    ba.append("\x89PNG\r\n\x1A\n", 8);
+
+    QByteArray ihdr;
+    appendU32(ihdr, img.width(), true);
+    appendU32(ihdr, h, true);
+    ihdr.append((char)bitDepth);
+    ihdr.append((char)(channels == 1 ? 0 : channels == 3 ? 2 : 6)); // gray, RGB, RGBA
+    ihdr.append(QByteArray(3, '\0')); // deflate, adaptive filters, no interlace
+    pngChunk(ba, "IHDR", ihdr);
+
+    QByteArray icc = src.colorSpace().isValid() ? src.colorSpace().iccProfile() : QByteArray();
+    if (!icc.isEmpty()) {
+        uLongf cl = compressBound(icc.size());
+        QByteArray cIcc(cl, '\0');
+
+        if (compress2((Bytef *)cIcc.data(), &cl, (const Bytef *)icc.constData(), icc.size(), Z_DEFAULT_COMPRESSION) == Z_OK) {
+            cIcc.resize(cl);
+            pngChunk(ba, "iCCP", QByteArray("ICC Profile", 12) + QByteArray(1, '\0') + cIcc);
+        }
+    }
+
+    if (src.dotsPerMeterX() > 0 && src.dotsPerMeterY() > 0) {
+        QByteArray phys;
+        appendU32(phys, src.dotsPerMeterX(), true);
+        appendU32(phys, src.dotsPerMeterY(), true);
+        phys.append((char)1); // meter
+        pngChunk(ba, "pHYs", phys);
+    }
+
+    for (int idx = 0; idx < numChunks; idx++) {
+        QByteArray data;
+
+        // zlib header: deflate, 32 KB window & the level (fastest, fast, default, maximum)
+        if (idx == 0) {
+            const char *header = level == Z_DEFAULT_COMPRESSION || level == 6 ? "\x78\x9C" : level < 2 ? "\x78\x01" : level < 6 ? "\x78\x5E" : "\x78\xDA";
+            data.append(header, 2);
+        }
+
+        data.append(chunks[idx]);
+        chunks[idx].clear();
+
+        if (idx == numChunks - 1)
+            appendU32(data, (quint32)adler, true);
+
+        pngChunk(ba, "IDAT", data);
+    }
+
+    pngChunk(ba, "IEND", QByteArray());
+
+    return true;
+#else
+    Q_UNUSED(src);
+    Q_UNUSED(ba);
+    Q_UNUSED(level);
+    return false;
+#endif
+}
+
+/**
+ * Encodes a TIFF with Deflate compressed strips.
+ * The strips are independent, so they are compressed concurrently.
+ **/
+bool DkParallelEncoder::encodeTiff(const QImage &src, QByteArray &ba)
+{
+#ifdef WITH_QUAZIP
+    int channels = 0, bitDepth = 0;
+    QImage img = toPacked(src, channels, bitDepth);
+
+    if (img.isNull())
+        return false;
+
+    int h = img.height();
+    qint64 rowBytes = (qint64)img.width() * channels * bitDepth / 8;
+    int rowsPerStrip = (int)qBound<qint64>(1, chunk_size / rowBytes, h);
+    int numStrips = (h + rowsPerStrip - 1) / rowsPerStrip;
+
+    QVector<QByteArray> strips(numStrips);
+    QVector<int> stripIdx;
+    for (int idx = 0; idx < numStrips; idx++)
+        stripIdx << idx;
+
+    QtConcurrent::blockingMap(stripIdx, [&](int idx) {
+        int firstRow = idx * rowsPerStrip;
+        int lastRow = qMin(h, firstRow + rowsPerStrip);
+
+        std::vector<uchar> raw((size_t)(rowBytes * (lastRow - firstRow)));
+        for (int r = firstRow; r < lastRow; r++)
+            packRow(img, r, channels, bitDepth, false, raw.data() + (r - firstRow) * rowBytes);
+
+        uLongf length = compressBound((uLong)raw.size());
+        QByteArray &out = strips[idx];
+        out.resize((int)length);
+
+        if (compress2((Bytef *)out.data(), &length, raw.data(), (uLong)raw.size(), Z_DEFAULT_COMPRESSION) == Z_OK)
+            out.resize((int)length);
+        else
+            out.clear();
+    });
+
+    qint64 size = 0;
+    for (const QByteArray &s : strips) {
+        if (s.isEmpty())
+            return false;
+        size += s.size() + 1;
+    }
+
+    // QByteArray cannot hold more (and classic TIFFs are limited to 4 GB anyway)
+    if (size > std::numeric_limits<int>::max() - (1 << 24))
+        return false;
+
+    ba.clear();
+    ba.reserve((int)size + (1 << 16));
+    ba.append("II", 2);
+    appendU16(ba, 42, false);
+    appendU32(ba, 0, false); // IFD offset - see below
+
+    QVector<quint32> offsets;
+    QVector<quint32> counts;
+
+    for (QByteArray &s : strips) {
+        offsets << ba.size();
+        counts << s.size();
+        ba.append(s);
+        s.clear();
+
+        // word alignment
+        if (ba.size() % 2)
+            ba.append('\0');
+    }
+
+    QVector<quint16> bits(channels, (quint16)bitDepth);
+    bool hasRes = src.dotsPerMeterX() > 0 && src.dotsPerMeterY() > 0;
+    QByteArray icc = src.colorSpace().isValid() ? src.colorSpace().iccProfile() : QByteArray();
+
+    // tags need to be sorted
+    QVector<DkTiffTag> tags;
+    tags << DkTiffTag::longs(256, {(quint32)img.width()});
+    tags << DkTiffTag::longs(257, {(quint32)h});
+    tags << DkTiffTag::shorts(258, bits);
+    tags << DkTiffTag::shorts(259, {8}); // Adobe Deflate
+    tags << DkTiffTag::shorts(262, {(quint16)(channels == 1 ? 1 : 2)}); // min is black, RGB
+    tags << DkTiffTag::longs(273, offsets);
+    tags << DkTiffTag::shorts(277, {(quint16)channels});
+    tags << DkTiffTag::longs(278, {(quint32)rowsPerStrip});
+    tags << DkTiffTag::longs(279, counts);
+    if (hasRes) {
+        tags << DkTiffTag::rational(282, qRound(src.dotsPerMeterX() * 0.0254 * 1000), 1000);
+        tags << DkTiffTag::rational(283, qRound(src.dotsPerMeterY() * 0.0254 * 1000), 1000);
+    }
+    tags << DkTiffTag::shorts(284, {1}); // chunky
+    if (hasRes)
+        tags << DkTiffTag::shorts(296, {2}); // inch
+    if (channels == 4)
+        tags << DkTiffTag::shorts(338, {2}); // unassociated alpha
+    if (!icc.isEmpty())
+        tags << DkTiffTag(34675, DkTiffTag::type_undefined, icc.size(), icc);
+
+    quint32 ifdOffset = ba.size();
+    qToLittleEndian(ifdOffset, (uchar *)ba.data() + 4);
+
+    // values larger than 4 bytes are stored behind the IFD
+    quint32 extOffset = ifdOffset + 2 + 12 * tags.size() + 4;
+    QByteArray ext;
+
+    appendU16(ba, tags.size(), false);
+    for (const DkTiffTag &t : tags) {
+        appendU16(ba, t.tag, false);
+        appendU16(ba, t.type, false);
+        appendU32(ba, t.count, false);
+
+        if (t.value.size() <= 4) {
+            ba.append(t.value);
+            ba.append(QByteArray(4 - t.value.size(), '\0'));
+        } else {
+            appendU32(ba, extOffset + ext.size(), false);
+            ext.append(t.value);
+
+            if (ext.size() % 2)
+                ext.append('\0');
+        }
+    }
+    appendU32(ba, 0, false); // last IFD
+    ba.append(ext);
+
+    return true;
+#else
+    Q_UNUSED(src);
+    Q_UNUSED(ba);
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************************************
+ DkParallelEncoder.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QByteArray>
+#include <QImage>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Encodes large PNG and TIFF files using all threads.
+ * PNGs are filtered and deflated in independent chunks, that are
+ * joined to a single zlib stream (as pigz does). TIFFs are written with
+ * Deflate compressed strips which are compressed concurrently.
+ * Metadata is not written - it is injected later (see DkBasicLoader::saveToBuffer).
+ **/
+class DllCoreExport DkParallelEncoder
+{
+public:
+    enum {
+        min_pixels = 1 << 24, // smaller images are encoded fast enough by Qt
+        chunk_size = 1 << 20, // uncompressed bytes per chunk (or strip)
+    };
+
+    static bool canEncode(const QImage &img, const QString &suffix, int compression);
+    static bool encode(const QImage &img, const QString &suffix, QByteArray &ba, int compression);
+
+protected:
+    static QImage toPacked(const QImage &img, int &channels, int &bitDepth);
+    static void packRow(const QImage &img, int row, int channels, int bitDepth, bool bigEndian, uchar *dst);
+
+    static bool encodePng(const QImage &img, QByteArray &ba, int level);
+    static bool encodeTiff(const QImage &img, QByteArray &ba);
+};
+
+}
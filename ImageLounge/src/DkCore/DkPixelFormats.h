@@ -0,0 +1,165 @@
+/*******************************************************************************************************
+ DkPixelFormats.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QImage>
+#include <QtGlobal>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+/**
+ * The memory layout of a pixel.
+ * All indexes are channel offsets within one pixel - they are compile time
+ * constants, so pixel kernels that are instantiated per layout have no
+ * format branches in their inner loops (and get vectorized by the compiler).
+ **/
+template <typename T, int numChannels, int r, int g, int b, int a, bool premul = false>
+struct DkPixelLayout {
+    typedef T Channel;
+
+    enum {
+        channels = numChannels,
+        red = r,
+        green = g,
+        blue = b,
+        alpha = a, // -1 if the alpha channel is not used
+        premultiplied = premul,
+        maxValue = (1 << (8 * sizeof(T))) - 1,
+    };
+};
+
+typedef DkPixelLayout<uchar, 1, 0, 0, 0, -1> DkGray8;
+typedef DkPixelLayout<quint16, 1, 0, 0, 0, -1> DkGray16;
+typedef DkPixelLayout<uchar, 3, 0, 1, 2, -1> DkRgb888;
+typedef DkPixelLayout<uchar, 4, 0, 1, 2, -1> DkRgbx8888;
+typedef DkPixelLayout<uchar, 4, 0, 1, 2, 3> DkRgba8888;
+typedef DkPixelLayout<uchar, 4, 0, 1, 2, 3, true> DkRgba8888Premultiplied;
+typedef DkPixelLayout<quint16, 4, 0, 1, 2, -1> DkRgbx64;
+typedef DkPixelLayout<quint16, 4, 0, 1, 2, 3> DkRgba64;
+typedef DkPixelLayout<quint16, 4, 0, 1, 2, 3, true> DkRgba64Premultiplied;
+
+// QRgb formats are 32 bit words - their byte order depends on the platform
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+typedef DkPixelLayout<uchar, 4, 2, 1, 0, -1> DkRgb32;
+typedef DkPixelLayout<uchar, 4, 2, 1, 0, 3> DkArgb32;
+typedef DkPixelLayout<uchar, 4, 2, 1, 0, 3, true> DkArgb32Premultiplied;
+#else
+typedef DkPixelLayout<uchar, 4, 1, 2, 3, -1> DkRgb32;
+typedef DkPixelLayout<uchar, 4, 1, 2, 3, 0> DkArgb32;
+typedef DkPixelLayout<uchar, 4, 1, 2, 3, 0, true> DkArgb32Premultiplied;
+#endif
+
+/**
+ * Dispatches pixel kernels to the layout of a QImage::Format.
+ * A kernel is a functor with a member template run<Layout>() - it is
+ * written once and instantiated for every layout:
+ *
+ *     struct MyKernel {
+ *         template <typename L> void run() { ... }
+ *     };
+ *
+ *     MyKernel k;
+ *     if (!DkPixelFormat::dispatch(img.format(), k))
+ *         ... // no layout (e.g. indexed or 16 bit RGB images)
+ **/
+class DkPixelFormat
+{
+public:
+    /**
+     * Calls kernel.run<Layout>() with the layout of format.
+     * @param format the image format
+     * @param kernel the kernel
+     * @return bool false if there is no layout for format (the kernel is not called)
+     **/
+    template <typename Kernel>
+    static bool dispatch(QImage::Format format, Kernel &kernel)
+    {
+        switch (format) {
+        case QImage::Format_Grayscale8:
+            kernel.template run<DkGray8>();
+            return true;
+        case QImage::Format_Grayscale16:
+            kernel.template run<DkGray16>();
+            return true;
+        case QImage::Format_RGB888:
+            kernel.template run<DkRgb888>();
+            return true;
+        case QImage::Format_RGB32:
+            kernel.template run<DkRgb32>();
+            return true;
+        case QImage::Format_ARGB32:
+            kernel.template run<DkArgb32>();
+            return true;
+        case QImage::Format_ARGB32_Premultiplied:
+            kernel.template run<DkArgb32Premultiplied>();
+            return true;
+        case QImage::Format_RGBX8888:
+            kernel.template run<DkRgbx8888>();
+            return true;
+        case QImage::Format_RGBA8888:
+            kernel.template run<DkRgba8888>();
+            return true;
+        case QImage::Format_RGBA8888_Premultiplied:
+            kernel.template run<DkRgba8888Premultiplied>();
+            return true;
+        case QImage::Format_RGBX64:
+            kernel.template run<DkRgbx64>();
+            return true;
+        case QImage::Format_RGBA64:
+            kernel.template run<DkRgba64>();
+            return true;
+        case QImage::Format_RGBA64_Premultiplied:
+            kernel.template run<DkRgba64Premultiplied>();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * True if pixel kernels can process format directly.
+     **/
+    static bool hasLayout(QImage::Format format)
+    {
+        Probe p;
+        return dispatch(format, p);
+    }
+
+private:
+    struct Probe {
+        template <typename L>
+        void run()
+        {
+        }
+    };
+};
+
+}
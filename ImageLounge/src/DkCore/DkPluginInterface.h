@@ -170,6 +170,91 @@ public:
     virtual void saveSettings(QSettings &) const {}; // dummy
 };
 
+/**
+ * The state of one batch worker (e.g. a model that cannot be shared between threads).
+ * Plugins derive from it and create their states in DkParallelBatchPluginInterface::createWorkerState().
+ **/
+class DkBatchWorkerState
+{
+public:
+    virtual ~DkBatchWorkerState()
+    {
+    }
+};
+
+/**
+ * Optional extension of the DkBatchPluginInterface for plugins that control how they are run in parallel.
+ * Implement it in addition to the DkBatchPluginInterface and add both to Q_INTERFACES.
+ * Batch processing then calls these run functions instead of DkBatchPluginInterface::runPlugin.
+ **/
+class DkParallelBatchPluginInterface
+{
+public:
+    enum Concurrency {
+        concurrency_thread_safe = 0, // runPlugin is called from all workers at once
+        concurrency_per_thread, // runPlugin is called from all workers at once - each with its own state
+        concurrency_single_thread, // calls to runPlugin are serialized
+
+        concurrency_end
+    };
+
+    virtual ~DkParallelBatchPluginInterface()
+    {
+    }
+
+    virtual int concurrency() const = 0;
+
+    /// <summary>
+    /// Creates the state of one worker (concurrency_per_thread only).
+    /// It is called for every worker after preLoadPlugin() - before any image is processed.
+    /// </summary>
+    /// <returns>The worker's state or NULL if the plugin does not need one.</returns>
+    virtual QSharedPointer<DkBatchWorkerState> createWorkerState() const
+    {
+        return QSharedPointer<DkBatchWorkerState>();
+    };
+
+    /// <summary>
+    /// The maximal number of images that are passed to the batched runPlugin.
+    /// Images of parallel workers are collected until the batch is full (or a short timeout expires).
+    /// </summary>
+    /// <returns>1 if the plugin processes images one by one.</returns>
+    virtual int maxBatchSize() const
+    {
+        return 1;
+    };
+
+    /// <summary>
+    /// Processes one image.
+    /// </summary>
+    /// <param name="state">The worker's state (NULL if the plugin does not create states).</param>
+    virtual QSharedPointer<DkImageContainer> runPlugin(const QString &runID,
+                                                       QSharedPointer<DkImageContainer> imgC,
+                                                       const DkSaveInfo &saveInfo,
+                                                       QSharedPointer<DkBatchInfo> &batchInfo,
+                                                       DkBatchWorkerState *state) const = 0;
+
+    /// <summary>
+    /// Processes up to maxBatchSize() images at once (e.g. vectorized or GPU inference).
+    /// The default implementation processes them one by one.
+    /// </summary>
+    /// <returns>One result per image - in the order of imgCs.</returns>
+    virtual QVector<QSharedPointer<DkImageContainer>> runPlugin(const QString &runID,
+                                                                const QVector<QSharedPointer<DkImageContainer>> &imgCs,
+                                                                const QVector<DkSaveInfo> &saveInfos,
+                                                                QVector<QSharedPointer<DkBatchInfo>> &batchInfos,
+                                                                DkBatchWorkerState *state) const
+    {
+        QVector<QSharedPointer<DkImageContainer>> results;
+        batchInfos.resize(imgCs.size());
+
+        for (int idx = 0; idx < imgCs.size(); idx++)
+            results << runPlugin(runID, imgCs[idx], saveInfos[idx], batchInfos[idx], state);
+
+        return results;
+    };
+};
+
 class DkViewPortInterface : public DkPluginInterface
 {
 public:
@@ -256,4 +341,5 @@ protected:
 // Change this version number if DkPluginInterface is changed!
 Q_DECLARE_INTERFACE(nmc::DkPluginInterface, "com.nomacs.ImageLounge.DkPluginInterface/3.6")
 Q_DECLARE_INTERFACE(nmc::DkBatchPluginInterface, "com.nomacs.ImageLounge.DkBatchPluginInterface/3.6")
+Q_DECLARE_INTERFACE(nmc::DkParallelBatchPluginInterface, "com.nomacs.ImageLounge.DkParallelBatchPluginInterface/1.0")
 Q_DECLARE_INTERFACE(nmc::DkViewPortInterface, "com.nomacs.ImageLounge.DkViewPortInterface/3.8")
@@ -38,6 +38,7 @@
 #include <QDebug>
 #include <QDir>
 #include <QHeaderView>
+#include <QJsonDocument>
 #include <QJsonValue>
 #include <QLibraryInfo>
 #include <QLineEdit>
@@ -57,6 +58,7 @@
 #include <QSlider>
 #include <QSortFilterProxyModel>
 #include <QSpinBox>
+#include <QStandardPaths>
 #include <QTabWidget>
 #include <QTableView>
 #include <QTextEdit>
@@ -170,11 +172,19 @@ QVector<DkLibrary> DkLibrary::loadDependencies() const
 }
 
 // DkPluginContainer --------------------------------------------------------------------
-DkPluginContainer::DkPluginContainer(const QString &pluginPath)
+DkPluginContainer::DkPluginContainer(const QString &pluginPath, const QJsonObject &indexEntry)
 {
     mPluginPath = pluginPath;
     mLoader = QSharedPointer<QPluginLoader>(new QPluginLoader(mPluginPath));
-    loadJson();
+
+    if (!indexEntry.isEmpty()) {
+        // the plugin index saves us from parsing the library - it is loaded once an action is triggered
+        mType = (PluginType)indexEntry.value("type").toInt(type_unknown);
+        mActionInfo = indexEntry.value("actions").toArray();
+        loadJson(indexEntry.value("metaData").toObject());
+        createMenu();
+    } else
+        loadJson(mLoader->metaData());
 }
 
 DkPluginContainer::~DkPluginContainer()
@@ -216,6 +226,10 @@ bool DkPluginContainer::isLoaded() const
 
 bool DkPluginContainer::load()
 {
+    // plugins from the index are loaded on demand, so we might be called several times
+    if (mInitialized)
+        return true;
+
     DkTimer dt;
 
     if (!isValid()) {
@@ -260,9 +274,20 @@ bool DkPluginContainer::load()
     if (mType != type_unknown) {
         // init actions
         plugin()->createActions(DkUtils::getMainWindow());
+
+        // replace the placeholder menu that was created from the plugin index
+        if (mPluginMenu) {
+            mPluginMenu->deleteLater();
+            mPluginMenu = 0;
+        }
+
         createMenu();
+        updateActionInfo();
     }
 
+    mInitialized = true;
+    DkPluginManager::instance().updateIndex(*this);
+
     qInfo() << mPluginPath << "loaded in" << dt;
     return true;
 }
@@ -280,20 +305,51 @@ void DkPluginContainer::createMenu()
     DkPluginInterface *p = plugin();
 
     // empty menu if we do not have any actions
-    if (!p || p->pluginActions().empty())
+    if (p ? p->pluginActions().empty() : mActionInfo.isEmpty())
         return;
 
     mPluginMenu = new QMenu(pluginName(), DkUtils::getMainWindow());
 
-    for (auto action : p->pluginActions()) {
-        mPluginMenu->addAction(action);
-        connect(action, SIGNAL(triggered()), this, SLOT(run()), Qt::UniqueConnection);
+    if (p) {
+        for (auto action : p->pluginActions()) {
+            mPluginMenu->addAction(action);
+            connect(action, SIGNAL(triggered()), this, SLOT(run()), Qt::UniqueConnection);
+        }
+    } else {
+        // not loaded yet: add placeholders that carry the run ids of the plugin's actions
+        for (const QJsonValue &v : mActionInfo) {
+            QJsonObject ai = v.toObject();
+
+            QAction *action = new QAction(ai.value("text").toString(), mPluginMenu);
+            action->setData(ai.value("runId").toString());
+            action->setStatusTip(ai.value("statusTip").toString());
+            mPluginMenu->addAction(action);
+            connect(action, SIGNAL(triggered()), this, SLOT(run()));
+        }
     }
 }
 
-void DkPluginContainer::loadJson()
+void DkPluginContainer::updateActionInfo()
 {
-    QJsonObject metaData = mLoader->metaData();
+    DkPluginInterface *p = plugin();
+
+    if (!p)
+        return;
+
+    mActionInfo = QJsonArray();
+
+    for (const QAction *a : p->pluginActions()) {
+        QJsonObject ai;
+        ai.insert("text", a->text());
+        ai.insert("runId", a->data().toString());
+        ai.insert("statusTip", a->statusTip());
+        mActionInfo.append(ai);
+    }
+}
+
+void DkPluginContainer::loadJson(const QJsonObject &metaData)
+{
+    mMetaData = metaData;
     QStringList keys = metaData.keys();
 
     for (const QString &key : keys) {
@@ -361,6 +417,9 @@ void DkPluginContainer::loadMetaData(const QJsonValue &val)
 
 void DkPluginContainer::run()
 {
+    if (!load())
+        return;
+
     DkPluginInterface *p = plugin();
 
     if (p && p->interfaceType() == DkPluginInterface::interface_viewport) {
@@ -397,6 +456,44 @@ bool DkPluginContainer::isValid() const
     return mIsValid;
 }
 
+DkPluginContainer::PluginType DkPluginContainer::type() const
+{
+    return mType;
+}
+
+QJsonObject DkPluginContainer::indexEntry() const
+{
+    QFileInfo fi(mPluginPath);
+
+    QJsonObject entry;
+    entry.insert("modified", fi.lastModified().toMSecsSinceEpoch());
+    entry.insert("size", fi.size());
+    entry.insert("language", DkSettingsManager::param().global().language);
+    entry.insert("type", mType);
+    entry.insert("metaData", mMetaData);
+    entry.insert("actions", mActionInfo);
+
+    return entry;
+}
+
+/**
+ * Returns true if the cached index entry still describes the plugin library.
+ * @param entry the entry of the plugin index
+ * @param pluginPath the library's absolute path
+ * @return bool false if the library changed since the entry was written
+ **/
+bool DkPluginContainer::isIndexEntryCurrent(const QJsonObject &entry, const QString &pluginPath)
+{
+    if (entry.isEmpty())
+        return false;
+
+    QFileInfo fi(pluginPath);
+
+    // action names are translated - so we need to reload if the language changed
+    return entry.value("modified").toVariant().toLongLong() == fi.lastModified().toMSecsSinceEpoch()
+        && entry.value("size").toVariant().toLongLong() == fi.size() && entry.value("language").toString() == DkSettingsManager::param().global().language;
+}
+
 QString DkPluginContainer::pluginPath() const
 {
     return mPluginPath;
@@ -485,7 +582,8 @@ QSharedPointer<QPluginLoader> DkPluginContainer::loader() const
 DkPluginInterface *DkPluginContainer::plugin() const
 {
     // is everything fine here??
-    if (!mLoader)
+    // NOTE: instance() would implicitly load the library - call load() instead
+    if (!mLoader || !mLoader->isLoaded())
         return 0;
 
     DkPluginInterface *pi = qobject_cast<DkPluginInterface *>(mLoader->instance());
@@ -501,16 +599,24 @@ DkPluginInterface *DkPluginContainer::plugin() const
 DkBatchPluginInterface *DkPluginContainer::batchPlugin() const
 {
     // is everything fine here??
-    if (!mLoader)
+    if (!mLoader || !mLoader->isLoaded())
         return 0;
 
     return qobject_cast<DkBatchPluginInterface *>(mLoader->instance());
 }
 
+DkParallelBatchPluginInterface *DkPluginContainer::parallelBatchPlugin() const
+{
+    if (!mLoader || !mLoader->isLoaded())
+        return 0;
+
+    return qobject_cast<DkParallelBatchPluginInterface *>(mLoader->instance());
+}
+
 DkViewPortInterface *DkPluginContainer::pluginViewPort() const
 {
     // is everything fine here??
-    if (!mLoader)
+    if (!mLoader || !mLoader->isLoaded())
         return 0;
 
     return qobject_cast<DkViewPortInterface *>(mLoader->instance());
@@ -518,13 +624,11 @@ DkViewPortInterface *DkPluginContainer::pluginViewPort() const
 
 QString DkPluginContainer::actionNameToRunId(const QString &actionName) const
 {
-    if (!plugin())
-        return QString();
-
-    QList<QAction *> actions = plugin()->pluginActions();
-    for (const QAction *a : actions) {
-        if (a->text() == actionName)
-            return a->data().toString();
+    // the action info is either cached or updated when the plugin is loaded
+    for (const QJsonValue &v : mActionInfo) {
+        QJsonObject ai = v.toObject();
+        if (ai.value("text").toString() == actionName)
+            return ai.value("runId").toString();
     }
 
     return QString();
@@ -1047,7 +1151,7 @@ void DkDescriptionImage::updateImage()
         const QVector<QSharedPointer<DkPluginContainer>> &plugins = DkPluginManager::instance().getPlugins();
         QSharedPointer<DkPluginContainer> plugin = plugins.at(sourceIndex.row());
 
-        if (plugin && plugin->plugin())
+        if (plugin && plugin->load() && plugin->plugin())
             img = plugin->plugin()->image();
         if (!img.isNull())
             setPixmap(QPixmap::fromImage(img));
@@ -1146,6 +1250,10 @@ void DkPluginManager::loadPlugins()
 
     DkTimer dt;
 
+    // plugins that did not change since the last run are created from the index without loading them
+    loadIndex();
+    mLoading = true;
+
     QStringList loadedPluginFileNames = QStringList();
     QStringList libPaths = QCoreApplication::libraryPaths();
     libPaths.append(QCoreApplication::applicationDirPath() + "/plugins");
@@ -1183,6 +1291,15 @@ void DkPluginManager::loadPlugins()
         }
     }
 
+    mLoading = false;
+
+    // forget plugins that were removed
+    for (const QString &path : mIndex.keys()) {
+        if (!QFileInfo::exists(path))
+            mIndex.remove(path);
+    }
+    saveIndex();
+
     std::sort(mPlugins.begin(), mPlugins.end()); // , &DkPluginContainer::operator<);
     qInfo() << mPlugins.size() << "plugins loaded in" << dt;
 
@@ -1199,14 +1316,80 @@ bool DkPluginManager::singlePluginLoad(const QString &filePath)
     if (isBlackListed(filePath))
         return false;
 
+    QJsonObject entry = mIndex.value(filePath).toObject();
+
+    if (DkPluginContainer::isIndexEntryCurrent(entry, filePath)) {
+        QSharedPointer<DkPluginContainer> plugin = QSharedPointer<DkPluginContainer>(new DkPluginContainer(filePath, entry));
+
+        // the index remembers libraries that are no nomacs plugins too
+        if (!plugin->isValid() || plugin->type() == DkPluginContainer::type_unknown)
+            return false;
+
+        mPlugins.append(plugin);
+        return true;
+    }
+
     DkTimer dt;
     QSharedPointer<DkPluginContainer> plugin = QSharedPointer<DkPluginContainer>(new DkPluginContainer(filePath));
     if (plugin->load())
         mPlugins.append(plugin);
+    else if (!plugin->isValid())
+        updateIndex(*plugin); // don't parse it again - libraries that failed to load are retried
 
     return plugin->isLoaded();
 }
 
+void DkPluginManager::updateIndex(const DkPluginContainer &plugin)
+{
+    QJsonObject entry = plugin.indexEntry();
+
+    if (mIndex.value(plugin.pluginPath()).toObject() == entry)
+        return;
+
+    mIndex.insert(plugin.pluginPath(), entry);
+
+    // plugins that are loaded on demand update the index right away
+    if (!mLoading)
+        saveIndex();
+}
+
+void DkPluginManager::loadIndex()
+{
+    QFile file(indexPath());
+
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+
+    // the plugin interface might have changed with another nomacs version
+    if (index.value("version").toString() == QApplication::applicationVersion())
+        mIndex = index.value("plugins").toObject();
+}
+
+void DkPluginManager::saveIndex() const
+{
+    QFileInfo fi(indexPath());
+    QDir().mkpath(fi.absolutePath());
+
+    QFile file(fi.absoluteFilePath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[Plugins] could not write the plugin index to" << fi.absoluteFilePath();
+        return;
+    }
+
+    QJsonObject index;
+    index.insert("version", QApplication::applicationVersion());
+    index.insert("plugins", mIndex);
+
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+}
+
+QString DkPluginManager::indexPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/nomacs/plugin-index.json";
+}
+
 QSharedPointer<DkPluginContainer> DkPluginManager::getPluginByName(const QString &pluginName) const
 {
     for (auto p : mPlugins) {
@@ -1232,9 +1415,7 @@ QVector<QSharedPointer<DkPluginContainer>> DkPluginManager::getBasicPlugins() co
     QVector<QSharedPointer<DkPluginContainer>> plugins;
 
     for (auto plugin : mPlugins) {
-        DkPluginInterface *p = plugin->plugin();
-
-        if (p && p->interfaceType() == DkPluginInterface::interface_basic) {
+        if (plugin->type() == DkPluginContainer::type_simple) {
             plugins.append(plugin);
         }
     }
@@ -1247,9 +1428,7 @@ QVector<QSharedPointer<DkPluginContainer>> DkPluginManager::getBatchPlugins() co
     QVector<QSharedPointer<DkPluginContainer>> plugins;
 
     for (auto plugin : mPlugins) {
-        DkPluginInterface *p = plugin->plugin();
-
-        if (p && (p->interfaceType() == DkPluginInterface::interface_basic || p->interfaceType() == DkPluginInterface::interface_batch)) {
+        if (plugin->type() == DkPluginContainer::type_simple || plugin->type() == DkPluginContainer::type_batch) {
             plugins.append(plugin);
         }
     }
@@ -1320,7 +1499,7 @@ void DkPluginManager::createPluginsPath()
     if (!pluginsDir.exists())
         pluginsDir.mkpath(pluginsDir.absolutePath());
 
-    nmc::DkSettingsManager::param().global().pluginsDir = pluginsDir.absolutePath();
+    nmc::DkSettingsManager::edit().global().pluginsDir = pluginsDir.absolutePath();
     qInfo() << "plugins dir set to: " << nmc::DkSettingsManager::param().global().pluginsDir;
 
     QCoreApplication::addLibraryPath(nmc::DkSettingsManager::param().global().pluginsDir);
@@ -1441,13 +1620,11 @@ void DkPluginActionManager::addPluginsToMenu()
     QStringList pluginMenu = QStringList();
 
     for (auto plugin : loadedPlugins) {
-        DkPluginInterface *pi = plugin->plugin();
-
-        if (pi && plugin->pluginMenu()) {
-            QList<QAction *> actions = pi->createActions(DkUtils::getMainWindow());
+        // NOTE: plugins might not be loaded yet - their menus are built from the plugin index
+        if (plugin->pluginMenu()) {
             mPluginSubMenus.append(plugin->pluginMenu());
             mMenu->addMenu(plugin->pluginMenu());
-        } else if (pi) {
+        } else if (plugin->type() != DkPluginContainer::type_unknown) {
             QAction *a = new QAction(plugin->pluginName(), this);
             a->setData(plugin->id());
             mPluginActions.append(a);
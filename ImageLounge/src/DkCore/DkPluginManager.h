@@ -31,6 +31,8 @@
 #include <QAbstractTableModel>
 #include <QDate>
 #include <QDialog>
+#include <QJsonArray>
+#include <QJsonObject>
 #include <QLabel>
 #include <QLibrary>
 #include <QMap>
@@ -95,7 +97,7 @@ class DllCoreExport DkPluginContainer : public QObject
     Q_OBJECT
 
 public:
-    DkPluginContainer(const QString &pluginPath);
+    DkPluginContainer(const QString &pluginPath, const QJsonObject &indexEntry = QJsonObject());
     ~DkPluginContainer();
 
     enum PluginType {
@@ -117,6 +119,10 @@ public:
     bool load();
     bool uninstall();
 
+    PluginType type() const;
+    QJsonObject indexEntry() const;
+    static bool isIndexEntryCurrent(const QJsonObject &entry, const QString &pluginPath);
+
     // attributes
     QString pluginPath() const;
     QString pluginName() const;
@@ -136,6 +142,7 @@ public:
     QSharedPointer<QPluginLoader> loader() const;
     DkPluginInterface *plugin() const;
     DkBatchPluginInterface *batchPlugin() const;
+    DkParallelBatchPluginInterface *parallelBatchPlugin() const;
     DkViewPortInterface *pluginViewPort() const;
     QString actionNameToRunId(const QString &actionName) const;
 
@@ -161,6 +168,7 @@ protected:
 
     bool mActive = false;
     bool mIsValid = false;
+    bool mInitialized = false;
 
     PluginType mType = type_unknown;
 
@@ -168,8 +176,13 @@ protected:
 
     QSharedPointer<QPluginLoader> mLoader = QSharedPointer<QPluginLoader>();
 
+    // cached in the plugin index so that menus can be built without loading the library
+    QJsonObject mMetaData;
+    QJsonArray mActionInfo;
+
     void createMenu();
-    void loadJson();
+    void updateActionInfo();
+    void loadJson(const QJsonObject &metaData);
     void loadMetaData(const QJsonValue &val);
 };
 
@@ -233,6 +246,7 @@ public:
     void loadPlugins();
 
     bool singlePluginLoad(const QString &filePath);
+    void updateIndex(const DkPluginContainer &plugin);
 
     QVector<QSharedPointer<DkPluginContainer>> getBasicPlugins() const;
     QVector<QSharedPointer<DkPluginContainer>> getBatchPlugins() const;
@@ -249,7 +263,13 @@ public:
 private:
     DkPluginManager();
 
+    void loadIndex();
+    void saveIndex() const;
+    static QString indexPath();
+
     QVector<QSharedPointer<DkPluginContainer>> mPlugins;
+    QJsonObject mIndex;
+    bool mLoading = false;
 };
 
 // Plug-in manager dialog for enabling/disabling plug-ins and downloading new ones
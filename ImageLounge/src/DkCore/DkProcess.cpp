@@ -26,11 +26,14 @@
  *******************************************************************************************************/
 
 #include "DkProcess.h"
+#include "DkBasicLoader.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
 #include "DkManipulators.h"
 #include "DkMath.h"
 #include "DkPluginManager.h"
+#include "DkScheduler.h"
+#include "DkScratch.h"
 #include "DkSettings.h"
 #include "DkTimer.h"
 #include "DkUtils.h"
@@ -38,13 +41,30 @@
 #include "DkMetaData.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDeadlineTimer>
 #include <QFuture>
 #include <QFutureWatcher>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QTemporaryFile>
 #include <QWidget>
-#include <QtConcurrentMap>
 #pragma warning(pop) // no warnings from includes - end
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <io.h> // _commit
+#else
+#include <unistd.h> // fsync
+#endif
 
 namespace nmc
 {
@@ -238,6 +258,16 @@ bool DkBatchTransform::isActive() const
     return mAngle != 0 || mCropFromMetadata || cropFromRectangle() || isResizeActive();
 }
 
+/**
+ * True if the transform only rotates by quarter turns (no resizing & cropping).
+ * Such transforms can be applied without touching the pixels (see DkBatchProcess::rotateFile()).
+ * @return bool true if the transform is a pure quarter turn
+ **/
+bool DkBatchTransform::isQuarterTurnOnly() const
+{
+    return mAngle != 0 && mAngle % 90 == 0 && !mCropFromMetadata && !cropFromRectangle() && !isResizeActive();
+}
+
 int DkBatchTransform::angle() const
 {
     return mAngle;
@@ -290,40 +320,70 @@ bool DkBatchTransform::compute(QSharedPointer<DkImageContainer> container, QStri
         return true;
     }
 
+    // all steps are combined to a single transformation so that the image is resampled once
+    QImage img = container->image();
     DkRotatingRect rect = container->cropRect();
-    if (mCropFromMetadata) {
-        if (!rect.isEmpty())
-            container->cropImage(rect, QColor(), false);
-    }
 
-    QImage img = container->image();
-    QImage tmpImg;
+    // crop from metadata: source -> cropped image
+    QTransform tCrop;
+    QSize cSize = img.size();
+
+    if (mCropFromMetadata && !rect.isEmpty()) {
+        QPointF cs;
+        rect.getTransform(tCrop, cs);
+
+        // see DkImage::cropToImage
+        if (cs.x() >= 0.5 && cs.y() >= 0.5) {
+            cSize = QSize(qRound(cs.x()), qRound(cs.y()));
+            container->getMetaData()->clearXMPRect();
+        } else
+            tCrop.reset();
+    }
 
     // resize
+    QSize sSize = cSize;
+
     if (isResizeActive()) {
         QSize size;
         float sf = 1.0f;
 
-        if (prepareProperties(img.size(), size, sf, logStrings))
-            tmpImg = DkImage::resizeImage(img, size, sf, mResizeIplMethod, mResizeCorrectGamma);
-        else
-            tmpImg = img;
-    } else
-        tmpImg = img;
+        // see DkImage::resizeImage
+        if (prepareProperties(cSize, size, sf, logStrings))
+            sSize = sf != 1.0f ? QSize(qRound(cSize.width() * sf), qRound(cSize.height() * sf)) : size;
+    }
+
+    if (sSize.isEmpty()) {
+        logStrings.append(QObject::tr("%1 error, could not transform image.").arg(name()));
+        return false;
+    }
+
+    QTransform tScale = QTransform::fromScale((double)sSize.width() / cSize.width(), (double)sSize.height() / cSize.height());
+
+    // rotate around the center - the bounding box is the new image (like QImage::transformed)
+    QTransform tRotate;
+    QSize rSize = sSize;
 
-    // rotate
     if (mAngle != 0) {
         QTransform rotationMatrix;
         rotationMatrix.rotate((double)mAngle);
-        tmpImg = tmpImg.transformed(rotationMatrix);
+
+        tRotate = QImage::trueMatrix(rotationMatrix, sSize.width(), sSize.height());
+        QRectF br = tRotate.mapRect(QRectF(QPointF(), QSizeF(sSize)));
+        rSize = QSize(qRound(br.width()), qRound(br.height()));
     }
 
     // crop from rectangle
+    QTransform tOffset;
+    QSize dSize = rSize;
+
     if (cropFromRectangle()) {
-        QRect r = mCropRect.intersected(container->image().rect());
-        tmpImg = tmpImg.copy(r);
+        QRect r = mCropRect.intersected(QRect(QPoint(), cSize));
+        tOffset = QTransform::fromTranslate(-r.x(), -r.y());
+        dSize = r.size();
     }
 
+    QImage tmpImg = DkImage::transformImage(img, tCrop * tScale * tRotate * tOffset, dSize, mResizeIplMethod, mResizeCorrectGamma);
+
     // logs
     if (!tmpImg.isNull()) {
         container->setImage(tmpImg, QObject::tr("transformed"));
@@ -417,16 +477,44 @@ bool DkManipulatorBatch::compute(QSharedPointer<DkImageContainer> container, QSt
     }
 
     if (container && container->hasImage()) {
-        for (const QSharedPointer<DkBaseManipulator> &mpl : mManager.manipulators()) {
-            if (mpl->isSelected()) {
-                QImage img = mpl->apply(container->image());
-                if (!img.isNull()) {
-                    container->setImage(img, mpl->name());
+        QVector<QSharedPointer<DkBaseManipulator>> pointOps;
+
+        auto apply = [&](const QVector<QSharedPointer<DkBaseManipulator>> &mpls) {
+            // consecutive point operations are fused to a single pass
+            QImage img = mpls.size() > 1 ? DkManipulatorManager::applyPointOperations(container->image(), mpls) : mpls.first()->apply(container->image());
+            QStringList names;
+
+            for (const QSharedPointer<DkBaseManipulator> &mpl : mpls) {
+                names << mpl->name();
+
+                if (!img.isNull())
                     logStrings.append(QObject::tr("%1 %2 applied.").arg(name()).arg(mpl->name()));
-                } else
+                else
                     logStrings.append(QObject::tr("%1 Cannot apply %2.").arg(name()).arg(mpl->name()));
             }
+
+            if (!img.isNull())
+                container->setImage(img, names.join(", "));
+        };
+
+        for (const QSharedPointer<DkBaseManipulator> &mpl : mManager.manipulators()) {
+            if (!mpl->isSelected())
+                continue;
+
+            if (mpl->pointOperation().isValid()) {
+                pointOps << mpl;
+                continue;
+            }
+
+            if (!pointOps.isEmpty())
+                apply(pointOps);
+            pointOps.clear();
+
+            apply({mpl});
         }
+
+        if (!pointOps.isEmpty())
+            apply(pointOps);
     }
 
     if (!container || !container->hasImage()) {
@@ -453,6 +541,167 @@ DkManipulatorManager DkManipulatorBatch::manager() const
 }
 
 #ifdef WITH_PLUGINS
+// DkPluginRunner --------------------------------------------------------------------
+/**
+ * Runs a DkParallelBatchPluginInterface the way it declared:
+ * serializes single threaded plugins, hands a worker state to each
+ * concurrent call and collects images of parallel workers to batches.
+ **/
+class DkPluginRunner
+{
+public:
+    DkPluginRunner(DkParallelBatchPluginInterface *plugin);
+
+    QSharedPointer<DkImageContainer> run(const QString &runID,
+                                         QSharedPointer<DkImageContainer> container,
+                                         const DkSaveInfo &saveInfo,
+                                         QSharedPointer<DkBatchInfo> &info);
+
+private:
+    struct Job {
+        QSharedPointer<DkImageContainer> container;
+        DkSaveInfo saveInfo;
+        QSharedPointer<DkImageContainer> result;
+        QSharedPointer<DkBatchInfo> info;
+        bool done = false;
+    };
+
+    void process(const QString &runID, const QVector<Job *> &jobs);
+    QSharedPointer<DkBatchWorkerState> acquireState();
+    void releaseState(QSharedPointer<DkBatchWorkerState> state);
+
+    DkParallelBatchPluginInterface *mPlugin = 0;
+    int mConcurrency = DkParallelBatchPluginInterface::concurrency_single_thread;
+    int mMaxBatchSize = 1;
+    int mBatchTimeout = 50; // ms a worker waits for others to fill its batch
+
+    QMutex mSerialMutex;
+
+    QMutex mStateMutex;
+    QVector<QSharedPointer<DkBatchWorkerState>> mFreeStates;
+
+    QMutex mBatchMutex;
+    QWaitCondition mBatchCondition;
+    QVector<Job *> mPending;
+};
+
+DkPluginRunner::DkPluginRunner(DkParallelBatchPluginInterface *plugin)
+{
+    mPlugin = plugin;
+    mConcurrency = plugin->concurrency();
+    mMaxBatchSize = qMax(plugin->maxBatchSize(), 1);
+
+    // create the states for all workers now - so that (expensive) setups are not timed per image
+    if (mConcurrency == DkParallelBatchPluginInterface::concurrency_per_thread) {
+        for (int idx = 0; idx < QThreadPool::globalInstance()->maxThreadCount(); idx++)
+            mFreeStates << plugin->createWorkerState();
+    }
+}
+
+QSharedPointer<DkImageContainer> DkPluginRunner::run(const QString &runID,
+                                                     QSharedPointer<DkImageContainer> container,
+                                                     const DkSaveInfo &saveInfo,
+                                                     QSharedPointer<DkBatchInfo> &info)
+{
+    Job job;
+    job.container = container;
+    job.saveInfo = saveInfo;
+
+    if (mMaxBatchSize == 1) {
+        process(runID, QVector<Job *>() << &job);
+        info = job.info;
+        return job.result;
+    }
+
+    QMutexLocker locker(&mBatchMutex);
+    mPending << &job;
+    QDeadlineTimer deadline(mBatchTimeout);
+
+    while (!job.done) {
+        // the worker that fills the batch (or waited long enough) processes it
+        bool pending = mPending.contains(&job);
+
+        if (pending && (mPending.size() >= mMaxBatchSize || deadline.hasExpired())) {
+            QVector<Job *> batch = mPending.mid(0, mMaxBatchSize);
+            mPending.remove(0, batch.size());
+
+            locker.unlock();
+            process(runID, batch);
+            locker.relock();
+
+            for (Job *j : batch)
+                j->done = true;
+
+            mBatchCondition.wakeAll();
+        } else if (pending)
+            mBatchCondition.wait(&mBatchMutex, deadline);
+        else
+            mBatchCondition.wait(&mBatchMutex); // another worker is processing our image
+    }
+
+    info = job.info;
+    return job.result;
+}
+
+void DkPluginRunner::process(const QString &runID, const QVector<Job *> &jobs)
+{
+    QSharedPointer<DkBatchWorkerState> state = acquireState();
+    QMutexLocker locker(mConcurrency == DkParallelBatchPluginInterface::concurrency_single_thread ? &mSerialMutex : nullptr);
+
+    if (jobs.size() == 1) {
+        Job *j = jobs.first();
+        j->result = mPlugin->runPlugin(runID, j->container, j->saveInfo, j->info, state.data());
+    } else {
+        QVector<QSharedPointer<DkImageContainer>> containers;
+        QVector<DkSaveInfo> saveInfos;
+        QVector<QSharedPointer<DkBatchInfo>> infos;
+
+        for (const Job *j : jobs) {
+            containers << j->container;
+            saveInfos << j->saveInfo;
+        }
+
+        QVector<QSharedPointer<DkImageContainer>> results = mPlugin->runPlugin(runID, containers, saveInfos, infos, state.data());
+
+        if (results.size() != jobs.size())
+            qWarning() << "[DkPluginRunner] plugin returned" << results.size() << "results for" << jobs.size() << "images";
+
+        for (int idx = 0; idx < jobs.size(); idx++) {
+            if (idx < results.size())
+                jobs[idx]->result = results[idx];
+            if (idx < infos.size())
+                jobs[idx]->info = infos[idx];
+        }
+    }
+
+    locker.unlock();
+    releaseState(state);
+}
+
+QSharedPointer<DkBatchWorkerState> DkPluginRunner::acquireState()
+{
+    if (mConcurrency != DkParallelBatchPluginInterface::concurrency_per_thread)
+        return QSharedPointer<DkBatchWorkerState>();
+
+    {
+        QMutexLocker locker(&mStateMutex);
+        if (!mFreeStates.empty())
+            return mFreeStates.takeLast();
+    }
+
+    // more workers than expected (e.g. --threads)
+    return mPlugin->createWorkerState();
+}
+
+void DkPluginRunner::releaseState(QSharedPointer<DkBatchWorkerState> state)
+{
+    if (mConcurrency != DkParallelBatchPluginInterface::concurrency_per_thread)
+        return;
+
+    QMutexLocker locker(&mStateMutex);
+    mFreeStates << state;
+}
+
 // DkPluginBatch --------------------------------------------------------------------
 DkPluginBatch::DkPluginBatch()
 {
@@ -558,9 +807,12 @@ bool DkPluginBatch::compute(QSharedPointer<DkImageContainer> container,
                     result = plugin->runPlugin(runID, container);
                 else if (plugin->interfaceType() == DkPluginInterface::interface_batch) {
                     DkBatchPluginInterface *bPlugin = pluginContainer->batchPlugin();
+                    QSharedPointer<DkPluginRunner> runner = mRunners.value(idx);
                     QSharedPointer<DkBatchInfo> info;
 
-                    if (bPlugin)
+                    if (runner)
+                        result = runner->run(runID, container, saveInfo, info);
+                    else if (bPlugin)
                         result = bPlugin->runPlugin(runID, container, saveInfo, info);
                     else
                         logStrings.append(QObject::tr("%1 Cannot cast batch plugin %2.").arg(name()).arg(pluginContainer->pluginName()));
@@ -622,6 +874,8 @@ void DkPluginBatch::loadAllPlugins()
         mPlugins << pluginContainer; // also add the empty ones...
         mRunIDs << runID;
 
+        QSharedPointer<DkPluginRunner> runner;
+
         if (pluginContainer) {
             qDebug() << "loading" << pluginContainer->pluginName() << "id:" << runID;
 
@@ -632,8 +886,16 @@ void DkPluginBatch::loadAllPlugins()
             if (plugin) {
                 plugin->preLoadPlugin();
             }
+
+            // the worker states are created after preLoadPlugin
+            DkParallelBatchPluginInterface *pPlugin = pluginContainer->parallelBatchPlugin();
+
+            if (plugin && pPlugin)
+                runner = QSharedPointer<DkPluginRunner>(new DkPluginRunner(pPlugin));
         } else
             qWarning() << "could not load: " << cPluginString;
+
+        mRunners << runner;
     }
 }
 
@@ -648,12 +910,81 @@ void DkPluginBatch::loadPlugin(const QString &pluginString, QSharedPointer<DkPlu
     } else {
         plugin = DkPluginManager::instance().getPluginByName(ids[0]);
 
-        if (plugin)
+        // plugins are loaded lazily - the batch needs them now
+        if (plugin && plugin->load())
             runID = plugin->actionNameToRunId(ids[1]);
     }
 }
 #endif
 
+// DkBatchTimings --------------------------------------------------------------------
+DkBatchTimings::DkBatchTimings(int numFunctions)
+    : mFunctions(numFunctions, -1)
+{
+    std::fill(mStages, mStages + stage_end, -1);
+}
+
+void DkBatchTimings::add(Stage stage, qint64 ns)
+{
+    mStages[stage] = qMax(mStages[stage], (qint64)0) + ns;
+}
+
+void DkBatchTimings::addFunction(int idx, qint64 ns)
+{
+    if (idx >= 0 && idx < mFunctions.size())
+        mFunctions[idx] = qMax(mFunctions[idx], (qint64)0) + ns;
+}
+
+qint64 DkBatchTimings::stage(Stage stage) const
+{
+    return mStages[stage];
+}
+
+qint64 DkBatchTimings::function(int idx) const
+{
+    return idx >= 0 && idx < mFunctions.size() ? mFunctions[idx] : -1;
+}
+
+QString DkBatchTimings::stageName(Stage stage)
+{
+    switch (stage) {
+    case stage_read:
+        return QObject::tr("Read");
+    case stage_decode:
+        return QObject::tr("Decode");
+    case stage_metadata:
+        return QObject::tr("Metadata");
+    case stage_encode:
+        return QObject::tr("Encode");
+    case stage_write:
+        return QObject::tr("Write");
+    default:
+        return QString();
+    }
+}
+
+// adds the time of its scope to a stage
+class DkStageTimer
+{
+public:
+    DkStageTimer(DkBatchTimings &timings, DkBatchTimings::Stage stage)
+        : mTimings(timings)
+        , mStage(stage)
+    {
+        mTimer.start();
+    }
+
+    ~DkStageTimer()
+    {
+        mTimings.add(mStage, mTimer.nsecsElapsed());
+    }
+
+protected:
+    DkBatchTimings &mTimings;
+    DkBatchTimings::Stage mStage;
+    QElapsedTimer mTimer;
+};
+
 // DkBatchProcess --------------------------------------------------------------------
 DkBatchProcess::DkBatchProcess(const DkSaveInfo &saveInfo)
 {
@@ -663,6 +994,12 @@ DkBatchProcess::DkBatchProcess(const DkSaveInfo &saveInfo)
 void DkBatchProcess::setProcessChain(const QVector<QSharedPointer<DkAbstractBatch>> processes)
 {
     mProcessFunctions = processes;
+    mTimings = DkBatchTimings(processes.size());
+}
+
+DkBatchTimings DkBatchProcess::timings() const
+{
+    return mTimings;
 }
 
 QString DkBatchProcess::inputFile() const
@@ -690,87 +1027,252 @@ bool DkBatchProcess::wasProcessed() const
     return mIsProcessed;
 }
 
+qint64 DkBatchProcess::inputModified() const
+{
+    return mInputModified;
+}
+
+qint64 DkBatchProcess::inputSize() const
+{
+    return mInputSize;
+}
+
+/**
+ * The hash of the input file's content.
+ * @return QByteArray the hash or an empty array if the file was not read to a buffer
+ **/
+QByteArray DkBatchProcess::inputHash() const
+{
+    return mInputHash;
+}
+
+/**
+ * Marks the item as skipped - it is not processed.
+ * @param reason is added to the log
+ **/
+void DkBatchProcess::skip(const QString &reason)
+{
+    mLogStrings.append(reason);
+}
+
 bool DkBatchProcess::compute()
 {
+    if (read()) {
+        develop();
+        write();
+    }
+
+    return mFailure == 0;
+}
+
+/**
+ * First stage: checks the input and reads the file to a buffer.
+ * Renaming and copying files is fully done here.
+ * @return bool true if the item needs to be developed and written.
+ **/
+bool DkBatchProcess::read()
+{
+    DkTraceSpan span("batch", "DkBatchProcess::read", mSaveInfo.inputFilePath());
+    DkStageTimer timer(mTimings, DkBatchTimings::stage_read);
     mIsProcessed = true;
 
     QFileInfo fInfoIn(mSaveInfo.inputFilePath());
     QFileInfo fInfoOut(mSaveInfo.outputFilePath());
 
+    mInputModified = fInfoIn.lastModified().toMSecsSinceEpoch();
+    mInputSize = fInfoIn.size();
+
+    // if no function works on the pixels, we neither decode nor encode
+    bool pixels = needsPixels();
+
     // check errors
     if ((mSaveInfo.mode() & DkSaveInfo::mode_do_not_save_output) == 0 && // do not save is not set
         (fInfoOut.exists() && mSaveInfo.mode() == DkSaveInfo::mode_skip_existing)) {
         mLogStrings.append(QObject::tr("%1 already exists -> skipping (check 'overwrite' if you want to overwrite the file)").arg(mSaveInfo.outputFilePath()));
         mFailure++;
-        return mFailure == 0;
+        return false;
     } else if (!fInfoIn.exists()) {
         mLogStrings.append(QObject::tr("Error: input file does not exist"));
         mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
         mFailure++;
-        return mFailure == 0;
-    } else if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && mProcessFunctions.empty()) {
+        return false;
+    } else if (mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && !pixels) {
         mLogStrings.append(QObject::tr("Skipping: nothing to do here."));
         mFailure++;
-        return mFailure == 0;
+        return false;
     }
 
+    mTimings.bytesRead = mInputSize;
+
     // rename operation?
-    if (mProcessFunctions.empty() && mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && fInfoIn.suffix() == fInfoOut.suffix()) {
+    if (!pixels && mSaveInfo.inputFilePath() == mSaveInfo.outputFilePath() && fInfoIn.suffix() == fInfoOut.suffix()) {
         if (!renameFile())
             mFailure++;
-        return mFailure == 0;
+        return false;
     }
     // copy operation?
-    else if (mProcessFunctions.empty() && fInfoIn.suffix() == fInfoOut.suffix()) {
+    else if (!pixels && fInfoIn.suffix() == fInfoOut.suffix()) {
         if (!copyFile())
             mFailure++;
         else
             deleteOriginalFile();
 
-        return mFailure == 0;
+        return false;
     }
 
-    // do the work
-    process();
+    // lossless rotation? (falls back to decoding if the file has no Exif data)
+    int angle = losslessAngle();
+    if (angle != 0) {
+        bool rotated = false;
 
-    // delete the original file if the user requested it
-    deleteOriginalFile();
+        if (!rotateFile(angle, rotated)) {
+            mFailure++;
+            return false;
+        } else if (rotated) {
+            deleteOriginalFile();
+            return false;
+        }
 
-    return mFailure == 0;
-}
+        mLogStrings.append(QObject::tr("%1 has no Exif data - rotating the pixels").arg(fInfoIn.fileName()));
+    }
 
-QStringList DkBatchProcess::getLog() const
-{
-    return mLogStrings;
+    mLogStrings.append(QObject::tr("processing %1").arg(mSaveInfo.inputFilePath()));
+
+    mImage = QSharedPointer<DkImageContainer>(new DkImageContainer(mSaveInfo.inputFilePath()));
+
+    mImage->setFileBuffer(mImage->loadFileToBuffer(mSaveInfo.inputFilePath()));
+
+    QSharedPointer<QByteArray> ba = mImage->getFileBuffer();
+    if (ba && !ba->isEmpty())
+        mInputHash = QCryptographicHash::hash(*ba, QCryptographicHash::Md5);
+
+    return true;
 }
 
-bool DkBatchProcess::process()
+/**
+ * Second stage: decodes the buffer, runs the process chain and
+ * encodes the result. The decoded image is released afterwards.
+ **/
+void DkBatchProcess::develop()
 {
-    mLogStrings.append(QObject::tr("processing %1").arg(mSaveInfo.inputFilePath()));
+    if (!mImage)
+        return;
 
-    QSharedPointer<DkImageContainer> imgC(new DkImageContainer(mSaveInfo.inputFilePath()));
+    DkTraceSpan span("batch", "DkBatchProcess::develop", mSaveInfo.inputFilePath());
+    QElapsedTimer dt;
+    dt.start();
 
-    if (!imgC->loadImage() || imgC->image().isNull()) {
+    bool loaded = mImage->loadImage() && !mImage->image().isNull();
+    mTimings.add(DkBatchTimings::stage_decode, dt.nsecsElapsed());
+
+    if (!loaded) {
         mLogStrings.append(QObject::tr("Error while loading..."));
         mFailure++;
-        return false;
+        mImage.clear();
+        return;
     }
 
-    for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
+    for (int idx = 0; idx < mProcessFunctions.size(); idx++) {
+        QSharedPointer<DkAbstractBatch> batch = mProcessFunctions[idx];
+
         if (!batch) {
             mLogStrings.append(QObject::tr("Error: cannot process a NULL function."));
             continue;
         }
 
+        dt.restart();
+
         QVector<QSharedPointer<DkBatchInfo>> cInfos;
-        if (!batch->compute(imgC, mSaveInfo, mLogStrings, cInfos)) {
+        if (!batch->compute(mImage, mSaveInfo, mLogStrings, cInfos)) {
             mLogStrings.append(QObject::tr("%1 failed").arg(batch->name()));
             mFailure++;
         }
 
+        mTimings.addFunction(idx, dt.nsecsElapsed());
         mInfos << cInfos;
     }
 
+    if ((mSaveInfo.mode() & DkSaveInfo::mode_do_not_save_output) == 0) {
+        // udpate metadata
+        dt.restart();
+        if (updateMetaData(mImage->getMetaData().data()))
+            mLogStrings.append(QObject::tr("Original filename added to Exif"));
+        mTimings.add(DkBatchTimings::stage_metadata, dt.nsecsElapsed());
+
+        QSharedPointer<DkBasicLoader> loader = mImage->getLoader();
+        QImage img = loader->lastImage();
+        mOutBuffer = QSharedPointer<QByteArray>(new QByteArray());
+
+        // only encode here - the metadata is injected by the writer so that the next image can be developed
+        dt.restart();
+        bool encoded = loader->encodeToBuffer(mSaveInfo.outputFilePath(), img, mOutBuffer, mSaveInfo.compression());
+        mTimings.add(DkBatchTimings::stage_encode, dt.nsecsElapsed());
+
+        dt.restart();
+        if (!encoded) {
+            mLogStrings.append(QObject::tr("Sorry, I could not save: %1").arg(mSaveInfo.outputFileInfo().fileName()));
+            mOutBuffer.clear();
+        } else if (DkBasicLoader::prepareMetaData(loader->getMetaData(), mSaveInfo.outputFilePath(), img, mOutBuffer))
+            mOutMetaData = loader->getMetaData();
+        mTimings.add(DkBatchTimings::stage_metadata, dt.nsecsElapsed());
+    }
+
+    mIsDeveloped = true;
+    mImage.clear(); // free the pixels before we (possibly) wait for the disk
+}
+
+/**
+ * Last stage: writes the encoded buffer and cleans up.
+ **/
+void DkBatchProcess::write()
+{
+    DkTraceSpan span("batch", "DkBatchProcess::write", mSaveInfo.outputFilePath());
+
+    if (mOutMetaData && mOutBuffer) {
+        QElapsedTimer dt;
+        dt.start();
+        DkBasicLoader::injectMetaData(mOutMetaData, mOutBuffer);
+        mTimings.add(DkBatchTimings::stage_metadata, dt.nsecsElapsed());
+    }
+    mOutMetaData.clear();
+
+    DkStageTimer timer(mTimings, DkBatchTimings::stage_write);
+    writeOutput();
+
+    // delete the original file if the user requested it
+    deleteOriginalFile();
+}
+
+/**
+ * Estimates the memory that is needed while this item is in the pipeline.
+ * Only the image header is read for that.
+ * @return qint64 the estimated number of bytes.
+ **/
+qint64 DkBatchProcess::memoryEstimate() const
+{
+    QFileInfo fi(mSaveInfo.inputFilePath());
+    qint64 fileSize = fi.size();
+
+    QImageReader reader(mSaveInfo.inputFilePath());
+    QSize s = reader.size();
+
+    // if we cannot read the header, assume a compression of 1:10
+    qint64 decoded = s.isValid() ? (qint64)s.width() * s.height() * 4 : fileSize * 10;
+
+    // input & output buffer + decoded image & one working copy
+    return 2 * fileSize + 2 * decoded;
+}
+
+QStringList DkBatchProcess::getLog() const
+{
+    return mLogStrings;
+}
+
+bool DkBatchProcess::writeOutput()
+{
+    if (!mIsDeveloped)
+        return false;
+
     // report we could not back-up & break here
     if (!prepareDeleteExisting()) {
         mFailure++;
@@ -783,12 +1285,21 @@ bool DkBatchProcess::process()
         return true;
     }
 
-    // udpate metadata
-    if (updateMetaData(imgC->getMetaData().data()))
-        mLogStrings.append(QObject::tr("Original filename added to Exif"));
-
     // save the image
-    if (imgC->saveImage(mSaveInfo.outputFilePath(), mSaveInfo.compression())) {
+    QFile file(mSaveInfo.outputFilePath());
+    bool saved = mOutBuffer && !mOutBuffer->isEmpty() && file.open(QIODevice::WriteOnly) && file.write(*mOutBuffer) == mOutBuffer->size();
+    file.close();
+
+    if (saved)
+        mTimings.bytesWritten = mOutBuffer->size();
+
+    mOutBuffer.clear();
+
+    // do not leave broken files (deleteOrRestoreExisting would consider them valid)
+    if (!saved)
+        file.remove();
+
+    if (saved) {
         mLogStrings.append(QObject::tr("%1 saved...").arg(mSaveInfo.outputFilePath()));
     } else {
         mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
@@ -831,6 +1342,114 @@ bool DkBatchProcess::renameFile()
     return true;
 }
 
+/**
+ * Dependency analysis of the process chain.
+ * @return bool true if any function of the chain needs the decoded image
+ **/
+bool DkBatchProcess::needsPixels() const
+{
+    for (const QSharedPointer<DkAbstractBatch> &f : mProcessFunctions) {
+        if (f && f->needsPixels())
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns the angle if the process chain is a single quarter turn of a JPEG.
+ * Such files are rotated by updating the Exif orientation only: the image data is
+ * copied as is, so there is no generation loss and we are only bound by the disk.
+ * @return int the angle in degrees [90 180 270] or 0 if the pixels need to be rotated
+ **/
+int DkBatchProcess::losslessAngle() const
+{
+    if (mSaveInfo.mode() & DkSaveInfo::mode_do_not_save_output)
+        return 0;
+
+    // inactive functions do not count
+    QVector<QSharedPointer<DkAbstractBatch>> functions;
+    for (const QSharedPointer<DkAbstractBatch> &f : mProcessFunctions) {
+        if (f && f->needsPixels())
+            functions << f;
+    }
+
+    if (functions.size() != 1)
+        return 0;
+
+    // users that ignore (or do not save) the Exif orientation expect rotated pixels
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
+    const DkSettings::MetaData &mdp = settings->metaData();
+    if (mdp.ignoreExifOrientation || !mdp.saveExifOrientation)
+        return 0;
+
+    QSharedPointer<DkBatchTransform> transform = qSharedPointerDynamicCast<DkBatchTransform>(functions.first());
+    if (!transform || !transform->isQuarterTurnOnly())
+        return 0;
+
+    QRegularExpression jpg("^jpe?g$", QRegularExpression::CaseInsensitiveOption);
+    if (!mSaveInfo.inputFileInfo().suffix().contains(jpg) || !mSaveInfo.outputFileInfo().suffix().contains(jpg))
+        return 0;
+
+    return ((transform->angle() % 360) + 360) % 360;
+}
+
+/**
+ * Copies the file and updates its Exif orientation.
+ * @param angle the clockwise rotation in degrees [90 180 270]
+ * @param rotated is false if the file has no Exif data (nothing is written then)
+ * @return bool false if an error occurred
+ **/
+bool DkBatchProcess::rotateFile(int angle, bool &rotated)
+{
+    rotated = false;
+
+    // the file is read once - the metadata is parsed from the buffer which is written later
+    QSharedPointer<QByteArray> ba(new QByteArray());
+    QFile inFile(mSaveInfo.inputFilePath());
+    if (inFile.open(QIODevice::ReadOnly))
+        *ba = inFile.readAll();
+    inFile.close();
+
+    QSharedPointer<DkMetaDataT> md(new DkMetaDataT());
+    md->readMetaData(mSaveInfo.inputFilePath(), ba);
+
+    if (!md->hasMetaData())
+        return true;
+
+    // report we could not back-up & break here
+    if (!prepareDeleteExisting())
+        return false;
+
+    updateMetaData(md.data());
+    md->setOrientation(angle == 270 ? -90 : angle);
+
+    // the image data is kept - only the Exif record is replaced
+    bool saved = !ba->isEmpty() && md->saveMetaData(ba, true) && !ba->isEmpty();
+
+    if (saved) {
+        QFile outFile(mSaveInfo.outputFilePath());
+        saved = outFile.open(QIODevice::WriteOnly) && outFile.write(*ba) == ba->size();
+        outFile.close();
+
+        // do not leave broken files (deleteOrRestoreExisting would consider them valid)
+        if (!saved)
+            outFile.remove();
+    }
+
+    if (saved)
+        mLogStrings.append(QObject::tr("%1 rotated by %2 degrees (Exif orientation)").arg(mSaveInfo.outputFilePath()).arg(angle));
+    else
+        mLogStrings.append(QObject::tr("Could not save: %1").arg(mSaveInfo.outputFilePath()));
+
+    if (!deleteOrRestoreExisting())
+        return false;
+
+    rotated = saved;
+
+    return saved;
+}
+
 bool DkBatchProcess::updateMetaData(DkMetaDataT *md)
 {
     if (!md)
@@ -867,15 +1486,41 @@ bool DkBatchProcess::copyFile()
     md->readMetaData(mSaveInfo.inputFilePath());
 
     bool exifUpdated = updateMetaData(md.data());
+    bool copied = false;
+
+    if (exifUpdated) {
+        // edit the Exif record in memory and write the file once
+        QSharedPointer<QByteArray> ba(new QByteArray());
+        if (file.open(QIODevice::ReadOnly))
+            *ba = file.readAll();
+        file.close();
+
+        exifUpdated = !ba->isEmpty() && md->saveMetaData(ba) && !ba->isEmpty();
+
+        // fall back to copying the file as is
+        if (exifUpdated) {
+            QFile outFile(mSaveInfo.outputFilePath());
+            copied = outFile.open(QIODevice::WriteOnly) && outFile.write(*ba) == ba->size();
+            outFile.close();
+
+            if (!copied) {
+                outFile.remove();
+                exifUpdated = false;
+            }
+        }
+    }
+
+    if (!copied)
+        copied = file.copy(mSaveInfo.outputFilePath());
 
-    if (!file.copy(mSaveInfo.outputFilePath())) {
+    if (!copied) {
         mLogStrings.append(QObject::tr("Error: could not copy file"));
         mLogStrings.append(QObject::tr("Input: %1").arg(mSaveInfo.inputFilePath()));
         mLogStrings.append(QObject::tr("Output: %1").arg(mSaveInfo.outputFilePath()));
         mLogStrings.append(file.errorString());
         return false;
     } else {
-        if (exifUpdated && md->saveMetaData(mSaveInfo.outputFilePath()))
+        if (exifUpdated)
             mLogStrings.append(QObject::tr("Original filename added to Exif"));
 
         mLogStrings.append(QObject::tr("Copying: %1 -> %2").arg(mSaveInfo.inputFilePath()).arg(mSaveInfo.outputFilePath()));
@@ -999,8 +1644,28 @@ DkBatchProcessing::DkBatchProcessing(const DkBatchConfig &config, QWidget *paren
 {
     mBatchConfig = config;
 
+    // network drives are faster with a few concurrent requests, local disks don't care
+    mReadPool.setMaxThreadCount(2);
+    mWritePool.setMaxThreadCount(2);
+    mDevelopPool.setMaxThreadCount(QThreadPool::globalInstance()->maxThreadCount());
+
     connect(&mBatchWatcher, SIGNAL(progressValueChanged(int)), this, SIGNAL(progressValueChanged(int)));
     connect(&mBatchWatcher, SIGNAL(finished()), this, SIGNAL(finished()));
+
+    // the develop threads idle now - release their scratch buffers
+    connect(&mBatchWatcher, &QFutureWatcherBase::finished, this, []() {
+        DkScratchPool::instance().trim();
+    });
+}
+
+DkBatchProcessing::~DkBatchProcessing()
+{
+    cancel();
+
+    // the stages feed each other - so stop them in order
+    mReadPool.waitForDone();
+    mDevelopPool.waitForDone();
+    mWritePool.waitForDone();
 }
 
 void DkBatchProcessing::init()
@@ -1010,6 +1675,10 @@ void DkBatchProcessing::init()
     QStringList fileList = mBatchConfig.getFileList();
 
     for (int idx = 0; idx < fileList.size(); idx++) {
+        // other shards compute this file - idx is kept so that counters in file names do not change
+        if (!isInShard(fileList.at(idx)))
+            continue;
+
         DkSaveInfo si = mBatchConfig.saveInfo();
 
         QFileInfo cFileInfo = QFileInfo(fileList.at(idx));
@@ -1022,8 +1691,8 @@ void DkBatchProcessing::init()
         si.setInputFilePath(fileList.at(idx));
         si.setOutputFilePath(outputFilePath);
 
-        DkBatchProcess cProcess(si);
-        cProcess.setProcessChain(mBatchConfig.getProcessFunctions());
+        QSharedPointer<DkBatchProcess> cProcess(new DkBatchProcess(si));
+        cProcess->setProcessChain(mBatchConfig.getProcessFunctions());
 
         mBatchItems.push_back(cProcess);
     }
@@ -1079,17 +1748,140 @@ void DkBatchProcessing::compute()
 {
     init();
 
+    mJournal.clear();
+
+    if (!mJournalPath.isEmpty()) {
+        mJournal = QSharedPointer<DkBatchJournal>(new DkBatchJournal(mJournalPath, DkBatchJournal::configHash(mBatchConfig)));
+
+        if (!mJournal->open()) {
+            qWarning() << "[Batch] cannot open the journal" << mJournalPath << "- processing all items";
+            mJournal.clear();
+        }
+    }
+
     qDebug() << "computing...";
 
     if (mBatchWatcher.isRunning())
         mBatchWatcher.waitForFinished();
 
-    QFuture<void> future = QtConcurrent::map(mBatchItems, &nmc::DkBatchProcessing::computeItem);
-    mBatchWatcher.setFuture(future);
-}
+    mRunNs = 0;
+    mRunTimer.start();
 
-bool DkBatchProcessing::computeItem(DkBatchProcess &item)
-{
+    mMemoryInFlight = 0;
+    mMemoryBudget = mMemoryLimit > 0 ? mMemoryLimit : qMax(qRound64(DkSettingsManager::param().resources().batchMemory * 1024.0 * 1024.0), (qint64)1);
+    mNumItemsDone = 0;
+
+    mBatchInterface = QFutureInterface<void>();
+    mBatchInterface.setProgressRange(0, mBatchItems.size());
+    mBatchInterface.reportStarted();
+    mBatchWatcher.setFuture(mBatchInterface.future());
+
+    if (mBatchItems.empty()) {
+        mBatchInterface.reportFinished();
+        return;
+    }
+
+    // items are read in order - the memory budget throttles the readers
+    for (int idx = 0; idx < mBatchItems.size(); idx++) {
+        QSharedPointer<DkBatchProcess> item = mBatchItems.at(idx);
+        mReadPool.start([this, idx, item]() {
+            readItem(idx, item);
+        });
+    }
+}
+
+void DkBatchProcessing::readItem(int idx, QSharedPointer<DkBatchProcess> item)
+{
+    if (mBatchInterface.isCanceled()) {
+        itemDone(idx, *item);
+        return;
+    }
+
+    // done in a previous run
+    if (mJournal && mJournal->isUpToDate(*item)) {
+        item->skip(tr("%1 is up-to-date -> skipping (see %2)").arg(item->inputFile()).arg(mJournalPath));
+        itemDone(idx, *item);
+        return;
+    }
+
+    qint64 mem = acquireMemory(item->memoryEstimate());
+
+    // canceled while waiting
+    if (mem == 0) {
+        itemDone(idx, *item);
+        return;
+    }
+
+    if (!item->read()) {
+        releaseMemory(mem);
+        itemDone(idx, *item);
+        return;
+    }
+
+    mDevelopPool.start([this, idx, item, mem]() {
+        item->develop();
+
+        mWritePool.start([this, idx, item, mem]() {
+            item->write();
+            releaseMemory(mem);
+            itemDone(idx, *item);
+        });
+    });
+}
+
+/**
+ * Blocks until the requested memory fits into the batch memory budget.
+ * Items that are larger than the budget are processed one at a time.
+ * @param bytes the memory requested
+ * @return qint64 the memory acquired (0 if the batch was canceled)
+ **/
+qint64 DkBatchProcessing::acquireMemory(qint64 bytes)
+{
+    bytes = qBound((qint64)1, bytes, mMemoryBudget);
+
+    QMutexLocker locker(&mMemoryMutex);
+
+    while (mMemoryInFlight + bytes > mMemoryBudget) {
+        if (mBatchInterface.isCanceled())
+            return 0;
+
+        mMemoryReleased.wait(&mMemoryMutex, 100);
+    }
+
+    mMemoryInFlight += bytes;
+
+    return bytes;
+}
+
+void DkBatchProcessing::releaseMemory(qint64 bytes)
+{
+    QMutexLocker locker(&mMemoryMutex);
+    mMemoryInFlight -= bytes;
+    mMemoryReleased.wakeAll();
+}
+
+void DkBatchProcessing::itemDone(int idx, const DkBatchProcess &item)
+{
+    // failed items are not recorded - so that they are retried
+    if (mJournal && item.wasProcessed() && !item.hasFailed())
+        mJournal->add(item);
+
+    emit itemFinished(idx);
+
+    int numDone = mNumItemsDone.fetchAndAddOrdered(1) + 1;
+    mBatchInterface.setProgressValue(numDone);
+
+    if (numDone == mBatchItems.size()) {
+        mRunNs = mRunTimer.nsecsElapsed();
+
+        if (mJournal)
+            mJournal->flush();
+        mBatchInterface.reportFinished();
+    }
+}
+
+bool DkBatchProcessing::computeItem(DkBatchProcess &item)
+{
     return item.compute();
 }
 
@@ -1098,8 +1890,8 @@ void DkBatchProcessing::postLoad()
     // collect batch infos
     QVector<QSharedPointer<DkBatchInfo>> batchInfo;
 
-    for (DkBatchProcess batch : mBatchItems) {
-        batchInfo << batch.batchInfo();
+    for (const QSharedPointer<DkBatchProcess> &batch : mBatchItems) {
+        batchInfo << batch->batchInfo();
     }
 
     for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions()) {
@@ -1125,43 +1917,346 @@ void DkBatchProcessing::computeBatch(const QString &settingsPath, const QString
     process->waitForFinished(); // block
 
     qInfo() << "batch finished with" << process->getNumFailures() << "errors in" << dt;
+    qInfo().noquote() << process->getReport().summary();
 
-    if (!logPath.isEmpty()) {
-        QFileInfo fi(logPath);
+    if (!logPath.isEmpty())
+        process->saveLog(logPath);
+}
 
-        QDir().mkpath(fi.absolutePath());
+// DkJsonLines --------------------------------------------------------------------
+// writes one (compact) JSON object per line to stdout - the progress format of the headless batch
+class DkJsonLines
+{
+public:
+    DkJsonLines()
+    {
+        mOut.open(stdout, QIODevice::WriteOnly);
+    }
 
-        QFile file(logPath);
-        if (!file.open(QIODevice::WriteOnly))
-            qWarning() << "Sorry, I could not write to" << logPath;
-        else {
-            QStringList log = process->getLog();
-            QTextStream s(&file);
-            for (const QString &line : log)
-                s << line << '\n';
-            qInfo() << "log written to: " << logPath;
+    void write(const QJsonObject &obj)
+    {
+        QMutexLocker locker(&mMutex);
+        mOut.write(QJsonDocument(obj).toJson(QJsonDocument::Compact) + '\n');
+        mOut.flush();
+    }
+
+    void error(const QString &msg)
+    {
+        QJsonObject obj;
+        obj.insert("event", "error");
+        obj.insert("message", msg);
+        write(obj);
+    }
+
+protected:
+    QMutex mMutex;
+    QFile mOut;
+};
+
+/**
+ * Runs a batch profile without the GUI stack (see --headless).
+ * The progress is written to stdout as JSON lines (start, item, finished or error events).
+ * @param settingsPath the batch profile
+ * @param fileListPath a text file with one image path per line, - reads the list from stdin, the profile's files are used if it is empty
+ * @param numThreads number of threads that decode, process & encode - <= 0 uses all cores
+ * @param numIoThreads number of threads that read and write files - <= 0 keeps the default
+ * @param memoryBudget the memory (in MB) of all images in the pipeline - <= 0 uses the batch memory of the settings
+ * @param logPath the batch log is saved to this file if it is not empty
+ * @param journalPath items that are up-to-date in this journal are skipped, finished items are added (see DkBatchJournal)
+ * @param shard i/N computes the i-th of N disjoint parts of the file list (see setShard) - all files if it is empty
+ * @return int the exit code (see DkBatchProcessing::ExitCode)
+ **/
+int DkBatchProcessing::computeBatchHeadless(const QString &settingsPath,
+                                            const QString &fileListPath,
+                                            int numThreads,
+                                            int numIoThreads,
+                                            double memoryBudget,
+                                            const QString &logPath,
+                                            const QString &journalPath,
+                                            const QString &shard)
+{
+    DkTimer dt;
+    DkJsonLines out;
+
+    if (!QFileInfo(settingsPath).isFile()) {
+        out.error(QString("cannot read the batch profile %1").arg(settingsPath));
+        return exit_usage;
+    }
+
+    DkBatchConfig bc = DkBatchProfile::loadProfile(settingsPath);
+
+    // the file list replaces the profile's files
+    if (!fileListPath.isEmpty()) {
+        bool fromStdIn = fileListPath == "-";
+        QFile file(fromStdIn ? QString() : fileListPath);
+        bool opened = fromStdIn ? file.open(stdin, QIODevice::ReadOnly | QIODevice::Text) : file.open(QIODevice::ReadOnly | QIODevice::Text);
+
+        if (!opened) {
+            out.error(QString("cannot read the file list %1").arg(fileListPath));
+            return exit_usage;
+        }
+
+        QStringList fileList;
+        QTextStream s(&file);
+        while (!s.atEnd()) {
+            QString line = s.readLine().trimmed();
+
+            // skip empty lines & comments
+            if (!line.isEmpty() && !line.startsWith("#"))
+                fileList << line;
+        }
+
+        bc.setFileList(fileList);
+    }
+
+#ifdef WITH_PLUGINS
+    // plugins need the GUI application (they create actions & menus when loaded)
+    for (auto pf : bc.getProcessFunctions()) {
+        if (pf.dynamicCast<DkPluginBatch>() && pf->isActive()) {
+            out.error("plugins are not supported in headless mode");
+            return exit_unsupported;
+        }
+    }
+#endif
+
+    if (bc.getFileList().isEmpty() || bc.getFileNamePattern().isEmpty()) {
+        out.error(QString("the batch profile %1 has no input files or no file name pattern").arg(settingsPath));
+        return exit_profile;
+    }
+
+    if (bc.getOutputDirPath().isEmpty() || !QDir().mkpath(bc.getOutputDirPath())) {
+        out.error(QString("cannot create the output directory %1").arg(bc.getOutputDirPath()));
+        return exit_output_dir;
+    }
+
+    int shardIndex = 0;
+    int numShards = 1;
+
+    if (!shard.isEmpty()) {
+        QStringList parts = shard.split("/");
+        bool okIdx = false, okNum = false;
+
+        if (parts.size() == 2) {
+            shardIndex = parts[0].toInt(&okIdx);
+            numShards = parts[1].toInt(&okNum);
+        }
+
+        if (!okIdx || !okNum || numShards < 1 || shardIndex < 0 || shardIndex >= numShards) {
+            out.error(QString("invalid shard %1 - use i/N with 0 <= i < N").arg(shard));
+            return exit_usage;
         }
     }
+
+    // images are processed in parallel too - so limit the CPU lane & the global pool as well
+    if (numThreads > 0)
+        DkScheduler::instance().setNumThreads(numThreads);
+
+    DkBatchProcessing process(bc);
+    process.setNumThreads(numThreads, numIoThreads);
+
+    if (memoryBudget > 0)
+        process.setMemoryBudget(qRound64(memoryBudget * 1024.0 * 1024.0));
+
+    process.setJournal(journalPath);
+    process.setShard(shardIndex, numShards);
+
+    QAtomicInt numDone(0);
+    int numItems = 0;
+    for (const QString &filePath : bc.getFileList()) {
+        if (process.isInShard(filePath))
+            numItems++;
+    }
+
+    connect(&process, &DkBatchProcessing::itemFinished, [&](int idx) {
+        const DkBatchProcess &item = *process.mBatchItems.at(idx);
+
+        QJsonObject obj;
+        obj.insert("event", "item");
+        obj.insert("index", idx);
+        obj.insert("done", numDone.fetchAndAddOrdered(1) + 1);
+        obj.insert("total", numItems);
+        obj.insert("input", item.inputFile());
+        obj.insert("output", item.outputFile());
+        obj.insert("status", !item.wasProcessed() ? "skipped" : item.hasFailed() ? "failed" : "ok");
+
+        if (item.hasFailed())
+            obj.insert("log", QJsonArray::fromStringList(item.getLog()));
+
+        out.write(obj);
+    });
+
+    QJsonObject start;
+    start.insert("event", "start");
+    start.insert("profile", settingsPath);
+    start.insert("total", numItems);
+    start.insert("threads", process.mDevelopPool.maxThreadCount());
+    start.insert("ioThreads", process.mReadPool.maxThreadCount());
+    if (!journalPath.isEmpty())
+        start.insert("journal", journalPath);
+    if (numShards > 1) {
+        start.insert("shard", shardIndex);
+        start.insert("shards", numShards);
+        start.insert("files", bc.getFileList().size());
+    }
+    out.write(start);
+
+    process.compute();
+    process.waitForFinished(); // block
+
+    int numFailures = process.getNumFailures();
+
+    QJsonObject finished;
+    finished.insert("event", "finished");
+    finished.insert("total", numItems);
+    finished.insert("processed", process.getNumProcessed());
+    finished.insert("failed", numFailures);
+    finished.insert("ms", dt.elapsed());
+
+    DkBatchReport report = process.getReport();
+    if (!report.isEmpty())
+        finished.insert("report", report.toJson());
+
+    out.write(finished);
+
+    if (!logPath.isEmpty())
+        process.saveLog(logPath);
+
+    return numFailures > 0 ? exit_item_failed : exit_ok;
+}
+
+/**
+ * Sets the number of threads of the pipeline's stages.
+ * @param numThreads threads that decode, process and encode images - ignored if <= 0
+ * @param numIoThreads threads that read and write files - ignored if <= 0
+ **/
+void DkBatchProcessing::setNumThreads(int numThreads, int numIoThreads)
+{
+    if (numThreads > 0)
+        mDevelopPool.setMaxThreadCount(numThreads);
+
+    if (numIoThreads > 0) {
+        mReadPool.setMaxThreadCount(numIoThreads);
+        mWritePool.setMaxThreadCount(numIoThreads);
+    }
+}
+
+/**
+ * Overrides the batch memory of the settings.
+ * @param bytes the memory of all images in the pipeline
+ **/
+void DkBatchProcessing::setMemoryBudget(qint64 bytes)
+{
+    mMemoryLimit = bytes;
+}
+
+/**
+ * Records the run in a journal - items recorded in previous runs of the same configuration are skipped.
+ * @param filePath the journal (it is created if it does not exist) or an empty string to disable journaling
+ **/
+void DkBatchProcessing::setJournal(const QString &filePath)
+{
+    mJournalPath = filePath;
+}
+
+/**
+ * Splits the batch into count shards - this process only computes the items of shard index.
+ * Files are assigned by a hash of their path, so every process that runs the same profile
+ * computes a disjoint part and files that are added later do not move between shards.
+ * @param index the shard of this process [0 count)
+ * @param count the number of shards (1 computes all items)
+ **/
+void DkBatchProcessing::setShard(int index, int count)
+{
+    mNumShards = qMax(count, 1);
+    mShardIndex = qBound(0, index, mNumShards - 1);
+}
+
+bool DkBatchProcessing::isInShard(const QString &filePath) const
+{
+    if (mNumShards <= 1)
+        return true;
+
+    // qHash is seeded per process - so we need a hash that is the same on all nodes
+    QByteArray h = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Md5);
+    quint32 v = ((quint32)(uchar)h[0] << 24) | ((quint32)(uchar)h[1] << 16) | ((quint32)(uchar)h[2] << 8) | (quint32)(uchar)h[3];
+
+    return (int)(v % (quint32)mNumShards) == mShardIndex;
+}
+
+bool DkBatchProcessing::saveLog(const QString &logPath) const
+{
+    QFileInfo fi(logPath);
+
+    QDir().mkpath(fi.absolutePath());
+
+    QFile file(logPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Sorry, I could not write to" << logPath;
+        return false;
+    }
+
+    QStringList log = getLog();
+    QTextStream s(&file);
+    for (const QString &line : log)
+        s << line << '\n';
+    qInfo() << "log written to: " << logPath;
+
+    return true;
 }
 
 QStringList DkBatchProcessing::getLog() const
 {
     QStringList log;
 
-    for (DkBatchProcess batch : mBatchItems) {
-        log << batch.getLog();
+    for (const QSharedPointer<DkBatchProcess> &batch : mBatchItems) {
+        log << batch->getLog();
         log << ""; // add empty line between images
     }
 
+    DkBatchReport report = getReport();
+    if (!report.isEmpty())
+        log << report.toText();
+
     return log;
 }
 
+/**
+ * Profiles the last run.
+ * @return DkBatchReport the stage timings of all items (empty while the batch is computed)
+ **/
+DkBatchReport DkBatchProcessing::getReport() const
+{
+    DkBatchReport report;
+
+    if (mRunNs <= 0)
+        return report;
+
+    int numDevelop = mDevelopPool.maxThreadCount();
+
+    report.addStage(DkBatchTimings::stageName(DkBatchTimings::stage_read), mReadPool.maxThreadCount());
+    report.addStage(DkBatchTimings::stageName(DkBatchTimings::stage_decode), numDevelop);
+
+    for (QSharedPointer<DkAbstractBatch> fun : mBatchConfig.getProcessFunctions())
+        report.addStage(fun ? fun->name() : QString(), numDevelop);
+
+    report.addStage(DkBatchTimings::stageName(DkBatchTimings::stage_metadata), numDevelop);
+    report.addStage(DkBatchTimings::stageName(DkBatchTimings::stage_encode), numDevelop);
+    report.addStage(DkBatchTimings::stageName(DkBatchTimings::stage_write), mWritePool.maxThreadCount());
+
+    for (const QSharedPointer<DkBatchProcess> &item : mBatchItems)
+        report.addItem(*item);
+
+    report.finish(mRunNs);
+
+    return report;
+}
+
 int DkBatchProcessing::getNumFailures() const
 {
     int numFailures = 0;
 
-    for (DkBatchProcess batch : mBatchItems) {
-        if (batch.hasFailed())
+    for (const QSharedPointer<DkBatchProcess> &batch : mBatchItems) {
+        if (batch->hasFailed())
             numFailures++;
     }
 
@@ -1172,8 +2267,8 @@ int DkBatchProcessing::getNumProcessed() const
 {
     int numProcessed = 0;
 
-    for (DkBatchProcess batch : mBatchItems) {
-        if (batch.wasProcessed())
+    for (const QSharedPointer<DkBatchProcess> &batch : mBatchItems) {
+        if (batch->wasProcessed())
             numProcessed++;
     }
 
@@ -1191,8 +2286,8 @@ QList<int> DkBatchProcessing::getCurrentResults()
         if (mResList.at(idx) != batch_item_not_computed)
             continue;
 
-        if (mBatchItems.at(idx).wasProcessed())
-            mResList[idx] = mBatchItems.at(idx).hasFailed() ? batch_item_failed : batch_item_succeeded;
+        if (mBatchItems.at(idx)->wasProcessed())
+            mResList[idx] = mBatchItems.at(idx)->hasFailed() ? batch_item_failed : batch_item_succeeded;
     }
 
     return mResList;
@@ -1202,9 +2297,9 @@ QStringList DkBatchProcessing::getResultList() const
 {
     QStringList results;
 
-    for (DkBatchProcess batch : mBatchItems) {
-        if (batch.wasProcessed())
-            results.append(getBatchSummary(batch));
+    for (const QSharedPointer<DkBatchProcess> &batch : mBatchItems) {
+        if (batch->wasProcessed())
+            results.append(getBatchSummary(*batch));
     }
 
     return results;
@@ -1240,6 +2335,456 @@ bool DkBatchProcessing::isComputing() const
 void DkBatchProcessing::cancel()
 {
     mBatchWatcher.cancel();
+    mMemoryReleased.wakeAll();
+}
+
+// DkBatchReport --------------------------------------------------------------------
+qint64 DkBatchReport::Stage::total() const
+{
+    qint64 t = 0;
+
+    for (qint64 v : ns)
+        t += v;
+
+    return t;
+}
+
+/**
+ * Returns the p-th percentile (nearest rank).
+ * @param p the percentile in [0 1]
+ **/
+qint64 DkBatchReport::Stage::percentile(double p) const
+{
+    if (ns.isEmpty())
+        return 0;
+
+    int idx = qBound(0, (int)std::ceil(p * ns.size()) - 1, ns.size() - 1);
+
+    return ns[idx];
+}
+
+/**
+ * Returns the time the stage keeps each of its threads busy.
+ **/
+double DkBatchReport::Stage::load() const
+{
+    return (double)total() / qMax(numThreads, 1);
+}
+
+void DkBatchReport::addStage(const QString &name, int numThreads)
+{
+    Stage s;
+    s.name = name;
+    s.numThreads = numThreads;
+    mStages << s;
+}
+
+/**
+ * Adds the timings of an item.
+ * The stages must be added first (in pipeline order).
+ **/
+void DkBatchReport::addItem(const DkBatchProcess &item)
+{
+    if (!item.wasProcessed() || mStages.size() < DkBatchTimings::stage_end)
+        return;
+
+    DkBatchTimings t = item.timings();
+    int numFunctions = mStages.size() - DkBatchTimings::stage_end;
+
+    QVector<qint64> values;
+    values << t.stage(DkBatchTimings::stage_read) << t.stage(DkBatchTimings::stage_decode);
+
+    for (int idx = 0; idx < numFunctions; idx++)
+        values << t.function(idx);
+
+    values << t.stage(DkBatchTimings::stage_metadata) << t.stage(DkBatchTimings::stage_encode) << t.stage(DkBatchTimings::stage_write);
+
+    for (int idx = 0; idx < values.size(); idx++) {
+        if (values[idx] >= 0)
+            mStages[idx].ns << values[idx];
+    }
+
+    mNumItems++;
+    mBytesRead += t.bytesRead;
+    mBytesWritten += t.bytesWritten;
+}
+
+void DkBatchReport::finish(qint64 wallNs)
+{
+    mWallNs = wallNs;
+
+    for (Stage &s : mStages)
+        std::sort(s.ns.begin(), s.ns.end());
+}
+
+bool DkBatchReport::isEmpty() const
+{
+    return mNumItems == 0 || mWallNs <= 0;
+}
+
+int DkBatchReport::numItems() const
+{
+    return mNumItems;
+}
+
+QVector<DkBatchReport::Stage> DkBatchReport::stages() const
+{
+    return mStages;
+}
+
+/**
+ * Returns the stage that limits the throughput.
+ * @return int the stage's index or -1 if no stage was timed
+ **/
+int DkBatchReport::bottleneck() const
+{
+    int bIdx = -1;
+    double bLoad = 0.0;
+
+    for (int idx = 0; idx < mStages.size(); idx++) {
+        double l = mStages[idx].load();
+
+        if (!mStages[idx].ns.isEmpty() && l > bLoad) {
+            bLoad = l;
+            bIdx = idx;
+        }
+    }
+
+    return bIdx;
+}
+
+double DkBatchReport::imagesPerSecond() const
+{
+    return mWallNs > 0 ? mNumItems / (mWallNs / 1e9) : 0.0;
+}
+
+double DkBatchReport::megaBytesPerSecond() const
+{
+    return mWallNs > 0 ? mBytesRead / (1024.0 * 1024.0) / (mWallNs / 1e9) : 0.0;
+}
+
+QString DkBatchReport::summary() const
+{
+    if (isEmpty())
+        return QString();
+
+    int b = bottleneck();
+
+    return QObject::tr("%1 images in %2 s - %3 images/s, %4 MB/s - bottleneck: %5")
+        .arg(mNumItems)
+        .arg(mWallNs / 1e9, 0, 'f', 1)
+        .arg(imagesPerSecond(), 0, 'f', 1)
+        .arg(megaBytesPerSecond(), 0, 'f', 1)
+        .arg(b != -1 ? mStages[b].name : QObject::tr("none"));
+}
+
+QStringList DkBatchReport::toText() const
+{
+    QStringList txt;
+
+    if (isEmpty())
+        return txt;
+
+    auto ms = [](qint64 ns) {
+        return QString::number(ns / 1e6, 'f', 1);
+    };
+
+    double busy = 0.0;
+    for (const Stage &s : mStages)
+        busy += s.load();
+
+    txt << QObject::tr("Profile");
+    txt << summary();
+    txt << QObject::tr("read: %1 MB, written: %2 MB").arg(mBytesRead / (1024.0 * 1024.0), 0, 'f', 1).arg(mBytesWritten / (1024.0 * 1024.0), 0, 'f', 1);
+    txt << QObject::tr("stage	threads	items	total [ms]	p50 [ms]	p90 [ms]	p99 [ms]	max [ms]	load");
+
+    for (const Stage &s : mStages) {
+        if (s.ns.isEmpty())
+            continue;
+
+        txt << QString("%1	%2	%3	%4	%5	%6	%7	%8	%9%")
+                   .arg(s.name)
+                   .arg(s.numThreads)
+                   .arg(s.ns.size())
+                   .arg(ms(s.total()))
+                   .arg(ms(s.percentile(0.5)))
+                   .arg(ms(s.percentile(0.9)))
+                   .arg(ms(s.percentile(0.99)))
+                   .arg(ms(s.ns.last()))
+                   .arg(busy > 0 ? qRound(s.load() / busy * 100) : 0);
+    }
+
+    return txt;
+}
+
+/**
+ * Returns one row per stage (times in ms).
+ **/
+QByteArray DkBatchReport::toCsv() const
+{
+    QByteArray csv = "stage,threads,items,total_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n";
+
+    for (const Stage &s : mStages) {
+        QString name = s.name;
+        name.replace("\"", "\"\"");
+
+        QStringList row;
+        row << "\"" + name + "\"";
+        row << QString::number(s.numThreads);
+        row << QString::number(s.ns.size());
+        row << QString::number(s.total() / 1e6, 'f', 3);
+        row << QString::number(s.ns.isEmpty() ? 0.0 : s.total() / 1e6 / s.ns.size(), 'f', 3);
+        row << QString::number(s.percentile(0.5) / 1e6, 'f', 3);
+        row << QString::number(s.percentile(0.9) / 1e6, 'f', 3);
+        row << QString::number(s.percentile(0.99) / 1e6, 'f', 3);
+        row << QString::number(s.ns.isEmpty() ? 0.0 : s.ns.last() / 1e6, 'f', 3);
+
+        csv += row.join(",").toUtf8() + "\n";
+    }
+
+    return csv;
+}
+
+QJsonObject DkBatchReport::toJson() const
+{
+    QJsonArray stages;
+
+    for (const Stage &s : mStages) {
+        QJsonObject so;
+        so.insert("name", s.name);
+        so.insert("threads", s.numThreads);
+        so.insert("items", s.ns.size());
+        so.insert("totalMs", s.total() / 1e6);
+        so.insert("p50Ms", s.percentile(0.5) / 1e6);
+        so.insert("p90Ms", s.percentile(0.9) / 1e6);
+        so.insert("p99Ms", s.percentile(0.99) / 1e6);
+        so.insert("maxMs", s.ns.isEmpty() ? 0.0 : s.ns.last() / 1e6);
+        stages.append(so);
+    }
+
+    int b = bottleneck();
+
+    QJsonObject obj;
+    obj.insert("items", mNumItems);
+    obj.insert("wallMs", mWallNs / 1e6);
+    obj.insert("bytesRead", (double)mBytesRead);
+    obj.insert("bytesWritten", (double)mBytesWritten);
+    obj.insert("imagesPerSecond", imagesPerSecond());
+    obj.insert("mbPerSecond", megaBytesPerSecond());
+    obj.insert("bottleneck", b != -1 ? mStages[b].name : QString());
+    obj.insert("stages", stages);
+
+    return obj;
+}
+
+/**
+ * Saves the report as JSON (*.json) or CSV (any other suffix).
+ **/
+bool DkBatchReport::save(const QString &filePath) const
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[Batch] cannot write the report to" << filePath;
+        return false;
+    }
+
+    bool json = QFileInfo(filePath).suffix().compare("json", Qt::CaseInsensitive) == 0;
+    QByteArray data = json ? QJsonDocument(toJson()).toJson() : toCsv();
+
+    return file.write(data) == data.size();
+}
+
+// DkBatchJournal --------------------------------------------------------------------
+DkBatchJournal::DkBatchJournal(const QString &filePath, const QByteArray &configHash)
+{
+    mFilePath = filePath;
+    mConfigHash = configHash;
+}
+
+DkBatchJournal::~DkBatchJournal()
+{
+    flush();
+    mFile.close();
+}
+
+/**
+ * Reads the entries of previous runs and opens the journal for appending.
+ * Entries of other configurations and broken lines (e.g. of a crash) are ignored.
+ * @return bool false if the journal cannot be written
+ **/
+bool DkBatchJournal::open()
+{
+    QFile file(mFilePath);
+
+    if (file.open(QIODevice::ReadOnly)) {
+        QString configHex = mConfigHash.toHex();
+
+        while (!file.atEnd()) {
+            QJsonObject obj = QJsonDocument::fromJson(file.readLine()).object();
+
+            if (obj.value("config").toString() != configHex)
+                continue;
+
+            Entry e;
+            e.modified = (qint64)obj.value("modified").toDouble();
+            e.size = (qint64)obj.value("size").toDouble(-1);
+            e.hash = QByteArray::fromHex(obj.value("hash").toString().toLatin1());
+            e.output = obj.value("output").toString();
+
+            // later runs replace earlier ones
+            mEntries.insert(obj.value("input").toString(), e);
+        }
+
+        file.close();
+    }
+
+    QDir().mkpath(QFileInfo(mFilePath).absolutePath());
+
+    mFile.setFileName(mFilePath);
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    qInfo() << "[Batch] journal" << mFilePath << "has" << mEntries.size() << "entries of this configuration";
+
+    return true;
+}
+
+/**
+ * True if the item was processed with the same configuration before and neither its input nor its output changed since.
+ * Inputs that were touched but not changed (same size, new modification time) are compared by their content hash.
+ * @param item the batch item
+ * @return bool true if the item can be skipped
+ **/
+bool DkBatchJournal::isUpToDate(const DkBatchProcess &item) const
+{
+    auto it = mEntries.constFind(item.inputFile());
+
+    if (it == mEntries.constEnd())
+        return false;
+
+    const Entry &e = it.value();
+
+    if (e.output != item.outputFile() || !QFileInfo::exists(e.output))
+        return false;
+
+    QFileInfo fi(item.inputFile());
+
+    if (!fi.exists() || fi.size() != e.size)
+        return false;
+
+    if (fi.lastModified().toMSecsSinceEpoch() == e.modified)
+        return true;
+
+    return !e.hash.isEmpty() && fileHash(item.inputFile()) == e.hash;
+}
+
+/**
+ * Appends a processed item - thread-safe.
+ * The journal is synced to disk every sync_interval items (and on flush()).
+ * @param item the processed batch item
+ **/
+void DkBatchJournal::add(const DkBatchProcess &item)
+{
+    qint64 modified = item.inputModified();
+    qint64 size = item.inputSize();
+    QByteArray hash = item.inputHash();
+
+    // the input was overwritten - record the file we wrote
+    if (item.inputFile() == item.outputFile()) {
+        QFileInfo fi(item.outputFile());
+        modified = fi.lastModified().toMSecsSinceEpoch();
+        size = fi.size();
+        hash.clear();
+    }
+
+    QJsonObject obj;
+    obj.insert("input", item.inputFile());
+    obj.insert("modified", (double)modified);
+    obj.insert("size", (double)size);
+    obj.insert("hash", QString(hash.toHex()));
+    obj.insert("config", QString(mConfigHash.toHex()));
+    obj.insert("output", item.outputFile());
+
+    QMutexLocker lock(&mMutex);
+
+    if (!mFile.isOpen())
+        return;
+
+    mFile.write(QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\n");
+
+    if (++mNumPending >= sync_interval) {
+        lock.unlock();
+        flush();
+    }
+}
+
+/**
+ * Writes pending entries to disk.
+ **/
+void DkBatchJournal::flush()
+{
+    QMutexLocker lock(&mMutex);
+
+    if (!mFile.isOpen() || mNumPending == 0)
+        return;
+
+    mFile.flush();
+
+#ifdef Q_OS_WIN
+    _commit(mFile.handle());
+#else
+    fsync(mFile.handle());
+#endif
+
+    mNumPending = 0;
+}
+
+int DkBatchJournal::numEntries() const
+{
+    return mEntries.size();
+}
+
+/**
+ * Hashes the batch configuration (process chain, save options & output).
+ * The file list is not part of it, so that a profile can be re-applied to folders that have grown.
+ * @param config the batch configuration
+ * @return QByteArray the hash
+ **/
+QByteArray DkBatchJournal::configHash(const DkBatchConfig &config)
+{
+    // QSettings can only serialize to files
+    QTemporaryFile file;
+    if (!file.open())
+        return QByteArray();
+    file.close();
+
+    {
+        QSettings settings(file.fileName(), QSettings::IniFormat);
+        config.saveSettings(settings);
+        settings.remove("General/FileList");
+        settings.sync();
+    }
+
+    return fileHash(file.fileName());
+}
+
+/**
+ * Hashes a file's content.
+ * @param filePath the file
+ * @return QByteArray the hash or an empty array if the file cannot be read
+ **/
+QByteArray DkBatchJournal::fileHash(const QString &filePath)
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+
+    return hash.result();
 }
 
 // DkBatchProfile --------------------------------------------------------------------
@@ -29,11 +29,19 @@
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileInfo>
+#include <QHash>
+#include <QFutureInterface>
 #include <QFutureWatcher>
+#include <QMutex>
 #include <QSharedPointer>
 #include <QStringList>
+#include <QThreadPool>
 #include <QUrl>
+#include <QVector>
+#include <QWaitCondition>
 #pragma warning(pop) // no warnings from includes - end
 
 #include "DkBatchInfo.h"
@@ -53,6 +61,7 @@
 
 // Qt defines
 class QImage;
+class QJsonObject;
 class QSettings;
 
 namespace nmc
@@ -61,6 +70,7 @@ namespace nmc
 // nomacs defines
 class DkImageContainer;
 class DkPluginContainer;
+class DkPluginRunner;
 class DkBaseManipulator;
 class DkMetaDataT;
 
@@ -85,6 +95,10 @@ public:
     {
         return false;
     };
+    virtual bool needsPixels() const
+    {
+        return isActive();
+    };
     virtual void postLoad(const QVector<QSharedPointer<DkBatchInfo>> &) const {};
 
     virtual QString name() const
@@ -131,6 +145,7 @@ protected:
     void loadPlugin(const QString &pluginString, QSharedPointer<DkPluginContainer> &plugin, QString &runID) const;
 
     QVector<QSharedPointer<DkPluginContainer>> mPlugins;
+    QVector<QSharedPointer<DkPluginRunner>> mRunners; // parallel batch plugins only (NULL otherwise)
     QStringList mRunIDs;
     QStringList mPluginList;
 };
@@ -193,6 +208,7 @@ public:
     virtual bool compute(QSharedPointer<DkImageContainer> container, QStringList &logStrings) const override;
     virtual QString name() const override;
     virtual bool isActive() const override;
+    bool isQuarterTurnOnly() const;
 
     int angle() const;
     bool cropMetatdata() const;
@@ -224,6 +240,41 @@ protected:
     QRect mCropRect;
 };
 
+/**
+ * The time an item spent in each stage of the batch pipeline.
+ * Times are in nanoseconds, -1 if the item did not pass the stage.
+ **/
+class DllCoreExport DkBatchTimings
+{
+public:
+    enum Stage {
+        stage_read,
+        stage_decode,
+        stage_metadata,
+        stage_encode,
+        stage_write,
+
+        stage_end
+    };
+
+    DkBatchTimings(int numFunctions = 0);
+
+    void add(Stage stage, qint64 ns);
+    void addFunction(int idx, qint64 ns);
+
+    qint64 stage(Stage stage) const;
+    qint64 function(int idx) const;
+
+    static QString stageName(Stage stage);
+
+    qint64 bytesRead = 0;
+    qint64 bytesWritten = 0;
+
+protected:
+    qint64 mStages[stage_end];
+    QVector<qint64> mFunctions; // one per function of the process chain
+};
+
 class DllCoreExport DkBatchProcess
 {
 public:
@@ -231,30 +282,105 @@ public:
 
     void setProcessChain(const QVector<QSharedPointer<DkAbstractBatch>> processes);
     bool compute(); // do the work
+
+    // pipeline stages - compute() runs them in a row
+    bool read();
+    void develop();
+    void write();
+    qint64 memoryEstimate() const;
+
     QStringList getLog() const;
     bool hasFailed() const;
     bool wasProcessed() const;
     QString inputFile() const;
     QString outputFile() const;
+    qint64 inputModified() const;
+    qint64 inputSize() const;
+    QByteArray inputHash() const;
+    void skip(const QString &reason);
+    DkBatchTimings timings() const;
 
     QVector<QSharedPointer<DkBatchInfo>> batchInfo() const;
 
 protected:
-    bool process();
+    bool writeOutput();
     bool prepareDeleteExisting();
     bool deleteOrRestoreExisting();
     bool deleteOriginalFile();
     bool copyFile();
     bool renameFile();
     bool updateMetaData(DkMetaDataT *md);
+    bool needsPixels() const;
+    int losslessAngle() const;
+    bool rotateFile(int angle, bool &rotated);
 
     DkSaveInfo mSaveInfo;
     int mFailure = 0;
     bool mIsProcessed = false;
+    bool mIsDeveloped = false;
+
+    // input stats recorded by the batch journal
+    qint64 mInputModified = 0;
+    qint64 mInputSize = -1;
+    QByteArray mInputHash;
+
+    // data that is passed between the stages
+    QSharedPointer<DkImageContainer> mImage;
+    QSharedPointer<QByteArray> mOutBuffer;
+    QSharedPointer<DkMetaDataT> mOutMetaData; // injected into mOutBuffer while writing
 
     QVector<QSharedPointer<DkBatchInfo>> mInfos;
     QVector<QSharedPointer<DkAbstractBatch>> mProcessFunctions;
     QStringList mLogStrings;
+    DkBatchTimings mTimings;
+};
+
+/**
+ * Profiles a batch run.
+ * The stage timings of all items are aggregated to totals and
+ * percentiles per stage (read, decode, each process function,
+ * metadata, encode and write). The bottleneck is the stage that
+ * keeps its pool's threads busiest - i.e. the largest total time
+ * divided by the number of threads that run the stage.
+ **/
+class DllCoreExport DkBatchReport
+{
+public:
+    struct Stage {
+        QString name;
+        int numThreads = 1;
+        QVector<qint64> ns; // sorted - only items that passed the stage
+
+        qint64 total() const;
+        qint64 percentile(double p) const;
+        double load() const;
+    };
+
+    DkBatchReport() = default;
+
+    void addStage(const QString &name, int numThreads);
+    void addItem(const DkBatchProcess &item);
+    void finish(qint64 wallNs);
+
+    bool isEmpty() const;
+    int numItems() const;
+    QVector<Stage> stages() const;
+    int bottleneck() const;
+    double imagesPerSecond() const;
+    double megaBytesPerSecond() const;
+
+    QString summary() const;
+    QStringList toText() const;
+    QByteArray toCsv() const;
+    QJsonObject toJson() const;
+    bool save(const QString &filePath) const;
+
+protected:
+    QVector<Stage> mStages; // read, decode, functions, metadata, encode, write
+    int mNumItems = 0;
+    qint64 mBytesRead = 0;
+    qint64 mBytesWritten = 0;
+    qint64 mWallNs = 0;
 };
 
 class DllCoreExport DkBatchConfig
@@ -320,6 +446,50 @@ protected:
     QVector<QSharedPointer<DkAbstractBatch>> mProcessFunctions;
 };
 
+/**
+ * Durable record of a batch run.
+ * Each finished item is appended as a JSON line that holds the input's
+ * modification time, size and content hash, a hash of the batch
+ * configuration and the output path. Lines are synced to disk in chunks.
+ * Reruns of the same configuration skip items that are up-to-date - so
+ * interrupted runs resume and grown folders are processed incrementally.
+ **/
+class DllCoreExport DkBatchJournal
+{
+public:
+    DkBatchJournal(const QString &filePath, const QByteArray &configHash);
+    ~DkBatchJournal();
+
+    bool open();
+    bool isUpToDate(const DkBatchProcess &item) const;
+    void add(const DkBatchProcess &item);
+    void flush();
+    int numEntries() const;
+
+    static QByteArray configHash(const DkBatchConfig &config);
+    static QByteArray fileHash(const QString &filePath);
+
+protected:
+    enum {
+        sync_interval = 64, // records per fsync
+    };
+
+    struct Entry {
+        qint64 modified = 0;
+        qint64 size = -1;
+        QByteArray hash;
+        QString output;
+    };
+
+    QString mFilePath;
+    QByteArray mConfigHash;
+    QHash<QString, Entry> mEntries; // entries of previous runs (read-only while computing)
+
+    QMutex mMutex;
+    QFile mFile;
+    int mNumPending = 0;
+};
+
 class DllCoreExport DkBatchProcessing : public QObject
 {
     Q_OBJECT
@@ -333,7 +503,20 @@ public:
         batch_item_end
     };
 
+    // exit codes of the headless batch
+    enum ExitCode {
+        exit_ok = 0,
+        exit_item_failed,
+        exit_usage,
+        exit_profile,
+        exit_output_dir,
+        exit_unsupported,
+
+        exit_end
+    };
+
     DkBatchProcessing(const DkBatchConfig &config = DkBatchConfig(), QWidget *parent = 0);
+    ~DkBatchProcessing();
 
     void compute();
     static bool computeItem(DkBatchProcess &item);
@@ -347,6 +530,7 @@ public:
     QList<int> getCurrentResults();
     QStringList getResultList() const;
     QString getBatchSummary(const DkBatchProcess &batch) const;
+    DkBatchReport getReport() const;
     void waitForFinished();
 
     // getter, setter
@@ -360,8 +544,22 @@ public:
     };
 
     void postLoad();
+    void setNumThreads(int numThreads, int numIoThreads);
+    void setMemoryBudget(qint64 bytes);
+    void setJournal(const QString &filePath);
+    void setShard(int index, int count);
+    bool isInShard(const QString &filePath) const;
+    bool saveLog(const QString &logPath) const;
 
     static void computeBatch(const QString &settingsPath, const QString &logPath);
+    static int computeBatchHeadless(const QString &settingsPath,
+                                    const QString &fileListPath,
+                                    int numThreads = 0,
+                                    int numIoThreads = 0,
+                                    double memoryBudget = 0.0,
+                                    const QString &logPath = QString(),
+                                    const QString &journalPath = QString(),
+                                    const QString &shard = QString());
 
 public slots:
     // user interaction
@@ -371,15 +569,48 @@ signals:
     void progressValueChanged(int idx);
     void finished();
 
+    // NOTE: emitted from the pipeline's threads
+    void itemFinished(int idx) const;
+
 protected:
     DkBatchConfig mBatchConfig;
-    QVector<DkBatchProcess> mBatchItems;
+    QVector<QSharedPointer<DkBatchProcess>> mBatchItems; // the pipeline's threads keep their items alive
     QList<int> mResList;
 
     // threading
     QFutureWatcher<void> mBatchWatcher;
+    QFutureInterface<void> mBatchInterface;
+
+    // read -> develop (decode, process, encode) -> write
+    // I/O and CPU stages have their own pools so that they overlap
+    QThreadPool mReadPool;
+    QThreadPool mDevelopPool;
+    QThreadPool mWritePool;
+
+    // bytes of all items that are currently in the pipeline
+    QMutex mMemoryMutex;
+    QWaitCondition mMemoryReleased;
+    qint64 mMemoryInFlight = 0;
+    qint64 mMemoryBudget = 0;
+    qint64 mMemoryLimit = 0; // overrides the settings' batch memory if > 0
+    QAtomicInt mNumItemsDone;
+
+    // wall time of the last run (for the report)
+    QElapsedTimer mRunTimer;
+    qint64 mRunNs = 0;
+
+    QString mJournalPath;
+
+    // this process computes items of shard mShardIndex (of mNumShards)
+    int mShardIndex = 0;
+    int mNumShards = 1;
+    QSharedPointer<DkBatchJournal> mJournal; // skips up-to-date items if set
 
     void init();
+    void readItem(int idx, QSharedPointer<DkBatchProcess> item);
+    qint64 acquireMemory(qint64 bytes);
+    void releaseMemory(qint64 bytes);
+    void itemDone(int idx, const DkBatchProcess &item);
 };
 
 class DllCoreExport DkBatchProfile
@@ -0,0 +1,325 @@
+/*******************************************************************************************************
+ DkReadAhead.cpp
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkReadAhead.h"
+
+#include "DkLog.h"
+#include "DkTelemetry.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QtConcurrentRun>
+
+#include <climits>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkReadAhead --------------------------------------------------------------------
+DkReadAhead::DkReadAhead()
+{
+    mPool.setMaxThreadCount(4);
+    mPool.setExpiryTimeout(10000);
+
+    DkTelemetry::instance().addProvider(this, [this](DkTelemetry::Stats &stats) {
+        stats.memory[DkTelemetry::mem_file_buffers] += bufferedBytes();
+    });
+}
+
+DkReadAhead::~DkReadAhead()
+{
+    clear();
+    mPool.waitForDone();
+}
+
+DkReadAhead &DkReadAhead::instance()
+{
+    static DkReadAhead inst;
+    return inst;
+}
+
+/**
+ * Reads a file of a network share.
+ * @param filePath the file
+ * @return QSharedPointer<QByteArray> the file (empty if it could not be read) or a null pointer if the file is local
+ **/
+QSharedPointer<QByteArray> DkReadAhead::read(const QString &filePath)
+{
+    QString mount = mountOf(filePath);
+
+    if (mount.isEmpty())
+        return QSharedPointer<QByteArray>();
+
+    QMutexLocker locker(&mMutex);
+
+    // the file was (or is being) read ahead
+    for (int idx = findBuffer(filePath); idx != -1; idx = findBuffer(filePath)) {
+        if (mBuffers[idx].data) {
+            QSharedPointer<QByteArray> ba = mBuffers[idx].data;
+            mBytes -= ba->size();
+            mBuffers.remove(idx);
+            DkTelemetry::instance().count(DkTelemetry::readahead_used);
+            qCDebug(lcLoader) << "[DkReadAhead]" << filePath << "was read ahead";
+            return ba;
+        }
+
+        mChanged.wait(&mMutex);
+    }
+
+    mMounts[mount].queue.removeAll(filePath);
+
+    // wait for a slot - read-aheads are not started while we wait
+    mMounts[mount].waiting++;
+    while (mMounts[mount].running >= max_reads_per_mount)
+        mChanged.wait(&mMutex);
+    mMounts[mount].waiting--;
+    mMounts[mount].running++;
+
+    locker.unlock();
+    QSharedPointer<QByteArray> ba = readFile(filePath);
+    locker.relock();
+
+    mMounts[mount].running--;
+    mChanged.wakeAll();
+    readAhead(mount);
+
+    return ba;
+}
+
+/**
+ * Reads the files ahead of time.
+ * The files are read in the given order - it replaces the files that
+ * were queued for the same shares. Local files are ignored.
+ * @param filePaths the next files in browse order
+ **/
+void DkReadAhead::prefetch(const QStringList &filePaths)
+{
+    QHash<QString, QStringList> queues;
+
+    for (const QString &fp : filePaths) {
+        QString mount = mountOf(fp);
+
+        if (!mount.isEmpty())
+            queues[mount] << fp;
+    }
+
+    if (queues.isEmpty())
+        return;
+
+    QMutexLocker locker(&mMutex);
+
+    for (auto it = queues.constBegin(); it != queues.constEnd(); it++) {
+        QStringList queue;
+
+        for (const QString &fp : it.value()) {
+            if (findBuffer(fp) == -1)
+                queue << fp;
+        }
+
+        mMounts[it.key()].queue = queue;
+        readAhead(it.key());
+    }
+}
+
+/**
+ * Drops all queued read-aheads and completed buffers.
+ * Running reads are finished.
+ **/
+void DkReadAhead::clear()
+{
+    QMutexLocker locker(&mMutex);
+
+    for (Mount &m : mMounts)
+        m.queue.clear();
+
+    for (int idx = mBuffers.size() - 1; idx >= 0; idx--) {
+        if (mBuffers[idx].data) {
+            mBytes -= mBuffers[idx].data->size();
+            mBuffers.remove(idx);
+        }
+    }
+}
+
+qint64 DkReadAhead::bufferedBytes() const
+{
+    QMutexLocker locker(&mMutex);
+    return mBytes;
+}
+
+/**
+ * Returns the mount point of a file on a network share.
+ * The result is cached per directory since looking up the file system
+ * is slow on network shares.
+ * @return QString the mount point or an empty string if the file is local
+ **/
+QString DkReadAhead::mountOf(const QString &filePath)
+{
+    QString dir = QFileInfo(filePath).absolutePath();
+
+    QMutexLocker locker(&mMountMutex);
+    auto it = mMountOfDir.constFind(dir);
+
+    if (it != mMountOfDir.constEnd())
+        return it.value();
+
+    locker.unlock();
+
+    QString mount;
+    if (DkUtils::isNetworkPath(dir)) {
+        QStorageInfo si(dir);
+        mount = si.isValid() && !si.rootPath().isEmpty() ? si.rootPath() : dir;
+    }
+
+    locker.relock();
+    mMountOfDir.insert(dir, mount);
+
+    return mount;
+}
+
+/**
+ * Starts the next read-ahead of a share.
+ * Only one file is read ahead at a time and only if no read waits.
+ * The mutex must be locked.
+ **/
+void DkReadAhead::readAhead(const QString &mount)
+{
+    Mount &m = mMounts[mount];
+
+    trim();
+
+    if (m.readingAhead || m.queue.isEmpty() || m.waiting > 0 || m.running >= max_reads_per_mount || mBytes >= max_buffered_bytes)
+        return;
+
+    QString filePath = m.queue.takeFirst();
+
+    m.readingAhead = true;
+    m.running++;
+
+    Buffer b;
+    b.filePath = filePath;
+    b.age.start();
+    mBuffers << b;
+
+    QtConcurrent::run(&mPool, [this, mount, filePath]() {
+        readAheadFinished(mount, filePath, readFile(filePath));
+    });
+}
+
+void DkReadAhead::readAheadFinished(const QString &mount, const QString &filePath, QSharedPointer<QByteArray> data)
+{
+    QMutexLocker locker(&mMutex);
+
+    int idx = findBuffer(filePath);
+
+    if (idx != -1 && data->isEmpty())
+        mBuffers.remove(idx);
+    else if (idx != -1) {
+        mBuffers[idx].data = data;
+        mBuffers[idx].age.restart();
+        mBytes += data->size();
+    }
+
+    Mount &m = mMounts[mount];
+    m.readingAhead = false;
+    m.running--;
+
+    mChanged.wakeAll();
+    readAhead(mount);
+}
+
+/**
+ * Drops buffers that are too old or exceed the budget (oldest first).
+ * The mutex must be locked.
+ **/
+void DkReadAhead::trim()
+{
+    for (int idx = 0; idx < mBuffers.size();) {
+        const Buffer &b = mBuffers[idx];
+
+        if (b.data && (mBytes > max_buffered_bytes || b.age.elapsed() > max_age_ms)) {
+            mBytes -= b.data->size();
+            mBuffers.remove(idx);
+            DkTelemetry::instance().count(DkTelemetry::readahead_wasted);
+            continue;
+        }
+
+        idx++;
+    }
+}
+
+int DkReadAhead::findBuffer(const QString &filePath) const
+{
+    for (int idx = 0; idx < mBuffers.size(); idx++) {
+        if (mBuffers[idx].filePath == filePath)
+            return idx;
+    }
+
+    return -1;
+}
+
+/**
+ * Reads the whole file with large sequential requests.
+ * The network clients split them into pipelined reads.
+ **/
+QSharedPointer<QByteArray> DkReadAhead::readFile(const QString &filePath)
+{
+    QSharedPointer<QByteArray> ba(new QByteArray());
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return ba;
+
+    qint64 size = file.size();
+
+    if (size <= 0 || size > INT_MAX) {
+        *ba = file.readAll();
+        return ba;
+    }
+
+    ba->resize((int)size);
+    qint64 pos = 0;
+
+    while (pos < size) {
+        qint64 n = file.read(ba->data() + pos, qMin<qint64>(chunk_size, size - pos));
+
+        if (n <= 0)
+            break;
+
+        pos += n;
+    }
+
+    ba->resize((int)pos);
+
+    return ba;
+}
+
+}
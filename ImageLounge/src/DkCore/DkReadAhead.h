@@ -0,0 +1,122 @@
+/*******************************************************************************************************
+ DkReadAhead.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Orders the file reads of network shares.
+ * Image loads, thumbnails and batch readers all read through read() -
+ * at most max_reads_per_mount files are read from one share at a time
+ * (in the order they were requested), each with large sequential requests.
+ * prefetch() reads the next files in browse order ahead of time
+ * (one at a time per share and only if no other read waits). read()
+ * then takes the completed buffer - or waits for the running read-ahead
+ * instead of reading the file twice. Local files are not handled.
+ **/
+class DllCoreExport DkReadAhead
+{
+public:
+    enum {
+        max_reads_per_mount = 2,
+        num_files = 4, // files that are read ahead of the cache window
+        max_buffered_bytes = 128 << 20,
+        max_age_ms = 30000, // older buffers are dropped (the file might have changed)
+        chunk_size = 8 << 20,
+    };
+
+    static DkReadAhead &instance();
+
+    QSharedPointer<QByteArray> read(const QString &filePath);
+    void prefetch(const QStringList &filePaths);
+    void clear();
+
+    qint64 bufferedBytes() const;
+    QString mountOf(const QString &filePath);
+
+private:
+    DkReadAhead();
+    DkReadAhead(const DkReadAhead &) = delete;
+    ~DkReadAhead();
+
+    struct Mount {
+        int running = 0; // reads in progress
+        int waiting = 0; // reads that wait for a slot
+        bool readingAhead = false;
+        QStringList queue; // browse order
+    };
+
+    struct Buffer {
+        QString filePath;
+        QSharedPointer<QByteArray> data; // null while it is read
+        QElapsedTimer age;
+    };
+
+    void readAhead(const QString &mount);
+    void readAheadFinished(const QString &mount, const QString &filePath, QSharedPointer<QByteArray> data);
+    void trim();
+    int findBuffer(const QString &filePath) const;
+
+    static QSharedPointer<QByteArray> readFile(const QString &filePath);
+
+    mutable QMutex mMutex;
+    QWaitCondition mChanged;
+    QHash<QString, Mount> mMounts;
+    QVector<Buffer> mBuffers; // oldest first
+    qint64 mBytes = 0;
+
+    QMutex mMountMutex;
+    QHash<QString, QString> mMountOfDir; // empty if the directory is local
+
+    QThreadPool mPool; // own threads - demand reads block the I/O lane while they wait for a slot
+};
+
+}
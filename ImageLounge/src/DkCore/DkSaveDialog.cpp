@@ -29,7 +29,9 @@
 #include "DkBaseViewPort.h"
 #include "DkBasicLoader.h"
 #include "DkBasicWidgets.h"
+#include "DkImageStorage.h"
 #include "DkSettings.h"
+#include "DkTimer.h"
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
@@ -41,6 +43,7 @@
 #include <QDialogButtonBox>
 #include <QGroupBox>
 #include <QLabel>
+#include <QPainter>
 #include <QPushButton>
 #include <QRadioButton>
 #include <QSettings>
@@ -117,11 +120,17 @@ DkCompressDialog::DkCompressDialog(QWidget *parent, Qt::WindowFlags flags)
     createLayout();
     init();
 
+    connect(&mPreviewWatcher, SIGNAL(finished()), this, SLOT(previewComputed()));
+
     resize(DkUtils::getInitialDialogSize());
 }
 
 DkCompressDialog::~DkCompressDialog()
 {
+    // the preview task does not refer to us - so we do not need to wait
+    mPreviewToken.cancel();
+    mPreviewWatcher.blockSignals(true);
+
     // save settings
     saveSettings();
 }
@@ -321,117 +330,220 @@ void DkCompressDialog::drawPreview()
     if (mImg.isNull() || !isVisible())
         return;
 
-    QImage origImg = mOrigView->getCurrentImageRegion();
-    mNewImg = QImage(origImg.size(), QImage::Format_ARGB32);
+    // encoders can't be interrupted - so we start over once the current preview is done
+    if (mPreviewWatcher.isRunning()) {
+        mPreviewDirty = true;
+        mPreviewToken.cancel(); // skips the size estimate
+        return;
+    }
+
+    mPreviewDirty = false;
+    mPreviewToken = DkCancelToken();
+
+    PreviewRequest request = previewRequest();
+    DkCancelToken token = mPreviewToken;
+
+    mPreviewWatcher.setFuture(DkScheduler::instance().run(
+        DkScheduler::lane_cpu,
+        DkScheduler::priority_interactive,
+        [request, token]() {
+            return computePreview(request, token);
+        },
+        token));
+}
+
+void DkCompressDialog::previewComputed()
+{
+    // the settings changed meanwhile
+    if (mPreviewDirty || mPreviewWatcher.isCanceled()) {
+        drawPreview();
+        return;
+    }
+
+    Preview preview = mPreviewWatcher.result();
+
+    if (!preview.estimateKey.isEmpty()) {
+        mEstimateKey = preview.estimateKey;
+        mEstimatedSize = preview.fileSize;
+    }
+
+    updateFileSizeLabel(mEstimatedSize);
+
+    // previewLabel->setScaledContents(true);
+    QImage img = preview.img.scaled(mPreviewLabel->size(), Qt::KeepAspectRatio, Qt::FastTransformation);
+    mPreviewLabel->setPixmap(QPixmap::fromImage(img));
+}
+
+/**
+ * Collects the current settings for the preview task.
+ * @return DkCompressDialog::PreviewRequest the request
+ **/
+DkCompressDialog::PreviewRequest DkCompressDialog::previewRequest()
+{
+    PreviewRequest r;
+    r.region = mOrigView->getCurrentImageRegion();
+    r.img = mImg;
 
     if ((mDialogMode == jpg_dialog || mDialogMode == j2k_dialog) && mHasAlpha)
-        mNewImg.fill(mBgCol.rgb());
+        r.fillCol = mBgCol.rgb();
     else if ((mDialogMode == jpg_dialog || mDialogMode == web_dialog) && !mHasAlpha)
-        mNewImg.fill(palette().color(QPalette::Window).rgb());
+        r.fillCol = palette().color(QPalette::Window).rgb();
     else
-        mNewImg.fill(QColor(0, 0, 0, 0).rgba());
+        r.fillCol = QColor(0, 0, 0, 0);
+
+    r.compression = getCompression();
+
+    if (mDialogMode == jpg_dialog)
+        r.format = "JPG";
+    else if (mDialogMode == j2k_dialog)
+        r.format = "J2K";
+    else if (mDialogMode == webp_dialog && r.compression != -1)
+        r.format = "WEBP";
+    else if (mDialogMode == avif_dialog)
+        r.format = "AVIF";
+    else if (mDialogMode == jxl_dialog)
+        r.format = "JXL";
+    else if (mDialogMode == web_dialog) {
+        r.format = mHasAlpha ? "PNG" : "JPG";
+        r.compression = mHasAlpha ? -1 : r.compression;
+        r.factor = getResizeFactor();
+    }
 
-    QPainter bgPainter(&mNewImg);
-    bgPainter.drawImage(origImg.rect(), origImg, origImg.rect());
-    bgPainter.end();
+    QString key = QString("%1|%2|%3|%4|%5").arg(mImg.cacheKey()).arg(QString(r.format)).arg(r.compression).arg(r.fillCol.rgba()).arg(r.factor);
 
-    if (mDialogMode == jpg_dialog) {
-        // pre-compute the jpg compression
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::ReadWrite);
-        mNewImg.save(&buffer, "JPG", getCompression());
-        mNewImg.loadFromData(ba, "JPG");
-        updateFileSizeLabel((float)ba.size(), origImg.size());
-    } else if (mDialogMode == j2k_dialog) {
-        // pre-compute the jpg compression
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::ReadWrite);
-        mNewImg.save(&buffer, "J2K", getCompression());
-        mNewImg.loadFromData(ba, "J2K");
-        updateFileSizeLabel((float)ba.size(), origImg.size());
-        qDebug() << "using j2k...";
-    } else if (mDialogMode == webp_dialog && getCompression() != -1) {
-        // pre-compute the jpg compression
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::ReadWrite);
-        mNewImg.save(&buffer, "WEBP", getCompression());
-        mNewImg.loadFromData(ba, "WEBP");
-        updateFileSizeLabel((float)ba.size(), origImg.size());
-        qDebug() << "using webp...";
-    } else if (mDialogMode == avif_dialog) {
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::WriteOnly);
-        mNewImg.save(&buffer, "AVIF", getCompression());
-        buffer.close();
-        mNewImg.loadFromData(ba, "AVIF");
-        updateFileSizeLabel((float)ba.size(), origImg.size());
-        qDebug() << "using avif...";
-    } else if (mDialogMode == jxl_dialog) {
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::WriteOnly);
-        mNewImg.save(&buffer, "JXL", getCompression());
-        buffer.close();
-        mNewImg.loadFromData(ba, "JXL");
-        updateFileSizeLabel((float)ba.size(), origImg.size());
-        qDebug() << "using jxl...";
-    } else if (mDialogMode == web_dialog) {
-        float factor = getResizeFactor();
-        if (factor != -1)
-            mNewImg = DkImage::resizeImage(mNewImg, QSize(), factor, DkImage::ipl_area);
-
-        if (!mHasAlpha) {
-            // pre-compute the jpg compression
-            QByteArray ba;
-            QBuffer buffer(&ba);
-            buffer.open(QIODevice::ReadWrite);
-            mNewImg.save(&buffer, "JPG", getCompression());
-            mNewImg.loadFromData(ba, "JPG");
-            updateFileSizeLabel((float)ba.size(), origImg.size(), factor);
-        } else {
-            // pre-compute the png compression
-            QByteArray ba;
-            QBuffer buffer(&ba);
-            buffer.open(QIODevice::ReadWrite);
-            mNewImg.save(&buffer, "PNG");
-            mNewImg.loadFromData(ba, "PNG");
-            updateFileSizeLabel((float)ba.size(), origImg.size(), factor);
-        }
-    } else
-        updateFileSizeLabel();
+    if (key != mEstimateKey)
+        r.estimateKey = key;
 
-    // previewLabel->setScaledContents(true);
-    QImage img = mNewImg.scaled(mPreviewLabel->size(), Qt::KeepAspectRatio, Qt::FastTransformation);
-    mPreviewLabel->setPixmap(QPixmap::fromImage(img));
+    return r;
 }
 
-void DkCompressDialog::updateFileSizeLabel(float bufferSize, QSize bufferImgSize, float factor)
+/**
+ * Encodes the visible region and decodes it again (so the user sees the artifacts).
+ * If requested, the file size of the full image is estimated too.
+ * This function is thread-safe.
+ * @param request the settings
+ * @param token skips the estimate if canceled
+ * @return DkCompressDialog::Preview the preview
+ **/
+DkCompressDialog::Preview DkCompressDialog::computePreview(const PreviewRequest &request, const DkCancelToken &token)
 {
-    if (bufferImgSize.isEmpty())
-        bufferImgSize = mNewImg.size();
+    DkTimer dt;
+    Preview p;
+    p.img = compose(request.region, request.fillCol);
 
-    if (mImg.isNull() || bufferSize == -1 || bufferImgSize.isNull()) {
-        mPreviewSizeLabel->setText(tr("File Size: --"));
-        mPreviewSizeLabel->setEnabled(false);
-        return;
+    if (request.factor != -1)
+        p.img = DkImage::resizeImage(p.img, QSize(), request.factor, DkImage::ipl_area);
+
+    if (!request.format.isEmpty()) {
+        QByteArray ba = encode(p.img, request.format, request.compression);
+        p.img.loadFromData(ba, request.format.constData());
     }
-    mPreviewSizeLabel->setEnabled(true);
 
-    if (factor == -1.0f)
-        factor = 1.0f;
+    if (!request.estimateKey.isEmpty() && !token.isCanceled()) {
+        p.fileSize = estimateFileSize(request, token);
+        p.estimateKey = request.estimateKey;
+    }
+
+    qInfo() << "[Compress Dialog]" << request.format << "preview computed in" << dt;
+
+    return p;
+}
+
+/**
+ * Predicts the file size of the full image.
+ * A few tiles are encoded to fit: size = overhead + bytesPerPixel * pixels
+ * where the overhead (headers) is measured with a tiny image. Hence, the
+ * estimate does not depend on the visible region and costs about the
+ * same for all image sizes.
+ * @param request the settings
+ * @param token the estimate is stopped if canceled
+ * @return float the file size in bytes or -1 if it cannot be estimated
+ **/
+float DkCompressDialog::estimateFileSize(const PreviewRequest &request, const DkCancelToken &token)
+{
+    if (request.format.isEmpty() || request.img.isNull())
+        return -1.0f;
+
+    float factor = request.factor > 0 ? request.factor : 1.0f;
+    auto scaled = [&](const QImage &img) {
+        return factor != 1.0f ? DkImage::resizeImage(img, QSize(), factor, DkImage::ipl_area) : img;
+    };
+
+    QSize size = (QSizeF(request.img.size()) * factor).toSize();
+    int tileSize = qRound(estimate_tile_size / factor); // in the original image
+
+    // small images are just encoded
+    if ((qint64)size.width() * size.height() <= 5LL * estimate_tile_size * estimate_tile_size)
+        return (float)encode(compose(scaled(request.img), request.fillCol), request.format, request.compression).size();
+
+    QImage tiny(8, 8, QImage::Format_ARGB32);
+    tiny.fill(request.fillCol.rgba());
+    qint64 overhead = encode(tiny, request.format, request.compression).size();
+
+    // tiles at the center and at the centers of the quadrants
+    QVector<QPointF> centers;
+    centers << QPointF(0.5, 0.5) << QPointF(0.25, 0.25) << QPointF(0.75, 0.25) << QPointF(0.25, 0.75) << QPointF(0.75, 0.75);
+
+    qint64 bytes = 0;
+    qint64 pixels = 0;
 
-    float depth = (mDialogMode == jpg_dialog || mDialogMode == j2k_dialog || (mDialogMode == web_dialog && mHasAlpha))
-        ? 24.0f
-        : (float)mImg.depth(); // jpg uses always 24 bit
+    for (const QPointF &c : centers) {
+        if (token.isCanceled())
+            return -1.0f;
 
-    float rawBufferSize = bufferImgSize.width() * bufferImgSize.height() * depth / 8.0f;
-    float rawImgSize = factor * (mImg.width() * mImg.height() * depth / 8.0f);
+        QRect r(0, 0, tileSize, tileSize);
+        r.moveCenter(QPoint(qRound(c.x() * request.img.width()), qRound(c.y() * request.img.height())));
+        r = r.intersected(request.img.rect());
 
-    mPreviewSizeLabel->setText(tr("File Size: ~%1").arg(DkUtils::readableByte(rawImgSize * bufferSize / rawBufferSize)));
+        QImage tile = compose(scaled(request.img.copy(r)), request.fillCol);
+        bytes += qMax(encode(tile, request.format, request.compression).size() - overhead, 0LL);
+        pixels += (qint64)tile.width() * tile.height();
+    }
+
+    if (pixels == 0)
+        return -1.0f;
+
+    return (float)(overhead + (double)bytes / pixels * size.width() * size.height());
+}
+
+/**
+ * Draws img onto fillCol (e.g. formats without alpha).
+ * @param img the image
+ * @param fillCol the background color
+ * @return QImage an ARGB32 image
+ **/
+QImage DkCompressDialog::compose(const QImage &img, const QColor &fillCol)
+{
+    QImage cImg(img.size(), QImage::Format_ARGB32);
+    cImg.fill(fillCol.rgba());
+
+    QPainter bgPainter(&cImg);
+    bgPainter.drawImage(img.rect(), img, img.rect());
+    bgPainter.end();
+
+    return cImg;
+}
+
+QByteArray DkCompressDialog::encode(const QImage &img, const QByteArray &format, int compression)
+{
+    QByteArray ba;
+    QBuffer buffer(&ba);
+    buffer.open(QIODevice::WriteOnly);
+    img.save(&buffer, format.constData(), compression);
+    buffer.close();
+
+    return ba;
+}
+
+void DkCompressDialog::updateFileSizeLabel(float fileSize)
+{
+    if (mImg.isNull() || fileSize < 0) {
+        mPreviewSizeLabel->setText(tr("File Size: --"));
+        mPreviewSizeLabel->setEnabled(false);
+        return;
+    }
+    mPreviewSizeLabel->setEnabled(true);
+    mPreviewSizeLabel->setText(tr("File Size: ~%1").arg(DkUtils::readableByte(fileSize)));
 }
 
 void DkCompressDialog::imageHasAlpha(bool hasAlpha)
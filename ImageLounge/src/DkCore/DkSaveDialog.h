@@ -29,8 +29,12 @@
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QDialog>
+#include <QFutureWatcher>
+#include <QImage>
 #pragma warning(pop) // no warnings from includes - end
 
+#include "DkScheduler.h"
+
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
 #define DllCoreExport Q_DECL_EXPORT
@@ -108,7 +112,8 @@ protected slots:
     void losslessCompression(bool lossless);
     void changeSizeWeb(int);
     void drawPreview();
-    void updateFileSizeLabel(float bufferSize = -1, QSize bufferImgSize = QSize(), float factor = -1);
+    void previewComputed();
+    void updateFileSizeLabel(float fileSize = -1);
 
 protected:
     void init();
@@ -118,6 +123,32 @@ protected:
     void loadSettings();
     void resizeEvent(QResizeEvent *ev) override;
 
+    struct PreviewRequest {
+        QImage region; // the visible region of the original
+        QImage img; // the full image (for the size estimate)
+        QColor fillCol; // drawn below transparent pixels
+        QByteArray format; // empty if the preview is not encoded
+        int compression = -1;
+        float factor = -1.0f;
+        QString estimateKey; // the settings, empty if the file size is known already
+    };
+
+    struct Preview {
+        QImage img;
+        float fileSize = -1.0f; // predicted size of the full image
+        QString estimateKey;
+    };
+
+    enum {
+        estimate_tile_size = 256,
+    };
+
+    PreviewRequest previewRequest();
+    static Preview computePreview(const PreviewRequest &request, const DkCancelToken &token);
+    static float estimateFileSize(const PreviewRequest &request, const DkCancelToken &token);
+    static QImage compose(const QImage &img, const QColor &fillCol);
+    static QByteArray encode(const QImage &img, const QByteArray &format, int compression);
+
     enum {
         best_quality = 0,
         high_quality,
@@ -145,7 +176,15 @@ protected:
     QComboBox *mCompressionCombo = 0;
 
     QImage mImg;
-    QImage mNewImg;
+
+    // previews are computed in the background - requests that arrive meanwhile are coalesced
+    QFutureWatcher<Preview> mPreviewWatcher;
+    DkCancelToken mPreviewToken;
+    bool mPreviewDirty = false;
+
+    // the size estimate is kept as long as the settings do not change
+    QString mEstimateKey;
+    float mEstimatedSize = -1.0f;
 };
 
 }
@@ -0,0 +1,128 @@
+/*******************************************************************************************************
+ DkScheduler.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkScheduler.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QThreadPool>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkCancelToken --------------------------------------------------------------------
+DkCancelToken::DkCancelToken()
+    : mCanceled(new QAtomicInt(0))
+{
+}
+
+void DkCancelToken::cancel()
+{
+    mCanceled->storeRelaxed(1);
+}
+
+bool DkCancelToken::isCanceled() const
+{
+    return mCanceled->loadRelaxed() != 0;
+}
+
+// DkScheduler --------------------------------------------------------------------
+DkScheduler::DkScheduler()
+{
+    // a few concurrent requests keep network drives busy - more only thrash local disks
+    mPools[lane_io] = new QThreadPool();
+    mPools[lane_io]->setMaxThreadCount(4);
+
+    // decoding gets its own pool - data parallel loops (QtConcurrent) run on the global pool
+    // so they cannot starve the image the user is waiting for
+    mPools[lane_cpu] = new QThreadPool();
+    mPools[lane_cpu]->setMaxThreadCount(QThreadPool::globalInstance()->maxThreadCount());
+
+    // probes mostly wait for the OS to time out - so a few threads are enough
+    mPools[lane_probe] = new QThreadPool();
+    mPools[lane_probe]->setMaxThreadCount(2);
+}
+
+DkScheduler &DkScheduler::instance()
+{
+    static DkScheduler inst;
+    return inst;
+}
+
+QThreadPool *DkScheduler::pool(Lane lane) const
+{
+    return mPools[lane];
+}
+
+/**
+ * Applies the user's thread settings to the CPU lane and the global pool.
+ * @param numThreads the number of threads per pool
+ **/
+void DkScheduler::setNumThreads(int numThreads)
+{
+    if (numThreads <= 0)
+        return;
+
+    QThreadPool::globalInstance()->setMaxThreadCount(numThreads);
+    mPools[lane_cpu]->setMaxThreadCount(numThreads);
+}
+
+/**
+ * Queues a task.
+ * The pool takes ownership of the task if task->autoDelete() is true.
+ * @param task the task
+ * @param lane the lane (I/O, CPU or probe)
+ * @param priority the priority class
+ * @param subPriority optional priority within the class (e.g. the distance of a thumbnail to the viewport)
+ **/
+void DkScheduler::start(QRunnable *task, Lane lane, Priority priority, int subPriority)
+{
+    mPools[lane]->start(task, poolPriority(priority, subPriority));
+}
+
+/**
+ * Removes a task that has not started yet.
+ * @param task the task
+ * @param lane the task's lane
+ * @return bool true if the task was removed - the caller owns it then
+ **/
+bool DkScheduler::take(QRunnable *task, Lane lane)
+{
+    return mPools[lane]->tryTake(task);
+}
+
+/**
+ * Maps a priority class to a QThreadPool priority.
+ * Sub priorities are clamped so that they never exceed their class.
+ **/
+int DkScheduler::poolPriority(Priority priority, int subPriority)
+{
+    const int band = 1 << 16;
+    return priority * band + qBound(-band / 2 + 1, subPriority, band / 2 - 1);
+}
+
+}
@@ -0,0 +1,201 @@
+/*******************************************************************************************************
+ DkScheduler.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QRunnable>
+#include <QSharedPointer>
+
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+// Qt defines
+class QThreadPool;
+
+namespace nmc
+{
+
+/**
+ * Cooperative cancellation of scheduled tasks.
+ * Copies share their state - so the submitter keeps a copy and
+ * cancels it while the task checks it.
+ * A task that is canceled before it starts is not run at all.
+ **/
+class DllCoreExport DkCancelToken
+{
+public:
+    DkCancelToken();
+
+    void cancel();
+    bool isCanceled() const;
+
+private:
+    QSharedPointer<QAtomicInt> mCanceled;
+};
+
+template <typename T>
+void dkReportCall(QFutureInterface<T> &fi, const std::function<T()> &fnc)
+{
+    fi.reportResult(fnc());
+}
+
+inline void dkReportCall(QFutureInterface<void> &, const std::function<void()> &fnc)
+{
+    fnc();
+}
+
+/**
+ * A task of the DkScheduler.
+ * Like DkThumbTask, it reports canceled if it is taken from
+ * its pool (or its token is canceled) before it runs.
+ **/
+template <typename T>
+class DkScheduledTask : public QRunnable
+{
+public:
+    DkScheduledTask(const std::function<T()> &fnc, const DkCancelToken &token)
+    {
+        mFnc = fnc;
+        mToken = token;
+        mFutureInterface.reportStarted();
+    }
+
+    ~DkScheduledTask()
+    {
+        if (!mDone) {
+            mFutureInterface.reportCanceled();
+            mFutureInterface.reportFinished();
+        }
+    }
+
+    QFuture<T> future()
+    {
+        return mFutureInterface.future();
+    }
+
+    void run() override
+    {
+        // the destructor reports canceled
+        if (mToken.isCanceled() || mFutureInterface.isCanceled())
+            return;
+
+        dkReportCall(mFutureInterface, mFnc);
+
+        mDone = true;
+        mFutureInterface.reportFinished();
+    }
+
+private:
+    QFutureInterface<T> mFutureInterface;
+    std::function<T()> mFnc;
+    DkCancelToken mToken;
+    bool mDone = false;
+};
+
+/**
+ * The thread pools of nomacs.
+ * Tasks are queued in one of three lanes: the I/O lane for tasks that
+ * mostly wait for the disk (reading buffers, writing files), the
+ * CPU lane for decoding and image processing and the probe lane for
+ * checks that might hang (e.g. stat'ing files of disconnected shares).
+ * Within a lane, tasks of higher priority classes are started first:
+ * the image the user is looking at starts before prefetched images,
+ * which start before thumbnails and batch processing.
+ * Idle threads of a lane always take the next task of its shared queue.
+ **/
+class DllCoreExport DkScheduler
+{
+public:
+    enum Lane {
+        lane_io = 0,
+        lane_cpu,
+        lane_probe, // hung probes must not block the I/O lane
+
+        lane_end
+    };
+
+    enum Priority {
+        priority_batch = 0,
+        priority_thumbnail,
+        priority_prefetch,
+        priority_interactive,
+
+        priority_end
+    };
+
+    static DkScheduler &instance();
+
+    QThreadPool *pool(Lane lane) const;
+    void setNumThreads(int numThreads);
+
+    /**
+     * Runs fnc in the given lane.
+     * @param lane the lane (I/O, CPU or probe)
+     * @param priority the priority class of the task
+     * @param fnc the task
+     * @param token cancels the task if it has not started yet
+     * @return QFuture the task's future (canceled if the task was dropped)
+     **/
+    template <typename F>
+    auto run(Lane lane, Priority priority, F fnc, const DkCancelToken &token = DkCancelToken()) -> QFuture<decltype(fnc())>
+    {
+        typedef decltype(fnc()) T;
+
+        DkScheduledTask<T> *task = new DkScheduledTask<T>(std::function<T()>(fnc), token);
+        QFuture<T> future = task->future();
+        start(task, lane, priority);
+
+        return future;
+    }
+
+    void start(QRunnable *task, Lane lane, Priority priority, int subPriority = 0);
+    bool take(QRunnable *task, Lane lane);
+
+    static int poolPriority(Priority priority, int subPriority = 0);
+
+private:
+    DkScheduler();
+    DkScheduler(const DkScheduler &) = delete;
+
+    QThreadPool *mPools[lane_end];
+};
+
+}
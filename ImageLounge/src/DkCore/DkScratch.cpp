@@ -0,0 +1,431 @@
+/*******************************************************************************************************
+ DkScratch.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkScratch.h"
+
+#include "DkTelemetry.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDebug>
+#include <QDir>
+#include <QSet>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QTemporaryFile>
+
+#include <climits>
+#include <new>
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+#include <fcntl.h>
+#endif
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+/**
+ * The free blocks of one thread.
+ * It is created on the first lease of its thread (thread_local)
+ * and frees its blocks when the thread exits.
+ **/
+class DkScratchArena
+{
+public:
+    DkScratchArena();
+    ~DkScratchArena();
+
+    static DkScratchArena *local();
+
+    uchar *lease(int sizeClass);
+    void release(uchar *data, int sizeClass);
+    void trim();
+
+private:
+    enum {
+        num_size_classes = 48,
+    };
+
+    QMutex mMutex; // trim() may be called from other threads
+    QVector<uchar *> mFree[num_size_classes];
+    qint64 mCachedBytes = 0;
+};
+
+DkScratchArena::DkScratchArena()
+{
+    DkScratchPool::instance().addArena(this);
+}
+
+DkScratchArena::~DkScratchArena()
+{
+    trim();
+    DkScratchPool::instance().removeArena(this);
+}
+
+DkScratchArena *DkScratchArena::local()
+{
+    static thread_local DkScratchArena arena;
+    return &arena;
+}
+
+uchar *DkScratchArena::lease(int sizeClass)
+{
+    qint64 size = (qint64)1 << sizeClass;
+    DkScratchPool &pool = DkScratchPool::instance();
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (!mFree[sizeClass].empty()) {
+            mCachedBytes -= size;
+            pool.mCachedBytes.fetchAndAddRelaxed(-size);
+            pool.mLeasedBytes.fetchAndAddRelaxed(size);
+            DkTelemetry::instance().count(DkTelemetry::scratch_reused);
+
+            return mFree[sizeClass].takeLast();
+        }
+    }
+
+    uchar *data = new (std::nothrow) uchar[(size_t)size];
+
+    if (data) {
+        pool.mLeasedBytes.fetchAndAddRelaxed(size);
+        DkTelemetry::instance().count(DkTelemetry::scratch_allocated);
+    }
+
+    return data;
+}
+
+void DkScratchArena::release(uchar *data, int sizeClass)
+{
+    qint64 size = (qint64)1 << sizeClass;
+    DkScratchPool &pool = DkScratchPool::instance();
+    pool.mLeasedBytes.fetchAndAddRelaxed(-size);
+
+    QMutexLocker locker(&mMutex);
+
+    // keep the arena bounded - huge images are rare
+    if (mCachedBytes + size > DkScratchPool::max_cached_bytes) {
+        delete[] data;
+        return;
+    }
+
+    mFree[sizeClass] << data;
+    mCachedBytes += size;
+    pool.mCachedBytes.fetchAndAddRelaxed(size);
+}
+
+void DkScratchArena::trim()
+{
+    QMutexLocker locker(&mMutex);
+
+    for (QVector<uchar *> &blocks : mFree) {
+        for (uchar *data : blocks)
+            delete[] data;
+        blocks.clear();
+    }
+
+    DkScratchPool::instance().mCachedBytes.fetchAndAddRelaxed(-mCachedBytes);
+    mCachedBytes = 0;
+}
+
+// DkScratch --------------------------------------------------------------------
+DkScratch::DkScratch()
+{
+    mArena = DkScratchArena::local();
+}
+
+DkScratch::~DkScratch()
+{
+    for (const QPair<uchar *, int> &b : mBlocks)
+        mArena->release(b.first, b.second);
+}
+
+/**
+ * Leases a buffer of at least bytes from the thread's arena.
+ * @param bytes the size in bytes
+ * @return void* the buffer (uninitialized) or NULL if it could not be allocated
+ **/
+void *DkScratch::alloc(size_t bytes)
+{
+    int sizeClass = DkScratchPool::min_size_class;
+
+    while (((size_t)1 << sizeClass) < bytes)
+        sizeClass++;
+
+    uchar *data = mArena->lease(sizeClass);
+
+    if (data)
+        mBlocks << qMakePair(data, sizeClass);
+    else
+        qWarning() << "[DkScratch] could not allocate" << bytes << "bytes";
+
+    return data;
+}
+
+/**
+ * Returns an (uninitialized) image on leased memory.
+ * @param size the image size
+ * @param format the image format
+ * @return QImage an image that is valid as long as this scratch lives
+ **/
+QImage DkScratch::image(const QSize &size, QImage::Format format)
+{
+    // 32 bit aligned lines like QImage's own
+    int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    int bpl = ((size.width() * depth + 31) / 32) * 4;
+    uchar *data = static_cast<uchar *>(alloc((size_t)bpl * size.height()));
+
+    if (!data)
+        return QImage();
+
+    return QImage(data, size.width(), size.height(), bpl, format);
+}
+
+#ifdef WITH_OPENCV
+/**
+ * Returns an (uninitialized) Mat on leased memory.
+ * @return cv::Mat a Mat that is valid as long as this scratch lives
+ **/
+cv::Mat DkScratch::mat(int rows, int cols, int type)
+{
+    void *data = alloc((size_t)rows * cols * CV_ELEM_SIZE(type));
+
+    if (!data)
+        return cv::Mat();
+
+    return cv::Mat(rows, cols, type, data);
+}
+#endif
+
+// DkScratchPool --------------------------------------------------------------------
+DkScratchPool::DkScratchPool()
+{
+    DkTelemetry::instance().addProvider(this, [this](DkTelemetry::Stats &stats) {
+        stats.memory[DkTelemetry::mem_scratch] += cachedBytes() + leasedBytes();
+    });
+}
+
+DkScratchPool &DkScratchPool::instance()
+{
+    static DkScratchPool inst;
+    return inst;
+}
+
+/**
+ * Frees the cached blocks of all threads.
+ * Leased blocks are not touched.
+ **/
+void DkScratchPool::trim()
+{
+    QMutexLocker locker(&mMutex);
+
+    for (DkScratchArena *a : mArenas)
+        a->trim();
+}
+
+qint64 DkScratchPool::cachedBytes() const
+{
+    return mCachedBytes.loadRelaxed();
+}
+
+qint64 DkScratchPool::leasedBytes() const
+{
+    return mLeasedBytes.loadRelaxed();
+}
+
+void DkScratchPool::addArena(DkScratchArena *arena)
+{
+    QMutexLocker locker(&mMutex);
+    mArenas << arena;
+}
+
+void DkScratchPool::removeArena(DkScratchArena *arena)
+{
+    QMutexLocker locker(&mMutex);
+    mArenas.removeAll(arena);
+}
+
+// DkMappedImage --------------------------------------------------------------------
+namespace
+{
+
+struct DkMappedBlock {
+    QTemporaryFile *file = 0;
+    uchar *data = 0;
+    qint64 bytes = 0;
+};
+
+QMutex &mappedMutex()
+{
+    static QMutex m;
+    return m;
+}
+
+// the base pointers of all mapped images
+QSet<const uchar *> &mappedData()
+{
+    static QSet<const uchar *> d;
+    return d;
+}
+
+QAtomicInteger<qint64> mappedTotal;
+
+/**
+ * The directory of the pixel files.
+ * It is on the disk - the temp directory is often a RAM disk (tmpfs).
+ **/
+QString mappedDir()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/nomacs/pixels";
+    QDir().mkpath(dir);
+
+    return dir;
+}
+
+/**
+ * Allocates the disk blocks of the file.
+ * Writing to a sparse file's mapping crashes (SIGBUS) if the disk gets full
+ * - so we rather fail now.
+ **/
+bool preallocate(QFile *file, qint64 bytes)
+{
+#if defined(Q_OS_LINUX)
+    return posix_fallocate(file->handle(), 0, (off_t)bytes) == 0 && file->resize(bytes);
+#elif defined(Q_OS_MAC)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)bytes, 0};
+    return fcntl(file->handle(), F_PREALLOCATE, &store) != -1 && file->resize(bytes);
+#else
+    // NTFS files are not sparse unless they are marked as such - resizing allocates the blocks
+    return file->resize(bytes);
+#endif
+}
+
+}
+
+/**
+ * Allocates an (uninitialized) image on a memory-mapped temporary file.
+ * @param size the image size
+ * @param format the image format
+ * @return QImage the image or a null image if the file could not be mapped (e.g. the disk is full)
+ **/
+QImage DkMappedImage::allocate(const QSize &size, QImage::Format format)
+{
+    if (size.isEmpty() || format == QImage::Format_Invalid)
+        return QImage();
+
+    int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    qint64 bpl = (((qint64)size.width() * depth + 31) >> 5) << 2; // 32 bit aligned like QImage
+    qint64 bytes = bpl * size.height();
+
+    if (bpl > INT_MAX)
+        return QImage();
+
+    QString dir = mappedDir();
+    QTemporaryFile *file = new QTemporaryFile(dir + "/nomacs-XXXXXX.pixels");
+    uchar *data = 0;
+
+    if (QStorageInfo(dir).bytesAvailable() > bytes && file->open() && preallocate(file, bytes))
+        data = file->map(0, bytes);
+
+    if (!data) {
+        qWarning() << "[DkMappedImage] could not map" << bytes / (1024 * 1024) << "MB in" << dir;
+        delete file;
+        return QImage();
+    }
+
+    DkMappedBlock *block = new DkMappedBlock();
+    block->file = file;
+    block->data = data;
+    block->bytes = bytes;
+
+    {
+        QMutexLocker locker(&mappedMutex());
+        mappedData().insert(data);
+    }
+    mappedTotal.fetchAndAddRelaxed(bytes);
+
+    qInfo() << "[DkMappedImage]" << size << "mapped to" << file->fileName();
+
+    return QImage(data, size.width(), size.height(), (int)bpl, format, &DkMappedImage::cleanup, block);
+}
+
+/**
+ * Returns true if an image of this size should not be allocated on the heap.
+ * That is the case if it needs more than 512 MB and more than a quarter of the RAM.
+ **/
+bool DkMappedImage::shouldMap(const QSize &size, QImage::Format format)
+{
+    if (size.isEmpty() || format == QImage::Format_Invalid)
+        return false;
+
+    qint64 bytes = (qint64)size.width() * size.height() * QImage::toPixelFormat(format).bitsPerPixel() / 8;
+    double totalMB = DkMemory::getTotalMemory();
+
+    qint64 limit = qMax((qint64)512 << 20, totalMB > 0 ? (qint64)(totalMB / 4.0 * 1024 * 1024) : 0);
+
+    return bytes > limit;
+}
+
+/**
+ * Returns true if the pixels of img are memory-mapped.
+ **/
+bool DkMappedImage::isMapped(const QImage &img)
+{
+    if (img.isNull())
+        return false;
+
+    QMutexLocker locker(&mappedMutex());
+    return mappedData().contains(img.constBits());
+}
+
+/**
+ * Returns the size of all mapped images in bytes.
+ **/
+qint64 DkMappedImage::mappedBytes()
+{
+    return mappedTotal.loadRelaxed();
+}
+
+void DkMappedImage::cleanup(void *info)
+{
+    DkMappedBlock *block = static_cast<DkMappedBlock *>(info);
+
+    {
+        QMutexLocker locker(&mappedMutex());
+        mappedData().remove(block->data);
+    }
+    mappedTotal.fetchAndSubRelaxed(block->bytes);
+
+    // removes the file
+    block->file->unmap(block->data);
+    delete block->file;
+    delete block;
+}
+
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************************************
+ DkScratch.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInteger>
+#include <QImage>
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+
+// opencv
+#ifdef WITH_OPENCV
+#include "opencv2/core/core.hpp"
+#endif
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+class DkScratchArena;
+
+/**
+ * Scratch memory of pixel kernels.
+ * Buffers are leased from the calling thread's arena and
+ * returned to it when the DkScratch goes out of scope. Hence,
+ * repeated calls (batch runs, slider previews) reuse their
+ * temporaries instead of faulting in fresh pages.
+ * Leased memory must not escape the scope - copy the results.
+ **/
+class DllCoreExport DkScratch
+{
+public:
+    DkScratch();
+    ~DkScratch();
+
+    void *alloc(size_t bytes);
+
+    template <typename T>
+    T *alloc(size_t count)
+    {
+        return static_cast<T *>(alloc(count * sizeof(T)));
+    }
+
+    QImage image(const QSize &size, QImage::Format format);
+
+#ifdef WITH_OPENCV
+    cv::Mat mat(int rows, int cols, int type);
+#endif
+
+private:
+    DkScratch(const DkScratch &) = delete;
+    DkScratch &operator=(const DkScratch &) = delete;
+
+    DkScratchArena *mArena = 0;
+    QVector<QPair<uchar *, int>> mBlocks; // data & size class
+};
+
+/**
+ * Book keeping of all scratch arenas.
+ * An arena caches up to max_cached_bytes of free blocks
+ * in power of two size classes - it is freed when its thread exits.
+ **/
+class DllCoreExport DkScratchPool
+{
+public:
+    enum {
+        min_size_class = 16, // 64 KB
+        max_cached_bytes = 128 << 20, // per thread
+    };
+
+    static DkScratchPool &instance();
+
+    void trim();
+
+    qint64 cachedBytes() const;
+    qint64 leasedBytes() const;
+
+private:
+    DkScratchPool();
+    DkScratchPool(const DkScratchPool &) = delete;
+
+    friend class DkScratchArena;
+
+    void addArena(DkScratchArena *arena);
+    void removeArena(DkScratchArena *arena);
+
+    QMutex mMutex;
+    QVector<DkScratchArena *> mArenas;
+
+    QAtomicInteger<qint64> mCachedBytes;
+    QAtomicInteger<qint64> mLeasedBytes;
+};
+
+/**
+ * Pixel memory of images that are larger than the RAM can hold.
+ * The pixels live in a memory-mapped temporary file - the OS pages
+ * them in and out instead of swapping the whole process. The
+ * file is unmapped and removed together with the last image copy.
+ * The file is allocated on the disk up front, so allocate() fails if the disk
+ * is full (instead of writes to the mapping). The mapping is writable: an image
+ * is modified in place unless it is shared - then modifying it detaches a copy
+ * to the heap.
+ **/
+class DllCoreExport DkMappedImage
+{
+public:
+    static QImage allocate(const QSize &size, QImage::Format format);
+    static bool shouldMap(const QSize &size, QImage::Format format);
+    static bool isMapped(const QImage &img);
+    static qint64 mappedBytes();
+
+private:
+    static void cleanup(void *info);
+};
+
+}
@@ -26,6 +26,7 @@
  *******************************************************************************************************/
 
 #include "DkSettings.h"
+#include "DkScheduler.h"
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
@@ -45,7 +46,9 @@
 #include <QStandardPaths>
 #include <QStyledItemDelegate>
 #include <QTableView>
+#include <QThread>
 #include <QThreadPool>
+#include <QTimer>
 #include <QTranslator>
 
 #ifdef Q_OS_WIN
@@ -366,6 +369,7 @@ void DkSettings::load(QSettings &settings, bool defaults)
     app_p.hideAllPanels = settings.value("hideAllPanels", app_p.hideAllPanels).toBool();
     app_p.closeOnEsc = settings.value("closeOnEsc", app_p.closeOnEsc).toBool();
     app_p.closeOnMiddleMouse = settings.value("closeOnMiddleMouse", app_p.closeOnMiddleMouse).toBool();
+    app_p.singleInstance = settings.value("singleInstance", app_p.singleInstance).toBool();
     app_p.showRecentFiles = settings.value("showRecentFiles", app_p.showRecentFiles).toBool();
     app_p.useLogFile = settings.value("useLogFile", app_p.useLogFile).toBool();
     app_p.defaultJpgQuality = settings.value("defaultJpgQuality", app_p.defaultJpgQuality).toInt();
@@ -433,8 +437,12 @@ void DkSettings::load(QSettings &settings, bool defaults)
     // display_p.saveThumb = settings.value("saveThumb", display_p.saveThumb).toBool();
     display_p.antiAliasing = settings.value("antiAliasing", display_p.antiAliasing).toBool();
     display_p.highQualityAntiAliasing = settings.value("highQualityAntiAliasing", display_p.highQualityAntiAliasing).toBool();
+    display_p.colorManagement = settings.value("colorManagement", display_p.colorManagement).toBool();
+    display_p.displayProfile = settings.value("displayProfile", display_p.displayProfile).toString();
+    display_p.useOpenGL = settings.value("useOpenGL", display_p.useOpenGL).toBool();
     display_p.showCrop = settings.value("showCrop", display_p.showCrop).toBool();
     display_p.histogramStyle = settings.value("histogramStyle", display_p.histogramStyle).toInt();
+    display_p.histogramSampling = settings.value("histogramSampling", display_p.histogramSampling).toBool();
     display_p.tpPattern = settings.value("tpPattern", display_p.tpPattern).toBool();
     display_p.showNavigation = settings.value("showNavigation", display_p.showNavigation).toBool();
     display_p.themeName = settings.value("themeName312", display_p.themeName).toString();
@@ -482,6 +490,7 @@ void DkSettings::load(QSettings &settings, bool defaults)
     sync_p.syncAbsoluteTransform = settings.value("syncAbsoluteTransform", sync_p.syncAbsoluteTransform).toBool();
     sync_p.switchModifier = settings.value("switchModifier", sync_p.switchModifier).toBool();
     sync_p.syncActions = settings.value("syncActions", sync_p.syncActions).toBool();
+    sync_p.shareDecodedImages = settings.value("shareDecodedImages", sync_p.shareDecodedImages).toBool();
 
     settings.endGroup();
     // Resource Settings --------------------------------------------------------------------
@@ -493,11 +502,16 @@ void DkSettings::load(QSettings &settings, bool defaults)
     resources_p.maxImagesCached = settings.value("maxImagesCached", resources_p.maxImagesCached).toInt();
     resources_p.waitForLastImg = settings.value("waitForLastImg", resources_p.waitForLastImg).toBool();
     resources_p.filterRawImages = settings.value("filterRawImages", resources_p.filterRawImages).toBool();
+    resources_p.rawHighBitDepth = settings.value("rawHighBitDepth", resources_p.rawHighBitDepth).toBool();
+    resources_p.parallelEncoding = settings.value("parallelEncoding", resources_p.parallelEncoding).toBool();
     resources_p.loadRawThumb = settings.value("loadRawThumb", resources_p.loadRawThumb).toInt();
     resources_p.filterDuplicats = settings.value("filterDuplicates", resources_p.filterDuplicats).toBool();
     resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();
     resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
     resources_p.loadSavedImage = settings.value("loadSavedImage", resources_p.loadSavedImage).toInt();
+    resources_p.thumbCache = settings.value("thumbCache", resources_p.thumbCache).toBool();
+    resources_p.thumbCacheSize = settings.value("thumbCacheSize", resources_p.thumbCacheSize).toInt();
+    resources_p.batchMemory = settings.value("batchMemory", resources_p.batchMemory).toFloat();
 
     if (sync_p.switchModifier) {
         global_p.altMod = Qt::ControlModifier;
@@ -510,7 +524,7 @@ void DkSettings::load(QSettings &settings, bool defaults)
     settings.endGroup();
 
     if (global_p.numThreads != -1)
-        QThreadPool::globalInstance()->setMaxThreadCount(global_p.numThreads);
+        DkScheduler::instance().setNumThreads(global_p.numThreads);
     else
         global_p.numThreads = QThreadPool::globalInstance()->maxThreadCount();
 
@@ -583,6 +597,8 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("closeOnEsc", app_p.closeOnEsc);
     if (force || app_p.closeOnMiddleMouse != app_d.closeOnMiddleMouse)
         settings.setValue("closeOnMiddleMouse", app_p.closeOnMiddleMouse);
+    if (force || app_p.singleInstance != app_d.singleInstance)
+        settings.setValue("singleInstance", app_p.singleInstance);
     if (force || app_p.showRecentFiles != app_d.showRecentFiles)
         settings.setValue("showRecentFiles", app_p.showRecentFiles);
     if (force || app_p.useLogFile != app_d.useLogFile)
@@ -682,10 +698,18 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("antiAliasing", display_p.antiAliasing);
     if (force || display_p.highQualityAntiAliasing != display_d.highQualityAntiAliasing)
         settings.setValue("highQualityAntiAliasing", display_p.highQualityAntiAliasing);
+    if (force || display_p.colorManagement != display_d.colorManagement)
+        settings.setValue("colorManagement", display_p.colorManagement);
+    if (force || display_p.displayProfile != display_d.displayProfile)
+        settings.setValue("displayProfile", display_p.displayProfile);
+    if (force || display_p.useOpenGL != display_d.useOpenGL)
+        settings.setValue("useOpenGL", display_p.useOpenGL);
     if (force || display_p.showCrop != display_d.showCrop)
         settings.setValue("showCrop", display_p.showCrop);
     if (force || display_p.histogramStyle != display_d.histogramStyle)
         settings.setValue("histogramStyle", display_p.histogramStyle);
+    if (force || display_p.histogramSampling != display_d.histogramSampling)
+        settings.setValue("histogramSampling", display_p.histogramSampling);
     if (force || display_p.tpPattern != display_d.tpPattern)
         settings.setValue("tpPattern", display_p.tpPattern);
     if (force || display_p.showNavigation != display_d.showNavigation)
@@ -759,6 +783,8 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("switchModifier", sync_p.switchModifier);
     if (force || sync_p.syncActions != sync_d.syncActions)
         settings.setValue("syncActions", sync_p.syncActions);
+    if (force || sync_p.shareDecodedImages != sync_d.shareDecodedImages)
+        settings.setValue("shareDecodedImages", sync_p.shareDecodedImages);
 
     settings.endGroup();
     // Resource Settings --------------------------------------------------------------------
@@ -776,6 +802,10 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("waitForLastImg", resources_p.waitForLastImg);
     if (force || resources_p.filterRawImages != resources_d.filterRawImages)
         settings.setValue("filterRawImages", resources_p.filterRawImages);
+    if (force || resources_p.rawHighBitDepth != resources_d.rawHighBitDepth)
+        settings.setValue("rawHighBitDepth", resources_p.rawHighBitDepth);
+    if (force || resources_p.parallelEncoding != resources_d.parallelEncoding)
+        settings.setValue("parallelEncoding", resources_p.parallelEncoding);
     if (force || resources_p.loadRawThumb != resources_d.loadRawThumb)
         settings.setValue("loadRawThumb", resources_p.loadRawThumb);
     if (force || resources_p.filterDuplicats != resources_d.filterDuplicats)
@@ -786,6 +816,12 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("gammaCorrection", resources_p.gammaCorrection);
     if (force || resources_p.loadSavedImage != resources_d.loadSavedImage)
         settings.setValue("loadSavedImage", resources_p.loadSavedImage);
+    if (force || resources_p.thumbCache != resources_d.thumbCache)
+        settings.setValue("thumbCache", resources_p.thumbCache);
+    if (force || resources_p.thumbCacheSize != resources_d.thumbCacheSize)
+        settings.setValue("thumbCacheSize", resources_p.thumbCacheSize);
+    if (force || resources_p.batchMemory != resources_d.batchMemory)
+        settings.setValue("batchMemory", resources_p.batchMemory);
 
     settings.endGroup();
 
@@ -822,6 +858,7 @@ void DkSettings::setToDefaultSettings()
     app_p.advancedSettings = false;
     app_p.closeOnEsc = false;
     app_p.closeOnMiddleMouse = false;
+    app_p.singleInstance = false;
     app_p.hideAllPanels = false;
     app_p.showRecentFiles = true;
     app_p.browseFilters = QStringList();
@@ -886,8 +923,12 @@ void DkSettings::setToDefaultSettings()
     display_p.thumbPreviewSize = 64;
     display_p.antiAliasing = true;
     display_p.highQualityAntiAliasing = false;
+    display_p.colorManagement = true;
+    display_p.displayProfile = "";
+    display_p.useOpenGL = false;
     display_p.showCrop = false;
     display_p.histogramStyle = 0; // DkHistogram::DisplayMode::histogram_mode_simple
+    display_p.histogramSampling = false;
     display_p.tpPattern = false;
     display_p.showNavigation = true;
     display_p.themeName = "Light-Theme.css";
@@ -919,18 +960,24 @@ void DkSettings::setToDefaultSettings()
     sync_p.lastUpdateCheck = QDate(2018, 7, 14); // ; )
     sync_p.syncAbsoluteTransform = true;
     sync_p.syncActions = false;
+    sync_p.shareDecodedImages = false;
 
     resources_p.cacheMemory = 256;
     resources_p.historyMemory = 128;
     resources_p.nativeDialog = true;
     resources_p.maxImagesCached = 5;
     resources_p.filterRawImages = true;
+    resources_p.rawHighBitDepth = false;
+    resources_p.parallelEncoding = true;
     resources_p.loadRawThumb = raw_thumb_always;
     resources_p.filterDuplicats = false;
     resources_p.preferredExtension = "*.jpg";
     resources_p.gammaCorrection = true;
     resources_p.loadSavedImage = ls_load_to_tab;
     resources_p.waitForLastImg = true;
+    resources_p.thumbCache = false;
+    resources_p.thumbCacheSize = 256;
+    resources_p.batchMemory = 2048;
 
     qDebug() << "ok... default settings are set";
 }
@@ -975,7 +1022,7 @@ void DkSettings::setNumThreads(int numThreads)
 {
     if (numThreads != global_p.numThreads) {
         global_p.numThreads = numThreads;
-        QThreadPool::globalInstance()->setMaxThreadCount(numThreads);
+        DkScheduler::instance().setNumThreads(numThreads);
     }
 }
 
@@ -1035,9 +1082,54 @@ DkSettings::Resources &DkSettings::resources()
     return resources_p;
 }
 
+const DkSettings::App &DkSettings::app() const
+{
+    return app_p;
+}
+
+const DkSettings::Global &DkSettings::global() const
+{
+    return global_p;
+}
+
+const DkSettings::Display &DkSettings::display() const
+{
+    return display_p;
+}
+
+const DkSettings::SlideShow &DkSettings::slideShow() const
+{
+    return slideShow_p;
+}
+
+const DkSettings::Sync &DkSettings::sync() const
+{
+    return sync_p;
+}
+
+const DkSettings::MetaData &DkSettings::metaData() const
+{
+    return meta_p;
+}
+
+const DkSettings::Resources &DkSettings::resources() const
+{
+    return resources_p;
+}
+
+/**
+ * Returns the version of a snapshot.
+ * It is incremented whenever DkSettingsManager publishes a new snapshot.
+ **/
+quint64 DkSettings::version() const
+{
+    return mVersion;
+}
+
 DkSettingsManager::DkSettingsManager()
 {
     mParams = new DkSettings();
+    publish();
 }
 
 DkSettingsManager &DkSettingsManager::instance()
@@ -1059,11 +1151,83 @@ DkSettings &DkSettingsManager::param()
     return instance().settings();
 }
 
+/**
+ * Returns the settings for changing them.
+ * Reading them with param() does not publish a new snapshot - so
+ * settings that workers read must be changed through edit().
+ * @return DkSettings& the settings of the GUI thread
+ **/
+DkSettings &DkSettingsManager::edit()
+{
+    DkSettingsManager &m = instance();
+
+    if (isGuiThread())
+        m.invalidate();
+
+    return m.settings();
+}
+
 DkSettings &DkSettingsManager::settings()
 {
     return *mParams;
 }
 
+/**
+ * Returns the current settings snapshot.
+ * Workers should capture it once per task and read all settings from it,
+ * the snapshot does not change while they are using it.
+ * If the GUI thread calls it, changes it made before are published first.
+ * @return DkSettingsSnapshot the latest published settings
+ **/
+DkSettingsSnapshot DkSettingsManager::snapshot()
+{
+    DkSettingsManager &m = instance();
+
+    if (m.mDirty.loadRelaxed() && isGuiThread())
+        m.publish();
+
+    return std::atomic_load(&m.mSnapshot);
+}
+
+/**
+ * Copies the current settings to a new snapshot.
+ * This must only be called by the GUI thread (it is the only one that changes the settings).
+ **/
+void DkSettingsManager::publish()
+{
+    // clear first - changes made while copying dirty it again
+    mDirty.storeRelaxed(0);
+
+    DkSettings *s = new DkSettings(*mParams);
+    s->mVersion = ++mVersion;
+
+    std::atomic_store(&mSnapshot, DkSettingsSnapshot(s));
+}
+
+bool DkSettingsManager::isGuiThread()
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    return !app || QThread::currentThread() == app->thread();
+}
+
+/**
+ * Marks the settings as changed.
+ * The snapshot is published with the next event loop iteration
+ * (or with the next snapshot() call of the GUI thread).
+ **/
+void DkSettingsManager::invalidate()
+{
+    if (!mDirty.testAndSetRelaxed(0, 1))
+        return;
+
+    if (QCoreApplication *app = QCoreApplication::instance()) {
+        QTimer::singleShot(0, app, []() {
+            if (DkSettingsManager::instance().mDirty.loadRelaxed())
+                DkSettingsManager::instance().publish();
+        });
+    }
+}
+
 void DkSettingsManager::init()
 {
     // init settings
@@ -1075,6 +1239,9 @@ void DkSettingsManager::init()
     int mode = settings.value("AppSettings/appMode", param().app().appMode).toInt();
     param().app().currentAppMode = mode;
 
+    // workers must not see the settings before they are loaded
+    publish();
+
     // init debug
     DkUtils::initializeDebug();
 
@@ -1089,7 +1256,7 @@ void DkSettingsManager::init()
 void DkSettingsManager::importSettings(const QString &settingsPath)
 {
     QSettings settings(settingsPath, QSettings::IniFormat);
-    param().load(settings);
+    edit().load(settings);
     param().save(true);
 
     qInfo() << "settings imported...";
@@ -1401,7 +1568,7 @@ QString DkThemeManager::themeDir() const
 
 void DkThemeManager::setCurrentTheme(const QString &themeName) const
 {
-    DkSettingsManager::param().display().themeName = themeName;
+    DkSettingsManager::edit().display().themeName = themeName;
 }
 
 QString DkThemeManager::loadTheme(const QString &themeName) const
@@ -1446,7 +1613,7 @@ void DkThemeManager::applyTheme() const
     // add theme
     QString cssString = loadTheme(getCurrentThemeName());
 
-    DkSettings::Display &dp = DkSettingsManager::param().display();
+    DkSettings::Display &dp = DkSettingsManager::edit().display();
 
     // NOTE: it is important, that default.css does not contain
     // any line of code except for the color definitions
@@ -1525,11 +1692,11 @@ QString DkThemeManager::parseColors(const QString &styleSheet) const
             QString cc = kv[1].simplified();
 
             if (kv[0] == "HIGHLIGHT_COLOR" && cc != "default")
-                DkSettingsManager::param().display().highlightColor.setNamedColor(cc);
+                DkSettingsManager::edit().display().highlightColor.setNamedColor(cc);
             else if (kv[0] == "HUD_BACKGROUND_COLOR" && cc != "default")
-                DkSettingsManager::param().display().hudBgColor.setNamedColor(cc);
+                DkSettingsManager::edit().display().hudBgColor.setNamedColor(cc);
             else if (kv[0] == "HUD_FOREGROUND_COLOR" && cc != "default")
-                DkSettingsManager::param().display().hudFgdColor.setNamedColor(cc);
+                DkSettingsManager::edit().display().hudFgdColor.setNamedColor(cc);
             else if (kv[0] == "BACKGROUND_COLOR") {
                 QColor c;
                 c.setNamedColor(cc);
@@ -1538,13 +1705,13 @@ QString DkThemeManager::parseColors(const QString &styleSheet) const
                     c = QPalette().color(QPalette::Window);
 
                 if (DkSettingsManager::param().display().defaultBackgroundColor)
-                    DkSettingsManager::param().display().bgColor = c;
-                DkSettingsManager::param().display().themeBgdColor = c;
+                    DkSettingsManager::edit().display().bgColor = c;
+                DkSettingsManager::edit().display().themeBgdColor = c;
             } else if (kv[0] == "FOREGROUND_COLOR" && cc != "default")
-                DkSettingsManager::param().display().themeFgdColor.setNamedColor(cc);
+                DkSettingsManager::edit().display().themeFgdColor.setNamedColor(cc);
             else if (kv[0] == "ICON_COLOR" && cc != "default") {
                 if (DkSettingsManager::param().display().defaultIconColor)
-                    DkSettingsManager::param().display().iconColor.setNamedColor(cc);
+                    DkSettingsManager::edit().display().iconColor.setNamedColor(cc);
             } else if (cc != "default")
                 qWarning() << "could not parse color:" << str;
         }
@@ -28,12 +28,15 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
 #include <QBitArray>
 #include <QColor>
 #include <QDate>
 #include <QSettings>
 #include <QSharedPointer>
 #include <QVector>
+
+#include <memory>
 #pragma warning(pop) // no warnings from includes - end
 
 #pragma warning(disable : 4251) // TODO: remove
@@ -125,6 +128,8 @@ public:
         sort_date_created,
         sort_date_modified,
         sort_random,
+        sort_date_taken,
+        sort_rating,
         sort_end,
     };
 
@@ -139,6 +144,7 @@ public:
         raw_thumb_always,
         raw_thumb_if_large,
         raw_thumb_never,
+        raw_thumb_refine,
 
         raw_thumb_end,
     };
@@ -194,6 +200,7 @@ public:
         bool advancedSettings;
         bool closeOnEsc;
         bool closeOnMiddleMouse;
+        bool singleInstance; // files are handed over to the running nomacs
         bool hideAllPanels;
 
         int defaultJpgQuality;
@@ -237,6 +244,9 @@ public:
         bool showCrop;
         bool antiAliasing;
         bool highQualityAntiAliasing;
+        bool colorManagement;
+        QString displayProfile; // ICC profile of the display (sRGB if empty)
+        bool useOpenGL;
         bool showBorder;
         bool displaySquaredThumbs;
         bool showThumbLabel;
@@ -247,6 +257,7 @@ public:
         float animationDuration;
 
         int histogramStyle;
+        bool histogramSampling;
     };
 
     struct Global {
@@ -301,6 +312,7 @@ public:
         bool syncAbsoluteTransform;
         bool switchModifier;
         bool syncActions;
+        bool shareDecodedImages; // local instances exchange decoded images (see DkSharedImages)
     };
     struct MetaData {
         bool ignoreExifOrientation;
@@ -314,11 +326,16 @@ public:
         int maxImagesCached;
         bool waitForLastImg;
         bool filterRawImages;
+        bool rawHighBitDepth; // develop RAW images with 16 bits per channel
+        bool parallelEncoding; // compress large PNGs and TIFFs with all cores
         bool filterDuplicats;
         int loadRawThumb;
         QString preferredExtension;
         bool gammaCorrection;
         int loadSavedImage;
+        bool thumbCache;
+        int thumbCacheSize;
+        float batchMemory;
     };
 
     enum DisplayItems {
@@ -359,7 +376,19 @@ public:
     MetaData &metaData();
     Resources &resources();
 
+    const App &app() const;
+    const Global &global() const;
+    const Display &display() const;
+    const SlideShow &slideShow() const;
+    const Sync &sync() const;
+    const MetaData &metaData() const;
+    const Resources &resources() const;
+
+    quint64 version() const;
+
 protected:
+    friend class DkSettingsManager;
+
     QStringList scamDataDesc;
     QStringList sdescriptionDesc;
 
@@ -386,8 +415,17 @@ protected:
     QString getDefaultSettingsFile() const;
 
     QString mSettingsPath;
+    quint64 mVersion = 0;
 };
 
+/**
+ * Immutable copy of the settings.
+ * Worker threads capture a snapshot once per task (or batch job)
+ * instead of reading DkSettingsManager::param() which is changed by the GUI.
+ * Changes made through DkSettingsManager::edit() are published in a new snapshot.
+ **/
+typedef std::shared_ptr<const DkSettings> DkSettingsSnapshot;
+
 class DllCoreExport DkSettingsManager
 {
 public:
@@ -399,17 +437,29 @@ public:
     void operator=(DkSettingsManager const &) = delete;
 
     static DkSettings &param(); // convenience
+    static DkSettings &edit(); // use it to change settings - workers get a new snapshot
     // QSettings& qSettings();
     DkSettings &settings(); // rename
     void init();
 
+    static DkSettingsSnapshot snapshot();
+    void publish();
+
     static void importSettings(const QString &settingsPath);
 
 private:
     DkSettingsManager();
 
+    static bool isGuiThread();
+    void invalidate();
+
     // QSettings* mSettings = 0;
     DkSettings *mParams = 0;
+
+    // swapped atomically (std::atomic_load/atomic_store)
+    DkSettingsSnapshot mSnapshot;
+    QAtomicInt mDirty = 0;
+    quint64 mVersion = 0;
 };
 
 class DkZoomConfig
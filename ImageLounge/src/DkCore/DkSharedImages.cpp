@@ -0,0 +1,295 @@
+/*******************************************************************************************************
+ DkSharedImages.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkSharedImages.h"
+
+#include "DkSettings.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QColorSpace>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSharedMemory>
+
+#include <climits>
+#include <cstring>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+/**
+ * Layout of a segment: the header, the ICC profile and the pixels (64 byte aligned).
+ **/
+struct DkSharedImageHeader {
+    enum {
+        magic_number = 0x6e6d6331, // nmc1
+        data_alignment = 64,
+    };
+
+    quint32 magic;
+    quint32 ready; // set once the pixels are written
+    qint32 loader;
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    qint32 format;
+    qint32 dotsPerMeterX;
+    qint32 dotsPerMeterY;
+    qint32 iccSize;
+    qint64 dataOffset;
+};
+
+// DkSharedImages --------------------------------------------------------------------
+DkSharedImages &DkSharedImages::instance()
+{
+    static DkSharedImages inst;
+    return inst;
+}
+
+bool DkSharedImages::isEnabled()
+{
+    return DkSettingsManager::snapshot()->sync().shareDecodedImages;
+}
+
+/**
+ * Copies the image to a new segment.
+ * The image returned should replace img, so that the pixels are not kept twice.
+ * @param filePath the (resolved) file path
+ * @param pageIdx the page of multi-page documents
+ * @param img the decoded image
+ * @param loader the loader that decoded the image (see DkBasicLoader::loaderID)
+ * @return QImage the image backed by the segment or img if it could not be shared
+ **/
+QImage DkSharedImages::publish(const QString &filePath, int pageIdx, const QImage &img, int loader)
+{
+    if (img.isNull())
+        return img;
+
+    QByteArray icc = img.colorSpace().iccProfile();
+    qint64 dataOffset = sizeof(DkSharedImageHeader) + icc.size();
+    dataOffset = (dataOffset + DkSharedImageHeader::data_alignment - 1) / DkSharedImageHeader::data_alignment * DkSharedImageHeader::data_alignment;
+    qint64 bytes = dataOffset + img.sizeInBytes();
+
+    if (bytes > INT_MAX)
+        return img;
+
+    QSharedMemory *segment = new QSharedMemory(key(filePath, pageIdx));
+
+    // a peer was faster (or the segment exists from a previous load)
+    if (!segment->create((int)bytes)) {
+        if (segment->error() != QSharedMemory::AlreadyExists)
+            qWarning() << "[Shared Images] could not share" << filePath << "-" << segment->errorString();
+        delete segment;
+        return img;
+    }
+
+    segment->lock();
+
+    uchar *ptr = static_cast<uchar *>(segment->data());
+    DkSharedImageHeader *header = reinterpret_cast<DkSharedImageHeader *>(ptr);
+    header->magic = DkSharedImageHeader::magic_number;
+    header->loader = loader;
+    header->width = img.width();
+    header->height = img.height();
+    header->bytesPerLine = img.bytesPerLine();
+    header->format = img.format();
+    header->dotsPerMeterX = img.dotsPerMeterX();
+    header->dotsPerMeterY = img.dotsPerMeterY();
+    header->iccSize = icc.size();
+    header->dataOffset = dataOffset;
+
+    std::memcpy(ptr + sizeof(DkSharedImageHeader), icc.constData(), icc.size());
+    std::memcpy(ptr + dataOffset, img.constBits(), (size_t)img.sizeInBytes());
+    header->ready = 1;
+
+    segment->unlock();
+
+    // const - writing to the image must not change the pixels of our peers
+    QImage sharedImg(static_cast<const uchar *>(ptr + dataOffset), img.width(), img.height(), img.bytesPerLine(), img.format(), &DkSharedImages::release, segment);
+    sharedImg.setColorSpace(img.colorSpace());
+    sharedImg.setDotsPerMeterX(img.dotsPerMeterX());
+    sharedImg.setDotsPerMeterY(img.dotsPerMeterY());
+
+    qInfo() << "[Shared Images]" << filePath << "shared";
+
+    return sharedImg;
+}
+
+/**
+ * Attaches to the image of filePath if a local instance published it.
+ * @param filePath the (resolved) file path
+ * @param pageIdx the page of multi-page documents
+ * @param loader if not NULL, set to the loader that decoded the image
+ * @return QImage the (read-only) image or a NULL image if it is not shared
+ **/
+QImage DkSharedImages::attach(const QString &filePath, int pageIdx, int *loader)
+{
+    QSharedMemory *segment = new QSharedMemory(key(filePath, pageIdx));
+
+    if (!segment->attach(QSharedMemory::ReadOnly)) {
+        delete segment;
+        return QImage();
+    }
+
+    segment->lock();
+    DkSharedImageHeader header = *static_cast<const DkSharedImageHeader *>(segment->constData());
+    segment->unlock();
+
+    qint64 bytes = header.dataOffset + (qint64)header.bytesPerLine * header.height;
+
+    // the publisher is still writing (or the segment is not ours)
+    if (segment->size() < (int)sizeof(DkSharedImageHeader) || header.magic != DkSharedImageHeader::magic_number || !header.ready
+        || bytes > segment->size()) {
+        delete segment;
+        return QImage();
+    }
+
+    const uchar *ptr = static_cast<const uchar *>(segment->constData());
+
+    QImage img(ptr + header.dataOffset,
+               header.width,
+               header.height,
+               header.bytesPerLine,
+               (QImage::Format)header.format,
+               &DkSharedImages::release,
+               segment);
+    img.setDotsPerMeterX(header.dotsPerMeterX);
+    img.setDotsPerMeterY(header.dotsPerMeterY);
+
+    if (header.iccSize > 0)
+        img.setColorSpace(QColorSpace::fromIccProfile(QByteArray((const char *)ptr + sizeof(DkSharedImageHeader), header.iccSize)));
+
+    if (loader)
+        *loader = header.loader;
+
+    qInfo() << "[Shared Images]" << filePath << "attached";
+
+    return img;
+}
+
+/**
+ * The key is unique for the file's content - modified files are never attached.
+ * @param filePath the (resolved) file path
+ * @param pageIdx the page of multi-page documents
+ * @return QString the segment key
+ **/
+QString DkSharedImages::key(const QString &filePath, int pageIdx)
+{
+    QFileInfo fi(filePath);
+    QString id = QString("%1|%2|%3|%4").arg(fi.absoluteFilePath()).arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.size()).arg(pageIdx);
+
+    return "nomacs-image-" + QCryptographicHash::hash(id.toUtf8(), QCryptographicHash::Md5).toHex();
+}
+
+/**
+ * Cleanup function of the shared images - detaches from the segment.
+ * The system removes the segment once no instance is attached anymore.
+ * @param segment the QSharedMemory
+ **/
+void DkSharedImages::release(void *segment)
+{
+    delete static_cast<QSharedMemory *>(segment);
+}
+
+// DkImageRegistry --------------------------------------------------------------------
+DkImageRegistry &DkImageRegistry::instance()
+{
+    static DkImageRegistry inst;
+    return inst;
+}
+
+/**
+ * Registers a decoded image so that other tabs can reuse it.
+ * @param filePath the (resolved) file path
+ * @param pageIdx the page of multi-page documents
+ * @param img the decoded (unedited) image
+ * @param loader the loader that decoded the image (see DkBasicLoader::loaderID)
+ **/
+void DkImageRegistry::add(const QString &filePath, int pageIdx, const QImage &img, int loader)
+{
+    if (img.isNull())
+        return;
+
+    Entry e;
+    e.img = img;
+    e.loader = loader;
+
+    QMutexLocker lock(&mMutex);
+    mImages.insert(DkSharedImages::key(filePath, pageIdx), e);
+}
+
+/**
+ * Returns the image another tab decoded from the file.
+ * Modified files are never found since the file's modification time is part of the key.
+ * @param filePath the (resolved) file path
+ * @param pageIdx the page of multi-page documents
+ * @param loader if not NULL, it is set to the loader that decoded the image
+ * @return QImage the shared image or a null image
+ **/
+QImage DkImageRegistry::find(const QString &filePath, int pageIdx, int *loader)
+{
+    QString k = DkSharedImages::key(filePath, pageIdx);
+
+    QMutexLocker lock(&mMutex);
+    auto it = mImages.find(k);
+    if (it == mImages.end())
+        return QImage();
+
+    // nobody but us refers to the pixels anymore
+    if (it->img.isDetached()) {
+        mImages.erase(it);
+        return QImage();
+    }
+
+    if (loader)
+        *loader = it->loader;
+
+    qInfo() << "[DkImageRegistry] reusing decoded image of" << filePath;
+    return it->img;
+}
+
+/**
+ * Drops all images that are only referenced by the registry.
+ * Call this whenever images are released so that the registry does not keep them alive.
+ **/
+void DkImageRegistry::prune()
+{
+    QMutexLocker lock(&mMutex);
+
+    for (auto it = mImages.begin(); it != mImages.end();) {
+        if (it->img.isDetached())
+            it = mImages.erase(it);
+        else
+            ++it;
+    }
+}
+
+}
@@ -0,0 +1,107 @@
+/*******************************************************************************************************
+ DkSharedImages.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Exchanges decoded images between local (synchronized) instances.
+ * Decoded pixels are copied to a shared memory segment that is keyed
+ * by the file's path, modification time and page. Instances that open
+ * the same file attach to the segment instead of decoding it again.
+ * The images returned are backed by the segment (read-only, they are
+ * copied on write). A segment is released when the last image of all
+ * instances that refers to it is destroyed.
+ * The exchange is opt-in (SynchronizeSettings/shareDecodedImages).
+ **/
+class DllCoreExport DkSharedImages
+{
+public:
+    static DkSharedImages &instance();
+    static bool isEnabled();
+
+    QImage publish(const QString &filePath, int pageIdx, const QImage &img, int loader);
+    QImage attach(const QString &filePath, int pageIdx, int *loader = 0);
+
+    static QString key(const QString &filePath, int pageIdx);
+
+private:
+    DkSharedImages() = default;
+    DkSharedImages(const DkSharedImages &) = delete;
+
+    static void release(void *segment);
+};
+
+/**
+ * Process-wide registry of decoded images.
+ * Tabs (image loaders) that open the same file share its pixels
+ * instead of decoding (and keeping) it once per tab. The registry
+ * holds implicitly shared copies only: an entry is dropped as soon as
+ * no container refers to its pixels anymore (see prune()).
+ **/
+class DllCoreExport DkImageRegistry
+{
+public:
+    static DkImageRegistry &instance();
+
+    void add(const QString &filePath, int pageIdx, const QImage &img, int loader);
+    QImage find(const QString &filePath, int pageIdx, int *loader = 0);
+    void prune();
+
+private:
+    DkImageRegistry() = default;
+    DkImageRegistry(const DkImageRegistry &) = delete;
+
+    struct Entry {
+        QImage img;
+        int loader = 0;
+    };
+
+    QMutex mMutex;
+    QHash<QString, Entry> mImages;
+};
+
+}
@@ -29,9 +29,12 @@
 
 #include "DkActionManager.h"
 #include "DkSettings.h"
+#include "DkTelemetry.h"
+#include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QLabel>
+#include <QTimer>
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
@@ -60,9 +63,39 @@ void DkStatusBar::createLayout()
             addPermanentWidget(mLabels[idx]);
     }
 
+    // memory & cache telemetry - only updated while we are visible
+    mTelemetryTimer = new QTimer(this);
+    mTelemetryTimer->setInterval(2000);
+    connect(mTelemetryTimer, SIGNAL(timeout()), this, SLOT(updateTelemetry()));
+
     hide();
 }
 
+void DkStatusBar::updateTelemetry()
+{
+    DkTelemetry::Stats s = DkTelemetry::instance().stats();
+
+    QLabel *l = mLabels[status_memory_info];
+    l->setText(DkUtils::readableByte((float)s.totalMemory()));
+    l->setToolTip(DkTelemetry::instance().report());
+    l->show();
+}
+
+void DkStatusBar::showEvent(QShowEvent *event)
+{
+    updateTelemetry();
+    mTelemetryTimer->start();
+
+    QStatusBar::showEvent(event);
+}
+
+void DkStatusBar::hideEvent(QHideEvent *event)
+{
+    mTelemetryTimer->stop();
+
+    QStatusBar::hideEvent(event);
+}
+
 void DkStatusBar::setMessage(const QString &msg, StatusLabel which)
 {
     if (which < 0 || which >= mLabels.size())
@@ -95,7 +128,7 @@ void DkStatusBarManager::show(bool show, bool permanent)
         return;
 
     if (permanent)
-        DkSettingsManager::param().app().showStatusBar = show;
+        DkSettingsManager::edit().app().showStatusBar = show;
     DkActionManager::instance().action(DkActionManager::menu_panel_statusbar)->setChecked(DkSettingsManager::param().app().showStatusBar);
 
     statusbar()->setVisible(show);
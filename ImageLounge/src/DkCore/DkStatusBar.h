@@ -45,6 +45,7 @@
 
 // Qt defines
 class QLabel;
+class QTimer;
 
 namespace nmc
 {
@@ -67,14 +68,22 @@ public:
         status_filenumber_info,
         status_filesize_info,
         status_time_info,
+        status_memory_info,
 
         status_end,
     };
 
     void setMessage(const QString &msg, StatusLabel which = status_pixel_info);
 
+public slots:
+    void updateTelemetry();
+
 protected:
     void createLayout();
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+    QTimer *mTelemetryTimer = 0;
 
     QVector<QLabel *> mLabels;
 };
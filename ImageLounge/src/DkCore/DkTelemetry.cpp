@@ -0,0 +1,246 @@
+/*******************************************************************************************************
+ DkTelemetry.cpp
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkTelemetry.h"
+
+#include "DkScheduler.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QObject>
+#include <QThreadPool>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// DkTelemetry --------------------------------------------------------------------
+DkTelemetry &DkTelemetry::instance()
+{
+    static DkTelemetry inst;
+    return inst;
+}
+
+/**
+ * Registers a memory (or queue) provider.
+ * Providers are called by stats() - they must stay valid
+ * until removeProvider() is called.
+ * @param owner the object that owns the memory
+ * @param provider adds the memory of owner to the stats
+ **/
+void DkTelemetry::addProvider(const void *owner, const Provider &provider)
+{
+    QMutexLocker locker(&mMutex);
+    mProviders << qMakePair(owner, provider);
+}
+
+void DkTelemetry::removeProvider(const void *owner)
+{
+    QMutexLocker locker(&mMutex);
+
+    for (int idx = mProviders.size() - 1; idx >= 0; idx--) {
+        if (mProviders[idx].first == owner)
+            mProviders.remove(idx);
+    }
+}
+
+void DkTelemetry::count(Counter c, int inc)
+{
+    mCounters[c].fetchAndAddRelaxed(inc);
+}
+
+void DkTelemetry::addToQueue(Queue q, int inc)
+{
+    mQueues[q].fetchAndAddRelaxed(inc);
+}
+
+/**
+ * Collects the current stats.
+ * Providers are called by the calling thread - most subsystems
+ * are not thread-safe, so call this from the GUI thread.
+ * @return DkTelemetry::Stats a snapshot of all subsystems
+ **/
+DkTelemetry::Stats DkTelemetry::stats() const
+{
+    Stats s;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        for (const QPair<const void *, Provider> &p : mProviders)
+            p.second(s);
+    }
+
+    for (int idx = 0; idx < queue_end; idx++)
+        s.queues[idx] += mQueues[idx].loadRelaxed();
+
+    for (int idx = 0; idx < DkScheduler::lane_end; idx++)
+        s.queues[queue_threads] += DkScheduler::instance().pool((DkScheduler::Lane)idx)->activeThreadCount();
+
+    for (int idx = 0; idx < counter_end; idx++)
+        s.counters[idx] = mCounters[idx].loadRelaxed();
+
+    return s;
+}
+
+/**
+ * Returns a human readable (rich text) report of the current stats.
+ * @return QString a html table
+ **/
+QString DkTelemetry::report() const
+{
+    Stats s = stats();
+
+    QString r = "<table>";
+    auto row = [&r](const QString &name, const QString &val) {
+        r += "<tr><td>" + name + "</td><td align=\"right\">&nbsp;&nbsp;" + val + "</td></tr>";
+    };
+
+    for (int idx = 0; idx < mem_end; idx++)
+        row(memoryName((Memory)idx), DkUtils::readableByte((float)s.memory[idx]));
+    row("<b>" + QObject::tr("Total") + "</b>", "<b>" + DkUtils::readableByte((float)s.totalMemory()) + "</b>");
+
+    r += "<tr><td colspan=\"2\"><hr></td></tr>";
+
+    row(QObject::tr("Cache hit rate"), QString("%1 % (%2/%3)")
+        .arg(qRound(s.hitRate() * 100))
+        .arg(s.counters[cache_hit])
+        .arg(s.counters[cache_hit] + s.counters[cache_partial_hit] + s.counters[cache_miss]));
+    row(QObject::tr("Prefetch accuracy"), QString("%1 % (%2/%3)")
+        .arg(qRound(s.prefetchAccuracy() * 100))
+        .arg(s.counters[prefetch_used])
+        .arg(s.counters[prefetch_used] + s.counters[prefetch_wasted]));
+    row(QObject::tr("Scratch reuse"), QString("%1 % (%2/%3)")
+        .arg(qRound(s.scratchReuse() * 100))
+        .arg(s.counters[scratch_reused])
+        .arg(s.counters[scratch_reused] + s.counters[scratch_allocated]));
+    row(QObject::tr("Read-ahead accuracy"), QString("%1 % (%2/%3)")
+        .arg(qRound(s.readAheadAccuracy() * 100))
+        .arg(s.counters[readahead_used])
+        .arg(s.counters[readahead_used] + s.counters[readahead_wasted]));
+
+    r += "<tr><td colspan=\"2\"><hr></td></tr>";
+
+    for (int idx = 0; idx < queue_end; idx++)
+        row(queueName((Queue)idx), QString::number(s.queues[idx]));
+
+    r += "</table>";
+
+    return r;
+}
+
+QString DkTelemetry::memoryName(Memory m)
+{
+    switch (m) {
+    case mem_images:
+        return QObject::tr("Decoded images");
+    case mem_file_buffers:
+        return QObject::tr("File buffers");
+    case mem_pages:
+        return QObject::tr("Cached pages");
+    case mem_scaled_images:
+        return QObject::tr("Scaled images");
+    case mem_image_storage:
+        return QObject::tr("Viewport copies");
+    case mem_history:
+        return QObject::tr("Edit history");
+    case mem_thumbnails:
+        return QObject::tr("Thumbnails");
+    case mem_scratch:
+        return QObject::tr("Scratch buffers");
+    default:
+        return QString();
+    }
+}
+
+QString DkTelemetry::queueName(Queue q)
+{
+    switch (q) {
+    case queue_image_loads:
+        return QObject::tr("Images loading");
+    case queue_thumbnails:
+        return QObject::tr("Thumbnails queued");
+    case queue_threads:
+        return QObject::tr("Active threads");
+    default:
+        return QString();
+    }
+}
+
+// DkTelemetry::Stats --------------------------------------------------------------------
+qint64 DkTelemetry::Stats::totalMemory() const
+{
+    qint64 total = 0;
+
+    for (qint64 m : memory)
+        total += m;
+
+    return total;
+}
+
+/**
+ * Returns the share of requested images that were decoded already.
+ * @return double the hit rate [0 1]
+ **/
+double DkTelemetry::Stats::hitRate() const
+{
+    qint64 requests = counters[cache_hit] + counters[cache_partial_hit] + counters[cache_miss];
+    return requests > 0 ? (double)counters[cache_hit] / requests : 0.0;
+}
+
+/**
+ * Returns the share of prefetched images that were displayed.
+ * Images that are still cached are not counted.
+ * @return double the accuracy [0 1]
+ **/
+double DkTelemetry::Stats::prefetchAccuracy() const
+{
+    qint64 done = counters[prefetch_used] + counters[prefetch_wasted];
+    return done > 0 ? (double)counters[prefetch_used] / done : 0.0;
+}
+
+/**
+ * Returns the share of scratch buffers that did not need an allocation.
+ * @return double the reuse rate [0 1]
+ **/
+double DkTelemetry::Stats::scratchReuse() const
+{
+    qint64 leases = counters[scratch_reused] + counters[scratch_allocated];
+    return leases > 0 ? (double)counters[scratch_reused] / leases : 0.0;
+}
+
+/**
+ * Returns the share of read-ahead files that were requested.
+ * @return double the accuracy [0 1]
+ **/
+double DkTelemetry::Stats::readAheadAccuracy() const
+{
+    qint64 done = counters[readahead_used] + counters[readahead_wasted];
+    return done > 0 ? (double)counters[readahead_used] / done : 0.0;
+}
+
+}
@@ -0,0 +1,139 @@
+/*******************************************************************************************************
+ DkTelemetry.h
+ Created on:	14.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * Memory, cache and queue statistics of nomacs.
+ * Subsystems that own memory register a provider which adds
+ * their usage to a Stats snapshot. Events (e.g. cache hits)
+ * are counted lock-free.
+ **/
+class DllCoreExport DkTelemetry
+{
+public:
+    enum Memory {
+        mem_images = 0, // decoded images
+        mem_file_buffers,
+        mem_pages, // cached pages of multi-page documents
+        mem_scaled_images, // scaled copies of the containers
+        mem_image_storage, // scaled copies, pyramids & tiles of the viewports
+        mem_history, // edit history
+        mem_thumbnails,
+        mem_scratch, // scratch buffers of the pixel kernels
+
+        mem_end
+    };
+
+    enum Queue {
+        queue_image_loads = 0, // images that are currently loaded
+        queue_thumbnails, // thumbnails queued or computed
+        queue_threads, // active threads of the scheduler
+
+        queue_end
+    };
+
+    enum Counter {
+        cache_hit = 0, // the image was decoded when it was requested
+        cache_partial_hit, // the image was loading or its file was fetched
+        cache_miss,
+        prefetch_issued,
+        prefetch_used, // prefetched images that were displayed
+        prefetch_wasted, // prefetched images that were released without being displayed
+        scratch_reused, // scratch buffers that were leased from an arena
+        scratch_allocated, // scratch buffers that had to be allocated
+        readahead_used, // files of network shares that were read ahead and then requested
+        readahead_wasted, // files that were read ahead but dropped
+
+        counter_end
+    };
+
+    class DllCoreExport Stats
+    {
+    public:
+        qint64 memory[mem_end] = {};
+        int queues[queue_end] = {};
+        qint64 counters[counter_end] = {};
+
+        qint64 totalMemory() const;
+        double hitRate() const;
+        double prefetchAccuracy() const;
+        double scratchReuse() const;
+        double readAheadAccuracy() const;
+    };
+
+    typedef std::function<void(Stats &)> Provider;
+
+    static DkTelemetry &instance();
+
+    void addProvider(const void *owner, const Provider &provider);
+    void removeProvider(const void *owner);
+
+    void count(Counter c, int inc = 1);
+    void addToQueue(Queue q, int inc);
+
+    Stats stats() const;
+    QString report() const;
+
+    static QString memoryName(Memory m);
+    static QString queueName(Queue q);
+
+private:
+    DkTelemetry() = default;
+    DkTelemetry(const DkTelemetry &) = delete;
+
+    mutable QMutex mMutex;
+    QVector<QPair<const void *, Provider>> mProviders;
+
+    QAtomicInteger<qint64> mCounters[counter_end];
+    QAtomicInt mQueues[queue_end];
+};
+
+}
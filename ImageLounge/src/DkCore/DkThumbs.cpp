@@ -27,21 +27,29 @@
 
 #include "DkThumbs.h"
 #include "DkBasicLoader.h"
+#include "DkCodecs.h"
 #include "DkImageStorage.h"
 #include "DkMetaData.h"
+#include "DkReadAhead.h"
+#include "DkScheduler.h"
 #include "DkSettings.h"
+#include "DkTelemetry.h"
 #include "DkTimer.h"
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDirIterator>
 #include <QFileInfo>
 #include <QImageReader>
+#include <QImageWriter>
 #include <QMutex>
+#include <QSet>
+#include <QStandardPaths>
 #include <QStringList>
-#include <QThreadPool>
 #include <QTimer>
-#include <QtConcurrentRun>
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
@@ -58,6 +66,7 @@ DkThumbNail::DkThumbNail(const QString &filePath, const QImage &img)
     mFile = filePath;
     mMaxThumbSize = qRound(max_thumb_size * DkSettingsManager::param().dpiScaleFactor());
     mImgExists = true;
+    mImgLevel = mImg.isNull() ? 0 : mMaxThumbSize;
 }
 
 DkThumbNail::~DkThumbNail()
@@ -74,6 +83,66 @@ void DkThumbNail::compute(int forceLoad)
     // if we use member vars in the thread and the object gets deleted during thread execution we crash...
     mImg = computeIntern(mFile, QSharedPointer<QByteArray>(), forceLoad, mMaxThumbSize);
     mImg = DkImage::createThumb(mImg);
+    mImgLevel = mMaxThumbSize;
+}
+
+/**
+ * Returns the thumbnail sizes that are decoded together.
+ * Thumbnails that are decoded from the full image are cached in
+ * all levels - so zooming thumbnail views does not decode again.
+ * @return QVector<int> the levels (smallest first)
+ **/
+QVector<int> DkThumbNail::mipLevels()
+{
+    int maxSize = qRound(max_thumb_size * DkSettingsManager::param().dpiScaleFactor());
+
+    return QVector<int>() << maxSize / 4 << maxSize / 2 << maxSize;
+}
+
+/**
+ * Returns the smallest mip level that covers size.
+ * @param size the side length (in device pixels) a thumbnail is drawn with
+ * @return int the level's thumbnail size
+ **/
+int DkThumbNail::mipLevel(int size)
+{
+    QVector<int> levels = mipLevels();
+
+    for (int l : levels) {
+        if (l >= size)
+            return l;
+    }
+
+    return levels.last();
+}
+
+/**
+ * Downscales a thumbnail so that it fits into maxThumbSize.
+ * @param thumb the thumbnail
+ * @param maxThumbSize the maximal side length
+ * @return QImage the scaled thumbnail
+ **/
+QImage DkThumbNail::scaleThumb(const QImage &thumb, int maxThumbSize)
+{
+    int w = thumb.width();
+    int h = thumb.height();
+
+    if (w > maxThumbSize || h > maxThumbSize) {
+        if (w > h) {
+            h = qRound((double)maxThumbSize / w * h);
+            w = maxThumbSize;
+        } else if (w < h) {
+            w = qRound((double)maxThumbSize / h * w);
+            h = maxThumbSize;
+        } else {
+            w = maxThumbSize;
+            h = maxThumbSize;
+        }
+    }
+
+    // scale
+    QImage sThumb = thumb.scaled(QSize(w * 2, h * 2), Qt::KeepAspectRatio, Qt::FastTransformation);
+    return sThumb.scaled(QSize(w, h), Qt::KeepAspectRatio, Qt::SmoothTransformation);
 }
 
 /**
@@ -90,114 +159,152 @@ void DkThumbNail::compute(int forceLoad)
  **/
 QImage DkThumbNail::computeIntern(const QString &filePath, const QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize)
 {
-    DkTimer dt;
+    DkTraceSpan dt("thumbnail", "DkThumbNail::computeIntern", filePath);
     // qDebug() << "[thumb] file: " << filePath;
 
+    // thumbnails that were decoded before are persistently cached
+    bool useCache = (forceLoad == do_not_force || forceLoad == force_exif_thumb) && DkThumbCache::instance().isEnabled();
+
+    if (useCache) {
+        QImage cThumb = DkThumbCache::instance().find(filePath, maxThumbSize);
+
+        if (!cThumb.isNull())
+            return cThumb;
+    }
+
     // see if we can read the thumbnail from the exif data
     QImage thumb;
-    DkMetaDataT metaData;
+    QSharedPointer<DkMetaDataT> metaData(new DkMetaDataT());
 
-    QSharedPointer<QByteArray> baZip = QSharedPointer<QByteArray>();
+    QFileInfo fInfo(filePath);
+    QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
+    fInfo = QFileInfo(lFilePath);
+
+    QSharedPointer<QByteArray> baFile = ba;
 #ifdef WITH_QUAZIP
     if (QFileInfo(mFile).dir().path().contains(DkZipContainer::zipMarker()))
-        baZip = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
+        baFile = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
+
+    // we will decode the full image anyway - so read the file once for both, Exiv2 and the decoder
+    if ((!baFile || baFile->isEmpty()) && (forceLoad == force_full_thumb || forceLoad == force_save_thumb)) {
+        baFile = DkReadAhead::instance().read(lFilePath);
+
+        QFile file(lFilePath);
+        if (!baFile && file.open(QIODevice::ReadOnly))
+            baFile = QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+    }
+
     try {
         // [DIEM] READ  build crashed here 09.06.2016
-        if (baZip && !baZip->isEmpty())
-            metaData.readMetaData(filePath, baZip);
-        else if (!ba || ba->isEmpty())
-            metaData.readMetaData(filePath);
+        if (!baFile || baFile->isEmpty())
+            metaData->readMetaData(filePath);
         else
-            metaData.readMetaData(filePath, ba);
+            metaData->readMetaData(filePath, baFile);
+
+        // sorting by capture date or rating does not need to read all files again
+        DkMetaDataIndex::instance().insert(filePath, *metaData);
 
         // read the full image if we want to create new thumbnails
         if (forceLoad != force_save_thumb)
-            thumb = metaData.getThumbnail();
+            thumb = metaData->getThumbnail();
     } catch (...) {
         // do nothing - we'll load the full file
     }
     removeBlackBorder(thumb);
 
     bool exifThumb = !thumb.isNull();
-    int orientation = metaData.getOrientationDegree();
+    int orientation = metaData->getOrientationDegree();
 
-    if (exifThumb && (metaData.isAVIF() || metaData.isHEIF() || metaData.isJXL()) && orientation != -1 && orientation != 0) {
+    if (exifThumb && (metaData->isAVIF() || metaData->isHEIF() || metaData->isJXL()) && orientation != -1 && orientation != 0) {
         // do not rotate together with full image but rotate Exif thumb only
-        QTransform rotationMatrix;
-        rotationMatrix.rotate((double)orientation);
-        thumb = thumb.transformed(rotationMatrix);
+        thumb = DkImage::rotateQuarterTurns(thumb, orientation / 90);
     }
 
-    QFileInfo fInfo(filePath);
-    QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
-    fInfo = QFileInfo(lFilePath);
+#ifdef WITH_LIBHEIF
+    // Exiv2 does not know the thumbnail items of HEIF containers (they are rotated already)
+    if (!exifThumb && forceLoad != force_save_thumb && (metaData->isHEIF() || metaData->isAVIF())) {
+        thumb = DkHeifLoader::thumbnail(lFilePath, baFile);
+        exifThumb = !thumb.isNull();
+    }
+#endif
 
     // diem: do_not_force is the generic load - so also rescale these
     bool rescale = forceLoad == do_not_force;
 
+    // the Exif thumbnail would be upscaled (blurry) - decode the image instead
+    QImage exifFallback;
+    if (rescale && exifThumb && qMax(thumb.width(), thumb.height()) < maxThumbSize * 3 / 4) {
+        exifFallback = thumb;
+        thumb = QImage();
+        exifThumb = false;
+    }
+
+    // all mip levels are cached from the same decode
+    QVector<int> levels = mipLevels();
+    bool mips = useCache && rescale && levels.contains(maxThumbSize);
+    int scaleSize = mips ? levels.last() : maxThumbSize;
+
     if ((forceLoad != force_exif_thumb || fInfo.size() < 1e5) && (thumb.isNull() || forceLoad == force_full_thumb || forceLoad == force_save_thumb)) { // braces
 
-        // try to read the image
+        // try to read the image - the metadata was parsed above, so the loader does not need to open it again
         DkBasicLoader loader;
 
-        if (baZip && !baZip->isEmpty()) {
-            if (loader.loadGeneral(lFilePath, baZip, true, true))
-                thumb = loader.image();
-        } else {
-            if (loader.loadGeneral(lFilePath, ba, true, true))
-                thumb = loader.image();
-        }
+        // we downscale anyway - so let the decoder skip the full resolution
+        if (rescale)
+            loader.setTargetSize(QSize(scaleSize * 2, scaleSize * 2));
+
+        if (loader.loadGeneral(lFilePath, baFile, metaData, true))
+            thumb = loader.image();
+    }
+
+    if (thumb.isNull() && !exifFallback.isNull()) {
+        thumb = exifFallback;
+        exifThumb = true;
+        mips = false;
+        scaleSize = maxThumbSize;
     }
 
     if (thumb.isNull() && forceLoad == force_exif_thumb)
         return QImage();
 
     // the image is not scaled correctly yet
-    if (rescale && !thumb.isNull()) {
-        int w = thumb.width();
-        int h = thumb.height();
-
-        if (w > maxThumbSize || h > maxThumbSize) {
-            if (w > h) {
-                h = qRound((double)maxThumbSize / w * h);
-                w = maxThumbSize;
-            } else if (w < h) {
-                w = qRound((double)maxThumbSize / h * w);
-                h = maxThumbSize;
-            } else {
-                w = maxThumbSize;
-                h = maxThumbSize;
-            }
-        }
+    if (rescale && !thumb.isNull())
+        thumb = scaleThumb(thumb, exifThumb ? maxThumbSize : scaleSize);
 
-        // scale
-        thumb = thumb.scaled(QSize(w * 2, h * 2), Qt::KeepAspectRatio, Qt::FastTransformation);
-        thumb = thumb.scaled(QSize(w, h), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
+    if (orientation != -1 && orientation != 0 && (metaData->isJpg() || metaData->isRaw()))
+        thumb = DkImage::rotateQuarterTurns(thumb, orientation / 90);
 
-    if (orientation != -1 && orientation != 0 && (metaData.isJpg() || metaData.isRaw())) {
-        QTransform rotationMatrix;
-        rotationMatrix.rotate((double)orientation);
-        thumb = thumb.transformed(rotationMatrix);
-    }
+    // the full image was decoded - cache the result so that we don't need to do that again
+    if (mips && !exifThumb && !thumb.isNull()) {
+        QImage level = thumb;
+
+        // each level is downscaled from the next larger one
+        for (int idx = levels.size() - 1; idx >= 0; idx--) {
+            if (idx < levels.size() - 1)
+                level = level.scaled(QSize(levels[idx], levels[idx]), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+            DkThumbCache::instance().insert(filePath, levels[idx], level);
+
+            if (levels[idx] == maxThumbSize)
+                thumb = level;
+        }
+    } else if (useCache && rescale && !exifThumb && !thumb.isNull())
+        DkThumbCache::instance().insert(filePath, maxThumbSize, thumb);
 
     // save the thumbnail if the caller either forces it, or the save thumb is requested and the image did not have any before
     if (forceLoad == force_save_thumb || (forceLoad == save_thumb && !exifThumb)) {
         try {
             QImage sThumb = thumb.copy();
-            if (orientation != -1 && orientation != 0) {
-                QTransform rotationMatrix;
-                rotationMatrix.rotate(-(double)orientation);
-                sThumb = sThumb.transformed(rotationMatrix);
-            }
+            if (orientation != -1 && orientation != 0)
+                sThumb = DkImage::rotateQuarterTurns(sThumb, -orientation / 90);
 
-            metaData.updateImageMetaData(sThumb);
+            metaData->updateImageMetaData(sThumb);
 
             if (!ba || ba->isEmpty())
-                metaData.saveMetaData(lFilePath);
+                metaData->saveMetaData(lFilePath);
             else
-                metaData.saveMetaData(lFilePath, ba);
+                metaData->saveMetaData(lFilePath, ba);
 
             qDebug() << "[thumb] saved to exif data";
         } catch (...) {
@@ -271,6 +378,27 @@ void DkThumbNail::removeBlackBorder(QImage &img)
 void DkThumbNail::setImage(const QImage img)
 {
     mImg = DkImage::createThumb(img);
+    mDisplayImg = QImage();
+    mImgLevel = mImg.isNull() ? 0 : mipLevels().last();
+}
+
+/**
+ * Converts a thumbnail for drawing.
+ * The result is (optionally) squared and stored in a format
+ * that is uploaded to a pixmap without conversion.
+ * This is done by the worker threads to keep the GUI thread free when thumbnails appear.
+ * @param thumb the thumbnail
+ * @param squared if true, the thumbnail is cropped to a square
+ * @return QImage the display version of thumb
+ **/
+QImage DkThumbNail::displayImage(const QImage &thumb, bool squared)
+{
+    if (thumb.isNull())
+        return thumb;
+
+    QImage img = squared ? DkImage::makeSquare(thumb) : thumb;
+
+    return img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
 }
 
 /**
@@ -288,15 +416,24 @@ DkThumbNailT::DkThumbNailT(const QString &filePath, const QImage &img)
 DkThumbNailT::~DkThumbNailT()
 {
     mThumbWatcher.blockSignals(true);
+
+    // do not compute thumbnails of deleted objects
+    if (isQueued() && DkScheduler::instance().take(mTask, DkScheduler::lane_cpu))
+        delete mTask;
+
     mThumbWatcher.cancel();
 }
 
-bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteArray> ba)
+bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteArray> ba, int priority)
 {
-    if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb)
+    if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb) {
         mImg = QImage();
+        mDisplayImg = QImage();
+        mImgLevel = 0;
+    }
 
-    if (!mImg.isNull() || !mImgExists || mFetching)
+    // smaller thumbnails are shown until the larger level is fetched
+    if ((!mImg.isNull() && mImgLevel >= mMaxThumbSize) || !mImgExists || mFetching)
         return false;
 
     // check if we can load the file
@@ -308,20 +445,52 @@ bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteA
     // watcher.isRunning() returns false if the thread is waiting in the pool
     mFetching = true;
     mForceLoad = forceLoad;
+    mPriority = priority;
+    mFetchLevel = mMaxThumbSize;
 
     connect(&mThumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()), Qt::UniqueConnection);
 
-    mThumbWatcher.setFuture(QtConcurrent::run(DkThumbsThreadPool::pool(), // load thumbnails on their dedicated pool
-                                              this,
-                                              &nmc::DkThumbNailT::computeCall,
-                                              mFile,
-                                              ba,
-                                              forceLoad,
-                                              mMaxThumbSize));
+    mTask = new DkThumbTask(this, ba, forceLoad, mMaxThumbSize);
+    mThumbWatcher.setFuture(mTask->future());
+
+    // thumbnails yield to the images the user is looking at
+    DkScheduler::instance().start(mTask, DkScheduler::lane_cpu, DkScheduler::priority_thumbnail, priority);
 
     return true;
 }
 
+void DkThumbNailT::setPriority(int priority)
+{
+    if (priority == mPriority)
+        return;
+
+    mPriority = priority;
+
+    // QThreadPool cannot re-sort its queue - so we take it out and put it back in
+    if (isQueued() && DkScheduler::instance().take(mTask, DkScheduler::lane_cpu))
+        DkScheduler::instance().start(mTask, DkScheduler::lane_cpu, DkScheduler::priority_thumbnail, priority);
+}
+
+int DkThumbNailT::priority() const
+{
+    return mPriority;
+}
+
+void DkThumbNailT::cancelFetch()
+{
+    if (isQueued() && DkScheduler::instance().take(mTask, DkScheduler::lane_cpu)) {
+        delete mTask; // reports canceled
+        mTask = 0;
+        mFetching = false;
+    }
+}
+
+bool DkThumbNailT::isQueued() const
+{
+    // the finished check guards against a task that has already been deleted by the pool
+    return mTask && mFetching && !mThumbWatcher.future().isFinished();
+}
+
 QImage DkThumbNailT::computeCall(const QString &filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize)
 {
     QImage thumb = DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize);
@@ -331,8 +500,26 @@ QImage DkThumbNailT::computeCall(const QString &filePath, QSharedPointer<QByteAr
 void DkThumbNailT::thumbLoaded()
 {
     QFuture<QImage> future = mThumbWatcher.future();
+    mTask = 0;
 
-    mImg = future.result();
+    // the request was removed from the pool before it started
+    if (future.isCanceled()) {
+        mFetching = false;
+        return;
+    }
+
+    QImage img = future.result();
+
+    // a larger level failed - keep the one we have
+    if (img.isNull() && !mImg.isNull()) {
+        mImgLevel = mFetchLevel;
+        mFetching = false;
+        return;
+    }
+
+    mImg = img;
+    mImgLevel = mFetchLevel;
+    mDisplayImg = future.resultCount() > 1 ? future.resultAt(1) : QImage();
 
     if (mImg.isNull() && mForceLoad != force_exif_thumb)
         mImgExists = false;
@@ -341,27 +528,602 @@ void DkThumbNailT::thumbLoaded()
     emit thumbLoadedSignal(!mImg.isNull());
 }
 
-// DkThumbsThreadPool --------------------------------------------------------------------
-DkThumbsThreadPool::DkThumbsThreadPool()
+// DkThumbTask --------------------------------------------------------------------
+DkThumbTask::DkThumbTask(DkThumbNailT *thumb, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize)
+{
+    mThumb = thumb;
+    mFilePath = thumb->getFilePath();
+    mBa = ba;
+    mForceLoad = forceLoad;
+    mMaxThumbSize = maxThumbSize;
+    mSquared = DkSettingsManager::snapshot()->display().displaySquaredThumbs;
+
+    mFutureInterface.reportStarted();
+    DkTelemetry::instance().addToQueue(DkTelemetry::queue_thumbnails, 1);
+}
+
+DkThumbTask::~DkThumbTask()
+{
+    DkTelemetry::instance().addToQueue(DkTelemetry::queue_thumbnails, -1);
+
+    // we were taken from (or cleared by) the pool
+    if (!mDone) {
+        mFutureInterface.reportCanceled();
+        mFutureInterface.reportFinished();
+    }
+}
+
+QFuture<QImage> DkThumbTask::future()
+{
+    return mFutureInterface.future();
+}
+
+void DkThumbTask::run()
+{
+    QImage thumb = mThumb->computeCall(mFilePath, mBa, mForceLoad, mMaxThumbSize);
+
+    // we have the pixels anyway - hashing them is cheap
+    if (!thumb.isNull())
+        DkImageHashIndex::instance().insert(mFilePath, thumb);
+
+    // the label only uploads it (see DkThumbLabel::updateLabel)
+    QImage display = DkThumbNail::displayImage(thumb, mSquared);
+
+    mDone = true;
+    mFutureInterface.reportResult(thumb, 0);
+    mFutureInterface.reportResult(display, 1);
+    mFutureInterface.reportFinished();
+}
+
+// DkThumbCache --------------------------------------------------------------------
+DkThumbCache::DkThumbCache()
 {
-    mPool = new QThreadPool();
-    mPool->setMaxThreadCount(qMax(mPool->maxThreadCount() - 2, 1));
+    mCacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/nomacs/thumbnails";
 }
 
-DkThumbsThreadPool &DkThumbsThreadPool::instance()
+DkThumbCache &DkThumbCache::instance()
 {
-    static DkThumbsThreadPool inst;
+    static DkThumbCache inst;
     return inst;
 }
 
-QThreadPool *DkThumbsThreadPool::pool()
+bool DkThumbCache::isEnabled() const
+{
+    DkSettingsSnapshot settings = DkSettingsManager::snapshot();
+
+    return settings->resources().thumbCache && settings->resources().thumbCacheSize > 0 && !settings->app().privateMode;
+}
+
+QString DkThumbCache::cacheDir() const
+{
+    return mCacheDir;
+}
+
+/**
+ * Returns the cache file of a thumbnail.
+ * The file name encodes the source's path, modification date and size.
+ * @param filePath the image's file path.
+ * @param maxThumbSize the thumbnail's size.
+ * @return QString the thumbnail's file path or an empty string if the file does not exist.
+ **/
+QString DkThumbCache::cacheFilePath(const QString &filePath, int maxThumbSize) const
 {
-    return instance().mPool;
+    QFileInfo fInfo(filePath);
+
+    // e.g. images in zip files are not cached
+    if (!fInfo.exists() || !fInfo.isFile())
+        return QString();
+
+    QString key = fInfo.absoluteFilePath() + "|" + QString::number(fInfo.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(fInfo.size()) + "|"
+        + QString::number(maxThumbSize);
+
+    return keyFilePath(key);
 }
 
-void DkThumbsThreadPool::clear()
+/**
+ * Returns the cache file of a key.
+ **/
+QString DkThumbCache::keyFilePath(const QString &key) const
 {
-    pool()->clear();
+    QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+
+    // two levels keep the directories small
+    return mCacheDir + "/" + hash.left(2) + "/" + hash;
+}
+
+/**
+ * Returns the cached thumbnail.
+ * @param filePath the image's file path.
+ * @param maxThumbSize the thumbnail's size.
+ * @return QImage the thumbnail - a null image if it is not cached.
+ **/
+QImage DkThumbCache::find(const QString &filePath, int maxThumbSize) const
+{
+    QString cPath = cacheFilePath(filePath, maxThumbSize);
+
+    if (cPath.isEmpty())
+        return QImage();
+
+    return read(cPath);
+}
+
+/**
+ * Returns the thumbnail that was stored last for a file.
+ * The file itself is not accessed - so the thumbnail might be outdated.
+ * @param filePath the image's file path.
+ * @param maxThumbSize the thumbnail's size.
+ * @return QImage the thumbnail - a null image if none was stored.
+ **/
+QImage DkThumbCache::findLastKnown(const QString &filePath, int maxThumbSize) const
+{
+    return read(keyFilePath("last|" + QDir::cleanPath(filePath) + "|" + QString::number(maxThumbSize)));
+}
+
+QImage DkThumbCache::read(const QString &cPath) const
+{
+    QFile file(cPath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+
+    QImage thumb;
+    thumb.loadFromData(file.readAll());
+
+    // the modification date is our access time for the LRU eviction
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return thumb;
+}
+
+/**
+ * Adds a thumbnail to the cache.
+ * @param filePath the image's file path.
+ * @param maxThumbSize the thumbnail's size.
+ * @param thumb the thumbnail.
+ **/
+void DkThumbCache::insert(const QString &filePath, int maxThumbSize, const QImage &thumb)
+{
+    QString cPath = cacheFilePath(filePath, maxThumbSize);
+
+    if (cPath.isEmpty())
+        return;
+
+    write(cPath, thumb);
+}
+
+/**
+ * Stores the thumbnail that is returned by findLastKnown().
+ * @param filePath the image's file path.
+ * @param maxThumbSize the thumbnail's size.
+ * @param thumb the thumbnail.
+ **/
+void DkThumbCache::insertLastKnown(const QString &filePath, int maxThumbSize, const QImage &thumb)
+{
+    write(keyFilePath("last|" + QDir::cleanPath(filePath) + "|" + QString::number(maxThumbSize)), thumb);
+}
+
+void DkThumbCache::write(const QString &cPath, const QImage &thumb)
+{
+    if (thumb.isNull())
+        return;
+
+    if (!QDir().mkpath(QFileInfo(cPath).absolutePath()))
+        return;
+
+    // write to a tmp file first - other threads might read the thumbnail
+    QString tmpPath = cPath + "." + QString::number((quintptr)QThread::currentThreadId()) + ".tmp";
+
+    QImageWriter writer(tmpPath, thumb.hasAlphaChannel() ? "png" : "jpg");
+    writer.setQuality(90);
+
+    if (!writer.write(thumb)) {
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    QFile::remove(cPath);
+
+    if (!QFile::rename(tmpPath, cPath)) {
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    qint64 maxSize = qint64(DkSettingsManager::snapshot()->resources().thumbCacheSize) * 1024 * 1024;
+    bool full = false;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (mCacheSize == -1)
+            mCacheSize = computeCacheSize();
+        else
+            mCacheSize += QFileInfo(cPath).size();
+
+        full = mCacheSize > maxSize;
+    }
+
+    if (full)
+        evict(maxSize);
+}
+
+/**
+ * Removes all cached thumbnails.
+ **/
+void DkThumbCache::clear()
+{
+    QMutexLocker locker(&mMutex);
+
+    QDir(mCacheDir).removeRecursively();
+    mCacheSize = 0;
+}
+
+qint64 DkThumbCache::cacheSize() const
+{
+    QMutexLocker locker(&mMutex);
+
+    if (mCacheSize == -1)
+        mCacheSize = computeCacheSize();
+
+    return mCacheSize;
+}
+
+qint64 DkThumbCache::computeCacheSize() const
+{
+    qint64 size = 0;
+    QDirIterator it(mCacheDir, QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        it.next();
+        size += it.fileInfo().size();
+    }
+
+    return size;
+}
+
+/**
+ * Removes the least recently used thumbnails.
+ * We remove thumbnails until 80% of maxSize is reached
+ * so that we don't need to evict with every new thumbnail.
+ * @param maxSize the cache size in bytes.
+ **/
+void DkThumbCache::evict(qint64 maxSize)
+{
+    QMutexLocker locker(&mMutex);
+
+    DkTimer dt;
+    QFileInfoList files;
+    QDirIterator it(mCacheDir, QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        it.next();
+        files << it.fileInfo();
+    }
+
+    std::sort(files.begin(), files.end(), [](const QFileInfo &l, const QFileInfo &r) {
+        return l.lastModified() < r.lastModified();
+    });
+
+    qint64 size = 0;
+    for (const QFileInfo &fi : files)
+        size += fi.size();
+
+    int numRemoved = 0;
+    for (const QFileInfo &fi : files) {
+        if (size <= maxSize * 0.8)
+            break;
+
+        if (QFile::remove(fi.absoluteFilePath())) {
+            size -= fi.size();
+            numRemoved++;
+        }
+    }
+
+    mCacheSize = size;
+
+    qInfo() << "[DkThumbCache]" << numRemoved << "thumbnails removed in" << dt;
+}
+
+// DkImageHashIndex --------------------------------------------------------------------
+DkImageHashIndex::DkImageHashIndex()
+{
+}
+
+DkImageHashIndex &DkImageHashIndex::instance()
+{
+    static DkImageHashIndex inst;
+    return inst;
+}
+
+/**
+ * Computes the difference hash (dHash) of an image.
+ * The image is reduced to 9x8 gray values and each bit encodes
+ * whether a pixel is darker than its right neighbor.
+ * @param img the image (a thumbnail is sufficient)
+ * @return quint64 the hash
+ **/
+quint64 DkImageHashIndex::hash(const QImage &img)
+{
+    if (img.isNull())
+        return 0;
+
+    // smooth scaling averages all pixels of a cell
+    QImage small = img.scaled(9, 8, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_Grayscale8);
+
+    quint64 h = 0;
+
+    for (int y = 0; y < small.height(); y++) {
+        const uchar *row = small.constScanLine(y);
+
+        for (int x = 0; x < small.width() - 1; x++) {
+            h <<= 1;
+            if (row[x] < row[x + 1])
+                h |= 1;
+        }
+    }
+
+    return h;
+}
+
+/**
+ * The hamming distance of two hashes.
+ * @return int the number of bits that differ [0 64]
+ **/
+int DkImageHashIndex::distance(quint64 lh, quint64 rh)
+{
+    quint64 v = lh ^ rh;
+    int d = 0;
+
+    for (; v; d++)
+        v &= v - 1;
+
+    return d;
+}
+
+void DkImageHashIndex::insert(const QString &filePath, const QImage &thumb)
+{
+    insert(filePath, hash(thumb));
+}
+
+/**
+ * Adds an image to the index - its previous hash is replaced.
+ * @param filePath the image
+ * @param hash its dHash (see hash())
+ **/
+void DkImageHashIndex::insert(const QString &filePath, quint64 hash)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto fIt = mFileNodes.find(filePath);
+    if (fIt != mFileNodes.end()) {
+        if (mNodes[fIt.value()].hash == hash)
+            return;
+
+        // the file changed - nodes are not removed from the tree, they just become empty
+        mNodes[fIt.value()].files.removeAll(filePath);
+    }
+
+    int idx = 0;
+
+    if (mNodes.empty()) {
+        Node root;
+        root.hash = hash;
+        mNodes << root;
+    }
+
+    // walk down the tree - the children of a node are keyed by their distance to it
+    while (true) {
+        int d = distance(mNodes[idx].hash, hash);
+
+        if (d == 0)
+            break;
+
+        int cIdx = mNodes[idx].children.value(d, -1);
+
+        if (cIdx == -1) {
+            Node n;
+            n.hash = hash;
+            mNodes << n;
+
+            cIdx = mNodes.size() - 1;
+            mNodes[idx].children.insert(d, cIdx);
+        }
+
+        idx = cIdx;
+    }
+
+    mNodes[idx].files << filePath;
+    mFileNodes.insert(filePath, idx);
+}
+
+bool DkImageHashIndex::contains(const QString &filePath) const
+{
+    QMutexLocker locker(&mMutex);
+    return mFileNodes.contains(filePath);
+}
+
+bool DkImageHashIndex::find(const QString &filePath, quint64 &hash) const
+{
+    QMutexLocker locker(&mMutex);
+
+    auto fIt = mFileNodes.constFind(filePath);
+
+    if (fIt == mFileNodes.constEnd())
+        return false;
+
+    hash = mNodes[fIt.value()].hash;
+    return true;
+}
+
+int DkImageHashIndex::size() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFileNodes.size();
+}
+
+/**
+ * Collects all nodes within maxDistance of hash.
+ * The triangle inequality lets us skip all subtrees whose distance to
+ * their parent differs by more than maxDistance from the parent's distance to hash.
+ * The mutex must be locked.
+ **/
+void DkImageHashIndex::findIntern(quint64 hash, int maxDistance, QVector<int> &nodes) const
+{
+    if (mNodes.empty())
+        return;
+
+    QVector<int> stack;
+    stack << 0;
+
+    while (!stack.empty()) {
+        const Node &n = mNodes[stack.takeLast()];
+        int d = distance(n.hash, hash);
+
+        if (d <= maxDistance && !n.files.empty())
+            nodes << (int)(&n - mNodes.constData());
+
+        for (auto cIt = n.children.constBegin(); cIt != n.children.constEnd(); cIt++) {
+            if (qAbs(cIt.key() - d) <= maxDistance)
+                stack << cIt.value();
+        }
+    }
+}
+
+/**
+ * Returns all indexed images that are similar to filePath.
+ * @param filePath the reference image (it must be indexed)
+ * @param maxDistance the maximal hamming distance of the hashes
+ * @return QStringList the similar images sorted by their distance (without filePath)
+ **/
+QStringList DkImageHashIndex::findSimilar(const QString &filePath, int maxDistance) const
+{
+    QMutexLocker locker(&mMutex);
+
+    auto fIt = mFileNodes.constFind(filePath);
+
+    if (fIt == mFileNodes.constEnd())
+        return QStringList();
+
+    quint64 h = mNodes[fIt.value()].hash;
+
+    QVector<int> nodes;
+    findIntern(h, maxDistance, nodes);
+
+    std::sort(nodes.begin(), nodes.end(), [&](int l, int r) {
+        return distance(mNodes[l].hash, h) < distance(mNodes[r].hash, h);
+    });
+
+    QStringList files;
+    for (int idx : nodes)
+        files << mNodes[idx].files;
+
+    files.removeAll(filePath);
+
+    return files;
+}
+
+/**
+ * Groups similar images (e.g. bursts or duplicates).
+ * Similarity is transitive within a group: a burst that changes slowly
+ * ends up in one group even if its first and last images differ more than maxDistance.
+ * @param filePaths the images to group - images that are not indexed are ignored
+ * @param maxDistance the maximal hamming distance of neighboring images
+ * @return QVector<QStringList> the groups with more than one image (each in the order of filePaths)
+ **/
+QVector<QStringList> DkImageHashIndex::groups(const QStringList &filePaths, int maxDistance) const
+{
+    QHash<QString, int> fileIdx;
+    for (int idx = 0; idx < filePaths.size(); idx++)
+        fileIdx.insert(filePaths[idx], idx);
+
+    // union-find
+    QVector<int> parents(filePaths.size());
+    for (int idx = 0; idx < parents.size(); idx++)
+        parents[idx] = idx;
+
+    auto root = [&](int idx) {
+        while (parents[idx] != idx)
+            idx = parents[idx] = parents[parents[idx]];
+        return idx;
+    };
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        // each node is queried once - all its files are identical
+        QSet<int> visited;
+        QVector<int> nodes;
+
+        for (const QString &fp : filePaths) {
+            int nIdx = mFileNodes.value(fp, -1);
+
+            if (nIdx == -1 || visited.contains(nIdx))
+                continue;
+
+            visited.insert(nIdx);
+
+            nodes.clear();
+            findIntern(mNodes[nIdx].hash, maxDistance, nodes);
+
+            int r = root(fileIdx.value(fp));
+
+            for (int sIdx : nodes) {
+                for (const QString &sfp : mNodes[sIdx].files) {
+                    int fIdx = fileIdx.value(sfp, -1);
+
+                    if (fIdx != -1)
+                        parents[root(fIdx)] = r;
+                }
+            }
+        }
+    }
+
+    QHash<int, int> groupIdx;
+    QVector<QStringList> groups;
+
+    for (int idx = 0; idx < filePaths.size(); idx++) {
+        int r = root(idx);
+
+        if (!groupIdx.contains(r)) {
+            groupIdx.insert(r, groups.size());
+            groups << QStringList();
+        }
+
+        groups[groupIdx.value(r)] << filePaths[idx];
+    }
+
+    QVector<QStringList> dups;
+    for (const QStringList &g : groups) {
+        if (g.size() > 1)
+            dups << g;
+    }
+
+    return dups;
+}
+
+/**
+ * Hashes images that are not indexed yet.
+ * Their thumbnails are computed (or loaded from the thumbnail cache) - this blocks.
+ * @param filePaths the images
+ * @return int the number of images that were added to the index
+ **/
+int DkImageHashIndex::index(const QStringList &filePaths)
+{
+    int numIndexed = 0;
+
+    for (const QString &fp : filePaths) {
+        if (contains(fp))
+            continue;
+
+        DkThumbNail thumb(fp);
+        thumb.compute();
+
+        if (!thumb.getImage().isNull()) {
+            insert(fp, thumb.getImage());
+            numIndexed++;
+        }
+    }
+
+    return numIndexed;
 }
 
 }
@@ -30,10 +30,15 @@
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QColor>
 #include <QDir>
+#include <QFutureInterface>
 #include <QFutureWatcher>
+#include <QHash>
 #include <QImage>
+#include <QMutex>
+#include <QRunnable>
 #include <QSharedPointer>
 #include <QThread>
+#include <QVector>
 #pragma warning(pop) // no warnings from includes - end
 
 #pragma warning(disable : 4251) // TODO: remove
@@ -48,11 +53,11 @@
 #endif
 #endif
 
-class QThreadPool;
-
 namespace nmc
 {
 
+class DkThumbTask;
+
 #define max_thumb_size 400
 
 /**
@@ -103,6 +108,34 @@ public:
         return mImg;
     };
 
+    /**
+     * Returns the thumbnail prepared for drawing (see displayImage()).
+     * Thumbnails that were fetched in the background come with it.
+     * @param squared true if the version cropped to a square is requested
+     * @return QImage the display image or a null image if none was prepared.
+     **/
+    QImage getDisplayImage(bool squared) const
+    {
+        QSize s = squared ? QSize(qMin(mImg.width(), mImg.height()), qMin(mImg.width(), mImg.height())) : mImg.size();
+        return (!mDisplayImg.isNull() && mDisplayImg.size() == s) ? mDisplayImg : QImage();
+    };
+
+    static QImage displayImage(const QImage &thumb, bool squared);
+
+    static QVector<int> mipLevels();
+    static int mipLevel(int size);
+
+    /**
+     * Releases the thumbnail image.
+     * It is fetched again (e.g. from the thumbnail cache) if needed.
+     **/
+    void release()
+    {
+        mImg = QImage();
+        mDisplayImg = QImage();
+        mImgLevel = 0;
+    };
+
     /**
      * Returns the file information.
      * @return QFileInfo the thumbnail file
@@ -128,6 +161,11 @@ public:
             return exists_not;
     };
 
+    /**
+     * Sets the size of thumbnails that are fetched.
+     * Thumbnail views set the mip level that covers their preview size (see mipLevel()).
+     * @param maxSize the maximal side length
+     **/
     void setMaxThumbSize(int maxSize)
     {
         mMaxThumbSize = maxSize;
@@ -157,12 +195,15 @@ public:
 
 protected:
     QImage computeIntern(const QString &file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize);
+    static QImage scaleThumb(const QImage &thumb, int maxThumbSize);
 
     QImage mImg;
+    QImage mDisplayImg;
     QString mFile;
     // int s;
     bool mImgExists;
     int mMaxThumbSize;
+    int mImgLevel = 0; // the thumbnail size mImg was computed for
 };
 
 class DllCoreExport DkThumbNailT : public QObject, public DkThumbNail
@@ -173,7 +214,25 @@ public:
     DkThumbNailT(const QString &mFile = QString(), const QImage &mImg = QImage());
     ~DkThumbNailT();
 
-    bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+    enum {
+        priority_visible = 0, // thumbnails that are prefetched get -1 per row they are away from the viewport
+    };
+
+    bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), int priority = priority_visible);
+
+    /**
+     * Changes the priority of a pending request.
+     * Requests with higher priorities are computed first.
+     * @param priority the new priority (see priority_visible)
+     **/
+    void setPriority(int priority);
+    int priority() const;
+
+    /**
+     * Removes the request from the scheduler if it has not started yet.
+     * The thumbnail can be fetched again later.
+     **/
+    void cancelFetch();
 
     /**
      * Returns whether the thumbnail was loaded, or does not exist.
@@ -200,26 +259,134 @@ protected slots:
     void thumbLoaded();
 
 protected:
+    friend class DkThumbTask;
+
     QImage computeCall(const QString &filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize);
+    bool isQueued() const;
 
     QFutureWatcher<QImage> mThumbWatcher;
     bool mFetching;
     int mForceLoad;
+    int mPriority = priority_visible;
+    int mFetchLevel = 0; // the thumbnail size that is fetched
+    DkThumbTask *mTask = 0; // owned by the scheduler - only valid while queued
+};
+
+/**
+ * A single thumbnail request.
+ * In contrast to QtConcurrent::run, requests are queued with a
+ * priority and can be taken from the pool as long as they have not started.
+ **/
+class DkThumbTask : public QRunnable
+{
+public:
+    DkThumbTask(DkThumbNailT *thumb, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize);
+    ~DkThumbTask();
+
+    QFuture<QImage> future();
+    void run() override;
+
+private:
+    QFutureInterface<QImage> mFutureInterface;
+    DkThumbNailT *mThumb;
+    QString mFilePath;
+    QSharedPointer<QByteArray> mBa;
+    int mForceLoad;
+    int mMaxThumbSize;
+    bool mSquared; // Display::displaySquaredThumbs when the thumbnail was requested
+    bool mDone = false;
 };
 
-class DkThumbsThreadPool
+/**
+ * Persistent thumbnail cache.
+ * Thumbnails that had to be decoded from the full image are stored
+ * in the user's cache directory. They are keyed by file path, modification
+ * date, file size and thumbnail size - so changes of a file
+ * invalidate its thumbnail. The least recently used thumbnails are removed
+ * if the cache exceeds Resources::thumbCacheSize.
+ * The cache is thread-safe and used if Resources::thumbCache is set.
+ * Views that must draw before the files are accessed (e.g. recent files
+ * on network shares) use the last known thumbnails which are keyed by
+ * the file path only.
+ **/
+class DllCoreExport DkThumbCache
 {
 public:
-    static DkThumbsThreadPool &instance();
+    static DkThumbCache &instance();
 
-    static QThreadPool *pool();
-    static void clear();
+    bool isEnabled() const;
+    QImage find(const QString &filePath, int maxThumbSize) const;
+    void insert(const QString &filePath, int maxThumbSize, const QImage &thumb);
+    QImage findLastKnown(const QString &filePath, int maxThumbSize) const;
+    void insertLastKnown(const QString &filePath, int maxThumbSize, const QImage &thumb);
+    void clear();
+
+    QString cacheDir() const;
+    qint64 cacheSize() const;
 
 private:
-    DkThumbsThreadPool();
-    DkThumbsThreadPool(const DkThumbsThreadPool &);
+    DkThumbCache();
+    DkThumbCache(const DkThumbCache &);
+
+    QString cacheFilePath(const QString &filePath, int maxThumbSize) const;
+    QString keyFilePath(const QString &key) const;
+    QImage read(const QString &cPath) const;
+    void write(const QString &cPath, const QImage &thumb);
+    qint64 computeCacheSize() const;
+    void evict(qint64 maxSize);
+
+    QString mCacheDir;
+    mutable QMutex mMutex;
+    mutable qint64 mCacheSize = -1; // bytes, -1 if not computed yet
+};
+
+/**
+ * Perceptual hashes of images for finding (near) duplicates.
+ * A 64 bit difference hash (dHash) is computed from each thumbnail,
+ * so that it survives rescaling, recompression and small edits.
+ * Hashes are stored in a BK-tree which answers "all images within
+ * a hamming distance of d" without comparing against every image.
+ * The index is thread-safe.
+ **/
+class DllCoreExport DkImageHashIndex
+{
+public:
+    enum {
+        distance_duplicate = 4, // re-encoded or resized copies
+        distance_similar = 10, // bursts & slightly edited images
+    };
+
+    static DkImageHashIndex &instance();
+
+    static quint64 hash(const QImage &img);
+    static int distance(quint64 lh, quint64 rh);
+
+    void insert(const QString &filePath, const QImage &thumb);
+    void insert(const QString &filePath, quint64 hash);
+    bool contains(const QString &filePath) const;
+    bool find(const QString &filePath, quint64 &hash) const;
+    int size() const;
+
+    QStringList findSimilar(const QString &filePath, int maxDistance = distance_similar) const;
+    QVector<QStringList> groups(const QStringList &filePaths, int maxDistance = distance_similar) const;
+
+    int index(const QStringList &filePaths);
+
+private:
+    DkImageHashIndex();
+    DkImageHashIndex(const DkImageHashIndex &);
+
+    struct Node {
+        quint64 hash = 0;
+        QStringList files;
+        QHash<int, int> children; // distance -> node
+    };
+
+    void findIntern(quint64 hash, int maxDistance, QVector<int> &nodes) const;
 
-    QThreadPool *mPool;
+    QVector<Node> mNodes; // mNodes[0] is the root
+    QHash<QString, int> mFileNodes; // file path -> node
+    mutable QMutex mMutex;
 };
 
 }
@@ -32,9 +32,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QCoreApplication>
 #include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QString>
+#include <QThread>
 #include <qmath.h>
+
+#include <cstring>
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
@@ -130,4 +138,245 @@ int DkTimer::elapsed() const
 {
     return mTimer.elapsed();
 }
+
+// DkTraceBuffer --------------------------------------------------------------------
+// single producer ring buffer - each slot is guarded by a sequence number (seqlock)
+// so that the exporter can read while the owning thread keeps recording
+class DkTraceBuffer
+{
+public:
+    enum {
+        num_events = 4096,
+        id_length = 96,
+    };
+
+    struct Event {
+        std::atomic<quint32> seq{0};
+        const char *category = nullptr;
+        const char *name = nullptr;
+        qint64 start = 0;
+        qint64 end = 0;
+        char id[id_length] = {};
+    };
+
+    struct Span {
+        const char *category;
+        const char *name;
+        qint64 start;
+        qint64 end;
+        QByteArray id;
+    };
+
+    DkTraceBuffer(int tid, const QString &threadName)
+        : mTid(tid)
+        , mThreadName(threadName)
+    {
+    }
+
+    int tid() const
+    {
+        return mTid;
+    }
+
+    QString threadName() const
+    {
+        return mThreadName;
+    }
+
+    void write(const char *category, const char *name, const QString &id, qint64 start, qint64 end)
+    {
+        quint32 head = mHead.load(std::memory_order_relaxed);
+        Event &e = mEvents[head % num_events];
+
+        quint32 seq = e.seq.load(std::memory_order_relaxed);
+        e.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        e.category = category;
+        e.name = name;
+        e.start = start;
+        e.end = end;
+
+        // keep the end of long ids (i.e. the file name)
+        QByteArray idUtf8 = id.toUtf8();
+        int len = qMin(idUtf8.size(), (int)id_length - 1);
+        memcpy(e.id, idUtf8.constData() + idUtf8.size() - len, len);
+        e.id[len] = '\0';
+
+        e.seq.store(seq + 2, std::memory_order_release);
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    QVector<Span> read() const
+    {
+        QVector<Span> spans;
+
+        quint32 head = mHead.load(std::memory_order_acquire);
+        quint32 first = head > num_events ? head - num_events : 0;
+
+        for (quint32 idx = first; idx < head; idx++) {
+            const Event &e = mEvents[idx % num_events];
+
+            quint32 seq = e.seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue; // currently written
+
+            Span s{e.category, e.name, e.start, e.end, QByteArray(e.id, (int)qstrnlen(e.id, id_length))};
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != seq)
+                continue; // overwritten while reading
+
+            spans << s;
+        }
+
+        return spans;
+    }
+
+protected:
+    int mTid;
+    QString mThreadName;
+
+    std::atomic<quint32> mHead{0};
+    Event mEvents[num_events];
+};
+
+// DkTracer --------------------------------------------------------------------
+DkTracer::DkTracer()
+{
+    mClock.start();
+}
+
+DkTracer &DkTracer::instance()
+{
+    static DkTracer inst;
+    return inst;
+}
+
+void DkTracer::setEnabled(bool enabled)
+{
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool DkTracer::isEnabled() const
+{
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the trace clock.
+ * @return qint64 microseconds since the tracer was created
+ **/
+qint64 DkTracer::now() const
+{
+    return mClock.nsecsElapsed() / 1000;
+}
+
+void DkTracer::record(const char *category, const char *name, const QString &id, qint64 start, qint64 end)
+{
+    if (!isEnabled())
+        return;
+
+    threadBuffer()->write(category, name, id, start, end);
+}
+
+DkTraceBuffer *DkTracer::threadBuffer()
+{
+    // the buffers are owned by the tracer - so spans of finished threads are still exported
+    static thread_local DkTraceBuffer *buffer = nullptr;
+
+    if (!buffer) {
+        QMutexLocker locker(&mMutex);
+
+        QThread *t = QThread::currentThread();
+        QString threadName = t->objectName();
+
+        if (threadName.isEmpty())
+            threadName = (QCoreApplication::instance() && QCoreApplication::instance()->thread() == t) ? "main" : QString("Thread %1").arg(mBuffers.size() + 1);
+
+        mBuffers << QSharedPointer<DkTraceBuffer>(new DkTraceBuffer(mBuffers.size() + 1, threadName));
+        buffer = mBuffers.last().data();
+    }
+
+    return buffer;
+}
+
+/**
+ * Exports all recorded spans to the Chrome Trace Event format.
+ * The file can be opened with chrome://tracing or https://ui.perfetto.dev
+ * @param filePath the JSON file path
+ * @return bool true if the trace was written
+ **/
+bool DkTracer::exportChromeTrace(const QString &filePath) const
+{
+    QVector<QSharedPointer<DkTraceBuffer>> buffers;
+    {
+        QMutexLocker locker(&mMutex);
+        buffers = mBuffers;
+    }
+
+    QJsonArray events;
+    int numSpans = 0;
+
+    for (const QSharedPointer<DkTraceBuffer> &b : buffers) {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = 1;
+        threadName["tid"] = b->tid();
+        threadName["args"] = QJsonObject{{"name", b->threadName()}};
+        events << threadName;
+
+        for (const DkTraceBuffer::Span &s : b->read()) {
+            QJsonObject e;
+            e["name"] = QString::fromLatin1(s.name);
+            e["cat"] = QString::fromLatin1(s.category);
+            e["ph"] = "X";
+            e["ts"] = s.start;
+            e["dur"] = s.end - s.start;
+            e["pid"] = 1;
+            e["tid"] = b->tid();
+
+            if (!s.id.isEmpty())
+                e["args"] = QJsonObject{{"id", QString::fromUtf8(s.id)}};
+
+            events << e;
+            numSpans++;
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[Tracer] could not write to" << filePath;
+        return false;
+    }
+
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+
+    qInfo() << "[Tracer]" << numSpans << "spans of" << buffers.size() << "threads exported to" << filePath;
+
+    return true;
+}
+
+// DkTraceSpan --------------------------------------------------------------------
+DkTraceSpan::DkTraceSpan(const char *category, const char *name, const QString &id)
+    : DkTimer()
+    , mCategory(category)
+    , mName(name)
+    , mId(id)
+{
+    if (DkTracer::instance().isEnabled())
+        mStart = DkTracer::instance().now();
+}
+
+DkTraceSpan::~DkTraceSpan()
+{
+    if (mStart >= 0)
+        DkTracer::instance().record(mCategory, mName, mId, mStart, DkTracer::instance().now());
+}
 }
\ No newline at end of file
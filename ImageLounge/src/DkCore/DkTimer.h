@@ -29,8 +29,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <time.h>
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QObject>
+#include <QSharedPointer>
 #include <QTime>
+#include <QVector>
+
+#include <atomic>
 #pragma warning(pop) // no warnings from includes - end
 
 #ifndef DllCoreExport
@@ -77,4 +83,57 @@ protected:
     QTime mTimer;
 };
 
+class DkTraceBuffer;
+
+/**
+ * Records spans (see DkTraceSpan) of all threads.
+ * Each thread writes to its own ring buffer so recording does not lock.
+ * Recording is disabled by default and the buffers can be exported
+ * to the Chrome Trace (Perfetto) JSON format.
+ **/
+class DllCoreExport DkTracer
+{
+public:
+    static DkTracer &instance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    qint64 now() const;
+    void record(const char *category, const char *name, const QString &id, qint64 start, qint64 end);
+
+    bool exportChromeTrace(const QString &filePath) const;
+
+private:
+    DkTracer();
+
+    DkTraceBuffer *threadBuffer();
+
+    std::atomic<bool> mEnabled{false};
+    QElapsedTimer mClock;
+
+    mutable QMutex mMutex;
+    QVector<QSharedPointer<DkTraceBuffer>> mBuffers;
+};
+
+/**
+ * A scoped timer which is recorded as span if tracing is enabled.
+ * It can be used as a drop-in replacement for DkTimer.
+ * @param category the span category (e.g. loader, cacher, paint) - must be a static string
+ * @param name the span name - must be a static string
+ * @param id an optional identifier (e.g. the file path)
+ **/
+class DllCoreExport DkTraceSpan : public DkTimer
+{
+public:
+    DkTraceSpan(const char *category, const char *name, const QString &id = QString());
+    virtual ~DkTraceSpan();
+
+protected:
+    const char *mCategory;
+    const char *mName;
+    QString mId;
+    qint64 mStart = -1;
+};
+
 }
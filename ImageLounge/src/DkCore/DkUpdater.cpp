@@ -167,7 +167,7 @@ void DkUpdater::checkForUpdates()
         return;
     }
 
-    DkSettingsManager::param().sync().lastUpdateCheck = QDate::currentDate();
+    DkSettingsManager::edit().sync().lastUpdateCheck = QDate::currentDate();
     DkSettingsManager::param().save();
 
 #ifdef Q_OS_WIN
@@ -325,8 +325,8 @@ void DkUpdater::downloadFinishedSlot(QNetworkReply *data)
 
         file.close();
 
-        DkSettingsManager::param().global().setupVersion = mSetupVersion;
-        DkSettingsManager::param().global().setupPath = absoluteFilePath;
+        DkSettingsManager::edit().global().setupVersion = mSetupVersion;
+        DkSettingsManager::edit().global().setupPath = absoluteFilePath;
         DkSettingsManager::param().save();
 
         emit downloadFinished(absoluteFilePath);
@@ -26,28 +26,44 @@
  *******************************************************************************************************/
 
 #include "DkUtils.h"
+#include "DkLog.h"
 #include "DkMath.h"
 #include "DkNoMacs.h"
+#include "DkScheduler.h"
 #include "DkSettings.h"
 #include "DkViewPort.h"
 
 #if defined(Q_OS_LINUX) && !defined(Q_OS_OPENBSD)
+#include <malloc.h> // mallinfo2
 #include <sys/sysinfo.h>
+#include <unistd.h> // sysconf
+#endif
+
+#ifdef Q_OS_MAC
+#include <mach/mach.h>
+#include <sys/sysctl.h>
 #endif
 
 #ifndef WITH_OPENCV
 #include <cassert>
 #endif
 
+#include <algorithm>
+#include <iterator>
+
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QApplication>
 #include <QColor>
 #include <QComboBox>
 #include <QCoreApplication>
+#include <QDataStream>
 #include <QDate>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QFuture>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include <QMainWindow>
 #include <QMimeDatabase>
 #include <QMouseEvent>
@@ -56,14 +72,22 @@
 #include <QRandomGenerator>
 #include <QRegularExpression>
 #include <QStandardPaths>
+#include <QStorageInfo>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 #include <QTranslator>
 #include <QUrl>
 #include <QtConcurrentRun>
 #include <qmath.h>
 
 #include <QSystemSemaphore>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+
+#include <psapi.h> // GetProcessMemoryInfo
+#endif
 #pragma warning(pop) // no warnings from includes - end
 
 #if defined(Q_OS_WIN) && !defined(SOCK_STREAM)
@@ -118,7 +142,13 @@ double DkMemory::getTotalMemory()
         mem = info.totalram;
 
 #elif defined Q_OS_MAC
-    // TODO: could somebody (with a mac please add the corresponding calls?
+
+    quint64 memSize = 0;
+    size_t len = sizeof(memSize);
+
+    if (!sysctlbyname("hw.memsize", &memSize, &len, NULL, 0))
+        mem = (double)memSize;
+
 #endif
 
     // convert to MB
@@ -145,14 +175,33 @@ double DkMemory::getFreeMemory()
 
 #elif defined Q_OS_LINUX and not defined(Q_OS_OPENBSD)
 
+    // freeram does not count the page cache - MemAvailable does (Linux >= 3.14)
+    QFile meminfo("/proc/meminfo");
+
+    if (meminfo.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QList<QByteArray> lines = meminfo.readAll().split('\n');
+
+        for (const QByteArray &l : lines) {
+            if (l.startsWith("MemAvailable:")) {
+                mem = l.mid(13).trimmed().split(' ').first().toDouble() * 1024;
+                break;
+            }
+        }
+    }
+
     struct sysinfo info;
 
-    if (!sysinfo(&info))
+    if (mem < 0 && !sysinfo(&info))
         mem = info.freeram;
 
 #elif defined Q_OS_MAC
 
-    // TODO: could somebody with a mac please add the corresponding calls?
+    // free & inactive pages can be used without swapping
+    vm_statistics64_data_t vmStats;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64, (host_info64_t)&vmStats, &count) == KERN_SUCCESS)
+        mem = ((double)vmStats.free_count + vmStats.inactive_count) * vm_page_size;
 
 #endif
 
@@ -163,6 +212,239 @@ double DkMemory::getFreeMemory()
     return mem;
 }
 
+/**
+ * Returns the memory this process uses.
+ * On Linux (glibc >= 2.33) the heap bytes in use are reported - these are
+ * exact and do not depend on which pages were touched. Otherwise the
+ * private bytes (Windows) or the resident set size is returned.
+ * @return qint64 the memory in bytes or -1 if it is unknown
+ **/
+qint64 DkMemory::getProcessMemory()
+{
+    qint64 mem = -1;
+
+#ifdef Q_OS_WIN
+
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    ZeroMemory(&pmc, sizeof(pmc));
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)))
+        mem = (qint64)pmc.PrivateUsage;
+
+#elif defined Q_OS_LINUX and not defined(Q_OS_OPENBSD)
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    mem = (qint64)(mi.uordblks + mi.hblkhd);
+#else
+    QFile statm("/proc/self/statm");
+
+    if (statm.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QList<QByteArray> vals = statm.readAll().split(' ');
+
+        if (vals.size() > 1)
+            mem = vals[1].toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+#endif
+
+#elif defined Q_OS_MAC
+
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        mem = (qint64)info.resident_size;
+
+#endif
+
+    return mem;
+}
+
+// DkMemoryGovernor --------------------------------------------------------------------
+DkMemoryGovernor::DkMemoryGovernor()
+{
+}
+
+DkMemoryGovernor &DkMemoryGovernor::instance()
+{
+    static DkMemoryGovernor inst;
+    return inst;
+}
+
+/**
+ * Returns the current memory pressure.
+ * @return DkMemoryGovernor::Pressure the pressure of the last sample.
+ **/
+DkMemoryGovernor::Pressure DkMemoryGovernor::pressure()
+{
+    sample();
+
+    QMutexLocker locker(&mMutex);
+    return mPressure;
+}
+
+/**
+ * Returns the image cache budget.
+ * A disabled cache (Resources::cacheMemory = 0) stays disabled.
+ * @return double the budget in MB
+ **/
+double DkMemoryGovernor::cacheMemory()
+{
+    sample();
+
+    double mem = DkSettingsManager::snapshot()->resources().cacheMemory;
+
+    QMutexLocker locker(&mMutex);
+
+    if (mem <= 0)
+        return mem;
+
+    switch (mPressure) {
+    case pressure_critical:
+        return mem * 0.25;
+    case pressure_moderate:
+        return mem * 0.5;
+    default:
+        break;
+    }
+
+    // grow if the cache is small compared to the free memory
+    if (mFreeMemory > 0)
+        return mem * qBound(1.0, mFreeMemory / (8.0 * mem), 2.0);
+
+    return mem;
+}
+
+/**
+ * Returns the edit history budget.
+ * The history is never grown - it holds edits that cannot be recomputed.
+ * @return double the budget in MB
+ **/
+double DkMemoryGovernor::historyMemory()
+{
+    double mem = DkSettingsManager::snapshot()->resources().historyMemory;
+
+    switch (pressure()) {
+    case pressure_critical:
+        return mem * 0.25;
+    case pressure_moderate:
+        return mem * 0.5;
+    default:
+        return mem;
+    }
+}
+
+/**
+ * Returns the number of images that may be prefetched.
+ * @return int the number of images (>= 1).
+ **/
+int DkMemoryGovernor::maxImagesCached()
+{
+    int num = qMax(DkSettingsManager::snapshot()->resources().maxImagesCached, 1);
+
+    switch (pressure()) {
+    case pressure_critical:
+        return 1;
+    case pressure_moderate:
+        return qMax(num / 2, 1);
+    default:
+        return num;
+    }
+}
+
+void DkMemoryGovernor::sample()
+{
+    QMutexLocker locker(&mMutex);
+
+    if (mLastSample.isValid() && mLastSample.elapsed() < 1000)
+        return;
+
+    mLastSample.restart();
+
+    double freeMem = DkMemory::getFreeMemory();
+    double totalMem = DkMemory::getTotalMemory();
+    Pressure p = systemPressure();
+
+    // fall back to the share of free memory if the OS has no pressure signal
+    if (freeMem > 0 && totalMem > 0) {
+        double r = freeMem / totalMem;
+
+        if (r < 0.05)
+            p = pressure_critical;
+        else if (r < 0.1)
+            p = qMax(p, pressure_moderate);
+    }
+
+    if (p != mPressure)
+        qInfo() << "[Memory] pressure changed to" << p << "(" << freeMem << "MB free)";
+
+    mPressure = p;
+    mFreeMemory = freeMem;
+}
+
+/**
+ * Reads the memory pressure signal of the OS.
+ * Linux: pressure stall information (kernel >= 4.20)
+ * macOS: the kernel's VM pressure level
+ * Windows: the memory load
+ **/
+DkMemoryGovernor::Pressure DkMemoryGovernor::systemPressure()
+{
+    Pressure p = pressure_none;
+
+#ifdef Q_OS_WIN
+
+    MEMORYSTATUSEX MemoryStatus;
+    ZeroMemory(&MemoryStatus, sizeof(MEMORYSTATUSEX));
+    MemoryStatus.dwLength = sizeof(MEMORYSTATUSEX);
+
+    if (GlobalMemoryStatusEx(&MemoryStatus)) {
+        if (MemoryStatus.dwMemoryLoad >= 95)
+            p = pressure_critical;
+        else if (MemoryStatus.dwMemoryLoad >= 90)
+            p = pressure_moderate;
+    }
+
+#elif defined Q_OS_LINUX and not defined(Q_OS_OPENBSD)
+
+    // e.g. some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    QFile psi("/proc/pressure/memory");
+
+    if (psi.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QList<QByteArray> lines = psi.readAll().split('\n');
+
+        for (const QByteArray &l : lines) {
+            int idx = l.indexOf("avg10=");
+            if (idx == -1)
+                continue;
+
+            double avg = l.mid(idx + 6).split(' ').first().toDouble();
+
+            if (l.startsWith("full") && avg >= 10.0)
+                p = pressure_critical;
+            else if (l.startsWith("some") && avg >= 10.0)
+                p = qMax(p, pressure_moderate);
+        }
+    }
+
+#elif defined Q_OS_MAC
+
+    // 1 normal, 2 warning, 4 critical
+    int level = 0;
+    size_t len = sizeof(level);
+
+    if (!sysctlbyname("kern.memorystatus_vm_pressure_level", &level, &len, NULL, 0)) {
+        if (level >= 4)
+            p = pressure_critical;
+        else if (level >= 2)
+            p = pressure_moderate;
+    }
+
+#endif
+
+    return p;
+}
+
 // DkUtils --------------------------------------------------------------------
 #ifdef Q_OS_WIN
 
@@ -235,6 +517,45 @@ bool DkUtils::naturalCompare(const QString &s1, const QString &s2, Qt::CaseSensi
     return QString::compare(s1, s2, cs) < 0;
 }
 
+/**
+ * Creates a collation key for natural sorting.
+ * A plain string compare of two keys gives the same order as
+ * a case insensitive natural compare (img2 < img10). Numbers
+ * are prefixed with their length and leading zeros are removed.
+ * @param str the string (e.g. a file name)
+ * @return QString the sort key
+ **/
+QString DkUtils::naturalSortKey(const QString &str)
+{
+    QString folded = str.toCaseFolded();
+    QString key;
+    key.reserve(folded.size() + 8);
+
+    for (int idx = 0; idx < folded.size();) {
+        if (!folded[idx].isDigit()) {
+            key += folded[idx];
+            idx++;
+            continue;
+        }
+
+        // skip leading zeros: img001 == img1
+        while (idx < folded.size() - 1 && folded[idx] == '0' && folded[idx + 1].isDigit())
+            idx++;
+
+        int nStart = idx;
+        while (idx < folded.size() && folded[idx].isDigit())
+            idx++;
+
+        // '0' keeps numbers between punctuation and letters (as in ASCII)
+        // the length makes sure that 4 < 10
+        key += QChar('0');
+        key += QChar(ushort(qMin(idx - nStart, 0xFFFE) + 1));
+        key += folded.mid(nStart, idx - nStart);
+    }
+
+    return key;
+}
+
 /// <summary>
 /// Resolves symbolic links.
 /// </summary>
@@ -380,21 +701,12 @@ void DkUtils::addLanguages(QComboBox *langCombo, QStringList &languages)
 }
 
 /// <summary>
-/// Saves log messages to a temporary log file.
-/// Log messages are saved to DkUtils::instance().app().logPath() if
-/// DkUtils::instance().app().useLogFile ist true.
+/// Saves a log message to a temporary log file.
+/// The file is opened for each message - regular messages
+/// are written by the DkLogSink thread.
 /// </summary>
 /// <param name="type">The message type (QtDebugMsg are not written to the log).</param>
-/// <param name=""></param>
 /// <param name="msg">The message.</param>
-void qtMessageOutput(QtMsgType type, const QMessageLogContext &, const QString &msg)
-{
-    if (!DkSettingsManager::param().app().useLogFile)
-        return;
-
-    DkUtils::logToFile(type, msg);
-}
-
 void DkUtils::logToFile(QtMsgType type, const QString &msg)
 {
     static QString filePath;
@@ -402,28 +714,10 @@ void DkUtils::logToFile(QtMsgType type, const QString &msg)
     if (filePath.isEmpty())
         filePath = DkUtils::getLogFilePath();
 
-    QString txt;
+    QString txt = logMessage(type, msg);
 
-    switch (type) {
-    case QtDebugMsg:
-        return; // ignore debug messages
-        break;
-    case QtInfoMsg:
-        txt = msg;
-        break;
-    case QtWarningMsg:
-        txt = "[Warning] " + msg;
-        break;
-    case QtCriticalMsg:
-        txt = "[Critical] " + msg;
-        break;
-    case QtFatalMsg:
-        txt = "[FATAL] " + msg;
-        break;
-    default:
-        // txt = "unknown message type: " + QString::number(type) + msg;
+    if (txt.isEmpty())
         return;
-    }
 
     QFile outFile(filePath);
     if (!outFile.open(QIODevice::WriteOnly | QIODevice::Append))
@@ -433,10 +727,36 @@ void DkUtils::logToFile(QtMsgType type, const QString &msg)
     ts << txt << Qt::endl;
 }
 
+/// <summary>
+/// Returns the line of the log file for a message.
+/// </summary>
+/// <param name="type">The message type.</param>
+/// <param name="msg">The message.</param>
+/// <returns>The message with its type prefix or an empty string if the message is not logged (e.g. QtDebugMsg).</returns>
+QString DkUtils::logMessage(QtMsgType type, const QString &msg)
+{
+    switch (type) {
+    case QtInfoMsg:
+        return msg;
+    case QtWarningMsg:
+        return "[Warning] " + msg;
+    case QtCriticalMsg:
+        return "[Critical] " + msg;
+    case QtFatalMsg:
+        return "[FATAL] " + msg;
+    default:
+        // debug messages are ignored
+        return QString();
+    }
+}
+
 void DkUtils::initializeDebug()
 {
-    if (DkSettingsManager::param().app().useLogFile)
-        qInstallMessageHandler(qtMessageOutput);
+    // log messages are written by a background thread so that logging threads never wait for the file
+    if (DkSettingsManager::param().app().useLogFile) {
+        DkLogSink::instance().setLogFile(DkUtils::getLogFilePath());
+        DkLogSink::instance().install();
+    }
 
     // format console
     QString p = "%{if-info}[INFO] %{endif}%{if-warning}[WARNING] %{endif}%{if-critical}[CRITICAL] %{endif}%{if-fatal}[ERROR] %{endif}%{message}";
@@ -525,18 +845,16 @@ void DkUtils::mSleep(int ms)
 
 bool DkUtils::exists(const QFileInfo &file, int waitMs)
 {
-    QFuture<bool> future = QtConcurrent::run(
-        // TODO: if we have a lot of mounted files (windows) in the history
-        // we can potentially exhaust the pool & image loading has
-        // to wait for these exists
-        // I now only moved it to the thumbnail pool which does
-        // not fix this issue at all (now thumbnail preview stalls)
-        // we could
-        // - create a dedicated pool for exists
-        // - create a dedicated pool for image loading
-        DkThumbsThreadPool::pool(), // hook it to the thumbs pool
-        &DkUtils::checkFile,
-        file);
+    // NOTE: if we have a lot of mounted files (windows) in the history
+    // the checks can hang - they run in their own lane and checks that timed out are dropped
+    DkCancelToken token;
+    QFuture<bool> future = DkScheduler::instance().run(
+        DkScheduler::lane_probe,
+        DkScheduler::priority_interactive,
+        [file]() {
+            return DkUtils::checkFile(file);
+        },
+        token);
 
     for (int idx = 0; idx < waitMs; idx++) {
         if (future.isFinished())
@@ -547,7 +865,7 @@ bool DkUtils::exists(const QFileInfo &file, int waitMs)
         mSleep(1);
     }
 
-    // future.cancel();
+    token.cancel();
 
     // assume file is not existing if it took longer than waitMs
     return (future.isFinished()) ? future.result() : false;
@@ -820,20 +1138,10 @@ QString DkUtils::colorToString(const QColor &col)
 
 QStringList DkUtils::filterStringList(const QString &query, const QStringList &list)
 {
-    // white space is the magic thingy
-    QStringList queries = query.split(" ");
     QStringList resultList = list;
 
-    for (int idx = 0; idx < queries.size(); idx++) {
-        // Detect and correct special case where a space is leading or trailing the search term - this should be significant
-        if (idx == 0 && queries.size() > 1 && queries[idx].size() == 0)
-            queries[idx] = " " + queries[idx + 1];
-        if (idx == queries.size() - 1 && queries.size() > 2 && queries[idx].size() == 0)
-            queries[idx] = queries[idx - 1] + " ";
-        // The queries will be repeated, but this is okay - it will just be matched both with and without the space.
-        resultList = resultList.filter(queries[idx], Qt::CaseInsensitive);
-        qDebug() << "query: " << queries[idx];
-    }
+    for (const QString &q : searchTerms(query))
+        resultList = resultList.filter(q, Qt::CaseInsensitive);
 
     // if string match returns nothing -> try a regexp
     if (resultList.empty()) {
@@ -850,6 +1158,28 @@ QStringList DkUtils::filterStringList(const QString &query, const QStringList &l
     return resultList;
 }
 
+/**
+ * Splits a search query into its terms.
+ * @param query the query (terms are separated by white spaces)
+ * @return QStringList the terms - all of them have to be found
+ **/
+QStringList DkUtils::searchTerms(const QString &query)
+{
+    // white space is the magic thingy
+    QStringList queries = query.split(" ");
+
+    for (int idx = 0; idx < queries.size(); idx++) {
+        // Detect and correct special case where a space is leading or trailing the search term - this should be significant
+        if (idx == 0 && queries.size() > 1 && queries[idx].size() == 0)
+            queries[idx] = " " + queries[idx + 1];
+        if (idx == queries.size() - 1 && queries.size() > 2 && queries[idx].size() == 0)
+            queries[idx] = queries[idx - 1] + " ";
+        // The queries will be repeated, but this is okay - it will just be matched both with and without the space.
+    }
+
+    return queries;
+}
+
 bool DkUtils::moveToTrash(const QString &filePath)
 {
     QFileInfo fileInfo(filePath);
@@ -870,6 +1200,25 @@ bool DkUtils::moveToTrash(const QString &filePath)
     return file.moveToTrash();
 }
 
+/**
+ * True if path is on a network share (or its file system is unknown).
+ * Parallel I/O should be bounded on network shares and files should not be mapped.
+ * @param path a file or directory path
+ **/
+bool DkUtils::isNetworkPath(const QString &path)
+{
+    QFileInfo fi(path);
+
+    // UNC paths
+    if (fi.absoluteFilePath().startsWith("//"))
+        return true;
+
+    QStorageInfo si(fi.isDir() ? fi.absoluteFilePath() : fi.absolutePath());
+    QString fs = si.fileSystemType().toLower();
+
+    return !si.isValid() || fs.contains(QRegularExpression("nfs|cifs|smb|fuse|9p|afp|webdav"));
+}
+
 QString DkUtils::readableByte(float bytes)
 {
     if (bytes >= 1024 * 1024 * 1024) {
@@ -1250,53 +1599,304 @@ bool TabMiddleMouseCloser::eventFilter(QObject *obj, QEvent *event)
     return QObject::eventFilter(obj, event);
 }
 
-// DkRunGuard --------------------------------------------------------------------
-DkRunGuard::DkRunGuard()
-    : mSharedMem(mSharedMemKey)
+// DkFileNameIndex --------------------------------------------------------------------
+DkFileNameIndex::DkFileNameIndex(const QStringList &fileNames)
 {
-    QSystemSemaphore lock(mLockKey, 1);
-    lock.acquire();
+    setFileNames(fileNames);
+}
 
-    {
-        // this fixes unix issues if the first instance crashes
-        // see here for details: https://habrahabr.ru/post/173281/
-        QSharedMemory fix(mSharedMemKey);
-        fix.attach();
+/**
+ * Indexes all trigrams of the file names.
+ * @param fileNames the file names
+ **/
+void DkFileNameIndex::setFileNames(const QStringList &fileNames)
+{
+    mFileNames = fileNames;
+    mTrigrams.clear();
+    mHasLast = false;
+
+    for (int idx = 0; idx < mFileNames.size(); idx++) {
+        // case insensitive matching compares the case folded characters
+        QString fn = mFileNames[idx].toCaseFolded();
+
+        for (int cIdx = 0; cIdx + 3 <= fn.size(); cIdx++) {
+            QVector<int> &files = mTrigrams[trigram(fn.constData() + cIdx)];
+
+            // a name might contain a trigram twice
+            if (files.empty() || files.last() != idx)
+                files << idx;
+        }
     }
+}
 
-    lock.release();
+/**
+ * Returns all file names that match a query (see DkUtils::filterStringList).
+ * @param query the search terms or a regular expression
+ * @return QStringList the matching names in the order of the index
+ **/
+QStringList DkFileNameIndex::filter(const QString &query)
+{
+    QStringList terms = DkUtils::searchTerms(query);
+    QVector<int> hits;
+
+    // typing refines the results - unless the previous query ended with a (significant) space
+    if (mHasLast && query.startsWith(mLastQuery) && !mLastQuery.endsWith(" ")) {
+        for (int idx : mLastMatches) {
+            if (matches(idx, terms))
+                hits << idx;
+        }
+    } else {
+        for (int idx : candidates(terms)) {
+            if (matches(idx, terms))
+                hits << idx;
+        }
+    }
+
+    mLastQuery = query;
+    mLastMatches = hits;
+    mHasLast = true;
+
+    QStringList resultList;
+    for (int idx : hits)
+        resultList << mFileNames[idx];
+
+    // if string match returns nothing -> try a regexp
+    if (resultList.empty()) {
+        QRegularExpression regExp(query);
+        resultList = mFileNames.filter(regExp);
+
+        if (resultList.empty()) {
+            QString wildcardExp = QRegularExpression::wildcardToRegularExpression(query);
+            QRegularExpression re(QRegularExpression::anchoredPattern(wildcardExp), QRegularExpression::CaseInsensitiveOption);
+            resultList = mFileNames.filter(re);
+        }
+    }
+
+    return resultList;
 }
 
-DkRunGuard::~DkRunGuard()
+quint64 DkFileNameIndex::trigram(const QChar *c)
 {
-    QSystemSemaphore lock(mLockKey, 1);
-    lock.acquire();
+    return ((quint64)c[0].unicode() << 32) | ((quint64)c[1].unicode() << 16) | (quint64)c[2].unicode();
+}
 
-    if (mSharedMem.isAttached())
-        mSharedMem.detach();
+/**
+ * Returns all files that contain the trigrams of all terms.
+ * All files are candidates if no term has three characters.
+ **/
+QVector<int> DkFileNameIndex::candidates(const QStringList &terms) const
+{
+    QVector<int> result;
+    bool all = true;
 
-    lock.release();
+    for (const QString &t : terms) {
+        QString ft = t.toCaseFolded();
+
+        for (int cIdx = 0; cIdx + 3 <= ft.size(); cIdx++) {
+            auto it = mTrigrams.constFind(trigram(ft.constData() + cIdx));
+
+            // no file has this trigram
+            if (it == mTrigrams.constEnd())
+                return QVector<int>();
+
+            if (all) {
+                result = it.value();
+                all = false;
+            } else {
+                QVector<int> intersection;
+                std::set_intersection(result.begin(), result.end(), it->begin(), it->end(), std::back_inserter(intersection));
+                result = intersection;
+            }
+
+            if (result.empty())
+                return result;
+        }
+    }
+
+    if (all) {
+        result.resize(mFileNames.size());
+        for (int idx = 0; idx < result.size(); idx++)
+            result[idx] = idx;
+    }
+
+    return result;
 }
 
-/// <summary>
-/// Checks if this instance is the first running.
-/// If it's the first instance, a shared memory block is created.
-/// </summary>
-/// <returns>true if this is the first instance</returns>
+bool DkFileNameIndex::matches(int idx, const QStringList &terms) const
+{
+    for (const QString &t : terms) {
+        if (!mFileNames[idx].contains(t, Qt::CaseInsensitive))
+            return false;
+    }
+
+    return true;
+}
+
+// DkRunGuard --------------------------------------------------------------------
+// handed over files are prefixed with this magic number
+static const quint32 runGuardMagic = 0x6e6d6331; // nmc1
+
+DkRunGuard::DkRunGuard(QObject *parent)
+    : QObject(parent)
+{
+}
+
+DkRunGuard::~DkRunGuard()
+{
+    // removes the socket - the next instance that starts is the first
+    if (mServer)
+        mServer->close();
+}
+
+/**
+ * Checks if this instance is the first running.
+ * If nobody answers on the local socket, this instance starts listening on it.
+ * Hence, the lock is released if the first instance quits or crashes.
+ * @return bool true if this is the first instance
+ **/
 bool DkRunGuard::tryRunning()
 {
-    QSystemSemaphore lock(mLockKey, 1);
+    if (mServer)
+        return mServer->isListening();
+
+    // two instances that start at once must not both remove & listen
+    QSystemSemaphore lock(serverName() + "-lock", 1);
     lock.acquire();
 
-    // check if we can attach to the shared memory
-    // if not: we are the first
-    bool attached = mSharedMem.attach();
-    if (!attached)
-        mSharedMem.create(sizeof(quint64));
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
 
+    if (socket.waitForConnected(500)) {
+        socket.abort();
+        lock.release();
+        return false;
+    }
+
+    // nobody answers: a crashed instance might have left its socket file
+    QLocalServer::removeServer(serverName());
+
+    mServer = new QLocalServer(this);
+    mServer->setSocketOptions(QLocalServer::UserAccessOption);
+
+    bool listening = mServer->listen(serverName());
     lock.release();
 
-    return !attached;
+    if (!listening)
+        qWarning() << "[DkRunGuard] cannot listen:" << mServer->errorString();
+
+    return listening;
+}
+
+/**
+ * Accepts files of other instances.
+ * Call it if tryRunning() returned true and the window is ready -
+ * filesReceived() is emitted for every instance that hands over its files.
+ * Instances that connected meanwhile are waiting in the server's queue.
+ * @return bool true if the local server is listening
+ **/
+bool DkRunGuard::listen()
+{
+    if (!mServer || !mServer->isListening())
+        return false;
+
+    connect(mServer, SIGNAL(newConnection()), this, SLOT(newConnection()), Qt::UniqueConnection);
+    newConnection();
+
+    return true;
+}
+
+/**
+ * Hands the files over to the running instance.
+ * It retries for timeout ms since the running instance might still be starting.
+ * @param filePaths absolute file paths (an empty list just brings the running instance to front)
+ * @param timeout in ms
+ * @return bool true if the running instance accepted the files - start normally otherwise
+ **/
+bool DkRunGuard::sendFiles(const QStringList &filePaths, int timeout) const
+{
+    QElapsedTimer dt;
+    dt.start();
+
+    QLocalSocket socket;
+
+    for (;;) {
+        socket.connectToServer(serverName());
+
+        if (socket.waitForConnected(qMax(timeout - (int)dt.elapsed(), 1)))
+            break;
+
+        if (dt.elapsed() >= timeout) {
+            qInfo() << "[DkRunGuard] the running instance does not answer:" << socket.errorString();
+            return false;
+        }
+
+        QThread::msleep(50);
+    }
+
+#ifdef Q_OS_WIN
+    // the running instance is allowed to raise its window
+    AllowSetForegroundWindow(ASFW_ANY);
+#endif
+
+    QByteArray msg;
+    QDataStream ds(&msg, QIODevice::WriteOnly);
+    ds.setVersion(QDataStream::Qt_5_6);
+    ds << runGuardMagic << filePaths;
+
+    socket.write(msg);
+
+    // wait for the acknowledgment
+    if (!socket.waitForBytesWritten(timeout) || !socket.waitForReadyRead(timeout) || socket.read(1) != "1") {
+        qInfo() << "[DkRunGuard] the running instance did not accept the files";
+        return false;
+    }
+
+    socket.disconnectFromServer();
+
+    return true;
+}
+
+void DkRunGuard::newConnection()
+{
+    while (QLocalSocket *socket = mServer->nextPendingConnection()) {
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            QDataStream ds(socket);
+            ds.setVersion(QDataStream::Qt_5_6);
+            ds.startTransaction();
+
+            quint32 magic = 0;
+            QStringList filePaths;
+            ds >> magic >> filePaths;
+
+            // wait for the rest of the message
+            if (!ds.commitTransaction())
+                return;
+
+            if (magic != runGuardMagic) {
+                qWarning() << "[DkRunGuard] unknown message ignored";
+                socket->abort();
+                return;
+            }
+
+            socket->write("1");
+            socket->flush();
+
+            qInfo() << "[DkRunGuard] received" << filePaths.size() << "files from another instance";
+            emit filesReceived(filePaths);
+        });
+    }
+}
+
+/**
+ * The socket of the running instance (one per user).
+ * It is the lock of tryRunning() too.
+ **/
+QString DkRunGuard::serverName()
+{
+    QString user = qEnvironmentVariable("USER", qEnvironmentVariable("USERNAME"));
+
+    return "nomacs-run-guard-" + QString::number(qHash(user), 16);
 }
 
 }
@@ -32,11 +32,13 @@
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QHash>
+#include <QMutex>
 #include <QRegExp>
 #include <QVector>
 
-#include <QSharedMemory>
 #pragma warning(pop) // no warnings from includes - end
 
 #pragma warning(disable : 4251) // dll interface missing
@@ -93,6 +95,7 @@ DllCoreExport QDebug qWarningClean();
 
 // Qt defines
 class QComboBox;
+class QLocalServer;
 class QColor;
 class QUrl;
 
@@ -150,6 +153,8 @@ public:
 
     static bool naturalCompare(const QString &s1, const QString &s2, Qt::CaseSensitivity cs = Qt::CaseSensitive);
 
+    static QString naturalSortKey(const QString &str);
+
     static QString resolveSymLink(const QString &filePath);
 
     static QString getLongestNumber(const QString &str, int startIdx = 0);
@@ -160,6 +165,8 @@ public:
 
     static void logToFile(QtMsgType type, const QString &msg);
 
+    static QString logMessage(QtMsgType type, const QString &msg);
+
     static QString getLogFilePath();
 
     static QString getAppDataPath();
@@ -197,7 +204,9 @@ public:
     static QString colorToString(const QColor &col);
     static QString readableByte(float bytes);
     static QStringList filterStringList(const QString &query, const QStringList &list);
+    static QStringList searchTerms(const QString &query);
     static bool moveToTrash(const QString &filePath);
+    static bool isNetworkPath(const QString &path);
     static QList<QUrl> findUrlsInTextNewline(QString text);
 
 #ifdef WITH_OPENCV
@@ -450,6 +459,47 @@ class DllCoreExport DkMemory
 public:
     static double getTotalMemory();
     static double getFreeMemory();
+    static qint64 getProcessMemory();
+};
+
+/**
+ * Adapts the memory budgets to the system's memory pressure.
+ * Free memory (and the OS pressure signals on Linux, macOS and Windows)
+ * are sampled at most once per second. If plenty of memory is free, the
+ * cache may grow up to twice Resources::cacheMemory. Under pressure the
+ * cache, prefetching and history budgets are scaled down and the cold
+ * tiers (e.g. screen resolution images, thumbnails) are shed first.
+ * The governor is thread-safe.
+ **/
+class DllCoreExport DkMemoryGovernor
+{
+public:
+    enum Pressure {
+        pressure_none = 0,
+        pressure_moderate, // shed cold tiers
+        pressure_critical, // keep the current image only
+
+        pressure_end
+    };
+
+    static DkMemoryGovernor &instance();
+
+    Pressure pressure();
+    double cacheMemory();
+    double historyMemory();
+    int maxImagesCached();
+
+private:
+    DkMemoryGovernor();
+    DkMemoryGovernor(const DkMemoryGovernor &);
+
+    void sample();
+    static Pressure systemPressure();
+
+    QMutex mMutex;
+    QElapsedTimer mLastSample;
+    Pressure mPressure = pressure_none;
+    double mFreeMemory = -1; // MB
 };
 
 class DllCoreExport DkFileNameConverter
@@ -470,20 +520,66 @@ protected:
     int mCIdx;
 };
 
-// from: http://stackoverflow.com/questions/5006547/qt-best-practice-for-a-single-instance-app-protection
-class DllCoreExport DkRunGuard
+/**
+ * Trigram index of file names for incremental search.
+ * filter() has the semantics of DkUtils::filterStringList: all search terms
+ * must be in a file name (case insensitive), otherwise the query is matched
+ * as regular expression or wildcard. Only names that contain all trigrams of
+ * the terms are compared - and if the query extends the previous one
+ * (i.e. the user keeps typing), the previous results are refined.
+ **/
+class DllCoreExport DkFileNameIndex
+{
+public:
+    DkFileNameIndex(const QStringList &fileNames = QStringList());
+
+    void setFileNames(const QStringList &fileNames);
+    QStringList filter(const QString &query);
+
+protected:
+    static quint64 trigram(const QChar *c);
+    QVector<int> candidates(const QStringList &terms) const;
+    bool matches(int idx, const QStringList &terms) const;
+
+    QStringList mFileNames;
+    QHash<quint64, QVector<int>> mTrigrams; // trigram -> file indexes (sorted)
+
+    // the previous query - its results are refined if the query is extended
+    QString mLastQuery;
+    QVector<int> mLastMatches;
+    bool mHasLast = false;
+};
+
+/**
+ * Single instance support.
+ * The per-user local socket is the lock: the first instance listens on it
+ * (tryRunning) and accepts files once its window exists (listen).
+ * Later instances hand their files over (sendFiles) and quit - the first
+ * instance opens them with its warm caches instead of starting a whole new process.
+ * If the first instance quits, the next one that starts takes over.
+ **/
+class DllCoreExport DkRunGuard : public QObject
 {
+    Q_OBJECT
+
 public:
-    DkRunGuard();
+    DkRunGuard(QObject *parent = 0);
     ~DkRunGuard();
 
     bool tryRunning();
+    bool listen();
+    bool sendFiles(const QStringList &filePaths, int timeout = 3000) const;
+
+signals:
+    void filesReceived(const QStringList &filePaths) const;
+
+private slots:
+    void newConnection();
 
 private:
-    QString mSharedMemKey = "nomacs | run guard shared memory";
-    QString mLockKey = "nomacs | run guard semaphore";
+    static QString serverName();
 
-    QSharedMemory mSharedMem; /* gcc cannot deal with this: = mSharedMemKey;*/
+    QLocalServer *mServer = 0;
 
     Q_DISABLE_COPY(DkRunGuard)
 };
@@ -1663,6 +1663,9 @@ void DkBatchPluginWidget::addPlugins(QStandardItemModel *model) const
     QVector<QSharedPointer<DkPluginContainer>> plugins = DkPluginManager::instance().getBatchPlugins();
 
     for (auto p : plugins) {
+        if (!p->load())
+            continue;
+
         QStandardItem *mPluginItem = new QStandardItem(p->pluginName());
         mPluginItem->setEditable(false);
         mPluginItem->setCheckable(false);
@@ -1687,7 +1690,7 @@ void DkBatchPluginWidget::selectPlugin(const QString &pluginName)
     mCurrentPlugin = 0; // unset
     QSharedPointer<DkPluginContainer> plugin = DkPluginManager::instance().getPluginByName(pluginName);
 
-    if (!plugin || !plugin->batchPlugin()) {
+    if (!plugin || !plugin->load() || !plugin->batchPlugin()) {
         mSettingsTitle->setText("");
         mSettingsTitle->hide();
         mSettingsEditor->hide();
@@ -1961,6 +1964,7 @@ void DkBatchManipulatorWidget::selectManipulator(QSharedPointer<DkBaseManipulato
     // load the preview
     if (!mPreviewPath.isEmpty() && mPreview.isNull()) {
         DkBasicLoader bl;
+        bl.setTargetSize(QSize(mMaxPreview, mMaxPreview));
         if (bl.loadGeneral(mPreviewPath)) {
             QImage img = bl.image();
 
@@ -2343,10 +2347,28 @@ void DkBatchInfoWidget::createLayout()
 
     mIcon = new QLabel(this);
 
+    // the profile of the last run
+    mReport = new QLabel(this);
+    mReport->setObjectName("BatchInfo");
+    mReport->setWordWrap(true);
+    mReport->hide();
+
+    mExportButton = new QPushButton(tr("Export Report"), this);
+    mExportButton->setToolTip(tr("Saves the stage timings of the last run as CSV or JSON"));
+    mExportButton->hide();
+    connect(mExportButton, SIGNAL(clicked()), this, SIGNAL(exportReportSignal()));
+
+    QWidget *textWidget = new QWidget(this);
+    QVBoxLayout *textLayout = new QVBoxLayout(textWidget);
+    textLayout->setContentsMargins(0, 0, 0, 0);
+    textLayout->addWidget(mInfo);
+    textLayout->addWidget(mReport);
+    textLayout->addWidget(mExportButton, 0, Qt::AlignLeft);
+
     QHBoxLayout *layout = new QHBoxLayout(this);
     layout->setAlignment(Qt::AlignLeft);
-    layout->addWidget(mIcon);
-    layout->addWidget(mInfo);
+    layout->addWidget(mIcon, 0, Qt::AlignTop);
+    layout->addWidget(textWidget);
 }
 
 void DkBatchInfoWidget::setInfo(const QString &message, const InfoMode &mode)
@@ -2374,6 +2396,17 @@ void DkBatchInfoWidget::setInfo(const QString &message, const InfoMode &mode)
     mInfo->setText(message);
 }
 
+/**
+ * Shows the throughput & bottleneck of a batch run.
+ * @param summary the report's summary - hides the report if it is empty
+ **/
+void DkBatchInfoWidget::setReport(const QString &summary)
+{
+    mReport->setText(summary);
+    mReport->setVisible(!summary.isEmpty());
+    mExportButton->setVisible(!summary.isEmpty());
+}
+
 // Batch Widget --------------------------------------------------------------------
 DkBatchWidget::DkBatchWidget(const QString &currentDirectory, QWidget *parent /* = 0 */)
     : DkFadeWidget(parent)
@@ -2526,6 +2559,7 @@ void DkBatchWidget::createLayout()
 
     connect(mButtonWidget, SIGNAL(playSignal(bool)), this, SLOT(toggleBatch(bool)));
     connect(mButtonWidget, SIGNAL(showLogSignal()), this, SLOT(showLog()));
+    connect(mInfoWidget, SIGNAL(exportReportSignal()), this, SLOT(exportReport()));
     connect(this,
             SIGNAL(infoSignal(const QString &, const DkBatchInfoWidget::InfoMode &)),
             mInfoWidget,
@@ -2762,6 +2796,7 @@ void DkBatchWidget::startProcessing()
 {
     inputWidget()->startProcessing();
     mInfoWidget->setInfo("");
+    mInfoWidget->setReport("");
 
     // mProgressBar->setFixedWidth(100);
     qDebug() << "progressbar width: " << mProgressBar->width();
@@ -2797,6 +2832,7 @@ void DkBatchWidget::stopProcessing()
 
     DkBatchInfoWidget::InfoMode im = (numFailures > 0) ? DkBatchInfoWidget::InfoMode::info_warning : DkBatchInfoWidget::InfoMode::info_message;
     mInfoWidget->setInfo(tr("%1/%2 files processed... %3 failed.").arg(numProcessed).arg(numItems).arg(numFailures), im);
+    mInfoWidget->setReport(mBatchProcessing->getReport().summary());
 
     mLogNeedsUpdate = false;
     mLogUpdateTimer.stop();
@@ -2829,6 +2865,36 @@ void DkBatchWidget::showLog()
     textDialog->exec();
 }
 
+void DkBatchWidget::exportReport()
+{
+    DkBatchReport report = mBatchProcessing->getReport();
+
+    if (report.isEmpty())
+        return;
+
+    QString csvFilter = tr("CSV (*.csv)");
+    QString jsonFilter = tr("JSON (*.json)");
+    QString selFilter = csvFilter;
+
+    QString expPath = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + QDir::separator() + "batch-report.csv";
+    QString sPath = QFileDialog::getSaveFileName(this,
+                                                 tr("Export Batch Report"),
+                                                 expPath,
+                                                 csvFilter + ";;" + jsonFilter,
+                                                 &selFilter,
+                                                 DkDialog::fileDialogOptions());
+
+    if (sPath.isEmpty())
+        return;
+
+    // the dialog does not append the suffix on all platforms
+    if (QFileInfo(sPath).suffix().isEmpty())
+        sPath += selFilter == jsonFilter ? ".json" : ".csv";
+
+    if (!report.save(sPath))
+        QMessageBox::critical(this, tr("Export Batch Report"), tr("Sorry, I cannot write to %1").arg(sPath), QMessageBox::Ok);
+}
+
 void DkBatchWidget::setSelectedFiles(const QStringList &selFiles)
 {
     if (!selFiles.empty()) {
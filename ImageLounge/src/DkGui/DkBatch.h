@@ -603,12 +603,18 @@ public:
 
 public slots:
     void setInfo(const QString &message, const DkBatchInfoWidget::InfoMode &mode = DkBatchInfoWidget::InfoMode::info_message);
+    void setReport(const QString &summary);
+
+signals:
+    void exportReportSignal() const;
 
 protected:
     void createLayout();
 
     QLabel *mInfo = 0;
     QLabel *mIcon = 0;
+    QLabel *mReport = 0;
+    QPushButton *mExportButton = 0;
 };
 
 class DkBatchWidget : public DkFadeWidget
@@ -636,6 +642,7 @@ public slots:
     void toggleBatch(bool start);
     void widgetChanged();
     void showLog();
+    void exportReport();
     void processingFinished();
     void updateProgress(int progress);
     void updateLog();
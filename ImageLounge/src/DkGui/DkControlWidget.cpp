@@ -291,6 +291,7 @@ void DkControlWidget::connectWidgets()
     // playing
     connect(mPlayer, SIGNAL(previousSignal()), mViewport, SLOT(loadPrevFileFast()));
     connect(mPlayer, SIGNAL(nextSignal()), mViewport, SLOT(loadNextFileFast()));
+    connect(mPlayer, SIGNAL(autoNextSignal()), mViewport, SLOT(loadNextSlide()));
 
     // cropping
     connect(mCropWidget,
@@ -489,7 +490,7 @@ void DkControlWidget::showHistogram(bool visible)
     if (visible && !mHistogram->isVisible()) {
         mHistogram->show();
         if (!mViewport->getImage().isNull())
-            mHistogram->drawHistogram(mViewport->getImage());
+            mHistogram->drawHistogram(mViewport->getImage(), mViewport->imageContainer(), mViewport->getImageStorage()->sampleImage(DkImageHistogram::sample_pixels));
         else
             mHistogram->clearHistogram();
     } else if (!visible && mHistogram->isVisible()) {
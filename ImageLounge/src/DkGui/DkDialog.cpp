@@ -32,6 +32,9 @@
 #include "DkBasicWidgets.h"
 #include "DkCentralWidget.h"
 #include "DkImageStorage.h"
+#include "DkLog.h"
+#include "DkMetaData.h"
+#include "DkMosaicDatabase.h"
 #include "DkPluginManager.h"
 #include "DkSettings.h"
 #include "DkThumbs.h"
@@ -55,6 +58,7 @@
 #include <QDesktopServices>
 #include <QDesktopWidget>
 #include <QDialogButtonBox>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QFormLayout>
@@ -71,14 +75,13 @@
 #include <QMessageBox>
 #include <QMimeData>
 #include <QMouseEvent>
+#include <QMutex>
 #include <QPageSetupDialog>
 #include <QPrintDialog>
 #include <QPrinterInfo>
 #include <QProgressBar>
-#include <QProgressDialog>
 #include <QPushButton>
 #include <QRadioButton>
-#include <QRandomGenerator>
 #include <QScreen>
 #include <QSlider>
 #include <QSpinBox>
@@ -92,9 +95,14 @@
 #include <QToolButton>
 #include <QTreeView>
 #include <QWidget>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 #include <qmath.h>
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
 // quazip
 #ifdef WITH_QUAZIP
 #ifdef WITH_QUAZIP1
@@ -442,9 +450,9 @@ void DkTrainDialog::accept()
         QStringList userFilters = settings.value("ResourceSettings/userFilters", QStringList()).toStringList();
         userFilters.append(tag);
         settings.setValue("ResourceSettings/userFilters", userFilters);
-        DkSettingsManager::param().app().openFilters.append(tag);
-        DkSettingsManager::param().app().fileFilters.append("*." + acceptedFileInfo.suffix());
-        DkSettingsManager::param().app().browseFilters += acceptedFileInfo.suffix();
+        DkSettingsManager::edit().app().openFilters.append(tag);
+        DkSettingsManager::edit().app().fileFilters.append("*." + acceptedFileInfo.suffix());
+        DkSettingsManager::edit().app().browseFilters += acceptedFileInfo.suffix();
     }
 
     QDialog::accept();
@@ -674,6 +682,7 @@ void DkSearchDialog::init()
 void DkSearchDialog::setFiles(const QStringList &fileList)
 {
     mFileList = fileList;
+    mFileIndex.setFileNames(fileList);
     mResultList = fileList;
     mStringModel->setStringList(makeViewable(fileList));
 }
@@ -695,7 +704,7 @@ void DkSearchDialog::on_searchBar_textChanged(const QString &text)
     if (text == mCurrentSearch)
         return;
 
-    mResultList = DkUtils::filterStringList(text, mFileList);
+    mResultList = mFileIndex.filter(text);
     qDebug() << "searching [" << text << "] - converted to individual keywords [" << text.split(" ") << "] takes: " << dt;
     mCurrentSearch = text;
 
@@ -782,11 +791,11 @@ void DkSearchDialog::setDefaultButton(int defaultButton /* = find_button */)
 
 void DkSearchDialog::updateHistory()
 {
-    DkSettingsManager::param().global().searchHistory.append(mCurrentSearch);
+    DkSettingsManager::edit().global().searchHistory.append(mCurrentSearch);
 
     // keep the history small
     if (DkSettingsManager::param().global().searchHistory.size() > 50)
-        DkSettingsManager::param().global().searchHistory.pop_front();
+        DkSettingsManager::edit().global().searchHistory.pop_front();
 
     // QCompleter* history = new QCompleter(DkSettingsManager::param().global().searchHistory);
     // searchBar->setCompleter(history);
@@ -2159,29 +2168,35 @@ void DkPrintPreviewDialog::createLayout()
     setLayout(layout);
 }
 
+// zooming does not emit previewChanged() - so we check the preview's resolution ourselves
 void DkPrintPreviewDialog::zoomIn()
 {
     mPreview->zoomIn();
+    mPreview->checkPreviewResolution();
 }
 
 void DkPrintPreviewDialog::zoomOut()
 {
     mPreview->zoomOut();
+    mPreview->checkPreviewResolution();
 }
 
 void DkPrintPreviewDialog::zoom(int scale)
 {
     mPreview->setZoomFactor(scale / 100.0);
+    mPreview->checkPreviewResolution();
 }
 
 void DkPrintPreviewDialog::previewFitWidth()
 {
     mPreview->fitToWidth();
+    mPreview->checkPreviewResolution();
 }
 
 void DkPrintPreviewDialog::previewFitPage()
 {
     mPreview->fitInView();
+    mPreview->checkPreviewResolution();
 }
 
 void DkPrintPreviewDialog::updateDpiFactor(qreal dpi)
@@ -2225,6 +2240,7 @@ DkPrintPreviewWidget::DkPrintPreviewWidget(QPrinter *printer, QWidget *parent, Q
 {
     mPrinter = printer;
     connect(this, SIGNAL(paintRequested(QPrinter *)), this, SLOT(paintPreview(QPrinter *)));
+    connect(this, SIGNAL(previewChanged()), this, SLOT(checkPreviewResolution()));
 }
 
 void DkPrintPreviewWidget::paintEvent(QPaintEvent *event)
@@ -2281,6 +2297,7 @@ void DkPrintPreviewWidget::wheelEvent(QWheelEvent *event)
         zoomIn();
     else
         zoomOut();
+    checkPreviewResolution();
     emit zoomChanged();
 
     QPrintPreviewWidget::wheelEvent(event);
@@ -2322,12 +2339,34 @@ void DkPrintPreviewWidget::changeDpi(int value)
     updatePreview();
 }
 
+/**
+ * Returns the on-screen pixels per printer pixel.
+ **/
+double DkPrintPreviewWidget::screenScale(QPrinter *printer) const
+{
+    return zoomFactor() * logicalDpiX() / qMax(printer->resolution(), 1) * devicePixelRatioF();
+}
+
+/**
+ * Repaints the preview if it is zoomed beyond the resolution of its images.
+ * Zooming only rescales the recorded pages - so we need to paint them again.
+ **/
+void DkPrintPreviewWidget::checkPreviewResolution()
+{
+    if (!mPrintImages.isEmpty() && zoomFactor() > mPreviewZoom * 1.01)
+        updatePreview();
+}
+
 void DkPrintPreviewWidget::paintPreview(QPrinter *printer)
 {
     QPainter painter(printer);
 
+    // the pages are recorded and rescaled when zooming - so draw them for a 2x zoom
+    mPreviewZoom = zoomFactor() * 2.0;
+    double scale = screenScale(printer) * 2.0;
+
     for (auto pi : mPrintImages) {
-        pi->draw(painter);
+        pi->drawPreview(painter, scale);
 
         if (pi != mPrintImages.last())
             printer->newPage();
@@ -2341,7 +2380,7 @@ void DkPrintPreviewWidget::paintForPrinting()
     QPainter painter(mPrinter);
 
     for (int idx = mPrinter->fromPage(); idx <= to && idx < mPrintImages.size(); idx++) {
-        mPrintImages[idx]->draw(painter, true);
+        mPrintImages[idx]->print(painter);
 
         if (idx + 1 < to)
             mPrinter->newPage();
@@ -2599,40 +2638,83 @@ int DkExportTiffDialog::exportImages(const QString &saveFilePath, int from, int
 
     QFileInfo saveInfo(saveFilePath);
 
-    // Do your job
-    for (int idx = from; idx <= to; idx++) {
+    QVector<int> pages;
+    for (int idx = from; idx <= to; idx++)
+        pages << idx;
+
+    QSharedPointer<DkMetaDataT> metaData = mLoader.getMetaData();
+    QMutex metaDataMutex;
+
+    QAtomicInt numProcessed = 0;
+
+    // the preview is updated at most 4 times a second
+    QElapsedTimer previewTimer;
+    QMutex previewMutex;
+
+    // pages are decoded (each with its own TIFF handle) & encoded in parallel
+    QtConcurrent::blockingMap(pages, [&](int idx) {
+        // user canceled?
+        if (!mProcessing)
+            return;
+
         QFileInfo cInfo(saveInfo.absolutePath(), saveInfo.baseName() + QString::number(idx) + "." + saveInfo.suffix());
         qDebug() << "trying to save: " << cInfo.absoluteFilePath();
 
-        emit updateProgress(idx - 1);
-
         // user wants to overwrite files
         if (cInfo.exists() && overwrite) {
             QFile f(cInfo.absoluteFilePath());
             f.remove();
         } else if (cInfo.exists()) {
             emit infoMessage(tr("%1 exists, skipping...").arg(cInfo.fileName()));
-            continue;
+            emit updateProgress(from + numProcessed.fetchAndAddOrdered(1));
+            return;
         }
 
-        if (!mLoader.loadPageAt(idx)) { // load next
+        QImage img = mLoader.decodePageAt(idx);
+
+        if (img.isNull()) {
             emit infoMessage(tr("Sorry, I could not load page: %1").arg(idx));
-            continue;
+            emit updateProgress(from + numProcessed.fetchAndAddOrdered(1));
+            return;
         }
 
-        QString lSaveFilePath = mLoader.save(cInfo.absoluteFilePath(), mLoader.image(), 90); // TODO: ask user for compression?
-        QFileInfo lSaveInfo = QFileInfo(lSaveFilePath);
+        QSharedPointer<QByteArray> ba;
+        bool saved = mLoader.encodeToBuffer(cInfo.absoluteFilePath(), img, ba, 90); // TODO: ask user for compression?
+
+        if (saved) {
+            // pages share the TIFF's metadata - each gets its own copy
+            QSharedPointer<DkMetaDataT> pageMetaData;
+            if (metaData) {
+                QMutexLocker locker(&metaDataMutex);
+                pageMetaData = metaData->copy();
+            }
+
+            if (DkBasicLoader::prepareMetaData(pageMetaData, cInfo.absoluteFilePath(), img, ba))
+                DkBasicLoader::injectMetaData(pageMetaData, ba);
 
-        if (!lSaveInfo.exists() || !lSaveInfo.isFile())
+            saved = mLoader.writeBufferToFile(cInfo.absoluteFilePath(), ba);
+        }
+
+        if (!saved)
             emit infoMessage(tr("Sorry, I could not save: %1").arg(cInfo.fileName()));
 
-        emit updateImage(mLoader.image());
-        emit updateProgress(idx);
+        bool updatePreview = false;
+        {
+            QMutexLocker locker(&previewMutex);
+            if (!previewTimer.isValid() || previewTimer.elapsed() > 250) {
+                previewTimer.start();
+                updatePreview = true;
+            }
+        }
 
-        // user canceled?
-        if (!mProcessing)
-            return QDialog::Rejected;
-    }
+        if (updatePreview)
+            emit updateImage(img.scaled(QSize(1024, 1024), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+
+        emit updateProgress(from + numProcessed.fetchAndAddOrdered(1));
+    });
+
+    if (!mProcessing)
+        return QDialog::Rejected;
 
     mProcessing = false;
 
@@ -3139,11 +3221,6 @@ int DkMosaicDialog::computeMosaic(const QString &filter, const QString &suffix,
     cv::split(mImgLab, channels);
     cv::Mat imgL = channels[0];
 
-    // keeps track of the weights
-    cv::Mat cc(numPatches.height(), numPatches.width(), CV_32FC1);
-    cc.setTo(0);
-    cv::Mat ccD(numPatches.height(), numPatches.width(), CV_8UC1); // tells us if we have already computed the real patch
-
     mFilesUsed.resize(numPatches.height() * numPatches.width());
 
     // destination image
@@ -3154,159 +3231,156 @@ int DkMosaicDialog::computeMosaic(const QString &filter, const QString &suffix,
     cv::Mat pImg(patchResO * numPatches.height(), patchResO * numPatches.width(), CV_8UC1);
     pImg = 255;
 
-    qDebug() << "mosaic data --------------------------------";
-    qDebug() << "patchRes: " << patchResD;
-    qDebug() << "new resolution: " << dImg.cols << " x " << dImg.rows;
-    qDebug() << "num patches: " << numPatches.width() << " x " << numPatches.height();
-    qDebug() << "mosaic data --------------------------------";
+    qCDebug(lcMosaic) << "mosaic data --------------------------------";
+    qCDebug(lcMosaic) << "patchRes: " << patchResD;
+    qCDebug(lcMosaic) << "new resolution: " << dImg.cols << " x " << dImg.rows;
+    qCDebug(lcMosaic) << "num patches: " << numPatches.width() << " x " << numPatches.height();
+    qCDebug(lcMosaic) << "mosaic data --------------------------------";
 
-    // progress bar
-    int pIdx = 0;
     int maxP = numPatches.width() * numPatches.height();
 
-    int iDidNothing = 0;
-    bool force = false;
-    bool useTwice = false;
+    // index the database - descriptors of known images are loaded from the cache
+    emit infoMessage(tr("Indexing %1...").arg(mSavePath));
 
-    while (iDidNothing < 10000) {
-        if (!mProcessing)
-            return QDialog::Rejected;
-
-        if (iDidNothing > 100) {
-            force = true;
+    DkMosaicDatabase db(mSavePath, filter, suffix);
+    bool indexed = db.build([this](int numIndexed, int numImages) {
+        emit updateProgress(qRound((float)numIndexed / numImages * 30));
+        return mProcessing;
+    });
 
-            if (!useTwice)
-                emit infoMessage(tr("Filling empty areas..."));
-        }
-
-        if (iDidNothing > 400 && !useTwice) {
-            emit infoMessage(tr("I need to use some images twice - maybe the database is too small?"));
-            iDidNothing = 0;
-            useTwice = true;
-        } else if (iDidNothing > 400) {
-            emit infoMessage(tr("Sorry, it seems that i cannot create your mosaic with this database."));
-            return QDialog::Rejected;
-        }
+    if (!indexed || !mProcessing)
+        return QDialog::Rejected;
 
-        QString imgPath = getRandomImagePath(mSavePath, filter, suffix);
+    if (db.size() == 0) {
+        emit infoMessage(tr("Sorry, it seems that i cannot create your mosaic with this database."));
+        return QDialog::Rejected;
+    }
 
-        if (!useTwice && mFilesUsed.contains(QFileInfo(imgPath))) {
-            iDidNothing++;
-            continue;
-        }
+    bool useTwice = db.size() < maxP;
+    emit infoMessage(useTwice ? tr("I need to use some images twice - maybe the database is too small?") : QString());
 
-        try {
-            DkThumbNail thumb = DkThumbNail(imgPath);
-            thumb.compute();
+    // the patches of the cropped source image
+    QImage srcImg = mLoader.image().copy(qFloor(shC), qFloor(shR), patchResO * numPatches.width(), patchResO * numPatches.height());
 
-            cv::Mat ccTmp(cc.size(), cc.depth());
+    QVector<int> patchIdxs(maxP);
+    std::iota(patchIdxs.begin(), patchIdxs.end(), 0);
 
-            if (!force)
-                ccTmp.setTo(0);
-            else
-                ccTmp = cc.clone();
+    // find the nearest neighbours of all patches
+    const int numCandidates = 8;
+    QVector<QVector<float>> patchDescs(maxP);
+    QVector<QVector<QPair<float, int>>> candidates(maxP);
+    QVector<float> *descPtr = patchDescs.data();
+    QVector<QPair<float, int>> *candPtr = candidates.data();
 
-            cv::Mat thumbPatch = createPatch(thumb, patchResO);
+    QtConcurrent::blockingMap(patchIdxs, [&](int pIdx) {
+        if (!mProcessing)
+            return;
+
+        int rIdx = pIdx / numPatches.width();
+        int cIdx = pIdx % numPatches.width();
+
+        descPtr[pIdx] = DkMosaicDatabase::descriptor(srcImg.copy(cIdx * patchResO, rIdx * patchResO, patchResO, patchResO));
+        candPtr[pIdx] = db.nearest(descPtr[pIdx], numCandidates);
+    });
+
+    if (!mProcessing)
+        return QDialog::Rejected;
+
+    // assign images - the best matching patches choose first
+    QVector<int> order = patchIdxs;
+    std::stable_sort(order.begin(), order.end(), [&](int p1, int p2) {
+        float d1 = candidates[p1].isEmpty() ? std::numeric_limits<float>::max() : candidates[p1].first().first;
+        float d2 = candidates[p2].isEmpty() ? std::numeric_limits<float>::max() : candidates[p2].first().first;
+        return d1 < d2;
+    });
+
+    QVector<bool> used(db.size(), false);
+    QVector<int> assigned(maxP, -1);
+    int numUsed = 0;
+
+    for (int pIdx : order) {
+        // every image was used once - start over
+        if (numUsed == db.size()) {
+            used.fill(false);
+            numUsed = 0;
+        }
 
-            if (thumbPatch.rows != patchResO || thumbPatch.cols != patchResO) {
-                iDidNothing++;
-                continue;
+        for (const QPair<float, int> &c : candidates[pIdx]) {
+            if (!used[c.second]) {
+                assigned[pIdx] = c.second;
+                break;
             }
+        }
 
-            matchPatch(imgL, thumbPatch, patchResO, ccTmp);
-
-            if (force) {
-                cv::Mat mask = (cc == 0);
-                mask.convertTo(mask, CV_32FC1, 1.0f / 255.0f);
-                ccTmp = ccTmp.mul(mask);
-            }
+        // all candidates are taken - search the remaining images
+        if (assigned[pIdx] == -1) {
+            QVector<QPair<float, int>> n = db.nearest(patchDescs[pIdx], 1, used);
+            if (!n.isEmpty())
+                assigned[pIdx] = n.first().second;
+        }
 
-            double maxVal = 0;
-            cv::Point maxIdx;
-            cv::minMaxLoc(ccTmp, 0, &maxVal, 0, &maxIdx);
-            float *ccPtr = cc.ptr<float>(maxIdx.y);
-
-            if (maxVal > ccPtr[maxIdx.x]) {
-                cv::Mat pPatch =
-                    pImg.rowRange(maxIdx.y * patchResO, maxIdx.y * patchResO + patchResO).colRange(maxIdx.x * patchResO, maxIdx.x * patchResO + patchResO);
-                thumbPatch.copyTo(pPatch);
-
-                // visualize
-                if (pIdx % 10 == 0) {
-                    channels[0] = pImg;
-
-                    // debug
-                    cv::Mat imgT3;
-                    cv::merge(channels, imgT3);
-                    cv::cvtColor(imgT3, imgT3, CV_Lab2BGR);
-                    emit updateImage(DkImage::mat2QImage(imgT3));
-                }
+        if (assigned[pIdx] == -1)
+            continue;
 
-                if (ccPtr[maxIdx.x] == 0) {
-                    pIdx++;
-                    emit updateProgress(qRound((float)pIdx / maxP * 100));
-                }
+        used[assigned[pIdx]] = true;
+        numUsed++;
+        mFilesUsed[pIdx] = QFileInfo(db.entry(assigned[pIdx]).filePath);
+    }
 
-                // compute it now if we already have the full image loaded
-                if (thumb.getImage().width() > patchResD && thumb.getImage().height() > patchResD) {
-                    thumbPatch = createPatch(thumb, patchResD);
+    // render the patches in parallel
+    QAtomicInt numRendered = 0;
+    QMutex patchMutex;
+    QElapsedTimer previewTimer;
+    previewTimer.start();
 
-                    cv::Mat dPatch =
-                        dImg.rowRange(maxIdx.y * patchResD, maxIdx.y * patchResD + patchResD).colRange(maxIdx.x * patchResD, maxIdx.x * patchResD + patchResD);
-                    thumbPatch.copyTo(dPatch);
-                    ccD.ptr<unsigned char>(maxIdx.y)[maxIdx.x] = 1;
-                } else
-                    ccD.ptr<unsigned char>(maxIdx.y)[maxIdx.x] = 0;
+    QtConcurrent::blockingMap(patchIdxs, [&](int pIdx) {
+        if (!mProcessing || assigned[pIdx] == -1)
+            return;
 
-                // update cc
-                ccPtr[maxIdx.x] = (float)maxVal;
+        int rIdx = pIdx / numPatches.width();
+        int cIdx = pIdx % numPatches.width();
 
-                mFilesUsed[maxIdx.y * numPatchesH + maxIdx.x] = thumb.getFilePath(); // replaces additionally the old file
-                iDidNothing = 0;
-            } else
-                iDidNothing++;
-        }
-        // catch cv exceptions e.g. out of memory
-        catch (...) {
-            iDidNothing++;
-        }
+        try {
+            DkThumbNail thumb(db.entry(assigned[pIdx]).filePath);
+            thumb.compute();
 
-        // are we done yet?
-        double minVal = 0;
-        cv::minMaxLoc(cc, &minVal);
+            cv::Mat thumbPatch = createPatch(thumb, patchResD);
+            cv::Mat previewPatch;
+            cv::resize(thumbPatch, previewPatch, cv::Size(patchResO, patchResO), 0.0, 0.0, CV_INTER_AREA);
 
-        if (minVal > 0)
-            break;
-    }
+            QMutexLocker locker(&patchMutex);
 
-    pIdx = 0;
+            cv::Mat dPatch = dImg.rowRange(rIdx * patchResD, rIdx * patchResD + patchResD).colRange(cIdx * patchResD, cIdx * patchResD + patchResD);
+            thumbPatch.copyTo(dPatch);
 
-    // compute real resolution
-    for (int rIdx = 0; rIdx < ccD.rows; rIdx++) {
-        const unsigned char *ccDPtr = ccD.ptr<unsigned char>(rIdx);
+            cv::Mat pPatch = pImg.rowRange(rIdx * patchResO, rIdx * patchResO + patchResO).colRange(cIdx * patchResO, cIdx * patchResO + patchResO);
+            previewPatch.copyTo(pPatch);
 
-        for (int cIdx = 0; cIdx < ccD.cols; cIdx++) {
-            // is the patch already computed?
-            if (ccDPtr[cIdx])
-                continue;
+            // visualize
+            if (previewTimer.elapsed() > 250) {
+                previewTimer.restart();
 
-            QFileInfo cFile = mFilesUsed.at(rIdx * ccD.cols + cIdx);
+                std::vector<cv::Mat> pChannels = channels;
+                pChannels[0] = pImg;
 
-            if (!cFile.exists()) {
-                emit infoMessage(tr("Something is seriously wrong, I could not load: %1").arg(cFile.absoluteFilePath()));
-                continue;
+                cv::Mat imgT3;
+                cv::merge(pChannels, imgT3);
+                cv::cvtColor(imgT3, imgT3, CV_Lab2BGR);
+                emit updateImage(DkImage::mat2QImage(imgT3));
             }
+        }
+        // catch cv exceptions e.g. out of memory
+        catch (...) {
+            emit infoMessage(tr("Something is seriously wrong, I could not load: %1").arg(db.entry(assigned[pIdx]).filePath));
+        }
 
-            cv::Mat thumbPatch = createPatch(DkThumbNail(cFile.absoluteFilePath()), patchResD);
+        emit updateProgress(30 + qRound((float)(numRendered.fetchAndAddOrdered(1) + 1) / maxP * 70));
+    });
 
-            cv::Mat dPatch = dImg.rowRange(rIdx * patchResD, rIdx * patchResD + patchResD).colRange(cIdx * patchResD, cIdx * patchResD + patchResD);
-            thumbPatch.copyTo(dPatch);
-            emit updateProgress(qRound((float)pIdx / maxP * 100));
-            pIdx++;
-        }
-    }
+    if (!mProcessing)
+        return QDialog::Rejected;
 
-    qDebug() << "I fully rendered: " << ccD.rows * ccD.cols - cv::sum(ccD)[0] << " images";
+    qCDebug(lcMosaic) << "I rendered" << numRendered.loadAcquire() << "patches from" << numUsed << "images";
 
     // create final images
     mOrigImg = mImgLab;
@@ -3315,31 +3389,11 @@ int DkMosaicDialog::computeMosaic(const QString &filter, const QString &suffix,
 
     mProcessing = false;
 
-    qDebug() << "mosaic computed in: " << dt;
+    qCDebug(lcMosaic) << "mosaic computed in: " << dt;
 
     return QDialog::Accepted;
 }
 
-void DkMosaicDialog::matchPatch(const cv::Mat &img, const cv::Mat &thumb, int patchRes, cv::Mat &cc)
-{
-    for (int rIdx = 0; rIdx < cc.rows; rIdx++) {
-        float *ccPtr = cc.ptr<float>(rIdx);
-        const cv::Mat imgStrip = img.rowRange(rIdx * patchRes, rIdx * patchRes + patchRes);
-
-        for (int cIdx = 0; cIdx < cc.cols; cIdx++) {
-            // already computed?
-            if (ccPtr[cIdx] != 0)
-                continue;
-
-            const cv::Mat cPatch = imgStrip.colRange(cIdx * patchRes, cIdx * patchRes + patchRes);
-
-            cv::Mat absDiff;
-            cv::absdiff(cPatch, thumb, absDiff);
-            ccPtr[cIdx] = 1.0f - ((float)cv::sum(absDiff)[0] / (patchRes * patchRes * 255));
-        }
-    }
-}
-
 cv::Mat DkMosaicDialog::createPatch(const DkThumbNail &thumb, int patchRes)
 {
     QImage img;
@@ -3347,13 +3401,14 @@ cv::Mat DkMosaicDialog::createPatch(const DkThumbNail &thumb, int patchRes)
     // load full image if we have not enough resolution
     if (thumb.getImage().isNull() || qMin(thumb.getImage().width(), thumb.getImage().height()) < patchRes) {
         DkBasicLoader loader;
+        loader.setTargetSize(QSize(patchRes, patchRes));
         loader.loadGeneral(thumb.getFilePath(), true, true);
         img = loader.image();
     } else
         img = thumb.getImage();
 
-    cv::Mat cvThumb = DkImage::qImage2Mat(img);
-    cv::cvtColor(cvThumb, cvThumb, CV_RGB2Lab);
+    cv::Mat cvThumb;
+    cv::cvtColor(DkImage::qImage2MatView(img), cvThumb, CV_RGB2Lab);
     std::vector<cv::Mat> channels;
     cv::split(cvThumb, channels);
     cvThumb = channels[0];
@@ -3371,62 +3426,13 @@ cv::Mat DkMosaicDialog::createPatch(const DkThumbNail &thumb, int patchRes)
     }
 
     if (cvThumb.rows < patchRes || cvThumb.cols < patchRes)
-        qDebug() << "enlarging thumbs!!";
+        qCDebug(lcMosaic) << "enlarging thumbs!!";
 
     cv::resize(cvThumb, cvThumb, cv::Size(patchRes, patchRes), 0.0, 0.0, CV_INTER_AREA);
 
     return cvThumb;
 }
 
-QString DkMosaicDialog::getRandomImagePath(const QString &cPath, const QString &ignore, const QString &suffix)
-{
-    // TODO: remove hierarchy
-    QStringList fileFilters = (suffix.isEmpty()) ? DkSettingsManager::param().app().fileFilters : QStringList(suffix);
-
-    // get all dirs
-    QFileInfoList entries = QDir(cPath).entryInfoList(QStringList(), QDir::AllDirs | QDir::NoDotAndDotDot);
-    // qDebug() << entries;
-    //  get all files
-    entries += QDir(cPath).entryInfoList(fileFilters);
-    // qDebug() << "current entries: " << e;
-
-    if (!ignore.isEmpty()) {
-        QStringList ignoreList = ignore.split(";");
-        QFileInfoList entriesTmp = entries;
-        entries.clear();
-
-        for (int idx = 0; idx < entriesTmp.size(); idx++) {
-            bool lIgnore = false;
-            QString p = entriesTmp.at(idx).absoluteFilePath();
-
-            for (int iIdx = 0; iIdx < ignoreList.size(); iIdx++) {
-                if (p.contains(ignoreList.at(iIdx))) {
-                    lIgnore = true;
-                    break;
-                }
-            }
-
-            if (!lIgnore)
-                entries.append(entriesTmp.at(idx));
-        }
-    }
-
-    if (entries.isEmpty())
-        return QString();
-
-    int rIdx = qRound(QRandomGenerator::global()->generateDouble() * (entries.size() - 1));
-
-    // qDebug() << "rand index: " << rIdx;
-
-    QFileInfo rPath = entries.at(rIdx);
-    // qDebug() << rPath.absoluteFilePath();
-
-    if (rPath.isDir())
-        return getRandomImagePath(rPath.absoluteFilePath(), ignore, suffix);
-    else
-        return rPath.absoluteFilePath();
-}
-
 void DkMosaicDialog::updatePostProcess()
 {
     if (mMosaicMat.empty() || mProcessing)
@@ -3467,7 +3473,7 @@ bool DkMosaicDialog::postProcessMosaic(float multiply /* = 0.3 */, float screen
 {
     mPostProcessing = true;
 
-    qDebug() << "darken: " << multiply << " lighten: " << screen;
+    qCDebug(lcMosaic) << "darken: " << multiply << " lighten: " << screen;
 
     cv::Mat origR;
     cv::Mat mosaicR;
@@ -3517,16 +3523,16 @@ bool DkMosaicDialog::postProcessMosaic(float multiply /* = 0.3 */, float screen
         // if (!computePreview)
         //	mosaicMat.release();
         cv::cvtColor(origR, origR, CV_Lab2BGR);
-        qDebug() << "color converted";
+        qCDebug(lcMosaic) << "color converted";
 
         mMosaic = DkImage::mat2QImage(origR);
-        qDebug() << "mosaicing computed...";
+        qCDebug(lcMosaic) << "mosaicing computed...";
 
     } catch (...) {
         origR.release();
 
         QMessageBox::critical(DkUtils::getMainWindow(), tr("Error"), tr("Sorry, I could not mix the image..."));
-        qDebug() << "exception caught...";
+        qCDebug(lcMosaic) << "exception caught...";
         mMosaic = DkImage::mat2QImage(mMosaicMat);
     }
 
@@ -3689,7 +3695,7 @@ void DkWelcomeDialog::accept()
 
     // change language
     if (mLanguageCombo->currentIndex() != mLanguages.indexOf(DkSettingsManager::param().global().language) && mLanguageCombo->currentIndex() >= 0) {
-        DkSettingsManager::param().global().language = mLanguages.at(mLanguageCombo->currentIndex());
+        DkSettingsManager::edit().global().language = mLanguages.at(mLanguageCombo->currentIndex());
         mLanguageChanged = true;
     }
 
@@ -3708,6 +3714,11 @@ DkArchiveExtractionDialog::DkArchiveExtractionDialog(QWidget *parent, Qt::Window
 {
     mFileList = QStringList();
     setWindowTitle(tr("Extract images from an archive"));
+
+    mExtractor = new DkZipExtractor(this);
+    connect(mExtractor, SIGNAL(progress(int, int)), this, SLOT(extractionProgress(int, int)));
+    connect(mExtractor, SIGNAL(finished()), this, SLOT(extractionFinished()));
+
     createLayout();
     setMinimumSize(340, 400);
     setAcceptDrops(true);
@@ -3716,7 +3727,7 @@ DkArchiveExtractionDialog::DkArchiveExtractionDialog(QWidget *parent, Qt::Window
 void DkArchiveExtractionDialog::createLayout()
 {
     // archive file path
-    QLabel *archiveLabel = new QLabel(tr("Archive (%1)").arg(DkSettingsManager::param().app().containerRawFilters.replace(" *", ", *")), this);
+    QLabel *archiveLabel = new QLabel(tr("Archive (%1)").arg(DkSettingsManager::edit().app().containerRawFilters.replace(" *", ", *")), this);
     mArchivePathEdit = new QLineEdit(this);
     mArchivePathEdit->setObjectName("DkWarningEdit");
     mArchivePathEdit->setValidator(&mFileValidator);
@@ -3744,6 +3755,9 @@ void DkArchiveExtractionDialog::createLayout()
     mRemoveSubfolders->setChecked(false);
     connect(mRemoveSubfolders, SIGNAL(stateChanged(int)), this, SLOT(checkbocChecked(int)));
 
+    mProgress = new QProgressBar(this);
+    mProgress->hide();
+
     // mButtons
     mButtons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, Qt::Horizontal, this);
     mButtons->button(QDialogButtonBox::Ok)->setText(tr("&Extract"));
@@ -3763,6 +3777,7 @@ void DkArchiveExtractionDialog::createLayout()
     gdLayout->addWidget(mFeedbackLabel, 4, 0, 1, 2);
     gdLayout->addWidget(mFileListDisplay, 5, 0, 1, 2);
     gdLayout->addWidget(mRemoveSubfolders, 6, 0, 1, 2);
+    gdLayout->addWidget(mProgress, 7, 0, 1, 2);
 
     QVBoxLayout *layout = new QVBoxLayout(this);
     layout->addWidget(extractWidget);
@@ -3827,7 +3842,7 @@ void DkArchiveExtractionDialog::openArchive()
     QString filePath = QFileDialog::getOpenFileName(this,
                                                     tr("Open Archive"),
                                                     (mArchivePathEdit->text().isEmpty()) ? QFileInfo(mFilePath).absolutePath() : mArchivePathEdit->text(),
-                                                    tr("Archives (%1)").arg(DkSettingsManager::param().app().containerRawFilters.remove(",")),
+                                                    tr("Archives (%1)").arg(DkSettingsManager::edit().app().containerRawFilters.remove(",")),
                                                     nullptr,
                                                     DkDialog::fileDialogOptions());
 
@@ -3923,15 +3938,65 @@ void DkArchiveExtractionDialog::loadArchive(const QString &filePath)
 
 void DkArchiveExtractionDialog::accept()
 {
-    QStringList extractedFiles = extractFilesWithProgress(mArchivePathEdit->text(), mFileList, mDirPathEdit->text(), mRemoveSubfolders->isChecked());
+    if (mExtractor->isRunning())
+        return;
+
+    QDir dir(mDirPathEdit->text());
+    QStringList filePaths;
+
+    for (const QString &f : mFileList)
+        filePaths << dir.absoluteFilePath(mRemoveSubfolders->isChecked() ? QFileInfo(f).fileName() : f);
 
-    if ((extractedFiles.isEmpty() || extractedFiles.size() != mFileList.size()) && !extractedFiles.contains("userCanceled")) {
+    mButtons->button(QDialogButtonBox::Ok)->setEnabled(false);
+    mProgress->setRange(0, mFileList.size());
+    mProgress->setValue(0);
+    mProgress->show();
+    userFeedback(tr("Extracting %1 files...").arg(mFileList.size()), false);
+
+    // the files are extracted in the background - see extractionFinished()
+    mExtractor->extract(mArchivePathEdit->text(), mFileList, filePaths);
+}
+
+void DkArchiveExtractionDialog::reject()
+{
+    if (mExtractor->isRunning()) {
+        userFeedback(tr("Canceling..."), false);
+        mExtractor->cancel();
+        return;
+    }
+
+    QDialog::reject();
+}
+
+void DkArchiveExtractionDialog::extractionProgress(int done, int total)
+{
+    mProgress->setValue(done);
+    userFeedback(tr("Extracting file %1 of %2").arg(done).arg(total), false);
+}
+
+void DkArchiveExtractionDialog::extractionFinished()
+{
+    mProgress->hide();
+    mButtons->button(QDialogButtonBox::Ok)->setEnabled(true);
+
+    if (mExtractor->wasCanceled()) {
+        userFeedback("", false);
+        QDialog::reject();
+        return;
+    }
+
+    QStringList failed = mExtractor->failedEntries();
+
+    if (!failed.isEmpty()) {
         QMessageBox msgBox(this);
         msgBox.setText(tr("The images could not be extracted!"));
+        msgBox.setInformativeText(tr("%1 of %2 files failed.").arg(failed.size()).arg(mFileList.size()));
+        msgBox.setDetailedText(failed.join("\n"));
         msgBox.setIcon(QMessageBox::Critical);
         msgBox.exec();
     }
 
+    userFeedback("", false);
     QDialog::accept();
 }
 
@@ -3962,44 +4027,6 @@ void DkArchiveExtractionDialog::dragEnterEvent(QDragEnterEvent *event)
     }
 }
 
-QStringList
-DkArchiveExtractionDialog::extractFilesWithProgress(const QString &fileCompressed, const QStringList &files, const QString &dir, bool removeSubfolders)
-{
-    QProgressDialog progressDialog(this);
-    progressDialog.setCancelButtonText(tr("&Cancel"));
-    progressDialog.setRange(0, files.size() - 1);
-    progressDialog.setWindowTitle(tr("Extracting files..."));
-    progressDialog.setWindowModality(Qt::WindowModal);
-    progressDialog.setModal(true);
-    progressDialog.hide();
-    progressDialog.show();
-
-    QStringList extracted;
-    for (int i = 0; i < files.count(); i++) {
-        progressDialog.setValue(i);
-        progressDialog.setLabelText(tr("Extracting file %1 of %2").arg(i + 1).arg(files.size()));
-
-        QString absPath;
-        if (removeSubfolders)
-            absPath = QDir(dir).absoluteFilePath(QFileInfo(files.at(i)).fileName());
-        else
-            absPath = QDir(dir).absoluteFilePath(files.at(i));
-
-        if (JlCompress::extractFile(fileCompressed, files.at(i), absPath).isEmpty()) {
-            qDebug() << "unable to extract:" << files.at(i);
-            // return QStringList();
-        }
-        extracted.append(absPath);
-        if (progressDialog.wasCanceled()) {
-            return QStringList("userCanceled");
-        }
-    }
-
-    progressDialog.close();
-
-    return extracted;
-}
-
 #endif
 
 // DkDialogManager --------------------------------------------------------------------
@@ -4136,19 +4163,100 @@ QImage DkPrintImage::image() const
     return mImg;
 }
 
-void DkPrintImage::draw(QPainter &p, bool highQuality)
+/**
+ * Draws the image for the print preview.
+ * @param p the painter of the preview
+ * @param screenScale on-screen pixels per printer pixel
+ **/
+void DkPrintImage::drawPreview(QPainter &p, double screenScale)
 {
-    QRect r = mImg.rect();
-    r = mTransform.mapRect(r);
+    QRect r = mTransform.mapRect(mImg.rect());
+    QImage img = previewLevel((QSizeF(r.size()) * screenScale).toSize());
+
+    p.setRenderHints(QPainter::SmoothPixmapTransform);
+    p.drawImage(r, img, img.rect());
+}
 
-    QImage img = mImg;
+/**
+ * Prints the image.
+ * It is resampled to the printer's resolution tile by tile. Each tile is
+ * streamed to the device - so there is no full resolution intermediate.
+ * The tiles are placed with the image's scale (not their own rounded scale) so that they do not leave seams.
+ * @param p the painter of the printer
+ **/
+void DkPrintImage::print(QPainter &p)
+{
+    QRect r = mTransform.mapRect(mImg.rect());
+    double s = mTransform.m11();
 
-    if (highQuality)
-        img = DkImage::resizeImage(mImg, QSize(), mTransform.m11(), DkImage::ipl_area, false);
-    else
+    // the printer upsamples itself
+    if (s >= 1.0 || mImg.depth() < 8) {
         p.setRenderHints(QPainter::SmoothPixmapTransform);
+        p.drawImage(r, mImg, mImg.rect());
+        return;
+    }
 
-    p.drawImage(r, img, img.rect());
+    // source pixels that are added to each side of a tile (so that the filter sees its neighbors)
+    int pad = qCeil(2.0 / s) + 1;
+    int bpp = mImg.depth() / 8;
+
+    for (int ty = 0; ty < r.height(); ty += tile_size) {
+        int ty1 = qMin(ty + tile_size, r.height());
+        int sy0 = qMax(0, qFloor(ty / s) - pad);
+        int sy1 = qMin(mImg.height(), qCeil(ty1 / s) + pad);
+
+        for (int tx = 0; tx < r.width(); tx += tile_size) {
+            int tx1 = qMin(tx + tile_size, r.width());
+            int sx0 = qMax(0, qFloor(tx / s) - pad);
+            int sx1 = qMin(mImg.width(), qCeil(tx1 / s) + pad);
+
+            // shares the pixels of mImg (no copy)
+            QImage src(mImg.constScanLine(sy0) + sx0 * bpp, sx1 - sx0, sy1 - sy0, mImg.bytesPerLine(), mImg.format());
+            src.setColorTable(mImg.colorTable());
+            src.setColorSpace(mImg.colorSpace());
+
+            // the source window's position on the page
+            int dx0 = qRound(sx0 * s);
+            int dy0 = qRound(sy0 * s);
+            QSize ts(qMax(qRound(sx1 * s) - dx0, 1), qMax(qRound(sy1 * s) - dy0, 1));
+            QImage tile = DkImage::resizeImage(src, ts, 1.0, DkImage::ipl_area, false);
+
+            // the tile's position within the resampled source
+            QRect tr(tx - dx0, ty - dy0, tx1 - tx, ty1 - ty);
+
+            p.drawImage(QPoint(r.x() + tx, r.y() + ty), tile, tr);
+        }
+    }
+}
+
+/**
+ * Returns the smallest pyramid level that covers size.
+ * The pyramid is extended when smaller levels are requested.
+ * @param size the size the image is drawn with (on screen)
+ **/
+QImage DkPrintImage::previewLevel(const QSize &size)
+{
+    if (mImg.isNull() || size.isEmpty())
+        return mImg;
+
+    if (mPyramid.isEmpty())
+        mPyramid << mImg;
+
+    // halving the smallest level would still cover size
+    const QImage &last = mPyramid.last();
+    if ((last.width() + 1) / 2 >= size.width() && (last.height() + 1) / 2 >= size.height()) {
+        QVector<QImage> levels = DkImageStorage::pyramid(last, size);
+        mPyramid << levels.mid(1);
+    }
+
+    for (int idx = mPyramid.size() - 1; idx > 0; idx--) {
+        const QImage &l = mPyramid[idx];
+
+        if (l.width() >= size.width() && l.height() >= size.height())
+            return l;
+    }
+
+    return mImg;
 }
 
 void DkPrintImage::fit()
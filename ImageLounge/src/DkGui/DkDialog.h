@@ -40,6 +40,7 @@
 #pragma warning(pop) // no warnings from includes - end
 
 #include "DkBasicLoader.h"
+#include "DkUtils.h"
 
 // Qt defines
 class QStandardItemModel;
@@ -277,6 +278,7 @@ protected:
     QString mPath;
     QStringList mFileList;
     QStringList mResultList;
+    DkFileNameIndex mFileIndex;
 
     QString mEndMessage;
 
@@ -505,13 +507,24 @@ protected:
     QPushButton *cancelButton;
 };
 
+/**
+ * An image on a printed page.
+ * Previews are drawn from a pyramid level that matches their on-screen
+ * size. Printing resamples the image to the printer's resolution in tiles
+ * - so neither the preview nor the print job holds a full resolution copy.
+ **/
 class DkPrintImage
 {
 public:
+    enum {
+        tile_size = 1024, // device pixels
+    };
+
     DkPrintImage(const QImage &img = QImage(), QPrinter *printer = 0);
 
     QImage image() const;
-    void draw(QPainter &p, bool highQuality = false);
+    void drawPreview(QPainter &p, double screenScale);
+    void print(QPainter &p);
 
     void fit();
     void center();
@@ -521,8 +534,10 @@ public:
 
 private:
     void center(QTransform &t) const;
+    QImage previewLevel(const QSize &size);
 
     QImage mImg;
+    QVector<QImage> mPyramid; // preview levels (the first level is mImg)
     QPrinter *mPrinter;
 
     QTransform mTransform;
@@ -544,6 +559,7 @@ public slots:
     void paintPreview(QPrinter *printer);
     void changeDpi(int value);
     void centerImage();
+    void checkPreviewResolution();
 
     void setLandscapeOrientation();
     void setPortraitOrientation();
@@ -557,8 +573,11 @@ protected:
     virtual void paintEvent(QPaintEvent *event) override;
 
 private:
+    double screenScale(QPrinter *printer) const;
+
     QPrinter *mPrinter;
     QVector<QSharedPointer<DkPrintImage>> mPrintImages;
+    double mPreviewZoom = 0.0; // zoom factor of the last preview
 };
 
 class DkPrintPreviewDialog : public QDialog
@@ -724,8 +743,6 @@ protected:
     void createLayout();
     void enableMosaicSave(bool enable);
     void enableAll(bool enable);
-    QString getRandomImagePath(const QString &cPath, const QString &ignore, const QString &suffix);
-    void matchPatch(const cv::Mat &img, const cv::Mat &thumb, int patchRes, cv::Mat &cc);
     cv::Mat createPatch(const DkThumbNail &thumb, int patchRes);
 
     void dropEvent(QDropEvent *event) override;
@@ -887,6 +904,11 @@ public slots:
     void openArchive();
     void openDir();
     void accept() override;
+    void reject() override;
+
+protected slots:
+    void extractionProgress(int done, int total);
+    void extractionFinished();
 
 protected:
     void dragEnterEvent(QDragEnterEvent *event) override;
@@ -894,7 +916,6 @@ protected:
 
     void createLayout();
     void userFeedback(const QString &msg, bool error = false);
-    QStringList extractFilesWithProgress(const QString &fileCompressed, const QStringList &files, const QString &dir, bool removeSubfolders);
 
     DkFileValidator mFileValidator;
     QDialogButtonBox *mButtons = 0;
@@ -903,6 +924,9 @@ protected:
     QListWidget *mFileListDisplay = 0;
     QLabel *mFeedbackLabel = 0;
     QCheckBox *mRemoveSubfolders = 0;
+    QProgressBar *mProgress = 0;
+
+    DkZipExtractor *mExtractor = 0;
 
     QStringList mFileList;
     QString mFilePath;
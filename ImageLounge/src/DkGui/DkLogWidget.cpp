@@ -28,11 +28,17 @@ related links:
 
 #include "DkLogWidget.h"
 
+#include "DkDialog.h"
+#include "DkLog.h"
+#include "DkTimer.h"
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes
 #include <QAction>
+#include <QFileDialog>
+#include <QMenu>
 #include <QPushButton>
+#include <QStandardPaths>
 #include <QTextEdit>
 #include <QVBoxLayout>
 #pragma warning(pop)
@@ -40,8 +46,6 @@ related links:
 namespace nmc
 {
 
-QSharedPointer<DkMessageQueuer> msgQueuer = QSharedPointer<DkMessageQueuer>();
-
 // -------------------------------------------------------------------- DkLogWidget
 DkLogWidget::DkLogWidget(QWidget *parent)
     : DkWidget(parent)
@@ -49,18 +53,38 @@ DkLogWidget::DkLogWidget(QWidget *parent)
     setObjectName("logWidget");
     createLayout();
 
-    if (!msgQueuer)
-        msgQueuer = QSharedPointer<DkMessageQueuer>(new DkMessageQueuer());
-
-    connect(msgQueuer.data(), SIGNAL(message(const QString &)), this, SLOT(log(const QString &)), Qt::QueuedConnection);
+    // messages are emitted by the sink thread
+    connect(&DkLogSink::instance(), SIGNAL(message(QtMsgType, const QString &)), this, SLOT(log(QtMsgType, const QString &)), Qt::QueuedConnection);
 
-    qInstallMessageHandler(widgetMessageHandler);
+    DkLogSink::instance().install();
     QMetaObject::connectSlotsByName(this);
 }
 
-void DkLogWidget::log(const QString &msg)
+void DkLogWidget::log(QtMsgType type, const QString &msg)
 {
-    mTextEdit->append(msg);
+    QString txt;
+
+    switch (type) {
+    case QtDebugMsg:
+        txt = "<span style=\"color: #aaa\"><i>" + msg + "</i></span>";
+        break;
+    case QtInfoMsg:
+        txt = "<span style=\"color: #21729e\">" + msg + "</span>";
+        break;
+    case QtWarningMsg:
+        txt = "<span style=\"color: #e29b0d\">[Warning] " + msg + "</span>";
+        break;
+    case QtCriticalMsg:
+        txt = "<span style=\"color: #a81e1e\">[Critical] " + msg + "</span>";
+        break;
+    case QtFatalMsg:
+        txt = "<span style=\"color: #a81e1e\">[FATAL] " + msg + "</span>";
+        break;
+    default:
+        return;
+    }
+
+    mTextEdit->append(txt);
 }
 
 void DkLogWidget::on_clearButton_pressed()
@@ -68,10 +92,55 @@ void DkLogWidget::on_clearButton_pressed()
     mTextEdit->clear();
 }
 
+void DkLogWidget::showContextMenu(const QPoint &pos)
+{
+    QMenu *menu = mTextEdit->createStandardContextMenu();
+    menu->addSeparator();
+
+    QAction *debugAction = menu->addAction(tr("Show &Debug Messages"));
+    debugAction->setCheckable(true);
+    debugAction->setChecked(DkLogSink::instance().isDebugEnabled());
+    connect(debugAction, SIGNAL(toggled(bool)), this, SLOT(showDebugMessages(bool)));
+
+    QAction *recordAction = menu->addAction(tr("Record &Trace"));
+    recordAction->setCheckable(true);
+    recordAction->setChecked(DkTracer::instance().isEnabled());
+    connect(recordAction, SIGNAL(toggled(bool)), this, SLOT(recordTrace(bool)));
+
+    QAction *exportAction = menu->addAction(tr("&Export Trace..."));
+    connect(exportAction, SIGNAL(triggered()), this, SLOT(exportTrace()));
+
+    menu->exec(mTextEdit->mapToGlobal(pos));
+    delete menu;
+}
+
+void DkLogWidget::showDebugMessages(bool show)
+{
+    DkLogSink::instance().setDebugEnabled(show);
+}
+
+void DkLogWidget::recordTrace(bool record)
+{
+    DkTracer::instance().setEnabled(record);
+    qInfo() << "[Tracer]" << (record ? "recording" : "stopped");
+}
+
+void DkLogWidget::exportTrace()
+{
+    QString expPath = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + QDir::separator() + "nomacs-trace.json";
+
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Export Trace"), expPath, tr("Chrome Trace (*.json)"), nullptr, DkDialog::fileDialogOptions());
+
+    if (!filePath.isEmpty())
+        DkTracer::instance().exportChromeTrace(filePath);
+}
+
 void DkLogWidget::createLayout()
 {
     mTextEdit = new QTextEdit(this);
     mTextEdit->setReadOnly(true);
+    mTextEdit->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(mTextEdit, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(showContextMenu(const QPoint &)));
 
     QPushButton *clearButton = new QPushButton(this);
     clearButton->setFlat(true);
@@ -84,23 +153,6 @@ void DkLogWidget::createLayout()
     layout->addWidget(clearButton, 1, 1, Qt::AlignRight | Qt::AlignTop);
 }
 
-/// <summary>
-/// Saves log messages to a temporary log file.
-/// Log messages are saved to DkUtils::instance().app().logPath() if
-/// DkUtils::instance().app().useLogFile ist true.
-/// </summary>
-/// <param name="type">The message type (QtDebugMsg are not written to the log).</param>
-/// <param name=""></param>
-/// <param name="msg">The message.</param>
-void widgetMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg)
-{
-    if (msgQueuer) {
-        msgQueuer->log(type, msg);
-    }
-
-    DkUtils::logToFile(type, msg);
-}
-
 // -------------------------------------------------------------------- DkLogDock
 DkLogDock::DkLogDock(const QString &title, QWidget *parent, Qt::WindowFlags flags)
     : DkDockWidget(title, parent, flags)
@@ -115,36 +167,4 @@ void DkLogDock::createLayout()
     setWidget(logWidget);
 }
 
-DkMessageQueuer::DkMessageQueuer()
-{
-}
-
-void DkMessageQueuer::log(QtMsgType type, const QString &msg)
-{
-    QString txt;
-
-    switch (type) {
-    case QtDebugMsg:
-        // return;	// ignore debug messages
-        txt = "<span style=\"color: #aaa\"><i>" + msg + "</i></span>";
-        break;
-    case QtInfoMsg:
-        txt = "<span style=\"color: #21729e\">" + msg + "</span>";
-        break;
-    case QtWarningMsg:
-        txt = "<span style=\"color: #e29b0d\">[Warning] " + msg + "</span>";
-        break;
-    case QtCriticalMsg:
-        txt = "<span style=\"color: #a81e1e\">[Critical] " + msg + "</span>";
-        break;
-    case QtFatalMsg:
-        txt = "<span style=\"color: #a81e1e\">[FATAL] " + msg + "</span>";
-        break;
-    default:
-        return;
-    }
-
-    emit message(txt);
-}
-
 }
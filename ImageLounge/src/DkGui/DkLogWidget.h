@@ -48,21 +48,6 @@ class QTextEdit;
 namespace nmc
 {
 
-void widgetMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg);
-
-class DkMessageQueuer : public QObject
-{
-    Q_OBJECT
-
-public:
-    DkMessageQueuer();
-
-    void log(QtMsgType type, const QString &msg);
-
-signals:
-    void message(const QString &msg);
-};
-
 class DkLogDock : public DkDockWidget
 {
     Q_OBJECT
@@ -82,8 +67,12 @@ public:
     DkLogWidget(QWidget *parent = 0);
 
 public slots:
-    void log(const QString &msg);
+    void log(QtMsgType type, const QString &msg);
     void on_clearButton_pressed();
+    void showContextMenu(const QPoint &pos);
+    void showDebugMessages(bool show);
+    void recordTrace(bool record);
+    void exportTrace();
 
 protected:
     void createLayout();
@@ -53,6 +53,8 @@
 #include <QTreeView>
 #include <QVBoxLayout>
 #include <qmath.h>
+
+#include <numeric>
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
@@ -71,6 +73,8 @@ DkMetaDataModel::DkMetaDataModel(QObject *parent /* = 0 */)
 
 DkMetaDataModel::~DkMetaDataModel()
 {
+    // queued workers are dropped
+    mToken.cancel();
     delete rootItem;
 }
 
@@ -78,11 +82,16 @@ void DkMetaDataModel::clear()
 {
     beginResetModel();
     rootItem->clear();
+    mEntries.clear();
+    mPending.clear();
+    mLeafs.clear();
+    mGeneration++;
     endResetModel();
 }
 
 /// <summary>
 /// Adds the meta data.
+/// The keys are collected in the background - metaDataReady() is emitted when the groups are created.
 /// </summary>
 /// <param name="metaData">The meta data.</param>
 void DkMetaDataModel::addMetaData(QSharedPointer<DkMetaDataT> metaData)
@@ -92,99 +101,279 @@ void DkMetaDataModel::addMetaData(QSharedPointer<DkMetaDataT> metaData)
     if (!metaData)
         return;
 
+    // the loader might edit the container's meta data while we read it
+    mMetaData = metaData->copy();
+    mMetaDataMutex = QSharedPointer<QMutex>(new QMutex());
+
+    QSharedPointer<DkMetaDataT> md = mMetaData;
+    QSharedPointer<QMutex> mutex = mMetaDataMutex;
+
+    connect(&mEntryWatcher, SIGNAL(finished()), this, SLOT(entriesCollected()), Qt::UniqueConnection);
+    mEntryWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [md, mutex]() {
+        QMutexLocker locker(mutex.data());
+        return collectEntries(md);
+    }, mToken));
+}
+
+void DkMetaDataModel::entriesCollected()
+{
+    if (mEntryWatcher.isCanceled())
+        return;
+
+    beginResetModel();
+    rootItem->clear();
+    mLeafs.clear();
+    mGeneration++;
+
+    mEntries = mEntryWatcher.result();
+
+    QVector<int> all(mEntries.size());
+    std::iota(all.begin(), all.end(), 0);
+    mPending.clear();
+    mPending.insert(rootItem, all);
+    endResetModel();
+
+    // create the groups
+    fetchMore(QModelIndex());
+
+    emit metaDataReady();
+}
+
+/**
+ * Collects all keys (this is called in a worker thread).
+ * Values are not formatted - except for the file info which is cheap.
+ * @param metaData the meta data
+ * @return QVector<DkMetaDataModel::Entry> all entries
+ **/
+QVector<DkMetaDataModel::Entry> DkMetaDataModel::collectEntries(QSharedPointer<DkMetaDataT> metaData)
+{
+    QVector<Entry> entries;
+
+    auto add = [&entries](const QString &key, const QString &metaKey, int source, bool translate) {
+        Entry e;
+        e.key = key;
+        e.metaKey = metaKey;
+        e.keyName = key.split(".").last();
+        e.source = source;
+
+        if (translate)
+            e.keyName = DkMetaDataHelper::getInstance().translateKey(e.keyName);
+
+        entries << e;
+    };
+
     QStringList fileKeys, fileValues;
     metaData->getFileMetaData(fileKeys, fileValues);
 
     for (int idx = 0; idx < fileKeys.size(); idx++) {
-        QString lastKey = fileKeys.at(idx).split(".").last();
-        createItem(fileKeys.at(idx), lastKey, fileValues.at(idx));
+        add(fileKeys.at(idx), fileKeys.at(idx), source_file, false);
+        entries.last().value = fileValues.at(idx);
     }
 
-    QStringList exifKeys = metaData->getExifKeys();
+    for (const QString &key : metaData->getExifKeys())
+        add(key, key, source_exif, true);
+
+    for (const QString &key : metaData->getIptcKeys())
+        add(key, key, source_iptc, true);
+
+    for (const QString &key : metaData->getXmpKeys())
+        add(key, key, source_xmp, true);
+
+    for (const QString &key : metaData->getQtKeys())
+        add(tr("Data.") + key, key, source_qt, true);
+
+    return entries;
+}
+
+/**
+ * Formats the value of an entry (this is called in a worker thread).
+ * @param metaData the meta data
+ * @param entry the entry
+ * @return QVariant the value (a date if it can be converted)
+ **/
+QVariant DkMetaDataModel::formatValue(QSharedPointer<DkMetaDataT> metaData, const Entry &entry)
+{
+    QString value;
+
+    switch (entry.source) {
+    case source_exif:
+        value = metaData->getNativeExifValue(entry.metaKey, true);
+        break;
+    case source_iptc:
+        value = metaData->getIptcValue(entry.metaKey);
+        break;
+    case source_xmp:
+        value = metaData->getXmpValue(entry.metaKey);
+        break;
+    case source_qt:
+        value = metaData->getQtValue(entry.metaKey);
+        break;
+    default:
+        value = entry.value;
+        break;
+    }
 
-    for (int idx = 0; idx < exifKeys.size(); idx++) {
-        QString lastKey = exifKeys.at(idx).split(".").last();
-        QString translatedKey = DkMetaDataHelper::getInstance().translateKey(lastKey);
-        QString exifValue = metaData->getNativeExifValue(exifKeys.at(idx), true);
-        exifValue = DkMetaDataHelper::getInstance().resolveSpecialValue(metaData, lastKey, exifValue);
+    if (entry.source != source_file)
+        value = DkMetaDataHelper::getInstance().resolveSpecialValue(metaData, entry.metaKey.split(".").last(), value);
 
-        createItem(exifKeys.at(idx), translatedKey, exifValue);
-    }
+    QString cleanValue = DkUtils::cleanFraction(value);
+    QDateTime pd = DkUtils::getConvertableDate(cleanValue);
 
-    QStringList iptcKeys = metaData->getIptcKeys();
+    if (!pd.isNull())
+        return pd;
 
-    for (int idx = 0; idx < iptcKeys.size(); idx++) {
-        QString lastKey = iptcKeys.at(idx).split(".").last();
-        QString translatedKey = DkMetaDataHelper::getInstance().translateKey(lastKey);
-        QString exifValue = metaData->getIptcValue(iptcKeys.at(idx));
-        exifValue = DkMetaDataHelper::getInstance().resolveSpecialValue(metaData, lastKey, exifValue);
+    return cleanValue;
+}
 
-        createItem(iptcKeys.at(idx), translatedKey, exifValue);
-    }
+/**
+ * Formats the values of new items in the background.
+ * @param entryIdx the entries to be formatted
+ **/
+void DkMetaDataModel::formatValues(const QVector<int> &entryIdx)
+{
+    if (entryIdx.empty() || !mMetaData)
+        return;
 
-    QStringList xmpKeys = metaData->getXmpKeys();
+    QVector<Entry> entries;
+    for (int idx : entryIdx)
+        entries << mEntries[idx];
 
-    for (int idx = 0; idx < xmpKeys.size(); idx++) {
-        QString lastKey = xmpKeys.at(idx).split(".").last();
-        QString translatedKey = DkMetaDataHelper::getInstance().translateKey(lastKey);
-        QString exifValue = metaData->getXmpValue(xmpKeys.at(idx));
-        exifValue = DkMetaDataHelper::getInstance().resolveSpecialValue(metaData, lastKey, exifValue);
+    QSharedPointer<DkMetaDataT> md = mMetaData;
+    QSharedPointer<QMutex> mutex = mMetaDataMutex;
 
-        createItem(xmpKeys.at(idx), translatedKey, exifValue);
-    }
+    auto *watcher = new QFutureWatcher<QVector<QVariant>>(this);
+    int generation = mGeneration;
 
-    QStringList qtKeys = metaData->getQtKeys();
+    connect(watcher, &QFutureWatcher<QVector<QVariant>>::finished, this, [this, watcher, entryIdx, generation]() {
+        watcher->deleteLater();
 
-    for (QString cKey : qtKeys) {
-        QString lastKey = cKey.split(".").last();
-        QString translatedKey = DkMetaDataHelper::getInstance().translateKey(lastKey);
-        QString exifValue = metaData->getQtValue(cKey);
-        exifValue = DkMetaDataHelper::getInstance().resolveSpecialValue(metaData, lastKey, exifValue);
+        if (watcher->isCanceled() || generation != mGeneration)
+            return;
 
-        createItem(tr("Data.") + cKey, translatedKey, exifValue);
-    }
+        QVector<QVariant> values = watcher->result();
+
+        for (int idx = 0; idx < entryIdx.size() && idx < values.size(); idx++) {
+            TreeItem *item = mLeafs.value(entryIdx[idx]);
+
+            if (!item)
+                continue;
+
+            item->setData(values[idx], 1);
+            QModelIndex mi = createIndex(item->row(), 1, item);
+            emit dataChanged(mi, mi);
+        }
+
+        emit valuesFormatted();
+    });
+
+    watcher->setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [md, mutex, entries]() {
+        QMutexLocker locker(mutex.data());
+
+        QVector<QVariant> values;
+        values.reserve(entries.size());
+
+        for (const Entry &e : entries)
+            values << formatValue(md, e);
+
+        return values;
+    }, mToken));
+}
+
+int DkMetaDataModel::depth(TreeItem *item) const
+{
+    int d = 0;
+
+    for (TreeItem *p = item; p && p != rootItem; p = p->parent())
+        d++;
+
+    return d;
+}
+
+bool DkMetaDataModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+
+    TreeItem *item = parent.isValid() ? static_cast<TreeItem *>(parent.internalPointer()) : rootItem;
+
+    return item->childCount() > 0 || mPending.contains(item);
 }
 
-void DkMetaDataModel::createItem(const QString &key, const QString &keyName, const QString &value)
+bool DkMetaDataModel::canFetchMore(const QModelIndex &parent) const
 {
-    // Split key first
-    QStringList keyHierarchy = key.split('.');
+    TreeItem *item = parent.isValid() ? static_cast<TreeItem *>(parent.internalPointer()) : rootItem;
 
-    if (keyHierarchy.empty()) {
-        qDebug() << "no key hierarchy... skipping: " << key;
+    return mPending.contains(item);
+}
+
+/**
+ * Creates the children of parent.
+ * Entries of deeper levels are added to new groups - their items are created
+ * when the groups are expanded.
+ * @param parent the group
+ **/
+void DkMetaDataModel::fetchMore(const QModelIndex &parent)
+{
+    TreeItem *item = parent.isValid() ? static_cast<TreeItem *>(parent.internalPointer()) : rootItem;
+
+    if (!mPending.contains(item))
         return;
-    }
 
-    TreeItem *item = rootItem;
+    QVector<int> pending = mPending.take(item);
+    int level = depth(item);
 
-    for (int idx = 0; idx < keyHierarchy.size() - 1; idx++) {
-        QString cKey = keyHierarchy.at(idx);
-        TreeItem *cHierarchyItem = item->find(cKey, 0);
+    QVector<TreeItem *> children;
+    QHash<QString, TreeItem *> groups;
+    QVector<int> newLeafs;
 
-        if (!cHierarchyItem) {
-            QVector<QVariant> keyData;
-            keyData << cKey;
-            cHierarchyItem = new TreeItem(keyData, item);
-            item->appendChild(cHierarchyItem);
-        }
+    for (int idx : pending) {
+        const Entry &e = mEntries[idx];
+        QStringList keyHierarchy = e.key.split('.');
 
-        item = cHierarchyItem; // switch to next hierarchy level
-    }
+        if (keyHierarchy.size() > level + 1) {
+            const QString &cKey = keyHierarchy.at(level);
+            TreeItem *group = groups.value(cKey);
 
-    QString cleanValue = DkUtils::cleanFraction(value);
+            if (!group) {
+                QVector<QVariant> keyData;
+                keyData << cKey;
+                group = new TreeItem(keyData, item);
+                groups.insert(cKey, group);
+                children << group;
+            }
 
-    QVector<QVariant> metaDataEntry;
-    metaDataEntry << keyName;
+            mPending[group] << idx;
+        } else {
+            QVector<QVariant> metaDataEntry;
+            metaDataEntry << e.keyName << QVariant();
 
-    QDateTime pd = DkUtils::getConvertableDate(cleanValue);
+            TreeItem *dataItem = new TreeItem(metaDataEntry, item);
+            children << dataItem;
+            mLeafs.insert(idx, dataItem);
+            newLeafs << idx;
+        }
+    }
 
-    if (!pd.isNull())
-        metaDataEntry << pd;
-    else
-        metaDataEntry << cleanValue;
+    if (children.empty())
+        return;
+
+    beginInsertRows(parent, item->childCount(), item->childCount() + children.size() - 1);
+    for (TreeItem *c : children)
+        item->appendChild(c);
+    endInsertRows();
+
+    formatValues(newLeafs);
+}
 
-    TreeItem *dataItem = new TreeItem(metaDataEntry, item);
-    item->appendChild(dataItem);
+/**
+ * Creates all items (e.g. for filtering).
+ **/
+void DkMetaDataModel::fetchAll()
+{
+    while (!mPending.empty()) {
+        TreeItem *item = mPending.begin().key();
+        fetchMore(item == rootItem ? QModelIndex() : createIndex(item->row(), 0, item));
+    }
 }
 
 QModelIndex DkMetaDataModel::index(int row, int column, const QModelIndex &parent) const
@@ -426,8 +615,11 @@ void DkMetaDataDock::createLayout()
 
 void DkMetaDataDock::on_filter_textChanged(const QString &filterText)
 {
-    if (!filterText.isEmpty())
+    if (!filterText.isEmpty()) {
+        // we cannot filter groups that were not expanded yet
+        mModel->fetchAll();
         mTreeView->expandAll();
+    }
 
     mProxyModel->setFilterRegularExpression(QRegularExpression(QRegularExpression::escape(filterText), QRegularExpression::CaseInsensitiveOption));
 }
@@ -444,16 +636,30 @@ void DkMetaDataDock::updateEntries()
         return;
 
     mModel = new DkMetaDataModel(this);
+    connect(mModel, SIGNAL(metaDataReady()), this, SLOT(metaDataReady()));
+    connect(mModel, SIGNAL(valuesFormatted()), this, SLOT(valuesFormatted()));
     mModel->addMetaData(mImgC->getMetaData());
     mProxyModel->setSourceModel(mModel);
+}
 
+void DkMetaDataDock::metaDataReady()
+{
+    if (!mFilterEdit->text().isEmpty()) {
+        mModel->fetchAll();
+        mTreeView->expandAll();
+    }
+
+    // expanding creates the children
     mTreeView->setUpdatesEnabled(false);
-    nr = mProxyModel->rowCount();
+    int nr = mProxyModel->rowCount();
     for (int idx = 0; idx < nr; idx++)
         expandRows(mProxyModel->index(idx, 0, QModelIndex()), mExpandedNames);
 
     mTreeView->setUpdatesEnabled(true);
+}
 
+void DkMetaDataDock::valuesFormatted()
+{
     // for values we should adjust the size at least to the currently visible rows...
     mTreeView->resizeColumnToContents(1);
     // if (treeView->columnWidth(1) > 1000)
@@ -30,12 +30,15 @@
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QAbstractTableModel>
 #include <QDockWidget>
+#include <QFutureWatcher>
+#include <QMutex>
 #include <QSortFilterProxyModel>
 #include <QTextEdit>
 #pragma warning(pop) // no warnings from includes - end
 
 #include "DkBaseWidgets.h"
 #include "DkImageContainer.h"
+#include "DkScheduler.h"
 
 // Qt defines
 class QTreeView;
@@ -52,6 +55,14 @@ namespace nmc
 // nomacs defines
 class TreeItem;
 
+/**
+ * Tree model of all meta data entries.
+ * The model is built lazily: the keys are collected in the background
+ * and just the top level groups are created. Children of a group are
+ * created if it is expanded (fetchMore) and their values are formatted
+ * in the background. Hence, maker notes or large XMP blobs do not cost
+ * anything unless the user looks at them.
+ **/
 class DkMetaDataModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -72,13 +83,55 @@ public:
     virtual Qt::ItemFlags flags(const QModelIndex &index) const;
     // virtual bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole);
 
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    void fetchAll();
+
     virtual void addMetaData(QSharedPointer<DkMetaDataT> metaData);
     void clear();
 
+signals:
+    void metaDataReady() const;
+    void valuesFormatted() const;
+
+protected slots:
+    void entriesCollected();
+
 protected:
+    enum Source {
+        source_file = 0,
+        source_exif,
+        source_iptc,
+        source_xmp,
+        source_qt,
+    };
+
+    struct Entry {
+        QString key; // the key hierarchy (e.g. Exif.Photo.ExposureTime)
+        QString metaKey; // the key of the meta data
+        QString keyName; // translated
+        QString value; // file entries only - all others are formatted on demand
+        int source = source_file;
+    };
+
     TreeItem *rootItem;
 
-    void createItem(const QString &key, const QString &keyName, const QString &value);
+    static QVector<Entry> collectEntries(QSharedPointer<DkMetaDataT> metaData);
+    static QVariant formatValue(QSharedPointer<DkMetaDataT> metaData, const Entry &entry);
+    void formatValues(const QVector<int> &entryIdx);
+    int depth(TreeItem *item) const;
+
+    // the model's own copy - it is read by one worker at a time
+    QSharedPointer<DkMetaDataT> mMetaData;
+    QSharedPointer<QMutex> mMetaDataMutex;
+    DkCancelToken mToken;
+    QFutureWatcher<QVector<Entry>> mEntryWatcher;
+
+    QVector<Entry> mEntries;
+    QHash<TreeItem *, QVector<int>> mPending; // groups -> entries that are not created yet
+    QHash<int, TreeItem *> mLeafs; // entries -> items
+    int mGeneration = 0;
 };
 
 class DkMetaDataProxyModel : public QSortFilterProxyModel
@@ -108,6 +161,10 @@ public slots:
     void thumbLoaded(bool loaded);
     void on_filter_textChanged(const QString &filterText);
 
+protected slots:
+    void metaDataReady();
+    void valuesFormatted();
+
 protected:
     void createLayout();
     void updateEntries();
@@ -38,8 +38,10 @@
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
+#include <QFileInfo>
 #include <QHostInfo>
 #include <QList>
+#include <QLockFile>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QMutex>
@@ -69,6 +71,46 @@
 namespace nmc
 {
 
+// DkPendingTransform --------------------------------------------------------------------
+void DkPendingTransform::add(const QTransform &transform, const QTransform &imgTransform, const QPointF &canvasSize)
+{
+    // a null canvas size indicates a relative transform (see DkViewPort::tcpSynchronize)
+    if (!canvasSize.isNull()) {
+        mHasAbsolute = true;
+        mTransform = transform;
+        mImgTransform = imgTransform;
+        mCanvasSize = canvasSize;
+
+        // the absolute transform already contains all previous deltas
+        mHasRelative = false;
+        mRelativeTransform.reset();
+    } else if (!mHasRelative) {
+        mHasRelative = true;
+        mRelativeTransform = transform;
+    } else {
+        // accumulate the translation - that's all the receiver applies
+        mRelativeTransform = QTransform::fromTranslate(mRelativeTransform.dx() + transform.dx(), mRelativeTransform.dy() + transform.dy());
+    }
+}
+
+bool DkPendingTransform::isEmpty() const
+{
+    return !mHasAbsolute && !mHasRelative;
+}
+
+void DkPendingTransform::flush(const Handler &handler)
+{
+    if (mHasAbsolute)
+        handler(mTransform, mImgTransform, mCanvasSize);
+
+    if (mHasRelative)
+        handler(mRelativeTransform, QTransform(), QPointF());
+
+    mHasAbsolute = false;
+    mHasRelative = false;
+    mRelativeTransform.reset();
+}
+
 // DkClientManager --------------------------------------------------------------------
 DkClientManager::DkClientManager(const QString &title, QObject *parent)
     : QObject(parent)
@@ -77,6 +119,16 @@ DkClientManager::DkClientManager(const QString &title, QObject *parent)
     this->mCurrentTitle = title;
     qRegisterMetaType<QList<quint16>>("QList<quint16>");
     qRegisterMetaType<QList<DkPeer *>>("QList<DkPeer*>");
+
+    // Qt has no frame callback for widgets - so we pace with the display's refresh rate
+    QScreen *screen = QGuiApplication::primaryScreen();
+    double fps = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60.0;
+
+    mTransformTimer = new QTimer(this);
+    mTransformTimer->setSingleShot(true);
+    mTransformTimer->setTimerType(Qt::PreciseTimer);
+    mTransformTimer->setInterval(qMax(qRound(1000.0 / fps), 1));
+    connect(mTransformTimer, SIGNAL(timeout()), this, SLOT(flushTransform()));
 }
 
 DkClientManager::~DkClientManager()
@@ -129,7 +181,21 @@ void DkClientManager::connectionSentNewTitle(DkConnection *connection, const QSt
 
 void DkClientManager::connectionReceivedTransformation(DkConnection *, const QTransform &transform, const QTransform &imgTransform, const QPointF &canvasSize)
 {
-    emit receivedTransformation(transform, imgTransform, canvasSize);
+    mReceivedTransform.add(transform, imgTransform, canvasSize);
+
+    // all messages that are buffered in the socket are read before the viewport is updated
+    if (!mApplyPending) {
+        mApplyPending = true;
+        QMetaObject::invokeMethod(this, "applyReceivedTransform", Qt::QueuedConnection);
+    }
+}
+
+void DkClientManager::applyReceivedTransform()
+{
+    mApplyPending = false;
+    mReceivedTransform.flush([this](const QTransform &transform, const QTransform &imgTransform, const QPointF &canvasSize) {
+        emit receivedTransformation(transform, imgTransform, canvasSize);
+    });
 }
 
 void DkClientManager::connectionReceivedPosition(DkConnection *, const QRect &rect, bool opacity, bool overlaid)
@@ -175,23 +241,35 @@ void DkClientManager::sendTitle(const QString &newTitle)
     }
 }
 
+/**
+ * Sends the transform to all synchronized peers.
+ * The first transform is sent right away, transforms that follow within
+ * the same frame are coalesced and sent when the frame is over.
+ **/
 void DkClientManager::sendTransform(QTransform transform, QTransform imgTransform, QPointF canvasSize)
 {
+    mSendTransform.add(transform, imgTransform, canvasSize);
+
+    if (!mTransformTimer->isActive())
+        flushTransform();
+}
+
+void DkClientManager::flushTransform()
+{
+    if (mSendTransform.isEmpty())
+        return;
+
     QList<DkPeer *> synchronizedPeers = mPeerList.getSynchronizedPeers();
-    foreach (DkPeer *peer, synchronizedPeers) {
-        if (!peer)
-            continue;
 
-        connect(this,
-                SIGNAL(sendNewTransformMessage(QTransform, QTransform, QPointF)),
-                peer->connection,
-                SLOT(sendNewTransformMessage(QTransform, QTransform, QPointF)));
-        emit sendNewTransformMessage(transform, imgTransform, canvasSize);
-        disconnect(this,
-                   SIGNAL(sendNewTransformMessage(QTransform, QTransform, QPointF)),
-                   peer->connection,
-                   SLOT(sendNewTransformMessage(QTransform, QTransform, QPointF)));
-    }
+    mSendTransform.flush([&synchronizedPeers](const QTransform &transform, const QTransform &imgTransform, const QPointF &canvasSize) {
+        for (DkPeer *peer : synchronizedPeers) {
+            if (peer && peer->connection)
+                peer->connection->sendNewTransformMessage(transform, imgTransform, canvasSize);
+        }
+    });
+
+    // don't send again before the next frame
+    mTransformTimer->start();
 }
 
 void DkClientManager::sendPosition(QRect newRect, bool overlaid)
@@ -307,7 +385,7 @@ void DkClientManager::sendGoodByeToAll()
 DkLocalClientManager::DkLocalClientManager(const QString &title, QObject *parent)
     : DkClientManager(title, parent)
 {
-    startServer();
+    // the server is started after the first image is shown (see DkSyncManager::startServer)
 }
 
 QList<DkPeer *> DkLocalClientManager::getPeerList()
@@ -337,6 +415,9 @@ QMimeData *DkLocalClientManager::mimeData() const
 
 void DkLocalClientManager::startServer()
 {
+    if (mServer)
+        return;
+
     mServer = new DkLocalTcpServer(this);
     connect(mServer, SIGNAL(serverReiceivedNewConnection(int)), this, SLOT(newConnection(int)));
 
@@ -369,6 +450,20 @@ void DkLocalClientManager::searchForOtherClients()
 {
     assert(mServer);
 
+    // just connect to the instances that are running
+    if (registerInstance()) {
+        QList<quint16> ports = registeredPorts();
+
+        for (quint16 port : ports) {
+            DkConnection *connection = createConnection();
+            connection->connectToHost(QHostAddress::LocalHost, port);
+        }
+
+        qInfo() << "[Sync]" << ports.size() << "instances registered";
+        return;
+    }
+
+    // fallback if the registry is not writable
     for (int i = local_tcp_port_start; i <= local_tcp_port_end; i++) {
         if (i == mServer->serverPort())
             continue;
@@ -378,6 +473,70 @@ void DkLocalClientManager::searchForOtherClients()
     }
 }
 
+/**
+ * Registers this instance with a lock file named after its server port.
+ * The lock is held until the instance quits - lock files of crashed
+ * instances are stale and removed by the next search.
+ * @return bool true if the instance is registered
+ **/
+bool DkLocalClientManager::registerInstance()
+{
+    if (mRegistration)
+        return true;
+
+    if (!mServer->isListening() || !QDir().mkpath(registryPath()))
+        return false;
+
+    QSharedPointer<QLockFile> lock(new QLockFile(QDir(registryPath()).absoluteFilePath(QString("%1.lock").arg(mServer->serverPort()))));
+    lock->setStaleLockTime(0); // we are stale only if our process is gone
+
+    if (!lock->tryLock(0)) {
+        qWarning() << "[Sync] could not register instance:" << lock->error();
+        return false;
+    }
+
+    mRegistration = lock;
+
+    return true;
+}
+
+/**
+ * Returns the server ports of all other instances that are running.
+ * @return QList<quint16> the ports
+ **/
+QList<quint16> DkLocalClientManager::registeredPorts() const
+{
+    QList<quint16> ports;
+    const QStringList files = QDir(registryPath()).entryList(QStringList() << "*.lock", QDir::Files);
+
+    for (const QString &f : files) {
+        bool ok = false;
+        quint16 port = (quint16)QFileInfo(f).baseName().toUInt(&ok);
+
+        if (!ok || port == mServer->serverPort())
+            continue;
+
+        QLockFile lock(QDir(registryPath()).absoluteFilePath(f));
+        lock.setStaleLockTime(0);
+
+        // we got the lock: the instance is gone (unlocking removes the file)
+        if (lock.tryLock(0)) {
+            lock.unlock();
+            continue;
+        }
+
+        if (lock.error() == QLockFile::LockFailedError)
+            ports << port;
+    }
+
+    return ports;
+}
+
+QString DkLocalClientManager::registryPath()
+{
+    return QDir::temp().absoluteFilePath("nomacs-sync");
+}
+
 void DkLocalClientManager::connectionSynchronized(QList<quint16> synchronizedPeersOfOtherClient, DkConnection *connection)
 {
     qDebug() << "Connection synchronized with:" << connection->getPeerPort();
@@ -778,4 +937,10 @@ DkClientManager *DkSyncManager::client()
     return mClient;
 }
 
+void DkSyncManager::startServer()
+{
+    DkTraceSpan ts("startup", "sync_server");
+    mClient->startServer();
+}
+
 }
@@ -35,11 +35,15 @@
 #include <QSharedPointer>
 #include <QTcpServer>
 #include <QThread>
+
+#include <functional>
 #pragma warning(pop) // no warnings from includes - end
 
 #include "DkConnection.h"
 
+class QLockFile;
 class QMimeData;
+class QTimer;
 
 namespace nmc
 {
@@ -128,6 +132,30 @@ private:
     QMultiHash<quint16, DkPeer *> peerList;
 };
 
+/**
+ * The transforms of one sync direction that were not sent (or applied) yet.
+ * Only the newest absolute transform is kept. Relative transforms (panning)
+ * are accumulated since each of them is a delta.
+ **/
+class DkPendingTransform
+{
+public:
+    typedef std::function<void(const QTransform &, const QTransform &, const QPointF &)> Handler;
+
+    void add(const QTransform &transform, const QTransform &imgTransform, const QPointF &canvasSize);
+    bool isEmpty() const;
+    void flush(const Handler &handler);
+
+private:
+    bool mHasAbsolute = false;
+    QTransform mTransform;
+    QTransform mImgTransform;
+    QPointF mCanvasSize;
+
+    bool mHasRelative = false; // relative transforms that arrived after mTransform
+    QTransform mRelativeTransform;
+};
+
 class DkClientManager : public QObject
 {
     Q_OBJECT
@@ -148,7 +176,6 @@ signals:
     void sendDisableSynchronizeMessage();
     void sendNewTitleMessage(const QString &newtitle);
     void sendNewPositionMessage(QRect position, bool opacity, bool overlaid);
-    void sendNewTransformMessage(QTransform transform, QTransform imgTransform, QPointF canvasSize);
     void sendNewFileMessage(qint16 op, const QString &filename);
     void sendNewImageMessage(QImage image, const QString &title);
     void sendNewUpcomingImageMessage(const QString &imageTitle);
@@ -184,6 +211,8 @@ protected slots:
     virtual void connectionReceivedGoodBye(DkConnection *connection);
     void connectionShowStatusMessage(DkConnection *connection, const QString &msg);
     void disconnected();
+    void flushTransform();
+    void applyReceivedTransform();
 
 protected:
     void removeConnection(DkConnection *connection);
@@ -195,6 +224,12 @@ protected:
     QString mCurrentTitle;
     quint16 mNewPeerId;
     QList<DkConnection *> mStartUpConnections;
+
+    // transforms are sent (and applied) at most once per frame
+    QTimer *mTransformTimer = 0;
+    DkPendingTransform mSendTransform;
+    DkPendingTransform mReceivedTransform;
+    bool mApplyPending = false;
 };
 
 class DkLocalClientManager : public DkClientManager
@@ -230,8 +265,14 @@ private slots:
 private:
     DkLocalConnection *createConnection();
     void searchForOtherClients();
+    bool registerInstance();
+    QList<quint16> registeredPorts() const;
+    static QString registryPath();
+
+    DkLocalTcpServer *mServer = 0;
 
-    DkLocalTcpServer *mServer;
+    // locked as long as this instance runs (see registerInstance)
+    QSharedPointer<QLockFile> mRegistration;
 };
 
 class DkLocalTcpServer : public QTcpServer
@@ -258,6 +299,7 @@ public:
     void operator=(DkSyncManager const &) = delete;
 
     DkClientManager *client();
+    void startServer();
 
 private:
     DkSyncManager();
@@ -130,10 +130,13 @@ DkNoMacs::DkNoMacs(QWidget *parent, Qt::WindowFlags flags)
 
     mMenu = new DkMenuBar(this, -1);
 
-    DkActionManager &am = DkActionManager::instance();
-    am.createActions(this);
-    am.createMenus(mMenu);
-    am.enableImageActions(false);
+    {
+        DkTraceSpan ts("startup", "actions");
+        DkActionManager &am = DkActionManager::instance();
+        am.createActions(this);
+        am.createMenus(mMenu);
+        am.enableImageActions(false);
+    }
 
     mSaveSettings = true;
 
@@ -178,6 +181,8 @@ DkNoMacs::~DkNoMacs()
 
 void DkNoMacs::init()
 {
+    DkTraceSpan ts("startup", "window_init");
+
     // assign icon -> in windows the 32px version
     QString iconPath = ":/nomacs/img/nomacs.svg";
     loadStyleSheet();
@@ -220,8 +225,8 @@ void DkNoMacs::init()
         && QApplication::applicationVersion() == nmc::DkSettingsManager::param().global().setupVersion) {
         // ask for exists - otherwise we always try to delete it if the user deleted it
         if (!QFileInfo(nmc::DkSettingsManager::param().global().setupPath).exists() || QFile::remove(nmc::DkSettingsManager::param().global().setupPath)) {
-            nmc::DkSettingsManager::param().global().setupPath = "";
-            nmc::DkSettingsManager::param().global().setupVersion = "";
+            nmc::DkSettingsManager::edit().global().setupPath = "";
+            nmc::DkSettingsManager::edit().global().setupVersion = "";
             nmc::DkSettingsManager::param().save();
         }
     }
@@ -290,6 +295,8 @@ void DkNoMacs::createActions()
     connect(am.action(DkActionManager::menu_sort_date_created), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
     connect(am.action(DkActionManager::menu_sort_date_modified), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
     connect(am.action(DkActionManager::menu_sort_random), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+    connect(am.action(DkActionManager::menu_sort_date_taken), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+    connect(am.action(DkActionManager::menu_sort_rating), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
     connect(am.action(DkActionManager::menu_sort_ascending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
     connect(am.action(DkActionManager::menu_sort_descending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 
@@ -335,12 +342,12 @@ void DkNoMacs::createActions()
 
 void DkNoMacs::clearFileHistory()
 {
-    DkSettingsManager::param().global().recentFiles.clear();
+    DkSettingsManager::edit().global().recentFiles.clear();
 }
 
 void DkNoMacs::clearFolderHistory()
 {
-    DkSettingsManager::param().global().recentFolders.clear();
+    DkSettingsManager::edit().global().recentFolders.clear();
 }
 
 DkCentralWidget *DkNoMacs::getTabWidget() const
@@ -562,10 +569,10 @@ void DkNoMacs::toggleFullScreen()
 
 void DkNoMacs::enterFullScreen()
 {
-    DkSettingsManager::param().app().currentAppMode += qFloor(DkSettings::mode_end * 0.5f);
+    DkSettingsManager::edit().app().currentAppMode += qFloor(DkSettings::mode_end * 0.5f);
     if (DkSettingsManager::param().app().currentAppMode < 0) {
         qDebug() << "illegal state: " << DkSettingsManager::param().app().currentAppMode;
-        DkSettingsManager::param().app().currentAppMode = DkSettings::mode_default;
+        DkSettingsManager::edit().app().currentAppMode = DkSettings::mode_default;
     }
 
     menuBar()->hide();
@@ -586,10 +593,10 @@ void DkNoMacs::enterFullScreen()
 void DkNoMacs::exitFullScreen()
 {
     if (isFullScreen()) {
-        DkSettingsManager::param().app().currentAppMode -= qFloor(DkSettings::mode_end * 0.5f);
+        DkSettingsManager::edit().app().currentAppMode -= qFloor(DkSettings::mode_end * 0.5f);
         if (DkSettingsManager::param().app().currentAppMode < 0) {
             qDebug() << "illegal state: " << DkSettingsManager::param().app().currentAppMode;
-            DkSettingsManager::param().app().currentAppMode = DkSettings::mode_default;
+            DkSettingsManager::edit().app().currentAppMode = DkSettings::mode_default;
         }
 
         if (DkSettingsManager::param().app().showMenuBar)
@@ -714,7 +721,7 @@ void DkNoMacs::fitFrame()
 
 void DkNoMacs::setRecursiveScan(bool recursive)
 {
-    DkSettingsManager::param().global().scanSubFolders = recursive;
+    DkSettingsManager::edit().global().scanSubFolders = recursive;
 
     QSharedPointer<DkImageLoader> loader = getTabWidget()->getCurrentImageLoader();
 
@@ -1248,6 +1255,38 @@ void DkNoMacs::loadFile(const QString &filePath)
         getTabWidget()->loadFile(filePath, false);
 }
 
+/**
+ * Opens files that another instance handed over (see DkRunGuard).
+ * The first file is shown in the current tab if it has no image,
+ * all others are opened in new tabs.
+ * @param filePaths absolute file or directory paths
+ **/
+void DkNoMacs::openFiles(const QStringList &filePaths)
+{
+    // the window might be hidden (background instance) or minimized
+    if (isHidden())
+        show();
+    if (isMinimized())
+        setWindowState(windowState() & ~Qt::WindowMinimized);
+
+    raise();
+    activateWindow();
+
+    DkCentralWidget *cw = getTabWidget();
+
+    if (!cw)
+        return;
+
+    for (const QString &filePath : filePaths) {
+        if (QFileInfo(filePath).isDir())
+            cw->loadDirToTab(filePath);
+        else if (cw->getCurrentImage())
+            cw->addTab(filePath);
+        else
+            cw->loadFile(filePath, false);
+    }
+}
+
 // TODO: move this
 void DkNoMacs::renameFile()
 {
@@ -1354,19 +1393,23 @@ void DkNoMacs::changeSorting(bool change)
         QString senderName = QObject::sender()->objectName();
 
         if (senderName == "menu_sort_filename")
-            DkSettingsManager::param().global().sortMode = DkSettings::sort_filename;
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_filename;
         else if (senderName == "menu_sort_file_size")
-            DkSettingsManager::param().global().sortMode = DkSettings::sort_file_size;
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_file_size;
         else if (senderName == "menu_sort_date_created")
-            DkSettingsManager::param().global().sortMode = DkSettings::sort_date_created;
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_date_created;
         else if (senderName == "menu_sort_date_modified")
-            DkSettingsManager::param().global().sortMode = DkSettings::sort_date_modified;
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_date_modified;
         else if (senderName == "menu_sort_random")
-            DkSettingsManager::param().global().sortMode = DkSettings::sort_random;
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_random;
+        else if (senderName == "menu_sort_date_taken")
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_date_taken;
+        else if (senderName == "menu_sort_rating")
+            DkSettingsManager::edit().global().sortMode = DkSettings::sort_rating;
         else if (senderName == "menu_sort_ascending")
-            DkSettingsManager::param().global().sortDir = DkSettings::sort_ascending;
+            DkSettingsManager::edit().global().sortDir = DkSettings::sort_ascending;
         else if (senderName == "menu_sort_descending")
-            DkSettingsManager::param().global().sortDir = DkSettings::sort_descending;
+            DkSettingsManager::edit().global().sortDir = DkSettings::sort_descending;
 
         if (getTabWidget()->getCurrentImageLoader())
             getTabWidget()->getCurrentImageLoader()->sort();
@@ -1552,19 +1595,24 @@ void DkNoMacs::restartWithPseudoColor(bool contrast)
 
 void DkNoMacs::onWindowLoaded()
 {
+    DkTraceSpan ts("startup", "window_loaded");
+
     DefaultSettings settings;
     bool firstTime = settings.value("AppSettings/firstTime.nomacs.3", true).toBool();
 
-    if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showExplorer))
-        showExplorer(true);
-    if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showMetaDataDock))
-        showMetaDataDock(true);
-    if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showEditDock))
-        showEditDock(true);
-    if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showHistoryDock))
-        showHistoryDock(true);
-    if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showLogDock))
-        showLogDock(true);
+    // docks are created when they are shown - so don't create them if all panels are hidden
+    if (!DkSettingsManager::param().app().hideAllPanels) {
+        if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showExplorer))
+            showExplorer(true);
+        if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showMetaDataDock))
+            showMetaDataDock(true);
+        if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showEditDock))
+            showEditDock(true);
+        if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showHistoryDock))
+            showHistoryDock(true);
+        if (DkDockWidget::testDisplaySettings(DkSettingsManager::param().app().showLogDock))
+            showLogDock(true);
+    }
 
     if (firstTime) {
         // here are some first time requests
@@ -1578,11 +1626,12 @@ void DkNoMacs::onWindowLoaded()
         }
     }
 
-    checkForUpdate(true);
-
     // load settings AFTER everything is initialized
     getTabWidget()->loadSettings();
 
+    // the updater & the sync server are not needed for the first image
+    QTimer::singleShot(500, this, SLOT(initDeferred()));
+
 // init global taskbar
 #ifdef WIN32
     QWinTaskbarButton *button = new QWinTaskbarButton(this);
@@ -1594,6 +1643,14 @@ void DkNoMacs::onWindowLoaded()
     toggleDocks(DkSettingsManager::param().app().hideAllPanels);
 }
 
+void DkNoMacs::initDeferred()
+{
+    DkTraceSpan ts("startup", "deferred_init");
+
+    DkSyncManager::inst().startServer();
+    checkForUpdate(true);
+}
+
 void DkNoMacs::keyPressEvent(QKeyEvent *event)
 {
     if (event->key() == Qt::Key_Alt) {
@@ -1631,7 +1688,7 @@ bool DkNoMacs::eventFilter(QObject *, QEvent *event)
 
 void DkNoMacs::showMenuBar(bool show)
 {
-    DkSettingsManager::param().app().showMenuBar = show;
+    DkSettingsManager::edit().app().showMenuBar = show;
 
     QAction *mp = DkActionManager::instance().action(DkActionManager::menu_panel_menu);
     mp->blockSignals(true);
@@ -1800,7 +1857,7 @@ void DkNoMacs::showUpdateDialog(QString msg, QString title)
         return;
     }
 
-    DkSettingsManager::param().sync().updateDialogShown = true;
+    DkSettingsManager::edit().sync().updateDialogShown = true;
     DkSettingsManager::param().save();
 
     if (!mUpdateDialog) {
@@ -2020,8 +2077,8 @@ DkNoMacsIpl::DkNoMacsIpl(QWidget *parent, Qt::WindowFlags flags)
     setAcceptDrops(true);
     setMouseTracking(true); // receive mouse event everytime
 
-    DkSettingsManager::param().app().appMode = 0;
-    DkSettingsManager::param().app().appMode = DkSettings::mode_default;
+    DkSettingsManager::edit().app().appMode = 0;
+    DkSettingsManager::edit().app().appMode = DkSettings::mode_default;
 }
 
 // FramelessNoMacs --------------------------------------------------------------------
@@ -2029,7 +2086,7 @@ DkNoMacsFrameless::DkNoMacsFrameless(QWidget *parent, Qt::WindowFlags flags)
     : DkNoMacs(parent, flags)
 {
     setObjectName("DkNoMacsFrameless");
-    DkSettingsManager::param().app().appMode = DkSettings::mode_frameless;
+    DkSettingsManager::edit().app().appMode = DkSettings::mode_frameless;
 
     setWindowFlags(Qt::FramelessWindowHint);
     setAttribute(Qt::WA_TranslucentBackground, true);
@@ -2167,7 +2224,7 @@ DkNoMacsContrast::DkNoMacsContrast(QWidget *parent, Qt::WindowFlags flags)
     setAcceptDrops(true);
     setMouseTracking(true); // receive mouse event everytime
 
-    DkSettingsManager::param().app().appMode = DkSettings::mode_contrast;
+    DkSettingsManager::edit().app().appMode = DkSettings::mode_contrast;
     setObjectName("DkNoMacsContrast");
 
     // show it...
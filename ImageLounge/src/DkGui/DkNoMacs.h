@@ -137,6 +137,7 @@ signals:
     void sendQuitLocalClientsSignal() const;
 
 public slots:
+    void openFiles(const QStringList &filePaths);
     void toggleFullScreen();
     void enterFullScreen();
     void exitFullScreen();
@@ -206,6 +207,7 @@ public slots:
     // batch actions
     void computeThumbsBatch();
     void onWindowLoaded();
+    void initDeferred();
 
 protected:
     // mouse events
@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "DkNoMacs.h"
 #include "DkSettings.h"
 #include "DkSettingsWidget.h"
+#include "DkThumbs.h"
 #include "DkUtils.h"
 #include "DkWidgets.h"
 
@@ -414,6 +415,11 @@ void DkGeneralPreference::createLayout()
     cbCloseOnMiddleMouse->setToolTip(tr("Close nomacs if the Middle Mouse Button is pressed over the image."));
     cbCloseOnMiddleMouse->setChecked(DkSettingsManager::param().app().closeOnMiddleMouse);
 
+    QCheckBox *cbSingleInstance = new QCheckBox(tr("Single Instance"), this);
+    cbSingleInstance->setObjectName("singleInstance");
+    cbSingleInstance->setToolTip(tr("Open files in the running nomacs instead of starting a new one."));
+    cbSingleInstance->setChecked(DkSettingsManager::param().app().singleInstance);
+
     QCheckBox *cbCheckForUpdates = new QCheckBox(tr("Check For Updates"), this);
     cbCheckForUpdates->setObjectName("checkForUpdates");
     cbCheckForUpdates->setToolTip(tr("Check for updates on start-up."));
@@ -432,6 +438,7 @@ void DkGeneralPreference::createLayout()
     generalGroup->addWidget(cbSwitchModifier);
     generalGroup->addWidget(cbCloseOnEsc);
     generalGroup->addWidget(cbCloseOnMiddleMouse);
+    generalGroup->addWidget(cbSingleInstance);
     generalGroup->addWidget(cbCheckForUpdates);
     generalGroup->addWidget(cbShowBgImage);
 
@@ -473,22 +480,22 @@ void DkGeneralPreference::showRestartLabel() const
 
 void DkGeneralPreference::on_backgroundColor_accepted() const
 {
-    DkSettingsManager::param().display().defaultBackgroundColor = false;
+    DkSettingsManager::edit().display().defaultBackgroundColor = false;
 }
 
 void DkGeneralPreference::on_backgroundColor_resetClicked() const
 {
-    DkSettingsManager::param().display().defaultBackgroundColor = true;
+    DkSettingsManager::edit().display().defaultBackgroundColor = true;
 }
 
 void DkGeneralPreference::on_iconColor_accepted() const
 {
-    DkSettingsManager::param().display().defaultIconColor = false;
+    DkSettingsManager::edit().display().defaultIconColor = false;
 }
 
 void DkGeneralPreference::on_iconColor_resetClicked() const
 {
-    DkSettingsManager::param().display().defaultIconColor = true;
+    DkSettingsManager::edit().display().defaultIconColor = true;
 }
 
 void DkGeneralPreference::on_themeBox_currentIndexChanged(const QString &text) const
@@ -497,7 +504,7 @@ void DkGeneralPreference::on_themeBox_currentIndexChanged(const QString &text) c
     tn = tn.replace(" ", "-");
 
     if (DkSettingsManager::param().display().themeName != tn) {
-        DkSettingsManager::param().display().themeName = tn;
+        DkSettingsManager::edit().display().themeName = tn;
         DkThemeManager tm;
         tm.loadTheme(tn);
     }
@@ -506,25 +513,25 @@ void DkGeneralPreference::on_themeBox_currentIndexChanged(const QString &text) c
 void DkGeneralPreference::on_showRecentFiles_toggled(bool checked) const
 {
     if (DkSettingsManager::param().app().showRecentFiles != checked)
-        DkSettingsManager::param().app().showRecentFiles = checked;
+        DkSettingsManager::edit().app().showRecentFiles = checked;
 }
 
 void DkGeneralPreference::on_logRecentFiles_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().logRecentFiles != checked)
-        DkSettingsManager::param().global().logRecentFiles = checked;
+        DkSettingsManager::edit().global().logRecentFiles = checked;
 }
 
 void DkGeneralPreference::on_checkOpenDuplicates_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().checkOpenDuplicates != checked)
-        DkSettingsManager::param().global().checkOpenDuplicates = checked;
+        DkSettingsManager::edit().global().checkOpenDuplicates = checked;
 }
 
 void DkGeneralPreference::on_extendedTabs_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().extendedTabs != checked) {
-        DkSettingsManager::param().global().extendedTabs = checked;
+        DkSettingsManager::edit().global().extendedTabs = checked;
         showRestartLabel();
     }
 }
@@ -532,39 +539,45 @@ void DkGeneralPreference::on_extendedTabs_toggled(bool checked) const
 void DkGeneralPreference::on_closeOnEsc_toggled(bool checked) const
 {
     if (DkSettingsManager::param().app().closeOnEsc != checked)
-        DkSettingsManager::param().app().closeOnEsc = checked;
+        DkSettingsManager::edit().app().closeOnEsc = checked;
 }
 
 void DkGeneralPreference::on_closeOnMiddleMouse_toggled(bool checked) const
 {
     if (DkSettingsManager::param().app().closeOnMiddleMouse != checked)
-        DkSettingsManager::param().app().closeOnMiddleMouse = checked;
+        DkSettingsManager::edit().app().closeOnMiddleMouse = checked;
+}
+
+void DkGeneralPreference::on_singleInstance_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().app().singleInstance != checked)
+        DkSettingsManager::edit().app().singleInstance = checked;
 }
 
 void DkGeneralPreference::on_zoomOnWheel_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().zoomOnWheel != checked) {
-        DkSettingsManager::param().global().zoomOnWheel = checked;
+        DkSettingsManager::edit().global().zoomOnWheel = checked;
     }
 }
 
 void DkGeneralPreference::on_horZoomSkips_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().horZoomSkips != checked) {
-        DkSettingsManager::param().global().horZoomSkips = checked;
+        DkSettingsManager::edit().global().horZoomSkips = checked;
     }
 }
 
 void DkGeneralPreference::on_doubleClickForFullscreen_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().doubleClickForFullscreen != checked)
-        DkSettingsManager::param().global().doubleClickForFullscreen = checked;
+        DkSettingsManager::edit().global().doubleClickForFullscreen = checked;
 }
 
 void DkGeneralPreference::on_showBgImage_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().showBgImage != checked) {
-        DkSettingsManager::param().global().showBgImage = checked;
+        DkSettingsManager::edit().global().showBgImage = checked;
         showRestartLabel();
     }
 }
@@ -572,20 +585,20 @@ void DkGeneralPreference::on_showBgImage_toggled(bool checked) const
 void DkGeneralPreference::on_checkForUpdates_toggled(bool checked) const
 {
     if (DkSettingsManager::param().sync().checkForUpdates != checked)
-        DkSettingsManager::param().sync().checkForUpdates = checked;
+        DkSettingsManager::edit().sync().checkForUpdates = checked;
 }
 
 void DkGeneralPreference::on_switchModifier_toggled(bool checked) const
 {
     if (DkSettingsManager::param().sync().switchModifier != checked) {
-        DkSettingsManager::param().sync().switchModifier = checked;
+        DkSettingsManager::edit().sync().switchModifier = checked;
 
         if (DkSettingsManager::param().sync().switchModifier) {
-            DkSettingsManager::param().global().altMod = Qt::ControlModifier;
-            DkSettingsManager::param().global().ctrlMod = Qt::AltModifier;
+            DkSettingsManager::edit().global().altMod = Qt::ControlModifier;
+            DkSettingsManager::edit().global().ctrlMod = Qt::AltModifier;
         } else {
-            DkSettingsManager::param().global().altMod = Qt::AltModifier;
-            DkSettingsManager::param().global().ctrlMod = Qt::ControlModifier;
+            DkSettingsManager::edit().global().altMod = Qt::AltModifier;
+            DkSettingsManager::edit().global().ctrlMod = Qt::ControlModifier;
         }
     }
 }
@@ -593,7 +606,7 @@ void DkGeneralPreference::on_switchModifier_toggled(bool checked) const
 void DkGeneralPreference::on_loopImages_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().loop != checked)
-        DkSettingsManager::param().global().loop = checked;
+        DkSettingsManager::edit().global().loop = checked;
 }
 
 void DkGeneralPreference::on_defaultSettings_clicked()
@@ -604,7 +617,7 @@ void DkGeneralPreference::on_defaultSettings_clicked()
                                       QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
 
     if (answer == QMessageBox::Yes) {
-        DkSettingsManager::param().setToDefaultSettings();
+        DkSettingsManager::edit().setToDefaultSettings();
         showRestartLabel();
         qDebug() << "answer is: " << answer << "flushing all settings...";
     }
@@ -663,7 +676,7 @@ void DkGeneralPreference::on_languageCombo_currentIndexChanged(int index) const
         QString language = mLanguages[index];
 
         if (DkSettingsManager::param().global().language != language) {
-            DkSettingsManager::param().global().language = language;
+            DkSettingsManager::edit().global().language = language;
             showRestartLabel();
         }
     }
@@ -702,6 +715,17 @@ void DkDisplayPreference::createLayout()
     hQAntiAliasing->setToolTip(tr("NOTE: if checked, nomacs might be slow while zooming."));
     hQAntiAliasing->setChecked(DkSettingsManager::param().display().highQualityAntiAliasing);
 
+    QCheckBox *colorManagement = new QCheckBox(tr("Color Manage Images with embedded ICC Profiles"), this);
+    colorManagement->setObjectName("colorManagement");
+    colorManagement->setToolTip(tr("If checked, images are converted from their embedded profile to the display profile."));
+    colorManagement->setChecked(DkSettingsManager::param().display().colorManagement);
+
+    // OpenGL viewport
+    QCheckBox *useOpenGL = new QCheckBox(tr("Use OpenGL for Displaying Images"), this);
+    useOpenGL->setObjectName("useOpenGL");
+    useOpenGL->setToolTip(tr("If checked, panning, zooming and transitions are rendered by the graphics card."));
+    useOpenGL->setChecked(DkSettingsManager::param().display().useOpenGL);
+
     // show scollbars
     QCheckBox *showScrollBars = new QCheckBox(tr("Show Scrollbars when zooming into images"), this);
     showScrollBars->setObjectName("showScrollBars");
@@ -743,6 +767,8 @@ void DkDisplayPreference::createLayout()
     DkGroupWidget *zoomGroup = new DkGroupWidget(tr("Zoom"), this);
     zoomGroup->addWidget(invertZoom);
     zoomGroup->addWidget(hQAntiAliasing);
+    zoomGroup->addWidget(colorManagement);
+    zoomGroup->addWidget(useOpenGL);
     zoomGroup->addWidget(showScrollBars);
     zoomGroup->addWidget(interpolationLabel);
     zoomGroup->addWidget(sbInterpolation);
@@ -885,31 +911,31 @@ void DkDisplayPreference::createLayout()
 void DkDisplayPreference::on_interpolationBox_valueChanged(int value) const
 {
     if (DkSettingsManager::param().display().interpolateZoomLevel != value)
-        DkSettingsManager::param().display().interpolateZoomLevel = value;
+        DkSettingsManager::edit().display().interpolateZoomLevel = value;
 }
 
 void DkDisplayPreference::on_fadeImageBox_valueChanged(double value) const
 {
     if (DkSettingsManager::param().display().animationDuration != value)
-        DkSettingsManager::param().display().animationDuration = (float)value;
+        DkSettingsManager::edit().display().animationDuration = (float)value;
 }
 
 void DkDisplayPreference::on_displayTimeBox_valueChanged(double value) const
 {
     if (DkSettingsManager::param().slideShow().time != value)
-        DkSettingsManager::param().slideShow().time = (float)value;
+        DkSettingsManager::edit().slideShow().time = (float)value;
 }
 
 void DkDisplayPreference::on_showPlayer_toggled(bool checked) const
 {
     if (DkSettingsManager::param().slideShow().showPlayer != checked)
-        DkSettingsManager::param().slideShow().showPlayer = checked;
+        DkSettingsManager::edit().slideShow().showPlayer = checked;
 }
 
 void DkDisplayPreference::on_iconSizeBox_valueChanged(int value) const
 {
     if (DkSettingsManager::param().display().iconSize != value) {
-        DkSettingsManager::param().display().iconSize = value;
+        DkSettingsManager::edit().display().iconSize = value;
         emit infoSignal(tr("Please Restart nomacs to apply changes"));
     }
 }
@@ -917,49 +943,65 @@ void DkDisplayPreference::on_iconSizeBox_valueChanged(int value) const
 void DkDisplayPreference::on_keepZoom_buttonClicked(int buttonId) const
 {
     if (DkSettingsManager::param().display().keepZoom != buttonId)
-        DkSettingsManager::param().display().keepZoom = buttonId;
+        DkSettingsManager::edit().display().keepZoom = buttonId;
 }
 
 void DkDisplayPreference::on_invertZoom_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().invertZoom != checked)
-        DkSettingsManager::param().display().invertZoom = checked;
+        DkSettingsManager::edit().display().invertZoom = checked;
 }
 
 void DkDisplayPreference::on_hQAntiAliasing_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().highQualityAntiAliasing != checked)
-        DkSettingsManager::param().display().highQualityAntiAliasing = checked;
+        DkSettingsManager::edit().display().highQualityAntiAliasing = checked;
+}
+
+void DkDisplayPreference::on_colorManagement_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().display().colorManagement != checked) {
+        DkSettingsManager::edit().display().colorManagement = checked;
+        DkColorManager::instance().clear();
+    }
+}
+
+void DkDisplayPreference::on_useOpenGL_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().display().useOpenGL != checked) {
+        DkSettingsManager::edit().display().useOpenGL = checked;
+        emit infoSignal(tr("Please Restart nomacs to apply changes"));
+    }
 }
 
 void DkDisplayPreference::on_zoomToFit_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().zoomToFit != checked)
-        DkSettingsManager::param().display().zoomToFit = checked;
+        DkSettingsManager::edit().display().zoomToFit = checked;
 }
 
 void DkDisplayPreference::on_transition_currentIndexChanged(int index) const
 {
     if (DkSettingsManager::param().display().transition != index)
-        DkSettingsManager::param().display().transition = (DkSettings::TransitionMode)index;
+        DkSettingsManager::edit().display().transition = (DkSettings::TransitionMode)index;
 }
 
 void DkDisplayPreference::on_alwaysAnimate_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().alwaysAnimate != checked)
-        DkSettingsManager::param().display().alwaysAnimate = checked;
+        DkSettingsManager::edit().display().alwaysAnimate = checked;
 }
 
 void DkDisplayPreference::on_showCrop_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().showCrop != checked)
-        DkSettingsManager::param().display().showCrop = checked;
+        DkSettingsManager::edit().display().showCrop = checked;
 }
 
 void DkDisplayPreference::on_showScrollBars_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().showScrollBars != checked)
-        DkSettingsManager::param().display().showScrollBars = checked;
+        DkSettingsManager::edit().display().showScrollBars = checked;
 }
 
 void DkDisplayPreference::on_useZoomLevels_toggled(bool checked) const
@@ -971,7 +1013,7 @@ void DkDisplayPreference::on_useZoomLevels_toggled(bool checked) const
 void DkDisplayPreference::on_showNavigation_toggled(bool checked) const
 {
     if (DkSettingsManager::param().display().showNavigation != checked)
-        DkSettingsManager::param().display().showNavigation = checked;
+        DkSettingsManager::edit().display().showNavigation = checked;
 }
 
 void DkDisplayPreference::on_zoomLevels_editingFinished() const
@@ -1054,6 +1096,29 @@ void DkFilePreference::createLayout()
     historyGroup->addWidget(historyBox);
     historyGroup->addWidget(hLabel);
 
+    // thumbnail cache
+    QCheckBox *cbThumbCache = new QCheckBox(tr("Cache Thumbnails"), this);
+    cbThumbCache->setObjectName("thumbCache");
+    cbThumbCache->setToolTip(tr("Thumbnails of images without embedded previews are stored in: %1").arg(DkThumbCache::instance().cacheDir()));
+    cbThumbCache->setChecked(DkSettingsManager::param().resources().thumbCache);
+
+    QSpinBox *thumbCacheBox = new QSpinBox(this);
+    thumbCacheBox->setObjectName("thumbCacheBox");
+    thumbCacheBox->setMinimum(1);
+    thumbCacheBox->setMaximum(100000);
+    thumbCacheBox->setSuffix(" MB");
+    thumbCacheBox->setMaximumWidth(200);
+    thumbCacheBox->setValue(DkSettingsManager::param().resources().thumbCacheSize);
+
+    QPushButton *clearThumbCache = new QPushButton(tr("Clear Thumbnail Cache"), this);
+    clearThumbCache->setObjectName("clearThumbCache");
+    clearThumbCache->setMaximumWidth(200);
+
+    DkGroupWidget *thumbCacheGroup = new DkGroupWidget(tr("Thumbnail Cache"), this);
+    thumbCacheGroup->addWidget(cbThumbCache);
+    thumbCacheGroup->addWidget(thumbCacheBox);
+    thumbCacheGroup->addWidget(clearThumbCache);
+
     // loading policy
     QVector<QRadioButton *> loadButtons;
     loadButtons.append(new QRadioButton(tr("Skip Images"), this));
@@ -1113,6 +1178,7 @@ void DkFilePreference::createLayout()
     l->addWidget(tempFolderGroup);
     l->addWidget(cacheGroup);
     l->addWidget(historyGroup);
+    l->addWidget(thumbCacheGroup);
     l->addWidget(loadGroup);
     l->addWidget(saveGroup);
     l->addWidget(skipGroup);
@@ -1123,44 +1189,62 @@ void DkFilePreference::on_dirChooser_directoryChanged(const QString &dirPath) co
     bool dirExists = QDir(dirPath).exists();
 
     if (DkSettingsManager::param().global().tmpPath != dirPath && dirExists)
-        DkSettingsManager::param().global().tmpPath = dirPath;
+        DkSettingsManager::edit().global().tmpPath = dirPath;
     else if (!dirExists)
-        DkSettingsManager::param().global().tmpPath = "";
+        DkSettingsManager::edit().global().tmpPath = "";
 }
 
 void DkFilePreference::on_loadGroup_buttonClicked(int buttonId) const
 {
     if (DkSettingsManager::param().resources().waitForLastImg != (buttonId == 1))
-        DkSettingsManager::param().resources().waitForLastImg = (buttonId == 1);
+        DkSettingsManager::edit().resources().waitForLastImg = (buttonId == 1);
 }
 
 void DkFilePreference::on_saveGroup_buttonClicked(int buttonId) const
 {
     if (DkSettingsManager::param().resources().loadSavedImage != buttonId)
-        DkSettingsManager::param().resources().loadSavedImage = buttonId;
+        DkSettingsManager::edit().resources().loadSavedImage = buttonId;
 }
 
 void DkFilePreference::on_skipBox_valueChanged(int value) const
 {
     if (DkSettingsManager::param().global().skipImgs != value) {
-        DkSettingsManager::param().global().skipImgs = value;
+        DkSettingsManager::edit().global().skipImgs = value;
     }
 }
 
 void DkFilePreference::on_cacheBox_valueChanged(int value) const
 {
     if (DkSettingsManager::param().resources().cacheMemory != value) {
-        DkSettingsManager::param().resources().cacheMemory = (float)value;
+        DkSettingsManager::edit().resources().cacheMemory = (float)value;
     }
 }
 
 void DkFilePreference::on_historyBox_valueChanged(int value) const
 {
     if (DkSettingsManager::param().resources().historyMemory != value) {
-        DkSettingsManager::param().resources().historyMemory = (float)value;
+        DkSettingsManager::edit().resources().historyMemory = (float)value;
     }
 }
 
+void DkFilePreference::on_thumbCache_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().resources().thumbCache != checked)
+        DkSettingsManager::edit().resources().thumbCache = checked;
+}
+
+void DkFilePreference::on_thumbCacheBox_valueChanged(int value) const
+{
+    if (DkSettingsManager::param().resources().thumbCacheSize != value)
+        DkSettingsManager::edit().resources().thumbCacheSize = value;
+}
+
+void DkFilePreference::on_clearThumbCache_clicked() const
+{
+    DkThumbCache::instance().clear();
+    emit infoSignal(tr("Thumbnail cache cleared"));
+}
+
 void DkFilePreference::paintEvent(QPaintEvent *event)
 {
     // fixes stylesheets which are not applied to custom widgets
@@ -1297,8 +1381,8 @@ QList<QStandardItem *> DkFileAssociationsPreference::getItems(const QString &fil
 void DkFileAssociationsPreference::writeSettings() const
 {
     DkFileFilterHandling fh;
-    DkSettingsManager::param().app().browseFilters.clear();
-    DkSettingsManager::param().app().registerFilters.clear();
+    DkSettingsManager::edit().app().browseFilters.clear();
+    DkSettingsManager::edit().app().registerFilters.clear();
 
     for (int idx = 0; idx < mModel->rowCount(); idx++) {
         QStandardItem *item = mModel->item(idx, 0);
@@ -1314,13 +1398,13 @@ void DkFileAssociationsPreference::writeSettings() const
             cFilter = cFilter.section(QRegularExpression("(\\(|\\))"), 1);
             cFilter = cFilter.replace(")", "");
 
-            DkSettingsManager::param().app().browseFilters += cFilter.split(" ");
+            DkSettingsManager::edit().app().browseFilters += cFilter.split(" ");
         }
 
         fh.registerFileType(item->text(), tr("Image"), regItem->checkState() == Qt::Checked);
 
         if (regItem->checkState() == Qt::Checked) {
-            DkSettingsManager::param().app().registerFilters.append(item->text());
+            DkSettingsManager::edit().app().registerFilters.append(item->text());
             qDebug() << item->text() << " registered";
         } else
             qDebug() << item->text() << " unregistered";
@@ -1356,6 +1440,7 @@ void DkAdvancedPreference::createLayout()
     loadRawButtons[DkSettings::raw_thumb_always] = new QRadioButton(tr("Always Load JPG if Embedded"), this);
     loadRawButtons[DkSettings::raw_thumb_if_large] = new QRadioButton(tr("Load JPG if it Fits the Screen Resolution"), this);
     loadRawButtons[DkSettings::raw_thumb_never] = new QRadioButton(tr("Always Load RAW Data"), this);
+    loadRawButtons[DkSettings::raw_thumb_refine] = new QRadioButton(tr("Show Embedded JPG First, then Load RAW Data"), this);
 
     // check wrt the current settings
     loadRawButtons[DkSettingsManager::param().resources().loadRawThumb]->setChecked(true);
@@ -1365,18 +1450,26 @@ void DkAdvancedPreference::createLayout()
     loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_always], DkSettings::raw_thumb_always);
     loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_if_large], DkSettings::raw_thumb_if_large);
     loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_never], DkSettings::raw_thumb_never);
+    loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_refine], DkSettings::raw_thumb_refine);
 
     QCheckBox *cbFilterRaw = new QCheckBox(tr("Apply Noise Filtering to RAW Images"), this);
     cbFilterRaw->setObjectName("filterRaw");
     cbFilterRaw->setToolTip(tr("If checked, a noise filter is applied which reduced color noise"));
     cbFilterRaw->setChecked(DkSettingsManager::param().resources().filterRawImages);
 
+    QCheckBox *cbRawHighBitDepth = new QCheckBox(tr("Develop RAW Images with 16 Bits"), this);
+    cbRawHighBitDepth->setObjectName("rawHighBitDepth");
+    cbRawHighBitDepth->setToolTip(tr("If checked, RAW images keep 16 bits per channel (needs more memory) - e.g. for exporting 16 bit TIFFs"));
+    cbRawHighBitDepth->setChecked(DkSettingsManager::param().resources().rawHighBitDepth);
+
     DkGroupWidget *loadRawGroup = new DkGroupWidget(tr("RAW Loader Settings"), this);
     loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_always]);
     loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_if_large]);
     loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_never]);
+    loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_refine]);
     loadRawGroup->addSpace();
     loadRawGroup->addWidget(cbFilterRaw);
+    loadRawGroup->addWidget(cbRawHighBitDepth);
 
     // file loading
     QCheckBox *cbSaveDeleted = new QCheckBox(tr("Ask to Save Deleted Files"), this);
@@ -1395,10 +1488,17 @@ void DkAdvancedPreference::createLayout()
                            + tr("NOTE: this allows for rotating JPGs without losing information."));
     cbSaveExif->setChecked(DkSettingsManager::param().metaData().saveExifOrientation);
 
+    QCheckBox *cbParallelEncoding = new QCheckBox(tr("Compress Large PNGs and TIFFs in Parallel"), this);
+    cbParallelEncoding->setObjectName("parallelEncoding");
+    cbParallelEncoding->setToolTip(tr("If checked, large PNG and compressed TIFF files are deflated using all threads.\n")
+                                   + tr("NOTE: TIFFs are then Deflate instead of LZW compressed."));
+    cbParallelEncoding->setChecked(DkSettingsManager::param().resources().parallelEncoding);
+
     DkGroupWidget *loadFileGroup = new DkGroupWidget(tr("File Loading/Saving"), this);
     loadFileGroup->addWidget(cbSaveDeleted);
     loadFileGroup->addWidget(cbIgnoreExif);
     loadFileGroup->addWidget(cbSaveExif);
+    loadFileGroup->addWidget(cbParallelEncoding);
 
     // batch processing
     QSpinBox *sbNumThreads = new QSpinBox(this);
@@ -1450,37 +1550,49 @@ void DkAdvancedPreference::createLayout()
 void DkAdvancedPreference::on_loadRaw_buttonClicked(int buttonId) const
 {
     if (DkSettingsManager::param().resources().loadRawThumb != buttonId)
-        DkSettingsManager::param().resources().loadRawThumb = buttonId;
+        DkSettingsManager::edit().resources().loadRawThumb = buttonId;
 }
 
 void DkAdvancedPreference::on_filterRaw_toggled(bool checked) const
 {
     if (DkSettingsManager::param().resources().filterRawImages != checked)
-        DkSettingsManager::param().resources().filterRawImages = checked;
+        DkSettingsManager::edit().resources().filterRawImages = checked;
+}
+
+void DkAdvancedPreference::on_rawHighBitDepth_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().resources().rawHighBitDepth != checked)
+        DkSettingsManager::edit().resources().rawHighBitDepth = checked;
 }
 
 void DkAdvancedPreference::on_saveDeleted_toggled(bool checked) const
 {
     if (DkSettingsManager::param().global().askToSaveDeletedFiles != checked)
-        DkSettingsManager::param().global().askToSaveDeletedFiles = checked;
+        DkSettingsManager::edit().global().askToSaveDeletedFiles = checked;
 }
 
 void DkAdvancedPreference::on_ignoreExif_toggled(bool checked) const
 {
     if (DkSettingsManager::param().metaData().ignoreExifOrientation != checked)
-        DkSettingsManager::param().metaData().ignoreExifOrientation = checked;
+        DkSettingsManager::edit().metaData().ignoreExifOrientation = checked;
 }
 
 void DkAdvancedPreference::on_saveExif_toggled(bool checked) const
 {
     if (DkSettingsManager::param().metaData().saveExifOrientation != checked)
-        DkSettingsManager::param().metaData().saveExifOrientation = checked;
+        DkSettingsManager::edit().metaData().saveExifOrientation = checked;
+}
+
+void DkAdvancedPreference::on_parallelEncoding_toggled(bool checked) const
+{
+    if (DkSettingsManager::param().resources().parallelEncoding != checked)
+        DkSettingsManager::edit().resources().parallelEncoding = checked;
 }
 
 void DkAdvancedPreference::on_useLog_toggled(bool checked) const
 {
     if (DkSettingsManager::param().app().useLogFile != checked) {
-        DkSettingsManager::param().app().useLogFile = checked;
+        DkSettingsManager::edit().app().useLogFile = checked;
         emit infoSignal(tr("Please Restart nomacs to apply changes"));
     }
 }
@@ -1488,7 +1600,7 @@ void DkAdvancedPreference::on_useLog_toggled(bool checked) const
 void DkAdvancedPreference::on_useNative_toggled(bool checked) const
 {
     if (DkSettingsManager::param().resources().nativeDialog != checked) {
-        DkSettingsManager::param().resources().nativeDialog = checked;
+        DkSettingsManager::edit().resources().nativeDialog = checked;
     }
 }
 
@@ -1502,7 +1614,7 @@ void DkAdvancedPreference::on_logFolder_clicked() const
 void DkAdvancedPreference::on_numThreads_valueChanged(int val) const
 {
     if (DkSettingsManager::param().global().numThreads != val)
-        DkSettingsManager::param().setNumThreads(val);
+        DkSettingsManager::edit().setNumThreads(val);
 }
 
 void DkAdvancedPreference::paintEvent(QPaintEvent *event)
@@ -1560,7 +1672,7 @@ void DkEditorPreference::changeSetting(const QString &key, const QVariant &value
     DkSettingsWidget::changeSetting(settings, key, value, groups);
 
     // update values
-    nmc::DkSettingsManager::instance().param().load();
+    nmc::DkSettingsManager::edit().load();
 }
 
 void DkEditorPreference::removeSetting(const QString &key, const QStringList &groups) const
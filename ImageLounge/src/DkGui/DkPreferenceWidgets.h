@@ -152,6 +152,7 @@ public slots:
     void on_extendedTabs_toggled(bool checked) const;
     void on_closeOnEsc_toggled(bool checked) const;
     void on_closeOnMiddleMouse_toggled(bool checked) const;
+    void on_singleInstance_toggled(bool checked) const;
     void on_zoomOnWheel_toggled(bool checked) const;
     void on_horZoomSkips_toggled(bool checked) const;
     void on_doubleClickForFullscreen_toggled(bool checked) const;
@@ -196,6 +197,8 @@ public slots:
     void on_keepZoom_buttonClicked(int buttonId) const;
     void on_invertZoom_toggled(bool checked) const;
     void on_hQAntiAliasing_toggled(bool checked) const;
+    void on_colorManagement_toggled(bool checked) const;
+    void on_useOpenGL_toggled(bool checked) const;
     void on_zoomToFit_toggled(bool checked) const;
     void on_transition_currentIndexChanged(int index) const;
     void on_alwaysAnimate_toggled(bool checked) const;
@@ -230,6 +233,9 @@ public slots:
     void on_skipBox_valueChanged(int value) const;
     void on_cacheBox_valueChanged(int value) const;
     void on_historyBox_valueChanged(int value) const;
+    void on_thumbCache_toggled(bool checked) const;
+    void on_thumbCacheBox_valueChanged(int value) const;
+    void on_clearThumbCache_clicked() const;
     void on_saveGroup_buttonClicked(int buttonId) const;
 
 signals:
@@ -277,9 +283,11 @@ public:
 public slots:
     void on_loadRaw_buttonClicked(int buttonId) const;
     void on_filterRaw_toggled(bool checked) const;
+    void on_rawHighBitDepth_toggled(bool checked) const;
     void on_saveDeleted_toggled(bool checked) const;
     void on_ignoreExif_toggled(bool checked) const;
     void on_saveExif_toggled(bool checked) const;
+    void on_parallelEncoding_toggled(bool checked) const;
     void on_useLog_toggled(bool checked) const;
     void on_useNative_toggled(bool checked) const;
     void on_logFolder_clicked() const;
@@ -0,0 +1,525 @@
+/*******************************************************************************************************
+ DkReplay.cpp
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkReplay.h"
+
+#include "DkCentralWidget.h"
+#include "DkImageContainer.h"
+#include "DkImageLoader.h"
+#include "DkImageStorage.h"
+#include "DkNoMacs.h"
+#include "DkSettings.h"
+#include "DkThumbsWidgets.h"
+#include "DkViewPort.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QAbstractScrollArea>
+#include <QApplication>
+#include <QDebug>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QGraphicsView>
+#include <QJsonDocument>
+#include <QScrollBar>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QtMath>
+
+#include <algorithm>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+namespace
+{
+// grants access to QAbstractScrollArea::viewportEvent
+class ScrollAreaAccess : public QAbstractScrollArea
+{
+public:
+    using QAbstractScrollArea::viewportEvent;
+};
+}
+
+// DkReplay --------------------------------------------------------------------
+DkReplay::DkReplay(const QString &tracePath, DkNoMacs *window)
+    : mTracePath(tracePath)
+    , mWindow(window)
+{
+}
+
+/**
+ * Replays the trace in window and writes the results.
+ * @param tracePath the input trace (JSON)
+ * @param resultsPath the results file - results are printed to stdout if empty
+ * @param window the main window
+ * @return int the exit code
+ **/
+int DkReplay::runReplay(const QString &tracePath, const QString &resultsPath, DkNoMacs *window)
+{
+    // do not touch recent files & persistent caches
+    DkSettingsManager::edit().app().privateMode = true;
+
+    DkReplay replay(tracePath, window);
+
+    if (!replay.run())
+        return 1;
+
+    return replay.saveResults(resultsPath) ? 0 : 1;
+}
+
+bool DkReplay::run()
+{
+    if (!mWindow || !loadTrace() || !openFolder())
+        return false;
+
+    mClock.start();
+
+    for (const QJsonValue &v : mTrace["steps"].toArray())
+        runStep(v.toObject());
+
+    mStep = 0;
+
+    // stop listening before the widgets are deleted
+    if (mViewPort)
+        mViewPort->viewport()->removeEventFilter(this);
+    if (mThumbsViewport)
+        mThumbsViewport->removeEventFilter(this);
+
+    for (const Step &s : mSteps) {
+        QJsonObject r = stepResult(s);
+        qInfo().noquote() << "[Replay]" << s.action << "- first pixel p50:" << r["ttfp_ms"].toObject()["p50"].toDouble()
+                          << "ms p99:" << r["ttfp_ms"].toObject()["p99"].toDouble() << "ms | sharp p50:" << r["tts_ms"].toObject()["p50"].toDouble()
+                          << "ms | frames p99:" << r["frame_ms"].toObject()["p99"].toDouble() << "ms";
+    }
+
+    return true;
+}
+
+bool DkReplay::loadTrace()
+{
+    QFile file(mTracePath);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "[Replay] cannot open" << mTracePath;
+        return false;
+    }
+
+    QJsonParseError error;
+    mTrace = QJsonDocument::fromJson(file.readAll(), &error).object();
+
+    if (error.error != QJsonParseError::NoError) {
+        qCritical() << "[Replay] illegal trace" << mTracePath << error.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Loads the first image of the trace's folder and waits until it is shown.
+ **/
+bool DkReplay::openFolder()
+{
+    QDir traceDir = QFileInfo(mTracePath).absoluteDir();
+    QDir dir(traceDir.absoluteFilePath(mTrace["folder"].toString(".")));
+
+    QString filePath;
+    if (mTrace.contains("file"))
+        filePath = dir.absoluteFilePath(mTrace["file"].toString());
+    else {
+        QFileInfoList files = dir.entryInfoList(DkSettingsManager::param().app().fileFilters, QDir::Files, QDir::Name | QDir::IgnoreCase);
+
+        if (!files.empty())
+            filePath = files.first().absoluteFilePath();
+    }
+
+    if (filePath.isEmpty() || !QFileInfo::exists(filePath)) {
+        qCritical() << "[Replay] no image found in" << dir.absolutePath();
+        return false;
+    }
+
+    QJsonArray ws = mTrace["window"].toArray();
+    mWindow->resize(ws.size() == 2 ? QSize(ws[0].toInt(), ws[1].toInt()) : QSize(1280, 800));
+
+    DkCentralWidget *cw = mWindow->getTabWidget();
+    cw->showViewPort(true);
+    mWindow->loadFile(filePath);
+
+    mViewPort = cw->getViewPort();
+    mViewPort->viewport()->installEventFilter(this);
+
+    if (!waitFor([this]() { return isSharp(); }, 30000)) {
+        qCritical() << "[Replay] cannot display" << filePath;
+        return false;
+    }
+
+    return true;
+}
+
+void DkReplay::runStep(const QJsonObject &step)
+{
+    Step s;
+    s.action = step["action"].toString();
+    s.statsBefore = DkTelemetry::instance().stats();
+    mSteps.append(s);
+    mStep = &mSteps.last();
+
+    DkCentralWidget *cw = mWindow->getTabWidget();
+    int count = step["count"].toInt(1);
+    int interval = step["interval"].toInt(16);
+    int duration = step["duration"].toInt(1000);
+
+    QElapsedTimer dt;
+    dt.start();
+
+    if (mStep->action == "next" || mStep->action == "prev") {
+        int skip = mStep->action == "next" ? 1 : -1;
+
+        for (int idx = 0; idx < count; idx++) {
+            input([this, skip]() { mViewPort->loadFileFast(skip); }, true);
+            processEvents(interval);
+        }
+    } else if (mStep->action == "zoom") {
+        double factor = step["factor"].toDouble(1.25);
+
+        for (int idx = 0; idx < count; idx++) {
+            input([this, factor]() { mViewPort->zoom(factor); }, false);
+            processEvents(interval);
+        }
+    } else if (mStep->action == "pan") {
+        QPointF dxy(step["dx"].toDouble(), step["dy"].toDouble());
+
+        for (int idx = 0; idx < count; idx++) {
+            input([this, dxy]() { mViewPort->moveView(dxy); }, false);
+            processEvents(interval);
+        }
+    } else if (mStep->action == "thumbs") {
+        // switching to the thumbnail view is not part of the fling
+        cw->showThumbView(true);
+        QGraphicsView *view = cw->getThumbScrollWidget() ? cw->getThumbScrollWidget()->findChild<QGraphicsView *>() : 0;
+
+        if (view) {
+            mThumbsViewport = view->viewport();
+            mThumbsViewport->installEventFilter(this);
+            settle();
+            mStep->frames.clear();
+
+            int dy = step["dy"].toInt(300);
+
+            for (int idx = 0; idx < count; idx++) {
+                input([view, dy]() { view->verticalScrollBar()->setValue(view->verticalScrollBar()->value() + dy); }, false);
+                mStep->samples.last().needsSharp = false;
+                processEvents(interval);
+            }
+
+            settle();
+            mThumbsViewport->removeEventFilter(this);
+            mThumbsViewport = 0;
+        } else
+            qWarning() << "[Replay] no thumbnail view found";
+
+        cw->showViewPort(true);
+    } else if (mStep->action == "slideshow") {
+        QSharedPointer<DkImageLoader> loader = cw->getCurrentImageLoader();
+        QSharedPointer<DkImageContainerT> current = loader->getCurrentImage();
+        cw->startSlideshow(true);
+
+        // the slideshow switches images itself - we poll for the switches
+        while (dt.elapsed() < duration) {
+            processEvents(2);
+
+            if (loader->getCurrentImage() != current) {
+                current = loader->getCurrentImage();
+
+                Sample sample;
+                sample.t0 = now();
+                sample.target = current;
+                sample.newImage = true;
+                mStep->samples.append(sample);
+            }
+        }
+
+        cw->startSlideshow(false);
+    } else if (mStep->action == "wait") {
+        processEvents(duration);
+    } else
+        qWarning() << "[Replay] unknown action" << mStep->action;
+
+    settle();
+
+    mStep->duration = dt.elapsed();
+    mStep->statsAfter = DkTelemetry::instance().stats();
+    mStep = 0;
+}
+
+/**
+ * Issues an input and starts its sample.
+ * @param fnc the input
+ * @param newImage true if the input loads a new image
+ **/
+void DkReplay::input(const std::function<void()> &fnc, bool newImage)
+{
+    Sample sample;
+    sample.t0 = now();
+    sample.newImage = newImage;
+
+    if (newImage) {
+        // the user navigated away before the previous image was shown
+        for (Sample &s : mStep->samples) {
+            if (s.newImage && !s.skipped && (s.firstPixel < 0 || s.sharp < 0))
+                s.skipped = true;
+        }
+    }
+
+    fnc();
+
+    // the loader switches its current image synchronously
+    if (newImage)
+        sample.target = mWindow->getTabWidget()->getCurrentImageLoader()->getCurrentImage();
+
+    mStep->samples.append(sample);
+}
+
+/**
+ * Runs the event loop for ms milliseconds.
+ **/
+void DkReplay::processEvents(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+bool DkReplay::waitFor(const std::function<bool()> &cond, int timeoutMs)
+{
+    QElapsedTimer dt;
+    dt.start();
+
+    while (!cond()) {
+        if (dt.elapsed() > timeoutMs)
+            return false;
+
+        processEvents(5);
+    }
+
+    return true;
+}
+
+/**
+ * Waits until all samples of the current step are resolved.
+ **/
+bool DkReplay::settle(int timeoutMs)
+{
+    return waitFor(
+        [this]() {
+            for (const Sample &s : mStep->samples) {
+                if (!s.skipped && (s.firstPixel < 0 || (s.needsSharp && s.sharp < 0)))
+                    return false;
+            }
+            return true;
+        },
+        timeoutMs);
+}
+
+bool DkReplay::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() != QEvent::Paint || !mStep)
+        return QObject::eventFilter(watched, event);
+
+    QWidget *widget = qobject_cast<QWidget *>(watched);
+
+    if (!widget || (widget != mViewPort->viewport() && widget != mThumbsViewport))
+        return QObject::eventFilter(watched, event);
+
+    QAbstractScrollArea *area = qobject_cast<QAbstractScrollArea *>(widget->parentWidget());
+
+    if (!area)
+        return QObject::eventFilter(watched, event);
+
+    // paint here so that we can time the frame and evaluate it afterwards
+    // viewports are painted by their scroll area (e.g. DkViewPort::paintEvent) - just like its viewport filter does
+    QElapsedTimer dt;
+    dt.start();
+    (area->*(&ScrollAreaAccess::viewportEvent))(event);
+
+    painted(widget, dt.nsecsElapsed() / 1e6);
+
+    return true;
+}
+
+void DkReplay::painted(QWidget *widget, double ms)
+{
+    mStep->frames.append(ms);
+
+    bool vpPainted = widget == mViewPort->viewport();
+    double t = now();
+
+    for (Sample &s : mStep->samples) {
+        if (s.skipped || (s.firstPixel >= 0 && (!s.needsSharp || s.sharp >= 0)))
+            continue;
+
+        if (s.newImage) {
+            QSharedPointer<DkImageContainerT> target = s.target.toStrongRef();
+
+            if (!vpPainted || !target || mViewPort->imageContainer() != target || !target->hasImage())
+                continue;
+        }
+
+        if (s.firstPixel < 0)
+            s.firstPixel = t - s.t0;
+
+        if (s.needsSharp && s.sharp < 0 && vpPainted && isSharp())
+            s.sharp = t - s.t0;
+    }
+}
+
+/**
+ * True if the viewport shows the current image in full quality.
+ **/
+bool DkReplay::isSharp() const
+{
+    QSharedPointer<DkImageContainerT> imgC = mWindow->getTabWidget()->getCurrentImageLoader()->getCurrentImage();
+
+    return mViewPort && imgC && imgC->getLoadState() == DkImageContainer::loaded && mViewPort->imageContainer() == imgC
+        && !mViewPort->getImageStorage()->isComputing();
+}
+
+double DkReplay::now() const
+{
+    return mClock.isValid() ? mClock.nsecsElapsed() / 1e6 : 0.0;
+}
+
+QJsonObject DkReplay::stepResult(const Step &step) const
+{
+    QVector<double> ttfp;
+    QVector<double> tts;
+    int skipped = 0;
+    int timeouts = 0;
+
+    for (const Sample &s : step.samples) {
+        if (s.firstPixel >= 0)
+            ttfp << s.firstPixel;
+        if (s.sharp >= 0)
+            tts << s.sharp;
+
+        if (s.skipped)
+            skipped++;
+        else if (s.firstPixel < 0 || (s.needsSharp && s.sharp < 0))
+            timeouts++;
+    }
+
+    auto delta = [&step](DkTelemetry::Counter c) {
+        return step.statsAfter.counters[c] - step.statsBefore.counters[c];
+    };
+
+    QJsonObject r;
+    r["action"] = step.action;
+    r["inputs"] = step.samples.size();
+    r["duration_ms"] = step.duration;
+    r["ttfp_ms"] = percentiles(ttfp);
+    r["tts_ms"] = percentiles(tts);
+    r["frame_ms"] = percentiles(step.frames);
+    r["skipped"] = skipped;
+    r["timeouts"] = timeouts;
+    r["cache_hit"] = delta(DkTelemetry::cache_hit);
+    r["cache_partial_hit"] = delta(DkTelemetry::cache_partial_hit);
+    r["cache_miss"] = delta(DkTelemetry::cache_miss);
+    r["prefetch_used"] = delta(DkTelemetry::prefetch_used);
+    r["prefetch_wasted"] = delta(DkTelemetry::prefetch_wasted);
+
+    return r;
+}
+
+QJsonObject DkReplay::percentiles(QVector<double> values)
+{
+    QJsonObject p;
+    p["n"] = values.size();
+
+    if (values.empty())
+        return p;
+
+    std::sort(values.begin(), values.end());
+
+    // nearest rank
+    auto rank = [&values](double q) {
+        int idx = qBound(0, qCeil(q * values.size()) - 1, values.size() - 1);
+        return values[idx];
+    };
+
+    p["p50"] = rank(0.5);
+    p["p90"] = rank(0.9);
+    p["p99"] = rank(0.99);
+    p["max"] = values.last();
+
+    return p;
+}
+
+bool DkReplay::saveResults(const QString &filePath) const
+{
+    QJsonObject env;
+    env["nomacs"] = QApplication::applicationVersion();
+    env["qt"] = qVersion();
+    env["os"] = QSysInfo::prettyProductName();
+    env["cpu"] = QSysInfo::currentCpuArchitecture();
+    env["threads"] = QThread::idealThreadCount();
+    env["anti_aliasing"] = DkSettingsManager::param().display().antiAliasing;
+
+    QJsonArray steps;
+    for (const Step &s : mSteps)
+        steps.append(stepResult(s));
+
+    QJsonObject results;
+    results["trace"] = QFileInfo(mTracePath).fileName();
+    results["environment"] = env;
+    results["steps"] = steps;
+
+    QByteArray json = QJsonDocument(results).toJson();
+
+    if (filePath.isEmpty()) {
+        QTextStream(stdout) << json;
+        return true;
+    }
+
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "[Replay] cannot write results to" << filePath;
+        return false;
+    }
+
+    file.write(json);
+    qInfo() << "[Replay] results written to" << filePath;
+
+    return true;
+}
+
+}
@@ -0,0 +1,149 @@
+/*******************************************************************************************************
+ DkReplay.h
+ Created on:	15.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+#include <QWeakPointer>
+
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#include "DkTelemetry.h"
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+class QWidget;
+
+namespace nmc
+{
+
+class DkNoMacs;
+class DkViewPort;
+class DkImageContainerT;
+
+/**
+ * Replays a recorded input trace in the main window.
+ * The trace is a JSON file:
+ * {
+ *   "folder": "images",           // relative to the trace
+ *   "file": "first.jpg",          // optional - the first image of the folder otherwise
+ *   "window": [1280, 800],
+ *   "steps": [
+ *     { "action": "next", "count": 20, "interval": 50 },
+ *     { "action": "prev", "count": 5, "interval": 30 },
+ *     { "action": "zoom", "factor": 1.25, "count": 8, "interval": 16 },
+ *     { "action": "pan", "dx": 40, "dy": 0, "count": 30, "interval": 16 },
+ *     { "action": "thumbs", "dy": 300, "count": 40, "interval": 16 },
+ *     { "action": "slideshow", "duration": 5000 },
+ *     { "action": "wait", "duration": 1000 }
+ *   ]
+ * }
+ * Inputs are issued with a fixed interval, so bursts are faster than the
+ * decoder if the interval is short. For every input, the time to the first
+ * paint that shows its image (first pixel) and to the first paint of the
+ * anti-aliased full image (sharp) are recorded. Every paint of the
+ * viewport (or thumbnail view) is a frame. Cache hits are counted per step.
+ * The results report percentiles per step.
+ **/
+class DllCoreExport DkReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    DkReplay(const QString &tracePath, DkNoMacs *window);
+
+    bool run();
+    bool saveResults(const QString &filePath) const;
+
+    static int runReplay(const QString &tracePath, const QString &resultsPath, DkNoMacs *window);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    struct Sample {
+        double t0 = 0.0; // ms since the replay started
+        double firstPixel = -1.0; // ms after t0
+        double sharp = -1.0; // ms after t0
+        QWeakPointer<DkImageContainerT> target;
+        qint64 imageKey = 0; // the image shown before the input
+        bool newImage = false; // the input changes the image
+        bool needsSharp = true; // false if only the first pixel is measured (e.g. thumbnails)
+        bool skipped = false; // a later input changed the image first
+    };
+
+    struct Step {
+        QString action;
+        QVector<Sample> samples;
+        QVector<double> frames; // paint durations in ms
+        DkTelemetry::Stats statsBefore;
+        DkTelemetry::Stats statsAfter;
+        double duration = 0.0;
+    };
+
+    bool loadTrace();
+    bool openFolder();
+    void runStep(const QJsonObject &step);
+
+    void input(const std::function<void()> &fnc, bool newImage);
+    void processEvents(int ms);
+    bool waitFor(const std::function<bool()> &cond, int timeoutMs);
+    bool settle(int timeoutMs = 10000);
+    void painted(QWidget *widget, double ms);
+    bool isSharp() const;
+    double now() const;
+
+    QJsonObject stepResult(const Step &step) const;
+    static QJsonObject percentiles(QVector<double> values);
+
+    QString mTracePath;
+    QJsonObject mTrace;
+    DkNoMacs *mWindow = 0;
+    DkViewPort *mViewPort = 0;
+    QWidget *mThumbsViewport = 0;
+
+    QElapsedTimer mClock;
+    QVector<Step> mSteps;
+    Step *mStep = 0;
+};
+
+}
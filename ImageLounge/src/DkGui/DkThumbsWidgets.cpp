@@ -51,15 +51,18 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QProgressDialog>
 #include <QPushButton>
 #include <QResizeEvent>
 #include <QScrollBar>
+#include <QSet>
 #include <QStyleOptionGraphicsItem>
 #include <QThreadPool>
 #include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
 #include <QUrl>
+#include <algorithm>
 #include <qmath.h>
 #pragma warning(pop) // no warnings from includes - end
 
@@ -141,6 +144,8 @@ void DkFilePreview::initOrientations()
     else if (windowPosition == pos_east || windowPosition == pos_west || windowPosition == pos_dock_ver)
         orientation = Qt::Vertical;
 
+    mLayoutDirty = true;
+
     if (windowPosition == pos_dock_ver || windowPosition == pos_dock_hor)
         minHeight = max_thumb_size;
     else
@@ -253,6 +258,7 @@ void DkFilePreview::paintEvent(QPaintEvent *)
 
     if (mThumbs.empty()) {
         thumbRects.clear();
+        thumbEnds.clear();
         return;
     }
 
@@ -267,42 +273,38 @@ void DkFilePreview::paintEvent(QPaintEvent *)
     isPainted = true;
 }
 
-void DkFilePreview::drawThumbs(QPainter *painter)
+/**
+ * Computes the rects of all thumbs.
+ * The layout is cached - it only changes if thumbs are loaded, the
+ * folder changes or the widget is resized.
+ **/
+void DkFilePreview::updateLayout()
 {
-    // qDebug() << "drawing thumbs: " << worldMatrix.dx();
+    int ts = DkSettingsManager::param().effectiveThumbSize(this);
 
     bufferDim = (orientation == Qt::Horizontal) ? QRectF(QPointF(0, yOffset / 2), QSize(xOffset, 0)) : QRectF(QPointF(yOffset / 2, 0), QSize(0, xOffset));
-    thumbRects.clear();
-
-    DkTimer dt;
-
-    // mouse over effect
-    QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
+    thumbRects.resize(mThumbs.size());
+    thumbEnds.resize(mThumbs.size());
 
     for (int idx = 0; idx < mThumbs.size(); idx++) {
         QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
-        QImage img;
+        QSizeF s(ts, ts);
+
+        thumbRects[idx] = QRectF();
+        thumbEnds[idx] = orientation == Qt::Horizontal ? bufferDim.right() : bufferDim.bottom();
 
         // if the image is loaded draw that (it might be edited)
         if (mThumbs.at(idx)->hasImage()) {
-            img = mThumbs.at(idx)->imageScaledToHeight(DkSettingsManager::param().effectiveThumbSize(this));
-        } else {
-            if (thumb->hasImage() == DkThumbNail::exists_not) {
-                thumbRects.push_back(QRectF());
-                continue;
-            }
-
-            if (thumb->hasImage() == DkThumbNail::loaded)
-                img = thumb->getImage();
-        }
-
-        // if (img.width() > max_thumb_size * DkSettingsManager::param().dpiScaleFactor())
-        //	qDebug() << thumb->getFilePath() << "size:" << img.size();
+            QSize is = mThumbs.at(idx)->image().size();
+            if (!is.isEmpty())
+                s = QSizeF(qRound(is.width() * ts / (double)is.height()), ts);
+        } else if (thumb->hasImage() == DkThumbNail::exists_not)
+            continue;
+        else if (thumb->hasImage() == DkThumbNail::loaded)
+            s = thumb->getImage().size();
 
         QPointF anchor = orientation == Qt::Horizontal ? bufferDim.topRight() : bufferDim.bottomLeft();
-        QRectF r = !img.isNull()
-            ? QRectF(anchor, img.size())
-            : QRectF(anchor, QSize(DkSettingsManager::param().effectiveThumbSize(this), DkSettingsManager::param().effectiveThumbSize(this)));
+        QRectF r(anchor, s);
         if (orientation == Qt::Horizontal && height() - yOffset < r.height() * 2)
             r.setSize(QSizeF(qFloor(r.width() * (float)(height() - yOffset) / r.height()), height() - yOffset));
         else if (orientation == Qt::Vertical && width() - yOffset < r.width() * 2)
@@ -323,30 +325,98 @@ void DkFilePreview::drawThumbs(QPainter *painter)
             bufferDim.setRight(qFloor(bufferDim.right() + r.width()) + qCeil(xOffset / 2.0f));
         else
             bufferDim.setBottom(qFloor(bufferDim.bottom() + r.height()) + qCeil(xOffset / 2.0f));
-        thumbRects.push_back(r);
 
-        QRectF imgWorldRect = worldMatrix.mapRect(r);
+        thumbRects[idx] = r;
+        thumbEnds[idx] = orientation == Qt::Horizontal ? r.right() : r.bottom();
+    }
+
+    mLayoutSize = size();
+    mLayoutThumbSize = ts;
+    mLayoutDirty = false;
+}
+
+void DkFilePreview::invalidateLayout()
+{
+    mLayoutDirty = true;
+    update();
+}
 
-        // update file rect for move to current file timer
-        if (scrollToCurrentImage && idx == currentFileIdx)
-            newFileRect = imgWorldRect;
+/**
+ * Returns the index of the thumb at pos.
+ * @param pos the position in widget coordinates
+ * @return int the thumb's index or -1 if there is no thumb at pos
+ **/
+int DkFilePreview::thumbAt(const QPoint &pos) const
+{
+    QPointF p = worldMatrix.inverted().map(QPointF(pos));
+    qreal v = orientation == Qt::Horizontal ? p.x() : p.y();
 
-        // is the current image within the canvas?
-        if ((orientation == Qt::Horizontal && imgWorldRect.right() < 0) || (orientation == Qt::Vertical && imgWorldRect.bottom() < 0)) {
+    // the thumbs are sorted along the strip
+    int idx = int(std::lower_bound(thumbEnds.begin(), thumbEnds.end(), v) - thumbEnds.begin());
+
+    for (; idx < thumbRects.size() && idx < mThumbs.size(); idx++) {
+        const QRectF &r = thumbRects.at(idx);
+
+        if (r.isNull())
             continue;
-        }
+        if (r.contains(p))
+            return idx;
+        break;
+    }
+
+    return -1;
+}
+
+void DkFilePreview::drawThumbs(QPainter *painter)
+{
+    // qDebug() << "drawing thumbs: " << worldMatrix.dx();
 
-        if (((orientation == Qt::Horizontal && imgWorldRect.left() > width()) || (orientation == Qt::Vertical && imgWorldRect.top() > height()))
-            && scrollToCurrentImage) {
+    if (mLayoutDirty || mLayoutSize != size() || mLayoutThumbSize != DkSettingsManager::param().effectiveThumbSize(this))
+        updateLayout();
+
+    int ts = DkSettingsManager::param().effectiveThumbSize(this);
+
+    // mouse over effect
+    QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
+
+    // update file rect for move to current file timer
+    if (scrollToCurrentImage && currentFileIdx >= 0 && currentFileIdx < thumbRects.size() && !thumbRects.at(currentFileIdx).isNull())
+        newFileRect = worldMatrix.mapRect(thumbRects.at(currentFileIdx));
+
+    // visible range along the strip
+    QRectF view = worldMatrix.inverted().mapRect(QRectF(rect()));
+    qreal viewStart = orientation == Qt::Horizontal ? view.left() : view.top();
+    qreal viewEnd = orientation == Qt::Horizontal ? view.right() : view.bottom();
+
+    int first = int(std::lower_bound(thumbEnds.begin(), thumbEnds.end(), viewStart) - thumbEnds.begin());
+
+    for (int idx = first; idx < mThumbs.size(); idx++) {
+        const QRectF &r = thumbRects.at(idx);
+
+        if (r.isNull())
             continue;
-        } else if ((orientation == Qt::Horizontal && imgWorldRect.left() > width()) || (orientation == Qt::Vertical && imgWorldRect.top() > height())) {
+
+        if ((orientation == Qt::Horizontal ? r.left() : r.top()) > viewEnd)
             break;
+
+        QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
+        QImage img;
+
+        // if the image is loaded draw that (it might be edited) - the thumbnail is shown until it is scaled
+        if (mThumbs.at(idx)->hasImage()) {
+            connect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SLOT(invalidateLayout()), Qt::UniqueConnection);
+            img = mThumbs.at(idx)->imageScaledToHeightThreaded(ts);
         }
 
+        if (img.isNull() && thumb->hasImage() == DkThumbNail::loaded)
+            img = thumb->getImage();
+
+        QRectF imgWorldRect = worldMatrix.mapRect(r);
+
         // only fetch thumbs if we are not moving too fast...
         if (thumb->hasImage() == DkThumbNail::not_loaded && fabs(currentDx) < 40) {
             thumb->fetchThumb();
-            connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(update()));
+            connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(invalidateLayout()), Qt::UniqueConnection);
         }
 
         bool isLeftGradient = (orientation == Qt::Horizontal && worldMatrix.dx() < 0 && imgWorldRect.left() < leftGradient.finalStop().x())
@@ -549,28 +619,22 @@ void DkFilePreview::mouseMoveEvent(QMouseEvent *event)
     // select the current thumbnail
     if (dx > borderTrigger * 0.5) {
         int oldSelection = selected;
-        selected = -1;
 
         // find out where the mouse is
-        for (int idx = 0; idx < thumbRects.size(); idx++) {
-            if (worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-                selected = idx;
-
-                if (selected <= mThumbs.size() && selected >= 0) {
-                    QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
-                    // selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
-
-                    // important: setText shows the label - if you then hide it here again you'll get a stack overflow
-                    // if (fileLabel->height() < height())
-                    //	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
-                    QFileInfo fileInfo(thumb->getFilePath());
-                    QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + "\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + "\n"
-                        + tr("Created: ") + fileInfo.birthTime().toString();
-                    setToolTip(toolTipInfo);
-                    setStatusTip(fileInfo.fileName());
-                }
-                break;
-            }
+        selected = thumbAt(event->pos());
+
+        if (selected >= 0) {
+            QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
+            // selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
+
+            // important: setText shows the label - if you then hide it here again you'll get a stack overflow
+            // if (fileLabel->height() < height())
+            //	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
+            QFileInfo fileInfo(thumb->getFilePath());
+            QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + "\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + "\n"
+                + tr("Created: ") + fileInfo.birthTime().toString();
+            setToolTip(toolTipInfo);
+            setStatusTip(fileInfo.fileName());
         }
 
         if (selected != -1 || selected != oldSelection)
@@ -612,13 +676,12 @@ void DkFilePreview::mouseReleaseEvent(QMouseEvent *event)
 
     if (mouseTrace < 20) {
         // find out where the mouse did click
-        for (int idx = 0; idx < thumbRects.size(); idx++) {
-            if (idx < mThumbs.size() && worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-                if (mThumbs.at(idx)->isFromZip())
-                    emit changeFileSignal(idx - currentFileIdx);
-                else
-                    emit loadFileSignal(mThumbs.at(idx)->filePath() /*, event->modifiers() == Qt::ControlModifier*/);
-            }
+        int idx = thumbAt(event->pos());
+        if (idx != -1) {
+            if (mThumbs.at(idx)->isFromZip())
+                emit changeFileSignal(idx - currentFileIdx);
+            else
+                emit loadFileSignal(mThumbs.at(idx)->filePath() /*, event->modifiers() == Qt::ControlModifier*/);
         }
     } else
         unsetCursor();
@@ -641,7 +704,7 @@ void DkFilePreview::wheelEvent(QWheelEvent *event)
             newSize = max_thumb_size;
 
         if (newSize != DkSettingsManager::param().display().thumbSize) {
-            DkSettingsManager::param().display().thumbSize = newSize;
+            DkSettingsManager::edit().display().thumbSize = newSize;
             update();
         }
     } else if (delta != 0) {
@@ -784,7 +847,7 @@ void DkFilePreview::updateFileIdx(int idx)
     currentFileIdx = idx;
     if (currentFileIdx >= 0)
         scrollToCurrentImage = true;
-    update();
+    invalidateLayout();
 }
 
 void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage)
@@ -810,6 +873,7 @@ void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage)
 void DkFilePreview::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
 {
     mThumbs = thumbs;
+    mLayoutDirty = true;
 
     for (int idx = 0; idx < thumbs.size(); idx++) {
         if (thumbs.at(idx)->isSelected()) {
@@ -838,7 +902,6 @@ DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem *pa
     mIsHovered = false;
 
     setThumb(thumb);
-    setFlag(ItemIsSelectable, true);
 
     setAcceptHoverEvents(true);
 }
@@ -849,8 +912,19 @@ DkThumbLabel::~DkThumbLabel()
 
 void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb)
 {
+    // labels are recycled
+    if (mThumb)
+        disconnect(mThumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(updateLabel()));
+
     this->mThumb = thumb;
 
+    mThumbInitialized = false;
+    mTextInitialized = false;
+    mFetchingThumb = false;
+    mIsHovered = false;
+    mIcon.setPixmap(QPixmap());
+    mText.setPlainText("");
+
     if (thumb.isNull())
         return;
 
@@ -878,9 +952,36 @@ QPixmap DkThumbLabel::pixmap() const
 
 void DkThumbLabel::cancelLoading()
 {
+    if (!mThumb.isNull())
+        mThumb->cancelFetch();
+
     mFetchingThumb = false;
 }
 
+void DkThumbLabel::setIndex(int idx)
+{
+    mIdx = idx;
+}
+
+int DkThumbLabel::index() const
+{
+    return mIdx;
+}
+
+void DkThumbLabel::setThumbSelected(bool selected)
+{
+    if (selected == mSelected)
+        return;
+
+    mSelected = selected;
+    update();
+}
+
+bool DkThumbLabel::isThumbSelected() const
+{
+    return mSelected;
+}
+
 QRectF DkThumbLabel::boundingRect() const
 {
     int sz = DkSettingsManager::param().effectiveThumbPreviewSize();
@@ -903,11 +1004,14 @@ void DkThumbLabel::updateLabel()
     QPixmap pm;
 
     if (!mThumb->getImage().isNull()) {
-        pm = QPixmap::fromImage(mThumb->getImage());
+        bool squared = DkSettingsManager::param().display().displaySquaredThumbs;
 
-        if (DkSettingsManager::param().display().displaySquaredThumbs) {
-            pm = DkImage::makeSquare(pm);
-        }
+        // the loader threads typically prepared it already - so this is a plain upload
+        QImage img = mThumb->getDisplayImage(squared);
+        if (img.isNull())
+            img = DkThumbNail::displayImage(mThumb->getImage(), squared);
+
+        pm = QPixmap::fromImage(img, Qt::NoFormatConversion);
     } else
         qDebug() << "update called on empty thumb label!";
 
@@ -916,18 +1020,10 @@ void DkThumbLabel::updateLabel()
         mIcon.setPixmap(pm);
         mIcon.setFlag(ItemIsSelectable, true);
     }
-    if (pm.isNull())
-        setFlag(ItemIsSelectable, false); // if we cannot load it -> disable selection
 
-    // update label
+    // update label - the text itself is laid out when it is drawn the first time
     mText.setPos(0, pm.height());
-    mText.setDefaultTextColor(QColor(255, 255, 255));
-
-    QFont font;
-    font.setBold(false);
-    font.setPointSize(8);
-    mText.setFont(font);
-    mText.setPlainText(QFileInfo(mThumb->getFilePath()).fileName());
+    mTextInitialized = false;
     mText.hide();
 
     prepareGeometryChange();
@@ -1031,6 +1127,21 @@ void DkThumbLabel::paint(QPainter *painter, const QStyleOptionGraphicsItem *opti
 
     // draw text
     if (boundingRect().width() > 50 && DkSettingsManager::param().display().showThumbLabel) {
+        if (!mTextInitialized) {
+            static const QFont font = []() {
+                QFont f;
+                f.setBold(false);
+                f.setPointSize(8);
+                return f;
+            }();
+
+            const QString &fp = mThumb->getFilePath();
+            mText.setDefaultTextColor(QColor(255, 255, 255));
+            mText.setFont(font);
+            mText.setPlainText(fp.mid(fp.lastIndexOf('/') + 1));
+            mTextInitialized = true;
+        }
+
         QTransform tt = mt;
         tt.translate(0, boundingRect().height() - mText.boundingRect().height());
 
@@ -1053,7 +1164,7 @@ void DkThumbLabel::paint(QPainter *painter, const QStyleOptionGraphicsItem *opti
     }
 
     // render selected
-    if (isSelected()) {
+    if (mSelected) {
         painter->setBrush(mSelectBrush);
         painter->setPen(mSelectPen);
         painter->drawRect(boundingRect());
@@ -1065,13 +1176,18 @@ DkThumbScene::DkThumbScene(QWidget *parent /* = 0 */)
     : QGraphicsScene(parent)
 {
     setObjectName("DkThumbWidget");
+
+    connect(&mIndexWatcher, SIGNAL(finished()), this, SLOT(thumbsIndexed()));
 }
 
 void DkThumbScene::updateLayout()
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
+    // the rows change - the view schedules the new ones
+    cancelScheduledRows();
+
     QSize pSize;
 
     if (!views().empty())
@@ -1080,75 +1196,280 @@ void DkThumbScene::updateLayout()
     int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
     mXOffset = 2; // qCeil(psz*0.1f);
     mNumCols = qMax(qFloor(((float)pSize.width() - mXOffset) / (psz + mXOffset)), 1);
-    mNumCols = qMin(mThumbLabels.size(), mNumCols);
-    mNumRows = qCeil((float)mThumbLabels.size() / mNumCols);
+    mNumCols = qMin(mThumbs.size(), mNumCols);
+    mNumRows = qCeil((float)mThumbs.size() / mNumCols);
 
     int tso = psz + mXOffset;
     setSceneRect(0, 0, mNumCols * tso + mXOffset, mNumRows * tso + mXOffset);
 
-    DkTimer dt;
-    int cYOffset = mXOffset;
+    // positions are computed on the fly - so just re-materialize the visible labels
+    releaseLabels();
+
+    int selIdx = selectedThumbIndex();
+    if (selIdx != -1 && !views().empty())
+        views().first()->ensureVisible(thumbRect(selIdx));
+
+    updateVisibleLabels(visibleRect());
+
+    mFirstLayout = false;
+}
+
+void DkThumbScene::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+{
+    // the folder changed - do not index the old one
+    mIndexToken.cancel();
+    mIndexToken = DkCancelToken();
+    mPendingSelection = select_none;
 
-    for (int rIdx = 0; rIdx < mNumRows; rIdx++) {
-        int cXOffset = mXOffset;
+    this->mThumbs = thumbs;
+    updateThumbLabels();
+}
 
-        for (int cIdx = 0; cIdx < mNumCols; cIdx++) {
-            int tIdx = rIdx * mNumCols + cIdx;
+void DkThumbScene::updateThumbLabels()
+{
+    cancelScheduledRows();
+    releaseLabels();
 
-            if (tIdx < 0 || tIdx >= mThumbLabels.size())
-                break;
+    mSelected = QBitArray(mThumbs.size());
 
-            DkThumbLabel *cLabel = mThumbLabels.at(tIdx);
-            cLabel->setPos(cXOffset, cYOffset);
-            cLabel->updateSize();
+    showFile();
 
-            cXOffset += psz + mXOffset;
+    if (!mThumbs.empty())
+        updateLayout();
+
+    emit selectionChanged();
+}
+
+/**
+ * Materializes labels for all visible rows (+ one row margin).
+ * Labels that scrolled out of the window are recycled.
+ * @param visibleRect the visible scene rect
+ **/
+void DkThumbScene::updateVisibleLabels(const QRectF &visibleRect)
+{
+    if (mThumbs.empty() || mNumCols <= 0 || mNumRows <= 0)
+        return;
+
+    int tso = DkSettingsManager::param().effectiveThumbPreviewSize() + mXOffset;
+    int firstRow = qBound(0, qFloor((visibleRect.top() - mXOffset) / tso) - 1, mNumRows - 1);
+    int lastRow = qBound(0, qFloor((visibleRect.bottom() - mXOffset) / tso) + 1, mNumRows - 1);
+
+    int first = firstRow * mNumCols;
+    int last = qMin((lastRow + 1) * mNumCols, mThumbs.size()) - 1;
+
+    // recycle labels that left the window
+    for (auto it = mLabels.begin(); it != mLabels.end();) {
+        if (it.key() < first || it.key() > last) {
+            DkThumbLabel *label = it.value();
+            disconnect(label->getThumb().data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+            label->hide();
+            label->setThumb(QSharedPointer<DkThumbNailT>());
+            mFreeLabels << label;
+            it = mLabels.erase(it);
+        } else
+            ++it;
+    }
+
+    for (int idx = first; idx <= last; idx++) {
+        if (mLabels.contains(idx))
+            continue;
+
+        DkThumbLabel *label = 0;
+
+        if (!mFreeLabels.empty())
+            label = mFreeLabels.takeLast();
+        else {
+            label = new DkThumbLabel();
+            connect(label, SIGNAL(loadFileSignal(const QString &, bool)), this, SIGNAL(loadFileSignal(const QString &, bool)));
+            connect(label, SIGNAL(showFileSignal(const QString &)), this, SLOT(showFile(const QString &)));
+            addItem(label);
         }
 
-        // update ypos
-        cYOffset += psz + mXOffset; // 20 for label
+        QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
+        connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()), Qt::UniqueConnection);
+
+        // labels fetch on paint - so they need to know the level first
+        thumb->setMaxThumbSize(thumbLevel());
+        label->setThumb(thumb);
+        label->setIndex(idx);
+        label->setThumbSelected(mSelected.testBit(idx));
+        label->setPos(thumbRect(idx).topLeft());
+        label->show();
+
+        mLabels.insert(idx, label);
     }
+}
 
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (mThumbLabels.at(idx)->isSelected())
-            mThumbLabels.at(idx)->ensureVisible();
+/**
+ * Recycles all labels.
+ **/
+void DkThumbScene::releaseLabels()
+{
+    for (DkThumbLabel *label : mLabels) {
+        if (label->getThumb())
+            disconnect(label->getThumb().data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+        label->hide();
+        label->setThumb(QSharedPointer<DkThumbNailT>());
+        mFreeLabels << label;
     }
 
-    mFirstLayout = false;
+    mLabels.clear();
 }
 
-void DkThumbScene::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+/**
+ * Returns the thumbnail index at the scene position.
+ * @param scenePos a position in scene coordinates
+ * @return int the thumbnail index or -1 if there is no thumbnail.
+ **/
+int DkThumbScene::indexAt(const QPointF &scenePos) const
 {
-    this->mThumbs = thumbs;
-    updateThumbLabels();
+    if (mNumCols <= 0)
+        return -1;
+
+    int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
+    int tso = psz + mXOffset;
+
+    double x = scenePos.x() - mXOffset;
+    double y = scenePos.y() - mXOffset;
+
+    if (x < 0 || y < 0)
+        return -1;
+
+    int cIdx = qFloor(x / tso);
+    int rIdx = qFloor(y / tso);
+
+    // we are in between two thumbs
+    if (cIdx >= mNumCols || x - cIdx * tso > psz || y - rIdx * tso > psz)
+        return -1;
+
+    int idx = rIdx * mNumCols + cIdx;
+
+    return idx < mThumbs.size() ? idx : -1;
 }
 
-void DkThumbScene::updateThumbLabels()
+/**
+ * Returns the scene rect of a thumbnail.
+ * @param idx the thumbnail index
+ * @return QRectF the thumbnail's rect in scene coordinates.
+ **/
+QRectF DkThumbScene::thumbRect(int idx) const
 {
-    blockSignals(true); // do not emit selection changed while clearing!
-    clear(); // deletes the thumbLabels
-    blockSignals(false);
+    if (mNumCols <= 0)
+        return QRectF();
+
+    int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
+    int tso = psz + mXOffset;
 
-    mThumbLabels.clear();
+    return QRectF(mXOffset + (idx % mNumCols) * tso, mXOffset + (idx / mNumCols) * tso, psz, psz);
+}
 
-    for (int idx = 0; idx < mThumbs.size(); idx++) {
-        DkThumbLabel *thumb = new DkThumbLabel(mThumbs.at(idx)->getThumb());
-        connect(thumb, SIGNAL(loadFileSignal(const QString &, bool)), this, SIGNAL(loadFileSignal(const QString &, bool)));
-        connect(thumb, SIGNAL(showFileSignal(const QString &)), this, SLOT(showFile(const QString &)));
-        connect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+QRectF DkThumbScene::visibleRect() const
+{
+    if (views().empty())
+        return sceneRect();
+
+    QGraphicsView *v = views().first();
+    return v->mapToScene(v->viewport()->rect()).boundingRect();
+}
 
-        // thumb->show();
-        addItem(thumb);
-        mThumbLabels.append(thumb);
-        // thumbsNotLoaded.append(thumb);
+/**
+ * Requests the thumbnails of the visible rows and of a lookahead ring.
+ * Visible thumbnails are loaded first, the lookahead (one page in the scroll direction)
+ * gets lower priorities the further it is away. Requests of rows that left the
+ * window are removed from the thumbs pool.
+ * @param visibleRect the visible scene rect
+ * @param direction > 0 if the user scrolls down, < 0 if up
+ **/
+void DkThumbScene::scheduleThumbs(const QRectF &visibleRect, int direction)
+{
+    if (mThumbs.empty() || mNumCols <= 0 || mNumRows <= 0)
+        return;
+
+    int tso = DkSettingsManager::param().effectiveThumbPreviewSize() + mXOffset;
+    int firstVisible = qBound(0, qFloor((visibleRect.top() - mXOffset) / tso), mNumRows - 1);
+    int lastVisible = qBound(0, qFloor((visibleRect.bottom() - mXOffset) / tso), mNumRows - 1);
+    int lookahead = lastVisible - firstVisible + 1;
+
+    int first = firstVisible;
+    int last = lastVisible;
+
+    if (direction > 0)
+        last = qMin(lastVisible + lookahead, mNumRows - 1);
+    else if (direction < 0)
+        first = qMax(firstVisible - lookahead, 0);
+
+    // rows that scrolled away
+    if (mFirstScheduledRow != -1) {
+        cancelScheduledRows(mFirstScheduledRow, qMin(mLastScheduledRow, first - 1));
+        cancelScheduledRows(qMax(mFirstScheduledRow, last + 1), mLastScheduledRow);
     }
 
-    showFile();
+    for (int rIdx = first; rIdx <= last; rIdx++) {
+        int dist = 0;
+        if (rIdx < firstVisible)
+            dist = firstVisible - rIdx;
+        else if (rIdx > lastVisible)
+            dist = rIdx - lastVisible;
 
-    if (!mThumbs.empty())
-        updateLayout();
+        for (int tIdx = rIdx * mNumCols; tIdx < qMin((rIdx + 1) * mNumCols, mThumbs.size()); tIdx++)
+            fetchThumb(tIdx, DkThumbNailT::priority_visible - dist);
+    }
 
-    emit selectionChanged();
+    mFirstScheduledRow = first;
+    mLastScheduledRow = last;
+}
+
+/**
+ * Cancels pending thumbnail requests of the scheduled rows [first last].
+ * @param first the first row
+ * @param last the last row (-1 cancels all scheduled rows)
+ **/
+void DkThumbScene::cancelScheduledRows(int first, int last)
+{
+    if (mFirstScheduledRow == -1)
+        return;
+
+    bool all = last == -1;
+
+    if (all) {
+        first = mFirstScheduledRow;
+        last = mLastScheduledRow;
+    }
+
+    for (int tIdx = first * mNumCols; tIdx <= qMin((last + 1) * mNumCols - 1, mThumbs.size() - 1); tIdx++)
+        cancelThumb(tIdx);
+
+    if (all)
+        mFirstScheduledRow = mLastScheduledRow = -1;
+}
+
+void DkThumbScene::fetchThumb(int idx, int priority)
+{
+    QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
+    thumb->setMaxThumbSize(thumbLevel());
+
+    if (!thumb->fetchThumb(DkThumbNail::do_not_force, QSharedPointer<QByteArray>(), priority))
+        thumb->setPriority(priority); // already requested
+}
+
+/**
+ * Returns the thumbnail mip level for the current zoom.
+ * Zooming in fetches the next larger level while the labels keep
+ * showing the smaller one.
+ **/
+int DkThumbScene::thumbLevel() const
+{
+    double dpr = views().empty() ? 1.0 : views().first()->devicePixelRatioF();
+    return DkThumbNail::mipLevel(qRound(DkSettingsManager::param().effectiveThumbPreviewSize() * dpr));
+}
+
+void DkThumbScene::cancelThumb(int idx)
+{
+    // labels need to know that they have to fetch again
+    if (mLabels.contains(idx))
+        mLabels.value(idx)->cancelLoading();
+    else
+        mThumbs.at(idx)->getThumb()->cancelFetch();
 }
 
 void DkThumbScene::setImageLoader(QSharedPointer<DkImageLoader> loader)
@@ -1194,7 +1515,7 @@ void DkThumbScene::keyPressEvent(QKeyEvent *event)
         break;
     }
     case Qt::Key_Right: {
-        selectThumb(qMin(idx + 1, mThumbLabels.size() - 1));
+        selectThumb(qMin(idx + 1, mThumbs.size() - 1));
         break;
     }
     case Qt::Key_Up: {
@@ -1202,23 +1523,44 @@ void DkThumbScene::keyPressEvent(QKeyEvent *event)
         break;
     }
     case Qt::Key_Down: {
-        selectThumb(qMin(idx + mNumCols, mThumbLabels.size() - 1));
+        selectThumb(qMin(idx + mNumCols, mThumbs.size() - 1));
         break;
     }
     }
 }
 
+void DkThumbScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
+{
+    QGraphicsScene::mousePressEvent(event);
+
+    // the selection lives in mSelected (not in the items) - so we handle it here
+    int idx = indexAt(event->scenePos());
+
+    if (idx == -1) {
+        if (event->modifiers() == Qt::NoModifier)
+            selectThumbs(false);
+        return;
+    }
+
+    if (event->modifiers() & Qt::ControlModifier)
+        selectThumb(idx, !mSelected.testBit(idx));
+    else if (!(event->modifiers() & Qt::ShiftModifier) && !(event->button() == Qt::RightButton && mSelected.testBit(idx))) {
+        selectThumbs(false);
+        selectThumb(idx);
+    }
+}
+
 void DkThumbScene::showFile(const QString &filePath)
 {
     if (filePath == QDir::currentPath() || filePath.isEmpty()) {
-        int sf = getSelectedFiles().size();
+        int sf = mSelected.count(true);
 
         QString info;
 
         if (sf > 1)
             info = QString::number(sf) + tr(" selected");
         else
-            info = QString::number(mThumbLabels.size()) + tr(" images");
+            info = QString::number(mThumbs.size()) + tr(" images");
 
         DkStatusBarManager::instance().setMessage(tr("%1 | %2").arg(info, currentDir()));
     } else
@@ -1227,12 +1569,12 @@ void DkThumbScene::showFile(const QString &filePath)
 
 void DkThumbScene::ensureVisible(QSharedPointer<DkImageContainerT> img) const
 {
-    if (!img)
+    if (!img || views().empty())
         return;
 
-    for (DkThumbLabel *label : mThumbLabels) {
-        if (label->getThumb()->getFilePath() == img->filePath()) {
-            label->ensureVisible();
+    for (int idx = 0; idx < mThumbs.size(); idx++) {
+        if (mThumbs.at(idx)->filePath() == img->filePath()) {
+            views().first()->ensureVisible(thumbRect(idx));
             break;
         }
     }
@@ -1249,10 +1591,10 @@ QString DkThumbScene::currentDir() const
 int DkThumbScene::selectedThumbIndex(bool first)
 {
     int selIdx = -1;
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (first && mThumbLabels[idx]->isSelected())
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (first && mSelected.testBit(idx))
             return idx;
-        else if (mThumbLabels[idx]->isSelected())
+        else if (mSelected.testBit(idx))
             selIdx = idx;
     }
 
@@ -1261,17 +1603,17 @@ int DkThumbScene::selectedThumbIndex(bool first)
 
 void DkThumbScene::toggleThumbLabels(bool show)
 {
-    DkSettingsManager::param().display().showThumbLabel = show;
+    DkSettingsManager::edit().display().showThumbLabel = show;
 
-    for (const auto t : mThumbLabels)
+    for (const auto t : mLabels)
         t->update();
 }
 
 void DkThumbScene::toggleSquaredThumbs(bool squares)
 {
-    DkSettingsManager::param().display().displaySquaredThumbs = squares;
+    DkSettingsManager::edit().display().displaySquaredThumbs = squares;
 
-    for (const auto t : mThumbLabels)
+    for (const auto t : mLabels)
         t->updateLabel();
 
     // well, that's not too beautiful
@@ -1297,17 +1639,17 @@ void DkThumbScene::resizeThumbs(float dx)
     int newSize = qRound(DkSettingsManager::param().display().thumbPreviewSize * dx);
 
     if (newSize > 6 && newSize <= max_thumb_size) {
-        DkSettingsManager::param().display().thumbPreviewSize = newSize;
+        DkSettingsManager::edit().display().thumbPreviewSize = newSize;
         updateLayout();
     }
 }
 
 void DkThumbScene::cancelLoading()
 {
-    DkThumbsThreadPool::clear();
-
-    for (auto t : mThumbLabels)
+    for (auto t : mLabels)
         t->cancelLoading();
+
+    mFirstScheduledRow = mLastScheduledRow = -1;
 }
 
 void DkThumbScene::selectAllThumbs(bool selected)
@@ -1317,11 +1659,11 @@ void DkThumbScene::selectAllThumbs(bool selected)
 
 void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */, int to /* = -1 */)
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
     if (to == -1)
-        to = mThumbLabels.size() - 1;
+        to = mThumbs.size() - 1;
 
     if (from > to) {
         int tmp = to;
@@ -1329,28 +1671,173 @@ void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */,
         from = tmp;
     }
 
-    blockSignals(true);
-    for (int idx = from; idx <= to && idx < mThumbLabels.size(); idx++) {
-        mThumbLabels.at(idx)->setSelected(selected);
+    for (int idx = from; idx <= to && idx < mThumbs.size(); idx++) {
+        // thumbs that cannot be loaded are not selectable
+        if (selected && mThumbs.at(idx)->getThumb()->hasImage() == DkThumbNail::exists_not)
+            continue;
+
+        mSelected.setBit(idx, selected);
+
+        if (mLabels.contains(idx))
+            mLabels.value(idx)->setThumbSelected(selected);
     }
-    blockSignals(false);
+
+    emit selectionChanged();
+    showFile(); // update selection label
+}
+
+/**
+ * Selects all images that look like the selected images (see DkImageHashIndex).
+ **/
+void DkThumbScene::selectSimilar()
+{
+    indexThumbs(select_similar);
+}
+
+/**
+ * Selects all but the first image of each group of (near) duplicates.
+ * So deleting the selection culls the duplicates.
+ **/
+void DkThumbScene::selectDuplicates()
+{
+    indexThumbs(select_duplicates);
+}
+
+/**
+ * Hashes all images whose thumbnails were not loaded yet and selects afterwards.
+ * The images are hashed in parallel chunks - thumbnails that are cached persistently do not need to be decoded.
+ * @param selection the selection that is applied once all images are indexed
+ **/
+void DkThumbScene::indexThumbs(HashSelection selection)
+{
+    QStringList files;
+    for (auto t : mThumbs) {
+        if (!DkImageHashIndex::instance().contains(t->filePath()) && t->getThumb()->hasImage() != DkThumbNail::exists_not)
+            files << t->filePath();
+    }
+
+    if (files.empty()) {
+        selectFromIndex(selection);
+        return;
+    }
+
+    // the latest request wins
+    mPendingSelection = selection;
+
+    if (mIndexWatcher.isRunning())
+        return;
+
+    DkStatusBarManager::instance().setMessage(tr("Indexing %1 images...").arg(files.size()));
+
+    DkCancelToken token = mIndexToken;
+    QFuture<int> future = DkScheduler::instance().run(
+        DkScheduler::lane_io,
+        DkScheduler::priority_thumbnail,
+        [files, token]() {
+            const int chunkSize = 64;
+            QVector<QFuture<int>> chunks;
+
+            for (int idx = 0; idx < files.size(); idx += chunkSize) {
+                QStringList chunk = files.mid(idx, chunkSize);
+                chunks << DkScheduler::instance().run(
+                    DkScheduler::lane_cpu,
+                    DkScheduler::priority_thumbnail,
+                    [chunk]() {
+                        return DkImageHashIndex::instance().index(chunk);
+                    },
+                    token);
+            }
+
+            int numIndexed = 0;
+            for (QFuture<int> &c : chunks) {
+                c.waitForFinished();
+
+                if (c.resultCount() > 0)
+                    numIndexed += c.result();
+            }
+
+            return numIndexed;
+        },
+        token);
+
+    mIndexWatcher.setFuture(future);
+}
+
+void DkThumbScene::thumbsIndexed()
+{
+    HashSelection selection = mPendingSelection;
+    mPendingSelection = select_none;
+
+    if (selection == select_none)
+        return;
+
+    // the indexing of a previous folder was canceled - index this one
+    if (mIndexWatcher.isCanceled())
+        indexThumbs(selection);
+    else
+        selectFromIndex(selection);
+}
+
+void DkThumbScene::selectFromIndex(HashSelection selection)
+{
+    const DkImageHashIndex &index = DkImageHashIndex::instance();
+    QSet<QString> files;
+
+    if (selection == select_similar) {
+        for (const QString &fp : getSelectedFiles()) {
+            for (const QString &sfp : index.findSimilar(fp))
+                files.insert(sfp);
+        }
+    } else if (selection == select_duplicates) {
+        QStringList allFiles;
+        for (auto t : mThumbs)
+            allFiles << t->filePath();
+
+        // keep the first image of each group
+        for (const QStringList &g : index.groups(allFiles, DkImageHashIndex::distance_duplicate)) {
+            for (int idx = 1; idx < g.size(); idx++)
+                files.insert(g[idx]);
+        }
+
+        selectThumbs(false);
+    }
+
+    if (files.empty()) {
+        DkStatusBarManager::instance().setMessage(selection == select_similar ? tr("No similar images found") : tr("No duplicates found"));
+        return;
+    }
+
+    for (int idx = 0; idx < mThumbs.size(); idx++) {
+        if (!files.contains(mThumbs.at(idx)->filePath()))
+            continue;
+
+        mSelected.setBit(idx, true);
+
+        if (mLabels.contains(idx))
+            mLabels.value(idx)->setThumbSelected(true);
+    }
+
     emit selectionChanged();
     showFile(); // update selection label
 }
 
 void DkThumbScene::selectThumb(int idx, bool select)
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
-    if (idx < 0 || idx >= mThumbLabels.size()) {
+    if (idx < 0 || idx >= mThumbs.size()) {
         qWarning() << "index out of bounds in selectThumbs()" << idx;
         return;
     }
 
-    blockSignals(true);
-    mThumbLabels[idx]->setSelected(select);
-    blockSignals(false);
+    if (select && mThumbs.at(idx)->getThumb()->hasImage() == DkThumbNail::exists_not)
+        return;
+
+    mSelected.setBit(idx, select);
+
+    if (mLabels.contains(idx))
+        mLabels.value(idx)->setThumbSelected(select);
 
     emit selectionChanged();
     showFile(); // update selection label
@@ -1376,72 +1863,47 @@ void DkThumbScene::copySelected() const
     }
 }
 
-void DkThumbScene::pasteImages() const
+void DkThumbScene::pasteImages()
 {
     copyImages(QApplication::clipboard()->mimeData());
 }
 
-void DkThumbScene::copyImages(const QMimeData *mimeData, const Qt::DropAction &da) const
+void DkThumbScene::copyImages(const QMimeData *mimeData, const Qt::DropAction &da)
 {
     if (!mimeData || !mimeData->hasUrls() || !mLoader)
         return;
 
     QDir dir = mLoader->getDirPath();
+    QStringList srcPaths;
+    QStringList dstPaths;
 
     for (QUrl url : mimeData->urls()) {
         QFileInfo fileInfo = DkUtils::urlToLocalFile(url);
-        QFile file(fileInfo.absoluteFilePath());
         QString newFilePath = QFileInfo(dir, fileInfo.fileName()).absoluteFilePath();
 
-        // ignore existing silently
-        if (QFileInfo(newFilePath).exists())
-            continue;
-
-        auto askUser = [&](const QString &aMsg) {
-            int answer = QMessageBox::critical(DkUtils::getMainWindow(),
-                                               tr("Error"),
-                                               tr("Sorry, I cannot %1 %2").arg(aMsg, newFilePath),
-                                               QMessageBox::Ok | QMessageBox::Cancel);
-
-            return answer == QMessageBox::Cancel;
-        };
-
-        bool userCanceled = false;
-
-        switch (da) {
-        // move files -> a move is actually a rename
-        case Qt::MoveAction: {
-            if (!file.rename(newFilePath))
-                userCanceled = askUser(tr("move"));
-            break;
-        }
-        // create links
-        case Qt::LinkAction: {
 #ifdef Q_OS_WIN
+        if (da == Qt::LinkAction)
             newFilePath += ".lnk";
 #endif
 
-            if (!file.link(newFilePath)) {
-                userCanceled = askUser(tr("create link"));
-            }
-            break;
-        }
+        srcPaths << fileInfo.absoluteFilePath();
+        dstPaths << newFilePath;
+    }
 
-        default: {
-            // our default action is copying (usually done without modifiers)
-            if (!file.copy(newFilePath)) {
-                userCanceled = askUser(tr("copy"));
-            }
-            break;
-        }
-        }
+    DkFileOperations::Operation op = DkFileOperations::op_copy;
 
-        if (userCanceled)
-            break;
-    }
+    // move files -> a move is actually a rename
+    if (da == Qt::MoveAction)
+        op = DkFileOperations::op_move;
+    // create links
+    else if (da == Qt::LinkAction)
+        op = DkFileOperations::op_link;
+
+    // our default action is copying (usually done without modifiers)
+    startFileOperations(new DkFileOperations(op, srcPaths, dstPaths));
 }
 
-void DkThumbScene::deleteSelected() const
+void DkThumbScene::deleteSelected()
 {
     QStringList fileList = getSelectedFiles();
 
@@ -1467,35 +1929,11 @@ void DkThumbScene::deleteSelected() const
 
     int answer = msgBox->exec();
 
-    if (answer == QMessageBox::Yes || answer == QMessageBox::Accepted) {
-        if (mLoader && fileList.size() > 100) // saves CPU
-            mLoader->deactivate();
-
-        for (const QString &fString : fileList) {
-            QString fName = QFileInfo(fString).fileName();
-            qDebug() << "deleting: " << fString;
-
-            if (!DkUtils::moveToTrash(fString)) {
-                answer = QMessageBox::critical(DkUtils::getMainWindow(),
-                                               tr("Error"),
-                                               tr("Sorry, I cannot delete:\n%1").arg(fName),
-                                               QMessageBox::Ok | QMessageBox::Cancel);
-
-                if (answer == QMessageBox::Cancel) {
-                    break;
-                }
-            }
-        }
-
-        if (mLoader && fileList.size() > 100) // saves CPU
-            mLoader->activate();
-
-        if (mLoader)
-            mLoader->directoryChanged(mLoader->getDirPath());
-    }
+    if (answer == QMessageBox::Yes || answer == QMessageBox::Accepted)
+        startFileOperations(new DkFileOperations(DkFileOperations::op_trash, fileList));
 }
 
-void DkThumbScene::renameSelected() const
+void DkThumbScene::renameSelected()
 {
     QStringList fileList = getSelectedFiles();
 
@@ -1506,46 +1944,128 @@ void DkThumbScene::renameSelected() const
     QString newFileName = QInputDialog::getText(DkUtils::getMainWindow(), tr("Rename File(s)"), tr("New Filename:"), QLineEdit::Normal, "", &ok);
 
     if (ok && !newFileName.isEmpty()) {
+        QStringList newFileList;
+
         for (int idx = 0; idx < fileList.size(); idx++) {
             QFileInfo fileInfo = QFileInfo(fileList.at(idx));
-            QFile file(fileInfo.absoluteFilePath());
             QString pattern = (fileList.size() == 1) ? newFileName + ".<old>" : newFileName + "<d:3>.<old>"; // no index if just 1 file was added
             DkFileNameConverter converter(fileInfo.fileName(), pattern, idx);
-            QFileInfo newFileInfo(fileInfo.dir(), converter.getConvertedFileName());
-            if (!file.rename(newFileInfo.absoluteFilePath())) {
-                int answer = QMessageBox::critical(DkUtils::getMainWindow(),
-                                                   tr("Error"),
-                                                   tr("Sorry, I cannot rename: %1 to %2").arg(fileInfo.fileName(), newFileInfo.fileName()),
-                                                   QMessageBox::Ok | QMessageBox::Cancel);
-
-                if (answer == QMessageBox::Cancel) {
-                    break;
-                }
-            }
+            newFileList << QFileInfo(fileInfo.dir(), converter.getConvertedFileName()).absoluteFilePath();
         }
+
+        startFileOperations(new DkFileOperations(DkFileOperations::op_rename, fileList, newFileList));
+    }
+}
+
+/**
+ * Runs file operations in the background.
+ * The loader's folder is not re-indexed while the files are processed.
+ * Instead, all changes are applied at once when the operations are finished.
+ * @param ops the operations (this takes ownership)
+ * @return bool false if other operations are still running
+ **/
+bool DkThumbScene::startFileOperations(DkFileOperations *ops)
+{
+    if (mFileOps) {
+        delete ops;
+        emit statusInfoSignal(tr("Please wait until the files are processed..."));
+        return false;
     }
+
+    mFileOps = ops;
+
+    if (mLoader)
+        mLoader->blockDirectoryUpdates(true);
+
+    // the dialog shows up if the operations take longer than a few seconds
+    mFileOpsDialog = new QProgressDialog(tr("Processing %1 file(s)...").arg(ops->size()), tr("Cancel"), 0, ops->size(), DkUtils::getMainWindow());
+    mFileOpsDialog->setWindowTitle(tr("Files"));
+    mFileOpsDialog->setMinimumDuration(2000);
+    mFileOpsDialog->setAutoClose(false);
+    mFileOpsDialog->setAutoReset(false);
+
+    connect(ops, &DkFileOperations::progress, mFileOpsDialog, &QProgressDialog::setValue);
+    connect(mFileOpsDialog, SIGNAL(canceled()), ops, SLOT(cancel()));
+    connect(ops, SIGNAL(finished()), this, SLOT(fileOperationsFinished()));
+
+    ops->start();
+
+    return true;
+}
+
+void DkThumbScene::fileOperationsFinished()
+{
+    DkFileOperations *ops = qobject_cast<DkFileOperations *>(sender());
+
+    if (mFileOpsDialog) {
+        mFileOpsDialog->close();
+        mFileOpsDialog->deleteLater();
+        mFileOpsDialog = 0;
+    }
+
+    if (!ops)
+        return;
+
+    // one update instead of a folder update per file
+    if (mLoader) {
+        mLoader->applyFileChanges(ops->removedFiles(), ops->addedFiles());
+        mLoader->blockDirectoryUpdates(false);
+    }
+
+    QStringList errors = ops->errors();
+
+    if (!errors.empty()) {
+        QString msg;
+
+        switch (ops->operation()) {
+        case DkFileOperations::op_move:
+            msg = tr("Sorry, I cannot move:");
+            break;
+        case DkFileOperations::op_link:
+            msg = tr("Sorry, I cannot create links of:");
+            break;
+        case DkFileOperations::op_rename:
+            msg = tr("Sorry, I cannot rename:");
+            break;
+        case DkFileOperations::op_trash:
+            msg = tr("Sorry, I cannot delete:");
+            break;
+        default:
+            msg = tr("Sorry, I cannot copy:");
+            break;
+        }
+
+        int numShown = qMin(errors.size(), 10);
+        msg += "\n" + QStringList(errors.mid(0, numShown)).join("\n");
+
+        if (errors.size() > numShown)
+            msg += "\n" + tr("and %1 more").arg(errors.size() - numShown);
+
+        QMessageBox::critical(DkUtils::getMainWindow(), tr("Error"), msg);
+    }
+
+    mFileOps = 0;
 }
 
 QStringList DkThumbScene::getSelectedFiles() const
 {
     QStringList fileList;
 
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (mThumbLabels.at(idx) && mThumbLabels.at(idx)->isSelected()) {
-            fileList.append(mThumbLabels.at(idx)->getThumb()->getFilePath());
-        }
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (mSelected.testBit(idx))
+            fileList.append(mThumbs.at(idx)->filePath());
     }
 
     return fileList;
 }
 
-QVector<DkThumbLabel *> DkThumbScene::getSelectedThumbs() const
+QVector<QSharedPointer<DkThumbNailT>> DkThumbScene::getSelectedThumbs() const
 {
-    QVector<DkThumbLabel *> selected;
+    QVector<QSharedPointer<DkThumbNailT>> selected;
 
-    for (DkThumbLabel *label : mThumbLabels) {
-        if (label->isSelected())
-            selected << label;
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (mSelected.testBit(idx))
+            selected << mThumbs.at(idx)->getThumb();
     }
 
     return selected;
@@ -1553,22 +2073,13 @@ QVector<DkThumbLabel *> DkThumbScene::getSelectedThumbs() const
 
 int DkThumbScene::findThumb(DkThumbLabel *thumb) const
 {
-    int thumbIdx = -1;
-
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (thumb == mThumbLabels.at(idx)) {
-            thumbIdx = idx;
-            break;
-        }
-    }
-
-    return thumbIdx;
+    return thumb ? thumb->index() : -1;
 }
 
 bool DkThumbScene::allThumbsSelected() const
 {
-    for (DkThumbLabel *label : mThumbLabels)
-        if (label->flags() & QGraphicsItem::ItemIsSelectable && !label->isSelected())
+    for (int idx = 0; idx < mSelected.size(); idx++)
+        if (!mSelected.testBit(idx) && mThumbs.at(idx)->getThumb()->hasImage() != DkThumbNail::exists_not)
             return false;
 
     return true;
@@ -1581,6 +2092,7 @@ DkThumbsView::DkThumbsView(DkThumbScene *scene, QWidget *parent /* = 0 */)
     setObjectName("DkThumbsView");
     this->scene = scene;
     connect(scene, SIGNAL(thumbLoadedSignal()), this, SLOT(fetchThumbs()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(scheduleThumbs(int)));
 
     setResizeAnchor(QGraphicsView::AnchorUnderMouse);
     setAcceptDrops(true);
@@ -1609,13 +2121,13 @@ void DkThumbsView::mousePressEvent(QMouseEvent *event)
 
     qDebug() << "mouse pressed";
 
-    DkThumbLabel *itemClicked = static_cast<DkThumbLabel *>(scene->itemAt(mapToScene(event->pos()), QTransform()));
+    int idxClicked = scene->indexAt(mapToScene(event->pos()));
 
     // this is a bit of a hack
     // what we want to achieve: if the user is selecting with e.g. shift or ctrl
     // and he clicks (unintentionally) into the background - the selection would be lost
     // otherwise so we just don't propagate this event
-    if (itemClicked || event->modifiers() == Qt::NoModifier)
+    if (idxClicked != -1 || event->modifiers() == Qt::NoModifier)
         QGraphicsView::mousePressEvent(event);
 }
 
@@ -1637,11 +2149,11 @@ void DkThumbsView::mouseMoveEvent(QMouseEvent *event)
                 mimeData->setUrls(urls);
 
                 // create thumb image
-                QVector<DkThumbLabel *> tl = scene->getSelectedThumbs();
+                QVector<QSharedPointer<DkThumbNailT>> tl = scene->getSelectedThumbs();
                 QVector<QImage> imgs;
 
                 for (int idx = 0; idx < tl.size() && idx < 3; idx++) {
-                    imgs << tl[idx]->getThumb()->getImage();
+                    imgs << tl[idx]->getImage();
                 }
 
                 QPixmap pm = DkImage::merge(imgs).scaledToHeight(73); // 73: see https://www.youtube.com/watch?v=TIYMmbHik08
@@ -1662,12 +2174,12 @@ void DkThumbsView::mouseReleaseEvent(QMouseEvent *event)
 {
     QGraphicsView::mouseReleaseEvent(event);
 
-    DkThumbLabel *itemClicked = static_cast<DkThumbLabel *>(scene->itemAt(mapToScene(event->pos()), QTransform()));
+    int idxClicked = scene->indexAt(mapToScene(event->pos()));
 
-    if (lastShiftIdx != -1 && event->modifiers() & Qt::ShiftModifier && itemClicked != 0) {
-        scene->selectThumbs(true, lastShiftIdx, scene->findThumb(itemClicked));
-    } else if (itemClicked != 0) {
-        lastShiftIdx = scene->findThumb(itemClicked);
+    if (lastShiftIdx != -1 && event->modifiers() & Qt::ShiftModifier && idxClicked != -1) {
+        scene->selectThumbs(true, lastShiftIdx, idxClicked);
+    } else if (idxClicked != -1) {
+        lastShiftIdx = idxClicked;
     } else
         lastShiftIdx = -1;
 }
@@ -1750,12 +2262,22 @@ void DkThumbsView::fetchThumbs()
             continue;
         }
 
-        if (th->pixmap().isNull()) {
+        if (th->isVisible() && th->pixmap().isNull()) {
             th->update();
         }
     }
 }
 
+void DkThumbsView::scheduleThumbs(int scrollValue)
+{
+    int direction = scrollValue - mLastScrollValue;
+    mLastScrollValue = scrollValue;
+
+    QRectF vr = mapToScene(viewport()->rect()).boundingRect();
+    scene->updateVisibleLabels(vr);
+    scene->scheduleThumbs(vr, direction);
+}
+
 // DkThumbScrollWidget --------------------------------------------------------------------
 DkThumbScrollWidget::DkThumbScrollWidget(QWidget *parent /* = 0 */, Qt::WindowFlags flags /* = 0 */)
     : DkFadeWidget(parent, flags)
@@ -1884,15 +2406,12 @@ void DkThumbScrollWidget::batchPrint() const
 
 void DkThumbScrollWidget::on_loadFile_triggered()
 {
-    auto selected = mThumbsScene->selectedItems();
+    auto selected = mThumbsScene->getSelectedFiles();
 
     if (selected.isEmpty())
         return;
 
-    auto thumb = dynamic_cast<DkThumbLabel *>(selected.first());
-
-    if (thumb && thumb->getThumb())
-        mThumbsScene->loadFileSignal(thumb->getThumb()->getFilePath(), false);
+    mThumbsScene->loadFileSignal(selected.first(), false);
 }
 
 void DkThumbScrollWidget::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
@@ -1943,6 +2462,8 @@ void DkThumbScrollWidget::connectToActions(bool activate)
         connect(am.action(DkActionManager::preview_rename), SIGNAL(triggered()), mThumbsScene, SLOT(renameSelected()));
         connect(am.action(DkActionManager::preview_batch), SIGNAL(triggered()), this, SLOT(batchProcessFiles()));
         connect(am.action(DkActionManager::preview_print), SIGNAL(triggered()), this, SLOT(batchPrint()));
+        connect(am.action(DkActionManager::preview_select_similar), SIGNAL(triggered()), mThumbsScene, SLOT(selectSimilar()));
+        connect(am.action(DkActionManager::preview_select_duplicates), SIGNAL(triggered()), mThumbsScene, SLOT(selectDuplicates()));
 
         connect(mFilterEdit, SIGNAL(textChanged(const QString &)), this, SIGNAL(filterChangedSignal(const QString &)));
         connect(mView, SIGNAL(updateDirSignal(const QString &)), this, SIGNAL(updateDirSignal(const QString &)));
@@ -1960,6 +2481,8 @@ void DkThumbScrollWidget::connectToActions(bool activate)
         disconnect(am.action(DkActionManager::preview_rename), SIGNAL(triggered()), mThumbsScene, SLOT(renameSelected()));
         disconnect(am.action(DkActionManager::preview_batch), SIGNAL(triggered()), this, SLOT(batchProcessFiles()));
         disconnect(am.action(DkActionManager::preview_print), SIGNAL(triggered()), this, SLOT(batchPrint()));
+        disconnect(am.action(DkActionManager::preview_select_similar), SIGNAL(triggered()), mThumbsScene, SLOT(selectSimilar()));
+        disconnect(am.action(DkActionManager::preview_select_duplicates), SIGNAL(triggered()), mThumbsScene, SLOT(selectDuplicates()));
 
         disconnect(mFilterEdit, SIGNAL(textChanged(const QString &)), this, SIGNAL(filterChangedSignal(const QString &)));
         disconnect(mView, SIGNAL(updateDirSignal(const QString &)), this, SIGNAL(updateDirSignal(const QString &)));
@@ -1997,6 +2520,7 @@ void DkThumbScrollWidget::enableSelectionActions()
     am.action(DkActionManager::preview_rename)->setEnabled(enable);
     am.action(DkActionManager::preview_delete)->setEnabled(enable);
     am.action(DkActionManager::preview_batch)->setEnabled(enable);
+    am.action(DkActionManager::preview_select_similar)->setEnabled(enable);
 
     am.action(DkActionManager::preview_select_all)->setChecked(mThumbsScene->allThumbsSelected());
 }
@@ -2008,38 +2532,94 @@ DkThumbPreviewLabel::DkThumbPreviewLabel(const QString &filePath, int thumbSize,
     mThumbSize = thumbSize;
 
     mThumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(filePath));
+    mThumb->setMaxThumbSize(DkThumbNail::mipLevel(cacheSize()));
     connect(mThumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(thumbLoaded()));
 
     setFixedSize(mThumbSize, mThumbSize);
     setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
     setStatusTip(filePath);
+    setToolTip(QFileInfo(filePath).fileName());
 
-    QFileInfo fInfo(filePath);
-    setToolTip(fInfo.fileName());
+    // draw the last known thumbnail - the file is checked later (it might be on a disconnected share)
+    if (DkThumbCache::instance().isEnabled())
+        setPreview(DkThumbCache::instance().findLastKnown(filePath, cacheSize()));
+}
 
+/**
+ * Fetches the thumbnail of the file in the background.
+ **/
+void DkThumbPreviewLabel::refresh()
+{
     mThumb->fetchThumb(DkThumbNail::force_exif_thumb);
 }
 
+/**
+ * Marks the thumbnail as empty if the file does not exist.
+ * The last known thumbnail is kept (the share might be offline).
+ **/
+void DkThumbPreviewLabel::setMissing()
+{
+    if (!pixmap() || pixmap()->isNull())
+        setEmpty();
+}
+
 void DkThumbPreviewLabel::thumbLoaded()
 {
     if (mThumb->getImage().isNull()) {
-        setProperty("empty", true); // apply empty style
-        style()->unpolish(this);
-        style()->polish(this);
-        update();
-
+        setMissing();
         return;
     }
 
-    QPixmap pm = QPixmap::fromImage(mThumb->getImage());
+    setPreview(mThumb->getImage());
+
+    if (!DkThumbCache::instance().isEnabled())
+        return;
+
+    QString filePath = mThumb->getFilePath();
+    QImage img = pixmap()->toImage();
+    int size = cacheSize();
+
+    DkScheduler::instance().run(DkScheduler::lane_io, DkScheduler::priority_thumbnail, [filePath, size, img]() {
+        DkThumbCache::instance().insertLastKnown(filePath, size, img);
+    });
+}
+
+void DkThumbPreviewLabel::setPreview(const QImage &img)
+{
+    if (img.isNull())
+        return;
+
+    QPixmap pm = QPixmap::fromImage(img);
     pm = DkImage::makeSquare(pm);
 
     if (pm.width() > width())
         pm = pm.scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
 
+    if (property("empty").toBool()) {
+        setProperty("empty", false);
+        style()->unpolish(this);
+        style()->polish(this);
+    }
+
     setPixmap(pm);
 }
 
+void DkThumbPreviewLabel::setEmpty()
+{
+    setProperty("empty", true); // apply empty style
+    style()->unpolish(this);
+    style()->polish(this);
+    update();
+}
+
+/**
+ * Returns the size of the last known thumbnails.
+ **/
+int DkThumbPreviewLabel::cacheSize() const
+{
+    return qRound(mThumbSize * DkSettingsManager::param().dpiScaleFactor());
+}
+
 void DkThumbPreviewLabel::mousePressEvent(QMouseEvent *ev)
 {
     emit loadFileSignal(mThumb->getFilePath(), ev->modifiers() == Qt::ControlModifier);
@@ -2056,6 +2636,53 @@ DkRecentDirWidget::DkRecentDirWidget(const DkRecentDir &rde, QWidget *parent)
 
     createLayout();
     QMetaObject::connectSlotsByName(this);
+
+    connect(&mExistsWatcher, SIGNAL(finished()), this, SLOT(existsChecked()));
+}
+
+DkRecentDirWidget::~DkRecentDirWidget()
+{
+    // probes that did not start yet are dropped
+    mToken.cancel();
+}
+
+/**
+ * Checks if the directory exists and refreshes its thumbnails.
+ * The check runs in the probe lane - it can hang until the OS times out if a share
+ * is disconnected. Thumbnails are only fetched once it succeeded.
+ * Only the first call has an effect.
+ **/
+void DkRecentDirWidget::refresh()
+{
+    if (mRefreshed || mThumbs.isEmpty())
+        return;
+
+    mRefreshed = true;
+
+    QFileInfo fInfo(mRecentDir.firstFilePath());
+
+    mExistsWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_probe, DkScheduler::priority_thumbnail, [fInfo]() {
+        return DkUtils::checkFile(fInfo);
+    }, mToken));
+}
+
+void DkRecentDirWidget::existsChecked()
+{
+    if (mExistsWatcher.isCanceled())
+        return;
+
+    // this should fix issues with disconnected samba drives on windows
+    if (!mExistsWatcher.result()) {
+        qInfo() << mRecentDir.firstFilePath() << "does not exist";
+
+        for (auto tpl : mThumbs)
+            tpl->setMissing();
+
+        return;
+    }
+
+    for (auto tpl : mThumbs)
+        tpl->refresh();
 }
 
 void DkRecentDirWidget::createLayout()
@@ -2091,18 +2718,11 @@ void DkRecentDirWidget::createLayout()
     mButtons[button_remove]->setFlat(true);
     mButtons[button_remove]->hide();
 
-    QVector<DkThumbPreviewLabel *> tls;
-
-    // check if the folder exists (in the current context)
-    // this should fix issues with disconnected samba drives on windows
-    if (DkUtils::exists(QFileInfo(mRecentDir.firstFilePath()), 30)) {
-        for (auto tp : mRecentDir.filePaths(4)) {
-            auto tpl = new DkThumbPreviewLabel(tp, 42, this);
-            connect(tpl, SIGNAL(loadFileSignal(const QString &, bool)), this, SIGNAL(loadFileSignal(const QString &, bool)));
-            tls << tpl;
-        }
-    } else {
-        qInfo() << mRecentDir.firstFilePath() << "does not exist - according to a fast check";
+    // the folder is not accessed here (see refresh())
+    for (auto tp : mRecentDir.filePaths(4)) {
+        auto tpl = new DkThumbPreviewLabel(tp, 42, this);
+        connect(tpl, SIGNAL(loadFileSignal(const QString &, bool)), this, SIGNAL(loadFileSignal(const QString &, bool)));
+        mThumbs << tpl;
     }
 
     QLabel *pathLabel = new QLabel(mRecentDir.dirPath(), this);
@@ -2111,15 +2731,15 @@ void DkRecentDirWidget::createLayout()
 
     QGridLayout *layout = new QGridLayout(this);
     layout->setAlignment(Qt::AlignLeft);
-    layout->addWidget(dirNameLabel, 1, 0, 1, tls.size() + 1);
-    layout->setColumnStretch(tls.size() + 2, 1);
-    layout->addWidget(mButtons[button_load_dir], 1, tls.size() + 3);
-    layout->addWidget(mButtons[button_pin], 1, tls.size() + 4);
-    layout->addWidget(mButtons[button_remove], 1, tls.size() + 5);
-    layout->addWidget(pathLabel, 2, tls.size(), 1, 6);
+    layout->addWidget(dirNameLabel, 1, 0, 1, mThumbs.size() + 1);
+    layout->setColumnStretch(mThumbs.size() + 2, 1);
+    layout->addWidget(mButtons[button_load_dir], 1, mThumbs.size() + 3);
+    layout->addWidget(mButtons[button_pin], 1, mThumbs.size() + 4);
+    layout->addWidget(mButtons[button_remove], 1, mThumbs.size() + 5);
+    layout->addWidget(pathLabel, 2, mThumbs.size(), 1, 6);
 
-    for (int idx = 0; idx < tls.size(); idx++)
-        layout->addWidget(tls[idx], 2, idx, Qt::AlignTop);
+    for (int idx = 0; idx < mThumbs.size(); idx++)
+        layout->addWidget(mThumbs[idx], 2, idx, Qt::AlignTop);
 
     show();
     setCursor(Qt::PointingHandCursor);
@@ -2131,10 +2751,10 @@ void DkRecentDirWidget::createLayout()
 void DkRecentDirWidget::on_pin_clicked(bool checked)
 {
     if (checked) {
-        DkSettingsManager::param().global().pinnedFiles << mRecentDir.filePaths();
+        DkSettingsManager::edit().global().pinnedFiles << mRecentDir.filePaths();
     } else {
         for (const QString &fp : mRecentDir.filePaths())
-            DkSettingsManager::param().global().pinnedFiles.removeAll(fp);
+            DkSettingsManager::edit().global().pinnedFiles.removeAll(fp);
     }
 }
 
@@ -2199,9 +2819,32 @@ void DkRecentFilesWidget::createLayout()
 
     mScrollArea->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
 
+    connect(mScrollArea->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(refreshVisible()));
+
     // updateList();
 }
 
+void DkRecentFilesWidget::resizeEvent(QResizeEvent *event)
+{
+    DkFadeWidget::resizeEvent(event);
+    refreshVisible();
+}
+
+/**
+ * Refreshes the directories that are visible.
+ * Directories that are scrolled in later are refreshed then.
+ **/
+void DkRecentFilesWidget::refreshVisible()
+{
+    if (!isVisible())
+        return;
+
+    for (auto rf : mEntries) {
+        if (!rf->visibleRegion().isEmpty())
+            rf->refresh();
+    }
+}
+
 void DkRecentFilesWidget::updateList()
 {
     DkTimer dt;
@@ -2211,8 +2854,7 @@ void DkRecentFilesWidget::updateList()
     QWidget *dummy = new QWidget(this);
     QVBoxLayout *l = new QVBoxLayout(dummy);
 
-    QVector<DkRecentDirWidget *> recentFiles;
-    int idx = 0;
+    mEntries.clear();
 
     for (auto rd : fm.recentDirs()) {
         DkRecentDirWidget *rf = new DkRecentDirWidget(rd, dummy);
@@ -2221,14 +2863,16 @@ void DkRecentFilesWidget::updateList()
         connect(rf, SIGNAL(loadDirSignal(const QString &)), this, SIGNAL(loadDirSignal(const QString &)));
         connect(rf, SIGNAL(removeSignal()), this, SLOT(entryRemoved()));
 
-        recentFiles << rf;
+        mEntries << rf;
         l->addWidget(rf);
-        idx++;
     }
 
     qInfo() << "list updated in" << dt;
 
     mScrollArea->setWidget(dummy);
+
+    // the layout is done when we get back to the event loop
+    QTimer::singleShot(0, this, SLOT(refreshVisible()));
 }
 
 void DkRecentFilesWidget::entryRemoved()
@@ -2303,8 +2947,8 @@ QString DkRecentDir::firstFilePath() const
 
 void DkRecentDir::remove() const
 {
-    QStringList &pf = DkSettingsManager::param().global().pinnedFiles;
-    QStringList &rf = DkSettingsManager::param().global().recentFiles;
+    QStringList &pf = DkSettingsManager::edit().global().pinnedFiles;
+    QStringList &rf = DkSettingsManager::edit().global().recentFiles;
 
     // remove from history
     for (const QString &fp : mFilePaths) {
@@ -28,18 +28,24 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QBitArray>
 #include <QDrag>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QGraphicsObject>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QHash>
 #include <QPen>
+#include <QPointer>
 #include <QProcess>
 #include <QSharedPointer>
 #pragma warning(pop) // no warnings from includes - end
 
 #include "DkBaseWidgets.h"
+#include "DkFileOperations.h"
 #include "DkImageContainer.h"
+#include "DkScheduler.h"
 
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
@@ -55,6 +61,7 @@
 class QMenu;
 class QToolBar;
 class QLineEdit;
+class QProgressDialog;
 
 namespace nmc
 {
@@ -115,6 +122,7 @@ public slots:
     void updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs);
     void setFileInfo(QSharedPointer<DkImageContainerT> cImage);
     void newPosition();
+    void invalidateLayout();
 
 signals:
     void loadFileSignal(const QString &filePath) const;
@@ -144,7 +152,11 @@ private:
     QTimer *moveImageTimer;
 
     QRectF bufferDim;
-    QVector<QRectF> thumbRects;
+    QVector<QRectF> thumbRects; // layout of all thumbs (null if the file does not exist)
+    QVector<qreal> thumbEnds; // end of each thumb along the strip (sorted)
+    bool mLayoutDirty = true;
+    QSize mLayoutSize;
+    int mLayoutThumbSize = 0;
 
     QLinearGradient leftGradient;
     QLinearGradient rightGradient;
@@ -177,6 +189,8 @@ private:
 
     void init();
     void initOrientations();
+    void updateLayout();
+    int thumbAt(const QPoint &pos) const;
     void drawThumbs(QPainter *painter);
     void drawFadeOut(QLinearGradient gradient, QRectF imgRect, QImage *img);
     void drawSelectedEffect(QPainter *painter, const QRectF &r);
@@ -205,6 +219,11 @@ public:
     QPixmap pixmap() const;
     void cancelLoading();
 
+    void setIndex(int idx);
+    int index() const;
+    void setThumbSelected(bool selected);
+    bool isThumbSelected() const;
+
 public slots:
     void updateLabel();
 
@@ -222,15 +241,24 @@ protected:
     QGraphicsPixmapItem mIcon;
     QGraphicsTextItem mText;
     bool mThumbInitialized = false;
+    bool mTextInitialized = false;
     bool mFetchingThumb = false;
     QPen mNoImagePen;
     QBrush mNoImageBrush;
     QPen mSelectPen;
     QBrush mSelectBrush;
     bool mIsHovered = false;
+    bool mSelected = false;
+    int mIdx = -1; // index of the thumbnail in the scene
     QPointF mLastMove;
 };
 
+/**
+ * A virtualized thumbnail grid.
+ * Labels are only created for the visible rows (+ a margin) and recycled while scrolling.
+ * The layout is computed from the number of columns and the selection is kept
+ * in a bitset - so the scene scales to directories with 100k images.
+ **/
 class DllCoreExport DkThumbScene : public QGraphicsScene
 {
     Q_OBJECT
@@ -240,15 +268,19 @@ public:
 
     void updateLayout();
     QStringList getSelectedFiles() const;
-    QVector<DkThumbLabel *> getSelectedThumbs() const;
+    QVector<QSharedPointer<DkThumbNailT>> getSelectedThumbs() const;
     int selectedThumbIndex(bool first = true);
 
     void setImageLoader(QSharedPointer<DkImageLoader> loader);
-    void copyImages(const QMimeData *mimeData, const Qt::DropAction &da = Qt::CopyAction) const;
+    void copyImages(const QMimeData *mimeData, const Qt::DropAction &da = Qt::CopyAction);
     int findThumb(DkThumbLabel *thumb) const;
     bool allThumbsSelected() const;
     void ensureVisible(QSharedPointer<DkImageContainerT> img) const;
     QString currentDir() const;
+    void scheduleThumbs(const QRectF &visibleRect, int direction = 0);
+    void updateVisibleLabels(const QRectF &visibleRect);
+    int indexAt(const QPointF &scenePos) const;
+    QRectF thumbRect(int idx) const;
 
 public slots:
     void updateThumbLabels();
@@ -263,28 +295,65 @@ public slots:
     void selectThumb(int idx, bool select = true);
     void selectAllThumbs(bool select = true);
     void updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs);
-    void deleteSelected() const;
+    void deleteSelected();
     void copySelected() const;
-    void pasteImages() const;
-    void renameSelected() const;
+    void pasteImages();
+    void renameSelected();
+    void selectSimilar();
+    void selectDuplicates();
 
 signals:
     void loadFileSignal(const QString &filePath, bool newTab) const;
     void statusInfoSignal(const QString &msg, int pos = 0) const;
     void thumbLoadedSignal() const;
 
+protected slots:
+    void thumbsIndexed();
+    void fileOperationsFinished();
+
 protected:
+    enum HashSelection {
+        select_none = -1,
+        select_similar,
+        select_duplicates,
+    };
+
     void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
+    void indexThumbs(HashSelection selection);
+    void selectFromIndex(HashSelection selection);
     void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
+    void cancelScheduledRows(int first = 0, int last = -1);
+    void fetchThumb(int idx, int priority);
+    void cancelThumb(int idx);
+    int thumbLevel() const;
+    void releaseLabels();
+    QRectF visibleRect() const;
+    bool startFileOperations(DkFileOperations *ops);
 
     int mXOffset = 0;
     int mNumRows = 0;
     int mNumCols = 0;
     bool mFirstLayout = true;
 
-    QVector<DkThumbLabel *> mThumbLabels;
+    // rows whose thumbnails were requested by scheduleThumbs
+    int mFirstScheduledRow = -1;
+    int mLastScheduledRow = -1;
+
+    QHash<int, DkThumbLabel *> mLabels; // materialized labels (thumb index -> label)
+    QVector<DkThumbLabel *> mFreeLabels; // labels that can be recycled
+    QBitArray mSelected;
     QSharedPointer<DkImageLoader> mLoader;
     QVector<QSharedPointer<DkImageContainerT>> mThumbs;
+
+    // perceptual hashes of thumbnails that were not loaded yet
+    QFutureWatcher<int> mIndexWatcher;
+    DkCancelToken mIndexToken;
+    HashSelection mPendingSelection = select_none;
+
+    // background copy/move/rename/delete
+    QPointer<DkFileOperations> mFileOps;
+    QProgressDialog *mFileOpsDialog = 0;
 };
 
 class DkThumbsView : public QGraphicsView
@@ -299,6 +368,7 @@ signals:
 
 public slots:
     void fetchThumbs();
+    void scheduleThumbs(int scrollValue);
 
 protected:
     void wheelEvent(QWheelEvent *event) override;
@@ -312,6 +382,7 @@ protected:
     DkThumbScene *scene;
     QPointF mousePos;
     int lastShiftIdx;
+    int mLastScrollValue = 0;
 };
 
 class DllCoreExport DkThumbScrollWidget : public DkFadeWidget
@@ -394,6 +465,11 @@ private:
     QList<DkRecentDir> mDirs;
 };
 
+/**
+ * A thumbnail of the recent files view.
+ * It shows the last known thumbnail of the file (see DkThumbCache) -
+ * the file itself is not accessed until refresh() is called.
+ **/
 class DkThumbPreviewLabel : public QLabel
 {
     Q_OBJECT
@@ -401,6 +477,9 @@ class DkThumbPreviewLabel : public QLabel
 public:
     DkThumbPreviewLabel(const QString &filePath, int thumbSize = 100, QWidget *parent = 0, Qt::WindowFlags f = Qt::WindowFlags());
 
+    void refresh();
+    void setMissing();
+
 signals:
     void loadFileSignal(const QString &filePath, bool newTab);
 
@@ -409,17 +488,28 @@ public slots:
 
 protected:
     void mousePressEvent(QMouseEvent *ev) override;
+    void setPreview(const QImage &img);
+    void setEmpty();
+    int cacheSize() const;
 
     QSharedPointer<DkThumbNailT> mThumb;
     int mThumbSize = 100;
 };
 
+/**
+ * A directory of the recent files view.
+ * The directory is not accessed when the widget is created. refresh()
+ * checks if it exists in the background and updates the thumbnails.
+ **/
 class DllCoreExport DkRecentDirWidget : public DkFadeWidget
 {
     Q_OBJECT
 
 public:
     DkRecentDirWidget(const DkRecentDir &rde, QWidget *parent = 0);
+    ~DkRecentDirWidget();
+
+    void refresh();
 
 signals:
     void loadFileSignal(const QString &filePath, bool newTab);
@@ -431,9 +521,16 @@ public slots:
     void on_remove_clicked();
     void on_load_dir_clicked();
 
+protected slots:
+    void existsChecked();
+
 protected:
     DkRecentDir mRecentDir;
-    QVector<DkThumbLabel> mThumbs;
+    QVector<DkThumbPreviewLabel *> mThumbs;
+
+    QFutureWatcher<bool> mExistsWatcher;
+    DkCancelToken mToken;
+    bool mRefreshed = false;
 
     enum {
         button_load_dir = 0,
@@ -465,12 +562,15 @@ signals:
 public slots:
     void entryRemoved();
     void setVisible(bool visible) override;
+    void refreshVisible();
 
 protected:
     void createLayout();
     void updateList();
+    void resizeEvent(QResizeEvent *event) override;
 
     QScrollArea *mScrollArea;
+    QVector<DkRecentDirWidget *> mEntries;
 };
 
 }
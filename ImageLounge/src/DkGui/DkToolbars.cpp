@@ -1293,7 +1293,7 @@ void DkToolBarManager::showDefaultToolBar(bool show, bool permanent)
         return;
 
     if (permanent)
-        DkSettingsManager::param().app().showToolBar = show;
+        DkSettingsManager::edit().app().showToolBar = show;
     DkActionManager::instance().action(DkActionManager::menu_panel_toolbar)->setChecked(DkSettingsManager::param().app().showToolBar);
 
     mToolBar->setVisible(show);
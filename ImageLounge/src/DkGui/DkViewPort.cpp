@@ -35,11 +35,14 @@
 #include "DkMessageBox.h"
 #include "DkMetaData.h"
 #include "DkMetaDataWidgets.h"
+#include "DkMovie.h"
 #include "DkNetwork.h"
 #include "DkPluginManager.h"
+#include "DkScheduler.h"
 #include "DkSettings.h"
 #include "DkStatusBar.h"
 #include "DkThumbsWidgets.h" // needed in the connects -> shall we move them to mController?
+#include "DkTimer.h"
 #include "DkToolbars.h"
 #include "DkUtils.h"
 #include "DkWidgets.h"
@@ -51,11 +54,14 @@
 #include <QDesktopWidget>
 #include <QDrag>
 #include <QDragLeaveEvent>
+#include <QFile>
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
-#include <QMovie>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLWidget>
 #include <QSvgRenderer>
 #include <QVBoxLayout>
 #include <QtConcurrentRun>
@@ -71,6 +77,34 @@
 
 namespace nmc
 {
+/**
+ * True if an OpenGL context can be created and made current.
+ * This fails e.g. for remote desktops, broken drivers or VMs - a
+ * QOpenGLWidget would stay black then. The result is computed once.
+ **/
+static bool openGLAvailable()
+{
+    static int available = -1;
+
+    if (available == -1) {
+        QOpenGLContext ctx;
+        ctx.setShareContext(QOpenGLContext::globalShareContext());
+
+        QOffscreenSurface surface;
+        surface.setFormat(ctx.format());
+        surface.create();
+
+        available = ctx.create() && surface.isValid() && ctx.makeCurrent(&surface) ? 1 : 0;
+
+        if (available)
+            ctx.doneCurrent();
+        else
+            qWarning() << "[DkViewPort] OpenGL is not available - falling back to the raster viewport";
+    }
+
+    return available == 1;
+}
+
 // DkViewPort --------------------------------------------------------------------
 DkViewPort::DkViewPort(QWidget *parent)
     : DkBaseViewPort(parent)
@@ -91,6 +125,25 @@ DkViewPort::DkViewPort(QWidget *parent)
     mAnimationTimer->setInterval(5);
     connect(mAnimationTimer, SIGNAL(timeout()), this, SLOT(animateFade()));
 
+    // full resolution manipulations start once the parameters settle
+    mManipulatorTimer = new QTimer(this);
+    mManipulatorTimer->setSingleShot(true);
+    mManipulatorTimer->setInterval(500);
+    connect(mManipulatorTimer, SIGNAL(timeout()), this, SLOT(applyActiveManipulator()));
+
+    // navigation stopped if no file was loaded within the interval
+    mScrubTimer = new QTimer(this);
+    mScrubTimer->setSingleShot(true);
+    mScrubTimer->setInterval(200);
+    connect(mScrubTimer, SIGNAL(timeout()), this, SLOT(scrubFinished()));
+
+    // render on the GPU: QPainter's OpenGL engine caches images & tiles as textures
+    // and transforms (zoom, pan, rotation) and fading are done when drawing them
+    if (DkSettingsManager::param().display().useOpenGL && openGLAvailable()) {
+        setViewport(new QOpenGLWidget(this));
+        setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+    }
+
     // no border
     setMouseTracking(true); // receive mouse event everytime
 
@@ -198,6 +251,9 @@ DkViewPort::DkViewPort(QWidget *parent)
         connect(action, SIGNAL(triggered()), this, SLOT(applyManipulator()));
 
     connect(&mManipulatorWatcher, SIGNAL(finished()), this, SLOT(manipulatorApplied()));
+    connect(&mPreviewWatcher, SIGNAL(finished()), this, SLOT(manipulatorPreviewed()));
+    connect(&mRegionWatcher, SIGNAL(finished()), this, SLOT(regionLoaded()));
+    connect(&mNextSlideWatcher, SIGNAL(finished()), this, SLOT(nextSlidePrepared()));
 
     // TODO:
     // one could blur the canvas if a transparent GUI is present
@@ -214,6 +270,11 @@ DkViewPort::~DkViewPort()
 
     mManipulatorWatcher.cancel();
     mManipulatorWatcher.blockSignals(true);
+    mPreviewWatcher.cancel();
+    mPreviewWatcher.blockSignals(true);
+    mRegionToken.cancel();
+    mRegionWatcher.blockSignals(true);
+    mNextSlideWatcher.blockSignals(true);
 }
 
 void DkViewPort::createShortcuts()
@@ -320,7 +381,22 @@ void DkViewPort::setImage(QImage newImg)
 
     mController->getOverview()->setImage(QImage()); // clear overview
 
-    mImgStorage.setImage(newImg);
+    // the real image replaces the scrub thumbnail
+    mScrubImg = QImage();
+    mScrubThumb.clear();
+
+    // slideshow: the pyramid was built while the previous slide was shown
+    if (!mNextSlidePyramid.isEmpty() && mNextSlidePyramid.first().cacheKey() == newImg.cacheKey())
+        mImgStorage.setImage(newImg, mNextSlidePyramid);
+    else
+        mImgStorage.setImage(newImg);
+    mNextSlidePyramid.clear();
+
+    mRegionImg = QImage();
+    mRegionRect = QRect();
+    mRegionSource.reset();
+    mRegionToken.cancel();
+    mRegionQueued = false;
 
     if (mLoader->hasMovie() && !mLoader->isEdited())
         loadMovie();
@@ -350,6 +426,7 @@ void DkViewPort::setImage(QImage newImg)
     }
 
     mController->getPlayer()->startTimer();
+    prepareNextSlide();
     mController->getOverview()->setImage(newImg); // TODO: maybe we could make use of the image pyramid here
 
     mOldImgRect = mImgRect;
@@ -372,7 +449,7 @@ void DkViewPort::setImage(QImage newImg)
 
     // draw a histogram from the image -> does nothing if the histogram is invisible
     if (mController->getHistogram())
-        mController->getHistogram()->drawHistogram(newImg);
+        mController->getHistogram()->drawHistogram(newImg, mLoader->getCurrentImage(), mImgStorage.sampleImage(DkImageHistogram::sample_pixels));
 
     emit newImageSignal(&newImg);
     emit zoomSignal(mWorldMatrix.m11() * mImgMatrix.m11() * 100);
@@ -551,7 +628,7 @@ void DkViewPort::repeatZoom()
 
 void DkViewPort::toggleResetMatrix()
 {
-    DkSettingsManager::param().display().keepZoom = !DkSettingsManager::param().display().keepZoom;
+    DkSettingsManager::edit().display().keepZoom = !DkSettingsManager::param().display().keepZoom;
 }
 
 void DkViewPort::updateImageMatrix()
@@ -842,6 +919,43 @@ void DkViewPort::applyManipulator()
     // try to cast up
     QSharedPointer<DkBaseManipulatorExt> mplExt = qSharedPointerDynamicCast<DkBaseManipulatorExt>(mpl);
 
+    // another manipulation is running or about to start
+    if ((mManipulatorWatcher.isRunning() || mManipulatorTimer->isActive()) && mActiveManipulator != mpl) {
+        mController->setInfo(tr("Busy"));
+        return;
+    }
+
+    if (mplExt) {
+        mActiveManipulator = mpl;
+
+        // large images: show a preview - the full resolution follows once the user stops changing parameters
+        if (previewManipulator(mplExt)) {
+            // the result of a running manipulation is outdated
+            if (mManipulatorWatcher.isRunning())
+                mplExt->setDirty(true);
+
+            am.action(DkActionManager::menu_edit_image)->setChecked(true);
+            mManipulatorTimer->start();
+            return;
+        }
+    }
+
+    startManipulator(mpl);
+}
+
+void DkViewPort::applyActiveManipulator()
+{
+    if (mActiveManipulator)
+        startManipulator(mActiveManipulator);
+}
+
+void DkViewPort::startManipulator(const QSharedPointer<DkBaseManipulator> &mpl)
+{
+    DkActionManager &am = DkActionManager::instance();
+
+    // try to cast up
+    QSharedPointer<DkBaseManipulatorExt> mplExt = qSharedPointerDynamicCast<DkBaseManipulatorExt>(mpl);
+
     // mark dirty
     if (mManipulatorWatcher.isRunning() && mplExt && mActiveManipulator == mpl) {
         mplExt->setDirty(true);
@@ -871,7 +985,9 @@ void DkViewPort::applyManipulator()
     } else
         img = getImage();
 
-    mManipulatorWatcher.setFuture(QtConcurrent::run(mpl.data(), &nmc::DkBaseManipulator::apply, img));
+    mManipulatorWatcher.setFuture(DkScheduler::instance().run(DkScheduler::lane_cpu, DkScheduler::priority_interactive, [mpl, img]() {
+        return mpl->apply(img);
+    }));
 
     mActiveManipulator = mpl;
 
@@ -890,6 +1006,20 @@ void DkViewPort::manipulatorApplied()
     // trigger again if it's dirty
     QSharedPointer<DkBaseManipulatorExt> mplExt = qSharedPointerDynamicCast<DkBaseManipulatorExt>(mActiveManipulator);
 
+    // the parameters changed meanwhile - the result is outdated
+    if (mplExt && mplExt->isDirty()) {
+        mplExt->setDirty(false);
+
+        // if the user is still changing parameters, the timer starts it later
+        if (!mManipulatorTimer->isActive()) {
+            startManipulator(mActiveManipulator);
+            qDebug() << "triggering manipulator - it's dirty";
+        } else
+            emit showProgress(false);
+
+        return;
+    }
+
     // set the edited image
     QImage img = mManipulatorWatcher.result();
 
@@ -898,20 +1028,120 @@ void DkViewPort::manipulatorApplied()
     else
         mController->setInfo(mActiveManipulator->errorMessage());
 
-    if (mplExt && mplExt->isDirty()) {
-        mplExt->setDirty(false);
-        mplExt->action()->trigger();
-        qDebug() << "triggering manipulator - it's dirty";
-    }
+    clearPreview();
 
     emit showProgress(false);
 }
 
+void DkViewPort::manipulatorPreviewed()
+{
+    if (mPreviewWatcher.isCanceled())
+        return;
+
+    QImage img = mPreviewWatcher.result();
+
+    // only show previews if the full resolution is still to come
+    if (!img.isNull() && (mManipulatorTimer->isActive() || mManipulatorWatcher.isRunning())) {
+        mPreviewImg = img;
+        update();
+    }
+
+    QSharedPointer<DkBaseManipulatorExt> mplExt = qSharedPointerDynamicCast<DkBaseManipulatorExt>(mActiveManipulator);
+
+    if (mPreviewPending && mplExt) {
+        mPreviewPending = false;
+        previewManipulator(mplExt);
+    }
+}
+
+/**
+ * Applies mpl to a screen-sized proxy of the image.
+ * Previews are only computed for images that are considerably
+ * larger than the viewport since the full resolution is fast otherwise.
+ * @param mpl the manipulator
+ * @return bool true if a preview is (or will be) computed
+ **/
+bool DkViewPort::previewManipulator(const QSharedPointer<DkBaseManipulatorExt> &mpl)
+{
+    QImage src = manipulatorSource(mpl);
+
+    if (src.isNull() || mSvg || mMovie)
+        return false;
+
+    QSizeF vs = QSizeF(viewport()->size()) * devicePixelRatioF();
+    double scale = qMax(vs.width() / src.width(), vs.height() / src.height());
+
+    if (scale > 0.5)
+        return false;
+
+    if (mPreviewSourceKey != src.cacheKey()) {
+        mPreviewSource = DkImage::resizeImage(src, QSize(), scale, DkImage::ipl_area, false);
+        mPreviewSourceKey = src.cacheKey();
+    }
+
+    if (mPreviewSource.isNull())
+        return false;
+
+    // apply the recent parameters once the running preview is done
+    if (mPreviewWatcher.isRunning()) {
+        mPreviewPending = true;
+        return true;
+    }
+
+    QImage proxy = mPreviewSource;
+    mPreviewScale = (double)proxy.width() / src.width();
+    double ps = mPreviewScale;
+
+    mPreviewWatcher.setFuture(QtConcurrent::run([mpl, proxy, ps]() {
+        return mpl->applyPreview(proxy, ps);
+    }));
+
+    return true;
+}
+
+/**
+ * Returns the image mpl is applied to.
+ * If the last edit was done by mpl, it is the image before that edit
+ * (startManipulator undoes it before applying mpl again).
+ * @param mpl the manipulator
+ * @return QImage the source image
+ **/
+QImage DkViewPort::manipulatorSource(const QSharedPointer<DkBaseManipulatorExt> &mpl) const
+{
+    QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+    if (!imgC)
+        return getImage();
+
+    QSharedPointer<DkBasicLoader> l = imgC->getLoader();
+
+    if (l->historyIndex() > 0 && l->lastEdit().editName() == mpl->name()) {
+        for (int idx = l->historyIndex() - 1; idx >= 0; idx--) {
+            if (l->history()->at(idx).hasImage())
+                return l->historyImage(idx);
+        }
+    }
+
+    return imgC->image();
+}
+
+void DkViewPort::clearPreview()
+{
+    mPreviewWatcher.cancel();
+    mPreviewPending = false;
+    mPreviewImg = QImage();
+    mPreviewSource = QImage();
+    mPreviewSourceKey = 0;
+}
+
 void DkViewPort::paintEvent(QPaintEvent *event)
 {
+    DkTraceSpan span("paint", "DkViewPort::paintEvent");
     QPainter painter(viewport());
 
-    if (!mImgStorage.isEmpty()) {
+    if (!mScrubImg.isNull()) {
+        drawScrubImage(painter);
+    } else if (!mImgStorage.isEmpty()) {
         // usually the QGraphicsView should do this - but we have seen issues(e.g. #706)
         painter.setPen(Qt::NoPen);
         painter.setBrush(backgroundBrush());
@@ -936,7 +1166,13 @@ void DkViewPort::paintEvent(QPaintEvent *event)
 
         // TODO: if fading is active we interpolate with background instead of the other image
         double opacity = (DkSettingsManager::param().display().transition == DkSettings::trans_fade) ? 1.0 - mAnimationValue : 1.0;
-        draw(painter, opacity);
+        if (!mPreviewImg.isNull())
+            drawPreview(painter);
+        else
+            draw(painter, opacity);
+
+        if (mPreviewImg.isNull() && (mAnimationBuffer.isNull() || mAnimationValue <= 0))
+            drawRegion(painter);
 
         if (!mAnimationBuffer.isNull() && mAnimationValue > 0) {
             float oldOp = (float)painter.opacity();
@@ -980,10 +1216,158 @@ void DkViewPort::paintEvent(QPaintEvent *event)
 
     painter.end();
 
+    // startup profile: the time it takes until the first image is on screen
+    static bool firstImagePainted = false;
+    if (!firstImagePainted && !mImgStorage.isEmpty()) {
+        firstImagePainted = true;
+
+        qint64 now = DkTracer::instance().now();
+        DkTracer::instance().record("startup", "first_image", imageContainer() ? imageContainer()->filePath() : QString(), 0, now);
+        qInfo() << "[Startup] first image painted after" << now / 1000 << "ms";
+    }
+
     // propagate
     QGraphicsView::paintEvent(event);
 }
 
+/**
+ * Draws the manipulator preview centered on the current image.
+ * Preview pixels are scaled such that they cover as many screen pixels
+ * as the full resolution would - hence rotations etc. are displayed correctly.
+ * @param painter the painter with the world transform set
+ **/
+void DkViewPort::drawPreview(QPainter &painter)
+{
+    if (mPreviewImg.isNull() || mImgStorage.isEmpty())
+        return;
+
+    double s = mImgViewRect.width() / mImgStorage.size().width() / mPreviewScale;
+
+    QRectF r(QPointF(), QSizeF(mPreviewImg.size()) * s);
+    r.moveCenter(mImgViewRect.center());
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    painter.drawImage(r, mPreviewImg, mPreviewImg.rect());
+}
+
+/**
+ * Draws the full resolution region of huge images.
+ * Only an overview of huge TIFFs is loaded (see DkBasicLoader::loadTIFFOverview).
+ * If the user zooms in further than the overview's resolution, the visible
+ * region is decoded in the background and drawn on top of the overview.
+ * @param painter the painter with the world transform set
+ **/
+void DkViewPort::drawRegion(QPainter &painter)
+{
+    QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+    if (!imgC || mSvg || mMovie)
+        return;
+
+    QSharedPointer<DkBasicLoader> loader = imgC->getLoader();
+    QSharedPointer<DkTiffRegionLoader> rl = loader->regionLoader();
+
+    // edits are applied to the overview only
+    if (!rl || loader->historyIndex() > 0 || mImgStorage.isEmpty())
+        return;
+
+    QSize fs = rl->size();
+
+    // screen pixels per full resolution pixel
+    double screenScale = mImgViewRect.width() / fs.width() * mWorldMatrix.m11();
+
+    // the overview is good enough
+    if (screenScale * fs.width() / mImgStorage.size().width() <= 1.0)
+        return;
+
+    QTransform fullToView = QTransform::fromScale(mImgViewRect.width() / fs.width(), mImgViewRect.height() / fs.height())
+        * QTransform::fromTranslate(mImgViewRect.left(), mImgViewRect.top());
+    QRect visible = (fullToView * painter.worldTransform()).inverted().mapRect(QRectF(viewport()->rect())).toAlignedRect() & QRect(QPoint(), fs);
+
+    if (visible.isEmpty())
+        return;
+
+    double scale = qMin(screenScale, 1.0);
+
+    if (mRegionSource == rl && !mRegionImg.isNull() && mRegionRect.intersects(visible))
+        painter.drawImage(fullToView.mapRect(QRectF(mRegionRect)), mRegionImg, mRegionImg.rect());
+
+    bool covered = mRegionSource == rl && mRegionRect.contains(visible) && mRegionScale >= scale * 0.99;
+
+    if (covered)
+        return;
+
+    // the running decode covers the visible part
+    bool running = mRegionWatcher.isRunning();
+    if (running && mRegionSource == rl && mPendingRegionRect.contains(visible) && mPendingRegionScale >= scale * 0.99)
+        return;
+
+    // add a margin so that small pans do not trigger a new decode
+    QRect r = visible.adjusted(-visible.width() / 4, -visible.height() / 4, visible.width() / 4, visible.height() / 4) & QRect(QPoint(), fs);
+    mRegionSource = rl;
+
+    // stop the outdated decode - only the latest request is started once it returns
+    if (running) {
+        mRegionToken.cancel();
+        mQueuedRegionRect = r;
+        mQueuedRegionScale = scale;
+        mRegionQueued = true;
+        return;
+    }
+
+    loadRegion(rl, r, scale);
+}
+
+void DkViewPort::loadRegion(QSharedPointer<DkTiffRegionLoader> rl, const QRect &rect, double scale)
+{
+    mRegionQueued = false;
+    mPendingRegionRect = rect;
+    mPendingRegionScale = scale;
+
+    // the decode stops at its next checkpoint if the token is canceled
+    mRegionToken = DkCancelToken();
+    DkCancelToken token = mRegionToken;
+
+    mRegionWatcher.setFuture(DkScheduler::instance().run(
+        DkScheduler::lane_cpu,
+        DkScheduler::priority_interactive,
+        [rl, rect, scale, token]() {
+            return rl->region(rect, scale, token);
+        },
+        token));
+}
+
+void DkViewPort::regionLoaded()
+{
+    QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+    // did the image change meanwhile?
+    if (!imgC || imgC->getLoader()->regionLoader() != mRegionSource) {
+        mRegionQueued = false;
+        return;
+    }
+
+    // the result is outdated
+    if (mRegionQueued) {
+        loadRegion(mRegionSource, mQueuedRegionRect, mQueuedRegionScale);
+        return;
+    }
+
+    if (mRegionWatcher.isCanceled())
+        return;
+
+    QImage img = mRegionWatcher.result();
+
+    if (img.isNull())
+        return;
+
+    mRegionImg = img;
+    mRegionRect = mPendingRegionRect;
+    mRegionScale = mPendingRegionScale;
+
+    update();
+}
+
 void DkViewPort::leaveEvent(QEvent *event)
 {
     // hide navigation buttons if the mouse leaves the viewport
@@ -1017,8 +1401,8 @@ void DkViewPort::loadMovie()
         mMovie->stop();
 
     // check if it truely a movie (we need this for we don't know if webp is actually animated)
-    QSharedPointer<QMovie> m(new QMovie(mLoader->filePath()));
-    if (m->frameCount() == 1)
+    QSharedPointer<DkMovie> m(new DkMovie(mLoader->filePath()));
+    if (m->frameCount() <= 1)
         return;
 
     mMovie = m;
@@ -1034,14 +1418,26 @@ void DkViewPort::loadSvg()
     if (!mLoader)
         return;
 
+    QByteArray svgData;
+
     auto cc = mLoader->getCurrentImage();
     if (cc) {
-        mSvg = QSharedPointer<QSvgRenderer>(new QSvgRenderer(*cc->getFileBuffer()));
+        svgData = *cc->getFileBuffer();
     } else {
-        mSvg = QSharedPointer<QSvgRenderer>(new QSvgRenderer(mLoader->filePath()));
+        QFile file(mLoader->filePath());
+        if (file.open(QIODevice::ReadOnly))
+            svgData = file.readAll();
     }
 
+    mSvg = QSharedPointer<QSvgRenderer>(new QSvgRenderer(svgData));
     connect(mSvg.data(), SIGNAL(repaintNeeded()), this, SLOT(update()));
+
+    // animated SVGs are rendered directly
+    mSvgTiles = QSharedPointer<DkSvgTiles>();
+    if (mSvg->isValid() && !mSvg->animated()) {
+        mSvgTiles = QSharedPointer<DkSvgTiles>(new DkSvgTiles(svgData, mSvg->defaultSize()));
+        connect(mSvgTiles.data(), SIGNAL(tilesUpdated()), this, SLOT(update()));
+    }
 }
 
 void DkViewPort::pauseMovie(bool pause)
@@ -1066,16 +1462,7 @@ void DkViewPort::previousMovieFrame()
     if (!mMovie)
         return;
 
-    int fn = mMovie->currentFrameNumber() - 1;
-    if (fn == -1)
-        fn = mMovie->frameCount() - 1;
-    // qDebug() << "retrieving frame: " << fn;
-
-    while (mMovie->currentFrameNumber() != fn)
-        mMovie->jumpToNextFrame();
-
-    //// the subsequent thing is not working if the movie is paused
-    // bool success = movie->jumpToFrame(movie->currentFrameNumber()-1);
+    mMovie->jumpToPreviousFrame();
     update();
 }
 
@@ -1085,7 +1472,7 @@ void DkViewPort::stopMovie()
         return;
 
     mMovie->stop();
-    mMovie = QSharedPointer<QMovie>();
+    mMovie = QSharedPointer<DkMovie>();
 }
 
 void DkViewPort::drawPolygon(QPainter &painter, const QPolygon &polygon)
@@ -1635,6 +2022,10 @@ bool DkViewPort::unloadImage(bool fileChange)
     if (!mController->applyPluginChanges(true)) // user wants to apply changes first
         return false;
 
+    // drop pending manipulations of the current image
+    mManipulatorTimer->stop();
+    clearPreview();
+
     if (fileChange)
         success = mLoader->unloadFile(); // returns false if the user cancels
 
@@ -1643,11 +2034,13 @@ bool DkViewPort::unloadImage(bool fileChange)
 
     if (mMovie && success) {
         mMovie->stop();
-        mMovie = QSharedPointer<QMovie>();
+        mMovie = QSharedPointer<DkMovie>();
     }
 
-    if (mSvg && success)
+    if (mSvg && success) {
         mSvg = QSharedPointer<QSvgRenderer>();
+        mSvgTiles = QSharedPointer<DkSvgTiles>();
+    }
 
     return success != 0;
 }
@@ -1710,6 +2103,113 @@ void DkViewPort::loadNextFileFast()
     loadFileFast(1);
 }
 
+/**
+ * Shows the next slide if it is ready.
+ * Otherwise, the slide is shown as soon as it is decoded and prefiltered.
+ * Hence, transitions never blend against a half-loaded image.
+ **/
+void DkViewPort::loadNextSlide()
+{
+    // the slideshow was stopped while we were waiting
+    if (!mController->getPlayer()->isPlaying()) {
+        mSlideDue = false;
+        return;
+    }
+
+    if (!mSlideDue) {
+        mSlideDue = true;
+        mSlideDueTime.start();
+    }
+
+    if (!mNextSlide)
+        prepareNextSlide();
+
+    if (mNextSlide && !mNextSlideReady)
+        return;
+
+    mSlideDue = false;
+    mNumSlides++;
+
+    int late = mSlideDueTime.elapsed();
+
+    // we allow for one frame
+    if (late > 16) {
+        mNumSlidesMissed++;
+        qInfo() << "[Slideshow]" << (mNextSlide ? mNextSlide->fileName() : QString()) << "missed its slot by" << late << "ms -"
+                << mNumSlidesMissed << "of" << mNumSlides << "slides missed";
+    }
+
+    loadNextFileFast();
+}
+
+/**
+ * Decodes the next slide & builds its pyramid for the screen size.
+ **/
+void DkViewPort::prepareNextSlide()
+{
+    if (!mLoader || !mController->getPlayer()->isPlaying())
+        return;
+
+    QSharedPointer<DkImageContainerT> next = mLoader->peekImage(1);
+
+    if (next == mNextSlide)
+        return;
+
+    if (mNextSlide)
+        disconnect(mNextSlide.data(), SIGNAL(fileLoadedSignal(bool)), this, SLOT(nextSlideLoaded(bool)));
+
+    mNextSlide = next;
+    mNextSlideReady = false;
+    mNextSlidePyramid.clear();
+
+    // nothing to wait for (e.g. the next page of a tiff)
+    if (!mNextSlide || mNextSlide == imageContainer()) {
+        mNextSlideReady = true;
+        return;
+    }
+
+    connect(mNextSlide.data(), SIGNAL(fileLoadedSignal(bool)), this, SLOT(nextSlideLoaded(bool)), Qt::UniqueConnection);
+
+    if (mNextSlide->getLoadState() == DkImageContainerT::loaded)
+        nextSlideLoaded(true);
+    else if (mNextSlide->getLoadState() != DkImageContainerT::loading && !mNextSlide->loadImageThreaded())
+        nextSlideLoaded(false);
+}
+
+void DkViewPort::nextSlideLoaded(bool loaded)
+{
+    if (!mNextSlide || mNextSlideReady)
+        return;
+
+    if (!loaded || mNextSlide->getLoadState() != DkImageContainerT::loaded) {
+        // the loader will skip it
+        mNextSlideReady = true;
+        if (mSlideDue)
+            loadNextSlide();
+        return;
+    }
+
+    if (mNextSlideWatcher.isRunning())
+        mNextSlideWatcher.cancel();
+
+    QImage img = mNextSlide->image();
+    QSize s = img.size().scaled(size(), Qt::KeepAspectRatio);
+
+    mNextSlideWatcher.setFuture(QtConcurrent::run(&DkImageStorage::pyramid, img, s));
+}
+
+void DkViewPort::nextSlidePrepared()
+{
+    if (!mNextSlide || mNextSlideWatcher.isCanceled())
+        return;
+
+    mNextSlidePyramid = mNextSlideWatcher.result();
+    mNextSlideReady = true;
+
+    if (mSlideDue)
+        loadNextSlide();
+}
+
 void DkViewPort::loadFileFast(int skipIdx)
 {
     if (!unloadImage())
@@ -1717,6 +2217,15 @@ void DkViewPort::loadFileFast(int skipIdx)
 
     mNextSwipe = skipIdx > 0;
 
+    // we are scrubbing (e.g. the arrow key is held) if we navigated within the scrub interval
+    bool scrub = mScrubTimer->isActive();
+    mScrubTimer->start();
+
+    // cancel the full decode of the image we skip
+    QSharedPointer<DkImageContainerT> cImg = mLoader->getCurrentImage();
+    if (scrub && cImg && cImg->getLoadState() == DkImageContainerT::loading)
+        cImg->cancel();
+
     QApplication::sendPostedEvents();
 
     int sIdx = skipIdx;
@@ -1731,7 +2240,13 @@ void DkViewPort::loadFileFast(int skipIdx)
         mLoader->setCurrentImage(imgC);
 
         if (imgC && imgC->getLoadState() != DkImageContainer::exists_not) {
-            mLoader->load(imgC);
+            // cached images are shown right away
+            if (scrub && imgC->getLoadState() != DkImageContainer::loaded)
+                scrubTo(imgC);
+            else {
+                showColdImage(imgC);
+                mLoader->load(imgC);
+            }
             break;
         } else if (lastImg == imgC) {
             sIdx += skipIdx; // get me out of endless loops (self referencing shortcuts)
@@ -1748,6 +2263,103 @@ void DkViewPort::loadFileFast(int skipIdx)
     }
 }
 
+/**
+ * Shows the thumbnail of imgC instead of decoding it.
+ * Only cached or embedded thumbnails are used.
+ **/
+void DkViewPort::scrubTo(QSharedPointer<DkImageContainerT> imgC)
+{
+    mScrubbing = true;
+
+    if (mScrubThumb)
+        disconnect(mScrubThumb.data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(scrubThumbLoaded()));
+
+    // recently viewed images are still cached at screen resolution
+    if (showColdImage(imgC)) {
+        mScrubThumb.clear();
+        return;
+    }
+
+    mScrubThumb = imgC->getThumb();
+
+    // keep the last thumbnail until the new one is loaded
+    if (!mScrubThumb->getImage().isNull()) {
+        scrubThumbLoaded();
+    } else {
+        connect(mScrubThumb.data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(scrubThumbLoaded()), Qt::UniqueConnection);
+        mScrubThumb->fetchThumb(DkThumbNailT::force_exif_thumb);
+    }
+}
+
+/**
+ * Shows the screen resolution version of imgC until it is decoded.
+ * @return bool true if imgC was found in the cold tier of the cache.
+ **/
+bool DkViewPort::showColdImage(QSharedPointer<DkImageContainerT> imgC)
+{
+    if (!imgC || imgC->getLoadState() == DkImageContainer::loaded)
+        return false;
+
+    QImage img = DkColdImageCache::instance().image(imgC->filePath(), imgC->fileInfo().lastModified());
+
+    if (img.isNull())
+        return false;
+
+    mScrubImg = img;
+    update();
+
+    return true;
+}
+
+/**
+ * Shows the part of an image that was downloaded so far.
+ **/
+void DkViewPort::showPartialImage(const QImage &img)
+{
+    if (img.isNull())
+        return;
+
+    mScrubImg = img;
+    update();
+}
+
+void DkViewPort::scrubThumbLoaded()
+{
+    if (!mScrubThumb || mScrubThumb->getImage().isNull())
+        return;
+
+    mScrubImg = mScrubThumb->getImage();
+    update();
+}
+
+/**
+ * Fully loads the image where navigation stopped.
+ **/
+void DkViewPort::scrubFinished()
+{
+    if (!mScrubbing)
+        return;
+
+    mScrubbing = false;
+
+    if (mLoader && mLoader->getCurrentImage())
+        mLoader->load(mLoader->getCurrentImage());
+}
+
+void DkViewPort::drawScrubImage(QPainter &painter)
+{
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(backgroundBrush());
+    painter.drawRect(QRect(QPoint(), size()));
+
+    // fit the thumbnail to the viewport
+    QSizeF s = QSizeF(mScrubImg.size()).scaled(size(), Qt::KeepAspectRatio);
+    QRectF r(QPointF((width() - s.width()) * 0.5, (height() - s.height()) * 0.5), s);
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(r, mScrubImg, mScrubImg.rect());
+}
+
 void DkViewPort::loadFirst()
 {
     if (!unloadImage())
@@ -1891,6 +2503,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
                 Qt::UniqueConnection);
 
         connect(loader.data(), SIGNAL(showInfoSignal(const QString &, int, int)), mController, SLOT(setInfo(const QString &, int, int)), Qt::UniqueConnection);
+        connect(loader.data(), SIGNAL(partialImageSignal(const QImage &)), this, SLOT(showPartialImage(const QImage &)), Qt::UniqueConnection);
 
         connect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)), Qt::UniqueConnection);
 
@@ -1935,6 +2548,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
                    SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
 
         disconnect(loader.data(), SIGNAL(showInfoSignal(const QString &, int, int)), mController, SLOT(setInfo(const QString &, int, int)));
+        disconnect(loader.data(), SIGNAL(partialImageSignal(const QImage &)), this, SLOT(showPartialImage(const QImage &)));
         disconnect(loader.data(), SIGNAL(updateSpinnerSignalDelayed(bool, int)), mController, SLOT(setSpinnerDelayed(bool, int)));
 
         disconnect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)));
@@ -2070,9 +2684,12 @@ void DkViewPortFrameless::draw(QPainter &painter, double)
     }
 
     if (mSvg && mSvg->isValid()) {
-        mSvg->render(&painter, mImgViewRect);
+        if (mSvgTiles)
+            mSvgTiles->draw(painter, mImgViewRect, viewport()->rect());
+        else
+            mSvg->render(&painter, mImgViewRect);
     } else if (mMovie && mMovie->isValid()) {
-        painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
+        painter.drawImage(mImgViewRect, mMovie->currentImage(), mMovie->frameRect());
     } else {
         QRect displayRect = mWorldMatrix.mapRect(mImgViewRect).toRect();
         QImage img = mImgStorage.image(displayRect.size());
@@ -2302,26 +2919,100 @@ DkViewPortContrast::DkViewPortContrast(QWidget *parent)
     connect(ttb, SIGNAL(tFEnabled(bool)), this, SLOT(enableTF(bool)));
     connect(this, SIGNAL(tFSliderAdded(qreal)), ttb, SLOT(insertSlider(qreal)));
     connect(this, SIGNAL(imageModeSet(int)), ttb, SLOT(setImageMode(int)));
+
+    connect(&mChannelWatcher, SIGNAL(finished()), this, SLOT(channelComputed()));
 }
 
 DkViewPortContrast::~DkViewPortContrast()
 {
+    mChannelWatcher.blockSignals(true);
 }
 
 void DkViewPortContrast::changeChannel(int channel)
 {
-    if (channel < 0 || channel >= mImgs.size())
+    if (channel < 0 || channel >= mNumChannels)
         return;
 
+    mActiveChannel = channel;
+
     if (!mImgStorage.isEmpty()) {
-        mFalseColorImg = mImgs[channel];
-        mFalseColorImg.setColorTable(mColorTable);
         mDrawFalseColorImg = true;
+        computeChannel();
+    }
+}
 
-        update();
+/**
+ * Extracts the active channel in the background.
+ * The image is shown without false colors until it is ready.
+ **/
+void DkViewPortContrast::computeChannel()
+{
+    if (mImgStorage.isEmpty() || mNumChannels == 0)
+        return;
+
+    // the watcher drops results of previous requests
+    mChannelWatcher.setFuture(QtConcurrent::run(&DkViewPortContrast::channelImage, mImgStorage.image(), mActiveChannel));
+}
+
+void DkViewPortContrast::channelComputed()
+{
+    if (mChannelWatcher.isCanceled())
+        return;
+
+    mFalseColorImg = mChannelWatcher.result();
+    mFalseColorImg.setColorTable(mColorTable);
+
+    update();
+
+    drawImageHistogram();
+}
+
+/**
+ * Returns a channel of img as Indexed8 image.
+ * @param img the image
+ * @param channel 0: gray (luminance), 1: red, 2: green, 3: blue
+ * @return QImage the channel (without color table)
+ **/
+QImage DkViewPortContrast::channelImage(const QImage &img, int channel)
+{
+    if (img.format() == QImage::Format_Indexed8)
+        return img;
+
+    QImage src = img;
+    if (src.format() != QImage::Format_RGB32 && src.format() != QImage::Format_ARGB32)
+        src = src.convertToFormat(QImage::Format_RGB32);
+
+    QImage cImg(src.size(), QImage::Format_Indexed8);
 
-        drawImageHistogram();
+    if (cImg.isNull())
+        return cImg;
+
+    for (int y = 0; y < src.height(); y++) {
+        const QRgb *sPtr = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+        uchar *cPtr = cImg.scanLine(y);
+
+        for (int x = 0; x < src.width(); x++) {
+            QRgb c = sPtr[x];
+
+            switch (channel) {
+            case 1:
+                cPtr[x] = (uchar)qRed(c);
+                break;
+            case 2:
+                cPtr[x] = (uchar)qGreen(c);
+                break;
+            case 3:
+                cPtr[x] = (uchar)qBlue(c);
+                break;
+            default:
+                // BT.601 luminance in fixed point (as OpenCV's BGR2GRAY)
+                cPtr[x] = (uchar)((qRed(c) * 4899 + qGreen(c) * 9617 + qBlue(c) * 1868 + 8192) >> 14);
+                break;
+            }
+        }
     }
+
+    return cImg;
 }
 
 void DkViewPortContrast::changeColorTable(QGradientStops stops)
@@ -2390,7 +3081,7 @@ void DkViewPortContrast::changeColorTable(QGradientStops stops)
 
 void DkViewPortContrast::draw(QPainter &painter, double opacity)
 {
-    if (!mDrawFalseColorImg || mSvg || mMovie) {
+    if (!mDrawFalseColorImg || mFalseColorImg.isNull() || mSvg || mMovie) {
         DkBaseViewPort::draw(painter, opacity);
         return;
     }
@@ -2405,75 +3096,36 @@ void DkViewPortContrast::draw(QPainter &painter, double opacity)
     if (DkSettingsManager::param().display().tpPattern && img.hasAlphaChannel() && opacity == 1.0)
         drawPattern(painter);
 
-    if (mDrawFalseColorImg)
-        painter.drawImage(mImgViewRect, mFalseColorImg, mImgRect);
+    painter.drawImage(mImgViewRect, mFalseColorImg, mImgRect);
 }
 
 void DkViewPortContrast::setImage(QImage newImg)
 {
     DkViewPort::setImage(newImg);
 
+    // the channel of the previous image must not be drawn
+    mChannelWatcher.cancel();
+    mFalseColorImg = QImage();
+
     if (newImg.isNull())
         return;
 
-    if (mImgStorage.image().format() == QImage::Format_Indexed8) {
-        mImgs = QVector<QImage>(1);
-        mImgs[0] = mImgStorage.image();
+    mNumChannels = mImgStorage.image().format() == QImage::Format_Indexed8 ? 1 : 4;
+    if (mActiveChannel >= mNumChannels)
         mActiveChannel = 0;
-    }
-#ifdef WITH_OPENCV
-
-    else {
-
-        mImgs = QVector<QImage>(4);
-        std::vector<cv::Mat> planes;
-
-        cv::Mat imgUC3 = DkImage::qImage2Mat(mImgStorage.image());
-        // int format = imgQt.format();
-        // if (format == QImage::Format_RGB888)
-        //	imgUC3 = Mat(imgQt.height(), imgQt.width(), CV_8UC3, (uchar*)imgQt.bits(), imgQt.bytesPerLine());
-        // else
-        //	imgUC3 = Mat(imgQt.height(), imgQt.width(), CV_8UC4, (uchar*)imgQt.bits(), imgQt.bytesPerLine());
-        split(imgUC3, planes);
-        // Store the 3 channels in a QImage Vector.
-        // Be aware that OpenCV 'swaps' the rgb triplet, hence process it in a descending way:
-        int idx = 1;
-        for (int i = 2; i >= 0; i--) {
-            // dirty hack
-            if (i >= (int)planes.size())
-                i = 0;
-            mImgs[idx] = QImage((const unsigned char *)planes[i].data, (int)planes[i].cols, (int)planes[i].rows, (int)planes[i].step, QImage::Format_Indexed8);
-            mImgs[idx] = mImgs[idx].copy();
-            idx++;
-        }
-        // The first element in the vector contains the gray scale 'average' of the 3 channels:
-        cv::Mat grayMat;
-        cv::cvtColor(imgUC3, grayMat, CV_BGR2GRAY);
-        mImgs[0] = QImage((const unsigned char *)grayMat.data, (int)grayMat.cols, (int)grayMat.rows, (int)grayMat.step, QImage::Format_Indexed8);
-        mImgs[0] = mImgs[0].copy();
-        planes.clear();
-    }
-#else
-
-    else {
-        mDrawFalseColorImg = false;
-        emit imageModeSet(mode_invalid_format);
-        return;
-    }
-
-#endif
-
-    mFalseColorImg = mImgs[mActiveChannel];
-    mFalseColorImg.setColorTable(mColorTable);
 
     // images with valid color table return img.isGrayScale() false...
     if (mSvg || mMovie)
         emit imageModeSet(mode_invalid_format);
-    else if (mImgs.size() == 1)
+    else if (mNumChannels == 1)
         emit imageModeSet(mode_gray);
     else
         emit imageModeSet(mode_rgb);
 
+    // only the active channel is extracted - and not before it is drawn
+    if (mDrawFalseColorImg)
+        computeChannel();
+
     update();
 }
 
@@ -2486,6 +3138,10 @@ void DkViewPortContrast::pickColor(bool enable)
 void DkViewPortContrast::enableTF(bool enable)
 {
     mDrawFalseColorImg = enable;
+
+    if (enable && mFalseColorImg.isNull())
+        computeChannel();
+
     update();
 
     drawImageHistogram();
@@ -2518,8 +3174,8 @@ void DkViewPortContrast::mouseReleaseEvent(QMouseEvent *event)
         if (xy.x() < 0 || xy.y() < 0 || xy.x() >= getImageSize().width() || xy.y() >= getImageSize().height())
             isPointValid = false;
 
-        if (isPointValid) {
-            int colorIdx = mImgs[mActiveChannel].pixelIndex(xy);
+        if (isPointValid && mFalseColorImg.valid(xy)) {
+            int colorIdx = mFalseColorImg.pixelIndex(xy);
             qreal normedPos = (qreal)colorIdx / 255;
             emit tFSliderAdded(normedPos);
         }
@@ -2543,7 +3199,7 @@ void DkViewPortContrast::keyPressEvent(QKeyEvent *event)
 
 QImage DkViewPortContrast::getImage() const
 {
-    if (mDrawFalseColorImg)
+    if (mDrawFalseColorImg && !mFalseColorImg.isNull())
         return mFalseColorImg;
     else
         return imageContainer() ? imageContainer()->image() : QImage();
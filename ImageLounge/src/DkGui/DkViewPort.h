@@ -70,8 +70,10 @@ class DkRotatingRect;
 class DkPluginInterface;
 class DkPluginContainer;
 class DkBaseManipulator;
+class DkBaseManipulatorExt;
 class DkResizeDialog;
 class DkHudNavigation;
+class DkTiffRegionLoader;
 
 class DllCoreExport DkViewPort : public DkBaseViewPort
 {
@@ -157,6 +159,7 @@ public slots:
     void reloadFile();
     void loadNextFileFast();
     void loadPrevFileFast();
+    void loadNextSlide();
     void loadFileFast(int skipIdx);
     void loadFile(int skipIdx);
     void loadFirst();
@@ -186,7 +189,9 @@ public slots:
 
     // image manipulators
     virtual void applyManipulator();
+    void applyActiveManipulator();
     void manipulatorApplied();
+    void manipulatorPreviewed();
 
     virtual void updateImage(QSharedPointer<DkImageContainerT> image, bool loaded = true);
     virtual void setImageUpdated();
@@ -204,6 +209,12 @@ public slots:
     void nextMovieFrame();
     void previousMovieFrame();
     void animateFade();
+    void regionLoaded();
+    void nextSlideLoaded(bool loaded = true);
+    void nextSlidePrepared();
+    void scrubFinished();
+    void scrubThumbLoaded();
+    void showPartialImage(const QImage &img);
     virtual void togglePattern(bool show) override;
 
 protected:
@@ -249,6 +260,44 @@ protected:
     // image manipulators
     QFutureWatcher<QImage> mManipulatorWatcher;
     QSharedPointer<DkBaseManipulator> mActiveManipulator;
+    QTimer *mManipulatorTimer = 0;
+
+    // screen-sized previews of extended manipulators (large images only)
+    QFutureWatcher<QImage> mPreviewWatcher;
+    QImage mPreviewSource;
+    qint64 mPreviewSourceKey = 0;
+    QImage mPreviewImg;
+    double mPreviewScale = 1.0;
+    bool mPreviewPending = false;
+
+    // regions of huge images (see DkTiffRegionLoader)
+    QFutureWatcher<QImage> mRegionWatcher;
+    QSharedPointer<DkTiffRegionLoader> mRegionSource;
+    QImage mRegionImg;
+    QRect mRegionRect;
+    QRect mPendingRegionRect; // the region that is decoded
+    double mRegionScale = 0.0;
+    double mPendingRegionScale = 0.0;
+    DkCancelToken mRegionToken;
+    QRect mQueuedRegionRect; // the latest region requested while decoding
+    double mQueuedRegionScale = 0.0;
+    bool mRegionQueued = false;
+
+    // slideshow: the next slide is decoded & prefiltered before it is due
+    QSharedPointer<DkImageContainerT> mNextSlide;
+    QFutureWatcher<QVector<QImage>> mNextSlideWatcher;
+    QVector<QImage> mNextSlidePyramid;
+    bool mNextSlideReady = false;
+    bool mSlideDue = false;
+    DkTimer mSlideDueTime;
+    int mNumSlides = 0;
+    int mNumSlidesMissed = 0;
+
+    // scrubbing: rapid navigation only shows thumbnails
+    QTimer *mScrubTimer = 0;
+    QSharedPointer<DkThumbNailT> mScrubThumb;
+    QImage mScrubImg;
+    bool mScrubbing = false;
 
     // functions
     virtual int swipeRecognition(QPoint start, QPoint end);
@@ -256,11 +305,23 @@ protected:
     virtual void createShortcuts();
 
     void drawPolygon(QPainter &painter, const QPolygon &polygon);
+    void drawRegion(QPainter &painter);
+    void loadRegion(QSharedPointer<DkTiffRegionLoader> rl, const QRect &rect, double scale);
+    void drawPreview(QPainter &painter);
     virtual void drawBackground(QPainter &painter);
     virtual void updateImageMatrix() override;
     void showZoom();
     void toggleLena(bool fullscreen);
     void getPixelInfo(const QPoint &pos);
+
+    void startManipulator(const QSharedPointer<DkBaseManipulator> &mpl);
+    bool previewManipulator(const QSharedPointer<DkBaseManipulatorExt> &mpl);
+    QImage manipulatorSource(const QSharedPointer<DkBaseManipulatorExt> &mpl) const;
+    void clearPreview();
+    void prepareNextSlide();
+    void scrubTo(QSharedPointer<DkImageContainerT> imgC);
+    bool showColdImage(QSharedPointer<DkImageContainerT> imgC);
+    void drawScrubImage(QPainter &painter);
 };
 
 class DllCoreExport DkViewPortFrameless : public DkViewPort
@@ -319,6 +380,9 @@ public slots:
 
     virtual void setImage(QImage newImg) override;
 
+protected slots:
+    void channelComputed();
+
 protected:
     virtual void draw(QPainter &painter, double opacity = 1.0) override;
     virtual void mousePressEvent(QMouseEvent *event) override;
@@ -331,12 +395,15 @@ private:
     bool mDrawFalseColorImg = false;
     bool mIsColorPickerActive = false;
     int mActiveChannel = 0;
+    int mNumChannels = 0;
 
-    QVector<QImage> mImgs;
+    QFutureWatcher<QImage> mChannelWatcher;
     QVector<QRgb> mColorTable;
 
     // functions
     void drawImageHistogram();
+    void computeChannel();
+    static QImage channelImage(const QImage &img, int channel);
 };
 
 }
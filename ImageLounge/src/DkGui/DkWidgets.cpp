@@ -1241,9 +1241,9 @@ void DkFileInfoLabel::setVisible(bool visible, bool saveSettings)
             DkFadeLabel::setVisible(false);
             return;
         } else {
-            DkSettingsManager::param().slideShow().display.setBit(DkSettings::display_file_name, true);
-            DkSettingsManager::param().slideShow().display.setBit(DkSettings::display_creation_date, true);
-            DkSettingsManager::param().slideShow().display.setBit(DkSettings::display_file_rating, true);
+            DkSettingsManager::edit().slideShow().display.setBit(DkSettings::display_file_name, true);
+            DkSettingsManager::edit().slideShow().display.setBit(DkSettings::display_creation_date, true);
+            DkSettingsManager::edit().slideShow().display.setBit(DkSettings::display_file_rating, true);
         }
     }
 
@@ -1439,7 +1439,7 @@ void DkPlayer::startTimer()
 
 void DkPlayer::autoNext()
 {
-    emit nextSignal();
+    emit autoNextSignal();
 }
 
 void DkPlayer::next()
@@ -2212,6 +2212,8 @@ DkHistogram::DkHistogram(QWidget *parent)
     mContextMenu = new QMenu(tr("Histogram Settings"));
     mContextMenu->addAction(showStats);
 
+    connect(&mHistWatcher, SIGNAL(finished()), this, SLOT(histogramComputed()));
+
     QMetaObject::connectSlotsByName(this);
 }
 
@@ -2273,16 +2275,21 @@ void DkHistogram::paintEvent(QPaintEvent *)
         QString histText1("Pixels: %1\tMPix: %2");
         painter.drawText(QPoint(margin, height() - 2 * TEXT_SIZE + margin), histText1.arg(mNumPixels, 10, 10).arg(megaPixels, 10, 'f', 2));
 
-        if (mMinBinValue < 256) {
+        if (mMinBinValue < 256 && mBitDepth > 8) {
+            // 16 bit gray image statistics
+            QString histText2("Min: %1\tMax: %2\t(%3 bit)");
+            painter.drawText(QPoint(margin, height() - 1 * TEXT_SIZE + margin),
+                             histText2.arg(mMinValue, 5, 10).arg(mMaxValue16, 5, 10).arg(mBitDepth));
+        } else if (mMinBinValue < 256) {
             // gray image statistics
             QString histText2("Min: %1\tMax: %2\tValue Count: %3");
             painter.drawText(QPoint(margin, height() - 1 * TEXT_SIZE + margin),
                              histText2.arg(mMinBinValue, 5, 10).arg(mMaxBinValue, 5, 10).arg(mNumDistinctValues, 5, 10));
         } else {
             // color image statistics
-            double blackPct = 100.0 * (double)mNumZeroPixels / (double)mNumPixels;
-            double whitePct = 100.0 * (double)mNumSaturatedPixels / (double)mNumPixels;
-            double goodPct = 100.0 * (double)(mNumPixels - mNumZeroPixels - mNumSaturatedPixels) / (double)mNumPixels;
+            double blackPct = 100.0 * (double)mNumZeroPixels / (double)mNumSampledPixels;
+            double whitePct = 100.0 * (double)mNumSaturatedPixels / (double)mNumSampledPixels;
+            double goodPct = 100.0 * (double)(mNumSampledPixels - mNumZeroPixels - mNumSaturatedPixels) / (double)mNumSampledPixels;
 
             QString histText2("Black:  %1\tGood: %3\tWhite: %2");
             painter.drawText(QPoint(margin, height() - 1 * TEXT_SIZE + margin),
@@ -2303,7 +2310,7 @@ void DkHistogram::contextMenuEvent(QContextMenuEvent *event)
 void DkHistogram::on_toggleStats_triggered(bool show)
 {
     mDisplayMode = (show) ? DisplayMode::histogram_mode_extended : DisplayMode::histogram_mode_simple;
-    DkSettingsManager::param().display().histogramStyle = (int)mDisplayMode;
+    DkSettingsManager::edit().display().histogramStyle = (int)mDisplayMode;
     update();
 }
 
@@ -2319,102 +2326,101 @@ void DkHistogram::loadSettings()
 }
 
 /**
- * Goes through the image and counts pixels values. They are used to create the image histogram.
- * @param currently displayed image
+ * Counts the image's pixel values in the background. They are used to create the image histogram.
+ * 16 bit images are counted at their native depth.
+ * Transient images (no container, e.g. interactive previews) are always sampled.
+ * @param imgQt currently displayed image
+ * @param imgC the image's container - the histogram is cached there
+ * @param sample a smaller version of imgQt that is used if histogram sampling is enabled
  **/
-void DkHistogram::drawHistogram(QImage imgQt)
+void DkHistogram::drawHistogram(QImage imgQt, QSharedPointer<DkImageContainerT> imgC, const QImage &sample)
 {
     if (!isVisible() || imgQt.isNull()) {
         setPainted(false);
         return;
     }
 
-    DkTimer dt;
-
-    // clear histogram values
-    mNumZeroPixels = 0;
-    mNumSaturatedPixels = 0;
-    mMaxBinValue = -1;
-    mMinBinValue = 256;
-    mMaxValue = 0;
     mNumPixels = imgQt.width() * imgQt.height();
+    mHistImageKey = imgQt.cacheKey();
 
-    for (int idx = 0; idx < 256; idx++) {
-        mHist[0][idx] = 0;
-        mHist[1][idx] = 0;
-        mHist[2][idx] = 0;
+    // switching back to an image
+    if (imgC && imgC->histogram() && imgC->histogram()->imageKey == imgQt.cacheKey()) {
+        mHistContainer.reset();
+        setHistogram(*imgC->histogram());
+        return;
     }
 
-    // count pixel- and total values, for
-    // 8 bit images
-    if (imgQt.depth() == 8) {
-        qDebug() << "8 bit histogram -------------------";
-
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const unsigned char *pixel = imgQt.constScanLine(rIdx);
-
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++, pixel++) {
-                mHist[0][*pixel]++;
-                mHist[1][*pixel]++;
-                mHist[2][*pixel]++;
-
-                if (*pixel == 255)
-                    mNumSaturatedPixels++;
-                if (*pixel < mMinBinValue)
-                    mMinBinValue = *pixel;
-                if (*pixel > mMaxBinValue)
-                    mMaxBinValue = *pixel;
-            }
-        }
+    mHistContainer = imgC;
+
+    QImage src = imgQt;
+    int step = 1;
+
+    if (DkSettingsManager::param().display().histogramSampling || !imgC) {
+        // the sample is 8 bit - we rather skip pixels of 16 bit images
+        if (!sample.isNull() && !DkImageHistogram::isHighBitDepth(imgQt))
+            src = sample;
+
+        step = qMax(qFloor(qSqrt((double)src.width() * src.height() / DkImageHistogram::sample_pixels)), 1);
     }
-    // 24 bit images
-    else if (imgQt.depth() == 24) {
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const unsigned char *pixel = imgQt.constScanLine(rIdx);
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++) {
-                // If I understood the api correctly, the first bits are 0 if we have 24bpp & < 8 bits per channel
-                unsigned char pixR = *pixel;
-                mHist[0][*pixel]++;
-                pixel++;
-                unsigned char pixG = *pixel;
-                mHist[1][*pixel]++;
-                pixel++;
-                unsigned char pixB = *pixel;
-                mHist[2][*pixel]++;
-                pixel++;
-
-                if (pixR == 0 && pixG == 0 && pixB == 0) {
-                    mNumZeroPixels++;
-                } else if (pixR == 255 && pixG == 255 && pixB == 255) {
-                    mNumSaturatedPixels++;
-                }
-            }
-        }
+
+    qint64 key = mHistImageKey;
+    bool sampled = src.cacheKey() != key;
+
+    mHistWatcher.setFuture(QtConcurrent::run([src, step, key, sampled]() {
+        DkImageHistogram h = DkImageHistogram::fromImage(src, step);
+        h.imageKey = key;
+        h.exact = h.exact && !sampled;
+        return h;
+    }));
+}
+
+void DkHistogram::histogramComputed()
+{
+    DkImageHistogram h = mHistWatcher.result();
+
+    // another image was requested meanwhile
+    if (h.imageKey != mHistImageKey)
+        return;
+
+    // adjustments (e.g. auto adjust) reuse exact histograms
+    DkImageHistogram::cache(h);
+
+    if (mHistContainer)
+        mHistContainer->setHistogram(QSharedPointer<DkImageHistogram>(new DkImageHistogram(h)));
+    mHistContainer.reset();
+
+    setHistogram(h);
+}
+
+/**
+ * Shows the histogram values.
+ * @param hist the image's histogram
+ **/
+void DkHistogram::setHistogram(const DkImageHistogram &hist)
+{
+    if (hist.isEmpty()) {
+        setPainted(false);
+        update();
+        return;
     }
-    // 32 bit images
-    else if (imgQt.depth() == 32) {
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const QRgb *pixel = (QRgb *)(imgQt.constScanLine(rIdx));
-
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++, pixel++) {
-                size_t pixR = static_cast<size_t>(qRed(*pixel));
-                size_t pixG = static_cast<size_t>(qGreen(*pixel));
-                size_t pixB = static_cast<size_t>(qBlue(*pixel));
-
-                mHist[0][pixR]++;
-                mHist[1][pixG]++;
-                mHist[2][pixB]++;
-
-                if (pixR == 0 && pixG == 0 && pixB == 0) {
-                    mNumZeroPixels++;
-                } else if (pixR == 255 && pixG == 255 && pixB == 255) {
-                    mNumSaturatedPixels++;
-                }
-            }
-        }
+
+    for (int idx = 0; idx < 256; idx++) {
+        mHist[0][idx] = hist.hist[0][idx];
+        mHist[1][idx] = hist.hist[1][idx];
+        mHist[2][idx] = hist.hist[2][idx];
     }
 
+    mNumSampledPixels = hist.numPixels;
+    mNumZeroPixels = hist.numZeroPixels;
+    mNumSaturatedPixels = hist.numSaturatedPixels;
+    mMinBinValue = hist.minBinValue;
+    mMaxBinValue = hist.maxBinValue;
+    mBitDepth = hist.bitDepth;
+    mMinValue = hist.minValue;
+    mMaxValue16 = hist.maxValue;
+
     // determine extreme values from the histogram
+    mMaxValue = 0;
     mNumDistinctValues = 0;
 
     for (int idx = 0; idx < 256; idx++) {
@@ -2431,7 +2437,6 @@ void DkHistogram::drawHistogram(QImage imgQt)
     }
 
     setPainted(true);
-    qDebug() << "drawing the histogram took me: " << dt;
     update();
 }
 
@@ -45,6 +45,7 @@
 
 #include "DkBaseWidgets.h"
 #include "DkImageContainer.h"
+#include "DkImageStorage.h"
 #include "DkMath.h"
 
 // Qt defines
@@ -248,6 +249,7 @@ public:
 signals:
     void nextSignal();
     void previousSignal();
+    void autoNextSignal();
 
 public slots:
     void play(bool play);
@@ -701,7 +703,10 @@ public:
     DkHistogram(QWidget *parent);
     ~DkHistogram();
 
-    void drawHistogram(QImage img);
+    void drawHistogram(QImage img,
+                       QSharedPointer<DkImageContainerT> imgC = QSharedPointer<DkImageContainerT>(),
+                       const QImage &sample = QImage());
+    void setHistogram(const DkImageHistogram &hist);
     void clearHistogram();
     void setMaxHistogramValue(int maxValue);
     void updateHistogramValues(int histValues[][256]);
@@ -710,6 +715,9 @@ public:
 public slots:
     void on_toggleStats_triggered(bool show);
 
+protected slots:
+    void histogramComputed();
+
 protected:
     virtual void mousePressEvent(QMouseEvent *event) override;
     virtual void mouseMoveEvent(QMouseEvent *event) override;
@@ -722,17 +730,25 @@ protected:
 private:
     int mHist[3][256]; /// 3 channels 256 bin. channels duplicated when gray
     int mNumPixels = 0; /// image pixel count
+    int mNumSampledPixels = 0; /// pixels counted (less than mNumPixels if sampled)
     int mNumDistinctValues = 0; /// number of distinct values
     int mNumZeroPixels = 0; /// pixels with zero value
     int mNumSaturatedPixels = 0; /// pixels saturating RGB 8bit
     int mNumValues = 0; /// number of distinct histogram values
     int mMinBinValue = 256; /// (gray-only) minimum intensity value
     int mMaxBinValue = -1; /// (gray-only) maximum intensity value
+    int mBitDepth = 8; /// bits per channel of the image
+    int mMinValue = -1; /// (gray-only) minimum value in the image's range
+    int mMaxValue16 = -1; /// (gray-only) maximum value in the image's range
     int mMaxValue = 20; /// maximum count over all bins
     bool mIsPainted = false;
     float mScaleFactor = 1;
     DisplayMode mDisplayMode = DisplayMode::histogram_mode_simple; /// determins shown histogram type
 
+    QFutureWatcher<DkImageHistogram> mHistWatcher;
+    QSharedPointer<DkImageContainerT> mHistContainer; /// the histogram is cached here
+    qint64 mHistImageKey = 0; /// cacheKey() of the image requested last
+
     QMenu *mContextMenu = 0;
 };
 
@@ -43,22 +43,28 @@
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QCoreApplication>
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
 #include <QFileInfo>
+#include <QMenu>
 #include <QMessageBox>
 #include <QObject>
 #include <QProcess>
+#include <QSystemTrayIcon>
 #include <QTextStream>
 #include <QTranslator>
 #pragma warning(pop) // no warnings from includes - end
 
+#include "DkBenchmark.h"
 #include "DkCentralWidget.h"
+#include "DkLog.h"
 #include "DkNoMacs.h"
 #include "DkPluginManager.h"
 #include "DkPong.h"
 #include "DkProcess.h"
+#include "DkReplay.h"
 #include "DkSettings.h"
 #include "DkTimer.h"
 #include "DkUtils.h"
@@ -75,6 +81,93 @@
 #include <shlobj.h>
 #endif
 
+/**
+ * Batch processing without the GUI application (e.g. on render-farm nodes).
+ * The progress is written to stdout as JSON lines - see DkBatchProcessing::computeBatchHeadless.
+ * @return int the exit code (see DkBatchProcessing::ExitCode)
+ **/
+static int runHeadless(int &argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    nmc::DkSettingsManager::instance().init();
+    nmc::DkMetaDataHelper::initialize(); // this line makes the XmpParser thread-save
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QObject::tr("Headless batch processing - the progress is written to stdout as JSON lines."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption headlessOpt(QStringList() << "headless", QObject::tr("Batch processing without GUI."));
+    parser.addOption(headlessOpt);
+
+    QCommandLineOption batchOpt(QStringList() << "batch", QObject::tr("Batch processing of <batch-settings.pnm>."), QObject::tr("batch-settings-path"));
+    parser.addOption(batchOpt);
+
+    QCommandLineOption filesOpt(QStringList() << "files",
+                                QObject::tr("Processes the images listed in <file-list.txt> (one path per line, - reads stdin) instead of the profile's files."),
+                                QObject::tr("file-list.txt"));
+    parser.addOption(filesOpt);
+
+    QCommandLineOption threadsOpt(QStringList() << "threads", QObject::tr("Number of threads that decode, process and encode images."), QObject::tr("threads"));
+    parser.addOption(threadsOpt);
+
+    QCommandLineOption ioThreadsOpt(QStringList() << "io-threads", QObject::tr("Number of threads that read and write files."), QObject::tr("threads"));
+    parser.addOption(ioThreadsOpt);
+
+    QCommandLineOption memoryOpt(QStringList() << "memory-budget", QObject::tr("Memory of all images in the pipeline in <MB>."), QObject::tr("MB"));
+    parser.addOption(memoryOpt);
+
+    QCommandLineOption batchLogOpt(QStringList() << "batch-log", QObject::tr("Saves batch log to <log-path.txt>."), QObject::tr("log-path.txt"));
+    parser.addOption(batchLogOpt);
+
+    QCommandLineOption journalOpt(QStringList() << "journal",
+                                  QObject::tr("Records finished items in <batch.journal> and skips up-to-date items when it is run again."),
+                                  QObject::tr("batch.journal"));
+    parser.addOption(journalOpt);
+
+    QCommandLineOption shardOpt(QStringList() << "shard",
+                                QObject::tr("Processes the <i/N>-th part of the files - run N processes (e.g. on several nodes) with i = 0 ... N-1."),
+                                QObject::tr("i/N"));
+    parser.addOption(shardOpt);
+
+    QCommandLineOption traceOpt(QStringList() << "trace", QObject::tr("Records a trace and saves it to <trace.json> on exit."), QObject::tr("trace.json"));
+    parser.addOption(traceOpt);
+
+    // don't use process() - it exits with 1 which means that items failed
+    if (!parser.parse(app.arguments())) {
+        qCritical().noquote() << parser.errorText();
+        return nmc::DkBatchProcessing::exit_usage;
+    }
+
+    if (parser.isSet("help"))
+        parser.showHelp(nmc::DkBatchProcessing::exit_ok);
+    if (parser.isSet("version"))
+        parser.showVersion();
+
+    if (parser.value(batchOpt).isEmpty()) {
+        qCritical() << "--headless needs a batch profile: --batch <batch-settings.pnm>";
+        return nmc::DkBatchProcessing::exit_usage;
+    }
+
+    QString tracePath = parser.value(traceOpt);
+    nmc::DkTracer::instance().setEnabled(!tracePath.isEmpty());
+
+    int rVal = nmc::DkBatchProcessing::computeBatchHeadless(parser.value(batchOpt),
+                                                            parser.value(filesOpt),
+                                                            parser.value(threadsOpt).toInt(),
+                                                            parser.value(ioThreadsOpt).toInt(),
+                                                            parser.value(memoryOpt).toDouble(),
+                                                            parser.value(batchLogOpt),
+                                                            parser.value(journalOpt),
+                                                            parser.value(shardOpt));
+
+    if (!tracePath.isEmpty())
+        nmc::DkTracer::instance().exportChromeTrace(tracePath);
+
+    return rVal;
+}
+
 #ifdef Q_OS_WIN
 int main(int argc, wchar_t *argv[])
 {
@@ -83,6 +176,9 @@ int main(int argc, char *argv[])
 {
 #endif
 
+    // starts the clock of the startup profile
+    nmc::DkTracer::instance();
+
     QCoreApplication::setOrganizationName("nomacs");
     QCoreApplication::setOrganizationDomain("https://nomacs.org");
     QCoreApplication::setApplicationName("Image Lounge");
@@ -92,24 +188,38 @@ int main(int argc, char *argv[])
     QApplication::setAttribute(Qt::AA_DisableHighDpiScaling, true);
 #endif
 
+    // the OpenGL viewport is moved between top-level windows (e.g. frameless mode)
+    QApplication::setAttribute(Qt::AA_ShareOpenGLContexts, true);
+
+    // the headless batch does not initialize the GUI application
+    for (int idx = 1; idx < argc; idx++) {
+#ifdef Q_OS_WIN
+        QString arg = QString::fromWCharArray(argv[idx]);
+#else
+        QString arg = QString::fromLocal8Bit(argv[idx]);
+#endif
+        if (arg == "--headless")
+            return runHeadless(argc, (char **)argv);
+    }
+
     QApplication app(argc, (char **)argv);
 
+    // enable tracing before the settings are loaded so that the whole startup is profiled
+    for (const QString &arg : app.arguments()) {
+        if (arg == "--trace" || arg.startsWith("--trace="))
+            nmc::DkTracer::instance().setEnabled(true);
+    }
+
     // init settings
-    nmc::DkSettingsManager::instance().init();
-    nmc::DkMetaDataHelper::initialize(); // this line makes the XmpParser thread-save - so don't delete it even if you seem to know what you do
+    {
+        nmc::DkTraceSpan ts("startup", "settings");
+        nmc::DkSettingsManager::instance().init();
+        nmc::DkMetaDataHelper::initialize(); // this line makes the XmpParser thread-save - so don't delete it even if you seem to know what you do
+    }
 
     nmc::DefaultSettings settings;
     int mode = settings.value("AppSettings/appMode", nmc::DkSettingsManager::param().app().appMode).toInt();
 
-    // uncomment this for the single instance feature...
-    //// check for single instance
-    // nmc::DkRunGuard guard;
-    //
-    // if (!guard.tryRunning()) {
-    //	qDebug() << "nomacs is already running - quitting...";
-    //	return 0;
-    // }
-
     // CMD parser --------------------------------------------------------------------
     QCommandLineParser parser;
 
@@ -158,6 +268,10 @@ int main(int argc, char *argv[])
     QCommandLineOption batchLogOpt(QStringList() << "batch-log", QObject::tr("Saves batch log to <log-path.txt>."), QObject::tr("log-path.txt"));
     parser.addOption(batchLogOpt);
 
+    // handled before the GUI is created (see runHeadless) - listed for --help only
+    QCommandLineOption headlessOpt(QStringList() << "headless", QObject::tr("Runs --batch without GUI (see --headless --help)."));
+    parser.addOption(headlessOpt);
+
     QCommandLineOption importSettingsOpt(QStringList() << "import-settings",
                                          QObject::tr("Imports the settings from <settings-path.ini> and saves them."),
                                          QObject::tr("settings-path.ini"));
@@ -166,11 +280,44 @@ int main(int argc, char *argv[])
     QCommandLineOption registerFilesOpt(QStringList() << "register-files", QObject::tr("Register file associations (Windows only)."));
     parser.addOption(registerFilesOpt);
 
+    QCommandLineOption benchmarkOpt(QStringList() << "benchmark", QObject::tr("Benchmarks the image pipeline with the images of <corpus.json>."), QObject::tr("corpus.json"));
+    parser.addOption(benchmarkOpt);
+
+    QCommandLineOption benchmarkResultsOpt(QStringList() << "benchmark-results",
+                                           QObject::tr("Saves the benchmark results to <results.json>."),
+                                           QObject::tr("results.json"));
+    parser.addOption(benchmarkResultsOpt);
+
+    QCommandLineOption replayOpt(QStringList() << "replay", QObject::tr("Replays the navigation trace <trace.json> and measures the latency."), QObject::tr("trace.json"));
+    parser.addOption(replayOpt);
+
+    QCommandLineOption replayResultsOpt(QStringList() << "replay-results", QObject::tr("Saves the replay results to <results.json>."), QObject::tr("results.json"));
+    parser.addOption(replayResultsOpt);
+
+    QCommandLineOption traceOpt(QStringList() << "trace", QObject::tr("Records a trace and saves it to <trace.json> on exit."), QObject::tr("trace.json"));
+    parser.addOption(traceOpt);
+
+    QCommandLineOption backgroundOpt(QStringList() << "background", QObject::tr("Starts nomacs hidden in the tray - files are then opened by this instance."));
+    parser.addOption(backgroundOpt);
+
     parser.process(app);
 
+    QString tracePath = parser.value(traceOpt);
+    nmc::DkTracer::instance().setEnabled(!tracePath.isEmpty());
+
     // CMD parser --------------------------------------------------------------------
     nmc::DkPluginManager::createPluginsPath();
 
+    // run benchmarks
+    if (!parser.value(benchmarkOpt).isEmpty()) {
+        int rVal = nmc::DkBenchmark::runBenchmark(parser.value(benchmarkOpt), parser.value(benchmarkResultsOpt));
+
+        if (!tracePath.isEmpty())
+            nmc::DkTracer::instance().exportChromeTrace(tracePath);
+
+        return rVal;
+    }
+
     // compute batch process
     if (!parser.value(batchOpt).isEmpty()) {
         QString logPath;
@@ -180,6 +327,9 @@ int main(int argc, char *argv[])
         QString batchSettingsPath = parser.value(batchOpt);
         nmc::DkBatchProcessing::computeBatch(batchSettingsPath, logPath);
 
+        if (!tracePath.isEmpty())
+            nmc::DkTracer::instance().exportChromeTrace(tracePath);
+
         return 0;
     }
 
@@ -201,25 +351,64 @@ int main(int argc, char *argv[])
     if (noUI)
         return 0;
 
+    // single instance: hand the files over to the running nomacs
+    bool background = parser.isSet(backgroundOpt);
+    bool firstInstance = false;
+    nmc::DkRunGuard guard;
+
+    // options that change the whole instance start a new one (which never accepts files)
+    bool handOver = !parser.isSet(privateOpt) && !parser.isSet(modeOpt) && !parser.isSet(pongOpt) && !parser.isSet(fullScreenOpt)
+        && !parser.isSet(slideshowOpt) && parser.value(replayOpt).isEmpty();
+
+    if ((nmc::DkSettingsManager::param().app().singleInstance && handOver) || background) {
+        firstInstance = guard.tryRunning();
+
+        if (!firstInstance && background) {
+            qInfo() << "nomacs is already running - quitting...";
+            return 0;
+        }
+
+        if (!firstInstance && handOver) {
+            QStringList filePaths;
+
+            for (const QString &fp : parser.positionalArguments() + parser.values(tabOpt)) {
+                if (!fp.trimmed().isEmpty())
+                    filePaths << QFileInfo(fp.trimmed()).absoluteFilePath();
+            }
+
+            if (!parser.value(sourceDirOpt).trimmed().isEmpty())
+                filePaths << QFileInfo(parser.value(sourceDirOpt).trimmed()).absoluteFilePath();
+
+            // otherwise the running instance hangs - start a new one
+            if (guard.sendFiles(filePaths)) {
+                qInfo() << "files handed over to the running nomacs - quitting...";
+                return 0;
+            }
+        }
+    }
+
     // install translations
     QString translationName = "nomacs_" + settings.value("GlobalSettings/language", nmc::DkSettingsManager::param().global().language).toString() + ".qm";
     QString translationNameQt = "qt_" + settings.value("GlobalSettings/language", nmc::DkSettingsManager::param().global().language).toString() + ".qm";
 
     QTranslator translator;
-    nmc::DkSettingsManager::param().loadTranslation(translationName, translator);
-    app.installTranslator(&translator);
-
     QTranslator translatorQt;
-    nmc::DkSettingsManager::param().loadTranslation(translationNameQt, translatorQt);
-    app.installTranslator(&translatorQt);
+    {
+        nmc::DkTraceSpan ts("startup", "translations");
+        nmc::DkSettingsManager::param().loadTranslation(translationName, translator);
+        app.installTranslator(&translator);
+
+        nmc::DkSettingsManager::param().loadTranslation(translationNameQt, translatorQt);
+        app.installTranslator(&translatorQt);
+    }
 
     nmc::DkNoMacs *w = 0;
     nmc::DkPong *pw = 0; // pong
 
     // show pink icons if nomacs is in private mode
     if (parser.isSet(privateOpt)) {
-        nmc::DkSettingsManager::param().display().iconColor = QColor(136, 0, 125);
-        nmc::DkSettingsManager::param().app().privateMode = true;
+        nmc::DkSettingsManager::edit().display().iconColor = QColor(136, 0, 125);
+        nmc::DkSettingsManager::edit().app().privateMode = true;
     }
 
     if (parser.isSet(modeOpt)) {
@@ -234,10 +423,11 @@ int main(int argc, char *argv[])
         else
             qWarning() << "illegal mode: " << pm << "use either <default>, <frameless> or <pseudocolor>";
 
-        nmc::DkSettingsManager::param().app().currentAppMode = mode;
+        nmc::DkSettingsManager::edit().app().currentAppMode = mode;
     }
 
     nmc::DkTimer dt;
+    qint64 initStart = nmc::DkTracer::instance().now();
 
     // initialize nomacs
     if (mode == nmc::DkSettingsManager::param().mode_frameless) {
@@ -254,7 +444,8 @@ int main(int argc, char *argv[])
         w = new nmc::DkNoMacsIpl();
 
     // show what we got...
-    w->show();
+    if (!background)
+        w->show();
 
     // this triggers a first show
     QCoreApplication::sendPostedEvents();
@@ -262,10 +453,54 @@ int main(int argc, char *argv[])
     if (w)
         w->onWindowLoaded();
 
+    nmc::DkTracer::instance().record("startup", "initialization", QString(), initStart, nmc::DkTracer::instance().now());
     qInfo() << "Initialization takes: " << dt;
 
+    // replay a navigation trace
+    if (!parser.value(replayOpt).isEmpty()) {
+        int rVal = nmc::DkReplay::runReplay(parser.value(replayOpt), parser.value(replayResultsOpt), w);
+
+        if (!tracePath.isEmpty())
+            nmc::DkTracer::instance().exportChromeTrace(tracePath);
+
+        nmc::DkLogSink::instance().uninstall();
+        delete w;
+
+        return rVal;
+    }
+
     nmc::DkCentralWidget *cw = w->getTabWidget();
 
+    if (firstInstance) {
+        guard.listen();
+        QObject::connect(&guard, SIGNAL(filesReceived(const QStringList &)), w, SLOT(openFiles(const QStringList &)));
+    }
+
+    // keep running in the tray if the window is closed
+    if (background) {
+        app.setQuitOnLastWindowClosed(false);
+
+        QMenu *trayMenu = new QMenu(w);
+        trayMenu->addAction(QObject::tr("Open nomacs"), w, [w]() {
+            w->openFiles(QStringList());
+        });
+        trayMenu->addAction(QObject::tr("Quit"), &app, [w, &app]() {
+            // the window saves the settings if it is closed
+            if (w->close())
+                app.quit();
+        });
+
+        QSystemTrayIcon *trayIcon = new QSystemTrayIcon(w->windowIcon(), w);
+        trayIcon->setToolTip("nomacs");
+        trayIcon->setContextMenu(trayMenu);
+        trayIcon->show();
+
+        QObject::connect(trayIcon, &QSystemTrayIcon::activated, w, [w](QSystemTrayIcon::ActivationReason reason) {
+            if (reason == QSystemTrayIcon::Trigger)
+                w->openFiles(QStringList());
+        });
+    }
+
     bool loading = false;
 
     if (!parser.positionalArguments().empty()) {
@@ -299,8 +534,8 @@ int main(int argc, char *argv[])
 
     int fullScreenMode = settings.value("AppSettings/currentAppMode", nmc::DkSettingsManager::param().app().currentAppMode).toInt();
 
-    if (fullScreenMode == nmc::DkSettingsManager::param().mode_default_fullscreen || fullScreenMode == nmc::DkSettingsManager::param().mode_frameless_fullscreen
-        || fullScreenMode == nmc::DkSettingsManager::param().mode_contrast_fullscreen || parser.isSet(fullScreenOpt)) {
+    if ((fullScreenMode == nmc::DkSettingsManager::param().mode_default_fullscreen || fullScreenMode == nmc::DkSettingsManager::param().mode_frameless_fullscreen
+        || fullScreenMode == nmc::DkSettingsManager::param().mode_contrast_fullscreen || parser.isSet(fullScreenOpt)) && !background) {
         w->enterFullScreen();
         qDebug() << "trying to enter fullscreen...";
     }
@@ -323,7 +558,11 @@ int main(int argc, char *argv[])
     }
 
     // restore message handler, workaround for: https://github.com/nomacs/nomacs/issues/874
-    qInstallMessageHandler(0);
+    // this also writes pending messages and stops the log sink
+    nmc::DkLogSink::instance().uninstall();
+
+    if (!tracePath.isEmpty())
+        nmc::DkTracer::instance().exportChromeTrace(tracePath);
 
     if (w)
         delete w; // we need delete so that settings are saved (from destructors)